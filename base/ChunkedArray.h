@@ -0,0 +1,186 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef _RMS_CHUNKED_ARRAY_H
+#define _RMS_CHUNKED_ARRAY_H
+
+#include "config.h"
+#include <vector>
+
+namespace rms {
+
+/*
+ * Dense index-addressed array stored as fixed-size chunks. Chunks are shared between copies
+ * and duplicated on first write, exactly like RefCountedVector, so copying is O(#chunks).
+ * There is no free list or per-element reference count - this is meant for optional layers that
+ * run parallel to a RefCountedVector (eg per-vertex normals/colors in VFTriangleMesh), where the
+ * owner decides which indices are in use. Elements added by growing are set to the initial value.
+ * Thread-safety is also the same: parallel writes into one array need unshare() after the last copy.
+ */
+template<class Type>
+class ChunkedArray
+{
+public:
+	ChunkedArray( const Type & init = Type() ) : m_init(init)
+		{ m_nSize = 0; }
+	ChunkedArray( const ChunkedArray & copy ) : m_init(copy.m_init)
+		{ m_nSize = 0; share(copy); }
+	~ChunkedArray()
+		{ release(); }
+
+	const ChunkedArray & operator=( const ChunkedArray & copy ) {
+		if ( this != &copy ) {
+			release();
+			m_init = copy.m_init;
+			share(copy);
+		}
+		return *this;
+	}
+
+	inline unsigned int size() const { return m_nSize; }
+
+	//! grow (if necessary) so that nIndex is valid
+	inline void ensure( unsigned int nIndex ) {
+		if ( nIndex >= m_nSize )
+			grow( nIndex+1 );
+	}
+
+	void resize( unsigned int nSize ) {
+		if ( nSize > m_nSize ) {
+			grow(nSize);
+		} else {
+			m_nSize = nSize;
+			unsigned int nChunks = (nSize + ChunkMask) >> ChunkShift;
+			if ( nChunks < m_vChunks.size() ) {
+				#pragma omp critical(RefCountedVector_chunks)
+				{
+					for ( unsigned int k = nChunks; k < m_vChunks.size(); ++k )
+						release_chunk( m_vChunks[k] );
+				}
+				m_vChunks.resize(nChunks);
+				m_vOwned.resize(nChunks);
+			}
+		}
+	}
+
+	//! if !bFreeMem, unshared chunks are kept and re-initialized as the array grows again
+	void clear( bool bFreeMem = false ) {
+		if ( bFreeMem )
+			release();
+		m_nSize = 0;
+	}
+
+	//! set all elements to value
+	void fill( const Type & value ) {
+		for ( unsigned int k = 0; k < m_nSize; ++k )
+			(*this)[k] = value;
+	}
+
+	inline const Type & operator[]( unsigned int nIndex ) const {
+		lgASSERT( nIndex < m_nSize );
+		return m_vChunks[ nIndex >> ChunkShift ]->vData[ nIndex & ChunkMask ];
+	}
+	inline Type & operator[]( unsigned int nIndex ) {
+		lgASSERT( nIndex < m_nSize );
+		unsigned int nChunk = nIndex >> ChunkShift;
+		if ( ! m_vOwned[nChunk] )
+			detach(nChunk);
+		return m_vChunks[nChunk]->vData[ nIndex & ChunkMask ];
+	}
+
+	inline unsigned int chunk_count() const { return (unsigned int)m_vChunks.size(); }
+	unsigned int shared_chunk_count() const {
+		unsigned int nShared = 0;
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				if ( m_vChunks[k]->nShared > 1 )
+					++nShared;
+		}
+		return nShared;
+	}
+
+	//! duplicate all chunks that are shared with other arrays
+	void unshare() {
+		for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+			if ( ! m_vOwned[k] )
+				detach(k);
+	}
+
+protected:
+	enum {
+		ChunkShift = 10,
+		ChunkSize = 1 << ChunkShift,
+		ChunkMask = ChunkSize - 1
+	};
+	struct Chunk {
+		int nShared;
+		Type vData[ChunkSize];
+		Chunk() : nShared(1) {}
+	};
+	std::vector< Chunk * > m_vChunks;
+	mutable std::vector< unsigned char > m_vOwned;		//! as in RefCountedVector
+	unsigned int m_nSize;
+	Type m_init;
+
+	void grow( unsigned int nSize ) {
+		unsigned int nChunks = (nSize + ChunkMask) >> ChunkShift;
+		while ( m_vChunks.size() < nChunks ) {
+			m_vChunks.push_back( new Chunk() );
+			m_vOwned.push_back(1);
+		}
+		unsigned int nOldSize = m_nSize;
+		m_nSize = nSize;
+		for ( unsigned int k = nOldSize; k < nSize; ++k )
+			(*this)[k] = m_init;
+	}
+
+	// chunk reference counts share the RefCountedVector critical section, see comments there
+	void detach( unsigned int nChunk ) {
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			Chunk * pChunk = m_vChunks[nChunk];
+			if ( pChunk->nShared > 1 ) {
+				Chunk * pCopy = new Chunk(*pChunk);
+				pCopy->nShared = 1;
+				m_vChunks[nChunk] = pCopy;
+				--pChunk->nShared;
+			}
+			m_vOwned[nChunk] = 1;
+		}
+	}
+
+	void share( const ChunkedArray & copy ) {
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			m_vChunks = copy.m_vChunks;
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				++m_vChunks[k]->nShared;
+			m_vOwned.assign( m_vChunks.size(), 0 );
+			copy.m_vOwned.assign( m_vChunks.size(), 0 );
+		}
+		m_nSize = copy.m_nSize;
+	}
+
+	static void release_chunk( Chunk * pChunk ) {
+		if ( --pChunk->nShared == 0 )
+			delete pChunk;
+	}
+
+	void release() {
+		if ( m_vChunks.empty() )
+			return;
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				release_chunk( m_vChunks[k] );
+		}
+		m_vChunks.clear();
+		m_vOwned.clear();
+	}
+};
+
+
+} // end namespace rms
+
+#endif // _RMS_CHUNKED_ARRAY_H
@@ -18,40 +18,63 @@ namespace rms {
 
 #define INVALID_REFCOUNT std::numeric_limits<int>::max()
 
+/*
+ * Storage is a list of fixed-size chunks. Chunks are reference-counted and shared between
+ * copies of a RefCountedVector, so copying is O(#chunks). A chunk is duplicated the first time
+ * one of the copies writes to it (copy-on-write). Note that the non-const operator[] counts as a
+ * write, so use const access where possible on vectors that have been copied.
+ *
+ * All changes to chunk reference counts (copy, clear, destruction, chunk duplication) are guarded
+ * by a critical section, so vectors that share chunks can be copied/destroyed/written on different
+ * threads. Each vector also remembers which of its chunks it owns (is the only reference to), and
+ * writes to owned chunks don't touch the reference counts at all. Parallel writes to different
+ * elements of a single vector are only safe if it owns all its chunks, ie it was never copied or
+ * unshare() was called after the last copy. Otherwise two threads could duplicate the same chunk.
+ */
 template<class Type>
 class RefCountedVector
 {
 public:
 	RefCountedVector() 	
-		{ clear(); }
+		{ m_nMaxIndex = 0; clear(); }
+	RefCountedVector( const RefCountedVector & copy )
+		{ m_nMaxIndex = 0; share(copy); }
 	virtual ~RefCountedVector()
-		{}
+		{ release(); }
+
+	const RefCountedVector & operator=( const RefCountedVector & copy ) {
+		if ( this != &copy ) {
+			release();
+			share(copy);
+		}
+		return *this;
+	}
 
 	inline bool isValid( int nIndex ) const {
-		return ( nIndex < (int)m_vData.size() && m_vData[nIndex].nRefCount > 0 && m_vData[nIndex].nRefCount != INVALID_REFCOUNT );
+		return ( nIndex < (int)m_nMaxIndex && is_used(nIndex) );
 	}
 
 	inline int refCount( int nIndex ) const {
 		lgASSERT( isValid(nIndex)  );
-		return ( m_vData[nIndex].nRefCount > 0 && m_vData[nIndex].nRefCount != INVALID_REFCOUNT )
-			? m_vData[nIndex].nRefCount : 0;
+		return ( is_used(nIndex) ) ? entry(nIndex).nRefCount : 0;
 	}
 
 	inline int increment( int nIndex ) {
 		lgASSERT( isValid(nIndex)  );
-		return ++m_vData[nIndex].nRefCount;
+		return ++entry_w(nIndex).nRefCount;
 	}
 
 	inline void decrement( int nIndex ) {
 		lgASSERT( isValid(nIndex) );
-		--m_vData[nIndex].nRefCount;
-		lgASSERT( m_vData[nIndex].nRefCount >= 0 );
-		if ( m_vData[nIndex].nRefCount == 0 ) {			// add to empty list
+		RefEntry & e = entry_w(nIndex);
+		--e.nRefCount;
+		lgASSERT( e.nRefCount >= 0 );
+		if ( e.nRefCount == 0 ) {			// add to empty list
 			if ( m_nFirstFree == INVALID_REFCOUNT ) {
-				m_vData[nIndex].nRefCount = INVALID_REFCOUNT;
+				e.nRefCount = INVALID_REFCOUNT;
 				m_nFirstFree = nIndex;
 			} else {
-				m_vData[nIndex].nRefCount = -(m_nFirstFree+1);
+				e.nRefCount = -(m_nFirstFree+1);
 				m_nFirstFree = nIndex;
 			}
 			m_nUsedCount--;
@@ -61,17 +84,23 @@ public:
 	inline int insert( const Type & t ) {
 		m_nUsedCount++;
 		if ( m_nFirstFree == INVALID_REFCOUNT ) {
-			RefEntry r;
+			int nIndex = (int)m_nMaxIndex;
+			if ( (nIndex >> ChunkShift) == (int)m_vChunks.size() ) {
+				m_vChunks.push_back( new Chunk() );
+				m_vOwned.push_back(1);
+			}
+			m_nMaxIndex++;
+			RefEntry & r = entry_w(nIndex);
 			r.nRefCount = 1;
 			r.vecData = t;
-			m_vData.push_back(r);
-			return (int)(m_vData.size() - 1);
+			return nIndex;
 		} else {
 			int nFree = m_nFirstFree;
-			lgASSERT(nFree >= 0 && nFree < (int)m_vData.size());
-			int nNextFree = m_vData[ nFree ].nRefCount;
-			m_vData[nFree].nRefCount = 1;
-			m_vData[nFree].vecData = t;
+			lgASSERT(nFree >= 0 && nFree < (int)m_nMaxIndex);
+			RefEntry & r = entry_w(nFree);
+			int nNextFree = r.nRefCount;
+			r.nRefCount = 1;
+			r.vecData = t;
 			if ( nNextFree < 0 )
 				m_nFirstFree = -(nNextFree+1);
 			else {
@@ -83,57 +112,91 @@ public:
 	}
 
 	inline void remove( int nIndex ) {		// force remove
-		lgASSERT( (unsigned int)nIndex < m_vData.size() );
-		if ( m_vData[nIndex].nRefCount < 0 || m_vData[nIndex].nRefCount == INVALID_REFCOUNT )
+		lgASSERT( (unsigned int)nIndex < m_nMaxIndex );
+		if ( ! is_used(nIndex) )
 			return;			// already removed
+		RefEntry & e = entry_w(nIndex);
 		if ( m_nFirstFree == INVALID_REFCOUNT ) {
-			m_vData[nIndex].nRefCount = INVALID_REFCOUNT;
+			e.nRefCount = INVALID_REFCOUNT;
 			m_nFirstFree = nIndex;
 		} else {
-			m_vData[nIndex].nRefCount = -(m_nFirstFree+1);
+			e.nRefCount = -(m_nFirstFree+1);
 			m_nFirstFree = nIndex;
 		}
 		m_nUsedCount--;
 	}
 		
 
+	//! if bFreeMem is false, chunks that are not shared are kept for re-use
 	inline void clear( bool bFreeMem = false ) {
 		if ( bFreeMem )
-			m_vData.clear();
-		else
-			m_vData.resize(0);
+			release();
+		else {
+			#pragma omp critical(RefCountedVector_chunks)
+			{
+				size_t nKeep = 0, nChunks = m_vChunks.size();
+				for ( unsigned int k = 0; k < nChunks; ++k ) {
+					if ( m_vChunks[k]->nShared == 1 )
+						m_vChunks[nKeep++] = m_vChunks[k];
+					else
+						release_chunk( m_vChunks[k] );
+				}
+				m_vChunks.resize(nKeep);
+				m_vOwned.assign(nKeep, 1);
+			}
+		}
+		m_nMaxIndex = 0;
 		m_nFirstFree = INVALID_REFCOUNT;
 		m_nUsedCount = 0;
 	}
 
 
 	inline unsigned int size() const { return m_nUsedCount; }
-	inline unsigned int max_index() const { return (unsigned int)m_vData.size(); }
+	inline unsigned int max_index() const { return m_nMaxIndex; }
+
+	//! number of storage chunks, and how many of them are shared with other vectors
+	inline unsigned int chunk_count() const { return (unsigned int)m_vChunks.size(); }
+	unsigned int shared_chunk_count() const {
+		unsigned int nShared = 0;
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				if ( m_vChunks[k]->nShared > 1 )
+					++nShared;
+		}
+		return nShared;
+	}
+
+	//! duplicate all chunks that are shared with other vectors. Call this before writing to a copied vector from several threads
+	void unshare() {
+		for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+			if ( ! m_vOwned[k] )
+				detach(k);
+	}
 
 	inline Type & operator[]( int nIndex ) {
-		lgASSERT( nIndex < (int)m_vData.size() && m_vData[nIndex].nRefCount > 0 && m_vData[nIndex].nRefCount != INVALID_REFCOUNT  );
-		return m_vData[nIndex].vecData;
+		lgASSERT( nIndex < (int)m_nMaxIndex && is_used(nIndex) );
+		return entry_w(nIndex).vecData;
 	}
 	inline const Type & operator[]( int nIndex ) const {
-		lgASSERT( nIndex < (int)m_vData.size() && m_vData[nIndex].nRefCount > 0 && m_vData[nIndex].nRefCount != INVALID_REFCOUNT  );
-		return m_vData[nIndex].vecData;
+		lgASSERT( nIndex < (int)m_nMaxIndex && is_used(nIndex) );
+		return entry(nIndex).vecData;
 	}
 
 	std::string printData() const {
 		std::ostrstream out;
 		out << "[ F: ";
 		if ( m_nFirstFree == INVALID_REFCOUNT )
-			out << "X" << " VS: " <<  (int)m_vData.size() << " RS: " << m_nUsedCount << " ]" << std::endl;
+			out << "X" << " VS: " <<  (int)m_nMaxIndex << " RS: " << m_nUsedCount << " ]" << std::endl;
 		else
-			out << m_nFirstFree << " VS: " <<  (int)m_vData.size() << " RS: " << m_nUsedCount << " ]" << std::endl;
+			out << m_nFirstFree << " VS: " <<  (int)m_nMaxIndex << " RS: " << m_nUsedCount << " ]" << std::endl;
 
-		size_t nCount = m_vData.size();
-		for ( unsigned int i = 0; i  < nCount; ++i ) {
-			out << "  " << i << "[ " << *((int *)&m_vData[i].vecData) << "/" ;
-			if  ( m_vData[i].nRefCount == INVALID_REFCOUNT )
+		for ( unsigned int i = 0; i  < m_nMaxIndex; ++i ) {
+			out << "  " << i << "[ " << *((int *)&entry(i).vecData) << "/" ;
+			if  ( entry(i).nRefCount == INVALID_REFCOUNT )
 				out << "X ]";
 			else
-				out << m_vData[i].nRefCount << " ]";
+				out << entry(i).nRefCount << " ]";
 		}
 		out << std::endl << '\0';
 		return out.str();
@@ -144,29 +207,102 @@ protected:
 		int nRefCount;
 		Type vecData;
 	};
-	std::vector< RefEntry > m_vData;
+
+	enum {
+		ChunkShift = 10,
+		ChunkSize = 1 << ChunkShift,
+		ChunkMask = ChunkSize - 1
+	};
+	struct Chunk {
+		int nShared;				//! number of vectors referencing this chunk
+		RefEntry vEntries[ChunkSize];
+		Chunk() : nShared(1) {}
+	};
+	std::vector< Chunk * > m_vChunks;
+	mutable std::vector< unsigned char > m_vOwned;		//! 1 if this vector is the only reference to the chunk. Only set to 0 inside the critical section
+	unsigned int m_nMaxIndex;
 
 	unsigned int m_nUsedCount;
 	int m_nFirstFree;
 
+	inline const RefEntry & entry( int nIndex ) const 
+		{ return m_vChunks[ nIndex >> ChunkShift ]->vEntries[ nIndex & ChunkMask ]; }
+
+	inline RefEntry & entry_w( int nIndex ) {
+		unsigned int nChunk = (unsigned int)nIndex >> ChunkShift;
+		if ( ! m_vOwned[nChunk] )
+			detach(nChunk);
+		return m_vChunks[nChunk]->vEntries[ nIndex & ChunkMask ];
+	}
+
+	inline bool is_used( int nIndex ) const {
+		int nRefCount = entry(nIndex).nRefCount;
+		return nRefCount > 0 && nRefCount != INVALID_REFCOUNT;
+	}
+
+	void detach( unsigned int nChunk ) {
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			Chunk * pChunk = m_vChunks[nChunk];
+			if ( pChunk->nShared > 1 ) {
+				Chunk * pCopy = new Chunk(*pChunk);
+				pCopy->nShared = 1;
+				m_vChunks[nChunk] = pCopy;		// publish the copy before giving up the reference
+				--pChunk->nShared;
+			}
+			m_vOwned[nChunk] = 1;
+		}
+	}
+
+	void share( const RefCountedVector & copy ) {
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			m_vChunks = copy.m_vChunks;
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				++m_vChunks[k]->nShared;
+			m_vOwned.assign( m_vChunks.size(), 0 );
+			copy.m_vOwned.assign( m_vChunks.size(), 0 );
+		}
+		m_nMaxIndex = copy.m_nMaxIndex;
+		m_nUsedCount = copy.m_nUsedCount;
+		m_nFirstFree = copy.m_nFirstFree;
+	}
+
+	static void release_chunk( Chunk * pChunk ) {
+		if ( --pChunk->nShared == 0 )
+			delete pChunk;
+	}
+
+	void release() {
+		if ( m_vChunks.empty() )
+			return;
+		#pragma omp critical(RefCountedVector_chunks)
+		{
+			for ( unsigned int k = 0; k < m_vChunks.size(); ++k )
+				release_chunk( m_vChunks[k] );
+		}
+		m_vChunks.clear();
+		m_vOwned.clear();
+	}
+
 public:
 	class item_iterator
 	{
 	public:
-		inline item_iterator() { m_pCurrent = NULL; m_pLast = NULL;}
+		inline item_iterator() { m_nIndex = 0; m_pVector = NULL; }
 
 		inline item_iterator( item_iterator & copy ) {
-			m_pCurrent = copy.m_pCurrent;
-			m_pLast = copy.m_pLast;
+			m_nIndex = copy.m_nIndex;
+			m_pVector = copy.m_pVector;
 		}
 		
 		inline item_iterator(const item_iterator & copy ) {
-			m_pCurrent = copy.m_pCurrent;
-			m_pLast = copy.m_pLast;
+			m_nIndex = copy.m_nIndex;
+			m_pVector = copy.m_pVector;
 		}
 
 		inline RefEntry & operator*() { 
-			return *m_pCurrent;
+			return m_pVector->entry_w(m_nIndex);
 		}
 
 		inline item_iterator & operator++() {		// prefix
@@ -180,37 +316,38 @@ public:
 		}
 
 		inline bool operator==( item_iterator & r2 ) {
-			return m_pCurrent == r2.m_pCurrent;
+			return m_nIndex == r2.m_nIndex;
 		}
 		inline bool operator!=( item_iterator & r2 ) {
-			return m_pCurrent != r2.m_pCurrent;
+			return m_nIndex != r2.m_nIndex;
 		}
 
 	protected:
 		inline void goto_next() {
-			if ( m_pCurrent != m_pLast )
-				m_pCurrent++;
-			while ( (m_pCurrent->nRefCount <= 0 || m_pCurrent->nRefCount == INVALID_REFCOUNT) && m_pCurrent != m_pLast )
-				m_pCurrent++;
+			int nMax = (int)m_pVector->m_nMaxIndex;
+			if ( m_nIndex < nMax )
+				m_nIndex++;
+			while ( m_nIndex < nMax && ! m_pVector->is_used(m_nIndex) )
+				m_nIndex++;
 		}
 
-		inline item_iterator( RefEntry * pCurrent, RefEntry * pLast )
+		inline item_iterator( int nIndex, RefCountedVector * pVector )
 		{
-			m_pCurrent = pCurrent;
-			m_pLast = pLast;
-			if ( (m_pCurrent->nRefCount <= 0 || m_pCurrent->nRefCount == INVALID_REFCOUNT) )
+			m_nIndex = nIndex;
+			m_pVector = pVector;
+			if ( m_nIndex < (int)m_pVector->m_nMaxIndex && ! m_pVector->is_used(m_nIndex) )
 				goto_next();		// initialize
 		}
-		RefEntry * m_pCurrent;
-		RefEntry * m_pLast;
+		int m_nIndex;
+		RefCountedVector * m_pVector;
 		friend class RefCountedVector;
 	};
 
 	inline item_iterator begin_items() {
-		return item_iterator( &m_vData.front(), &m_vData.back() + 1 );
+		return item_iterator( 0, this );
 	}
 	inline item_iterator end_items() {
-		return item_iterator( &m_vData.back() + 1, &m_vData.back() + 1 );
+		return item_iterator( (int)m_nMaxIndex, this );
 	}
 
 
@@ -218,12 +355,13 @@ public:
 	class index_iterator
 	{
 	public:
-		inline index_iterator() { m_nIndex = 0; m_pCurrent = NULL; m_pLast = NULL;}
+		inline index_iterator() { m_nIndex = 0; m_nMax = 0; m_pEntry = NULL; m_pVector = NULL; }
 
 		inline index_iterator( const index_iterator & copy ) {
 			m_nIndex = copy.m_nIndex;
-			m_pCurrent = copy.m_pCurrent;
-			m_pLast = copy.m_pLast;
+			m_nMax = copy.m_nMax;
+			m_pEntry = copy.m_pEntry;
+			m_pVector = copy.m_pVector;
 		}
 
 		inline int operator*() { 
@@ -241,52 +379,52 @@ public:
 		}
 
 		inline bool operator==( index_iterator & r2 ) {
-			return m_pCurrent == r2.m_pCurrent;
+			return m_nIndex == r2.m_nIndex;
 		}
 		inline bool operator!=( index_iterator & r2 ) {
-			return m_pCurrent != r2.m_pCurrent;
+			return m_nIndex != r2.m_nIndex;
 		}
 
 	protected:
+		// walk entry pointer within a chunk, only look up chunk at chunk boundaries
+		inline void step() {
+			++m_nIndex;
+			if ( (m_nIndex & ChunkMask) == 0 )
+				m_pEntry = ( m_nIndex < m_nMax ) ? &m_pVector->entry(m_nIndex) : NULL;
+			else
+				++m_pEntry;
+		}
+		inline bool is_used() const {
+			return m_pEntry->nRefCount > 0 && m_pEntry->nRefCount != INVALID_REFCOUNT;
+		}
 		inline void goto_next() {
-			if ( m_pCurrent != m_pLast ) {
-				m_pCurrent++;
-				m_nIndex++;
-			}
-			while ( (m_pCurrent->nRefCount <= 0 || m_pCurrent->nRefCount == INVALID_REFCOUNT) && m_pCurrent != m_pLast ) {
-				m_pCurrent++;
-				m_nIndex++;
-			}
+			if ( m_nIndex < m_nMax )
+				step();
+			while ( m_nIndex < m_nMax && ! is_used() )
+				step();
 		}
 
-		inline index_iterator( int nIndex, const RefEntry * pCurrent, const RefEntry * pLast )
+		inline index_iterator( int nIndex, const RefCountedVector * pVector )
 		{
 			m_nIndex = nIndex;
-			m_pCurrent = pCurrent;
-			m_pLast = pLast;
-			if ( m_pCurrent == m_pLast )
-				;		// do nothing - finished!
-			else if ( (m_pCurrent->nRefCount <= 0 || m_pCurrent->nRefCount == INVALID_REFCOUNT) )
+			m_nMax = (int)pVector->m_nMaxIndex;
+			m_pVector = pVector;
+			m_pEntry = ( m_nIndex < m_nMax ) ? &m_pVector->entry(m_nIndex) : NULL;
+			if ( m_nIndex < m_nMax && ! is_used() )
 				goto_next();		// initialize
 		}
 		int m_nIndex;
-		const RefEntry * m_pCurrent;
-		const RefEntry * m_pLast;
+		int m_nMax;
+		const RefEntry * m_pEntry;
+		const RefCountedVector * m_pVector;
 		friend class RefCountedVector;
 	};
 
 	inline index_iterator begin_indexes() const {
-		if ( m_vData.empty() )
-			return end_indexes();
-		else
-			return index_iterator( (int)0, &m_vData.front(), &m_vData.back() + 1 );
+		return index_iterator( 0, this );
 	}
 	inline index_iterator end_indexes() const {
-		if ( m_vData.size() == 0 ) 
-			return index_iterator( 0, NULL, NULL );
-		else
-			return index_iterator( (int)m_vData.size(), &m_vData.back() + 1, &m_vData.back() + 1 );
-//			return index_iterator( (int)m_vData.size(), &m_vData.back() + 1, &m_vData.back() + 1 );
+		return index_iterator( (int)m_nMaxIndex, this );
 	}
 };
 
@@ -4,8 +4,8 @@
 #include "PolyLoop3.h"
 
 #include <Wm4Segment3.h>
-#include <Wm4DistVector3Segment3.h>
 #include <VectorUtil.h>
+#include <TriangleKernels.h>
 #include <limits>
 #include <fstream>
 #include <opengl.h>
@@ -60,17 +60,13 @@ Real PolyLoop3<Real>::SqrDistance( const Wml::Vector3<Real> & vPoint, Wml::Vecto
 
 	size_t nCount = m_vVertices.size();
 	for ( unsigned int i = 0; i < nCount-1; ++i ) {
-
-		Wml::Segment3<Real> seg;
-		seg.Origin = m_vVertices[i];
-		seg.Direction = m_vVertices[ i+1 ] - seg.Origin;
-		seg.Extent = seg.Direction.Normalize();
-
-		Wml::DistVector3Segment3<Real> dist(vPoint, seg);
-		Real fSqrDist = dist.GetSquared();
+		const Wml::Vector3<Real> & a = m_vVertices[i];
+		const Wml::Vector3<Real> & b = m_vVertices[i+1];
+		Real fT;
+		Real fSqrDist = PointSegmentSqrDistance( vPoint, a, b, fT );
 		if ( fSqrDist < fMinSqrDist ) {
 			fMinSqrDist = fSqrDist;
-			vMinNearest = dist.GetClosestPoint1();
+			vMinNearest = a + fT * (b - a);
 			nMinIndex = i;
 		}
 	}
@@ -0,0 +1,287 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "ExactPredicates.h"
+#include <vector>
+#include <cmath>
+
+using namespace rms;
+
+
+/*
+ * static error bounds for the double-precision filters (Shewchuk's xxxerrboundA),
+ * with epsilon = 2^-53
+ */
+static const double s_fEpsilon = 1.1102230246251565e-16;
+static const double s_fCCWErrBound = (3.0 + 16.0 * s_fEpsilon) * s_fEpsilon;
+static const double s_fO3DErrBound = (7.0 + 56.0 * s_fEpsilon) * s_fEpsilon;
+static const double s_fICCErrBound = (10.0 + 96.0 * s_fEpsilon) * s_fEpsilon;
+static const double s_fISPErrBound = (16.0 + 224.0 * s_fEpsilon) * s_fEpsilon;
+
+
+
+/*
+ * floating-point expansions: a value is stored as a sum of non-overlapping doubles,
+ * in increasing order of magnitude, with zero components removed. This is the slow
+ * general-purpose path; it only runs when the filter fails.
+ */
+typedef std::vector<double> Expansion;
+
+static inline void TwoSum( double a, double b, double & x, double & y )
+{
+	x = a + b;
+	double bv = x - a;
+	double av = x - bv;
+	y = (a - av) + (b - bv);
+}
+
+static inline void Split( double a, double & hi, double & lo )
+{
+	double c = 134217729.0 * a;		// 2^27 + 1
+	double abig = c - a;
+	hi = c - abig;
+	lo = a - hi;
+}
+
+static inline void TwoProduct( double a, double b, double & x, double & y )
+{
+	x = a * b;
+	double ahi, alo, bhi, blo;
+	Split(a, ahi, alo);
+	Split(b, bhi, blo);
+	double err1 = x - (ahi * bhi);
+	double err2 = err1 - (alo * bhi);
+	double err3 = err2 - (ahi * blo);
+	y = (alo * blo) - err3;
+}
+
+// exact a - b
+static Expansion Diff( double a, double b )
+{
+	double x, y;
+	TwoSum( a, -b, x, y );
+	Expansion e;
+	if ( y != 0 ) e.push_back(y);
+	if ( x != 0 ) e.push_back(x);
+	return e;
+}
+
+// h = e + b  (Shewchuk grow_expansion_zeroelim)
+static void Grow( const Expansion & e, double b, Expansion & h )
+{
+	h.resize(0);
+	double Q = b;
+	for ( size_t i = 0; i < e.size(); ++i ) {
+		double Qnew, hh;
+		TwoSum( Q, e[i], Qnew, hh );
+		Q = Qnew;
+		if ( hh != 0 )
+			h.push_back(hh);
+	}
+	if ( Q != 0 )
+		h.push_back(Q);
+}
+
+static Expansion Add( const Expansion & e, const Expansion & f )
+{
+	Expansion h(e), tmp;
+	for ( size_t j = 0; j < f.size(); ++j ) {
+		Grow( h, f[j], tmp );
+		h.swap(tmp);
+	}
+	return h;
+}
+
+static Expansion Sub( const Expansion & e, const Expansion & f )
+{
+	Expansion g(f);
+	for ( size_t j = 0; j < g.size(); ++j )
+		g[j] = -g[j];
+	return Add( e, g );
+}
+
+// h = e * b  (Shewchuk scale_expansion_zeroelim)
+static void Scale( const Expansion & e, double b, Expansion & h )
+{
+	h.resize(0);
+	if ( e.empty() || b == 0 )
+		return;
+	double Q, hh;
+	TwoProduct( e[0], b, Q, hh );
+	if ( hh != 0 )
+		h.push_back(hh);
+	for ( size_t i = 1; i < e.size(); ++i ) {
+		double p1, p0, sum;
+		TwoProduct( e[i], b, p1, p0 );
+		TwoSum( Q, p0, sum, hh );
+		if ( hh != 0 )
+			h.push_back(hh);
+		TwoSum( p1, sum, Q, hh );
+		if ( hh != 0 )
+			h.push_back(hh);
+	}
+	if ( Q != 0 )
+		h.push_back(Q);
+}
+
+static Expansion Mul( const Expansion & e, const Expansion & f )
+{
+	Expansion h, t;
+	for ( size_t j = 0; j < f.size(); ++j ) {
+		Scale( e, f[j], t );
+		h = Add( h, t );
+	}
+	return h;
+}
+
+static inline double Estimate( const Expansion & e )
+{
+	return (e.empty()) ? 0.0 : e.back();
+}
+
+
+
+
+double rms::Orient2D( const double * pa, const double * pb, const double * pc )
+{
+	double detleft = (pa[0] - pc[0]) * (pb[1] - pc[1]);
+	double detright = (pa[1] - pc[1]) * (pb[0] - pc[0]);
+	double det = detleft - detright;
+	double fBound = s_fCCWErrBound * (fabs(detleft) + fabs(detright));
+	if ( det > fBound || -det > fBound )
+		return det;
+
+	Expansion acx( Diff(pa[0], pc[0]) ), acy( Diff(pa[1], pc[1]) );
+	Expansion bcx( Diff(pb[0], pc[0]) ), bcy( Diff(pb[1], pc[1]) );
+	return Estimate( Sub( Mul(acx, bcy), Mul(acy, bcx) ) );
+}
+
+
+double rms::Orient3D( const double * pa, const double * pb, const double * pc, const double * pd )
+{
+	double adx = pa[0] - pd[0], ady = pa[1] - pd[1], adz = pa[2] - pd[2];
+	double bdx = pb[0] - pd[0], bdy = pb[1] - pd[1], bdz = pb[2] - pd[2];
+	double cdx = pc[0] - pd[0], cdy = pc[1] - pd[1], cdz = pc[2] - pd[2];
+
+	double bdycdz = bdy * cdz, bdzcdy = bdz * cdy;
+	double cdyadz = cdy * adz, cdzady = cdz * ady;
+	double adybdz = ady * bdz, adzbdy = adz * bdy;
+	double det = adx * (bdycdz - bdzcdy) + bdx * (cdyadz - cdzady) + cdx * (adybdz - adzbdy);
+	double fPermanent = (fabs(bdycdz) + fabs(bdzcdy)) * fabs(adx)
+					  + (fabs(cdyadz) + fabs(cdzady)) * fabs(bdx)
+					  + (fabs(adybdz) + fabs(adzbdy)) * fabs(cdx);
+	double fBound = s_fO3DErrBound * fPermanent;
+	if ( det > fBound || -det > fBound )
+		return det;
+
+	Expansion eadx( Diff(pa[0], pd[0]) ), eady( Diff(pa[1], pd[1]) ), eadz( Diff(pa[2], pd[2]) );
+	Expansion ebdx( Diff(pb[0], pd[0]) ), ebdy( Diff(pb[1], pd[1]) ), ebdz( Diff(pb[2], pd[2]) );
+	Expansion ecdx( Diff(pc[0], pd[0]) ), ecdy( Diff(pc[1], pd[1]) ), ecdz( Diff(pc[2], pd[2]) );
+
+	Expansion t1( Mul( eadx, Sub( Mul(ebdy, ecdz), Mul(ebdz, ecdy) ) ) );
+	Expansion t2( Mul( ebdx, Sub( Mul(ecdy, eadz), Mul(ecdz, eady) ) ) );
+	Expansion t3( Mul( ecdx, Sub( Mul(eady, ebdz), Mul(eadz, ebdy) ) ) );
+	return Estimate( Add( Add(t1, t2), t3 ) );
+}
+
+
+double rms::InCircle( const double * pa, const double * pb, const double * pc, const double * pd )
+{
+	double adx = pa[0] - pd[0], ady = pa[1] - pd[1];
+	double bdx = pb[0] - pd[0], bdy = pb[1] - pd[1];
+	double cdx = pc[0] - pd[0], cdy = pc[1] - pd[1];
+
+	double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+	double cdxady = cdx * ady, adxcdy = adx * cdy;
+	double adxbdy = adx * bdy, bdxady = bdx * ady;
+	double alift = adx * adx + ady * ady;
+	double blift = bdx * bdx + bdy * bdy;
+	double clift = cdx * cdx + cdy * cdy;
+
+	double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+	double fPermanent = (fabs(bdxcdy) + fabs(cdxbdy)) * alift
+					  + (fabs(cdxady) + fabs(adxcdy)) * blift
+					  + (fabs(adxbdy) + fabs(bdxady)) * clift;
+	double fBound = s_fICCErrBound * fPermanent;
+	if ( det > fBound || -det > fBound )
+		return det;
+
+	Expansion eadx( Diff(pa[0], pd[0]) ), eady( Diff(pa[1], pd[1]) );
+	Expansion ebdx( Diff(pb[0], pd[0]) ), ebdy( Diff(pb[1], pd[1]) );
+	Expansion ecdx( Diff(pc[0], pd[0]) ), ecdy( Diff(pc[1], pd[1]) );
+	Expansion ealift( Add( Mul(eadx, eadx), Mul(eady, eady) ) );
+	Expansion eblift( Add( Mul(ebdx, ebdx), Mul(ebdy, ebdy) ) );
+	Expansion eclift( Add( Mul(ecdx, ecdx), Mul(ecdy, ecdy) ) );
+
+	Expansion t1( Mul( ealift, Sub( Mul(ebdx, ecdy), Mul(ecdx, ebdy) ) ) );
+	Expansion t2( Mul( eblift, Sub( Mul(ecdx, eady), Mul(eadx, ecdy) ) ) );
+	Expansion t3( Mul( eclift, Sub( Mul(eadx, ebdy), Mul(ebdx, eady) ) ) );
+	return Estimate( Add( Add(t1, t2), t3 ) );
+}
+
+
+double rms::InSphere( const double * pa, const double * pb, const double * pc, const double * pd, const double * pe )
+{
+	double aex = pa[0] - pe[0], aey = pa[1] - pe[1], aez = pa[2] - pe[2];
+	double bex = pb[0] - pe[0], bey = pb[1] - pe[1], bez = pb[2] - pe[2];
+	double cex = pc[0] - pe[0], cey = pc[1] - pe[1], cez = pc[2] - pe[2];
+	double dex = pd[0] - pe[0], dey = pd[1] - pe[1], dez = pd[2] - pe[2];
+
+	double aexbey = aex * bey, bexaey = bex * aey;
+	double bexcey = bex * cey, cexbey = cex * bey;
+	double cexdey = cex * dey, dexcey = dex * cey;
+	double dexaey = dex * aey, aexdey = aex * dey;
+	double aexcey = aex * cey, cexaey = cex * aey;
+	double bexdey = bex * dey, dexbey = dex * bey;
+
+	double ab = aexbey - bexaey, bc = bexcey - cexbey, cd = cexdey - dexcey;
+	double da = dexaey - aexdey, ac = aexcey - cexaey, bd = bexdey - dexbey;
+
+	double abc = aez * bc - bez * ac + cez * ab;
+	double bcd = bez * cd - cez * bd + dez * bc;
+	double cda = cez * da + dez * ac + aez * cd;
+	double dab = dez * ab + aez * bd + bez * da;
+
+	double alift = aex * aex + aey * aey + aez * aez;
+	double blift = bex * bex + bey * bey + bez * bez;
+	double clift = cex * cex + cey * cey + cez * cez;
+	double dlift = dex * dex + dey * dey + dez * dez;
+
+	double det = (dlift * abc - clift * dab) + (blift * cda - alift * bcd);
+
+	double pab = fabs(aexbey) + fabs(bexaey), pbc = fabs(bexcey) + fabs(cexbey), pcd = fabs(cexdey) + fabs(dexcey);
+	double pda = fabs(dexaey) + fabs(aexdey), pac = fabs(aexcey) + fabs(cexaey), pbd = fabs(bexdey) + fabs(dexbey);
+	double fPermanent = ( (pcd * fabs(bez) + pbd * fabs(cez) + pbc * fabs(dez)) * alift )
+					  + ( (pda * fabs(cez) + pac * fabs(dez) + pcd * fabs(aez)) * blift )
+					  + ( (pab * fabs(dez) + pbd * fabs(aez) + pda * fabs(bez)) * clift )
+					  + ( (pbc * fabs(aez) + pac * fabs(bez) + pab * fabs(cez)) * dlift );
+	double fBound = s_fISPErrBound * fPermanent;
+	if ( det > fBound || -det > fBound )
+		return det;
+
+	Expansion eaex( Diff(pa[0], pe[0]) ), eaey( Diff(pa[1], pe[1]) ), eaez( Diff(pa[2], pe[2]) );
+	Expansion ebex( Diff(pb[0], pe[0]) ), ebey( Diff(pb[1], pe[1]) ), ebez( Diff(pb[2], pe[2]) );
+	Expansion ecex( Diff(pc[0], pe[0]) ), ecey( Diff(pc[1], pe[1]) ), ecez( Diff(pc[2], pe[2]) );
+	Expansion edex( Diff(pd[0], pe[0]) ), edey( Diff(pd[1], pe[1]) ), edez( Diff(pd[2], pe[2]) );
+
+	Expansion eab( Sub( Mul(eaex, ebey), Mul(ebex, eaey) ) );
+	Expansion ebc( Sub( Mul(ebex, ecey), Mul(ecex, ebey) ) );
+	Expansion ecd( Sub( Mul(ecex, edey), Mul(edex, ecey) ) );
+	Expansion eda( Sub( Mul(edex, eaey), Mul(eaex, edey) ) );
+	Expansion eac( Sub( Mul(eaex, ecey), Mul(ecex, eaey) ) );
+	Expansion ebd( Sub( Mul(ebex, edey), Mul(edex, ebey) ) );
+
+	Expansion eabc( Add( Sub( Mul(eaez, ebc), Mul(ebez, eac) ), Mul(ecez, eab) ) );
+	Expansion ebcd( Add( Sub( Mul(ebez, ecd), Mul(ecez, ebd) ), Mul(edez, ebc) ) );
+	Expansion ecda( Add( Add( Mul(ecez, eda), Mul(edez, eac) ), Mul(eaez, ecd) ) );
+	Expansion edab( Add( Add( Mul(edez, eab), Mul(eaez, ebd) ), Mul(ebez, eda) ) );
+
+	Expansion ealift( Add( Add( Mul(eaex, eaex), Mul(eaey, eaey) ), Mul(eaez, eaez) ) );
+	Expansion eblift( Add( Add( Mul(ebex, ebex), Mul(ebey, ebey) ), Mul(ebez, ebez) ) );
+	Expansion eclift( Add( Add( Mul(ecex, ecex), Mul(ecey, ecey) ), Mul(ecez, ecez) ) );
+	Expansion edlift( Add( Add( Mul(edex, edex), Mul(edey, edey) ), Mul(edez, edez) ) );
+
+	Expansion t1( Sub( Mul(edlift, eabc), Mul(eclift, edab) ) );
+	Expansion t2( Sub( Mul(eblift, ecda), Mul(ealift, ebcd) ) );
+	return Estimate( Add(t1, t2) );
+}
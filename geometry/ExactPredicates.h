@@ -0,0 +1,34 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_EXACT_PREDICATES_H__
+#define __RMS_EXACT_PREDICATES_H__
+#include "config.h"
+
+/*
+ * Robust geometric predicates (after Shewchuk, "Adaptive Precision Floating-Point Arithmetic
+ * and Fast Robust Geometric Predicates"). Each predicate first evaluates the determinant in
+ * double precision and checks it against a static error bound; only if the sign is uncertain
+ * is the determinant re-evaluated exactly with floating-point expansions. The return value
+ * has the correct sign, but its magnitude is only approximate.
+ *
+ * Sign conventions follow Shewchuk:
+ *   Orient2D(a,b,c)     > 0 if a,b,c are in counter-clockwise order
+ *   Orient3D(a,b,c,d)   > 0 if d lies below the plane of a,b,c (ie a,b,c appear counter-clockwise seen from above)
+ *   InCircle(a,b,c,d)   > 0 if d lies inside the circle through a,b,c (a,b,c counter-clockwise)
+ *   InSphere(a,b,c,d,e) > 0 if e lies inside the sphere through a,b,c,d (Orient3D(a,b,c,d) > 0)
+ *
+ * Points are const double pointers, so Wml::Vector2d / Wml::Vector3d can be passed directly.
+ */
+
+namespace rms
+{
+
+double Orient2D( const double * pa, const double * pb, const double * pc );
+double Orient3D( const double * pa, const double * pb, const double * pc, const double * pd );
+double InCircle( const double * pa, const double * pb, const double * pc, const double * pd );
+double InSphere( const double * pa, const double * pb, const double * pc, const double * pd, const double * pe );
+
+}  // end namespace rms
+
+#endif // __RMS_EXACT_PREDICATES_H__
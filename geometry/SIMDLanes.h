@@ -0,0 +1,102 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_SIMD_LANES_H__
+#define __RMS_SIMD_LANES_H__
+#include "config.h"
+#include <cmath>
+
+/*
+ * Thin wrappers around SSE / AVX registers, so that a batch kernel can be written once
+ * as a template over the lane type and instantiated for Float4 (SSE), Float8 (AVX), or
+ * plain float/double (scalar fallback). Comparisons return a lane mask for the SIMD types
+ * and bool for the scalar types; in both cases the mask is only meant to be passed on to
+ * Select() or combined with &, |.
+ *
+ * RMS_SIMD_SSE / RMS_SIMD_AVX are defined if the compiler targets those instruction sets.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RMS_SIMD_SSE
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define RMS_SIMD_AVX
+#include <immintrin.h>
+#endif
+
+
+namespace rms
+{
+namespace SIMD
+{
+
+	// scalar lanes
+	inline float Select( bool mask, float a, float b ) { return mask ? a : b; }
+	inline double Select( bool mask, double a, double b ) { return mask ? a : b; }
+	inline float Abs( float a ) { return (float)fabs(a); }
+	inline double Abs( double a ) { return fabs(a); }
+	inline float Sqrt( float a ) { return (float)sqrt(a); }
+	inline double Sqrt( double a ) { return sqrt(a); }
+
+
+#ifdef RMS_SIMD_SSE
+	struct Float4 {
+		__m128 m;
+		enum { Width = 4 };
+		inline Float4() {}
+		inline Float4( __m128 v ) : m(v) {}
+		inline explicit Float4( float f ) : m( _mm_set1_ps(f) ) {}
+		static inline Float4 Load( const float * p ) { return _mm_loadu_ps(p); }
+		inline void Store( float * p ) const { _mm_storeu_ps(p, m); }
+	};
+	inline Float4 operator+( Float4 a, Float4 b ) { return _mm_add_ps(a.m, b.m); }
+	inline Float4 operator-( Float4 a, Float4 b ) { return _mm_sub_ps(a.m, b.m); }
+	inline Float4 operator-( Float4 a ) { return _mm_xor_ps( _mm_set1_ps(-0.0f), a.m ); }
+	inline Float4 operator*( Float4 a, Float4 b ) { return _mm_mul_ps(a.m, b.m); }
+	inline Float4 operator/( Float4 a, Float4 b ) { return _mm_div_ps(a.m, b.m); }
+	inline Float4 operator<( Float4 a, Float4 b ) { return _mm_cmplt_ps(a.m, b.m); }
+	inline Float4 operator<=( Float4 a, Float4 b ) { return _mm_cmple_ps(a.m, b.m); }
+	inline Float4 operator>=( Float4 a, Float4 b ) { return _mm_cmpge_ps(a.m, b.m); }
+	inline Float4 operator>( Float4 a, Float4 b ) { return _mm_cmpgt_ps(a.m, b.m); }
+	inline Float4 operator&( Float4 a, Float4 b ) { return _mm_and_ps(a.m, b.m); }
+	inline Float4 operator|( Float4 a, Float4 b ) { return _mm_or_ps(a.m, b.m); }
+	inline Float4 Select( Float4 mask, Float4 a, Float4 b )
+		{ return _mm_or_ps( _mm_and_ps(mask.m, a.m), _mm_andnot_ps(mask.m, b.m) ); }
+	inline Float4 Abs( Float4 a ) { return _mm_andnot_ps( _mm_set1_ps(-0.0f), a.m ); }
+	inline Float4 Sqrt( Float4 a ) { return _mm_sqrt_ps(a.m); }
+	inline int MoveMask( Float4 a ) { return _mm_movemask_ps(a.m); }
+#endif
+
+#ifdef RMS_SIMD_AVX
+	struct Float8 {
+		__m256 m;
+		enum { Width = 8 };
+		inline Float8() {}
+		inline Float8( __m256 v ) : m(v) {}
+		inline explicit Float8( float f ) : m( _mm256_set1_ps(f) ) {}
+		static inline Float8 Load( const float * p ) { return _mm256_loadu_ps(p); }
+		inline void Store( float * p ) const { _mm256_storeu_ps(p, m); }
+	};
+	inline Float8 operator+( Float8 a, Float8 b ) { return _mm256_add_ps(a.m, b.m); }
+	inline Float8 operator-( Float8 a, Float8 b ) { return _mm256_sub_ps(a.m, b.m); }
+	inline Float8 operator-( Float8 a ) { return _mm256_xor_ps( _mm256_set1_ps(-0.0f), a.m ); }
+	inline Float8 operator*( Float8 a, Float8 b ) { return _mm256_mul_ps(a.m, b.m); }
+	inline Float8 operator/( Float8 a, Float8 b ) { return _mm256_div_ps(a.m, b.m); }
+	inline Float8 operator<( Float8 a, Float8 b ) { return _mm256_cmp_ps(a.m, b.m, _CMP_LT_OQ); }
+	inline Float8 operator<=( Float8 a, Float8 b ) { return _mm256_cmp_ps(a.m, b.m, _CMP_LE_OQ); }
+	inline Float8 operator>=( Float8 a, Float8 b ) { return _mm256_cmp_ps(a.m, b.m, _CMP_GE_OQ); }
+	inline Float8 operator>( Float8 a, Float8 b ) { return _mm256_cmp_ps(a.m, b.m, _CMP_GT_OQ); }
+	inline Float8 operator&( Float8 a, Float8 b ) { return _mm256_and_ps(a.m, b.m); }
+	inline Float8 operator|( Float8 a, Float8 b ) { return _mm256_or_ps(a.m, b.m); }
+	inline Float8 Select( Float8 mask, Float8 a, Float8 b )
+		{ return _mm256_blendv_ps( b.m, a.m, mask.m ); }
+	inline Float8 Abs( Float8 a ) { return _mm256_andnot_ps( _mm256_set1_ps(-0.0f), a.m ); }
+	inline Float8 Sqrt( Float8 a ) { return _mm256_sqrt_ps(a.m); }
+	inline int MoveMask( Float8 a ) { return _mm256_movemask_ps(a.m); }
+#endif
+
+}  // end namespace SIMD
+}  // end namespace rms
+
+#endif // __RMS_SIMD_LANES_H__
@@ -0,0 +1,206 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "SpatialSort.h"
+#include <algorithm>
+#include <limits>
+
+using namespace rms;
+
+
+// Skilling, "Programming the Hilbert curve" (2004). Transforms axis coordinates of nBits bits
+// each into the "transposed" Hilbert index, which is then interleaved into a single key
+static SpatialSortKey HilbertKey( unsigned int X[3], int nBits, int nDim )
+{
+	unsigned int M = 1u << (nBits-1);
+
+	// inverse undo
+	for ( unsigned int Q = M; Q > 1; Q >>= 1 ) {
+		unsigned int P = Q - 1;
+		for ( int i = 0; i < nDim; ++i ) {
+			if ( X[i] & Q ) {
+				X[0] ^= P;
+			} else {
+				unsigned int t = (X[0] ^ X[i]) & P;
+				X[0] ^= t;  X[i] ^= t;
+			}
+		}
+	}
+
+	// gray encode
+	for ( int i = 1; i < nDim; ++i )
+		X[i] ^= X[i-1];
+	unsigned int t = 0;
+	for ( unsigned int Q = M; Q > 1; Q >>= 1 )
+		if ( X[nDim-1] & Q )
+			t ^= Q - 1;
+	for ( int i = 0; i < nDim; ++i )
+		X[i] ^= t;
+
+	SpatialSortKey nKey = 0;
+	for ( int b = nBits-1; b >= 0; --b )
+		for ( int i = 0; i < nDim; ++i )
+			nKey = (nKey << 1) | ((X[i] >> b) & 1);
+	return nKey;
+}
+
+
+void rms::HilbertKeys( const double * pPoints, unsigned int nCount, int nDim, std::vector<SpatialSortKey> & vKeys )
+{
+	vKeys.resize(nCount);
+	if ( nCount == 0 )
+		return;
+
+	double fMin[3], fMax[3];
+	for ( int k = 0; k < nDim; ++k )
+		fMin[k] = fMax[k] = pPoints[k];
+	for ( unsigned int i = 1; i < nCount; ++i ) {
+		for ( int k = 0; k < nDim; ++k ) {
+			double f = pPoints[nDim*i + k];
+			if ( f < fMin[k] ) fMin[k] = f;
+			if ( f > fMax[k] ) fMax[k] = f;
+		}
+	}
+
+	// 31 bits per axis in 2D, 21 in 3D, so key fits in 64 bits. Uniform scale keeps the curve undistorted
+	int nBits = (nDim == 2) ? 31 : 21;
+	double fRange = 0;
+	for ( int k = 0; k < nDim; ++k )
+		fRange = std::max( fRange, fMax[k] - fMin[k] );
+	double fMaxCoord = (double)( (1u << nBits) - 1 );
+	double fScale = (fRange > 0) ? fMaxCoord / fRange : 0;
+
+	int nPoints = (int)nCount;
+	#pragma omp parallel for schedule(static) if(nPoints > 16384)
+	for ( int i = 0; i < nPoints; ++i ) {
+		unsigned int X[3] = {0,0,0};
+		for ( int k = 0; k < nDim; ++k ) {
+			double f = (pPoints[nDim*i + k] - fMin[k]) * fScale;
+			X[k] = (unsigned int)std::min( std::max(f, 0.0), fMaxCoord );
+		}
+		vKeys[i] = HilbertKey( X, nBits, nDim );
+	}
+}
+
+
+// sort vOrder[nStart..nEnd) by key
+static void SortRange( const std::vector<SpatialSortKey> & vKeys, std::vector<unsigned int> & vOrder, size_t nStart, size_t nEnd )
+{
+	std::vector< std::pair<SpatialSortKey, unsigned int> > vSort( nEnd - nStart );
+	for ( size_t i = nStart; i < nEnd; ++i )
+		vSort[i-nStart] = std::pair<SpatialSortKey, unsigned int>( vKeys[vOrder[i]], vOrder[i] );
+	std::sort( vSort.begin(), vSort.end() );
+	for ( size_t i = nStart; i < nEnd; ++i )
+		vOrder[i] = vSort[i-nStart].second;
+}
+
+
+void rms::HilbertOrder( const double * pPoints, unsigned int nCount, int nDim, std::vector<unsigned int> & vOrder )
+{
+	std::vector<SpatialSortKey> vKeys;
+	HilbertKeys( pPoints, nCount, nDim, vKeys );
+	vOrder.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		vOrder[i] = i;
+	SortRange( vKeys, vOrder, 0, nCount );
+}
+
+
+void rms::BRIOOrder( const double * pPoints, unsigned int nCount, int nDim, std::vector<unsigned int> & vOrder, unsigned int nSeed )
+{
+	std::vector<SpatialSortKey> vKeys;
+	HilbertKeys( pPoints, nCount, nDim, vKeys );
+
+	// shuffle (local LCG, so this is reproducible and does not touch rand() state)
+	vOrder.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		vOrder[i] = i;
+	unsigned int nState = nSeed * 2654435761u + 12345u;
+	for ( unsigned int i = nCount; i > 1; --i ) {
+		nState = nState * 1664525u + 1013904223u;
+		unsigned int j = (unsigned int)( ((unsigned long long)nState * i) >> 32 );
+		std::swap( vOrder[i-1], vOrder[j] );
+	}
+
+	// rounds [0,n/2^k), ..., [n/4,n/2), [n/2,n). Each is Hilbert-sorted independently
+	std::vector<size_t> vRounds;
+	vRounds.push_back(nCount);
+	while ( vRounds.back() > 64 )
+		vRounds.push_back( vRounds.back() / 2 );
+	vRounds.push_back(0);
+	std::reverse( vRounds.begin(), vRounds.end() );
+
+	int nRounds = (int)vRounds.size() - 1;
+	#pragma omp parallel for schedule(dynamic,1) if(nCount > 16384)
+	for ( int r = 0; r < nRounds; ++r )
+		SortRange( vKeys, vOrder, vRounds[r], vRounds[r+1] );
+}
+
+
+// orders point indices along one axis, ties by index so the split is reproducible
+struct SpatialAxisLess {
+	const double * pPoints;
+	int nDim, nAxis;
+	bool operator()( unsigned int i, unsigned int j ) const {
+		double fi = pPoints[nDim*i + nAxis], fj = pPoints[nDim*j + nAxis];
+		return fi < fj || ( fi == fj && i < j );
+	}
+};
+
+static void PartitionRegion( const double * pPoints, int nDim, unsigned int nMaxRegion, SpatialRegion & region, std::vector<SpatialRegion> & vRegions )
+{
+	unsigned int nCount = (unsigned int)region.vPoints.size();
+	double fMin[3], fMax[3];
+	for ( int k = 0; k < nDim; ++k )
+		fMin[k] = fMax[k] = ( nCount > 0 ) ? pPoints[nDim*region.vPoints[0] + k] : 0;
+	for ( unsigned int i = 1; i < nCount; ++i ) {
+		for ( int k = 0; k < nDim; ++k ) {
+			double f = pPoints[nDim*region.vPoints[i] + k];
+			if ( f < fMin[k] ) fMin[k] = f;
+			if ( f > fMax[k] ) fMax[k] = f;
+		}
+	}
+	int nAxis = 0;
+	for ( int k = 1; k < nDim; ++k )
+		if ( fMax[k] - fMin[k] > fMax[nAxis] - fMin[nAxis] )
+			nAxis = k;
+	if ( nCount <= nMaxRegion || fMax[nAxis] == fMin[nAxis] ) {
+		vRegions.push_back( SpatialRegion() );
+		std::swap( vRegions.back(), region );
+		return;
+	}
+
+	// lower half has coordinates <= fSplit, upper half >= fSplit
+	SpatialAxisLess less;
+	less.pPoints = pPoints;  less.nDim = nDim;  less.nAxis = nAxis;
+	std::vector<unsigned int>::iterator mid = region.vPoints.begin() + nCount/2;
+	std::nth_element( region.vPoints.begin(), mid, region.vPoints.end(), less );
+	double fSplit = pPoints[nDim*(*mid) + nAxis];
+
+	SpatialRegion lower, upper;
+	lower.vPoints.assign( region.vPoints.begin(), mid );
+	upper.vPoints.assign( mid, region.vPoints.end() );
+	std::vector<unsigned int>().swap( region.vPoints );
+	for ( int k = 0; k < 3; ++k ) {
+		lower.fMin[k] = upper.fMin[k] = region.fMin[k];
+		lower.fMax[k] = upper.fMax[k] = region.fMax[k];
+	}
+	lower.fMax[nAxis] = upper.fMin[nAxis] = fSplit;
+	PartitionRegion( pPoints, nDim, nMaxRegion, lower, vRegions );
+	PartitionRegion( pPoints, nDim, nMaxRegion, upper, vRegions );
+}
+
+
+void rms::PartitionPoints( const double * pPoints, unsigned int nCount, int nDim, unsigned int nMaxRegion, std::vector<SpatialRegion> & vRegions )
+{
+	vRegions.resize(0);
+	SpatialRegion all;
+	all.vPoints.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		all.vPoints[i] = i;
+	for ( int k = 0; k < 3; ++k ) {
+		all.fMin[k] = -std::numeric_limits<double>::infinity();
+		all.fMax[k] = std::numeric_limits<double>::infinity();
+	}
+	PartitionRegion( pPoints, nDim, std::max(nMaxRegion, 1u), all, vRegions );
+}
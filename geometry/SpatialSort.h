@@ -0,0 +1,49 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_SPATIAL_SORT_H__
+#define __RMS_SPATIAL_SORT_H__
+#include "config.h"
+#include <vector>
+
+/*
+ * Insertion orders for incremental constructions (Delaunay, hulls, etc).
+ *
+ * HilbertOrder sorts points along a Hilbert curve over their bounding box, so consecutive
+ * points are spatially close (which makes walk-based point location nearly O(1)).
+ * BRIOOrder is the Biased Randomized Insertion Order of Amenta et al: points are randomly
+ * assigned to rounds of doubling size, and each round is Hilbert-sorted. This keeps the
+ * expected-case guarantees of a random order but with the locality of the curve order.
+ *
+ * PartitionPoints splits a point set into kd-tree leaves, for constructions that run per region
+ * in parallel and then merge.
+ *
+ * Points are packed doubles, nDim = 2 or 3. Key computation and per-round sorts run in parallel.
+ */
+
+namespace rms
+{
+
+typedef unsigned long long SpatialSortKey;
+
+//! Hilbert-curve keys for points, relative to their bounding box
+void HilbertKeys( const double * pPoints, unsigned int nCount, int nDim, std::vector<SpatialSortKey> & vKeys );
+
+//! indices of points in Hilbert-curve order
+void HilbertOrder( const double * pPoints, unsigned int nCount, int nDim, std::vector<unsigned int> & vOrder );
+
+//! indices of points in BRIO order. nSeed makes the random part reproducible
+void BRIOOrder( const double * pPoints, unsigned int nCount, int nDim, std::vector<unsigned int> & vOrder, unsigned int nSeed = 0 );
+
+//! leaf of PartitionPoints(). Points of other regions are outside the open box (fMin,fMax); sides on the outside of the partition are +-infinity
+struct SpatialRegion {
+	std::vector<unsigned int> vPoints;
+	double fMin[3], fMax[3];
+};
+
+//! split points at the median of the widest axis until regions have at most nMaxRegion points. Result only depends on the input
+void PartitionPoints( const double * pPoints, unsigned int nCount, int nDim, unsigned int nMaxRegion, std::vector<SpatialRegion> & vRegions );
+
+}  // end namespace rms
+
+#endif // __RMS_SPATIAL_SORT_H__
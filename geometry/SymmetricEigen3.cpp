@@ -0,0 +1,93 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "SymmetricEigen3.h"
+
+using namespace rms;
+using namespace rms::SymmetricEigen3Impl;
+
+
+// solve W lanes starting at i
+template <class F>
+static inline void SolveLanes( unsigned int i, const float * const pA[6], float * const pEval[3], float * const pEvec[9] )
+{
+	F fEval[3], V[3][3];
+	EigenLanes<F>( F::Load(pA[0]+i), F::Load(pA[1]+i), F::Load(pA[2]+i),
+				   F::Load(pA[3]+i), F::Load(pA[4]+i), F::Load(pA[5]+i), fEval, V );
+	for ( int k = 0; k < 3; ++k )
+		fEval[k].Store( pEval[k]+i );
+	for ( int k = 0; k < 3; ++k )
+		for ( int j = 0; j < 3; ++j )
+			V[k][j].Store( pEvec[3*k+j]+i );
+}
+
+static inline void SolveScalar( unsigned int i, const float * const pA[6], float * const pEval[3], float * const pEvec[9] )
+{
+	float fEval[3], V[3][3];
+	EigenLanes<float>( pA[0][i], pA[1][i], pA[2][i], pA[3][i], pA[4][i], pA[5][i], fEval, V );
+	for ( int k = 0; k < 3; ++k )
+		pEval[k][i] = fEval[k];
+	for ( int k = 0; k < 3; ++k )
+		for ( int j = 0; j < 3; ++j )
+			pEvec[3*k+j][i] = V[k][j];
+}
+
+
+
+SymmetricEigen3Batch::SymmetricEigen3Batch()
+{
+	m_nCount = 0;
+}
+
+void SymmetricEigen3Batch::Resize( unsigned int nCount )
+{
+	m_nCount = nCount;
+	for ( int k = 0; k < 6; ++k )
+		m_vA[k].resize(nCount);
+	for ( int k = 0; k < 3; ++k )
+		m_vEval[k].resize(nCount);
+	for ( int k = 0; k < 9; ++k )
+		m_vEvec[k].resize(nCount);
+}
+
+void SymmetricEigen3Batch::Compute()
+{
+	if ( m_nCount == 0 )
+		return;
+	const float * pA[6];
+	float * pEval[3], * pEvec[9];
+	for ( int k = 0; k < 6; ++k )
+		pA[k] = &m_vA[k][0];
+	for ( int k = 0; k < 3; ++k )
+		pEval[k] = &m_vEval[k][0];
+	for ( int k = 0; k < 9; ++k )
+		pEvec[k] = &m_vEvec[k][0];
+	Compute( m_nCount, pA, pEval, pEvec );
+}
+
+
+void SymmetricEigen3Batch::Compute( unsigned int nCount, const float * const pA[6], float * const pEval[3], float * const pEvec[9] )
+{
+#if defined(RMS_SIMD_AVX)
+	const int nWidth = 8;
+#elif defined(RMS_SIMD_SSE)
+	const int nWidth = 4;
+#else
+	const int nWidth = 1;
+#endif
+
+	// full SIMD blocks in parallel, remainder with scalar lanes
+	int nBlocks = (int)(nCount / nWidth);
+	#pragma omp parallel for schedule(static)
+	for ( int b = 0; b < nBlocks; ++b ) {
+#if defined(RMS_SIMD_AVX)
+		SolveLanes<SIMD::Float8>( (unsigned int)b * nWidth, pA, pEval, pEvec );
+#elif defined(RMS_SIMD_SSE)
+		SolveLanes<SIMD::Float4>( (unsigned int)b * nWidth, pA, pEval, pEvec );
+#else
+		SolveScalar( (unsigned int)b, pA, pEval, pEvec );
+#endif
+	}
+	for ( unsigned int i = (unsigned int)nBlocks * nWidth; i < nCount; ++i )
+		SolveScalar( i, pA, pEval, pEvec );
+}
@@ -0,0 +1,148 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_SYMMETRIC_EIGEN3_H__
+#define __RMS_SYMMETRIC_EIGEN3_H__
+#include "config.h"
+#include <vector>
+#include <Wm4Vector3.h>
+#include "SIMDLanes.h"
+
+/*
+ * Eigen-decomposition of symmetric 3x3 matrices (covariance matrices, curvature tensors, etc).
+ *
+ * The solver is cyclic Jacobi with a fixed number of sweeps, so there is no data-dependent
+ * branching and the same code runs on SIMD lanes. This is much cheaper than constructing a
+ * Wml::Eigen / Wml::NoniterativeEigen3x3 object per matrix, and SymmetricEigen3Batch
+ * solves many matrices at once (SoA layout, SSE/AVX lanes, OpenMP over blocks).
+ *
+ * Matrices are passed as the 6 upper-triangle entries { a00, a01, a02, a11, a12, a22 }.
+ * Eigenvalues are returned in increasing order, eigenvectors are unit-length
+ * (so for a covariance matrix, eigenvector 0 is the plane-fit normal).
+ */
+
+namespace rms
+{
+
+namespace SymmetricEigen3Impl
+{
+	using namespace SIMD;
+
+	//! 5 sweeps are enough to converge to float precision for 3x3
+	enum { SweepCount = 5 };
+
+	//! one Jacobi rotation zeroing apq (Numerical Recipes 11.1 update). r is the remaining row/column
+	template <class F>
+	inline void Rotate( F & app, F & aqq, F & apq, F & arp, F & arq, F V[3][3], int p, int q )
+	{
+		F zero(0.0f), one(1.0f);
+		F mask( Abs(apq) > F(1e-30f) );
+		F fSafe( Select( mask, apq, one ) );
+		F theta( (aqq - app) / (F(2.0f) * fSafe) );
+		F t( one / (Abs(theta) + Sqrt(theta*theta + one)) );
+		t = Select( theta < zero, zero - t, t );
+		t = Select( mask, t, zero );
+		F c( one / Sqrt(t*t + one) );
+		F s( t * c );
+
+		app = app - t*apq;
+		aqq = aqq + t*apq;
+		apq = Select( mask, zero, apq );
+		F rp( c*arp - s*arq ), rq( s*arp + c*arq );
+		arp = rp;  arq = rq;
+		for ( int k = 0; k < 3; ++k ) {
+			F vp( c*V[k][p] - s*V[k][q] ), vq( s*V[k][p] + c*V[k][q] );
+			V[k][p] = vp;  V[k][q] = vq;
+		}
+	}
+
+	template <class F>
+	inline void SortPair( F fEval[3], F V[3][3], int i, int j )
+	{
+		F swap( fEval[j] < fEval[i] );
+		F a( Select(swap, fEval[j], fEval[i]) ), b( Select(swap, fEval[i], fEval[j]) );
+		fEval[i] = a;  fEval[j] = b;
+		for ( int k = 0; k < 3; ++k ) {
+			F vi( Select(swap, V[k][j], V[k][i]) ), vj( Select(swap, V[k][i], V[k][j]) );
+			V[k][i] = vi;  V[k][j] = vj;
+		}
+	}
+
+	//! V[k][j] is component k of eigenvector j
+	template <class F>
+	inline void EigenLanes( F a00, F a01, F a02, F a11, F a12, F a22, F fEval[3], F V[3][3] )
+	{
+		F zero(0.0f), one(1.0f);
+		for ( int k = 0; k < 3; ++k )
+			for ( int j = 0; j < 3; ++j )
+				V[k][j] = (k == j) ? one : zero;
+
+		for ( int nSweep = 0; nSweep < SweepCount; ++nSweep ) {
+			Rotate( a00, a11, a01, a02, a12, V, 0, 1 );
+			Rotate( a00, a22, a02, a01, a12, V, 0, 2 );
+			Rotate( a11, a22, a12, a01, a02, V, 1, 2 );
+		}
+		fEval[0] = a00;  fEval[1] = a11;  fEval[2] = a22;
+
+		SortPair( fEval, V, 0, 1 );
+		SortPair( fEval, V, 1, 2 );
+		SortPair( fEval, V, 0, 1 );
+	}
+
+}  // end namespace SymmetricEigen3Impl
+
+
+
+//! scalar version. A = { a00, a01, a02, a11, a12, a22 }
+template <class Real>
+inline void SymmetricEigen3( const Real A[6], Real fEigenvalues[3], Wml::Vector3<Real> vEigenvectors[3] )
+{
+	Real V[3][3];
+	SymmetricEigen3Impl::EigenLanes<Real>( A[0], A[1], A[2], A[3], A[4], A[5], fEigenvalues, V );
+	for ( int j = 0; j < 3; ++j )
+		vEigenvectors[j] = Wml::Vector3<Real>( V[0][j], V[1][j], V[2][j] );
+}
+
+
+
+//! batch of symmetric 3x3 eigenproblems, stored SoA
+class SymmetricEigen3Batch
+{
+public:
+	SymmetricEigen3Batch();
+
+	void Resize( unsigned int nCount );
+	unsigned int GetCount() const { return m_nCount; }
+
+	//! A = { a00, a01, a02, a11, a12, a22 }
+	inline void SetMatrix( unsigned int i, const float A[6] )
+		{ for ( int k = 0; k < 6; ++k ) m_vA[k][i] = A[k]; }
+
+	//! direct access to the SoA arrays (entry k in 0..5, eigenvalue k in 0..2, eigenvector component [axis*3 + vector])
+	float * Matrix( int k ) { return &m_vA[k][0]; }
+	const float * Eigenvalues( int k ) const { return &m_vEval[k][0]; }
+	const float * Eigenvectors( int k ) const { return &m_vEvec[k][0]; }
+
+	//! solve all matrices
+	void Compute();
+
+	inline void GetEigenvalues( unsigned int i, float fEigenvalues[3] ) const
+		{ for ( int k = 0; k < 3; ++k ) fEigenvalues[k] = m_vEval[k][i]; }
+	inline Wml::Vector3f GetEigenvector( unsigned int i, int j ) const
+		{ return Wml::Vector3f( m_vEvec[j][i], m_vEvec[3+j][i], m_vEvec[6+j][i] ); }
+
+
+	//! low-level interface. pA[6] / pEval[3] / pEvec[9] are SoA arrays of at least nCount floats
+	static void Compute( unsigned int nCount, const float * const pA[6], float * const pEval[3], float * const pEvec[9] );
+
+protected:
+	unsigned int m_nCount;
+	std::vector<float> m_vA[6];
+	std::vector<float> m_vEval[3];
+	std::vector<float> m_vEvec[9];
+};
+
+
+}  // end namespace rms
+
+#endif // __RMS_SYMMETRIC_EIGEN3_H__
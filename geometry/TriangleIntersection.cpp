@@ -0,0 +1,387 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "TriangleIntersection.h"
+#include "ExactPredicates.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace rms;
+using Wml::Vector3d;
+
+namespace {
+
+//! +1 if d is above the plane of a,b,c (counter-clockwise seen from above), -1 below, 0 on it. Exact.
+inline int Side( const Vector3d & a, const Vector3d & b, const Vector3d & c, const Vector3d & d )
+{
+	double f = Orient3D( a, b, c, d );
+	return (f < 0) ? 1 : ( (f > 0) ? -1 : 0 );
+}
+
+inline int Sign2D( const double * a, const double * b, const double * c )
+{
+	double f = Orient2D( a, b, c );
+	return (f > 0) ? 1 : ( (f < 0) ? -1 : 0 );
+}
+
+
+// Guigue-Devillers, "Fast and Robust Triangle-Triangle Overlap Test Using Orientation Predicates".
+// The triangles are permuted so that p1 (and p2) is alone on its side of the other plane, then two
+// orientation tests decide whether the intervals on the intersection line overlap.
+
+inline bool CheckMinMax( const Vector3d & p1, const Vector3d & q1, const Vector3d & r1,
+						 const Vector3d & p2, const Vector3d & q2, const Vector3d & r2 )
+{
+	if ( Side(q1, p2, p1, q2) > 0 )
+		return false;
+	if ( Side(p1, p2, r1, r2) > 0 )
+		return false;
+	return true;
+}
+
+//! 1 if intersecting, 0 if not, -1 if coplanar
+int TriTri3D( const Vector3d & p1, const Vector3d & q1, const Vector3d & r1,
+			  const Vector3d & p2, const Vector3d & q2, const Vector3d & r2, int dp2, int dq2, int dr2 )
+{
+	if ( dp2 > 0 ) {
+		if ( dq2 > 0 )			return CheckMinMax(p1,r1,q1,r2,p2,q2);
+		else if ( dr2 > 0 )		return CheckMinMax(p1,r1,q1,q2,r2,p2);
+		else					return CheckMinMax(p1,q1,r1,p2,q2,r2);
+	} else if ( dp2 < 0 ) {
+		if ( dq2 < 0 )			return CheckMinMax(p1,q1,r1,r2,p2,q2);
+		else if ( dr2 < 0 )		return CheckMinMax(p1,q1,r1,q2,r2,p2);
+		else					return CheckMinMax(p1,r1,q1,p2,q2,r2);
+	} else {
+		if ( dq2 < 0 ) {
+			if ( dr2 >= 0 )		return CheckMinMax(p1,r1,q1,q2,r2,p2);
+			else				return CheckMinMax(p1,q1,r1,p2,q2,r2);
+		} else if ( dq2 > 0 ) {
+			if ( dr2 > 0 )		return CheckMinMax(p1,r1,q1,p2,q2,r2);
+			else				return CheckMinMax(p1,q1,r1,q2,r2,p2);
+		} else {
+			if ( dr2 > 0 )		return CheckMinMax(p1,q1,r1,r2,p2,q2);
+			else if ( dr2 < 0 )	return CheckMinMax(p1,r1,q1,r2,p2,q2);
+			else				return -1;
+		}
+	}
+}
+
+int TriTriOverlap( const Vector3d & p1, const Vector3d & q1, const Vector3d & r1,
+				   const Vector3d & p2, const Vector3d & q2, const Vector3d & r2,
+				   const int d1[3], const int d2[3] )
+{
+	int dp1 = d1[0], dq1 = d1[1], dr1 = d1[2];
+	int dp2 = d2[0], dq2 = d2[1], dr2 = d2[2];
+	if ( dp1 > 0 ) {
+		if ( dq1 > 0 )			return TriTri3D(r1,p1,q1,p2,r2,q2,dp2,dr2,dq2);
+		else if ( dr1 > 0 )		return TriTri3D(q1,r1,p1,p2,r2,q2,dp2,dr2,dq2);
+		else					return TriTri3D(p1,q1,r1,p2,q2,r2,dp2,dq2,dr2);
+	} else if ( dp1 < 0 ) {
+		if ( dq1 < 0 )			return TriTri3D(r1,p1,q1,p2,q2,r2,dp2,dq2,dr2);
+		else if ( dr1 < 0 )		return TriTri3D(q1,r1,p1,p2,q2,r2,dp2,dq2,dr2);
+		else					return TriTri3D(p1,q1,r1,p2,r2,q2,dp2,dr2,dq2);
+	} else {
+		if ( dq1 < 0 ) {
+			if ( dr1 >= 0 )		return TriTri3D(q1,r1,p1,p2,r2,q2,dp2,dr2,dq2);
+			else				return TriTri3D(p1,q1,r1,p2,q2,r2,dp2,dq2,dr2);
+		} else if ( dq1 > 0 ) {
+			if ( dr1 > 0 )		return TriTri3D(p1,q1,r1,p2,r2,q2,dp2,dr2,dq2);
+			else				return TriTri3D(q1,r1,p1,p2,q2,r2,dp2,dq2,dr2);
+		} else {
+			if ( dr1 > 0 )		return TriTri3D(r1,p1,q1,p2,q2,r2,dp2,dq2,dr2);
+			else if ( dr1 < 0 )	return TriTri3D(r1,p1,q1,p2,r2,q2,dp2,dr2,dq2);
+			else				return -1;
+		}
+	}
+}
+
+
+//! points where triangle t (with exact signs s and distances d to the other plane) meets that plane
+int PlanePoints( const Vector3d t[3], const int s[3], const double d[3], Vector3d vPoints[3] )
+{
+	int nCount = 0;
+	for ( int i = 0; i < 3; ++i ) {
+		int j = (i+1) % 3;
+		if ( s[i] == 0 )
+			vPoints[nCount++] = t[i];
+		else if ( s[i] * s[j] < 0 && nCount < 3 ) {
+			double fDenom = d[i] - d[j];
+			double fT = ( fDenom != 0 ) ? d[i] / fDenom : 0.5;
+			fT = ( fT < 0 ) ? 0 : ( (fT > 1) ? 1 : fT );
+			vPoints[nCount++] = t[i] + fT * (t[j] - t[i]);
+		}
+	}
+	return nCount;
+}
+
+//! segment where the two plane-crossing intervals overlap along the intersection line
+void ConstructSegment( const Vector3d t1[3], const Vector3d t2[3], const int s1[3], const int s2[3],
+					   const Vector3d & n1, const Vector3d & n2, Vector3d vSegment[2] )
+{
+	double d1[3], d2[3];
+	for ( int i = 0; i < 3; ++i ) {
+		d1[i] = (t1[i] - t2[0]).Dot(n2);
+		d2[i] = (t2[i] - t1[0]).Dot(n1);
+	}
+	Vector3d vPoints1[3], vPoints2[3];
+	int nPoints1 = PlanePoints(t1, s1, d1, vPoints1);
+	int nPoints2 = PlanePoints(t2, s2, d2, vPoints2);
+	if ( nPoints1 == 0 || nPoints2 == 0 ) {
+		vSegment[0] = vSegment[1] = (nPoints1 > 0) ? vPoints1[0] : ( (nPoints2 > 0) ? vPoints2[0] : t1[0] );
+		return;
+	}
+
+	Vector3d vLine = n1.Cross(n2);
+	int nMin1 = 0, nMax1 = 0, nMin2 = 0, nMax2 = 0;
+	for ( int i = 1; i < nPoints1; ++i ) {
+		if ( vPoints1[i].Dot(vLine) < vPoints1[nMin1].Dot(vLine) )	nMin1 = i;
+		if ( vPoints1[i].Dot(vLine) > vPoints1[nMax1].Dot(vLine) )	nMax1 = i;
+	}
+	for ( int i = 1; i < nPoints2; ++i ) {
+		if ( vPoints2[i].Dot(vLine) < vPoints2[nMin2].Dot(vLine) )	nMin2 = i;
+		if ( vPoints2[i].Dot(vLine) > vPoints2[nMax2].Dot(vLine) )	nMax2 = i;
+	}
+	vSegment[0] = ( vPoints1[nMin1].Dot(vLine) > vPoints2[nMin2].Dot(vLine) ) ? vPoints1[nMin1] : vPoints2[nMin2];
+	vSegment[1] = ( vPoints1[nMax1].Dot(vLine) < vPoints2[nMax2].Dot(vLine) ) ? vPoints1[nMax1] : vPoints2[nMax2];
+	if ( vSegment[1].Dot(vLine) < vSegment[0].Dot(vLine) )		// touching, up to roundoff
+		vSegment[1] = vSegment[0];
+}
+
+
+//! drop the dominant axis of n
+inline void Project( const Vector3d & v, int nAxis, double p[2] )
+{
+	p[0] = v[ (nAxis+1) % 3 ];
+	p[1] = v[ (nAxis+2) % 3 ];
+}
+inline int DominantAxis( const Vector3d & n )
+{
+	double fX = fabs(n.X()), fY = fabs(n.Y()), fZ = fabs(n.Z());
+	return ( fX >= fY && fX >= fZ ) ? 0 : ( (fY >= fZ) ? 1 : 2 );
+}
+
+inline bool OnSegment2D( const double * a, const double * b, const double * p )
+{
+	return std::min(a[0],b[0]) <= p[0] && p[0] <= std::max(a[0],b[0])
+		&& std::min(a[1],b[1]) <= p[1] && p[1] <= std::max(a[1],b[1]);
+}
+
+//! closed segments [a,b] and [c,d]. If they cross, fT is the parameter along [a,b]
+bool SegmentsIntersect2D( const double * a, const double * b, const double * c, const double * d, double & fT )
+{
+	int o1 = Sign2D(a, b, c), o2 = Sign2D(a, b, d);
+	int o3 = Sign2D(c, d, a), o4 = Sign2D(c, d, b);
+	if ( o1 * o2 < 0 && o3 * o4 < 0 ) {
+		double fA = (d[0]-c[0])*(a[1]-c[1]) - (d[1]-c[1])*(a[0]-c[0]);
+		double fB = (d[0]-c[0])*(b[1]-c[1]) - (d[1]-c[1])*(b[0]-c[0]);
+		fT = ( fA != fB ) ? fA / (fA - fB) : 0.5;
+		return true;
+	}
+	// touching / collinear cases are picked up by the contained-vertex tests
+	return false;
+}
+
+inline bool InTriangle2D( const double * p, const double t[3][2] )
+{
+	int s0 = Sign2D(t[0], t[1], p), s1 = Sign2D(t[1], t[2], p), s2 = Sign2D(t[2], t[0], p);
+	bool bNeg = (s0 < 0 || s1 < 0 || s2 < 0);
+	bool bPos = (s0 > 0 || s1 > 0 || s2 > 0);
+	return ! (bNeg && bPos);
+}
+
+bool OnBoundary2D( const double * p, const double t[3][2] )
+{
+	for ( int i = 0; i < 3; ++i ) {
+		const double * a = t[i], * b = t[(i+1)%3];
+		if ( Sign2D(a, b, p) == 0 && OnSegment2D(a, b, p) )
+			return true;
+	}
+	return false;
+}
+
+//! coplanar triangles. Overlap points are the contained vertices and edge crossings
+bool CoplanarIntersect( const Vector3d t1[3], const Vector3d t2[3], const Vector3d & n, Vector3d vSegment[2] )
+{
+	int nAxis = DominantAxis(n);
+	double p1[3][2], p2[3][2];
+	for ( int i = 0; i < 3; ++i ) {
+		Project(t1[i], nAxis, p1[i]);
+		Project(t2[i], nAxis, p2[i]);
+	}
+
+	Vector3d vPoints[15];
+	int nPoints = 0;
+	for ( int i = 0; i < 3; ++i ) {
+		if ( InTriangle2D(p1[i], p2) || OnBoundary2D(p1[i], p2) )
+			vPoints[nPoints++] = t1[i];
+		if ( InTriangle2D(p2[i], p1) || OnBoundary2D(p2[i], p1) )
+			vPoints[nPoints++] = t2[i];
+	}
+	for ( int i = 0; i < 3; ++i ) {
+		for ( int j = 0; j < 3; ++j ) {
+			double fT;
+			if ( SegmentsIntersect2D(p1[i], p1[(i+1)%3], p2[j], p2[(j+1)%3], fT) )
+				vPoints[nPoints++] = t1[i] + fT * (t1[(i+1)%3] - t1[i]);
+		}
+	}
+	if ( nPoints == 0 )
+		return false;
+
+	int nA = 0, nB = 0;
+	double fMax = -1;
+	for ( int i = 0; i < nPoints; ++i ) {
+		for ( int j = i; j < nPoints; ++j ) {
+			double fDist = (vPoints[i] - vPoints[j]).SquaredLength();
+			if ( fDist > fMax ) {
+				fMax = fDist;  nA = i;  nB = j;
+			}
+		}
+	}
+	vSegment[0] = vPoints[nA];
+	vSegment[1] = vPoints[nB];
+	return true;
+}
+
+
+//! exact: does the closed segment [p,q] meet the closed triangle (x,y,z)? (not coplanar)
+bool SegmentTriangle( const Vector3d & p, const Vector3d & q, const Vector3d & x, const Vector3d & y, const Vector3d & z, Vector3d & vHit )
+{
+	int sp = Side(x, y, z, p), sq = Side(x, y, z, q);
+	if ( sp * sq > 0 || (sp == 0 && sq == 0) )
+		return false;
+	int o1 = Side(p, q, x, y), o2 = Side(p, q, y, z), o3 = Side(p, q, z, x);
+	bool bNeg = (o1 < 0 || o2 < 0 || o3 < 0);
+	bool bPos = (o1 > 0 || o2 > 0 || o3 > 0);
+	if ( bNeg && bPos )
+		return false;
+
+	Vector3d n = (y - x).Cross(z - x);
+	double dp = (p - x).Dot(n), dq = (q - x).Dot(n);
+	double fT = ( dp != dq ) ? dp / (dp - dq) : 0.5;
+	fT = ( fT < 0 ) ? 0 : ( (fT > 1) ? 1 : fT );
+	vHit = p + fT * (q - p);
+	return true;
+}
+
+inline bool IsDegenerate( const Vector3d & a, const Vector3d & b, const Vector3d & c )
+{
+	return (b - a).Cross(c - a).SquaredLength() == 0;
+}
+
+}  // end anonymous namespace
+
+
+
+bool rms::IntersectTriangles( const Wml::Vector3d vTri1[3], const Wml::Vector3d vTri2[3],
+							  Wml::Vector3d vSegment[2], bool * pCoplanar )
+{
+	if ( pCoplanar )
+		*pCoplanar = false;
+	if ( IsDegenerate(vTri1[0], vTri1[1], vTri1[2]) || IsDegenerate(vTri2[0], vTri2[1], vTri2[2]) )
+		return false;
+
+	int s2[3], s1[3];
+	for ( int i = 0; i < 3; ++i )
+		s2[i] = Side( vTri1[0], vTri1[1], vTri1[2], vTri2[i] );
+	if ( s2[0] == s2[1] && s2[1] == s2[2] && s2[0] != 0 )
+		return false;
+	for ( int i = 0; i < 3; ++i )
+		s1[i] = Side( vTri2[0], vTri2[1], vTri2[2], vTri1[i] );
+	if ( s1[0] == s1[1] && s1[1] == s1[2] && s1[0] != 0 )
+		return false;
+
+	Vector3d n1 = (vTri1[1] - vTri1[0]).Cross(vTri1[2] - vTri1[0]);
+	Vector3d n2 = (vTri2[1] - vTri2[0]).Cross(vTri2[2] - vTri2[0]);
+
+	int nResult = TriTriOverlap( vTri1[0], vTri1[1], vTri1[2], vTri2[0], vTri2[1], vTri2[2], s1, s2 );
+	if ( nResult < 0 ) {
+		if ( pCoplanar )
+			*pCoplanar = true;
+		return CoplanarIntersect( vTri1, vTri2, n1, vSegment );
+	}
+	if ( nResult == 0 )
+		return false;
+
+	ConstructSegment( vTri1, vTri2, s1, s2, n1, n2, vSegment );
+	return true;
+}
+
+
+bool rms::IntersectTrianglesSharedEdge( const Wml::Vector3d & a, const Wml::Vector3d & b,
+										const Wml::Vector3d & c, const Wml::Vector3d & d, Wml::Vector3d vSegment[2] )
+{
+	if ( IsDegenerate(a, b, c) || IsDegenerate(a, b, d) )
+		return false;
+	if ( Side(a, b, c, d) != 0 )
+		return false;
+
+	// coplanar - folded if c and d are on the same side of [a,b]
+	int nAxis = DominantAxis( (b - a).Cross(c - a) );
+	double pa[2], pb[2], pc[2], pd[2];
+	Project(a, nAxis, pa);  Project(b, nAxis, pb);  Project(c, nAxis, pc);  Project(d, nAxis, pd);
+	if ( Sign2D(pa, pb, pc) * Sign2D(pa, pb, pd) <= 0 )
+		return false;
+	vSegment[0] = a;
+	vSegment[1] = b;
+	return true;
+}
+
+
+bool rms::IntersectTrianglesSharedVertex( const Wml::Vector3d & v, const Wml::Vector3d & a, const Wml::Vector3d & b,
+										  const Wml::Vector3d & c, const Wml::Vector3d & d, Wml::Vector3d vSegment[2],
+										  bool * pCoplanar )
+{
+	if ( pCoplanar )
+		*pCoplanar = false;
+	if ( IsDegenerate(v, a, b) || IsDegenerate(v, c, d) )
+		return false;
+
+	if ( Side(v, a, b, c) != 0 || Side(v, a, b, d) != 0 ) {
+		// not coplanar - the triangles meet away from v iff an opposite edge crosses the other triangle
+		Vector3d vHit1, vHit2;
+		bool bHit1 = SegmentTriangle( a, b, v, c, d, vHit1 );
+		bool bHit2 = SegmentTriangle( c, d, v, a, b, vHit2 );
+		if ( ! bHit1 && ! bHit2 )
+			return false;
+		vSegment[0] = ( bHit1 && bHit2 ) ? vHit2 : v;
+		vSegment[1] = ( bHit1 ) ? vHit1 : vHit2;
+		return true;
+	}
+
+	// coplanar - the triangles overlap iff their sectors at v overlap: a ray of one strictly
+	// inside the other's sector, or identical sectors
+	int nAxis = DominantAxis( (a - v).Cross(b - v) );
+	double pv[2], pa[2], pb[2], pc[2], pd[2];
+	Project(v, nAxis, pv);  Project(a, nAxis, pa);  Project(b, nAxis, pb);  Project(c, nAxis, pc);  Project(d, nAxis, pd);
+	int oab = Sign2D(pv, pa, pb), ocd = Sign2D(pv, pc, pd);
+	bool bOverlap =
+		( Sign2D(pv, pa, pc) == oab && Sign2D(pv, pc, pb) == oab ) ||
+		( Sign2D(pv, pa, pd) == oab && Sign2D(pv, pd, pb) == oab ) ||
+		( Sign2D(pv, pc, pa) == ocd && Sign2D(pv, pa, pd) == ocd ) ||
+		( Sign2D(pv, pc, pb) == ocd && Sign2D(pv, pb, pd) == ocd );
+	if ( ! bOverlap ) {
+		// identical sectors: each ray of one triangle is collinear (same direction) with a ray of the other
+		const double * p1[2] = { pa, pb };
+		const double * p2[2] = { pc, pd };
+		int nSame = 0;
+		for ( int i = 0; i < 2; ++i ) {
+			for ( int j = 0; j < 2; ++j ) {
+				double fDot = (p1[i][0]-pv[0])*(p2[j][0]-pv[0]) + (p1[i][1]-pv[1])*(p2[j][1]-pv[1]);
+				if ( Sign2D(pv, p1[i], p2[j]) == 0 && fDot > 0 )
+					++nSame;
+			}
+		}
+		bOverlap = (nSame >= 2);
+	}
+	if ( ! bOverlap )
+		return false;
+
+	if ( pCoplanar )
+		*pCoplanar = true;
+	Vector3d t1[3] = { v, a, b }, t2[3] = { v, c, d };
+	Vector3d n = (a - v).Cross(b - v);
+	if ( ! CoplanarIntersect( t1, t2, n, vSegment ) )
+		vSegment[0] = vSegment[1] = v;
+	return true;
+}
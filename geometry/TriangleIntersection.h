@@ -0,0 +1,40 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_TRIANGLE_INTERSECTION_H__
+#define __RMS_TRIANGLE_INTERSECTION_H__
+#include "config.h"
+#include <Wm4Vector3.h>
+
+/*
+ * Robust triangle/triangle intersection. Whether two triangles intersect is decided with the
+ * exact Orient3D/Orient2D predicates (ExactPredicates.h), using the Guigue-Devillers case analysis,
+ * so the answer is consistent even for nearly-coplanar or touching triangles. Triangles are closed
+ * (touching counts). Degenerate (zero-area) triangles never intersect.
+ *
+ * The intersection segment is then constructed in double precision. For coplanar triangles it spans
+ * the two furthest-apart points of the overlap region.
+ *
+ * The Adjacent variants are for triangles of one mesh that share vertices: they only report
+ * intersections away from the shared edge/vertex (ie folds and crossings, not the shared element).
+ */
+
+namespace rms
+{
+
+//! returns true if the triangles intersect
+bool IntersectTriangles( const Wml::Vector3d vTri1[3], const Wml::Vector3d vTri2[3],
+						 Wml::Vector3d vSegment[2], bool * pCoplanar = NULL );
+
+//! triangles (a,b,c) and (a,b,d) sharing edge [a,b]. Intersect only if coplanar and folded onto each other
+bool IntersectTrianglesSharedEdge( const Wml::Vector3d & a, const Wml::Vector3d & b,
+								   const Wml::Vector3d & c, const Wml::Vector3d & d, Wml::Vector3d vSegment[2] );
+
+//! triangles (v,a,b) and (v,c,d) sharing vertex v. Intersect if they overlap anywhere other than v
+bool IntersectTrianglesSharedVertex( const Wml::Vector3d & v, const Wml::Vector3d & a, const Wml::Vector3d & b,
+									 const Wml::Vector3d & c, const Wml::Vector3d & d, Wml::Vector3d vSegment[2],
+									 bool * pCoplanar = NULL );
+
+}  // end namespace rms
+
+#endif // __RMS_TRIANGLE_INTERSECTION_H__
@@ -0,0 +1,350 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_TRIANGLE_KERNELS_H__
+#define __RMS_TRIANGLE_KERNELS_H__
+#include "config.h"
+#include <Wm4Vector3.h>
+#include <Wm4Math.h>
+#include "SIMDLanes.h"
+
+/*
+ * Lightweight ray/triangle and point/triangle kernels for the inner loops of the
+ * spatial data structures. These replace Wml::IntrRay3Triangle3 / Wml::DistVector3Triangle3,
+ * which are general-purpose query objects (virtual base, extra outputs) and are
+ * expensive to construct once per candidate triangle.
+ *
+ * Scalar versions work on Wml vectors. Batch versions work on a TrianglePacket, which
+ * stores N triangles in SoA layout (origin vertex + two edges). 4-wide packets use SSE,
+ * 8-wide packets use AVX if the compiler targets it (otherwise two SSE passes). On
+ * platforms without SSE the batch versions loop over the scalar kernels. See SIMDLanes.h.
+ */
+
+
+namespace rms
+{
+
+/*
+ * Scalar kernels
+ */
+
+//! Moller-Trumbore ray/triangle test (two-sided). On hit, returns ray parameter fT and barycentric (fU,fV) of vertices 1 and 2
+template <class Real>
+inline bool RayTriangleIntersect( const Wml::Vector3<Real> & vOrigin, const Wml::Vector3<Real> & vDirection,
+								  const Wml::Vector3<Real> & v0, const Wml::Vector3<Real> & v1, const Wml::Vector3<Real> & v2,
+								  Real & fT, Real & fU, Real & fV )
+{
+	Wml::Vector3<Real> e1( v1 - v0 ), e2( v2 - v0 );
+	Wml::Vector3<Real> p( vDirection.Cross(e2) );
+	Real fDet = e1.Dot(p);
+	if ( fDet > -Wml::Math<Real>::ZERO_TOLERANCE && fDet < Wml::Math<Real>::ZERO_TOLERANCE )
+		return false;
+	Real fInvDet = (Real)1 / fDet;
+	Wml::Vector3<Real> s( vOrigin - v0 );
+	fU = s.Dot(p) * fInvDet;
+	if ( fU < 0 || fU > 1 )
+		return false;
+	Wml::Vector3<Real> q( s.Cross(e1) );
+	fV = vDirection.Dot(q) * fInvDet;
+	if ( fV < 0 || fU + fV > 1 )
+		return false;
+	fT = e2.Dot(q) * fInvDet;
+	return fT >= 0;
+}
+
+
+//! squared distance from point to triangle. Barycentric coords of closest point are returned in fBary
+//  (region classification from Ericson, Real-Time Collision Detection, 5.1.5)
+template <class Real>
+inline Real PointTriangleSqrDistance( const Wml::Vector3<Real> & vPoint,
+									  const Wml::Vector3<Real> & a, const Wml::Vector3<Real> & b, const Wml::Vector3<Real> & c,
+									  Real fBary[3] )
+{
+	Wml::Vector3<Real> ab( b - a ), ac( c - a ), ap( vPoint - a );
+	Real d1 = ab.Dot(ap), d2 = ac.Dot(ap);
+	Real v = 0, w = 0;
+	if ( d1 <= 0 && d2 <= 0 ) {
+		v = 0; w = 0;								// vertex A
+	} else {
+		Wml::Vector3<Real> bp( vPoint - b );
+		Real d3 = ab.Dot(bp), d4 = ac.Dot(bp);
+		Real vc = d1*d4 - d3*d2;
+		if ( d3 >= 0 && d4 <= d3 ) {
+			v = 1; w = 0;							// vertex B
+		} else if ( vc <= 0 && d1 >= 0 && d3 <= 0 ) {
+			v = d1 / (d1 - d3); w = 0;				// edge AB
+		} else {
+			Wml::Vector3<Real> cp( vPoint - c );
+			Real d5 = ab.Dot(cp), d6 = ac.Dot(cp);
+			Real vb = d5*d2 - d1*d6;
+			Real va = d3*d6 - d5*d4;
+			if ( d6 >= 0 && d5 <= d6 ) {
+				v = 0; w = 1;						// vertex C
+			} else if ( vb <= 0 && d2 >= 0 && d6 <= 0 ) {
+				v = 0; w = d2 / (d2 - d6);			// edge AC
+			} else if ( va <= 0 && (d4-d3) >= 0 && (d5-d6) >= 0 ) {
+				w = (d4-d3) / ( (d4-d3) + (d5-d6) );	// edge BC
+				v = 1 - w;
+			} else {
+				Real fSum = va + vb + vc;			// interior
+				if ( fSum > 0 ) {
+					Real fDenom = (Real)1 / fSum;
+					v = vb * fDenom;
+					w = vc * fDenom;
+				}
+			}
+		}
+	}
+	fBary[0] = 1 - v - w;  fBary[1] = v;  fBary[2] = w;
+	Wml::Vector3<Real> vDiff( ap - v*ab - w*ac );
+	return vDiff.SquaredLength();
+}
+
+
+//! squared distance from point to segment [a,b]. fT is the segment parameter of the closest point, in [0,1]
+template <class Real>
+inline Real PointSegmentSqrDistance( const Wml::Vector3<Real> & vPoint,
+									 const Wml::Vector3<Real> & a, const Wml::Vector3<Real> & b, Real & fT )
+{
+	Wml::Vector3<Real> ab( b - a ), ap( vPoint - a );
+	Real fLenSqr = ab.SquaredLength();
+	fT = ( fLenSqr > 0 ) ? ap.Dot(ab) / fLenSqr : 0;
+	fT = ( fT < 0 ) ? 0 : ( (fT > 1) ? 1 : fT );
+	Wml::Vector3<Real> vDiff( ap - fT*ab );
+	return vDiff.SquaredLength();
+}
+
+
+
+
+/*
+ * Packed triangles (SoA layout)
+ */
+template <int N>
+struct TrianglePacket
+{
+	enum { Width = N };
+
+	float v0[3][N];		//! first vertex
+	float e1[3][N];		//! v1 - v0
+	float e2[3][N];		//! v2 - v0
+	int nCount;			//! number of valid lanes. Unused lanes duplicate lane 0 (see Pad())
+
+	TrianglePacket() : nCount(0) {}
+
+	inline void Set( int i, const Wml::Vector3f & a, const Wml::Vector3f & b, const Wml::Vector3f & c ) {
+		for ( int k = 0; k < 3; ++k ) {
+			v0[k][i] = a[k];
+			e1[k][i] = b[k] - a[k];
+			e2[k][i] = c[k] - a[k];
+		}
+	}
+	inline void Append( const Wml::Vector3f & a, const Wml::Vector3f & b, const Wml::Vector3f & c )
+		{ Set( nCount++, a, b, c ); }
+
+	//! fill unused lanes with copies of lane 0, so that they can never produce a "better" result
+	inline void Pad() {
+		for ( int i = nCount; i < N; ++i )
+			for ( int k = 0; k < 3; ++k ) {
+				v0[k][i] = v0[k][0];  e1[k][i] = e1[k][0];  e2[k][i] = e2[k][0];
+			}
+	}
+};
+typedef TrianglePacket<4> TrianglePacket4;
+typedef TrianglePacket<8> TrianglePacket8;
+
+
+
+// batch kernels are written once over the SIMD lane types
+namespace TriangleKernelsImpl
+{
+	using namespace SIMD;
+
+	//! Moller-Trumbore on W lanes starting at nLane. Returns hit bitmask (relative to nLane)
+	template <class F, int N>
+	inline int RayTriangleLanes( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection,
+								 const TrianglePacket<N> & tris, int nLane, float * pT, float * pU, float * pV )
+	{
+		F e1x( F::Load(tris.e1[0]+nLane) ), e1y( F::Load(tris.e1[1]+nLane) ), e1z( F::Load(tris.e1[2]+nLane) );
+		F e2x( F::Load(tris.e2[0]+nLane) ), e2y( F::Load(tris.e2[1]+nLane) ), e2z( F::Load(tris.e2[2]+nLane) );
+		F dx( vDirection.X() ), dy( vDirection.Y() ), dz( vDirection.Z() );
+
+		F px( dy*e2z - dz*e2y ), py( dz*e2x - dx*e2z ), pz( dx*e2y - dy*e2x );
+		F det( e1x*px + e1y*py + e1z*pz );
+		F invdet( F(1.0f) / det );
+
+		F sx( F(vOrigin.X()) - F::Load(tris.v0[0]+nLane) );
+		F sy( F(vOrigin.Y()) - F::Load(tris.v0[1]+nLane) );
+		F sz( F(vOrigin.Z()) - F::Load(tris.v0[2]+nLane) );
+		F u( (sx*px + sy*py + sz*pz) * invdet );
+
+		F qx( sy*e1z - sz*e1y ), qy( sz*e1x - sx*e1z ), qz( sx*e1y - sy*e1x );
+		F v( (dx*qx + dy*qy + dz*qz) * invdet );
+		F t( (e2x*qx + e2y*qy + e2z*qz) * invdet );
+
+		// NaN lanes (det == 0) fail the ordered compares
+		F zero(0.0f), one(1.0f);
+		F hit( (Abs(det) > F(Wml::Math<float>::ZERO_TOLERANCE)) & (u >= zero) & (v >= zero) & ((u+v) <= one) & (t >= zero) );
+		t.Store(pT);  u.Store(pU);  v.Store(pV);
+		return MoveMask(hit);
+	}
+
+
+	//! branch-free version of the scalar PointTriangleSqrDistance() region test, on W lanes starting at nLane
+	template <class F, int N>
+	inline void PointTriangleLanes( const Wml::Vector3f & vPoint, const TrianglePacket<N> & tris, int nLane,
+									float * pSqrDist, float * pV, float * pW )
+	{
+		F abx( F::Load(tris.e1[0]+nLane) ), aby( F::Load(tris.e1[1]+nLane) ), abz( F::Load(tris.e1[2]+nLane) );
+		F acx( F::Load(tris.e2[0]+nLane) ), acy( F::Load(tris.e2[1]+nLane) ), acz( F::Load(tris.e2[2]+nLane) );
+		F apx( F(vPoint.X()) - F::Load(tris.v0[0]+nLane) );
+		F apy( F(vPoint.Y()) - F::Load(tris.v0[1]+nLane) );
+		F apz( F(vPoint.Z()) - F::Load(tris.v0[2]+nLane) );
+
+		F d1( abx*apx + aby*apy + abz*apz ), d2( acx*apx + acy*apy + acz*apz );
+		F bpx( apx - abx ), bpy( apy - aby ), bpz( apz - abz );
+		F d3( abx*bpx + aby*bpy + abz*bpz ), d4( acx*bpx + acy*bpy + acz*bpz );
+		F cpx( apx - acx ), cpy( apy - acy ), cpz( apz - acz );
+		F d5( abx*cpx + aby*cpy + abz*cpz ), d6( acx*cpx + acy*cpy + acz*cpz );
+
+		F vc( d1*d4 - d3*d2 ), vb( d5*d2 - d1*d6 ), va( d3*d6 - d5*d4 );
+		F zero(0.0f), one(1.0f);
+
+		// interior, then override by regions in reverse order of the scalar tests
+		F sum( va + vb + vc );
+		F denom( one / sum );
+		F v( Select( sum > zero, vb*denom, zero ) );
+		F w( Select( sum > zero, vc*denom, zero ) );
+
+		F d43( d4 - d3 ), d56( d5 - d6 );
+		F mBC( (va <= zero) & (d43 >= zero) & (d56 >= zero) );
+		F wBC( d43 / (d43 + d56) );
+		v = Select( mBC, one - wBC, v );   w = Select( mBC, wBC, w );
+
+		F mAC( (vb <= zero) & (d2 >= zero) & (d6 <= zero) );
+		v = Select( mAC, zero, v );   w = Select( mAC, d2 / (d2 - d6), w );
+
+		F mC( (d6 >= zero) & (d5 <= d6) );
+		v = Select( mC, zero, v );   w = Select( mC, one, w );
+
+		F mAB( (vc <= zero) & (d1 >= zero) & (d3 <= zero) );
+		v = Select( mAB, d1 / (d1 - d3), v );   w = Select( mAB, zero, w );
+
+		F mB( (d3 >= zero) & (d4 <= d3) );
+		v = Select( mB, one, v );   w = Select( mB, zero, w );
+
+		F mA( (d1 <= zero) & (d2 <= zero) );
+		v = Select( mA, zero, v );   w = Select( mA, zero, w );
+
+		F dx( apx - v*abx - w*acx ), dy( apy - v*aby - w*acy ), dz( apz - v*abz - w*acz );
+		F dist( dx*dx + dy*dy + dz*dz );
+		dist.Store(pSqrDist);  v.Store(pV);  w.Store(pW);
+	}
+
+}  // end namespace TriangleKernelsImpl
+
+
+
+
+/*
+ * Batch kernels
+ */
+
+//! ray vs all triangles in packet. Returns hit bitmask; per-lane ray parameter / barycentrics in fT/fU/fV
+template <int N>
+inline int RayTrianglePacketIntersect( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection,
+									   const TrianglePacket<N> & tris, float fT[N], float fU[N], float fV[N] )
+{
+	int nMask = 0;
+#if defined(RMS_SIMD_AVX)
+	if ( N % 8 == 0 ) {
+		for ( int i = 0; i < N; i += 8 )
+			nMask |= TriangleKernelsImpl::RayTriangleLanes<TriangleKernelsImpl::Float8,N>(vOrigin, vDirection, tris, i, fT+i, fU+i, fV+i) << i;
+		return nMask;
+	}
+#endif
+#if defined(RMS_SIMD_SSE)
+	for ( int i = 0; i < N; i += 4 )
+		nMask |= TriangleKernelsImpl::RayTriangleLanes<TriangleKernelsImpl::Float4,N>(vOrigin, vDirection, tris, i, fT+i, fU+i, fV+i) << i;
+#else
+	for ( int i = 0; i < N; ++i ) {
+		Wml::Vector3f v0( tris.v0[0][i], tris.v0[1][i], tris.v0[2][i] );
+		Wml::Vector3f v1( v0.X() + tris.e1[0][i], v0.Y() + tris.e1[1][i], v0.Z() + tris.e1[2][i] );
+		Wml::Vector3f v2( v0.X() + tris.e2[0][i], v0.Y() + tris.e2[1][i], v0.Z() + tris.e2[2][i] );
+		if ( RayTriangleIntersect(vOrigin, vDirection, v0, v1, v2, fT[i], fU[i], fV[i]) )
+			nMask |= (1 << i);
+	}
+#endif
+	return nMask;
+}
+
+//! point vs all triangles in packet. Per-lane squared distance, and barycentrics (1-v-w, v, w) of closest point
+template <int N>
+inline void PointTrianglePacketSqrDistance( const Wml::Vector3f & vPoint, const TrianglePacket<N> & tris,
+											float fSqrDist[N], float fV[N], float fW[N] )
+{
+#if defined(RMS_SIMD_AVX)
+	if ( N % 8 == 0 ) {
+		for ( int i = 0; i < N; i += 8 )
+			TriangleKernelsImpl::PointTriangleLanes<TriangleKernelsImpl::Float8,N>(vPoint, tris, i, fSqrDist+i, fV+i, fW+i);
+		return;
+	}
+#endif
+#if defined(RMS_SIMD_SSE)
+	for ( int i = 0; i < N; i += 4 )
+		TriangleKernelsImpl::PointTriangleLanes<TriangleKernelsImpl::Float4,N>(vPoint, tris, i, fSqrDist+i, fV+i, fW+i);
+#else
+	for ( int i = 0; i < N; ++i ) {
+		Wml::Vector3f v0( tris.v0[0][i], tris.v0[1][i], tris.v0[2][i] );
+		Wml::Vector3f v1( v0.X() + tris.e1[0][i], v0.Y() + tris.e1[1][i], v0.Z() + tris.e1[2][i] );
+		Wml::Vector3f v2( v0.X() + tris.e2[0][i], v0.Y() + tris.e2[1][i], v0.Z() + tris.e2[2][i] );
+		float fBary[3];
+		fSqrDist[i] = PointTriangleSqrDistance(vPoint, v0, v1, v2, fBary);
+		fV[i] = fBary[1];  fW[i] = fBary[2];
+	}
+#endif
+}
+
+
+//! nearest ray hit in packet. Returns lane index, or -1 if no hit (or no hit closer than fMaxT)
+template <int N>
+inline int RayTrianglePacketNearest( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection,
+									 const TrianglePacket<N> & tris, float fMaxT, float & fT, float fBary[3] )
+{
+	float vT[N], vU[N], vV[N];
+	int nMask = RayTrianglePacketIntersect(vOrigin, vDirection, tris, vT, vU, vV);
+	int nBest = -1;
+	for ( int i = 0; i < tris.nCount; ++i ) {
+		if ( (nMask & (1<<i)) && vT[i] < fMaxT ) {
+			fMaxT = vT[i];
+			nBest = i;
+		}
+	}
+	if ( nBest >= 0 ) {
+		fT = vT[nBest];
+		fBary[0] = 1 - vU[nBest] - vV[nBest];  fBary[1] = vU[nBest];  fBary[2] = vV[nBest];
+	}
+	return nBest;
+}
+
+//! nearest triangle in packet. Returns lane index (always valid if nCount > 0)
+template <int N>
+inline int PointTrianglePacketNearest( const Wml::Vector3f & vPoint, const TrianglePacket<N> & tris,
+									   float & fSqrDist, float fBary[3] )
+{
+	float vDist[N], vV[N], vW[N];
+	PointTrianglePacketSqrDistance(vPoint, tris, vDist, vV, vW);
+	int nBest = 0;
+	for ( int i = 1; i < tris.nCount; ++i ) {
+		if ( vDist[i] < vDist[nBest] )
+			nBest = i;
+	}
+	fSqrDist = vDist[nBest];
+	fBary[0] = 1 - vV[nBest] - vW[nBest];  fBary[1] = vV[nBest];  fBary[2] = vW[nBest];
+	return nBest;
+}
+
+
+}  // end namespace rms
+
+#endif // __RMS_TRIANGLE_KERNELS_H__
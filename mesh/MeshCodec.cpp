@@ -0,0 +1,1064 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "MeshCodec.h"
+#include "VFTriangleMesh.h"
+#include "MeshUtils.h"
+#include "rmsdebug.h"
+
+#include <algorithm>
+#include <deque>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace rms;
+
+
+namespace {
+
+static double GetSeconds()
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+//! number of bits needed to store values in [0,nCount)
+static int IndexBits( unsigned int nCount )
+{
+	int nBits = 1;
+	while ( nBits < 32 && (nCount-1) >> nBits )
+		++nBits;
+	return nBits;
+}
+
+
+/*
+ * range coder (carry-propagating, LZMA-style byte output)
+ */
+class RangeEncoder
+{
+public:
+	RangeEncoder( std::vector<unsigned char> & vOut ) : m_vOut(vOut)
+		{ m_nLow = 0; m_nRange = 0xFFFFFFFF; m_nCache = 0; m_nCacheSize = 1; }
+
+	void Encode( unsigned int nStart, unsigned int nSize, unsigned int nTotal ) {
+		unsigned int r = m_nRange / nTotal;
+		m_nLow += (unsigned long long)nStart * r;
+		m_nRange = nSize * r;
+		while ( m_nRange < (1u << 24) ) {
+			m_nRange <<= 8;
+			ShiftLow();
+		}
+	}
+	void EncodeBits( unsigned int nValue, int nBits ) {
+		while ( nBits > 0 ) {
+			int n = std::min(nBits, 16);
+			Encode( nValue & ((1u << n) - 1), 1, 1u << n );
+			nValue >>= n;
+			nBits -= n;
+		}
+	}
+	void Flush() {
+		for ( int k = 0; k < 5; ++k )
+			ShiftLow();
+	}
+	size_t GetBytes() const { return m_vOut.size() + m_nCacheSize; }
+
+protected:
+	std::vector<unsigned char> & m_vOut;
+	unsigned long long m_nLow;
+	unsigned int m_nRange;
+	unsigned char m_nCache;
+	unsigned long long m_nCacheSize;
+
+	void ShiftLow() {
+		if ( (unsigned int)m_nLow < 0xFF000000u || (m_nLow >> 32) != 0 ) {
+			unsigned char nCarry = (unsigned char)(m_nLow >> 32);
+			unsigned char nTemp = m_nCache;
+			do {
+				m_vOut.push_back( (unsigned char)(nTemp + nCarry) );
+				nTemp = 0xFF;
+			} while ( --m_nCacheSize != 0 );
+			m_nCache = (unsigned char)( (unsigned int)m_nLow >> 24 );
+		}
+		m_nCacheSize++;
+		m_nLow = (m_nLow & 0x00FFFFFF) << 8;
+	}
+};
+
+class RangeDecoder
+{
+public:
+	RangeDecoder( const unsigned char * pData, size_t nBytes ) : m_pData(pData), m_nBytes(nBytes), m_nPos(0) {
+		m_nRange = 0xFFFFFFFF;  m_nCode = 0;  m_nStep = 1;
+		for ( int k = 0; k < 5; ++k )
+			m_nCode = (m_nCode << 8) | NextByte();
+	}
+
+	unsigned int GetFreq( unsigned int nTotal ) {
+		m_nStep = m_nRange / nTotal;
+		unsigned int nValue = m_nCode / m_nStep;
+		return std::min( nValue, nTotal-1 );
+	}
+	void Decode( unsigned int nStart, unsigned int nSize ) {
+		m_nCode -= nStart * m_nStep;
+		m_nRange = nSize * m_nStep;
+		while ( m_nRange < (1u << 24) ) {
+			m_nCode = (m_nCode << 8) | NextByte();
+			m_nRange <<= 8;
+		}
+	}
+	unsigned int DecodeBits( int nBits ) {
+		unsigned int nValue = 0;
+		int nShift = 0;
+		while ( nBits > 0 ) {
+			int n = std::min(nBits, 16);
+			unsigned int nChunk = GetFreq( 1u << n );
+			Decode( nChunk, 1 );
+			nValue |= nChunk << nShift;
+			nShift += n;
+			nBits -= n;
+		}
+		return nValue;
+	}
+	//! true if the decoder read past the end of the data
+	bool Overrun() const { return m_nPos > m_nBytes + 5; }
+
+protected:
+	const unsigned char * m_pData;
+	size_t m_nBytes;
+	size_t m_nPos;
+	unsigned int m_nRange;
+	unsigned int m_nCode;
+	unsigned int m_nStep;
+
+	unsigned char NextByte() {
+		unsigned char c = (m_nPos < m_nBytes) ? m_pData[m_nPos] : 0;
+		++m_nPos;
+		return c;
+	}
+};
+
+
+//! adaptive frequency model for small alphabets
+class AdaptiveModel
+{
+public:
+	AdaptiveModel( unsigned int nSymbols ) : m_vFreq(nSymbols, 1), m_nTotal(nSymbols) {}
+
+	void Encode( RangeEncoder & enc, unsigned int nSymbol ) {
+		unsigned int nStart = 0;
+		for ( unsigned int k = 0; k < nSymbol; ++k )
+			nStart += m_vFreq[k];
+		enc.Encode( nStart, m_vFreq[nSymbol], m_nTotal );
+		Update(nSymbol);
+	}
+	unsigned int Decode( RangeDecoder & dec ) {
+		unsigned int nFreq = dec.GetFreq( m_nTotal );
+		unsigned int nSymbol = 0, nStart = 0;
+		while ( nStart + m_vFreq[nSymbol] <= nFreq )
+			nStart += m_vFreq[nSymbol++];
+		dec.Decode( nStart, m_vFreq[nSymbol] );
+		Update(nSymbol);
+		return nSymbol;
+	}
+
+protected:
+	std::vector<unsigned int> m_vFreq;
+	unsigned int m_nTotal;
+
+	void Update( unsigned int nSymbol ) {
+		m_vFreq[nSymbol] += 32;
+		m_nTotal += 32;
+		if ( m_nTotal > (1u << 16) ) {
+			m_nTotal = 0;
+			for ( unsigned int k = 0; k < m_vFreq.size(); ++k ) {
+				m_vFreq[k] = (m_vFreq[k] + 1) / 2;
+				m_nTotal += m_vFreq[k];
+			}
+		}
+	}
+};
+
+
+//! integer residual: bit length (adaptive), then sign and low bits (raw)
+static void EncodeResidual( RangeEncoder & enc, AdaptiveModel & model, int nResidual )
+{
+	unsigned int nAbs = (unsigned int)( (nResidual < 0) ? -nResidual : nResidual );
+	int nLength = 0;
+	while ( nAbs >> nLength )
+		++nLength;
+	model.Encode(enc, nLength);
+	if ( nLength > 0 ) {
+		enc.EncodeBits( (nResidual < 0) ? 1 : 0, 1 );
+		if ( nLength > 1 )
+			enc.EncodeBits( nAbs - (1u << (nLength-1)), nLength-1 );
+	}
+}
+static int DecodeResidual( RangeDecoder & dec, AdaptiveModel & model )
+{
+	int nLength = (int)model.Decode(dec);
+	if ( nLength == 0 )
+		return 0;
+	bool bNegative = ( dec.DecodeBits(1) != 0 );
+	unsigned int nAbs = 1u << (nLength-1);
+	if ( nLength > 1 )
+		nAbs += dec.DecodeBits(nLength-1);
+	return (bNegative) ? -(int)nAbs : (int)nAbs;
+}
+
+
+
+/*
+ * traversal state, identical in the encoder and decoder
+ */
+enum TraversalOp {
+	OpSkip = 0,				// no triangle across gate (boundary)
+	OpNew = 1,				// third vertex is a new vertex
+	OpNeighborA = 2,		// third vertex is one of the 8 most recent neighbours of gate vertex a
+	OpNeighborB = 10,		//   ... of gate vertex b
+	OpGlobal = 18,			// explicit chunk vertex index
+	NumGateOps = 19,
+
+	OpSeedNew = 32,			// seed triangle vertices
+	OpSeedGlobal = 33
+};
+static const int NeighborSlots = 8;
+
+struct Gate {
+	unsigned int a, b, c;		// gate edge (a,b), c is opposite in the triangle that created it
+	Gate( unsigned int a_, unsigned int b_, unsigned int c_ ) : a(a_), b(b_), c(c_) {}
+};
+
+class TraversalState
+{
+public:
+	struct Neighbor {
+		unsigned int nVertex;
+		unsigned int nTriangles;
+	};
+	std::vector< std::vector<Neighbor> > vNeighbors;
+	std::deque<Gate> vGates;
+	std::vector<int> vPredict;		// 3 per vertex: parallelogram (a,b,c), copy (a,-1,-1) or none (-1,-1,-1)
+
+	unsigned int VertexCount() const { return (unsigned int)vNeighbors.size(); }
+
+	unsigned int AddVertex( int a, int b, int c ) {
+		vNeighbors.push_back( std::vector<Neighbor>() );
+		vPredict.push_back(a);  vPredict.push_back(b);  vPredict.push_back(c);
+		return (unsigned int)vNeighbors.size() - 1;
+	}
+	unsigned int AddSeedVertex() {
+		int nPrev = (int)vNeighbors.size() - 1;
+		return AddVertex( nPrev, -1, -1 );
+	}
+
+	unsigned int EdgeCount( unsigned int a, unsigned int b ) const {
+		const std::vector<Neighbor> & v = vNeighbors[a];
+		for ( unsigned int k = 0; k < v.size(); ++k )
+			if ( v[k].nVertex == b )
+				return v[k].nTriangles;
+		return 0;
+	}
+
+	//! position of x in the recent neighbours of a, or -1
+	int FindNeighbor( unsigned int a, unsigned int x ) const {
+		const std::vector<Neighbor> & v = vNeighbors[a];
+		int nCount = std::min( (int)v.size(), NeighborSlots );
+		for ( int k = 0; k < nCount; ++k )
+			if ( v[v.size()-1-k].nVertex == x )
+				return k;
+		return -1;
+	}
+	int GetNeighbor( unsigned int a, int k ) const {
+		const std::vector<Neighbor> & v = vNeighbors[a];
+		return ( k < (int)v.size() ) ? (int)v[v.size()-1-k].nVertex : -1;
+	}
+
+	void AddTriangle( unsigned int t0, unsigned int t1, unsigned int t2 ) {
+		AddEdge(t0, t1);  AddEdge(t1, t2);  AddEdge(t2, t0);
+	}
+	void PushSeedGates( unsigned int t0, unsigned int t1, unsigned int t2 ) {
+		vGates.push_back( Gate(t0,t1,t2) );
+		vGates.push_back( Gate(t1,t2,t0) );
+		vGates.push_back( Gate(t2,t0,t1) );
+	}
+	//! gate edge is (t0,t1)
+	void PushGates( unsigned int t0, unsigned int t1, unsigned int t2 ) {
+		vGates.push_back( Gate(t1,t2,t0) );
+		vGates.push_back( Gate(t2,t0,t1) );
+	}
+
+protected:
+	void AddEdge( unsigned int u, unsigned int v ) {
+		IncrementNeighbor(u, v);
+		if ( u != v )
+			IncrementNeighbor(v, u);
+	}
+	void IncrementNeighbor( unsigned int u, unsigned int v ) {
+		std::vector<Neighbor> & vList = vNeighbors[u];
+		for ( unsigned int k = 0; k < vList.size(); ++k ) {
+			if ( vList[k].nVertex == v ) {
+				vList[k].nTriangles++;
+				return;
+			}
+		}
+		Neighbor n;  n.nVertex = v;  n.nTriangles = 1;
+		vList.push_back(n);
+	}
+};
+
+
+static void PredictValues( const std::vector<int> & vValues, int nDim, const int * pPredict, int nMax, int * pOut )
+{
+	for ( int j = 0; j < nDim; ++j ) {
+		if ( pPredict[0] < 0 )
+			pOut[j] = 0;
+		else if ( pPredict[1] < 0 )
+			pOut[j] = vValues[nDim*pPredict[0]+j];
+		else {
+			int n = vValues[nDim*pPredict[0]+j] + vValues[nDim*pPredict[1]+j] - vValues[nDim*pPredict[2]+j];
+			pOut[j] = std::max( 0, std::min( nMax, n ) );
+		}
+	}
+}
+
+//! UV prediction has to fall back when the predicting vertices have no UV
+static void PredictUV( const std::vector<int> & vValues, const std::vector<unsigned char> & vHasUV, const int * pPredict, int nLastUV, int nMax, int * pOut )
+{
+	int vPredict[3] = { -1, -1, -1 };
+	if ( pPredict[0] >= 0 && vHasUV[pPredict[0]] ) {
+		vPredict[0] = pPredict[0];
+		if ( pPredict[1] >= 0 && vHasUV[pPredict[1]] && vHasUV[pPredict[2]] ) {
+			vPredict[1] = pPredict[1];
+			vPredict[2] = pPredict[2];
+		}
+	} else if ( nLastUV >= 0 )
+		vPredict[0] = nLastUV;
+	PredictValues( vValues, 2, vPredict, nMax, pOut );
+}
+
+
+
+/*
+ * file layout
+ */
+static const char FileMagic[4] = { 'R', 'M', 'C', '1' };
+
+struct FileHeader {
+	char vMagic[4];
+	int nPositionBits;
+	int nUVBits;
+	float vOrigin[3];
+	float fCellSize;
+	unsigned int nVertices;
+	unsigned int nTriangles;
+	unsigned int nChunks;
+	unsigned int nUVSets;
+};
+struct UVSetHeader {
+	float vOrigin[2];
+	float vCellSize[2];
+};
+
+
+//! quantized mesh data, indexed by vertex ID
+struct QuantizedData {
+	std::vector<int> vPositions;							// 3 per vertex
+	std::vector< std::vector<int> > vUVs;					// 2 per vertex, per UV set
+	std::vector< std::vector<unsigned char> > vHasUV;
+};
+
+
+//! result of the chunk traversal in the encoder
+struct ChunkTraversal {
+	std::vector<unsigned int> vOrder;			// chunk vertex -> mesh vertex ID, in coding order
+	std::vector<int> vPredict;
+	std::vector<unsigned char> vOps;
+	std::vector<unsigned char> vFlips;
+	std::vector<unsigned int> vGlobalRefs;		// chunk vertex index for OpGlobal / OpSeedGlobal
+	std::vector<int> vSharedRefs;				// per chunk vertex: -1 if first used in this chunk, otherwise decoded mesh vertex
+	unsigned int nTriangles;
+
+	std::vector<unsigned char> vBytes;
+	size_t nConnectivityBytes, nPositionBytes, nUVBytes;
+};
+
+
+static void TraverseChunk( const std::vector<unsigned int> & vTriangles, ChunkTraversal & chunk )
+{
+	unsigned int nTriangles = (unsigned int)vTriangles.size() / 3;
+	chunk.nTriangles = nTriangles;
+
+	// local vertex indices and vertex -> triangle lists
+	std::vector<unsigned int> vLocal(vTriangles);
+	std::sort(vLocal.begin(), vLocal.end());
+	vLocal.erase( std::unique(vLocal.begin(), vLocal.end()), vLocal.end() );
+	unsigned int nLocal = (unsigned int)vLocal.size();
+	std::vector<unsigned int> vTris( vTriangles.size() );
+	for ( unsigned int k = 0; k < vTriangles.size(); ++k )
+		vTris[k] = (unsigned int)( std::lower_bound(vLocal.begin(), vLocal.end(), vTriangles[k]) - vLocal.begin() );
+	std::vector<unsigned int> vStart(nLocal+1, 0), vVtxTris( vTris.size() );
+	for ( unsigned int k = 0; k < vTris.size(); ++k )
+		vStart[vTris[k]+1]++;
+	for ( unsigned int k = 0; k < nLocal; ++k )
+		vStart[k+1] += vStart[k];
+	std::vector<unsigned int> vFill(vStart.begin(), vStart.end()-1);
+	for ( unsigned int k = 0; k < vTris.size(); ++k )
+		vVtxTris[ vFill[vTris[k]]++ ] = k/3;
+
+	std::vector<int> vCodedID(nLocal, -1);
+	std::vector<unsigned int> vLocalOf;			// coded ID -> local index
+	std::vector<unsigned char> vDone(nTriangles, 0);
+	TraversalState state;
+	unsigned int nDone = 0, nNextSeed = 0;
+
+	while ( nDone < nTriangles ) {
+		if ( state.vGates.empty() ) {
+			while ( vDone[nNextSeed] )
+				++nNextSeed;
+			unsigned int tID = nNextSeed;
+			unsigned int vTri[3];
+			for ( int j = 0; j < 3; ++j ) {
+				unsigned int nLocalID = vTris[3*tID+j];
+				if ( vCodedID[nLocalID] < 0 ) {
+					vCodedID[nLocalID] = (int)state.AddSeedVertex();
+					vLocalOf.push_back(nLocalID);
+					chunk.vOps.push_back( OpSeedNew );
+				} else {
+					chunk.vOps.push_back( OpSeedGlobal );
+					chunk.vGlobalRefs.push_back( vCodedID[nLocalID] );
+				}
+				vTri[j] = vCodedID[nLocalID];
+			}
+			vDone[tID] = 1;  ++nDone;
+			state.AddTriangle(vTri[0], vTri[1], vTri[2]);
+			state.PushSeedGates(vTri[0], vTri[1], vTri[2]);
+			continue;
+		}
+
+		Gate gate = state.vGates.front();
+		state.vGates.pop_front();
+		if ( state.EdgeCount(gate.a, gate.b) >= 2 )
+			continue;
+
+		// find a remaining non-degenerate triangle across the gate
+		unsigned int la = vLocalOf[gate.a], lb = vLocalOf[gate.b];
+		int nFound = -1, nThird = -1;
+		bool bConsistent = true;
+		for ( unsigned int k = vStart[la]; k < vStart[la+1] && nFound < 0; ++k ) {
+			unsigned int tID = vVtxTris[k];
+			if ( vDone[tID] )
+				continue;
+			const unsigned int * t = &vTris[3*tID];
+			for ( int j = 0; j < 3; ++j ) {
+				if ( t[j] == la && t[(j+1)%3] == lb && t[(j+2)%3] != la && t[(j+2)%3] != lb ) {
+					nFound = (int)tID;  nThird = (int)t[(j+2)%3];  bConsistent = false;
+				} else if ( t[j] == lb && t[(j+1)%3] == la && t[(j+2)%3] != la && t[(j+2)%3] != lb ) {
+					nFound = (int)tID;  nThird = (int)t[(j+2)%3];  bConsistent = true;
+				}
+			}
+		}
+		if ( nFound < 0 ) {
+			chunk.vOps.push_back( OpSkip );
+			continue;
+		}
+
+		unsigned int x;
+		if ( vCodedID[nThird] < 0 ) {
+			x = state.AddVertex( gate.a, gate.b, gate.c );
+			vCodedID[nThird] = (int)x;
+			vLocalOf.push_back(nThird);
+			chunk.vOps.push_back( OpNew );
+		} else {
+			x = (unsigned int)vCodedID[nThird];
+			int k = state.FindNeighbor(gate.a, x);
+			if ( k >= 0 )
+				chunk.vOps.push_back( (unsigned char)(OpNeighborA + k) );
+			else if ( (k = state.FindNeighbor(gate.b, x)) >= 0 )
+				chunk.vOps.push_back( (unsigned char)(OpNeighborB + k) );
+			else {
+				chunk.vOps.push_back( OpGlobal );
+				chunk.vGlobalRefs.push_back(x);
+			}
+		}
+		chunk.vFlips.push_back( (bConsistent) ? 0 : 1 );
+		vDone[nFound] = 1;  ++nDone;
+
+		unsigned int t0 = (bConsistent) ? gate.b : gate.a;
+		unsigned int t1 = (bConsistent) ? gate.a : gate.b;
+		state.AddTriangle(t0, t1, x);
+		state.PushGates(t0, t1, x);
+	}
+
+	chunk.vOrder.resize( vLocalOf.size() );
+	for ( unsigned int k = 0; k < vLocalOf.size(); ++k )
+		chunk.vOrder[k] = vLocal[ vLocalOf[k] ];
+	chunk.vPredict.swap( state.vPredict );
+}
+
+
+static void EncodeChunk( ChunkTraversal & chunk, const QuantizedData & data, const FileHeader & header )
+{
+	RangeEncoder enc(chunk.vBytes);
+	unsigned int nVertices = (unsigned int)chunk.vOrder.size();
+	enc.EncodeBits( nVertices, 32 );
+	enc.EncodeBits( chunk.nTriangles, 32 );
+
+	// connectivity
+	int nLocalBits = IndexBits(nVertices);
+	AdaptiveModel gateModel(NumGateOps), seedModel(2), flipModel(2);
+	unsigned int nFlip = 0, nGlobal = 0;
+	for ( unsigned int k = 0; k < chunk.vOps.size(); ++k ) {
+		unsigned int nOp = chunk.vOps[k];
+		if ( nOp >= OpSeedNew ) {
+			seedModel.Encode( enc, nOp - OpSeedNew );
+			if ( nOp == OpSeedGlobal )
+				enc.EncodeBits( chunk.vGlobalRefs[nGlobal++], nLocalBits );
+			continue;
+		}
+		gateModel.Encode( enc, nOp );
+		if ( nOp == OpGlobal )
+			enc.EncodeBits( chunk.vGlobalRefs[nGlobal++], nLocalBits );
+		if ( nOp != OpSkip )
+			flipModel.Encode( enc, chunk.vFlips[nFlip++] );
+	}
+
+	// vertices shared with earlier chunks
+	int nSharedBits = IndexBits(header.nVertices);
+	AdaptiveModel sharedModel(2);
+	for ( unsigned int k = 0; k < nVertices; ++k ) {
+		sharedModel.Encode( enc, (chunk.vSharedRefs[k] < 0) ? 0 : 1 );
+		if ( chunk.vSharedRefs[k] >= 0 )
+			enc.EncodeBits( (unsigned int)chunk.vSharedRefs[k], nSharedBits );
+	}
+	chunk.nConnectivityBytes = enc.GetBytes();
+
+	// positions, in coding order
+	int nMax = (1 << header.nPositionBits) - 1;
+	std::vector<int> vValues( 3*nVertices );
+	AdaptiveModel positionModel( header.nPositionBits + 2 );
+	int vPredict[3];
+	for ( unsigned int k = 0; k < nVertices; ++k ) {
+		const int * pQuant = &data.vPositions[ 3*chunk.vOrder[k] ];
+		PredictValues( vValues, 3, &chunk.vPredict[3*k], nMax, vPredict );
+		for ( int j = 0; j < 3; ++j ) {
+			vValues[3*k+j] = pQuant[j];
+			EncodeResidual( enc, positionModel, pQuant[j] - vPredict[j] );
+		}
+	}
+	chunk.nPositionBytes = enc.GetBytes() - chunk.nConnectivityBytes;
+
+	// UV sets
+	int nMaxUV = (1 << header.nUVBits) - 1;
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet ) {
+		AdaptiveModel hasModel(2), uvModel( header.nUVBits + 2 );
+		std::vector<int> vUVs( 2*nVertices, 0 );
+		std::vector<unsigned char> vHasUV( nVertices, 0 );
+		int nLastUV = -1;
+		for ( unsigned int k = 0; k < nVertices; ++k ) {
+			unsigned int vID = chunk.vOrder[k];
+			vHasUV[k] = data.vHasUV[nSet][vID];
+			hasModel.Encode( enc, vHasUV[k] );
+			if ( ! vHasUV[k] )
+				continue;
+			PredictUV( vUVs, vHasUV, &chunk.vPredict[3*k], nLastUV, nMaxUV, vPredict );
+			for ( int j = 0; j < 2; ++j ) {
+				vUVs[2*k+j] = data.vUVs[nSet][2*vID+j];
+				EncodeResidual( enc, uvModel, vUVs[2*k+j] - vPredict[j] );
+			}
+			nLastUV = (int)k;
+		}
+	}
+	enc.Flush();
+	chunk.nUVBytes = chunk.vBytes.size() - chunk.nPositionBytes - chunk.nConnectivityBytes;
+
+	std::vector<unsigned char>().swap(chunk.vOps);
+	std::vector<unsigned char>().swap(chunk.vFlips);
+	std::vector<unsigned int>().swap(chunk.vGlobalRefs);
+	std::vector<int>().swap(chunk.vPredict);
+}
+
+
+
+//! decoded chunk, in chunk vertex indices
+struct DecodedChunk {
+	std::vector<unsigned int> vTriangles;
+	std::vector<int> vSharedRefs;
+	std::vector<int> vPositions;
+	std::vector< std::vector<int> > vUVs;
+	std::vector< std::vector<unsigned char> > vHasUV;
+	bool bOK;
+};
+
+static bool DecodeChunk( const unsigned char * pData, size_t nBytes, const FileHeader & header, DecodedChunk & chunk )
+{
+	RangeDecoder dec(pData, nBytes);
+	unsigned int nVertices = dec.DecodeBits(32);
+	unsigned int nTriangles = dec.DecodeBits(32);
+	if ( nVertices > header.nVertices || nTriangles > header.nTriangles )
+		return false;
+
+	// connectivity
+	int nLocalBits = IndexBits(nVertices);
+	AdaptiveModel gateModel(NumGateOps), seedModel(2), flipModel(2);
+	TraversalState state;
+	chunk.vTriangles.reserve( 3*nTriangles );
+	unsigned int nDone = 0;
+	while ( nDone < nTriangles ) {
+		if ( dec.Overrun() )
+			return false;
+		if ( state.vGates.empty() ) {
+			unsigned int vTri[3];
+			for ( int j = 0; j < 3; ++j ) {
+				if ( seedModel.Decode(dec) == 0 )
+					vTri[j] = state.AddSeedVertex();
+				else {
+					vTri[j] = dec.DecodeBits(nLocalBits);
+					if ( vTri[j] >= state.VertexCount() )
+						return false;
+				}
+			}
+			chunk.vTriangles.push_back(vTri[0]);  chunk.vTriangles.push_back(vTri[1]);  chunk.vTriangles.push_back(vTri[2]);
+			++nDone;
+			state.AddTriangle(vTri[0], vTri[1], vTri[2]);
+			state.PushSeedGates(vTri[0], vTri[1], vTri[2]);
+			continue;
+		}
+
+		Gate gate = state.vGates.front();
+		state.vGates.pop_front();
+		if ( state.EdgeCount(gate.a, gate.b) >= 2 )
+			continue;
+		unsigned int nOp = gateModel.Decode(dec);
+		if ( nOp == OpSkip )
+			continue;
+
+		int x;
+		if ( nOp == OpNew )
+			x = (int)state.AddVertex( gate.a, gate.b, gate.c );
+		else if ( nOp < OpNeighborB )
+			x = state.GetNeighbor( gate.a, nOp - OpNeighborA );
+		else if ( nOp < OpGlobal )
+			x = state.GetNeighbor( gate.b, nOp - OpNeighborB );
+		else
+			x = (int)dec.DecodeBits(nLocalBits);
+		if ( x < 0 || x >= (int)state.VertexCount() )
+			return false;
+
+		bool bConsistent = ( flipModel.Decode(dec) == 0 );
+		unsigned int t0 = (bConsistent) ? gate.b : gate.a;
+		unsigned int t1 = (bConsistent) ? gate.a : gate.b;
+		chunk.vTriangles.push_back(t0);  chunk.vTriangles.push_back(t1);  chunk.vTriangles.push_back(x);
+		++nDone;
+		state.AddTriangle(t0, t1, x);
+		state.PushGates(t0, t1, x);
+	}
+	if ( state.VertexCount() != nVertices )
+		return false;
+	std::deque<Gate>().swap(state.vGates);
+	std::vector< std::vector<TraversalState::Neighbor> >().swap(state.vNeighbors);
+
+	// shared vertices
+	int nSharedBits = IndexBits(header.nVertices);
+	AdaptiveModel sharedModel(2);
+	chunk.vSharedRefs.resize(nVertices);
+	for ( unsigned int k = 0; k < nVertices; ++k )
+		chunk.vSharedRefs[k] = ( sharedModel.Decode(dec) == 0 ) ? -1 : (int)dec.DecodeBits(nSharedBits);
+
+	// positions
+	int nMax = (1 << header.nPositionBits) - 1;
+	chunk.vPositions.resize( 3*nVertices );
+	AdaptiveModel positionModel( header.nPositionBits + 2 );
+	int vPredict[3];
+	for ( unsigned int k = 0; k < nVertices; ++k ) {
+		PredictValues( chunk.vPositions, 3, &state.vPredict[3*k], nMax, vPredict );
+		for ( int j = 0; j < 3; ++j )
+			chunk.vPositions[3*k+j] = vPredict[j] + DecodeResidual(dec, positionModel);
+	}
+
+	// UV sets
+	int nMaxUV = (1 << header.nUVBits) - 1;
+	chunk.vUVs.resize(header.nUVSets);
+	chunk.vHasUV.resize(header.nUVSets);
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet ) {
+		AdaptiveModel hasModel(2), uvModel( header.nUVBits + 2 );
+		std::vector<int> & vUVs = chunk.vUVs[nSet];
+		std::vector<unsigned char> & vHasUV = chunk.vHasUV[nSet];
+		vUVs.resize( 2*nVertices, 0 );
+		vHasUV.resize( nVertices, 0 );
+		int nLastUV = -1;
+		for ( unsigned int k = 0; k < nVertices; ++k ) {
+			vHasUV[k] = (unsigned char)hasModel.Decode(dec);
+			if ( ! vHasUV[k] )
+				continue;
+			PredictUV( vUVs, vHasUV, &state.vPredict[3*k], nLastUV, nMaxUV, vPredict );
+			for ( int j = 0; j < 2; ++j )
+				vUVs[2*k+j] = vPredict[j] + DecodeResidual(dec, uvModel);
+			nLastUV = (int)k;
+		}
+	}
+	return ! dec.Overrun();
+}
+
+
+static void AppendBytes( std::vector<unsigned char> & vBuffer, const void * pData, size_t nBytes )
+{
+	const unsigned char * p = (const unsigned char *)pData;
+	vBuffer.insert( vBuffer.end(), p, p + nBytes );
+}
+
+}  // end anonymous namespace
+
+
+
+
+MeshCodec::MeshCodec()
+{
+	m_nPositionBits = 14;
+	m_nUVBits = 12;
+	m_nTrianglesPerChunk = 250000;
+	ClearStats();
+}
+
+MeshCodec::~MeshCodec()
+{
+}
+
+void MeshCodec::ClearStats()
+{
+	memset( &m_stats, 0, sizeof(Stats) );
+}
+
+
+
+bool MeshCodec::Compress( const VFTriangleMesh & mesh, std::vector<unsigned char> & vBuffer )
+{
+	double fStart = GetSeconds();
+	ClearStats();
+	vBuffer.clear();
+
+	FileHeader header;
+	memcpy( header.vMagic, FileMagic, 4 );
+	header.nPositionBits = std::max( 2, std::min( 24, m_nPositionBits ) );
+	header.nUVBits = std::max( 2, std::min( 24, m_nUVBits ) );
+	header.nVertices = mesh.GetVertexCount();
+	header.nTriangles = mesh.GetTriangleCount();
+	header.nUVSets = 0;
+	while ( mesh.HasUVSet(header.nUVSets) )
+		header.nUVSets++;
+
+	// quantize positions and UVs
+	unsigned int nMaxVID = mesh.GetMaxVertexID();
+	Wml::AxisAlignedBox3f bounds;
+	mesh.GetBoundingBox(bounds);
+	float fMaxExtent = std::max( bounds.Max[0]-bounds.Min[0], std::max( bounds.Max[1]-bounds.Min[1], bounds.Max[2]-bounds.Min[2] ) );
+	int nMax = (1 << header.nPositionBits) - 1;
+	for ( int j = 0; j < 3; ++j )
+		header.vOrigin[j] = bounds.Min[j];
+	header.fCellSize = ( fMaxExtent > 0 ) ? fMaxExtent / (float)nMax : 1.0f;
+
+	QuantizedData data;
+	data.vPositions.resize( 3*nMaxVID, 0 );
+	#pragma omp parallel for
+	for ( int vID = 0; vID < (int)nMaxVID; ++vID ) {
+		if ( ! mesh.IsVertex(vID) )
+			continue;
+		Wml::Vector3f vVertex;
+		mesh.GetVertex(vID, vVertex);
+		for ( int j = 0; j < 3; ++j ) {
+			int n = (int)( (vVertex[j] - header.vOrigin[j]) / header.fCellSize + 0.5f );
+			data.vPositions[3*vID+j] = std::max( 0, std::min( nMax, n ) );
+		}
+	}
+
+	std::vector<UVSetHeader> vUVHeaders( header.nUVSets );
+	data.vUVs.resize( header.nUVSets );
+	data.vHasUV.resize( header.nUVSets );
+	int nMaxUV = (1 << header.nUVBits) - 1;
+	size_t nUVCount = 0;
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet ) {
+		std::vector<unsigned char> & vHasUV = data.vHasUV[nSet];
+		vHasUV.resize( nMaxVID, 0 );
+		Wml::Vector2f vUV, vMin(Wml::Vector2f::ZERO), vMax(Wml::Vector2f::ZERO);
+		bool bFirst = true;
+		for ( unsigned int vID = 0; vID < nMaxVID; ++vID ) {
+			if ( ! mesh.IsVertex(vID) || ! mesh.GetUV(vID, nSet, vUV) )
+				continue;
+			vHasUV[vID] = 1;
+			++nUVCount;
+			for ( int j = 0; j < 2; ++j ) {
+				vMin[j] = (bFirst) ? vUV[j] : std::min(vMin[j], vUV[j]);
+				vMax[j] = (bFirst) ? vUV[j] : std::max(vMax[j], vUV[j]);
+			}
+			bFirst = false;
+		}
+		UVSetHeader & uvHeader = vUVHeaders[nSet];
+		for ( int j = 0; j < 2; ++j ) {
+			uvHeader.vOrigin[j] = vMin[j];
+			uvHeader.vCellSize[j] = ( vMax[j] > vMin[j] ) ? (vMax[j] - vMin[j]) / (float)nMaxUV : 1.0f;
+		}
+		std::vector<int> & vUVs = data.vUVs[nSet];
+		vUVs.resize( 2*nMaxVID, 0 );
+		for ( unsigned int vID = 0; vID < nMaxVID; ++vID ) {
+			if ( ! vHasUV[vID] )
+				continue;
+			mesh.GetUV(vID, nSet, vUV);
+			for ( int j = 0; j < 2; ++j ) {
+				int n = (int)( (vUV[j] - uvHeader.vOrigin[j]) / uvHeader.vCellSize[j] + 0.5f );
+				vUVs[2*vID+j] = std::max( 0, std::min( nMaxUV, n ) );
+			}
+		}
+	}
+
+	// split triangles into chunks along the Morton curve of the centroids
+	std::vector< std::pair<unsigned long long, unsigned int> > vSorted;
+	vSorted.reserve( header.nTriangles );
+	VFTriangleMesh::triangle_iterator curt(mesh.BeginTriangles()), endt(mesh.EndTriangles());
+	while ( curt != endt ) {
+		IMesh::TriangleID tID = *curt;  curt++;
+		IMesh::VertexID vTri[3];
+		mesh.GetTriangle(tID, vTri);
+		unsigned long long nCode = 0;
+		for ( int j = 0; j < 3; ++j ) {
+			int nCentroid = ( data.vPositions[3*vTri[0]+j] + data.vPositions[3*vTri[1]+j] + data.vPositions[3*vTri[2]+j] ) / 3;
+			unsigned int nCell = (unsigned int)nCentroid >> std::max(0, header.nPositionBits - 20);
+			for ( int b = 0; b < 20; ++b )
+				nCode |= (unsigned long long)((nCell >> b) & 1) << (3*b+j);
+		}
+		vSorted.push_back( std::pair<unsigned long long, unsigned int>(nCode, tID) );
+	}
+	unsigned int nPerChunk = ( m_nTrianglesPerChunk > 0 ) ? m_nTrianglesPerChunk : std::max(1u, header.nTriangles);
+	header.nChunks = ( header.nTriangles + nPerChunk - 1 ) / nPerChunk;
+	if ( header.nChunks > 1 )
+		std::sort( vSorted.begin(), vSorted.end() );
+
+	// traverse chunks
+	std::vector<ChunkTraversal> vChunks( header.nChunks );
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int nChunk = 0; nChunk < (int)header.nChunks; ++nChunk ) {
+		unsigned int nFirst = nChunk * nPerChunk;
+		unsigned int nLast = std::min( header.nTriangles, nFirst + nPerChunk );
+		std::vector<unsigned int> vTriangles;
+		vTriangles.reserve( 3*(nLast-nFirst) );
+		for ( unsigned int k = nFirst; k < nLast; ++k ) {
+			IMesh::VertexID vTri[3];
+			mesh.GetTriangle( vSorted[k].second, vTri );
+			vTriangles.push_back(vTri[0]);  vTriangles.push_back(vTri[1]);  vTriangles.push_back(vTri[2]);
+		}
+		TraverseChunk( vTriangles, vChunks[nChunk] );
+	}
+	std::vector< std::pair<unsigned long long, unsigned int> >().swap(vSorted);
+
+	// decoded vertex IDs: vertices are appended by the first chunk that uses them
+	std::vector<int> vDecodedID( nMaxVID, -1 );
+	unsigned int nNextID = 0;
+	for ( unsigned int nChunk = 0; nChunk < header.nChunks; ++nChunk ) {
+		ChunkTraversal & chunk = vChunks[nChunk];
+		chunk.vSharedRefs.resize( chunk.vOrder.size() );
+		for ( unsigned int k = 0; k < chunk.vOrder.size(); ++k ) {
+			int & nID = vDecodedID[ chunk.vOrder[k] ];
+			chunk.vSharedRefs[k] = nID;
+			if ( nID < 0 )
+				nID = (int)nNextID++;
+		}
+	}
+	// unreferenced vertices are dropped
+	header.nVertices = nNextID;
+
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int nChunk = 0; nChunk < (int)header.nChunks; ++nChunk )
+		EncodeChunk( vChunks[nChunk], data, header );
+
+	AppendBytes( vBuffer, &header, sizeof(FileHeader) );
+	if ( header.nUVSets > 0 )
+		AppendBytes( vBuffer, &vUVHeaders[0], header.nUVSets * sizeof(UVSetHeader) );
+	for ( unsigned int nChunk = 0; nChunk < header.nChunks; ++nChunk ) {
+		ChunkTraversal & chunk = vChunks[nChunk];
+		unsigned int nBytes = (unsigned int)chunk.vBytes.size();
+		AppendBytes( vBuffer, &nBytes, sizeof(unsigned int) );
+		AppendBytes( vBuffer, &chunk.vBytes[0], nBytes );
+		m_stats.nConnectivityBytes += chunk.nConnectivityBytes;
+		m_stats.nPositionBytes += chunk.nPositionBytes;
+		m_stats.nUVBytes += chunk.nUVBytes;
+	}
+
+	m_stats.nRawBytes = 12 * (size_t)mesh.GetVertexCount() + 12 * (size_t)header.nTriangles + 8 * nUVCount;
+	m_stats.nCompressedBytes = vBuffer.size();
+	m_stats.nChunks = header.nChunks;
+	m_stats.fSeconds = GetSeconds() - fStart;
+	return true;
+}
+
+
+bool MeshCodec::Compress( const VFTriangleMesh & mesh, const char * pFilename, std::string & errString )
+{
+	std::vector<unsigned char> vBuffer;
+	if ( ! Compress(mesh, vBuffer) ) {
+		errString = "compression failed";
+		return false;
+	}
+	FILE * pFile = fopen(pFilename, "wb");
+	if ( pFile == NULL ) {
+		errString = std::string("cannot open ") + pFilename;
+		return false;
+	}
+	bool bOK = ( fwrite( &vBuffer[0], 1, vBuffer.size(), pFile ) == vBuffer.size() );
+	bOK = ( fclose(pFile) == 0 ) && bOK;
+	if ( ! bOK )
+		errString = std::string("error writing ") + pFilename;
+	return bOK;
+}
+
+
+
+bool MeshCodec::Decompress( const unsigned char * pData, size_t nBytes, VFTriangleMesh & mesh, std::string & errString, bool bEstimateNormals )
+{
+	double fStart = GetSeconds();
+	ClearStats();
+	mesh.Clear(false);
+
+	FileHeader header;
+	if ( nBytes < sizeof(FileHeader) || memcmp(pData, FileMagic, 4) != 0 ) {
+		errString = "not a compressed mesh";
+		return false;
+	}
+	memcpy( &header, pData, sizeof(FileHeader) );
+	size_t nPos = sizeof(FileHeader);
+	if ( header.nPositionBits < 2 || header.nPositionBits > 24 || header.nUVBits < 2 || header.nUVBits > 24
+		|| nBytes - nPos < header.nUVSets * sizeof(UVSetHeader) ) {
+		errString = "invalid header";
+		return false;
+	}
+	std::vector<UVSetHeader> vUVHeaders( header.nUVSets );
+	if ( header.nUVSets > 0 )
+		memcpy( &vUVHeaders[0], pData + nPos, header.nUVSets * sizeof(UVSetHeader) );
+	nPos += header.nUVSets * sizeof(UVSetHeader);
+
+	// chunk offsets
+	std::vector<size_t> vOffsets, vSizes;
+	for ( unsigned int nChunk = 0; nChunk < header.nChunks; ++nChunk ) {
+		unsigned int nChunkBytes = 0;
+		if ( nBytes - nPos < sizeof(unsigned int) )
+			break;
+		memcpy( &nChunkBytes, pData + nPos, sizeof(unsigned int) );
+		nPos += sizeof(unsigned int);
+		if ( nBytes - nPos < nChunkBytes )
+			break;
+		vOffsets.push_back(nPos);
+		vSizes.push_back(nChunkBytes);
+		nPos += nChunkBytes;
+	}
+	if ( vOffsets.size() != header.nChunks ) {
+		errString = "truncated data";
+		return false;
+	}
+
+	std::vector< std::vector<Wml::Vector2f> > vUVs( header.nUVSets );
+	std::vector< std::vector<unsigned char> > vHasUV( header.nUVSets );
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet ) {
+		vUVs[nSet].resize( header.nVertices );
+		vHasUV[nSet].resize( header.nVertices, 0 );
+	}
+
+	// decode a batch of chunks in parallel, then append them in order
+	int nBatchSize = 1;
+#ifdef _OPENMP
+	nBatchSize = 2 * omp_get_max_threads();
+#endif
+	bool bOK = true;
+	std::vector<unsigned int> vMap;
+	for ( unsigned int nBatch = 0; nBatch < header.nChunks && bOK; nBatch += nBatchSize ) {
+		unsigned int nCount = std::min( (unsigned int)nBatchSize, header.nChunks - nBatch );
+		std::vector<DecodedChunk> vDecoded(nCount);
+		#pragma omp parallel for schedule(dynamic,1)
+		for ( int k = 0; k < (int)nCount; ++k )
+			vDecoded[k].bOK = DecodeChunk( pData + vOffsets[nBatch+k], vSizes[nBatch+k], header, vDecoded[k] );
+
+		for ( unsigned int k = 0; k < nCount && bOK; ++k ) {
+			DecodedChunk & chunk = vDecoded[k];
+			if ( ! chunk.bOK ) {
+				bOK = false;
+				break;
+			}
+			unsigned int nVertices = (unsigned int)chunk.vSharedRefs.size();
+			vMap.resize(nVertices);
+			for ( unsigned int i = 0; i < nVertices && bOK; ++i ) {
+				if ( chunk.vSharedRefs[i] >= 0 ) {
+					vMap[i] = (unsigned int)chunk.vSharedRefs[i];
+					bOK = ( vMap[i] < mesh.GetMaxVertexID() );
+					continue;
+				}
+				const int * pQuant = &chunk.vPositions[3*i];
+				Wml::Vector3f vVertex( header.vOrigin[0] + (float)pQuant[0] * header.fCellSize,
+									   header.vOrigin[1] + (float)pQuant[1] * header.fCellSize,
+									   header.vOrigin[2] + (float)pQuant[2] * header.fCellSize );
+				vMap[i] = mesh.AppendVertex(vVertex);
+				bOK = ( vMap[i] < header.nVertices );
+				for ( unsigned int nSet = 0; nSet < header.nUVSets && bOK; ++nSet ) {
+					if ( ! chunk.vHasUV[nSet][i] )
+						continue;
+					const UVSetHeader & uvHeader = vUVHeaders[nSet];
+					vHasUV[nSet][vMap[i]] = 1;
+					vUVs[nSet][vMap[i]] = Wml::Vector2f( uvHeader.vOrigin[0] + (float)chunk.vUVs[nSet][2*i] * uvHeader.vCellSize[0],
+														 uvHeader.vOrigin[1] + (float)chunk.vUVs[nSet][2*i+1] * uvHeader.vCellSize[1] );
+				}
+			}
+			for ( unsigned int i = 0; i < chunk.vTriangles.size() && bOK; i += 3 )
+				mesh.AppendTriangle( vMap[chunk.vTriangles[i]], vMap[chunk.vTriangles[i+1]], vMap[chunk.vTriangles[i+2]] );
+		}
+	}
+	if ( ! bOK || mesh.GetVertexCount() != header.nVertices ) {
+		mesh.Clear(false);
+		errString = "corrupt data";
+		return false;
+	}
+
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet ) {
+		if ( ! mesh.HasUVSet(nSet) )
+			mesh.AppendUVSet();
+		mesh.InitializeUVSet(nSet);
+		for ( unsigned int vID = 0; vID < header.nVertices; ++vID )
+			if ( vHasUV[nSet][vID] )
+				mesh.SetUV( vID, nSet, vUVs[nSet][vID] );
+	}
+	if ( bEstimateNormals )
+		MeshUtils::EstimateNormals(mesh);
+
+	m_stats.nRawBytes = 12 * (size_t)mesh.GetVertexCount() + 12 * (size_t)mesh.GetTriangleCount();
+	for ( unsigned int nSet = 0; nSet < header.nUVSets; ++nSet )
+		m_stats.nRawBytes += 8 * (size_t)std::count( vHasUV[nSet].begin(), vHasUV[nSet].end(), 1 );
+	m_stats.nCompressedBytes = nBytes;
+	m_stats.nChunks = header.nChunks;
+	m_stats.fSeconds = GetSeconds() - fStart;
+	return true;
+}
+
+
+bool MeshCodec::Decompress( const char * pFilename, VFTriangleMesh & mesh, std::string & errString, bool bEstimateNormals )
+{
+	FILE * pFile = fopen(pFilename, "rb");
+	if ( pFile == NULL ) {
+		errString = std::string("cannot open ") + pFilename;
+		return false;
+	}
+	std::vector<unsigned char> vBuffer;
+	unsigned char vBlock[65536];
+	size_t nRead;
+	while ( (nRead = fread(vBlock, 1, sizeof(vBlock), pFile)) > 0 )
+		vBuffer.insert( vBuffer.end(), vBlock, vBlock + nRead );
+	fclose(pFile);
+	if ( vBuffer.empty() ) {
+		errString = std::string("empty file ") + pFilename;
+		return false;
+	}
+	return Decompress( &vBuffer[0], vBuffer.size(), mesh, errString, bEstimateNormals );
+}
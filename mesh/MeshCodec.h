@@ -0,0 +1,86 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_MESH_CODEC_H__
+#define __RMS_MESH_CODEC_H__
+
+#include "config.h"
+#include <vector>
+#include <string>
+
+namespace rms {
+
+class VFTriangleMesh;
+
+/*
+ * Compressed binary mesh format, for storing and transferring VFTriangleMesh (positions,
+ * triangles and UV sets).
+ *
+ * Connectivity is coded by a face traversal in the Edgebreaker family: each triangle is reached
+ * across a gate edge of an already-coded triangle, and only its third vertex is coded - as a new
+ * vertex, as one of the recent neighbours of a gate vertex, or (rarely) as an explicit index. Edges
+ * that already have two triangles are closed implicitly, so a manifold mesh needs one symbol per
+ * triangle plus one per boundary edge. Non-manifold and inconsistently-oriented meshes are handled
+ * (at some cost). Positions and UVs are quantized and predicted with the parallelogram rule across
+ * the gate edge. Everything is coded with an adaptive range coder.
+ *
+ * The triangles are split into spatially coherent chunks (Morton order of the centroids) that are
+ * coded independently, so compression and decompression run in parallel (OpenMP). Vertices shared
+ * between chunks are coded as references to the chunk that first uses them. The file is a header
+ * followed by the chunks, and chunks are decoded one batch at a time.
+ *
+ * Vertex and triangle IDs are not preserved: the decoded mesh is compact, with vertices in coding
+ * order. Only vertices referenced by triangles are coded, so isolated vertices are dropped. Normals
+ * are not stored (they are re-estimated on decompression). Typical sizes are about 0.5-0.9 bytes per
+ * triangle for smooth meshes with UVs at 11-14 position bits (about 0.7 at the default). Noisy scans need more.
+ */
+class MeshCodec
+{
+public:
+	MeshCodec();
+	~MeshCodec();
+
+	//! position quantization (per axis, relative to the largest bounding-box extent). Default 14
+	void SetPositionBits( int nBits ) { m_nPositionBits = nBits; }
+	//! UV quantization (per axis, relative to the UV bounding box). Default 12
+	void SetUVBits( int nBits ) { m_nUVBits = nBits; }
+	//! triangles per independently-coded chunk. 0 codes a single chunk (best ratio, no parallelism)
+	void SetTrianglesPerChunk( unsigned int nCount ) { m_nTrianglesPerChunk = nCount; }
+
+	struct Stats {
+		size_t nRawBytes;				//! 12 bytes per vertex and triangle, 8 per UV
+		size_t nCompressedBytes;
+		size_t nConnectivityBytes;
+		size_t nPositionBytes;
+		size_t nUVBytes;
+		unsigned int nChunks;
+		double fSeconds;
+
+		float GetRatio() const { return (nCompressedBytes > 0) ? (float)nRawBytes / (float)nCompressedBytes : 0.0f; }
+		//! throughput in MB of raw mesh data per second
+		float GetMBPerSecond() const { return (fSeconds > 0) ? (float)( (double)nRawBytes / (1024.0*1024.0) / fSeconds ) : 0.0f; }
+	};
+
+	bool Compress( const VFTriangleMesh & mesh, std::vector<unsigned char> & vBuffer );
+	bool Compress( const VFTriangleMesh & mesh, const char * pFilename, std::string & errString );
+
+	//! the mesh is cleared first. Normals are estimated with MeshUtils::EstimateNormals() if bEstimateNormals
+	bool Decompress( const unsigned char * pData, size_t nBytes, VFTriangleMesh & mesh, std::string & errString, bool bEstimateNormals = true );
+	bool Decompress( const char * pFilename, VFTriangleMesh & mesh, std::string & errString, bool bEstimateNormals = true );
+
+	//! stats of the last Compress() or Decompress() call
+	const Stats & GetLastStats() const { return m_stats; }
+
+protected:
+	int m_nPositionBits;
+	int m_nUVBits;
+	unsigned int m_nTrianglesPerChunk;
+	Stats m_stats;
+
+	void ClearStats();
+};
+
+
+} // end namespace rms
+
+#endif  // __RMS_MESH_CODEC_H__
@@ -0,0 +1,466 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "MeshStream.h"
+#include "rmsdebug.h"
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace rms;
+
+
+bool rms::SeekFile64( FILE * pFile, unsigned long long nOffset )
+{
+#ifdef WIN32
+	return _fseeki64( pFile, (__int64)nOffset, SEEK_SET ) == 0;
+#else
+	return fseeko( pFile, (off_t)nOffset, SEEK_SET ) == 0;
+#endif
+}
+
+
+namespace {
+
+// large-block buffered reads, fread() per property is far too slow for huge files
+class StreamBuffer
+{
+public:
+	StreamBuffer( FILE * pFile ) : m_pFile(pFile), m_vBuffer(1<<20), m_nPos(0), m_nSize(0) {}
+
+	inline bool Read( void * pData, size_t nBytes ) {
+		char * pOut = (char *)pData;
+		while ( nBytes > 0 ) {
+			if ( m_nPos == m_nSize && ! Fill() )
+				return false;
+			size_t nCopy = std::min( nBytes, m_nSize - m_nPos );
+			memcpy( pOut, &m_vBuffer[m_nPos], nCopy );
+			m_nPos += nCopy;  pOut += nCopy;  nBytes -= nCopy;
+		}
+		return true;
+	}
+
+	//! line without terminator. Returns false at end of file
+	bool ReadLine( std::string & line ) {
+		line.clear();
+		while ( true ) {
+			if ( m_nPos == m_nSize && ! Fill() )
+				return ! line.empty();
+			const char * pStart = &m_vBuffer[m_nPos];
+			const char * pEnd = (const char *)memchr( pStart, '\n', m_nSize - m_nPos );
+			size_t nLen = ( pEnd != NULL ) ? (size_t)(pEnd - pStart) : (m_nSize - m_nPos);
+			line.append( pStart, nLen );
+			m_nPos += nLen;
+			if ( pEnd != NULL ) {
+				++m_nPos;
+				if ( ! line.empty() && line[line.size()-1] == '\r' )
+					line.resize( line.size()-1 );
+				return true;
+			}
+		}
+	}
+
+protected:
+	FILE * m_pFile;
+	std::vector<char> m_vBuffer;
+	size_t m_nPos;
+	size_t m_nSize;
+
+	bool Fill() {
+		m_nSize = fread( &m_vBuffer[0], 1, m_vBuffer.size(), m_pFile );
+		m_nPos = 0;
+		return m_nSize > 0;
+	}
+};
+
+
+enum PlyType {
+	PlyChar, PlyUChar, PlyShort, PlyUShort, PlyInt, PlyUInt, PlyFloat, PlyDouble, PlyInvalid
+};
+
+PlyType ParsePlyType( const char * pType )
+{
+	if ( strcmp(pType, "char") == 0 || strcmp(pType, "int8") == 0 )			return PlyChar;
+	if ( strcmp(pType, "uchar") == 0 || strcmp(pType, "uint8") == 0 )		return PlyUChar;
+	if ( strcmp(pType, "short") == 0 || strcmp(pType, "int16") == 0 )		return PlyShort;
+	if ( strcmp(pType, "ushort") == 0 || strcmp(pType, "uint16") == 0 )		return PlyUShort;
+	if ( strcmp(pType, "int") == 0 || strcmp(pType, "int32") == 0 )			return PlyInt;
+	if ( strcmp(pType, "uint") == 0 || strcmp(pType, "uint32") == 0 )		return PlyUInt;
+	if ( strcmp(pType, "float") == 0 || strcmp(pType, "float32") == 0 )		return PlyFloat;
+	if ( strcmp(pType, "double") == 0 || strcmp(pType, "float64") == 0 )	return PlyDouble;
+	return PlyInvalid;
+}
+
+const int PlyTypeSize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+// binary PLY is read assuming a little-endian host
+double DecodePlyValue( const char * p, PlyType eType )
+{
+	switch ( eType ) {
+		case PlyChar:	{ signed char v;  memcpy(&v, p, 1);  return v; }
+		case PlyUChar:	{ unsigned char v;  memcpy(&v, p, 1);  return v; }
+		case PlyShort:	{ short v;  memcpy(&v, p, 2);  return v; }
+		case PlyUShort:	{ unsigned short v;  memcpy(&v, p, 2);  return v; }
+		case PlyInt:	{ int v;  memcpy(&v, p, 4);  return v; }
+		case PlyUInt:	{ unsigned int v;  memcpy(&v, p, 4);  return v; }
+		case PlyFloat:	{ float v;  memcpy(&v, p, 4);  return v; }
+		case PlyDouble:	{ double v;  memcpy(&v, p, 8);  return v; }
+		default:		return 0;
+	}
+}
+
+struct PlyProperty {
+	std::string name;
+	PlyType eType;
+	bool bList;
+	PlyType eCountType;
+};
+struct PlyElement {
+	std::string name;
+	unsigned int nCount;
+	std::vector<PlyProperty> vProperties;
+};
+
+
+void EmitPolygon( MeshStreamReader::Handler & handler, const std::vector<unsigned int> & vPoly, unsigned int & nTriangles )
+{
+	unsigned int vTri[3];
+	for ( unsigned int k = 1; k + 1 < vPoly.size(); ++k ) {
+		vTri[0] = vPoly[0];  vTri[1] = vPoly[k];  vTri[2] = vPoly[k+1];
+		handler.Triangle( nTriangles++, vTri );
+	}
+}
+
+
+bool ReadPLY( FILE * pFile, MeshStreamReader::Handler & handler, std::string & errString, bool bReadFaces )
+{
+	StreamBuffer buffer(pFile);
+	std::string line;
+	if ( ! buffer.ReadLine(line) || line != "ply" ) {
+		errString = "not a PLY file";
+		return false;
+	}
+
+	bool bBinary = false;
+	std::vector<PlyElement> vElements;
+	char sWord[64], sType[64], sCountType[64], sName[256];
+	while ( buffer.ReadLine(line) ) {
+		if ( line == "end_header" )
+			break;
+		const char * pLine = line.c_str();
+		if ( strncmp(pLine, "format ", 7) == 0 ) {
+			if ( strstr(pLine, "binary_little_endian") != NULL )
+				bBinary = true;
+			else if ( strstr(pLine, "ascii") == NULL ) {
+				errString = "unsupported PLY format (big-endian)";
+				return false;
+			}
+		} else if ( strncmp(pLine, "element ", 8) == 0 ) {
+			PlyElement element;
+			unsigned int nCount = 0;
+			if ( sscanf(pLine, "%63s %255s %u", sWord, sName, &nCount) != 3 ) {
+				errString = "invalid PLY element line";
+				return false;
+			}
+			element.name = sName;
+			element.nCount = nCount;
+			vElements.push_back(element);
+		} else if ( strncmp(pLine, "property list ", 14) == 0 && ! vElements.empty() ) {
+			PlyProperty prop;
+			if ( sscanf(pLine, "%63s %63s %63s %63s %255s", sWord, sWord, sCountType, sType, sName) != 5 ) {
+				errString = "invalid PLY property line";
+				return false;
+			}
+			prop.name = sName;  prop.bList = true;
+			prop.eCountType = ParsePlyType(sCountType);  prop.eType = ParsePlyType(sType);
+			if ( prop.eCountType == PlyInvalid || prop.eType == PlyInvalid ) {
+				errString = "invalid PLY property type";
+				return false;
+			}
+			vElements.back().vProperties.push_back(prop);
+		} else if ( strncmp(pLine, "property ", 9) == 0 && ! vElements.empty() ) {
+			PlyProperty prop;
+			if ( sscanf(pLine, "%63s %63s %255s", sWord, sType, sName) != 3 ) {
+				errString = "invalid PLY property line";
+				return false;
+			}
+			prop.name = sName;  prop.bList = false;
+			prop.eType = ParsePlyType(sType);  prop.eCountType = PlyInvalid;
+			if ( prop.eType == PlyInvalid ) {
+				errString = "invalid PLY property type";
+				return false;
+			}
+			vElements.back().vProperties.push_back(prop);
+		}
+	}
+
+	unsigned int nVertices = 0, nTriangles = 0;
+	std::vector<char> vRecord;
+	std::vector<unsigned int> vPoly;
+	for ( unsigned int ei = 0; ei < vElements.size(); ++ei ) {
+		const PlyElement & element = vElements[ei];
+		bool bVertex = (element.name == "vertex");
+		bool bFace = (element.name == "face");
+		if ( bVertex && nVertices > 0 ) {
+			errString = "multiple PLY vertex elements";
+			return false;
+		}
+		if ( bFace && ! bReadFaces )
+			return true;
+
+		// locate properties we want
+		int nXYZ[3] = {-1,-1,-1}, nIndices = -1;
+		unsigned int nRecordSize = 0;
+		bool bFixedSize = true;
+		for ( unsigned int pi = 0; pi < element.vProperties.size(); ++pi ) {
+			const PlyProperty & prop = element.vProperties[pi];
+			if ( prop.bList ) {
+				bFixedSize = false;
+				if ( prop.name == "vertex_indices" || prop.name == "vertex_index" )
+					nIndices = (int)pi;
+			} else {
+				if ( prop.name == "x" ) nXYZ[0] = (int)pi;
+				else if ( prop.name == "y" ) nXYZ[1] = (int)pi;
+				else if ( prop.name == "z" ) nXYZ[2] = (int)pi;
+				nRecordSize += PlyTypeSize[prop.eType];
+			}
+		}
+		if ( bVertex && (nXYZ[0] < 0 || nXYZ[1] < 0 || nXYZ[2] < 0) ) {
+			errString = "PLY vertex element has no x/y/z";
+			return false;
+		}
+		if ( bFace && nIndices < 0 ) {
+			errString = "PLY face element has no vertex_indices";
+			return false;
+		}
+
+		std::vector<double> vValues( element.vProperties.size() );
+		Wml::Vector3f vVertex;
+		for ( unsigned int k = 0; k < element.nCount; ++k ) {
+			bool bOK = true;
+			if ( bBinary && bFixedSize ) {
+				vRecord.resize( nRecordSize );
+				bOK = buffer.Read( &vRecord[0], nRecordSize );
+				const char * p = &vRecord[0];
+				for ( unsigned int pi = 0; pi < element.vProperties.size() && bOK; ++pi ) {
+					vValues[pi] = DecodePlyValue( p, element.vProperties[pi].eType );
+					p += PlyTypeSize[element.vProperties[pi].eType];
+				}
+			} else if ( bBinary ) {
+				char vScalar[8];
+				for ( unsigned int pi = 0; pi < element.vProperties.size() && bOK; ++pi ) {
+					const PlyProperty & prop = element.vProperties[pi];
+					if ( prop.bList ) {
+						bOK = buffer.Read( vScalar, PlyTypeSize[prop.eCountType] );
+						unsigned int nListCount = (unsigned int)DecodePlyValue( vScalar, prop.eCountType );
+						vRecord.resize( nListCount * PlyTypeSize[prop.eType] + 1 );
+						bOK = bOK && buffer.Read( &vRecord[0], nListCount * PlyTypeSize[prop.eType] );
+						if ( (int)pi == nIndices ) {
+							vPoly.resize(nListCount);
+							for ( unsigned int j = 0; j < nListCount; ++j )
+								vPoly[j] = (unsigned int)DecodePlyValue( &vRecord[j*PlyTypeSize[prop.eType]], prop.eType );
+						}
+					} else {
+						bOK = buffer.Read( vScalar, PlyTypeSize[prop.eType] );
+						vValues[pi] = DecodePlyValue( vScalar, prop.eType );
+					}
+				}
+			} else {
+				bOK = buffer.ReadLine(line);
+				char * pCur = const_cast<char *>(line.c_str());
+				for ( unsigned int pi = 0; pi < element.vProperties.size() && bOK; ++pi ) {
+					const PlyProperty & prop = element.vProperties[pi];
+					if ( prop.bList ) {
+						unsigned int nListCount = (unsigned int)strtoul(pCur, &pCur, 10);
+						if ( (int)pi == nIndices )
+							vPoly.resize(nListCount);
+						for ( unsigned int j = 0; j < nListCount; ++j ) {
+							double fValue = strtod(pCur, &pCur);
+							if ( (int)pi == nIndices )
+								vPoly[j] = (unsigned int)fValue;
+						}
+					} else
+						vValues[pi] = strtod(pCur, &pCur);
+				}
+			}
+			if ( ! bOK ) {
+				errString = "unexpected end of PLY file";
+				return false;
+			}
+
+			if ( bVertex ) {
+				vVertex = Wml::Vector3f( (float)vValues[nXYZ[0]], (float)vValues[nXYZ[1]], (float)vValues[nXYZ[2]] );
+				handler.Vertex( nVertices++, vVertex );
+			} else if ( bFace ) {
+				EmitPolygon( handler, vPoly, nTriangles );
+			}
+		}
+	}
+	return true;
+}
+
+
+bool ReadOBJ( FILE * pFile, MeshStreamReader::Handler & handler, std::string & errString, bool bReadFaces )
+{
+	StreamBuffer buffer(pFile);
+	std::string line;
+	unsigned int nVertices = 0, nTriangles = 0;
+	std::vector<unsigned int> vPoly;
+	Wml::Vector3f vVertex;
+	while ( buffer.ReadLine(line) ) {
+		const char * pLine = line.c_str();
+		if ( pLine[0] == 'v' && (pLine[1] == ' ' || pLine[1] == '\t') ) {
+			char * pCur = const_cast<char *>(pLine + 2);
+			for ( int j = 0; j < 3; ++j )
+				vVertex[j] = (float)strtod(pCur, &pCur);
+			handler.Vertex( nVertices++, vVertex );
+
+		} else if ( bReadFaces && pLine[0] == 'f' && (pLine[1] == ' ' || pLine[1] == '\t') ) {
+			// tokens are v, v/vt, v/vt/vn or v//vn. Negative indices are relative to the current vertex count
+			vPoly.resize(0);
+			char * pCur = const_cast<char *>(pLine + 2);
+			while ( true ) {
+				char * pNext = NULL;
+				long nIndex = strtol(pCur, &pNext, 10);
+				if ( pNext == pCur )
+					break;
+				if ( nIndex < 0 )
+					nIndex += (long)nVertices;
+				else
+					nIndex -= 1;
+				if ( nIndex < 0 || nIndex >= (long)nVertices ) {
+					errString = "invalid OBJ face index";
+					return false;
+				}
+				vPoly.push_back( (unsigned int)nIndex );
+				pCur = pNext;
+				while ( *pCur != 0 && *pCur != ' ' && *pCur != '\t' )
+					++pCur;
+			}
+			EmitPolygon( handler, vPoly, nTriangles );
+		}
+	}
+	return true;
+}
+
+
+std::string GetExtension( const char * pFilename )
+{
+	std::string filename(pFilename);
+	size_t nIndex = filename.find_last_of('.');
+	if ( nIndex == std::string::npos )
+		return std::string();
+	std::string extension = filename.substr(nIndex);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension;
+}
+
+}  // end anonymous namespace
+
+
+
+bool MeshStreamReader::IsSupportedFormat( const char * pFilename )
+{
+	std::string extension = GetExtension(pFilename);
+	return extension == ".obj" || extension == ".ply";
+}
+
+
+bool MeshStreamReader::Read( const char * pFilename, Handler & handler, std::string & errString, bool bReadFaces )
+{
+	std::string extension = GetExtension(pFilename);
+	if ( extension != ".obj" && extension != ".ply" ) {
+		errString = "unsupported format " + extension;
+		return false;
+	}
+	FILE * pFile = fopen(pFilename, "rb");
+	if ( pFile == NULL ) {
+		errString = std::string("cannot open ") + pFilename;
+		return false;
+	}
+	bool bOK = ( extension == ".ply" ) ?
+		ReadPLY(pFile, handler, errString, bReadFaces) : ReadOBJ(pFile, handler, errString, bReadFaces);
+	fclose(pFile);
+	return bOK;
+}
+
+
+
+
+
+MeshStreamWriter::MeshStreamWriter()
+{
+	m_pFile = NULL;
+	m_bPLY = false;
+	m_bNormals = false;
+}
+
+MeshStreamWriter::~MeshStreamWriter()
+{
+	Close();
+}
+
+bool MeshStreamWriter::Open( const char * pFilename, unsigned int nVertices, unsigned int nTriangles, bool bNormals, std::string & errString )
+{
+	Close();
+	std::string extension = GetExtension(pFilename);
+	if ( extension != ".obj" && extension != ".ply" ) {
+		errString = "unsupported format " + extension;
+		return false;
+	}
+	m_pFile = fopen(pFilename, "wb");
+	if ( m_pFile == NULL ) {
+		errString = std::string("cannot open ") + pFilename;
+		return false;
+	}
+	m_bPLY = ( extension == ".ply" );
+	m_bNormals = bNormals;
+	setvbuf( m_pFile, NULL, _IOFBF, 1<<20 );
+
+	if ( m_bPLY ) {
+		fprintf(m_pFile, "ply\nformat binary_little_endian 1.0\n");
+		fprintf(m_pFile, "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n", nVertices);
+		if ( m_bNormals )
+			fprintf(m_pFile, "property float nx\nproperty float ny\nproperty float nz\n");
+		fprintf(m_pFile, "element face %u\nproperty list uchar int vertex_indices\nend_header\n", nTriangles);
+	}
+	return true;
+}
+
+void MeshStreamWriter::WriteVertex( const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal )
+{
+	Wml::Vector3f vNormal = (pNormal) ? *pNormal : Wml::Vector3f::UNIT_Z;
+	if ( m_bPLY ) {
+		fwrite( (const float *)vVertex, sizeof(float), 3, m_pFile );
+		if ( m_bNormals )
+			fwrite( (const float *)vNormal, sizeof(float), 3, m_pFile );
+	} else {
+		fprintf(m_pFile, "v %f %f %f\n", vVertex.X(), vVertex.Y(), vVertex.Z());
+		if ( m_bNormals )
+			fprintf(m_pFile, "vn %f %f %f\n", vNormal.X(), vNormal.Y(), vNormal.Z());
+	}
+}
+
+void MeshStreamWriter::WriteTriangle( const unsigned int vTri[3] )
+{
+	if ( m_bPLY ) {
+		unsigned char nCount = 3;
+		fwrite( &nCount, 1, 1, m_pFile );
+		fwrite( vTri, sizeof(unsigned int), 3, m_pFile );
+	} else if ( m_bNormals ) {
+		fprintf(m_pFile, "f %u//%u %u//%u %u//%u\n", vTri[0]+1, vTri[0]+1, vTri[1]+1, vTri[1]+1, vTri[2]+1, vTri[2]+1);
+	} else
+		fprintf(m_pFile, "f %u %u %u\n", vTri[0]+1, vTri[1]+1, vTri[2]+1);
+}
+
+bool MeshStreamWriter::Close()
+{
+	if ( m_pFile == NULL )
+		return true;
+	bool bOK = ( ferror(m_pFile) == 0 );
+	bOK = ( fclose(m_pFile) == 0 ) && bOK;
+	m_pFile = NULL;
+	return bOK;
+}
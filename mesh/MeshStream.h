@@ -0,0 +1,64 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_MESH_STREAM_H__
+#define __RMS_MESH_STREAM_H__
+
+#include "config.h"
+#include <Wm4Vector3.h>
+#include <string>
+#include <cstdio>
+
+namespace rms {
+
+/*
+ * Streaming (constant-memory) mesh file reading and writing, for meshes that do not fit
+ * in a VFTriangleMesh. Supports OBJ and PLY (ascii or binary_little_endian). Only vertex
+ * positions and faces are read; polygons are fan-triangulated. Vertices and triangles
+ * are numbered from 0 in file order.
+ *
+ * Use MeshIO to read/write meshes that fit in memory.
+ */
+class MeshStreamReader
+{
+public:
+	class Handler {
+	public:
+		virtual ~Handler() {}
+		virtual void Vertex( unsigned int /*nIndex*/, const Wml::Vector3f & /*vVertex*/ ) {}
+		virtual void Triangle( unsigned int /*nIndex*/, const unsigned int /*vTri*/[3] ) {}
+	};
+
+	//! bReadFaces=false stops after the vertices (PLY), or skips face lines (OBJ)
+	static bool Read( const char * pFilename, Handler & handler, std::string & errString, bool bReadFaces = true );
+
+	static bool IsSupportedFormat( const char * pFilename );
+};
+
+
+class MeshStreamWriter
+{
+public:
+	MeshStreamWriter();
+	~MeshStreamWriter();
+
+	//! format from extension (.obj or .ply, binary). Counts are required for the PLY header
+	bool Open( const char * pFilename, unsigned int nVertices, unsigned int nTriangles, bool bNormals, std::string & errString );
+	void WriteVertex( const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal = NULL );
+	void WriteTriangle( const unsigned int vTri[3] );
+	bool Close();
+
+protected:
+	FILE * m_pFile;
+	bool m_bPLY;
+	bool m_bNormals;
+};
+
+
+//! 64-bit file seek (for temporary files larger than 2GB)
+bool SeekFile64( FILE * pFile, unsigned long long nOffset );
+
+
+} // end namespace rms
+
+#endif  // __RMS_MESH_STREAM_H__
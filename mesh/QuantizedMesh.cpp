@@ -0,0 +1,343 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "QuantizedMesh.h"
+#include "VFTriangleMesh.h"
+#include "SIMDLanes.h"
+#include "rmsdebug.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace rms;
+
+
+QuantizedMesh::QuantizedMesh()
+{
+	m_ePositionBits = Positions16;
+	m_eNormalBits = NoNormals;
+	m_nVertexCount = 0;
+	m_nTriangleCount = 0;
+	Clear(false);
+}
+
+QuantizedMesh::~QuantizedMesh()
+{
+}
+
+
+void QuantizedMesh::Clear( bool bFreeMem )
+{
+	IMesh::Clear(bFreeMem);
+	m_vPositions16.clear();
+	m_vPositions21.clear();
+	m_vNormals.clear();
+	m_vTriangles.clear();
+	if ( bFreeMem ) {
+		std::vector<unsigned short>().swap(m_vPositions16);
+		std::vector<unsigned long long>().swap(m_vPositions21);
+		std::vector<unsigned short>().swap(m_vNormals);
+		std::vector<unsigned int>().swap(m_vTriangles);
+	}
+	m_vValidVertices.clear();
+	m_vValidTriangles.clear();
+	m_nVertexCount = 0;
+	m_nTriangleCount = 0;
+	m_vOrigin = m_vCellSize = m_vErrorBound = Wml::Vector3f::ZERO;
+	m_bounds = Wml::AxisAlignedBox3f(0,0,0,0,0,0);
+	m_fMaxPositionError = m_fMaxNormalError = 0.0f;
+}
+
+
+size_t QuantizedMesh::GetMemoryUsage() const
+{
+	return m_vPositions16.size() * sizeof(unsigned short)
+		+ m_vPositions21.size() * sizeof(unsigned long long)
+		+ m_vNormals.size() * sizeof(unsigned short)
+		+ m_vTriangles.size() * sizeof(unsigned int)
+		+ (m_vValidVertices.size() + m_vValidTriangles.size()) / 8;
+}
+
+
+
+void QuantizedMesh::Initialize( const IMesh & mesh, PositionBits ePositions, NormalBits eNormals )
+{
+	Clear(false);
+	m_ePositionBits = ePositions;
+	m_eNormalBits = eNormals;
+
+	// find valid vertices and bounding box
+	unsigned int nMaxVID = mesh.GetMaxVertexID();
+	m_vValidVertices.resize(nMaxVID);
+	std::vector<VertexID> vVertices;
+	vVertices.reserve( mesh.GetVertexCount() );
+	Wml::Vector3f vVertex, vNormal;
+	IMesh::IVtxIterator curv(mesh.BeginIVertices()), endv(mesh.EndIVertices());
+	while ( curv != endv ) {
+		VertexID vID = *curv;  curv++;
+		mesh.GetVertex(vID, vVertex);
+		if ( vVertices.empty() )
+			m_bounds = Wml::AxisAlignedBox3f( vVertex.X(), vVertex.X(), vVertex.Y(), vVertex.Y(), vVertex.Z(), vVertex.Z() );
+		else {
+			for ( int j = 0; j < 3; ++j ) {
+				if ( vVertex[j] < m_bounds.Min[j] )  m_bounds.Min[j] = vVertex[j];
+				if ( vVertex[j] > m_bounds.Max[j] )  m_bounds.Max[j] = vVertex[j];
+			}
+		}
+		m_vValidVertices.set(vID, true);
+		vVertices.push_back(vID);
+	}
+	m_nVertexCount = (unsigned int)vVertices.size();
+
+	unsigned int nMaxQ = ( 1u << (unsigned int)ePositions ) - 1;
+	m_vOrigin = Wml::Vector3f( m_bounds.Min[0], m_bounds.Min[1], m_bounds.Min[2] );
+	Wml::Vector3f vInvCellSize;
+	for ( int j = 0; j < 3; ++j ) {
+		float fExtent = m_bounds.Max[j] - m_bounds.Min[j];
+		m_vCellSize[j] = fExtent / (float)nMaxQ;
+		vInvCellSize[j] = ( fExtent > 0 ) ? (float)nMaxQ / fExtent : 0.0f;
+		float fMaxAbs = std::max( fabs(m_bounds.Min[j]), fabs(m_bounds.Max[j]) );
+		m_vErrorBound[j] = 0.5f * m_vCellSize[j] + 2.0f * fMaxAbs * std::numeric_limits<float>::epsilon();
+	}
+
+	if ( ePositions == Positions16 )
+		m_vPositions16.resize( 3*nMaxVID, 0 );
+	else
+		m_vPositions21.resize( nMaxVID, 0 );
+	if ( eNormals == Normals16 )
+		m_vNormals.resize( nMaxVID, 0 );
+	else if ( eNormals == Normals32 )
+		m_vNormals.resize( 2*nMaxVID, 0 );
+	int nNormalBits = (int)eNormals / 2;
+
+	// encode vertices, measuring the actual error as we go
+	int nVertices = (int)vVertices.size();
+	float fMaxPosErrSqr = 0, fMinNormalDot = 1;
+	#pragma omp parallel
+	{
+		float fLocalMaxErrSqr = 0, fLocalMinDot = 1;
+		Wml::Vector3f vVertex, vNormal, vDecoded;
+
+		#pragma omp for
+		for ( int i = 0; i < nVertices; ++i ) {
+			VertexID vID = vVertices[i];
+			mesh.GetVertex(vID, vVertex, (eNormals != NoNormals) ? &vNormal : NULL);
+
+			unsigned int q[3];
+			for ( int j = 0; j < 3; ++j ) {
+				float f = (vVertex[j] - m_vOrigin[j]) * vInvCellSize[j] + 0.5f;
+				q[j] = ( f <= 0 ) ? 0 : ( ( f >= (float)nMaxQ ) ? nMaxQ : (unsigned int)f );
+			}
+			if ( ePositions == Positions16 ) {
+				for ( int j = 0; j < 3; ++j )
+					m_vPositions16[3*vID+j] = (unsigned short)q[j];
+			} else {
+				m_vPositions21[vID] = (unsigned long long)q[0] | ((unsigned long long)q[1] << 21) | ((unsigned long long)q[2] << 42);
+			}
+			DecodePosition(vID, vDecoded);
+			float fErrSqr = (vDecoded - vVertex).SquaredLength();
+			if ( fErrSqr > fLocalMaxErrSqr )
+				fLocalMaxErrSqr = fErrSqr;
+
+			if ( eNormals != NoNormals ) {
+				if ( vNormal.Normalize() < Wml::Mathf::ZERO_TOLERANCE )
+					vNormal = Wml::Vector3f::UNIT_Z;
+				unsigned int u, v;
+				EncodeOctahedral(vNormal, nNormalBits, u, v);
+				if ( eNormals == Normals16 )
+					m_vNormals[vID] = (unsigned short)(u | (v << 8));
+				else {
+					m_vNormals[2*vID] = (unsigned short)u;
+					m_vNormals[2*vID+1] = (unsigned short)v;
+				}
+				DecodeNormal(vID, vDecoded);
+				float fDot = vDecoded.Dot(vNormal);
+				if ( fDot < fLocalMinDot )
+					fLocalMinDot = fDot;
+			}
+		}
+
+		#pragma omp critical(QuantizedMesh_Initialize)
+		{
+			if ( fLocalMaxErrSqr > fMaxPosErrSqr )
+				fMaxPosErrSqr = fLocalMaxErrSqr;
+			if ( fLocalMinDot < fMinNormalDot )
+				fMinNormalDot = fLocalMinDot;
+		}
+	}
+	m_fMaxPositionError = sqrt(fMaxPosErrSqr);
+	m_fMaxNormalError = Wml::Mathf::ACos( std::min(1.0f, fMinNormalDot) );
+
+	// triangles
+	unsigned int nMaxTID = mesh.GetMaxTriangleID();
+	m_vValidTriangles.resize(nMaxTID);
+	m_vTriangles.resize( 3*nMaxTID, 0 );
+	VertexID nTri[3];
+	IMesh::ITriIterator curt(mesh.BeginITriangles()), endt(mesh.EndITriangles());
+	while ( curt != endt ) {
+		TriangleID tID = *curt;  curt++;
+		mesh.GetTriangle(tID, nTri);
+		m_vTriangles[3*tID] = nTri[0];
+		m_vTriangles[3*tID+1] = nTri[1];
+		m_vTriangles[3*tID+2] = nTri[2];
+		m_vValidTriangles.set(tID, true);
+		++m_nTriangleCount;
+	}
+}
+
+
+
+void QuantizedMesh::Decompress( VFTriangleMesh & mesh ) const
+{
+	mesh.Clear(true);
+	unsigned int nMaxVID = GetMaxVertexID();
+	std::vector<VertexID> vMap( nMaxVID, IMesh::InvalidID );
+	Wml::Vector3f vVertex, vNormal;
+	for ( unsigned int vID = 0; vID < nMaxVID; ++vID ) {
+		if ( ! m_vValidVertices[vID] )
+			continue;
+		DecodePosition(vID, vVertex);
+		DecodeNormal(vID, vNormal);
+		vMap[vID] = mesh.AppendVertex( vVertex, (m_eNormalBits != NoNormals) ? &vNormal : NULL );
+	}
+	unsigned int nMaxTID = GetMaxTriangleID();
+	for ( unsigned int tID = 0; tID < nMaxTID; ++tID ) {
+		if ( m_vValidTriangles[tID] ) {
+			const unsigned int * pTri = &m_vTriangles[3*tID];
+			mesh.AppendTriangle( vMap[pTri[0]], vMap[pTri[1]], vMap[pTri[2]] );
+		}
+	}
+}
+
+
+
+void QuantizedMesh::DecodePositions( VertexID vFirst, unsigned int nCount, float * pXYZ ) const
+{
+	lgASSERT( vFirst + nCount <= GetMaxVertexID() );
+	unsigned int k = 0;
+
+#ifdef RMS_SIMD_SSE
+	if ( m_ePositionBits == Positions16 ) {
+		// 4 vertices are 12 shorts, which decode to three float4 lanes with a period-3 pattern of x/y/z
+		const float * c = (const float *)m_vCellSize, * o = (const float *)m_vOrigin;
+		__m128 s0 = _mm_setr_ps(c[0], c[1], c[2], c[0]), s1 = _mm_setr_ps(c[1], c[2], c[0], c[1]), s2 = _mm_setr_ps(c[2], c[0], c[1], c[2]);
+		__m128 o0 = _mm_setr_ps(o[0], o[1], o[2], o[0]), o1 = _mm_setr_ps(o[1], o[2], o[0], o[1]), o2 = _mm_setr_ps(o[2], o[0], o[1], o[2]);
+		__m128i zero = _mm_setzero_si128();
+		const unsigned short * pIn = &m_vPositions16[3*vFirst];
+		for ( ; k + 4 <= nCount; k += 4, pIn += 12, pXYZ += 12 ) {
+			__m128i a = _mm_loadu_si128( (const __m128i *)pIn );
+			__m128i b = _mm_loadl_epi64( (const __m128i *)(pIn+8) );
+			__m128 f0 = _mm_cvtepi32_ps( _mm_unpacklo_epi16(a, zero) );
+			__m128 f1 = _mm_cvtepi32_ps( _mm_unpackhi_epi16(a, zero) );
+			__m128 f2 = _mm_cvtepi32_ps( _mm_unpacklo_epi16(b, zero) );
+			_mm_storeu_ps( pXYZ,   _mm_add_ps(o0, _mm_mul_ps(f0, s0)) );
+			_mm_storeu_ps( pXYZ+4, _mm_add_ps(o1, _mm_mul_ps(f1, s1)) );
+			_mm_storeu_ps( pXYZ+8, _mm_add_ps(o2, _mm_mul_ps(f2, s2)) );
+		}
+	}
+#endif
+
+	Wml::Vector3f vVertex;
+	for ( ; k < nCount; ++k, pXYZ += 3 ) {
+		DecodePosition( vFirst + k, vVertex );
+		pXYZ[0] = vVertex[0];  pXYZ[1] = vVertex[1];  pXYZ[2] = vVertex[2];
+	}
+}
+
+void QuantizedMesh::DecodeNormals( VertexID vFirst, unsigned int nCount, float * pXYZ ) const
+{
+	lgASSERT( vFirst + nCount <= GetMaxVertexID() );
+	Wml::Vector3f vNormal;
+	for ( unsigned int k = 0; k < nCount; ++k, pXYZ += 3 ) {
+		DecodeNormal( vFirst + k, vNormal );
+		pXYZ[0] = vNormal[0];  pXYZ[1] = vNormal[1];  pXYZ[2] = vNormal[2];
+	}
+}
+
+
+
+void QuantizedMesh::GetVertex( VertexID vID, Wml::Vector3f & vVertex, Wml::Vector3f * pNormal ) const
+{
+	lgASSERT( IsVertex(vID) );
+	DecodePosition(vID, vVertex);
+	if ( pNormal )
+		DecodeNormal(vID, *pNormal);
+}
+
+void QuantizedMesh::GetNormal( VertexID vID, Wml::Vector3f & vNormal ) const
+{
+	lgASSERT( IsVertex(vID) );
+	DecodeNormal(vID, vNormal);
+}
+
+void QuantizedMesh::GetTriangle( TriangleID tID, VertexID vTriangle[3]  ) const
+{
+	lgASSERT( IsTriangle(tID) );
+	const unsigned int * pTri = &m_vTriangles[3*tID];
+	vTriangle[0] = pTri[0];  vTriangle[1] = pTri[1];  vTriangle[2] = pTri[2];
+}
+
+void QuantizedMesh::GetTriangle( TriangleID tID, Wml::Vector3f vTriangle[3], Wml::Vector3f * pNormals ) const
+{
+	lgASSERT( IsTriangle(tID) );
+	const unsigned int * pTri = &m_vTriangles[3*tID];
+	for ( int j = 0; j < 3; ++j ) {
+		DecodePosition( pTri[j], vTriangle[j] );
+		if ( pNormals )
+			DecodeNormal( pTri[j], pNormals[j] );
+	}
+}
+
+
+
+/*
+ * Octahedral normal encoding: project onto the octahedron |x|+|y|+|z| = 1, fold the lower
+ * half over the diagonals, and quantize the resulting square. We try the four grid points
+ * around the projected point and keep the one that decodes closest to the input.
+ */
+static inline float OctSign( float f ) { return (f < 0) ? -1.0f : 1.0f; }
+
+void QuantizedMesh::EncodeOctahedral( const Wml::Vector3f & vNormal, int nBits, unsigned int & u, unsigned int & v )
+{
+	float fL1 = fabs(vNormal.X()) + fabs(vNormal.Y()) + fabs(vNormal.Z());
+	float px = vNormal.X() / fL1, py = vNormal.Y() / fL1;
+	if ( vNormal.Z() < 0 ) {
+		float tx = (1.0f - fabs(py)) * OctSign(px);
+		float ty = (1.0f - fabs(px)) * OctSign(py);
+		px = tx;  py = ty;
+	}
+
+	unsigned int nMax = (1u << nBits) - 1;
+	float fu = (px * 0.5f + 0.5f) * (float)nMax, fv = (py * 0.5f + 0.5f) * (float)nMax;
+	unsigned int u0 = (unsigned int)fu, v0 = (unsigned int)fv;
+	if ( u0 > nMax ) u0 = nMax;
+	if ( v0 > nMax ) v0 = nMax;
+
+	float fBestDot = -2.0f;
+	Wml::Vector3f vDecoded;
+	for ( unsigned int du = 0; du < 2; ++du ) {
+		for ( unsigned int dv = 0; dv < 2; ++dv ) {
+			unsigned int uu = std::min(u0+du, nMax), vv = std::min(v0+dv, nMax);
+			DecodeOctahedral( uu, vv, nBits, vDecoded );
+			float fDot = vDecoded.Dot(vNormal);
+			if ( fDot > fBestDot ) {
+				fBestDot = fDot;
+				u = uu;  v = vv;
+			}
+		}
+	}
+}
+
+void QuantizedMesh::DecodeOctahedral( unsigned int u, unsigned int v, int nBits, Wml::Vector3f & vNormal )
+{
+	float fScale = 2.0f / (float)( (1u << nBits) - 1 );
+	float px = (float)u * fScale - 1.0f, py = (float)v * fScale - 1.0f;
+	float pz = 1.0f - fabs(px) - fabs(py);
+	if ( pz < 0 ) {
+		float tx = (1.0f - fabs(py)) * OctSign(px);
+		float ty = (1.0f - fabs(px)) * OctSign(py);
+		px = tx;  py = ty;
+	}
+	vNormal = Wml::Vector3f(px, py, pz);
+	vNormal.Normalize();
+}
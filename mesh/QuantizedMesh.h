@@ -0,0 +1,222 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_QUANTIZED_MESH_H__
+#define __RMS_QUANTIZED_MESH_H__
+
+#include "config.h"
+#include "IMesh.h"
+#include "BitSet.h"
+#include <Wm4AxisAlignedBox3.h>
+#include <vector>
+
+namespace rms {
+
+class VFTriangleMesh;
+
+/*
+ * Read-only compressed copy of a mesh, for archival / serving very large meshes.
+ * Positions are quantized to 16 or 21 bits per axis relative to the bounding box
+ * (6 or 8 bytes per vertex), and normals are octahedral-encoded in 16 or 32 bits
+ * (or dropped). Vertex and triangle IDs are the same as in the source mesh.
+ *
+ * This is an IMesh, so read-only consumers (IMeshBVTree queries like FindNearest,
+ * IMeshRenderer, MeshUtils functions that only use the read interface) work directly
+ * on the compressed form, decoding on each read. There is no vertex one-ring, so
+ * functions that need BeginVtxTriangles() will not work. DecodePositions() decodes
+ * a range of vertices at once (with SSE2 for 16-bit positions).
+ *
+ * The error bounds are reported explicitly: GetPositionErrorBound() is the worst case
+ * per-axis error of the quantization grid, and GetMaxPositionError() / GetMaxNormalError()
+ * are the largest errors that were actually measured while encoding.
+ */
+class QuantizedMesh : public IMesh
+{
+public:
+	QuantizedMesh();
+	virtual ~QuantizedMesh();
+
+	enum PositionBits {
+		Positions16 = 16,
+		Positions21 = 21
+	};
+	enum NormalBits {
+		NoNormals = 0,
+		Normals16 = 16,			//! 8+8 bit octahedral, < 1 degree error
+		Normals32 = 32			//! 16+16 bit octahedral, < 0.05 degree error
+	};
+
+	void Initialize( const IMesh & mesh, PositionBits ePositions = Positions16, NormalBits eNormals = Normals16 );
+
+	//! decode to mesh. Vertex/triangle IDs are preserved if the source mesh was compact
+	void Decompress( VFTriangleMesh & mesh ) const;
+
+	PositionBits GetPositionBits() const { return m_ePositionBits; }
+	NormalBits GetNormalBits() const { return m_eNormalBits; }
+	const Wml::AxisAlignedBox3f & GetBounds() const { return m_bounds; }
+
+	//! worst-case per-axis position error (half of the quantization cell size, plus float rounding in the decode)
+	const Wml::Vector3f & GetPositionErrorBound() const { return m_vErrorBound; }
+	//! largest position error (distance) measured during encoding
+	float GetMaxPositionError() const { return m_fMaxPositionError; }
+	//! largest normal error (angle in radians) measured during encoding
+	float GetMaxNormalError() const { return m_fMaxNormalError; }
+
+	//! bytes used by vertex, normal and triangle storage
+	size_t GetMemoryUsage() const;
+
+	//! decode positions of nCount vertices starting at vFirst into pXYZ (packed x,y,z). Unused IDs decode to the box minimum
+	void DecodePositions( VertexID vFirst, unsigned int nCount, float * pXYZ ) const;
+	void DecodeNormals( VertexID vFirst, unsigned int nCount, float * pXYZ ) const;
+
+	inline void DecodePosition( VertexID vID, Wml::Vector3f & vVertex ) const;
+	inline void DecodeNormal( VertexID vID, Wml::Vector3f & vNormal ) const;
+
+/*
+ * IMesh read interface (mandatory)
+ */
+	virtual void GetVertex( VertexID vID, Wml::Vector3f & vVertex, Wml::Vector3f * pNormal = NULL ) const;
+	virtual void GetNormal( VertexID vID, Wml::Vector3f & vNormal ) const;
+	virtual unsigned int GetVertexCount() const
+		{ return m_nVertexCount; }
+	virtual unsigned int GetMaxVertexID() const
+		{ return (unsigned int)m_vValidVertices.size(); }
+	virtual bool IsVertex( VertexID vID ) const
+		{ return vID < m_vValidVertices.size() && m_vValidVertices[vID]; }
+
+	virtual void GetTriangle( TriangleID tID, VertexID vTriangle[3]  ) const;
+	virtual void GetTriangle( TriangleID tID, Wml::Vector3f vTriangle[3], Wml::Vector3f * pNormals = NULL ) const;
+	virtual unsigned int GetTriangleCount() const
+		{ return m_nTriangleCount; }
+	virtual unsigned int GetMaxTriangleID() const
+		{ return (unsigned int)m_vValidTriangles.size(); }
+	virtual bool IsTriangle( TriangleID tID ) const
+		{ return tID < m_vValidTriangles.size() && m_vValidTriangles[tID]; }
+
+	virtual void Clear( bool bFreeMem );
+
+
+/*
+ * basic iterators (over valid IDs)
+ */
+	class id_iterator {
+	public:
+		inline id_iterator() { m_nIndex = 0; m_pValid = NULL; }
+		inline unsigned int operator*() const { return m_nIndex; }
+		inline id_iterator & operator++() { goto_next(); return *this; }
+		inline void operator++(int) { goto_next(); }
+		inline bool operator==( const id_iterator & i2 ) const { return m_nIndex == i2.m_nIndex; }
+		inline bool operator!=( const id_iterator & i2 ) const { return m_nIndex != i2.m_nIndex; }
+	protected:
+		unsigned int m_nIndex;
+		const BitSet * m_pValid;
+		inline void goto_next() {
+			unsigned int nMax = (unsigned int)m_pValid->size();
+			do { ++m_nIndex; } while ( m_nIndex < nMax && ! m_pValid->get(m_nIndex) );
+		}
+		inline id_iterator( const BitSet * pValid, bool bStart ) : m_pValid(pValid) {
+			m_nIndex = (bStart) ? 0 : (unsigned int)pValid->size();
+			if ( bStart && m_nIndex < pValid->size() && ! pValid->get(0) )
+				goto_next();
+		}
+		friend class QuantizedMesh;
+	};
+	typedef id_iterator vertex_iterator;
+	typedef id_iterator triangle_iterator;
+
+	inline vertex_iterator BeginVertices() const { return id_iterator(&m_vValidVertices, true); }
+	inline vertex_iterator EndVertices() const { return id_iterator(&m_vValidVertices, false); }
+	inline triangle_iterator BeginTriangles() const { return id_iterator(&m_vValidTriangles, true); }
+	inline triangle_iterator EndTriangles() const { return id_iterator(&m_vValidTriangles, false); }
+
+
+protected:
+	PositionBits m_ePositionBits;
+	NormalBits m_eNormalBits;
+
+	Wml::AxisAlignedBox3f m_bounds;
+	Wml::Vector3f m_vOrigin;
+	Wml::Vector3f m_vCellSize;
+	Wml::Vector3f m_vErrorBound;
+	float m_fMaxPositionError;
+	float m_fMaxNormalError;
+
+	std::vector<unsigned short> m_vPositions16;		//! 3 per vertex
+	std::vector<unsigned long long> m_vPositions21;	//! x | y << 21 | z << 42
+	std::vector<unsigned short> m_vNormals;			//! 1 (Normals16) or 2 (Normals32) per vertex
+	std::vector<unsigned int> m_vTriangles;			//! 3 per triangle
+
+	BitSet m_vValidVertices;
+	BitSet m_vValidTriangles;
+	unsigned int m_nVertexCount;
+	unsigned int m_nTriangleCount;
+
+	static void EncodeOctahedral( const Wml::Vector3f & vNormal, int nBits, unsigned int & u, unsigned int & v );
+	static void DecodeOctahedral( unsigned int u, unsigned int v, int nBits, Wml::Vector3f & vNormal );
+
+/*
+ * IMesh iterator interface
+ */
+	inline virtual void * ivtx_make_iterator(bool bStart) const
+		{ return new vertex_iterator( (bStart) ? BeginVertices() : EndVertices() ); }
+	inline virtual void * ivtx_make_iterator( void * pFromItr ) const
+		{ return new vertex_iterator( * ((vertex_iterator *)pFromItr) ); }
+	inline virtual void ivtx_free_iterator( void * pItr )  const
+		{ delete (vertex_iterator *)pItr; }
+	inline virtual void ivtx_set( void * pItr, void * pTo ) const
+		{ *((vertex_iterator *)pItr) = *((vertex_iterator *)pTo); }
+	inline virtual void ivtx_goto_next( void * pItr ) const
+		{ ++(*((vertex_iterator *)pItr)); }
+	inline virtual bool ivtx_equal( void * pItr1, void * pItr2 ) const
+		{ return *((vertex_iterator *)pItr1) == *((vertex_iterator *)pItr2); }
+	inline virtual VertexID ivtx_value( void * pItr ) const
+		{ return **((vertex_iterator *)pItr); }
+
+	inline virtual void * itri_make_iterator(bool bStart) const
+		{ return new triangle_iterator( (bStart) ? BeginTriangles() : EndTriangles() ); }
+	inline virtual void * itri_make_iterator( void * pFromItr ) const
+		{ return new triangle_iterator( * ((triangle_iterator *)pFromItr) ); }
+	inline virtual void itri_free_iterator( void * pItr )  const
+		{ delete (triangle_iterator *)pItr; }
+	inline virtual void itri_set( void * pItr, void * pTo ) const
+		{ *((triangle_iterator *)pItr) = *((triangle_iterator *)pTo); }
+	inline virtual void itri_goto_next( void * pItr ) const
+		{ ++(*((triangle_iterator *)pItr)); }
+	inline virtual bool itri_equal( void * pItr1, void * pItr2 ) const
+		{ return *((triangle_iterator *)pItr1) == *((triangle_iterator *)pItr2); }
+	inline virtual TriangleID itri_value( void * pItr ) const
+		{ return **((triangle_iterator *)pItr); }
+};
+
+
+
+inline void QuantizedMesh::DecodePosition( VertexID vID, Wml::Vector3f & vVertex ) const
+{
+	if ( m_ePositionBits == Positions16 ) {
+		const unsigned short * p = &m_vPositions16[3*vID];
+		vVertex = Wml::Vector3f( m_vOrigin[0] + (float)p[0] * m_vCellSize[0],
+								 m_vOrigin[1] + (float)p[1] * m_vCellSize[1],
+								 m_vOrigin[2] + (float)p[2] * m_vCellSize[2] );
+	} else {
+		unsigned long long n = m_vPositions21[vID];
+		vVertex = Wml::Vector3f( m_vOrigin[0] + (float)(unsigned int)(n & 0x1FFFFF) * m_vCellSize[0],
+								 m_vOrigin[1] + (float)(unsigned int)((n >> 21) & 0x1FFFFF) * m_vCellSize[1],
+								 m_vOrigin[2] + (float)(unsigned int)((n >> 42) & 0x1FFFFF) * m_vCellSize[2] );
+	}
+}
+
+inline void QuantizedMesh::DecodeNormal( VertexID vID, Wml::Vector3f & vNormal ) const
+{
+	if ( m_eNormalBits == Normals16 ) {
+		unsigned short n = m_vNormals[vID];
+		DecodeOctahedral( n & 0xFF, n >> 8, 8, vNormal );
+	} else if ( m_eNormalBits == Normals32 ) {
+		DecodeOctahedral( m_vNormals[2*vID], m_vNormals[2*vID+1], 16, vNormal );
+	} else
+		vNormal = Wml::Vector3f::UNIT_Z;
+}
+
+
+} // end namespace rms
+
+#endif  // __RMS_QUANTIZED_MESH_H__
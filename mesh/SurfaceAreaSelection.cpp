@@ -4,11 +4,12 @@
 
 #include "opengl.h"
 #include "SurfaceAreaSelection.h"
-#include "MeshSourceUtil.h"
 
 #include <limits>
+#include <algorithm>
+#include <queue>
+#include <functional>
 #include <Wm4DistVector3Segment3.h>
-#include <DijkstraFrontProp.h>
 #include <MeshUtils.h>
 
 #include <rmsdebug.h>
@@ -25,6 +26,9 @@ SurfaceAreaSelection::SurfaceAreaSelection(void)
 	m_bGLDisplayListValid = false;
 	m_nGLDisplayList = -1;
 
+	m_bGeoDistancesValid = false;
+	m_fGeoDistanceRadius = 0;
+
 	Reset();
 }
 
@@ -52,6 +56,15 @@ void SurfaceAreaSelection::SetSurface(rms::VFTriangleMesh * pMesh, rms::MeshPoly
 		pMesh->GetTriangle( k, vTri );
 		m_vFaceNormalCache[k] = rms::Normal(vTri[0], vTri[1], vTri[2]);
 	}
+
+	m_vFloodLabels.resize(0);
+	m_vFloodLabels.resize( tID, 0 );
+	m_vGeoTouched.resize(0);
+	m_vGeoSource.resize(0);
+	m_vGeoDistances.resize(0);
+	m_vGeoDistances.resize( tID, std::numeric_limits<float>::max() );
+	m_vGeoInside.resize(0);
+	m_vGeoInside.resize( tID, false );
 	
 	Reset();
 }
@@ -66,6 +79,8 @@ void SurfaceAreaSelection::Reset()
 	m_vCurStroke.clear();
 	m_vPath.clear();
 	m_vOriginalPath.clear();
+	m_pathTrace.Clear();
+	m_strokeTrace.Clear();
 	InvalidateGeoDistances();
 
 	m_bGLDisplayListValid = false;
@@ -108,23 +123,29 @@ void SurfaceAreaSelection::Select(const std::set<IMesh::TriangleID> & vTriangles
 
 void SurfaceAreaSelection::AppendToStroke( const rms::Frame3f & vFrame )
 {
-	if (! m_bClosed )
-		m_vCurStroke.push_back(vFrame);
+	if ( m_bClosed )
+		return;
+	m_vCurStroke.push_back(vFrame);
+	TraceAppend( m_strokeTrace, vFrame.Origin() );
 }
 void SurfaceAreaSelection::CancelStroke()
 {
 	m_vCurStroke.resize(0);
+	m_strokeTrace.Clear();
 }
 
 void SurfaceAreaSelection::AppendCurrentStroke( )
 {
-	std::vector< rms::Frame3f > vStroke = m_vCurStroke;
-	m_vCurStroke.resize(0);
+	std::vector< rms::Frame3f > vStroke;
+	vStroke.swap(m_vCurStroke);
+	PathTrace strokeTrace;
+	std::swap( strokeTrace, m_strokeTrace );
 
 	if ( m_bClosed || vStroke.empty() )
 		return;
 	if ( m_vPath.empty() ) {
 		m_vPath = vStroke;
+		std::swap( m_pathTrace, strokeTrace );
 		TryClose();
 		return;
 	}
@@ -152,10 +173,21 @@ void SurfaceAreaSelection::AppendCurrentStroke( )
 
 	m_vPath.resize(iNearest+1);
 	m_vPath[iNearest] = vSnap;
+	m_pathTrace.Truncate(iNearest);
+	TraceAppend( m_pathTrace, vSnap );
 
 	for ( unsigned int i = 0; i < vStroke.size(); ++i )
 		m_vPath.push_back( vStroke[i] );
 
+	// only the connection to the first stroke sample is new, the rest of the stroke was traced as it was drawn
+	TraceAppend( m_pathTrace, vStart );
+	if ( strokeTrace.vTris[0] != IMesh::InvalidID ) {
+		TraceAppend( m_pathTrace, strokeTrace, 1 );
+	} else {
+		for ( unsigned int i = 1; i < vStroke.size(); ++i )
+			TraceAppend( m_pathTrace, vStroke[i].Origin() );
+	}
+
 	// check if we should close
 	TryClose();
 }
@@ -172,6 +204,9 @@ void SurfaceAreaSelection::TryClose()
 
   Wm4::Vector3f foo(0.5f * (m_vPath.front().Origin() + m_vPath.back().Origin()));
 	if ( ProjectToSurface( foo , m_vPath.back() ) ) {
+		m_pathTrace.Truncate( (unsigned int)m_vPath.size()-1 );
+		TraceAppend( m_pathTrace, m_vPath.back().Origin() );
+
 		m_bClosed = true;
 		m_vOriginalPath = m_vPath;
 
@@ -293,37 +328,77 @@ void SurfaceAreaSelection::SetGrowOffset(float fOffset, bool bScaleByMesh)
 	//    basically need to incrementally grow/shrink current selection until
 	//    all current vertices <= fUseOffset, instead of doing entire triangles...
 
-	ValidateGeoDistances();
-
-	m_fGrowOffset = fOffset;
 	float fUseOffset = (bScaleByMesh) ? (fOffset*m_fAvgEdgeLength) : fOffset;
+	ValidateGeoDistances( fabs(fUseOffset) );
+	m_fGrowOffset = fOffset;
 
-	std::set<IMesh::TriangleID> vNewInterior;
-	VFTriangleMesh::triangle_iterator curt(m_pMesh->BeginTriangles()), endt(m_pMesh->EndTriangles());
-	while ( curt != endt ) {
-		IMesh::TriangleID tID = *curt++;
-		if ( m_vGeoDistances[tID] <= fUseOffset )
-			vNewInterior.insert(tID);
+	// distances are relative to the selection they were computed from, so offsets do not accumulate
+	std::vector<IMesh::TriangleID> vNewInterior;
+	if ( fUseOffset >= 0 ) {
+		vNewInterior = m_vGeoSource;
+		size_t nTouched = m_vGeoTouched.size();
+		for ( unsigned int k = 0; k < nTouched; ++k ) {
+			IMesh::TriangleID tID = m_vGeoTouched[k];
+			if ( ! m_vGeoInside[tID] && m_vGeoDistances[tID] <= fUseOffset )
+				vNewInterior.push_back(tID);
+		}
+		std::sort( vNewInterior.begin(), vNewInterior.end() );
+	} else {
+		// un-touched inside triangles are further than the computed radius from the boundary
+		size_t nSource = m_vGeoSource.size();
+		for ( unsigned int k = 0; k < nSource; ++k ) {
+			IMesh::TriangleID tID = m_vGeoSource[k];
+			float fDist = m_vGeoDistances[tID];
+			if ( fDist == std::numeric_limits<float>::max() || fDist <= fUseOffset )
+				vNewInterior.push_back(tID);
+		}
 	}
 	
-	SetInterior(vNewInterior);
+	SetInterior( std::set<IMesh::TriangleID>( vNewInterior.begin(), vNewInterior.end() ) );
 	Optimize();
 }
 
 
 
-void SurfaceAreaSelection::Optimize()
+void SurfaceAreaSelection::Optimize( const std::vector<IMesh::TriangleID> * pFront )
 {
-	std::set<IMesh::TriangleID> vSave(m_vInterior);
+	std::vector<IMesh::TriangleID> vFront;
+	if ( pFront ) {
+		vFront = *pFront;
+	} else {
+		IMesh::TriangleID tNbrs[3];
+		std::set<IMesh::TriangleID>::iterator curt(m_vInterior.begin()), endt(m_vInterior.end());
+		while ( curt != endt ) {
+			IMesh::TriangleID tID = *curt++;
+			m_pMesh->FindNeighbours(tID, tNbrs);
+			for ( int j = 0; j < 3; ++j ) {
+				if ( m_vInterior.find(tNbrs[j]) == m_vInterior.end() ) {
+					vFront.push_back(tID);
+					break;
+				}
+			}
+		}
+	}
 
-	FillBoundaryTriangles();
-	ClipEarTriangles();
+	std::vector<IMesh::TriangleID> vFilled, vClipped;
+	FillBoundaryTriangles( vFront, vFilled );
+	vFront.insert( vFront.end(), vFilled.begin(), vFilled.end() );
+	ClipEarTriangles( vFront, vClipped );
 
-	// _NOT_ efficient...
-	std::set<IMesh::TriangleID> vCopy( m_vInterior );
-	SetInterior( vCopy );
-	if ( m_vInterior.empty() )
-		SetInterior(vSave);
+	// undo if we clipped everything
+	if ( m_vInterior.empty() ) {
+		m_vInterior.insert( vClipped.begin(), vClipped.end() );
+		for ( unsigned int i = 0; i < vFilled.size(); ++i )
+			m_vInterior.erase( vFilled[i] );
+	}
+
+	if ( m_pPolygons ) {
+		std::set<IMesh::TriangleID> vCopy( m_vInterior );
+		SetInterior( vCopy );
+	} else {
+		m_vBoundaryTris.clear();
+		m_bGLDisplayListValid = false;
+	}
 }
 
 
@@ -430,10 +505,131 @@ bool SurfaceAreaSelection::Contains( const rms::Frame3f & vFrame )
 
 void SurfaceAreaSelection::FindSelectionPatch()
 {
-	bool bOK = ComputeBoundaryTrisFromPath();
-	if ( ! bOK )
+	if ( ! ComputeBoundaryTrisFromPath() ) {
+		m_pathTrace.Clear();
+		return;
+	}
+
+	// flood seeds come from the trace, which includes the closing segment now, so it is cleared afterwards
+	std::vector<IMesh::TriangleID> vSide, vFront;
+	bool bFlooded = FloodSmallerSide( vSide, vFront );
+	m_pathTrace.Clear();
+	if ( ! bFlooded ) {
+		FindSelectionPatchGlobal();
 		return;
+	}
+
+	// interior is smaller side plus boundary. Only triangles along the boundary (or the mesh border) need to be optimized
+	vFront.insert( vFront.end(), m_vBoundaryTris.begin(), m_vBoundaryTris.end() );
+	vSide.insert( vSide.end(), m_vBoundaryTris.begin(), m_vBoundaryTris.end() );
+	std::sort( vSide.begin(), vSide.end() );
+	m_vInterior = std::set<IMesh::TriangleID>( vSide.begin(), vSide.end() );
+
+	Optimize( &vFront );
+}
+
+
+// Flood both sides of the boundary triangles at the same time, one triangle per side per step, 
+// so that the work is proportional to the smaller side. Returns false if seeds could not be found 
+// or the two floods meet (ie boundary does not separate them).
+bool SurfaceAreaSelection::FloodSmallerSide( std::vector<IMesh::TriangleID> & vSide, std::vector<IMesh::TriangleID> & vSideBorder )
+{
+	enum { Unvisited = 0, SideA = 1, SideB = 2, Boundary = 3 };
+
+	IMesh::TriangleID tNbrs[3];
+	Wml::Vector3f vTri[3];
+	std::vector<IMesh::TriangleID> vQueue[2];
+
+	std::set<IMesh::TriangleID>::iterator curt(m_vBoundaryTris.begin()), endt(m_vBoundaryTris.end());
+	while ( curt != endt )
+		m_vFloodLabels[ *curt++ ] = Boundary;
+
+	// seed each side with the neighbour of a boundary triangle that is furthest to the left/right 
+	// of the path (relative to local path direction)
+	IMesh::TriangleID tSeed[2] = { IMesh::InvalidID, IMesh::InvalidID };
+	float fSeedScore[2] = { 0.5f, 0.5f };
+	const PathTrace & trace = m_pathTrace;
+	for ( unsigned int i = 1; i < trace.Size(); ++i ) {
+		Wml::Vector3f vDir( trace.vPoints[i] - trace.vPoints[i-1] );
+		if ( vDir.Normalize() == 0 )
+			continue;
+		unsigned int nGapEnd = ( i+1 < trace.Size() ) ? trace.vGapStart[i+1] : (unsigned int)trace.vGapTris.size();
+		for ( unsigned int k = trace.vGapStart[i]; k <= nGapEnd; ++k ) {
+			IMesh::TriangleID tID = ( k < nGapEnd ) ? trace.vGapTris[k] : trace.vTris[i];
+			if ( tID == IMesh::InvalidID )
+				continue;
+			Wml::Vector3f vSide( m_vFaceNormalCache[tID].Cross(vDir) );
+			m_pMesh->GetTriangle( tID, vTri );
+			Wml::Vector3f vCenter( (vTri[0] + vTri[1] + vTri[2]) / 3.0f );
+			m_pMesh->FindNeighbours( tID, tNbrs );
+			for ( int j = 0; j < 3; ++j ) {
+				if ( tNbrs[j] == IMesh::InvalidID || m_vFloodLabels[tNbrs[j]] == Boundary )
+					continue;
+				m_pMesh->GetTriangle( tNbrs[j], vTri );
+				Wml::Vector3f vToNbr( (vTri[0] + vTri[1] + vTri[2]) / 3.0f - vCenter );
+				float fScore = vToNbr.Dot(vSide) / (vToNbr.Length() + 1e-30f);
+				if ( fScore > fSeedScore[0] ) {
+					fSeedScore[0] = fScore;  tSeed[0] = tNbrs[j];
+				} else if ( -fScore > fSeedScore[1] ) {
+					fSeedScore[1] = -fScore;  tSeed[1] = tNbrs[j];
+				}
+			}
+		}
+	}
+
+	bool bMet = ( tSeed[0] == IMesh::InvalidID || tSeed[1] == IMesh::InvalidID || tSeed[0] == tSeed[1] );
+	int nDone = -1;
+	std::vector<IMesh::TriangleID> vBorder[2];
+	if ( ! bMet ) {
+		size_t nHead[2] = { 0, 0 };
+		for ( int s = 0; s < 2; ++s ) {
+			m_vFloodLabels[ tSeed[s] ] = (unsigned char)(SideA + s);
+			vQueue[s].push_back( tSeed[s] );
+		}
+		while ( nDone < 0 && ! bMet ) {
+			for ( int s = 0; s < 2 && nDone < 0 && ! bMet; ++s ) {
+				if ( nHead[s] == vQueue[s].size() ) {
+					nDone = s;
+					break;
+				}
+				IMesh::TriangleID tID = vQueue[s][ nHead[s]++ ];
+				m_pMesh->FindNeighbours( tID, tNbrs );
+				for ( int j = 0; j < 3; ++j ) {
+					if ( tNbrs[j] == IMesh::InvalidID ) {
+						vBorder[s].push_back(tID);
+						continue;
+					}
+					unsigned char nLabel = m_vFloodLabels[ tNbrs[j] ];
+					if ( nLabel == Unvisited ) {
+						m_vFloodLabels[ tNbrs[j] ] = (unsigned char)(SideA + s);
+						vQueue[s].push_back( tNbrs[j] );
+					} else if ( nLabel == SideB - s ) {
+						bMet = true;
+					}
+				}
+			}
+		}
+	}
+
+	// reset labels
+	for ( int s = 0; s < 2; ++s )
+		for ( unsigned int k = 0; k < vQueue[s].size(); ++k )
+			m_vFloodLabels[ vQueue[s][k] ] = Unvisited;
+	curt = m_vBoundaryTris.begin();
+	while ( curt != endt )
+		m_vFloodLabels[ *curt++ ] = Unvisited;
+
+	if ( bMet )
+		return false;
+	vSide.swap( vQueue[nDone] );
+	vSideBorder.swap( vBorder[nDone] );
+	return true;
+}
 
+
+// flood fill from both sides of boundary tris over entire mesh, and take smaller side
+void SurfaceAreaSelection::FindSelectionPatchGlobal()
+{
 	IMesh::TriangleID tNbrs[3];
 
 	// find un-used triangle
@@ -513,16 +709,19 @@ void SurfaceAreaSelection::FindSelectionPatch()
 
 
 
-void SurfaceAreaSelection::ClipEarTriangles()
+// Erase selected triangles with fewer than two selected neighbours, until none are left. Each pass 
+// only re-checks triangles next to those erased in the previous pass.
+void SurfaceAreaSelection::ClipEarTriangles( const std::vector<IMesh::TriangleID> & vFront, std::vector<IMesh::TriangleID> & vClipped )
 {
-	bool bClipped = true;
-	while ( bClipped ) {
-		bClipped = false;
+	std::vector<IMesh::TriangleID> vCheck(vFront);
+	while ( ! vCheck.empty() ) {
 
 		std::vector<IMesh::TriangleID> vErase;
-		std::set<IMesh::TriangleID>::iterator curt(m_vInterior.begin()), endt(m_vInterior.end());
-		while ( curt != endt ) {
-			IMesh::TriangleID tID = *curt++;
+		size_t nCheck = vCheck.size();
+		for ( unsigned int i = 0; i < nCheck; ++i ) {
+			IMesh::TriangleID tID = vCheck[i];
+			if ( m_vInterior.find(tID) == m_vInterior.end() )
+				continue;
 		
 			IMesh::TriangleID tNbrs[3];
 			m_pMesh->FindNeighbours(tID, tNbrs);
@@ -533,32 +732,44 @@ void SurfaceAreaSelection::ClipEarTriangles()
 			if ( nNbrs < 2 )
 				vErase.push_back(tID);
 		}
+		std::sort( vErase.begin(), vErase.end() );
+		vErase.erase( std::unique( vErase.begin(), vErase.end() ), vErase.end() );
+
+		vCheck.resize(0);
 		for ( unsigned int i = 0; i < vErase.size(); ++i ) {
 			m_vInterior.erase( vErase[i] );
 			m_bGLDisplayListValid = false;
 			m_vBoundaryTris.erase( vErase[i] );
 		}
-		bClipped = ! vErase.empty();
+		for ( unsigned int i = 0; i < vErase.size(); ++i ) {
+			IMesh::TriangleID tNbrs[3];
+			m_pMesh->FindNeighbours(vErase[i], tNbrs);
+			for ( int j = 0; j < 3; ++j )
+				if ( tNbrs[j] != IMesh::InvalidID )
+					vCheck.push_back( tNbrs[j] );
+		}
+		vClipped.insert( vClipped.end(), vErase.begin(), vErase.end() );
 		//_RMSInfo("Clip Pass - clipped %d!\n", vErase.size());
 	}
 	//_RMSInfo("Done clip\n");
 }
 
 
-void SurfaceAreaSelection::FillBoundaryTriangles()
+// Select un-selected triangles with exactly two selected neighbours, until none are left. vFront 
+// must contain the selected triangles that have un-selected neighbours; later passes only check
+// around triangles filled in the previous pass.
+void SurfaceAreaSelection::FillBoundaryTriangles( const std::vector<IMesh::TriangleID> & vFront, std::vector<IMesh::TriangleID> & vFilled )
 {
-	bool bFilled = true;
-	while ( bFilled ) {
-		bFilled  = false;
+	std::vector<IMesh::TriangleID> vChanged(vFront);
+	while ( ! vChanged.empty() ) {
 
 		std::vector<IMesh::TriangleID> vFill;
-		std::set<IMesh::TriangleID>::iterator curt(m_vInterior.begin()), endt(m_vInterior.end());
-		while ( curt != endt ) {
-			IMesh::TriangleID tID = *curt++;
+		size_t nChanged = vChanged.size();
+		for ( unsigned int i = 0; i < nChanged; ++i ) {
+			IMesh::TriangleID tID = vChanged[i];
 
 			IMesh::TriangleID tNbrs[3], tNbrs2[3];
 			m_pMesh->FindNeighbours(tID, tNbrs);
-			int nNbrs = 0;
 			for ( int j = 0; j < 3; ++j ) {
 				IMesh::TriangleID tNbrID = tNbrs[j];
 				if ( tNbrID == IMesh::InvalidID || m_vInterior.find(tNbrID) != m_vInterior.end() )
@@ -574,82 +785,152 @@ void SurfaceAreaSelection::FillBoundaryTriangles()
 					vFill.push_back(tNbrID);
 			}
 		}
+		std::sort( vFill.begin(), vFill.end() );
+		vFill.erase( std::unique( vFill.begin(), vFill.end() ), vFill.end() );
+
 		size_t nFill = vFill.size();
 		for ( unsigned int i = 0; i < nFill; ++i ) {
 			m_vInterior.insert( vFill[i] );	
 			m_bGLDisplayListValid = false;
 			//m_vBoundaryTris.insert( vFill[i] );
 		}
-		bFilled = ! vFill.empty();
+		vFilled.insert( vFilled.end(), vFill.begin(), vFill.end() );
+		vChanged.swap(vFill);
 	}
 }
 
 
 bool SurfaceAreaSelection::ComputeBoundaryTrisFromPath()
 {
+	// path was traced as it was drawn, just need to connect the end back to the start
+	if ( m_pathTrace.Size() != m_vPath.size() ) {
+		m_pathTrace.Clear();
+		for ( unsigned int i = 0; i < m_vPath.size(); ++i )
+			TraceAppend( m_pathTrace, m_vPath[i].Origin() );
+	}
+	if ( m_pathTrace.Size() == 0 )
+		return false;
+	TraceAppend( m_pathTrace, m_vPath[0].Origin() );
+
 	m_vBoundaryTris.clear();
+	bool bFailed = false;
+	const PathTrace & trace = m_pathTrace;
+	for ( unsigned int i = 0; i < trace.Size(); ++i ) {
+		if ( trace.vTris[i] != IMesh::InvalidID )
+			m_vBoundaryTris.insert( trace.vTris[i] );
+		bFailed = bFailed || trace.vFailed[i];
+	}
+	m_vBoundaryTris.insert( trace.vGapTris.begin(), trace.vGapTris.end() );
 
-	Wml::Vector3f vSnap, vLastPoint;
-	IMesh::TriangleID tID, tLastNbrs[3], tLastID = IMesh::InvalidID;
+	// update path (gap points go before the sample they lead to)
+	m_vPath.resize(0);
+	for ( unsigned int i = 0; i < trace.Size(); ++i ) {
+		unsigned int nGapEnd = ( i+1 < trace.Size() ) ? trace.vGapStart[i+1] : (unsigned int)trace.vGapFrames.size();
+		for ( unsigned int k = trace.vGapStart[i]; k < nGapEnd; ++k )
+			m_vPath.push_back( trace.vGapFrames[k] );
+		if ( trace.vTris[i] != IMesh::InvalidID )
+			m_vPath.push_back( trace.vFrames[i] );
+	}
 
-	std::vector<Wml::Vector3f> vNewPath;
-		
-	bool bFailed = false;
-	size_t nCount = m_vPath.size();
-	for ( unsigned int j = 0; j < nCount + 1; ++j ) {
-		unsigned int i = j % nCount;
+	return ! bFailed;
+}
 
-		if ( i < nCount )
-			vNewPath.push_back( m_vPath[i].Origin() );
 
-		if ( ! m_pBVTree->FindNearest( m_vPath[i].Origin(), vSnap, tID ) )
-			continue;
-		if ( tID == tLastID ) {
-			vLastPoint = m_vPath[i].Origin();
-			continue;
-		}
-		
-		// check if we have a gap - if so, fix
-		IMesh::TriangleID tCurID = tID;
-		IMesh::TriangleID tTempLastID = tLastID;
-		while ( tLastID != IMesh::InvalidID && tLastNbrs[0] != tID && tLastNbrs[1] != tID && tLastNbrs[2] != tID && ! bFailed ) {
-			//if ( tCurID == tID ) 
-			//	_RMSInfo("New ");
-			//_RMSInfo("Gap - cur %d  last %d,  nbrs %d %d %d\n", tCurID, tTempLastID, tLastNbrs[0], tLastNbrs[1], tLastNbrs[2]);
+void SurfaceAreaSelection::PathTrace::Clear()
+{
+	vPoints.resize(0);
+	vFrames.resize(0);
+	vTris.resize(0);
+	vFailed.resize(0);
+	vGapStart.resize(0);
+	vGapTris.resize(0);
+	vGapFrames.resize(0);
+}
+
+void SurfaceAreaSelection::PathTrace::Truncate( unsigned int nSamples )
+{
+	if ( nSamples >= Size() )
+		return;
+	vGapTris.resize( vGapStart[nSamples] );
+	vGapFrames.resize( vGapStart[nSamples] );
+	vPoints.resize(nSamples);
+	vFrames.resize(nSamples);
+	vTris.resize(nSamples);
+	vFailed.resize(nSamples);
+	vGapStart.resize(nSamples);
+}
+
+
+// Find triangle containing vPoint, and the chain of triangles that connects it to the
+// triangle of the previous sample
+void SurfaceAreaSelection::TraceAppend( PathTrace & trace, const Wml::Vector3f & vPoint )
+{
+	int nPrev = (int)trace.Size() - 1;
+	while ( nPrev >= 0 && trace.vTris[nPrev] == IMesh::InvalidID )
+		--nPrev;
+
+	trace.vPoints.push_back( vPoint );
+	trace.vGapStart.push_back( (unsigned int)trace.vGapTris.size() );
+
+	Wml::Vector3f vSnap;
+	IMesh::TriangleID tID;
+	rms::Frame3f vFrame(vPoint);
+	if ( ! m_pBVTree->FindNearest( vPoint, vSnap, tID ) ) {
+		trace.vFrames.push_back( vFrame );
+		trace.vTris.push_back( IMesh::InvalidID );
+		trace.vFailed.push_back( false );
+		return;
+	}
+	Wml::Vector3f vProject(vPoint);
+	ProjectToSurface( vProject, vFrame );
+	trace.vFrames.push_back( vFrame );
 
+	// check if we have a gap - if so, fix
+	bool bFailed = false;
+	if ( nPrev >= 0 && trace.vTris[nPrev] != tID ) {
+		IMesh::TriangleID tLastNbrs[3];
+		IMesh::TriangleID tTempLastID = trace.vTris[nPrev];
+		Wml::Vector3f vLastPoint = trace.vPoints[nPrev];
+		m_pMesh->FindNeighbours( tTempLastID, tLastNbrs );
+		while ( tLastNbrs[0] != tID && tLastNbrs[1] != tID && tLastNbrs[2] != tID ) {
 			Wml::Vector3f vNext;
-			if ( ! FindNbrTriPoint( vLastPoint, m_vPath[i].Origin(), tTempLastID, 0, vNext ) ) {
+			if ( ! FindNbrTriPoint( vLastPoint, vPoint, tTempLastID, 0, vNext ) ) {
 				bFailed = true;
-				continue;
+				break;
 			}
 
 			IMesh::TriangleID tHitID;
 			m_pBVTree->FindNearest( vNext, vSnap, tHitID );
-			m_vBoundaryTris.insert(tHitID);
-			m_pMesh->FindNeighbours(tHitID, tLastNbrs);
+			trace.vGapTris.push_back( tHitID );
+			rms::Frame3f vNextFrame(vNext);
+			ProjectToSurface( vNext, vNextFrame );
+			trace.vGapFrames.push_back( vNextFrame );
+
+			m_pMesh->FindNeighbours( tHitID, tLastNbrs );
 			tTempLastID = tHitID;
-			tCurID = tHitID;
 			vLastPoint = vNext;
-			vNewPath.push_back( vNext );
-			//_RMSInfo("  Mid: tri %d,  nbrs %d %d %d\n", tHitID, tLastNbrs[0], tLastNbrs[1], tLastNbrs[2]);
 		}
-
-		m_vBoundaryTris.insert(tID);
-		m_pMesh->FindNeighbours(tID, tLastNbrs);
-		vLastPoint = m_vPath[i].Origin();
-		tLastID = tID;
 	}
 
+	trace.vTris.push_back( tID );
+	trace.vFailed.push_back( bFailed );
+}
+
 
-	// update path
-	m_vPath.resize(0);
-	rms::Frame3f vLastFrame;
-	for ( unsigned int i = 0; i < vNewPath.size(); ++i ) {
-		if ( ProjectToSurface( vNewPath[i], vLastFrame ) )
-			m_vPath.push_back( vLastFrame );
+// append samples [nFirst, end) of another trace. The gaps are re-used, so the sample before 
+// nFirst in append must be in the same triangle as the last sample of trace
+void SurfaceAreaSelection::TraceAppend( PathTrace & trace, const PathTrace & append, unsigned int nFirst )
+{
+	for ( unsigned int i = nFirst; i < append.Size(); ++i ) {
+		trace.vGapStart.push_back( (unsigned int)trace.vGapTris.size() );
+		unsigned int nGapEnd = ( i+1 < append.Size() ) ? append.vGapStart[i+1] : (unsigned int)append.vGapTris.size();
+		trace.vGapTris.insert( trace.vGapTris.end(), append.vGapTris.begin() + append.vGapStart[i], append.vGapTris.begin() + nGapEnd );
+		trace.vGapFrames.insert( trace.vGapFrames.end(), append.vGapFrames.begin() + append.vGapStart[i], append.vGapFrames.begin() + nGapEnd );
+		trace.vPoints.push_back( append.vPoints[i] );
+		trace.vFrames.push_back( append.vFrames[i] );
+		trace.vTris.push_back( append.vTris[i] );
+		trace.vFailed.push_back( append.vFailed[i] );
 	}
-
-	return ! bFailed;
 }
 
 
@@ -748,88 +1029,112 @@ void SurfaceAreaSelection::UpdateBoundaryTriangles()
 
 
 
-class SurfAreaSelection_FaceVtxSource : public IPositionSource<IMesh::TriangleID>
+// Signed geodesic (face-centroid graph) distances from the boundary of the current selection, 
+// negative inside. Dijkstra runs outwards from the boundary and stops at fMaxDistance, so the cost 
+// depends on the size of the offset band rather than the mesh. Distances are kept relative to the
+// selection they were first computed from, and the band is widened on demand.
+void SurfaceAreaSelection::ValidateGeoDistances( float fMaxDistance )
 {
-public:
-	std::vector<Wml::Vector3f> * pCenters;
-	SurfAreaSelection_FaceVtxSource(std::vector<Wml::Vector3f> * centers)
-		{ pCenters = centers; }
+	if ( m_bGeoDistancesValid && fMaxDistance <= m_fGeoDistanceRadius )
+		return;
 
-	virtual void GetPosition( IMesh::TriangleID nID, Wml::Vector3f & vPosition, Wml::Vector3f * pNormal ) {
-		vPosition = (*pCenters)[nID];
-	}
-	virtual IMesh::TriangleID MaxID() {
-		return (IMesh::TriangleID)pCenters->size();
+	if ( ! m_bGeoDistancesValid ) {
+		InvalidateGeoDistances();
+		m_vGeoSource.insert( m_vGeoSource.end(), m_vInterior.begin(), m_vInterior.end() );
+		for ( unsigned int k = 0; k < m_vGeoSource.size(); ++k )
+			m_vGeoInside[ m_vGeoSource[k] ] = true;
 	}
-};
-
+	float fRadius = std::max( fMaxDistance, 2.0f * m_fGeoDistanceRadius );
 
+	static const float GeoUnset = std::numeric_limits<float>::max();
+	for ( unsigned int k = 0; k < m_vGeoTouched.size(); ++k )
+		m_vGeoDistances[ m_vGeoTouched[k] ] = GeoUnset;
+	m_vGeoTouched.resize(0);
 
-void SurfaceAreaSelection::ValidateGeoDistances()
-{
-	if ( m_vGeoDistances.size() == m_pMesh->GetMaxTriangleID() )
-		return;
+	typedef std::pair<float, IMesh::TriangleID> QueueEntry;
+	std::priority_queue< QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > queue;
 
-	UpdateBoundaryTriangles();
+	// boundary of selection is start set
+	IMesh::TriangleID tNbrs[3];
+	size_t nSource = m_vGeoSource.size();
+	for ( unsigned int k = 0; k < nSource; ++k ) {
+		IMesh::TriangleID tID = m_vGeoSource[k];
+		m_pMesh->FindNeighbours(tID, tNbrs);
+		for ( int j = 0; j < 3; ++j ) {
+			if ( tNbrs[j] == IMesh::InvalidID || ! m_vGeoInside[ tNbrs[j] ] ) {
+				m_vGeoDistances[tID] = 0;
+				m_vGeoTouched.push_back(tID);
+				queue.push( QueueEntry(0.0f, tID) );
+				break;
+			}
+		}
+	}
 
-	m_vGeoDistances.resize(0);
-	m_vGeoDistances.resize( m_pMesh->GetMaxTriangleID(), -std::numeric_limits<float>::max() );
+	// propagate. Boundary triangles spread to both sides, others only to their own side
+	Wml::Vector3f vTri[3];
+	bool bExhausted = true;
+	unsigned int nInsideFrozen = 0;
+	IMesh::TriangleID tDeepest = IMesh::InvalidID;
+	while ( ! queue.empty() ) {
+		QueueEntry top = queue.top();
+		queue.pop();
+		IMesh::TriangleID tID = top.second;
+		float fDist = m_vGeoDistances[tID];
+		bool bInside = m_vGeoInside[tID];
+		if ( top.first != fabs(fDist) )
+			continue;		// stale entry
+		if ( top.first > fRadius ) {
+			bExhausted = false;
+			break;
+		}
+		if ( bInside ) {
+			++nInsideFrozen;
+			tDeepest = tID;
+		}
 
-	// construct list of face vertices and exterior faces
-	std::vector<Wml::Vector3f> vFaceCenters(m_pMesh->GetMaxTriangleID());
-	std::set<IMesh::TriangleID> vExterior;
-	VFTriangleMesh::triangle_iterator curt(m_pMesh->BeginTriangles()), endt(m_pMesh->EndTriangles());
-	while ( curt != endt ) {
-		IMesh::TriangleID tID = *curt++;
-		Wml::Vector3f vTri[3];
+		bool bBoundary = ( fDist == 0 && bInside );
 		m_pMesh->GetTriangle(tID, vTri);
-		Wml::Vector3f vCentroid = ( vTri[0] + vTri[1] + vTri[2] ) / 3.0f;
-		vFaceCenters[tID] = vCentroid;
-		if ( m_vInterior.find(tID) == m_vInterior.end() )
-			vExterior.insert(tID);
-	}
-	vExterior.insert( m_vBoundaryTris.begin(), m_vBoundaryTris.end() );
-
-	SurfAreaSelection_FaceVtxSource pointSource(&vFaceCenters);
-	TriangleNeighbourSource nbrSource(m_pMesh);
-	DijkstraFrontProp<IMesh::TriangleID> prop;
-	prop.SetSource(&pointSource, &nbrSource);
-
-	prop.AppendFilterVerts(m_vInterior);
-	std::set<IMesh::TriangleID>::iterator curb(m_vBoundaryTris.begin()), endb(m_vBoundaryTris.end());
-	while ( curb != endb ) 
-		prop.AppendStartValue( *curb++, 0 );
-	prop.FindAllDistances();
-
-	const std::vector<DijkstraFrontProp<IMesh::TriangleID>::VertInfo> & distances = prop.GetResults();
-	size_t nCount = distances.size();
-	int nMin = -1;
-	for ( unsigned int k = 0; k < nCount; ++k ) {
-		if ( distances[k].bFrozen ) {
-			m_vGeoDistances[k] = -distances[k].fMinDist;
-			if ( nMin < 0 || m_vGeoDistances[k] < m_vGeoDistances[nMin] )
-				nMin = k;
+		Wml::Vector3f vCenter( (vTri[0] + vTri[1] + vTri[2]) / 3.0f );
+		m_pMesh->FindNeighbours(tID, tNbrs);
+		for ( int j = 0; j < 3; ++j ) {
+			IMesh::TriangleID tNbrID = tNbrs[j];
+			if ( tNbrID == IMesh::InvalidID )
+				continue;
+			bool bNbrInside = m_vGeoInside[tNbrID];
+			if ( bNbrInside != bInside && ! bBoundary )
+				continue;
+			float fNbrDist = m_vGeoDistances[tNbrID];
+			if ( fNbrDist == 0 )
+				continue;
+			m_pMesh->GetTriangle(tNbrID, vTri);
+			float fNewDist = top.first + ( (vTri[0] + vTri[1] + vTri[2]) / 3.0f - vCenter ).Length();
+			if ( fNbrDist == GeoUnset ) {
+				m_vGeoTouched.push_back(tNbrID);
+			} else if ( fNewDist >= fabs(fNbrDist) ) {
+				continue;
+			}
+			m_vGeoDistances[tNbrID] = (bNbrInside) ? -fNewDist : fNewDist;
+			queue.push( QueueEntry(fNewDist, tNbrID) );
 		}
 	}
-	m_vGeoDistances[nMin] = -std::numeric_limits<float>::max();
-
-	prop.Reset();
-	prop.AppendFilterVerts(vExterior);
-	std::set<IMesh::TriangleID>::iterator curb2(m_vBoundaryTris.begin()), endb2(m_vBoundaryTris.end());
-	while ( curb2 != endb2 ) 
-		prop.AppendStartValue( *curb2++, 0 );
-	prop.FindAllDistances();
-
-	const std::vector<DijkstraFrontProp<IMesh::TriangleID>::VertInfo> & distances2 = prop.GetResults();
-	size_t nCount2 = distances2.size();
-	for ( unsigned int k = 0; k < nCount2; ++k ) {
-		if ( distances2[k].bFrozen )
-			m_vGeoDistances[k] = distances2[k].fMinDist;
-	}
+
+	// if entire inside was reached, make sure deepest triangle is never removed by a negative offset
+	if ( bExhausted && nInsideFrozen == nSource && tDeepest != IMesh::InvalidID )
+		m_vGeoDistances[tDeepest] = -std::numeric_limits<float>::max();
+
+	m_bGeoDistancesValid = true;
+	m_fGeoDistanceRadius = fRadius;
 }
 void SurfaceAreaSelection::InvalidateGeoDistances()
 {
-	m_vGeoDistances.resize(0);
+	for ( unsigned int k = 0; k < m_vGeoTouched.size(); ++k )
+		m_vGeoDistances[ m_vGeoTouched[k] ] = std::numeric_limits<float>::max();
+	m_vGeoTouched.resize(0);
+	for ( unsigned int k = 0; k < m_vGeoSource.size(); ++k )
+		m_vGeoInside[ m_vGeoSource[k] ] = false;
+	m_vGeoSource.resize(0);
+	m_bGeoDistancesValid = false;
+	m_fGeoDistanceRadius = 0;
 	m_fGrowOffset = 0;
 }
 
@@ -97,6 +97,27 @@ protected:
 	std::vector< rms::Frame3f > m_vOriginalPath;
 	std::vector< rms::Frame3f > m_vPath;
 
+	// Triangles crossed by a path, built up one sample at a time. Sample i lies in vTris[i], and
+	// the extra triangles (and surface points) needed to connect it to sample i-1 are
+	// vGapTris/vGapFrames[ vGapStart[i] ... vGapStart[i+1] ). vFailed[i] is set if that gap could not be closed.
+	struct PathTrace {
+		std::vector<Wml::Vector3f> vPoints;
+		std::vector<rms::Frame3f> vFrames;
+		std::vector<IMesh::TriangleID> vTris;
+		std::vector<bool> vFailed;
+		std::vector<unsigned int> vGapStart;
+		std::vector<IMesh::TriangleID> vGapTris;
+		std::vector<rms::Frame3f> vGapFrames;
+
+		void Clear();
+		void Truncate( unsigned int nSamples );
+		unsigned int Size() const { return (unsigned int)vPoints.size(); }
+	};
+	PathTrace m_pathTrace;			// trace of m_vPath
+	PathTrace m_strokeTrace;		// trace of m_vCurStroke
+	void TraceAppend( PathTrace & trace, const Wml::Vector3f & vPoint );
+	void TraceAppend( PathTrace & trace, const PathTrace & append, unsigned int nFirst );
+
 	bool m_bClosed;
 	void TryClose();
 
@@ -106,20 +127,33 @@ protected:
 	std::set< unsigned int > m_vInterior;
 	void SetInterior( const std::set<unsigned int> & vSet, bool bToPolygons = true );
 	void FindSelectionPatch();
+	void FindSelectionPatchGlobal();
+	bool FloodSmallerSide( std::vector<IMesh::TriangleID> & vSide, std::vector<IMesh::TriangleID> & vSideBorder );
 	bool ComputeBoundaryTrisFromPath();
 	bool FindNbrTriPoint( Wml::Vector3f vStart, Wml::Vector3f vEnd, unsigned int tStartTID, unsigned int tPrevID, Wml::Vector3f & vFound );
-	void ClipEarTriangles();
-	void FillBoundaryTriangles();
+	void ClipEarTriangles( const std::vector<IMesh::TriangleID> & vFront, std::vector<IMesh::TriangleID> & vClipped );
+	void FillBoundaryTriangles( const std::vector<IMesh::TriangleID> & vFront, std::vector<IMesh::TriangleID> & vFilled );
 	void UpdateBoundaryTriangles();
 
+	// per-triangle flood labels, always all-zero between calls to FloodSmallerSide()
+	std::vector<unsigned char> m_vFloodLabels;
+
+	// signed distances from boundary of m_vGeoSource (negative inside), valid up to m_fGeoDistanceRadius.
+	// Only entries in m_vGeoTouched are set, the rest are GeoUnset
 	std::vector<float> m_vGeoDistances;
-	void ValidateGeoDistances();
+	std::vector<IMesh::TriangleID> m_vGeoTouched;
+	std::vector<IMesh::TriangleID> m_vGeoSource;
+	std::vector<bool> m_vGeoInside;
+	bool m_bGeoDistancesValid;
+	float m_fGeoDistanceRadius;
+	void ValidateGeoDistances( float fMaxDistance );
 	void InvalidateGeoDistances();
 
 	bool ProjectToSurface( Wml::Vector3f & vPoint, rms::Frame3f & vFrame );
 
-	//! clip ears and fill inverse-ears  (this could be improved...)
-	void Optimize();
+	//! clip ears and fill inverse-ears. If pFront is given, it must contain all selected triangles that 
+	//! have unselected (or missing) neighbours, and only triangles near it are checked
+	void Optimize( const std::vector<IMesh::TriangleID> * pFront = NULL );
 };
 
 } // end namespace rms
\ No newline at end of file
@@ -0,0 +1,280 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "VFMeshHandle.h"
+#include "rmsdebug.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace rms;
+
+
+VFMeshHandle::VFMeshHandle()
+{
+	m_pCurrent = NULL;
+	m_pStaged = NULL;
+	m_nNextVersion = 1;
+	m_nLiveVersions = 0;
+#ifdef _OPENMP
+	omp_lock_t * pLock = new omp_lock_t;
+	omp_init_lock(pLock);
+	m_pLock = pLock;
+#else
+	m_pLock = NULL;
+#endif
+}
+
+VFMeshHandle::~VFMeshHandle()
+{
+	DiscardStagedEdits();
+	if ( m_pCurrent != NULL ) {
+		Release(m_pCurrent);
+		m_pCurrent = NULL;
+	}
+
+	// if this happens, a Pin has outlived the handle
+	if ( m_nLiveVersions != 0 )
+		lgBreakToDebugger();
+
+#ifdef _OPENMP
+	omp_destroy_lock( (omp_lock_t *)m_pLock );
+	delete (omp_lock_t *)m_pLock;
+#endif
+}
+
+
+void VFMeshHandle::Lock() const
+{
+#ifdef _OPENMP
+	omp_set_lock( (omp_lock_t *)m_pLock );
+#endif
+}
+
+void VFMeshHandle::Unlock() const
+{
+#ifdef _OPENMP
+	omp_unset_lock( (omp_lock_t *)m_pLock );
+#endif
+}
+
+
+
+VFMeshHandle::Version * VFMeshHandle::NewVersion()
+{
+	Version * pVersion = new Version();
+	pVersion->nVersion = 0;
+	pVersion->nTopologyVersion = 0;
+	pVersion->pTopologyOwner = NULL;
+	pVersion->nRefCount = 1;
+	Lock();
+	++m_nLiveVersions;
+	Unlock();
+	return pVersion;
+}
+
+void VFMeshHandle::AddRef( Version * pVersion ) const
+{
+	Lock();
+	++pVersion->nRefCount;
+	Unlock();
+}
+
+void VFMeshHandle::Release( Version * pVersion ) const
+{
+	// find versions to reclaim while holding the lock, but delete them afterwards.
+	//  Releasing a version that borrows adjacency also releases the owner.
+	Version * vDelete[2];
+	int nDelete = 0;
+	Lock();
+	while ( pVersion != NULL ) {
+		Version * pNext = NULL;
+		if ( --pVersion->nRefCount == 0 ) {
+			vDelete[nDelete++] = pVersion;
+			pNext = pVersion->pTopologyOwner;
+			--m_nLiveVersions;
+		}
+		pVersion = pNext;
+	}
+	Unlock();
+
+	// borrower is deleted before owner
+	for ( int k = 0; k < nDelete; ++k )
+		delete vDelete[k];
+}
+
+
+void VFMeshHandle::Swap( Version * pNewVersion )
+{
+	Lock();
+	Version * pOld = m_pCurrent;
+	m_pCurrent = pNewVersion;
+	Unlock();
+	if ( pOld != NULL )
+		Release(pOld);
+}
+
+
+
+VFMeshHandle::Pin VFMeshHandle::Acquire() const
+{
+	Pin pin;
+	Lock();
+	if ( m_pCurrent != NULL ) {
+		++m_pCurrent->nRefCount;
+		pin.m_pVersion = m_pCurrent;
+		pin.m_pHandle = this;
+	}
+	Unlock();
+	return pin;
+}
+
+unsigned int VFMeshHandle::GetPublishedVersion() const
+{
+	Lock();
+	unsigned int nVersion = ( m_pCurrent != NULL ) ? m_pCurrent->nVersion : 0;
+	Unlock();
+	return nVersion;
+}
+
+unsigned int VFMeshHandle::GetLiveVersionCount() const
+{
+	Lock();
+	unsigned int nCount = m_nLiveVersions;
+	Unlock();
+	return nCount;
+}
+
+
+
+unsigned int VFMeshHandle::PublishMesh( const VFTriangleMesh & mesh )
+{
+	DiscardStagedEdits();
+
+	// snapshot shares storage chunks with mesh, restoring it builds our own adjacency
+	Version * pNewVersion = NewVersion();
+	VFTriangleMesh::Snapshot snapshot;
+	mesh.TakeSnapshot(snapshot);
+	pNewVersion->mesh.RestoreSnapshot(snapshot);
+
+	unsigned int nVersion = m_nNextVersion++;
+	pNewVersion->nVersion = nVersion;
+	pNewVersion->nTopologyVersion = nVersion;
+	Swap(pNewVersion);
+	return nVersion;
+}
+
+
+void VFMeshHandle::EnsureStaged()
+{
+	if ( m_pStaged != NULL )
+		return;
+	lgASSERT( m_pCurrent != NULL );
+
+	// only the writer changes m_pCurrent, so no lock needed to read it here
+	Version * pOwner = ( m_pCurrent->pTopologyOwner != NULL ) ? m_pCurrent->pTopologyOwner : m_pCurrent;
+	AddRef(pOwner);
+
+	m_pStaged = NewVersion();
+	m_pStaged->mesh.ShareStorage( m_pCurrent->mesh );
+	m_pStaged->nTopologyVersion = m_pCurrent->nTopologyVersion;
+	m_pStaged->pTopologyOwner = pOwner;
+}
+
+void VFMeshHandle::SetVertex( IMesh::VertexID vID, const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal )
+{
+	EnsureStaged();
+	m_pStaged->mesh.SetVertex( vID, vVertex, pNormal );
+}
+
+void VFMeshHandle::SetNormal( IMesh::VertexID vID, const Wml::Vector3f & vNormal )
+{
+	EnsureStaged();
+	m_pStaged->mesh.SetNormal( vID, vNormal );
+}
+
+const VFTriangleMesh & VFMeshHandle::GetStagedMesh() const
+{
+	lgASSERT( m_pStaged != NULL || m_pCurrent != NULL );
+	return ( m_pStaged != NULL ) ? m_pStaged->mesh : m_pCurrent->mesh;
+}
+
+unsigned int VFMeshHandle::Publish()
+{
+	if ( m_pStaged == NULL )
+		return ( m_pCurrent != NULL ) ? m_pCurrent->nVersion : 0;
+
+	Version * pNewVersion = m_pStaged;
+	m_pStaged = NULL;
+	unsigned int nVersion = m_nNextVersion++;
+	pNewVersion->nVersion = nVersion;
+	Swap(pNewVersion);
+	return nVersion;
+}
+
+void VFMeshHandle::DiscardStagedEdits()
+{
+	if ( m_pStaged != NULL ) {
+		Release(m_pStaged);
+		m_pStaged = NULL;
+	}
+}
+
+
+
+
+VFMeshHandle::Pin::Pin()
+{
+	m_pHandle = NULL;
+	m_pVersion = NULL;
+}
+
+VFMeshHandle::Pin::Pin( const Pin & copy )
+{
+	m_pHandle = copy.m_pHandle;
+	m_pVersion = copy.m_pVersion;
+	if ( m_pVersion != NULL )
+		m_pHandle->AddRef(m_pVersion);
+}
+
+VFMeshHandle::Pin::~Pin()
+{
+	Release();
+}
+
+const VFMeshHandle::Pin & VFMeshHandle::Pin::operator=( const Pin & copy )
+{
+	if ( this != &copy ) {
+		Release();
+		m_pHandle = copy.m_pHandle;
+		m_pVersion = copy.m_pVersion;
+		if ( m_pVersion != NULL )
+			m_pHandle->AddRef(m_pVersion);
+	}
+	return *this;
+}
+
+void VFMeshHandle::Pin::Release()
+{
+	if ( m_pVersion != NULL ) {
+		m_pHandle->Release(m_pVersion);
+		m_pVersion = NULL;
+	}
+}
+
+const VFTriangleMesh & VFMeshHandle::Pin::Mesh() const
+{
+	lgASSERT( m_pVersion != NULL );
+	return m_pVersion->mesh;
+}
+
+unsigned int VFMeshHandle::Pin::GetVersion() const
+{
+	return ( m_pVersion != NULL ) ? m_pVersion->nVersion : 0;
+}
+
+unsigned int VFMeshHandle::Pin::GetTopologyVersion() const
+{
+	return ( m_pVersion != NULL ) ? m_pVersion->nTopologyVersion : 0;
+}
@@ -0,0 +1,127 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __LIBGEOMETRY_VF_MESH_HANDLE_H__
+#define __LIBGEOMETRY_VF_MESH_HANDLE_H__
+
+#include "config.h"
+#include "VFTriangleMesh.h"
+
+namespace rms {
+
+/*
+ * Publish/subscribe access to a VFTriangleMesh, RCU-style, so that background computations
+ * (curvature, BVH refits, ExpMaps, ...) can read a mesh while a UI thread edits it, without
+ * locking the mesh or copying it.
+ *
+ * Readers call Acquire() to pin the most recently published version. A pinned mesh is immutable
+ * and stays valid until the Pin is released, even if newer versions are published in the meantime.
+ * A version is reclaimed once no Pin (and no newer version, see below) refers to it.
+ *
+ * There is a single writer. Position/normal edits are staged with SetVertex()/SetNormal() into a
+ * private copy and become visible to readers when Publish() is called. The staged copy shares
+ * storage chunks with the published version (see RefCountedVector), and borrows the per-vertex
+ * adjacency of the version that last changed connectivity, so Publish() costs O(#chunks) plus
+ * one chunk copy per touched chunk. Connectivity changes are published with PublishMesh(), which
+ * rebuilds the per-vertex adjacency (O(n)).
+ *
+ * Acquire()/Release are thread-safe. The writer functions must be called from one thread.
+ * Published meshes do not include UV sets or scalar sets. The handle must outlive all Pins.
+ */
+class VFMeshHandle
+{
+protected:
+	struct Version;
+
+public:
+	VFMeshHandle();
+	~VFMeshHandle();
+
+	class Pin
+	{
+	public:
+		Pin();
+		Pin( const Pin & copy );
+		~Pin();
+		const Pin & operator=( const Pin & copy );
+
+		bool IsValid() const { return m_pVersion != NULL; }
+		void Release();
+
+		const VFTriangleMesh & Mesh() const;
+		unsigned int GetVersion() const;
+
+		//! version at which connectivity last changed. If two pins have the same topology version, only positions/normals differ
+		unsigned int GetTopologyVersion() const;
+
+	protected:
+		const VFMeshHandle * m_pHandle;
+		Version * m_pVersion;
+		friend class VFMeshHandle;
+	};
+
+	/*
+	 * reader interface
+	 */
+
+	//! pin most recently published version. Returns an invalid Pin if nothing has been published
+	Pin Acquire() const;
+
+	unsigned int GetPublishedVersion() const;
+
+	//! number of versions that have not been reclaimed yet (published, pinned, or owning shared adjacency)
+	unsigned int GetLiveVersionCount() const;
+
+
+	/*
+	 * writer interface
+	 */
+
+	//! publish a copy of mesh as a new version. Vertex/triangle IDs are preserved. Discards staged edits
+	unsigned int PublishMesh( const VFTriangleMesh & mesh );
+
+	//! stage edits for next Publish(). Requires a published mesh
+	void SetVertex( IMesh::VertexID vID, const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal = NULL );
+	void SetNormal( IMesh::VertexID vID, const Wml::Vector3f & vNormal );
+
+	bool HasStagedEdits() const { return m_pStaged != NULL; }
+
+	//! writer's view of the mesh, ie the published mesh plus staged edits
+	const VFTriangleMesh & GetStagedMesh() const;
+
+	//! make staged edits visible to readers. Returns new (or current, if nothing is staged) version
+	unsigned int Publish();
+
+	void DiscardStagedEdits();
+
+protected:
+	struct Version {
+		VFTriangleMesh mesh;
+		unsigned int nVersion;
+		unsigned int nTopologyVersion;
+		Version * pTopologyOwner;		// version whose per-vertex adjacency mesh is using, or NULL if it has its own
+		int nRefCount;
+	};
+	friend class Pin;
+
+	Version * m_pCurrent;				// published version, handle holds one reference
+	Version * m_pStaged;				// private to writer
+	unsigned int m_nNextVersion;
+	mutable unsigned int m_nLiveVersions;
+
+	void * m_pLock;
+	void Lock() const;
+	void Unlock() const;
+
+	Version * NewVersion();
+	void AddRef( Version * pVersion ) const;
+	void Release( Version * pVersion ) const;
+	void Swap( Version * pNewVersion );
+	void EnsureStaged();
+};
+
+
+} // end namespace rms
+
+
+#endif  // __LIBGEOMETRY_VF_MESH_HANDLE_H__
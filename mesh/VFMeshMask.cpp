@@ -90,6 +90,28 @@ void VFMeshMask::SetMesh( IMesh * pMesh )
 	Clear(false);
 	m_vCutVertices.resize( pMesh->GetMaxVertexID() );  m_nVertexSize = pMesh->GetMaxVertexID();
 	m_vCutTriangles.resize( pMesh->GetMaxTriangleID() );  m_nTriSize = pMesh->GetMaxTriangleID();
+	m_vCutVertexBits.resize( m_nVertexSize );
+	m_vCutTriangleBits.resize( m_nTriSize );
+}
+
+
+void VFMeshMask::Clear( bool bFreeMem )
+{
+	m_vCutVertices.clear(bFreeMem); 
+	m_vCutTriangles.clear(bFreeMem); 
+
+	// BitSet::clear() also resets the set count, so re-size afterwards to keep the bits allocated
+	size_t nVertexBits = m_vCutVertexBits.size(), nTriangleBits = m_vCutTriangleBits.size();
+	m_vCutVertexBits.clear();
+	m_vCutTriangleBits.clear();
+	if ( ! bFreeMem ) {
+		m_vCutVertexBits.resize( nVertexBits );
+		m_vCutTriangleBits.resize( nTriangleBits );
+	}
+
+	if (HasUVSet(0)) 
+		ClearUVSet(0); 
+	m_bvTree.Clear();
 }
 
 
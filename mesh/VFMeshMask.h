@@ -10,6 +10,7 @@
 #include "IMeshUVBVTree.h"
 #include <WmlPolygon2.h>
 #include <MeshSelection.h>
+#include <BitSet.h>
 #include <MeshPolygons.h>
 #include <ISurfaceProjector.h>
 
@@ -44,20 +45,19 @@ public:
 	MaskMode GetMaskMode() 
 		{ return m_eMaskMode; }
 
-	void Clear( bool bFreeMem = false ) 
-		{ m_vCutVertices.clear(bFreeMem); m_vCutTriangles.clear(bFreeMem); if (HasUVSet(0)) ClearUVSet(0); m_bvTree.Clear(); }
+	void Clear( bool bFreeMem = false );
 
 	inline void SetCutVtx( IMesh::VertexID vID ) 
-		{ m_vCutVertices.set( vID, true ); }
+		{ m_vCutVertices.set( vID, true ); m_vCutVertexBits.set( vID, true ); }
 
 	inline bool IsCutVtx( IMesh::VertexID vID ) const
-		{ return m_vCutVertices.has(vID); }
+		{ return vID < m_vCutVertexBits.size() && m_vCutVertexBits[vID]; }
 
 	inline void SetCutTri( IMesh::TriangleID tID ) 
-		{ m_vCutTriangles.set( tID, true ); }
+		{ m_vCutTriangles.set( tID, true ); m_vCutTriangleBits.set( tID, true ); }
 
 	inline bool IsCutTri( IMesh::TriangleID tID ) const
-		{ return m_vCutTriangles.has(tID); }
+		{ return tID < m_vCutTriangleBits.size() && m_vCutTriangleBits[tID]; }
 
 	bool IsVisibleTri( IMesh::TriangleID tID );
 
@@ -263,6 +263,11 @@ protected:
 	SparseArray<bool> m_vCutVertices;
 	SparseArray<bool> m_vCutTriangles;
 
+	// dense copies of the cut sets, for constant-time IsCutVtx/IsCutTri. The sparse
+	// arrays above are still used to enumerate in Intersection mode
+	BitSet m_vCutVertexBits;
+	BitSet m_vCutTriangleBits;
+
 	//! BV tree for fast projection routines
 	IMeshUVBVTree m_bvTree;
 
@@ -5,6 +5,8 @@
 #include <MeshUtils.h>
 #include "rmsdebug.h"
 
+#include <vector>
+
 using namespace rms;
 
 VFMeshMerge::VFMeshMerge( ) 
@@ -25,12 +27,25 @@ void VFMeshMerge::Initialize( IMesh * pBaseMesh, VFMeshMask * pMask, IMesh * pMe
 	UpdateMaxIDs();
 
 	for ( unsigned int i = 0; i < nPairs; ++i ) {
-		m_vBaseToMerge.set( vPairs[i].baseVID, vPairs[i].mergeVID );
-		m_vMergeToBase.set( vPairs[i].mergeVID, vPairs[i].baseVID );
+		m_vBaseToMerge[ vPairs[i].baseVID ] = vPairs[i].mergeVID;
+		m_vMergeToBase[ vPairs[i].mergeVID ] = vPairs[i].baseVID;
 	}
 }
 
 
+void VFMeshMerge::Clear( bool bFreeMem )
+{
+	if ( bFreeMem ) {
+		std::vector<VertexID>().swap( m_vBaseToMerge );
+		std::vector<VertexID>().swap( m_vMergeToBase );
+	} else {
+		m_vBaseToMerge.resize(0);
+		m_vMergeToBase.resize(0);
+	}
+	m_nMaxVID = 0;  m_nMaxTID = 0;
+}
+
+
 void VFMeshMerge::UpdateMaxIDs()
 {
 	if ( m_pBaseMesh ) {
@@ -49,8 +64,8 @@ void VFMeshMerge::UpdateMaxIDs()
 	}
 	m_nMaxTID = m_nMaxBaseTID + m_nMaxMergeTID;
 	m_nMaxVID = m_nMaxBaseVID + m_nMaxMergeVID;
-	m_vBaseToMerge.clear(false);  m_vBaseToMerge.resize( m_nMaxBaseVID );
-	m_vMergeToBase.clear(false);  m_vMergeToBase.resize( m_nMaxMergeVID );
+	m_vBaseToMerge.resize(0);  m_vBaseToMerge.resize( m_nMaxBaseVID, InvalidID );
+	m_vMergeToBase.resize(0);  m_vMergeToBase.resize( m_nMaxMergeVID, InvalidID );
 }
 
 
@@ -78,10 +93,8 @@ void VFMeshMerge::GetTriangle( TriangleID tID, VertexID vTriangle[3]  ) const
 
 		// re-write boundary vertices
 		for ( int j = 0; j < 3; ++j ) {
-			if ( m_vMergeToBase.has( vTriangle[j] ) )
-				vTriangle[j] = m_vMergeToBase.get( vTriangle[j] );
-			else
-				vTriangle[j] = FromMergeVID( vTriangle[j] );
+			VertexID vBaseID = m_vMergeToBase[ vTriangle[j] ];
+			vTriangle[j] = ( vBaseID != InvalidID ) ? vBaseID : FromMergeVID( vTriangle[j] );
 		}
 
 	} else {
@@ -95,10 +108,8 @@ void VFMeshMerge::GetTriangle( TriangleID tID, Wml::Vector3f vTriangle[3], Wml::
 		VertexID nTri[3];
 		m_pMergeMesh->GetTriangle( ToMergeTID(tID), nTri );
 		for ( int j = 0; j < 3; ++j ) {
-			if ( m_vMergeToBase.has( nTri[j] ) )   // rewrite boundary vertices
-				nTri[j] = m_vMergeToBase.get( nTri[j] );
-			else
-				nTri[j] = FromMergeVID( nTri[j] );
+			VertexID vBaseID = m_vMergeToBase[ nTri[j] ];		// rewrite boundary vertices
+			nTri[j] = ( vBaseID != InvalidID ) ? vBaseID : FromMergeVID( nTri[j] );
 			GetVertex( nTri[j], vTriangle[j], (pNormals) ? &pNormals[j] : NULL );
 		}
 
@@ -120,7 +131,7 @@ static const unsigned int BOTH_MERGE = 3;
 //! initialize vertex neighbour iteration
 void VFMeshMerge::BeginVtxTriangles( VtxNbrItr & v ) const
 {
-	bool bIsJoinVtx = (IsMergeVID(v.vID) == false) && m_vBaseToMerge.has(v.vID);
+	bool bIsJoinVtx = IsJoinVID(v.vID);
 	if ( ! bIsJoinVtx ) {
 		if ( ! IsMergeVID(v.vID) ) {
 			m_pBaseMesh->BeginVtxTriangles( v );
@@ -199,7 +210,7 @@ protected:
 
 void VFMeshMerge::NeighbourIteration( VertexID vID, NeighborTriCallback * pCallback )
 {
-	bool bIsJoinVtx = (IsMergeVID(vID) == false) && m_vBaseToMerge.has(vID);
+	bool bIsJoinVtx = IsJoinVID(vID);
 	if ( ! bIsJoinVtx ) {
 		if ( ! IsMergeVID(vID) ) {
 			m_pBaseMesh->NeighbourIteration(vID, pCallback);
@@ -246,7 +257,7 @@ bool VFMeshMerge::IsBoundaryVertex( VertexID vID ) const
 #endif
 
 	if ( ! IsMergeVID(vID) ) {
-		bool bIsJoinVtx = m_vBaseToMerge.has(vID);
+		bool bIsJoinVtx = IsJoinVID(vID);
 		if ( ! bIsJoinVtx )
 			return m_pBaseMesh->IsBoundaryVertex(vID);
 	} else {
@@ -255,3 +266,60 @@ bool VFMeshMerge::IsBoundaryVertex( VertexID vID ) const
 	return false;
 }
 
+
+
+void VFMeshMerge::Materialize( VFTriangleMesh & mesh, VertexMap * pVMap, TriangleMap * pTMap ) const
+{
+	mesh.Clear(false);
+	int nTris = (int)m_nMaxTID;
+	int nVerts = (int)m_nMaxVID;
+
+	// gather visible triangles, in merged IDs
+	std::vector<VertexID> vTris( 3*nTris );
+	std::vector<unsigned char> vKeepTri( nTris, 0 );
+	#pragma omp parallel for schedule(static) if(nTris > 16384)
+	for ( int tID = 0; tID < nTris; ++tID ) {
+		if ( IsTriangle(tID) ) {
+			GetTriangle( tID, &vTris[3*tID] );
+			vKeepTri[tID] = 1;
+		}
+	}
+
+	// only vertices used by visible triangles are written, in ID order
+	std::vector<VertexID> vNewVID( nVerts, InvalidID );
+	for ( int tID = 0; tID < nTris; ++tID ) {
+		if ( vKeepTri[tID] ) {
+			vNewVID[ vTris[3*tID] ] = 0;
+			vNewVID[ vTris[3*tID+1] ] = 0;
+			vNewVID[ vTris[3*tID+2] ] = 0;
+		}
+	}
+	std::vector<VertexID> vUsed;
+	for ( int vID = 0; vID < nVerts; ++vID )
+		if ( vNewVID[vID] != InvalidID )
+			vUsed.push_back(vID);
+
+	int nUsed = (int)vUsed.size();
+	std::vector<Wml::Vector3f> vVertices( nUsed ), vNormals( nUsed );
+	#pragma omp parallel for schedule(static) if(nUsed > 16384)
+	for ( int k = 0; k < nUsed; ++k )
+		GetVertex( vUsed[k], vVertices[k], &vNormals[k] );
+
+	for ( int k = 0; k < nUsed; ++k )
+		vNewVID[ vUsed[k] ] = mesh.AppendVertex( vVertices[k], &vNormals[k] );
+	if ( pVMap ) {
+		pVMap->Resize( nVerts, mesh.GetMaxVertexID() );
+		for ( int k = 0; k < nUsed; ++k )
+			pVMap->SetMap( vUsed[k], vNewVID[ vUsed[k] ] );
+	}
+
+	if ( pTMap )
+		pTMap->Resize( nTris, nTris );
+	for ( int tID = 0; tID < nTris; ++tID ) {
+		if ( ! vKeepTri[tID] )
+			continue;
+		TriangleID tNewID = mesh.AppendTriangle( vNewVID[ vTris[3*tID] ], vNewVID[ vTris[3*tID+1] ], vNewVID[ vTris[3*tID+2] ] );
+		if ( pTMap )
+			pTMap->SetMap( tID, tNewID );
+	}
+}
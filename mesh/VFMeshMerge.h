@@ -30,14 +30,19 @@ public:
 	VFMeshMask * GetBaseMask() { return m_pBaseMask; }
 	IMesh * GetMergeMesh() { return m_pMergeMesh; }
 
-	void Clear( bool bFreeMem = false ) 
-		{ m_vBaseToMerge.clear(bFreeMem);  m_vMergeToBase.clear(bFreeMem); 
-		  m_nMaxVID = 0;  m_nMaxTID = 0; }
+	void Clear( bool bFreeMem = false );
 
 	//! determine whether or not a triangle ID is part of the base mesh...
 	inline bool IsMergeTID( TriangleID tID ) const { 
 		return tID >= m_nMaxBaseTID; }
 
+	//! base vertex that is joined to a merge-mesh vertex
+	inline bool IsJoinVID( VertexID vID ) const {
+		return vID < m_nMaxBaseVID && m_vBaseToMerge[vID] != InvalidID; }
+
+	//! write the visible triangles (and the vertices they use) into a compact VFTriangleMesh. Maps are from this mesh's IDs to mesh's IDs
+	void Materialize( VFTriangleMesh & mesh, VertexMap * pVMap = NULL, TriangleMap * pTMap = NULL ) const;
+
 /*
  * IMesh read interface (mandatory)
  */
@@ -57,7 +62,7 @@ public:
 	virtual unsigned int GetMaxTriangleID() const
 		{ return m_nMaxTID; }
 	virtual bool IsTriangle( TriangleID tID ) const
-		{ lgBreakToDebugger(); return false; }
+		{ return ( IsMergeTID(tID) ) ? m_pMergeMesh->IsTriangle( ToMergeTID(tID) ) : m_pBaseMask->IsTriangle(tID); }
 
 /*
  * IMesh mesh info interface - has default implementation
@@ -246,8 +251,9 @@ public:
 	inline TriangleID ToMergeTID( TriangleID tID ) const { return tID - m_nMaxBaseTID; }
 	inline TriangleID FromMergeTID( TriangleID tID ) const {  return m_nMaxBaseTID + tID; }
 
-	SparseArray< VertexID > m_vBaseToMerge;
-	SparseArray< VertexID > m_vMergeToBase;
+	// dense join tables, InvalidID for vertices that are not joined
+	std::vector< VertexID > m_vBaseToMerge;
+	std::vector< VertexID > m_vMergeToBase;
 
 protected:
 
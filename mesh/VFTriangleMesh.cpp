@@ -17,8 +17,11 @@ using namespace rms;
 
 
 
-VFTriangleMesh::VFTriangleMesh(void)
+VFTriangleMesh::VFTriangleMesh( unsigned int nVertexAttributes )
+	: m_vNormals(Wml::Vector3f::UNIT_Z), m_vColors8(0), m_vBits(0)
 {
+	m_nVertexAttributes = nVertexAttributes;
+	InitializeChangeTracking();
 }
 
 VFTriangleMesh::~VFTriangleMesh(void)
@@ -26,11 +29,17 @@ VFTriangleMesh::~VFTriangleMesh(void)
 }
 
 VFTriangleMesh::VFTriangleMesh( const VFTriangleMesh & copy, VertexMap & vMap, TriangleMap * tMap, bool bCompact )
+	: m_vNormals(Wml::Vector3f::UNIT_Z), m_vColors8(0), m_vBits(0)
 {
+	m_nVertexAttributes = copy.m_nVertexAttributes;
+	InitializeChangeTracking();
 	Copy(copy, vMap, tMap, bCompact);
 }
 VFTriangleMesh::VFTriangleMesh( const VFTriangleMesh & copy, bool bCompact )
+	: m_vNormals(Wml::Vector3f::UNIT_Z), m_vColors8(0), m_vBits(0)
 {
+	m_nVertexAttributes = copy.m_nVertexAttributes;
+	InitializeChangeTracking();
 	Copy(copy, bCompact);
 }
 
@@ -60,6 +69,9 @@ void VFTriangleMesh::Copy( const VFTriangleMesh & mCopy, VertexMap & vMap, Trian
 		tMap->Resize( nMaxTID, nMaxTID );
 
 	Clear(true);
+	DisableVertexAttributes( m_nVertexAttributes );
+	RemoveVertexLayers();
+	EnableVertexAttributes( mCopy.m_nVertexAttributes );
 
 	Wml::Vector3f vVertex, vNormal;
 	vertex_iterator curv(mCopy_nonconst.BeginVertices()), endv(mCopy_nonconst.EndVertices());
@@ -86,6 +98,197 @@ void VFTriangleMesh::Copy( const VFTriangleMesh & mCopy, VertexMap & vMap, Trian
 	}
 }
 
+void VFTriangleMesh::TakeSnapshot( Snapshot & snapshot ) const
+{
+	snapshot.m_vVertices = m_vVertices;
+	snapshot.m_vTriangles = m_vTriangles;
+	snapshot.m_vEdges = m_vEdges;
+	snapshot.m_vNonManifoldEdges = m_vNonManifoldEdges;
+	snapshot.m_nVertexAttributes = m_nVertexAttributes;
+	snapshot.m_vNormals = m_vNormals;
+	snapshot.m_vColors = m_vColors;
+	snapshot.m_vColors8 = m_vColors8;
+	snapshot.m_vBits = m_vBits;
+	snapshot.m_vUserLayers = m_vUserLayers;
+}
+
+void VFTriangleMesh::RestoreSnapshot( const Snapshot & snapshot )
+{
+	Clear(false);
+	m_vVertices = snapshot.m_vVertices;
+	m_vTriangles = snapshot.m_vTriangles;
+	m_vEdges = snapshot.m_vEdges;
+	m_vNonManifoldEdges = snapshot.m_vNonManifoldEdges;
+	m_nVertexAttributes = snapshot.m_nVertexAttributes;
+	m_vNormals = snapshot.m_vNormals;
+	m_vColors = snapshot.m_vColors;
+	m_vColors8 = snapshot.m_vColors8;
+	m_vBits = snapshot.m_vBits;
+	m_vUserLayers = snapshot.m_vUserLayers;
+
+	// per-vertex triangle/edge lists live in our memory pools and are not part of the snapshot
+	//  (this un-shares the vertex chunks, since pData is stored in Vertex)
+	vertex_iterator curv(BeginVertices()), endv(EndVertices());
+	while ( curv != endv ) {
+		VertexID vID = *curv;  ++curv;
+		Vertex & v = m_vVertices[vID];
+		v.pData = m_VertDataMemPool.Allocate();
+		v.pData->vTriangles = m_VertListPool.GetList();
+		v.pData->vEdges = m_VertListPool.GetList();
+	}
+
+	const RefCountedVector<Triangle> & vTriangles = m_vTriangles;
+	triangle_iterator curt(BeginTriangles()), endt(EndTriangles());
+	while ( curt != endt ) {
+		TriangleID tID = *curt;  ++curt;
+		const Triangle & t = vTriangles[tID];
+		for ( int j = 0; j < 3; ++j )
+			AddTriEntry( tID, t.nVertices[j] );
+	}
+
+	const RefCountedVector<Edge> & vEdges = m_vEdges;
+	edge_iterator cure(BeginEdges()), ende(EndEdges());
+	while ( cure != ende ) {
+		EdgeID eID = *cure;  ++cure;
+		const Edge & e = vEdges[eID];
+		AddEdgeEntry( eID, e.nVertices[0] );
+		AddEdgeEntry( eID, e.nVertices[1] );
+	}
+
+	ResetChangeJournal();
+}
+
+
+void VFTriangleMesh::DetachSnapshots()
+{
+	m_vVertices.unshare();
+	m_vTriangles.unshare();
+	m_vEdges.unshare();
+	m_vNormals.unshare();
+	m_vColors.unshare();
+	m_vColors8.unshare();
+	m_vBits.unshare();
+	for ( unsigned int k = 0; k < m_vUserLayers.size(); ++k )
+		m_vUserLayers[k].vValues.unshare();
+}
+
+
+void VFTriangleMesh::ShareStorage( const VFTriangleMesh & mesh )
+{
+	Clear(false);
+	m_vVertices = mesh.m_vVertices;
+	m_vTriangles = mesh.m_vTriangles;
+	m_vEdges = mesh.m_vEdges;
+	m_vNonManifoldEdges = mesh.m_vNonManifoldEdges;
+	m_nVertexAttributes = mesh.m_nVertexAttributes;
+	m_vNormals = mesh.m_vNormals;
+	m_vColors = mesh.m_vColors;
+	m_vColors8 = mesh.m_vColors8;
+	m_vBits = mesh.m_vBits;
+	m_vUserLayers = mesh.m_vUserLayers;
+}
+
+
+
+void VFTriangleMesh::EnableVertexAttributes( unsigned int nAttributes )
+{
+	unsigned int nMaxVID = m_vVertices.max_index();
+	unsigned int nNew = nAttributes & ~m_nVertexAttributes;
+
+	if ( nNew & VertexNormals ) {
+		m_vNormals.clear();
+		m_vNormals.resize(nMaxVID);
+	}
+	if ( nNew & VertexBits ) {
+		m_vBits.clear();
+		m_vBits.resize(nMaxVID);
+	}
+
+	// only one color layer, existing colors are converted
+	if ( nNew & VertexColors8 ) {
+		m_vColors8.clear();
+		m_vColors8.resize(nMaxVID);
+		if ( m_nVertexAttributes & VertexColors ) {
+			const ChunkedArray<Wml::ColorRGBA> & vColors = m_vColors;
+			for ( unsigned int k = 0; k < nMaxVID; ++k )
+				m_vColors8[k] = PackColor8( vColors[k] );
+		}
+		m_vColors.clear(true);
+		nNew &= ~VertexColors;
+		m_nVertexAttributes &= ~VertexColors;
+	} else if ( nNew & VertexColors ) {
+		m_vColors.clear();
+		m_vColors.resize(nMaxVID);
+		if ( m_nVertexAttributes & VertexColors8 ) {
+			const ChunkedArray<unsigned int> & vColors8 = m_vColors8;
+			for ( unsigned int k = 0; k < nMaxVID; ++k )
+				m_vColors[k] = UnpackColor8( vColors8[k] );
+		}
+		m_vColors8.clear(true);
+		m_nVertexAttributes &= ~VertexColors8;
+	}
+
+	m_nVertexAttributes |= nNew;
+}
+
+void VFTriangleMesh::DisableVertexAttributes( unsigned int nAttributes )
+{
+	if ( nAttributes & VertexNormals )
+		m_vNormals.clear(true);
+	if ( nAttributes & VertexColors )
+		m_vColors.clear(true);
+	if ( nAttributes & VertexColors8 )
+		m_vColors8.clear(true);
+	if ( nAttributes & VertexBits )
+		m_vBits.clear(true);
+	m_nVertexAttributes &= ~nAttributes;
+}
+
+unsigned int VFTriangleMesh::AddVertexLayer( unsigned int nComponents )
+{
+	lgASSERT( nComponents > 0 );
+	m_vUserLayers.push_back( VertexLayer() );
+	VertexLayer & layer = m_vUserLayers.back();
+	layer.nComponents = nComponents;
+	layer.vValues.resize( m_vVertices.max_index() * nComponents );
+	return (unsigned int)m_vUserLayers.size() - 1;
+}
+
+void VFTriangleMesh::RemoveVertexLayers()
+{
+	m_vUserLayers.clear();
+}
+
+void VFTriangleMesh::InitializeVertexAttributes( VertexID vID )
+{
+	// grow layers to include vID, or reset the previous values if vID is being re-used
+	if ( m_nVertexAttributes & VertexNormals ) {
+		m_vNormals.ensure(vID);
+		m_vNormals[vID] = Wml::Vector3f::UNIT_Z;
+	}
+	if ( m_nVertexAttributes & VertexColors ) {
+		m_vColors.ensure(vID);
+		m_vColors[vID] = Wml::ColorRGBA();
+	}
+	if ( m_nVertexAttributes & VertexColors8 ) {
+		m_vColors8.ensure(vID);
+		m_vColors8[vID] = 0;
+	}
+	if ( m_nVertexAttributes & VertexBits ) {
+		m_vBits.ensure(vID);
+		m_vBits[vID] = 0;
+	}
+	size_t nLayers = m_vUserLayers.size();
+	for ( unsigned int k = 0; k < nLayers; ++k ) {
+		VertexLayer & layer = m_vUserLayers[k];
+		unsigned int nBase = vID * layer.nComponents;
+		layer.vValues.ensure( nBase + layer.nComponents - 1 );
+		for ( unsigned int j = 0; j < layer.nComponents; ++j )
+			layer.vValues[nBase+j] = 0.0f;
+	}
+}
+
+
 void VFTriangleMesh::CopyVertInfo( VFTriangleMesh & mesh )
 {
 	if ( mesh.GetVertexCount() != GetVertexCount() )
@@ -188,7 +391,7 @@ bool VFTriangleMesh::Append( VFTriangleMesh & mAppend, VertexMap & vMap, Triangl
 IMesh::VertexID VFTriangleMesh::AppendVertex( const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal )
 { 
 	VertexID vNewID = 
-		(VertexID)m_vVertices.insert( Vertex(vVertex, (pNormal) ? *pNormal : Wml::Vector3f::UNIT_Z ) );
+		(VertexID)m_vVertices.insert( Vertex(vVertex) );
 #ifdef PRINT_DEBUG_LOG
 	_RMSInfo("[VFMesh::AppendVertex      ] - adding vertex %6d\n", vNewID);
 #endif
@@ -204,6 +407,13 @@ IMesh::VertexID VFTriangleMesh::AppendVertex( const Wml::Vector3f & vVertex, con
 	m_VertListPool.Clear( v.vTriangles );
 	m_VertListPool.Clear( v.vEdges );
 
+	if ( m_nVertexAttributes != 0 || ! m_vUserLayers.empty() ) {
+		InitializeVertexAttributes(vNewID);
+		if ( pNormal && (m_nVertexAttributes & VertexNormals) )
+			m_vNormals[vNewID] = *pNormal;
+	}
+
+	OnVertexConnectivity(vNewID);
 	return vNewID;
 }
 
@@ -240,6 +450,7 @@ IMesh::TriangleID VFTriangleMesh::AppendTriangle( IMesh::VertexID v1, IMesh::Ver
 	AddTriangleEdge(tID, v3, v1);
 #endif
 
+	OnTriangleConnectivity(tID, v1, v2, v3);
 	return tID;
 }
 
@@ -256,6 +467,8 @@ bool VFTriangleMesh::SetTriangle( IMesh::TriangleID tID, IMesh::VertexID v1, IMe
 			 FindEdge(t.nVertices[2], t.nVertices[0]) == InvalidID )
 			 return false;
 
+		OnTriangleConnectivity( tID, t.nVertices[0], t.nVertices[1], t.nVertices[2] );
+
 		// remove existing edges
 		RemoveTriangleEdge(tID, t.nVertices[0], t.nVertices[1]);
 		RemoveTriangleEdge(tID, t.nVertices[1], t.nVertices[2]);
@@ -292,6 +505,7 @@ bool VFTriangleMesh::SetTriangle( IMesh::TriangleID tID, IMesh::VertexID v1, IMe
 		AddTriangleEdge( tID, v2, v3 );
 		AddTriangleEdge( tID, v3, v1 );
 
+		OnTriangleConnectivity( tID, v1, v2, v3 );
 		return true;
 	}
 	return false;
@@ -307,6 +521,13 @@ void VFTriangleMesh::Clear( bool bFreeMem )
 	m_VertDataMemPool.ClearAll();
 	m_VertListPool.Clear(bFreeMem);
 	m_vNonManifoldEdges.clear();
+	m_vNormals.clear(bFreeMem);
+	m_vColors.clear(bFreeMem);
+	m_vColors8.clear(bFreeMem);
+	m_vBits.clear(bFreeMem);
+	for ( unsigned int k = 0; k < m_vUserLayers.size(); ++k )
+		m_vUserLayers[k].vValues.clear(bFreeMem);
+	ResetChangeJournal();
 }
 
 
@@ -394,9 +615,10 @@ void VFTriangleMesh::RemoveVertex( VertexID vID )
 	//  SetTriangle() doesn't remove un-referenced vertices (which it really
 	//   shouldn't, since we might be performing mesh surgery stuff....
 	if ( v.pData->vTriangles.pFirst == NULL ) {
-		if ( m_vVertices.refCount( vID ) == 1 )
+		if ( m_vVertices.refCount( vID ) == 1 ) {
 			m_vVertices.remove( vID );
-		else
+			OnVertexConnectivity(vID);
+		} else
 			lgBreakToDebugger();
 	} else { 
 		// remove each attached face
@@ -418,6 +640,8 @@ void VFTriangleMesh::RemoveTriangle( TriangleID tID )
 	_RMSInfo("[VFMesh::RemoveTriangle    ] - removing triangle %6d  (%6d %6d %6d)\n", tID,  t.nVertices[0], t.nVertices[1], t.nVertices[2]);
 #endif
 
+	OnTriangleConnectivity( tID, t.nVertices[0], t.nVertices[1], t.nVertices[2] );
+
 	// decrement existing reference counts
 	lgASSERT( m_vVertices.isValid(t.nVertices[0]) && m_vVertices.isValid(t.nVertices[1]) && m_vVertices.isValid(t.nVertices[2]) );
 	for ( int i = 0; i < 3; ++i ) {
@@ -897,7 +1121,7 @@ void VFTriangleMesh::SplitEdge( VertexID e1, VertexID e2 )
 
 	// append new vertex
 	Wml::Vector3f vInterp = 0.5f * (pV1->vVertex + pV2->vVertex);
-	Wml::Vector3f nInterp = 0.5f * (pV1->vNormal + pV2->vNormal);
+	Wml::Vector3f nInterp = 0.5f * (GetNormal(e1) + GetNormal(e2));
 	VertexID vNew = AppendVertex(vInterp, &nInterp);
 	
 	// update triangles
@@ -1009,7 +1233,7 @@ bool VFTriangleMesh::CollapseEdge( EdgeID eID )
 	// find new position for vKeep
 	if ( ! bKeepIsBoundary ) {
 		Wml::Vector3f vNewPos = 0.5f * (m_vVertices[vKeep].vVertex + m_vVertices[vErase].vVertex);
-		Wml::Vector3f vNewNorm = 0.5f * (m_vVertices[vKeep].vNormal + m_vVertices[vErase].vNormal);
+		Wml::Vector3f vNewNorm = 0.5f * (GetNormal(vKeep) + GetNormal(vErase));
 		vNewNorm.Normalize();
 		SetVertex(vKeep, vNewPos, &vNewNorm);
 	}
@@ -1169,6 +1393,8 @@ bool VFTriangleMesh::FlipEdge( EdgeID eID )
 	AddTriangleEdge(vEdgeT[1], t2.nVertices[1], t2.nVertices[2]);
 	AddTriangleEdge(vEdgeT[1], t2.nVertices[2], t2.nVertices[0]);
 
+	OnTriangleConnectivity( vEdgeT[0], t1.nVertices[0], t1.nVertices[1], t1.nVertices[2] );
+	OnTriangleConnectivity( vEdgeT[1], t2.nVertices[0], t2.nVertices[1], t2.nVertices[2] );
 	return true;
 }
 
@@ -1184,6 +1410,137 @@ void VFTriangleMesh::ReverseOrientation()
 		tri.nVertices[2] = tri.nVertices[1];
 		tri.nVertices[1] = tmp;
 	}
+
+	// every triangle changed, but vertex one-rings are the same
+	m_nTopologyVersion = m_nVersion;
+	if ( m_bJournalEnabled && GetMaxTriangleID() > 0 )
+		JournalChange( m_nVersion, TriangleConnectivity, 0, GetMaxTriangleID()-1 );
+}
+
+
+
+
+void VFTriangleMesh::InitializeChangeTracking()
+{
+	m_nVersion = 1;
+	m_nPositionVersion = 0;
+	m_nTopologyVersion = 0;
+	m_bJournalEnabled = false;
+	m_nMaxJournalRanges = (1<<16);
+	m_nJournalStart = 0;
+}
+
+void VFTriangleMesh::ResetChangeJournal()
+{
+	m_nPositionVersion = m_nTopologyVersion = m_nVersion;
+	m_vJournal.resize(0);
+	m_nJournalStart = m_nVersion;
+}
+
+void VFTriangleMesh::EnableChangeJournal( bool bEnable, unsigned int nMaxRanges )
+{
+	m_bJournalEnabled = bEnable;
+	m_nMaxJournalRanges = (nMaxRanges < 2) ? 2 : nMaxRanges;
+	m_vJournal.resize(0);
+	m_nJournalStart = m_nVersion;
+}
+
+
+void VFTriangleMesh::OnTriangleConnectivity( TriangleID tID, VertexID v1, VertexID v2, VertexID v3 )
+{
+	m_nTopologyVersion = m_nVersion;
+	if ( m_bJournalEnabled ) {
+		JournalChange( m_nVersion, TriangleConnectivity, tID, tID );
+		JournalChange( m_nVersion, VertexConnectivity, v1, v1 );
+		JournalChange( m_nVersion, VertexConnectivity, v2, v2 );
+		JournalChange( m_nVersion, VertexConnectivity, v3, v3 );
+	}
+}
+
+
+void VFTriangleMesh::JournalChange( unsigned int nVersion, ChangeType eType, MeshEntityID nFirst, MeshEntityID nLast )
+{
+	// try to extend one of the most recent ranges. Edits tend to be local, so
+	//  in practice this keeps the journal much smaller than the number of edits.
+	//  Merging gives the whole range the new version, so only merge into small
+	//  ranges, or extend the end of a range with the same version (ie sequential edits)
+	const int nMergeWindow = 4;
+	const unsigned int nSmallRange = 32;
+
+	#pragma omp critical(VFTriangleMesh_JournalChange)
+	{
+		bool bMerged = false;
+		int nCount = (int)m_vJournal.size();
+		for ( int k = nCount-1; k >= 0 && k >= nCount-nMergeWindow && ! bMerged; --k ) {
+			ChangeRange & r = m_vJournal[k];
+			if ( r.eType != eType )
+				continue;
+			bool bAppend = ( r.nVersion == nVersion && nFirst >= r.nFirst && nFirst <= r.nLast+1 && nLast > r.nLast );
+			bool bSmall = ( nFirst <= r.nLast+1 && nLast+1 >= r.nFirst && r.nLast - r.nFirst < nSmallRange );
+			if ( bAppend || bSmall ) {
+				if ( nFirst < r.nFirst )		r.nFirst = nFirst;
+				if ( nLast > r.nLast )			r.nLast = nLast;
+				if ( nVersion > r.nVersion )	r.nVersion = nVersion;
+				bMerged = true;
+			}
+		}
+
+		if ( ! bMerged ) {
+			// if journal is full, discard oldest half. Versions before the newest discarded range can no longer be served
+			if ( m_vJournal.size() >= m_nMaxJournalRanges ) {
+				size_t nDiscard = m_vJournal.size() / 2;
+				for ( unsigned int k = 0; k < nDiscard; ++k )
+					if ( m_vJournal[k].nVersion > m_nJournalStart )
+						m_nJournalStart = m_vJournal[k].nVersion;
+				m_vJournal.erase( m_vJournal.begin(), m_vJournal.begin() + nDiscard );
+			}
+			ChangeRange r;
+			r.nVersion = nVersion;  r.eType = eType;
+			r.nFirst = nFirst;  r.nLast = nLast;
+			m_vJournal.push_back(r);
+		}
+	}
+}
+
+
+bool VFTriangleMesh::GetChanges( unsigned int nSinceVersion, std::vector<ChangeRange> & vChanges ) const
+{
+	vChanges.resize(0);
+	if ( ! m_bJournalEnabled || nSinceVersion < m_nJournalStart )
+		return false;
+	size_t nCount = m_vJournal.size();
+	for ( unsigned int k = 0; k < nCount; ++k )
+		if ( m_vJournal[k].nVersion > nSinceVersion )
+			vChanges.push_back( m_vJournal[k] );
+	return true;
+}
+
+
+bool VFTriangleMesh::GetChanges( unsigned int nSinceVersion, std::vector<VertexID> & vVertices, std::vector<TriangleID> & vTriangles, bool * pTopologyChanged ) const
+{
+	vVertices.resize(0);  vTriangles.resize(0);
+	if ( pTopologyChanged )
+		*pTopologyChanged = ( m_nTopologyVersion > nSinceVersion );
+	std::vector<ChangeRange> vChanges;
+	if ( ! GetChanges( nSinceVersion, vChanges ) )
+		return false;
+
+	unsigned int nMaxVID = GetMaxVertexID(), nMaxTID = GetMaxTriangleID();
+	std::vector<bool> vVertexSet( nMaxVID, false ), vTriangleSet( nMaxTID, false );
+	size_t nCount = vChanges.size();
+	for ( unsigned int k = 0; k < nCount; ++k ) {
+		const ChangeRange & r = vChanges[k];
+		bool bTris = ( r.eType == TriangleConnectivity );
+		std::vector<bool> & vSet = bTris ? vTriangleSet : vVertexSet;
+		std::vector<MeshEntityID> & vIDs = bTris ? vTriangles : vVertices;
+		for ( unsigned int nID = r.nFirst; nID <= r.nLast && nID < vSet.size(); ++nID ) {
+			if ( ! vSet[nID] ) {
+				vSet[nID] = true;
+				vIDs.push_back(nID);
+			}
+		}
+	}
+	return true;
 }
 
 
@@ -1253,7 +1610,7 @@ void VFTriangleMesh::GetVertexFrame( VertexID vID, Wml::Vector3f & tan1, Wml::Ve
 
 	// compute frame
 	Wml::Vector3f vNbrV = m_vVertices[vNbr].vVertex;
-	vNormal = v.vNormal;
+	vNormal = GetNormal(vID);
 	tan2 = vNbrV - v.vVertex;
 	tan1 = vNormal.Cross( tan2.Cross(vNormal) );
 	tan1.Normalize();
@@ -1348,12 +1705,11 @@ bool VFTriangleMesh::IsCompact() const
 
 void VFTriangleMesh::ClearBit( unsigned int nBit )
 {
-	RefCountedVector<Vertex>::item_iterator 
-		curv(m_vVertices.begin_items()), endv(m_vVertices.end_items());
-	while ( curv != endv ) {
-		(*curv).vecData.nBits &= ~(1<<nBit);
-		++curv;
-	}
+	if ( ! (m_nVertexAttributes & VertexBits) )
+		return;
+	unsigned int nCount = m_vBits.size();
+	for ( unsigned int k = 0; k < nCount; ++k )
+		m_vBits[k] &= ~(1<<nBit);
 }
 
 
@@ -17,6 +17,7 @@
 #include "IMesh.h"
 #include "MemoryPool.h"
 #include "RefCountedVector.h"
+#include "ChunkedArray.h"
 #include "SparseArray.h"
 #include "IDMap.h"
 
@@ -26,7 +27,17 @@ namespace rms {
 class  VFTriangleMesh : public IMesh
 {
 public:
-  VFTriangleMesh(void);
+  //! optional per-vertex layers, see EnableVertexAttributes()
+  enum VertexAttributes {
+    VertexPositions = 0,		//! positions are always stored
+    VertexNormals = 1,
+    VertexColors = 2,			//! float RGBA colors
+    VertexColors8 = 4,			//! 8-bit-per-channel RGBA colors (replaces VertexColors)
+    VertexBits = 8,
+    DefaultVertexAttributes = VertexNormals | VertexColors | VertexBits
+  };
+
+  explicit VFTriangleMesh( unsigned int nVertexAttributes = DefaultVertexAttributes );
   VFTriangleMesh( const VFTriangleMesh & copy, bool bCompact = true );
   VFTriangleMesh( const VFTriangleMesh & copy, VertexMap & vMap, TriangleMap * tMap = NULL, bool bCompact = true );
   ~VFTriangleMesh(void);
@@ -198,6 +209,28 @@ public:
   void SetBit( VertexID vID, unsigned int nBit );
   bool GetBit( VertexID vID, unsigned int nBit );
 
+  /*
+   * Optional vertex attribute layers. Positions are always stored; normals, colors and the bitmask
+   * are dense layers that can be left out (eg VFTriangleMesh(VertexPositions)) for geometry-only
+   * processing, which roughly halves per-vertex memory. SetNormal(), SetColor() and SetBit() enable
+   * their layer on demand, but normals passed to AppendVertex()/SetVertex() are dropped if there is
+   * no normal layer. Reading a missing layer returns the default (normal UNIT_Z, color (0,0,0,0), no bits).
+   * Copy() uses the attributes of the source mesh. Enabling a layer resizes it without locking, so a
+   * layer must be enabled before it is written from a parallel loop (the on-demand enable is not thread-safe).
+   */
+  unsigned int GetVertexAttributes() const { return m_nVertexAttributes; }
+  bool HasVertexAttribute( VertexAttributes eAttrib ) const { return (m_nVertexAttributes & eAttrib) != 0; }
+  void EnableVertexAttributes( unsigned int nAttributes );
+  void DisableVertexAttributes( unsigned int nAttributes );
+
+  //! add a layer of nComponents floats per vertex (initialized to 0), returns layer index
+  unsigned int AddVertexLayer( unsigned int nComponents );
+  unsigned int GetVertexLayerCount() const { return (unsigned int)m_vUserLayers.size(); }
+  unsigned int GetVertexLayerComponents( unsigned int nLayer ) const { return m_vUserLayers[nLayer].nComponents; }
+  void RemoveVertexLayers();
+  inline void SetLayerValue( unsigned int nLayer, VertexID vID, const float * pValues );
+  inline void GetLayerValue( unsigned int nLayer, VertexID vID, float * pValues ) const;
+
 
 protected:
 
@@ -222,20 +255,17 @@ protected:
   struct VertexData {
     ListPool<TriangleID>::List vTriangles;
     ListPool<EdgeID>::List vEdges;
-    Wml::ColorRGBA vColor;
   };
 
   MemoryPool<VertexData> m_VertDataMemPool;
 
   struct Vertex {
     Wml::Vector3f vVertex;		//! vertex location
-    Wml::Vector3f vNormal;		//! vertex normal
-    VertexData * pData;			//! other per-vertex data
-    unsigned int nBits;			//! insanely-useful per-vertex bitmask
+    VertexData * pData;			//! per-vertex adjacency
 
     Vertex() : pData(NULL) { }
-    Vertex( const Wml::Vector3f & v, const Wml::Vector3f & n )
-      : vVertex(v), vNormal(n), pData(NULL) {}
+    Vertex( const Wml::Vector3f & v )
+      : vVertex(v), pData(NULL) {}
   };
 
   struct Edge {
@@ -261,10 +291,108 @@ protected:
   RefCountedVector<Edge> m_vEdges;
   std::set<EdgeID> m_vNonManifoldEdges;
 
+  // optional vertex layers. If enabled, layer size is at least m_vVertices.max_index()
+  struct VertexLayer {
+    unsigned int nComponents;
+    ChunkedArray<float> vValues;
+  };
+  unsigned int m_nVertexAttributes;
+  ChunkedArray<Wml::Vector3f> m_vNormals;
+  ChunkedArray<Wml::ColorRGBA> m_vColors;
+  ChunkedArray<unsigned int> m_vColors8;
+  ChunkedArray<unsigned int> m_vBits;			//! insanely-useful per-vertex bitmask
+  std::vector<VertexLayer> m_vUserLayers;
+
+  void InitializeVertexAttributes( VertexID vID );
+  static inline unsigned int PackColor8( const Wml::ColorRGBA & c );
+  static inline Wml::ColorRGBA UnpackColor8( unsigned int nColor );
+
   EdgeID AddTriangleEdge( TriangleID tID, VertexID v1, VertexID v2 );
   bool RemoveTriangleEdge( TriangleID tID, VertexID v1, VertexID v2 );
 
 public:
+  /*
+   * Copy-on-write snapshot of the vertices, triangles and edges of a mesh, for undo/preview.
+   * Taking a snapshot only shares the storage chunks of the RefCountedVectors, which are
+   * duplicated when the mesh (or a restored copy) first writes to them. So a snapshot
+   * costs O(#chunks), and an edit touching a few vertices copies only their chunks.
+   * Vertex attribute layers are shared in the same way. UV sets and scalar sets are not included.
+   */
+  class Snapshot {
+  public:
+    unsigned int GetVertexCount() const { return m_vVertices.size(); }
+    unsigned int GetTriangleCount() const { return m_vTriangles.size(); }
+    void Clear() { 
+      m_vVertices.clear(true); m_vTriangles.clear(true); m_vEdges.clear(true); m_vNonManifoldEdges.clear(); 
+      m_vNormals.clear(true); m_vColors.clear(true); m_vColors8.clear(true); m_vBits.clear(true); m_vUserLayers.clear();
+    }
+  protected:
+    RefCountedVector<Vertex> m_vVertices;
+    RefCountedVector<Triangle> m_vTriangles;
+    RefCountedVector<Edge> m_vEdges;
+    std::set<EdgeID> m_vNonManifoldEdges;
+    unsigned int m_nVertexAttributes;
+    ChunkedArray<Wml::Vector3f> m_vNormals;
+    ChunkedArray<Wml::ColorRGBA> m_vColors;
+    ChunkedArray<unsigned int> m_vColors8;
+    ChunkedArray<unsigned int> m_vBits;
+    std::vector<VertexLayer> m_vUserLayers;
+    friend class VFTriangleMesh;
+  };
+
+  void TakeSnapshot( Snapshot & snapshot ) const;
+
+  //! replace mesh with snapshot. IDs are the same as when the snapshot was taken. Per-vertex adjacency is rebuilt, so this is O(n)
+  void RestoreSnapshot( const Snapshot & snapshot );
+
+  //! duplicate the storage chunks still shared with snapshots. Call this before setting vertices/triangles from several threads
+  void DetachSnapshots();
+
+  /*
+   * Change tracking, so that caches (BV trees, normals, Laplacian weights, ...) can be updated
+   * incrementally instead of rebuilt. A cache calls SyncVersion() when it is built and keeps the
+   * returned version; all later edits have larger versions. GetPositionVersion() and GetTopologyVersion()
+   * are the versions of the last edit that moved a vertex (position or normal), or that changed
+   * connectivity (vertex/triangle added, removed or re-connected).
+   *
+   * If the change journal is enabled, edits also record the affected IDs, as coalesced ID ranges,
+   * and GetChanges() returns what changed since a synced version. The journal has a bounded size and
+   * is reset by Clear()/Copy()/RestoreSnapshot(). If a version is older than the journal, GetChanges()
+   * returns false and the cache must be rebuilt.
+   *
+   * Edits only store the current version (no increment), so the journal does not prevent calling
+   * SetVertex() etc from parallel loops (on distinct vertices). The storage does: after TakeSnapshot()
+   * the mesh shares chunks with the snapshot, and DetachSnapshots() must be called before such a loop.
+   * The vertex layers written in the loop must also be enabled beforehand (see EnableVertexAttributes()).
+   */
+  enum ChangeType {
+    VertexMoved = 0,			//! position and/or normal changed
+    VertexConnectivity = 1,		//! vertex added/removed, or its one-ring changed
+    TriangleConnectivity = 2	//! triangle added/removed/re-connected
+  };
+  struct ChangeRange {
+    unsigned int nVersion;
+    ChangeType eType;
+    MeshEntityID nFirst, nLast;		//! inclusive ID range
+  };
+
+  //! returns a version that is older than any subsequent edit
+  inline unsigned int SyncVersion() const { return m_nVersion++; }
+  inline unsigned int GetPositionVersion() const { return m_nPositionVersion; }
+  inline unsigned int GetTopologyVersion() const { return m_nTopologyVersion; }
+  inline bool HasChangedSince( unsigned int nVersion ) const 
+    { return m_nPositionVersion > nVersion || m_nTopologyVersion > nVersion; }
+
+  //! nMaxRanges bounds the journal size. Edits made before the journal is enabled are not recorded
+  void EnableChangeJournal( bool bEnable, unsigned int nMaxRanges = (1<<16) );
+  bool IsChangeJournalEnabled() const { return m_bJournalEnabled; }
+
+  //! journal ranges with version > nSinceVersion (unordered, may overlap). Returns false if the journal does not go back that far
+  bool GetChanges( unsigned int nSinceVersion, std::vector<ChangeRange> & vChanges ) const;
+
+  //! unique vertices (moved or changed one-ring) and triangles changed since nSinceVersion. Removed IDs are included, check IsVertex()/IsTriangle()
+  bool GetChanges( unsigned int nSinceVersion, std::vector<VertexID> & vVertices, std::vector<TriangleID> & vTriangles, bool * pTopologyChanged = NULL ) const;
+
   typedef RefCountedVector<Vertex>::index_iterator vertex_iterator;
   inline vertex_iterator BeginVertices() const
   { return m_vVertices.begin_indexes(); }
@@ -285,6 +413,27 @@ public:
 
 
 protected:
+  // change tracking
+  mutable unsigned int m_nVersion;		//! version of edits made now, incremented by SyncVersion()
+  unsigned int m_nPositionVersion;
+  unsigned int m_nTopologyVersion;
+  bool m_bJournalEnabled;
+  unsigned int m_nMaxJournalRanges;
+  unsigned int m_nJournalStart;			//! journal is complete for versions >= m_nJournalStart
+  std::vector<ChangeRange> m_vJournal;
+
+  void InitializeChangeTracking();
+  void ResetChangeJournal();
+  inline void OnVertexMoved( VertexID vID );
+  inline void OnVertexConnectivity( VertexID vID );
+  void OnTriangleConnectivity( TriangleID tID, VertexID v1, VertexID v2, VertexID v3 );
+  void JournalChange( unsigned int nVersion, ChangeType eType, MeshEntityID nFirst, MeshEntityID nLast );
+
+  //! share all storage with mesh, including its per-vertex adjacency. This mesh then must not change 
+  //! connectivity, and mesh must outlive it (or at least its connectivity must). See VFMeshHandle
+  void ShareStorage( const VFTriangleMesh & mesh );
+  friend class VFMeshHandle;
+
   /*
  * IMesh iterator interface
  */
@@ -321,18 +470,36 @@ protected:
 
 
 
+inline void VFTriangleMesh::OnVertexMoved( VertexID vID )
+{
+  m_nPositionVersion = m_nVersion;
+  if ( m_bJournalEnabled )
+    JournalChange( m_nVersion, VertexMoved, vID, vID );
+}
+
+inline void VFTriangleMesh::OnVertexConnectivity( VertexID vID )
+{
+  m_nTopologyVersion = m_nVersion;
+  if ( m_bJournalEnabled )
+    JournalChange( m_nVersion, VertexConnectivity, vID, vID );
+}
+
+
 inline void VFTriangleMesh::SetVertex( VertexID vID, const Wml::Vector3f & vVertex, const Wml::Vector3f * pNormal )
 {
-  Vertex & v = m_vVertices[vID];
-  v.vVertex = vVertex;
-  if ( pNormal )
-    v.vNormal = *pNormal;
+  m_vVertices[vID].vVertex = vVertex;
+  if ( pNormal && (m_nVertexAttributes & VertexNormals) )
+    m_vNormals[vID] = *pNormal;
+  OnVertexMoved(vID);
 }
 
 inline void VFTriangleMesh::SetNormal( VertexID vID, const Wml::Vector3f & vNormal )
 {
-  Vertex & v = m_vVertices[vID];
-  v.vNormal = vNormal;
+  lgASSERT( m_vVertices.isValid(vID) );
+  if ( ! (m_nVertexAttributes & VertexNormals) )
+    EnableVertexAttributes( VertexNormals );		// not thread-safe, see EnableVertexAttributes()
+  m_vNormals[vID] = vNormal;
+  OnVertexMoved(vID);
 }
 
 
@@ -348,14 +515,13 @@ inline void VFTriangleMesh::GetVertex( IMesh::VertexID vID, Wml::Vector3f & vVer
   const Vertex & v = m_vVertices[vID];
   vVertex = v.vVertex;
   if ( pNormal )
-    *pNormal = v.vNormal;
+    *pNormal = (m_nVertexAttributes & VertexNormals) ? m_vNormals[vID] : Wml::Vector3f::UNIT_Z;
 }
 
 inline void VFTriangleMesh::GetNormal( IMesh::VertexID vID, Wml::Vector3f & vNormal ) const
 { 
   assert(m_vVertices.isValid(vID));
-  const Vertex & v = m_vVertices[vID];
-  vNormal = v.vNormal;
+  vNormal = (m_nVertexAttributes & VertexNormals) ? m_vNormals[vID] : Wml::Vector3f::UNIT_Z;
 }
 
 
@@ -366,7 +532,7 @@ inline const Wml::Vector3f & VFTriangleMesh::GetVertex( VertexID vID ) const
 }
 inline const Wml::Vector3f & VFTriangleMesh::GetNormal( VertexID vID ) const
 {
-  return m_vVertices[vID].vNormal;
+  return (m_nVertexAttributes & VertexNormals) ? m_vNormals[vID] : Wml::Vector3f::UNIT_Z;
 }
 
 inline unsigned int VFTriangleMesh::GetVertexCount() const
@@ -557,14 +723,57 @@ inline void VFTriangleMesh::ClearEdgeList( VertexID nVertID )
 inline void VFTriangleMesh::GetColor( VertexID vID, Wml::ColorRGBA & cColor ) const
 {
   lgASSERT( m_vVertices.isValid(vID) );
-  VertexData & v = * m_vVertices[vID].pData;
-  cColor = v.vColor;
+  if ( m_nVertexAttributes & VertexColors )
+    cColor = m_vColors[vID];
+  else if ( m_nVertexAttributes & VertexColors8 )
+    cColor = UnpackColor8( m_vColors8[vID] );
+  else
+    cColor = Wml::ColorRGBA();
 }
 inline void VFTriangleMesh::SetColor( VertexID vID, const Wml::ColorRGBA & cColor )
 {
   lgASSERT( m_vVertices.isValid(vID) );
-  VertexData & v = * m_vVertices[vID].pData;
-  v.vColor = cColor;
+  if ( m_nVertexAttributes & VertexColors8 )
+    m_vColors8[vID] = PackColor8(cColor);
+  else {
+    if ( ! (m_nVertexAttributes & VertexColors) )
+      EnableVertexAttributes( VertexColors );		// not thread-safe
+    m_vColors[vID] = cColor;
+  }
+}
+
+inline unsigned int VFTriangleMesh::PackColor8( const Wml::ColorRGBA & c )
+{
+  unsigned int nColor = 0;
+  for ( int k = 0; k < 4; ++k ) {
+    float f = ( c[k] < 0.0f ) ? 0.0f : ( ( c[k] > 1.0f ) ? 1.0f : c[k] );
+    nColor |= (unsigned int)(f * 255.0f + 0.5f) << (8*k);
+  }
+  return nColor;
+}
+inline Wml::ColorRGBA VFTriangleMesh::UnpackColor8( unsigned int nColor )
+{
+  const float fScale = 1.0f / 255.0f;
+  return Wml::ColorRGBA( (float)(nColor & 0xFF) * fScale, (float)((nColor >> 8) & 0xFF) * fScale,
+                         (float)((nColor >> 16) & 0xFF) * fScale, (float)(nColor >> 24) * fScale );
+}
+
+
+inline void VFTriangleMesh::SetLayerValue( unsigned int nLayer, VertexID vID, const float * pValues )
+{
+  lgASSERT( m_vVertices.isValid(vID) && nLayer < m_vUserLayers.size() );
+  VertexLayer & layer = m_vUserLayers[nLayer];
+  unsigned int nBase = vID * layer.nComponents;
+  for ( unsigned int k = 0; k < layer.nComponents; ++k )
+    layer.vValues[nBase+k] = pValues[k];
+}
+inline void VFTriangleMesh::GetLayerValue( unsigned int nLayer, VertexID vID, float * pValues ) const
+{
+  lgASSERT( m_vVertices.isValid(vID) && nLayer < m_vUserLayers.size() );
+  const VertexLayer & layer = m_vUserLayers[nLayer];
+  unsigned int nBase = vID * layer.nComponents;
+  for ( unsigned int k = 0; k < layer.nComponents; ++k )
+    pValues[k] = layer.vValues[nBase+k];
 }
 
 
@@ -572,18 +781,22 @@ inline void VFTriangleMesh::SetColor( VertexID vID, const Wml::ColorRGBA & cColo
 inline void VFTriangleMesh::ClearBit( VertexID vID, unsigned int nBit )
 {
   lgASSERT( m_vVertices.isValid(vID) );
-  m_vVertices[vID].nBits &= ~(1<<nBit);
+  if ( m_nVertexAttributes & VertexBits )
+    m_vBits[vID] &= ~(1<<nBit);
 }
 
 inline void VFTriangleMesh::SetBit( VertexID vID, unsigned int nBit )
 {
   lgASSERT( m_vVertices.isValid(vID) );
-  m_vVertices[vID].nBits |= (1<<nBit);
+  if ( ! (m_nVertexAttributes & VertexBits) )
+    EnableVertexAttributes( VertexBits );		// not thread-safe
+  m_vBits[vID] |= (1<<nBit);
 }
 
 inline bool VFTriangleMesh::GetBit( VertexID vID, unsigned int nBit )
 {
-  return ( m_vVertices[vID].nBits & (1<<nBit) ) != 0;
+  const ChunkedArray<unsigned int> & vBits = m_vBits;
+  return (m_nVertexAttributes & VertexBits) && ( vBits[vID] & (1<<nBit) ) != 0;
 }
 
 
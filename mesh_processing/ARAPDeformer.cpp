@@ -0,0 +1,363 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "ARAPDeformer.h"
+#include "MeshUtils.h"
+#include "SymmetricEigen3.h"
+#include <SparseLinearSystem.h>
+#include <Solver_TAUCS.h>
+
+#include "rmsdebug.h"
+
+#include <algorithm>
+
+
+using namespace rms;
+
+
+ARAPDeformer::ARAPDeformer()
+{
+	m_pMesh = NULL;
+	m_nIterations = 4;
+	m_bSystemValid = false;
+	m_pSystem = NULL;
+	m_pSolver = NULL;
+}
+
+ARAPDeformer::~ARAPDeformer()
+{
+	delete m_pSolver;
+	delete m_pSystem;
+}
+
+
+gsi::Solver_TAUCS * ARAPDeformer::GetSolver()
+{
+	if ( m_pSolver == NULL )
+		m_pSolver = new gsi::Solver_TAUCS(GetSystem());
+	return m_pSolver;
+}
+
+
+gsi::SparseLinearSystem * ARAPDeformer::GetSystem()
+{
+	if ( m_pSystem == NULL )
+		m_pSystem = new gsi::SparseLinearSystem();
+	return m_pSystem;
+}
+
+
+
+void ARAPDeformer::SetMesh(rms::VFTriangleMesh * pMesh)
+{
+	m_pMesh = pMesh;
+	m_vConstrained.resize(0);
+	m_vTargets.resize(0);
+	m_vConstraintIndex.resize(0);
+	m_vConstraintIndex.resize( m_pMesh->GetMaxVertexID(), -1 );
+	ComputeWeights();
+	ResetWarmStart();
+	m_bSystemValid = false;
+}
+
+
+void ARAPDeformer::ResetWarmStart()
+{
+	m_vPositions = m_vRestPositions;
+	m_vRotations.resize(0);
+	m_vRotations.resize( m_vRestPositions.size(), Wml::Matrix3f::IDENTITY );
+}
+
+
+void ARAPDeformer::AddBoundaryConstraints(float fWeight)
+{
+	VFTriangleMesh::vertex_iterator curv(m_pMesh->BeginVertices()), endv(m_pMesh->EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv++;
+		if ( m_pMesh->IsBoundaryVertex(vID) ) {
+			Wml::Vector3f v;
+			m_pMesh->GetVertex(vID, v);
+			UpdatePositionConstraint(vID, v, fWeight);
+		}
+	}
+}
+
+
+void ARAPDeformer::ClearConstraints()
+{
+	for ( unsigned int k = 0; k < m_vConstrained.size(); ++k )
+		m_vConstraintIndex[ m_vConstrained[k] ] = -1;
+	if ( ! m_vConstrained.empty() )
+		m_bSystemValid = false;
+	m_vConstrained.resize(0);
+	m_vTargets.resize(0);
+}
+
+
+void ARAPDeformer::UpdatePositionConstraint( IMesh::VertexID vID, const Wml::Vector3f & vPosition, float fWeight )
+{
+	int nIndex = m_vConstraintIndex[vID];
+	if ( fWeight <= 0 ) {
+		if ( nIndex >= 0 ) {
+			// remove (swap with last)
+			IMesh::VertexID vLast = m_vConstrained.back();
+			m_vConstrained[nIndex] = vLast;
+			m_vTargets[nIndex] = m_vTargets.back();
+			m_vConstraintIndex[vLast] = nIndex;
+			m_vConstrained.pop_back();
+			m_vTargets.pop_back();
+			m_vConstraintIndex[vID] = -1;
+			m_bSystemValid = false;
+		}
+		return;
+	}
+	if ( nIndex < 0 ) {
+		m_vConstraintIndex[vID] = (int)m_vConstrained.size();
+		m_vConstrained.push_back(vID);
+		m_vTargets.push_back(vPosition);
+		m_bSystemValid = false;
+	} else
+		m_vTargets[nIndex] = vPosition;
+}
+
+
+
+rms::Frame3f ARAPDeformer::GetCurrentFrame( IMesh::VertexID vID )
+{
+	const Wml::Matrix3f & R = m_vRotations[vID];
+	Wml::Vector3f vNormal( R * m_vRestNormals[vID] );
+	Wml::Vector3f vTangent( Wml::Vector3f::UNIT_X );
+	if ( m_vNbrStart[vID+1] > m_vNbrStart[vID] )
+		vTangent = m_vRestPositions[ m_vNbrs[m_vNbrStart[vID]] ] - m_vRestPositions[vID];
+	vTangent = R * vTangent;
+	vTangent -= vTangent.Dot(vNormal) * vNormal;
+	vTangent.Normalize();
+
+	rms::Frame3f vFrame(m_vPositions[vID]);
+	vFrame.SetFrame( vTangent, vNormal.Cross(vTangent), vNormal );
+	return vFrame;
+}
+
+
+
+void ARAPDeformer::ComputeWeights()
+{
+	unsigned int nVerts = m_pMesh->GetMaxVertexID();
+	m_vRestPositions.resize(nVerts);
+	m_vRestNormals.resize(nVerts);
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		if ( m_pMesh->IsVertex(i) )
+			m_pMesh->GetVertex(i, m_vRestPositions[i], &m_vRestNormals[i]);
+		else
+			m_vRestPositions[i] = m_vRestNormals[i] = Wml::Vector3f::ZERO;
+	}
+
+	// symmetric cotangent weights, 0.5 * (cot(alpha) + cot(beta)), accumulated per triangle
+	std::vector< std::vector<IMesh::VertexID> > vNbrs(nVerts);
+	std::vector< std::vector<float> > vWeights(nVerts);
+	VFTriangleMesh::triangle_iterator curt(m_pMesh->BeginTriangles()), endt(m_pMesh->EndTriangles());
+	while ( curt != endt ) {
+		IMesh::VertexID vTri[3];
+		m_pMesh->GetTriangle(*curt, vTri);
+		++curt;
+		for ( int k = 0; k < 3; ++k ) {
+			IMesh::VertexID a = vTri[(k+1)%3], b = vTri[(k+2)%3];
+			Wml::Vector3f e1( m_vRestPositions[a] - m_vRestPositions[vTri[k]] ), e2( m_vRestPositions[b] - m_vRestPositions[vTri[k]] );
+			float fSin = e1.Cross(e2).Length();
+			float fCot = ( fSin > 1e-12f ) ? e1.Dot(e2) / fSin : 0.0f;
+			for ( int j = 0; j < 2; ++j ) {
+				IMesh::VertexID u = (j == 0) ? a : b, v = (j == 0) ? b : a;
+				std::vector<IMesh::VertexID>::iterator found = std::find( vNbrs[u].begin(), vNbrs[u].end(), v );
+				if ( found == vNbrs[u].end() ) {
+					vNbrs[u].push_back(v);
+					vWeights[u].push_back( 0.5f * fCot );
+				} else
+					vWeights[u][ found - vNbrs[u].begin() ] += 0.5f * fCot;
+			}
+		}
+	}
+
+	// flatten. Negative weights (obtuse pairs) are clamped, so the system stays positive definite
+	m_vNbrStart.resize(nVerts+1);
+	m_vNbrs.resize(0);
+	m_vNbrWeights.resize(0);
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		m_vNbrStart[i] = (unsigned int)m_vNbrs.size();
+		for ( unsigned int k = 0; k < vNbrs[i].size(); ++k ) {
+			m_vNbrs.push_back( vNbrs[i][k] );
+			m_vNbrWeights.push_back( std::max( vWeights[i][k], 1e-4f ) );
+		}
+	}
+	m_vNbrStart[nVerts] = (unsigned int)m_vNbrs.size();
+}
+
+
+
+void ARAPDeformer::UpdateSystem()
+{
+	unsigned int nVerts = (unsigned int)m_vRestPositions.size();
+	m_vRow.resize(0);
+	m_vRow.resize(nVerts, -1);
+	m_vFree.resize(0);
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		if ( m_pMesh->IsVertex(i) && m_vConstraintIndex[i] < 0 ) {
+			m_vRow[i] = (int)m_vFree.size();
+			m_vFree.push_back(i);
+		}
+	}
+	unsigned int nFree = (unsigned int)m_vFree.size();
+
+	gsi::SparseLinearSystem * pSystem = GetSystem();
+	pSystem->Resize(nFree, nFree);
+	pSystem->ResizeRHS(3);
+	for ( unsigned int ri = 0; ri < nFree; ++ri ) {
+		IMesh::VertexID i = m_vFree[ri];
+		double dSum = 0;
+		for ( unsigned int k = m_vNbrStart[i]; k < m_vNbrStart[i+1]; ++k ) {
+			dSum += m_vNbrWeights[k];
+			int rj = m_vRow[ m_vNbrs[k] ];
+			if ( rj >= 0 )
+				pSystem->Set(ri, rj, -m_vNbrWeights[k]);
+		}
+		pSystem->Set(ri, ri, (dSum > 0) ? dSum : 1.0);
+	}
+
+	GetSolver()->OnMatrixChanged();
+	GetSolver()->SetStoreFactorization(true);
+	GetSolver()->SetSolverMode( gsi::Solver_TAUCS::TAUCS_LLT );
+	GetSolver()->SetOrderingMode( gsi::Solver_TAUCS::TAUCS_METIS );
+
+	m_bSystemValid = true;
+}
+
+
+
+void ARAPDeformer::FitRotation( const double S[3][3], Wml::Matrix3f & R )
+{
+	// S = U Sigma V^T, R = V U^T. V from the eigenvectors of S^T S, U = S V / Sigma
+	double A[6];
+	A[0] = S[0][0]*S[0][0] + S[1][0]*S[1][0] + S[2][0]*S[2][0];
+	A[1] = S[0][0]*S[0][1] + S[1][0]*S[1][1] + S[2][0]*S[2][1];
+	A[2] = S[0][0]*S[0][2] + S[1][0]*S[1][2] + S[2][0]*S[2][2];
+	A[3] = S[0][1]*S[0][1] + S[1][1]*S[1][1] + S[2][1]*S[2][1];
+	A[4] = S[0][1]*S[0][2] + S[1][1]*S[1][2] + S[2][1]*S[2][2];
+	A[5] = S[0][2]*S[0][2] + S[1][2]*S[1][2] + S[2][2]*S[2][2];
+	double fEval[3];
+	Wml::Vector3d v[3];
+	SymmetricEigen3<double>( A, fEval, v );
+
+	Wml::Vector3d u[3];
+	for ( int j = 1; j < 3; ++j )
+		u[j] = Wml::Vector3d( S[0][0]*v[j][0] + S[0][1]*v[j][1] + S[0][2]*v[j][2],
+							  S[1][0]*v[j][0] + S[1][1]*v[j][1] + S[1][2]*v[j][2],
+							  S[2][0]*v[j][0] + S[2][1]*v[j][1] + S[2][2]*v[j][2] );
+	if ( u[2].Normalize() < 1e-20 ) {
+		R = Wml::Matrix3f::IDENTITY;
+		return;
+	}
+	// rank < 3 is common (flat one-rings), so u0 is always the cross product,
+	//  and u1 is made up if the neighbourhood is (nearly) a line
+	u[1] -= u[1].Dot(u[2]) * u[2];
+	if ( u[1].Normalize() < 1e-10 ) {
+		u[1] = ( fabs(u[2][0]) < 0.9 ) ? Wml::Vector3d::UNIT_X : Wml::Vector3d::UNIT_Y;
+		u[1] -= u[1].Dot(u[2]) * u[2];
+		u[1].Normalize();
+	}
+	u[0] = u[1].Cross(u[2]);
+
+	// det(U) = 1, so flipping v0 if det(V) < 0 gives the closest rotation (not reflection)
+	if ( v[0].Dot( v[1].Cross(v[2]) ) < 0 )
+		v[0] = -v[0];
+
+	for ( int r = 0; r < 3; ++r )
+		for ( int c = 0; c < 3; ++c )
+			R[r][c] = (float)( v[0][r]*u[0][c] + v[1][r]*u[1][c] + v[2][r]*u[2][c] );
+}
+
+
+void ARAPDeformer::UpdateRotations()
+{
+	int nVerts = (int)m_vRestPositions.size();
+	#pragma omp parallel for schedule(dynamic,1024)
+	for ( int i = 0; i < nVerts; ++i ) {
+		if ( m_vNbrStart[i+1] == m_vNbrStart[i] )
+			continue;
+		double S[3][3] = { {0,0,0}, {0,0,0}, {0,0,0} };
+		for ( unsigned int k = m_vNbrStart[i]; k < m_vNbrStart[i+1]; ++k ) {
+			IMesh::VertexID j = m_vNbrs[k];
+			Wml::Vector3f e( m_vRestPositions[i] - m_vRestPositions[j] );
+			Wml::Vector3f ePrime( m_vPositions[i] - m_vPositions[j] );
+			double w = m_vNbrWeights[k];
+			for ( int r = 0; r < 3; ++r )
+				for ( int c = 0; c < 3; ++c )
+					S[r][c] += w * e[r] * ePrime[c];
+		}
+		FitRotation( S, m_vRotations[i] );
+	}
+}
+
+
+bool ARAPDeformer::UpdatePositions()
+{
+	unsigned int nFree = (unsigned int)m_vFree.size();
+	if ( nFree == 0 )
+		return true;
+
+	// b_i = sum_j w_ij/2 (R_i + R_j)(p_i - p_j), plus constrained neighbours moved to the RHS
+	std::vector<Wml::Vector3f> vRHS(nFree);
+	#pragma omp parallel for schedule(dynamic,1024)
+	for ( int ri = 0; ri < (int)nFree; ++ri ) {
+		IMesh::VertexID i = m_vFree[ri];
+		Wml::Vector3f b( Wml::Vector3f::ZERO );
+		for ( unsigned int k = m_vNbrStart[i]; k < m_vNbrStart[i+1]; ++k ) {
+			IMesh::VertexID j = m_vNbrs[k];
+			float w = m_vNbrWeights[k];
+			Wml::Vector3f e( m_vRestPositions[i] - m_vRestPositions[j] );
+			b += (0.5f * w) * ( m_vRotations[i] * e + m_vRotations[j] * e );
+			int nCons = m_vConstraintIndex[j];
+			if ( nCons >= 0 )
+				b += w * m_vTargets[nCons];
+		}
+		vRHS[ri] = b;
+	}
+
+	gsi::SparseLinearSystem * pSystem = GetSystem();
+	for ( unsigned int ri = 0; ri < nFree; ++ri )
+		for ( int k = 0; k < 3; ++k )
+			pSystem->SetRHS( ri, vRHS[ri][k], k );
+
+	if ( ! GetSolver()->Solve() )
+		return false;
+
+	for ( unsigned int ri = 0; ri < nFree; ++ri )
+		m_vPositions[ m_vFree[ri] ] = Wml::Vector3f( (float)pSystem->GetSolution(ri,0), (float)pSystem->GetSolution(ri,1), (float)pSystem->GetSolution(ri,2) );
+	return true;
+}
+
+
+
+void ARAPDeformer::Solve()
+{
+	if ( m_pMesh == NULL || m_vConstrained.empty() )
+		return;
+	if ( ! m_bSystemValid )
+		UpdateSystem();
+
+	// warm start: previous result, with the handles moved
+	for ( unsigned int k = 0; k < m_vConstrained.size(); ++k )
+		m_vPositions[ m_vConstrained[k] ] = m_vTargets[k];
+
+	for ( int nIter = 0; nIter < m_nIterations; ++nIter ) {
+		UpdateRotations();
+		if ( ! UpdatePositions() ) {
+			lgBreakToDebugger();
+			break;
+		}
+	}
+
+	unsigned int nVerts = (unsigned int)m_vPositions.size();
+	for ( unsigned int i = 0; i < nVerts; ++i )
+		if ( m_pMesh->IsVertex(i) )
+			m_pMesh->SetVertex(i, m_vPositions[i]);
+}
@@ -0,0 +1,106 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include "IDeformer.h"
+#include <VFTriangleMesh.h>
+#include <Wm4Matrix3.h>
+
+
+// predecl to avoid include
+namespace gsi {
+	class SparseLinearSystem;
+	class Solver_TAUCS;
+};
+
+
+namespace rms {
+
+/*
+ * As-rigid-as-possible surface deformation [Sorkine & Alexa 07].
+ *
+ * Position constraints are hard (fWeight is ignored, except that fWeight <= 0 removes the constraint).
+ * The cotangent system with the constrained vertices eliminated is factored when the set of
+ * constrained vertices changes, and re-used for every iteration and every frame after that, so moving
+ * handles only costs the local/global iterations (parallel rotation fits + back-substitution).
+ *
+ * Each Solve() starts from the previous result (with the handles moved), so a few iterations
+ * per frame are enough during interactive dragging. Call ResetWarmStart() to restart from the rest pose.
+ * The rest pose is the mesh at SetMesh().
+ */
+class ARAPDeformer : public IMeshDeformer
+{
+public:
+	ARAPDeformer();
+	virtual ~ARAPDeformer();
+
+	virtual void SetMesh(rms::VFTriangleMesh * pMesh);
+
+	virtual void AddBoundaryConstraints(float fWeight = 1.0f);
+
+	virtual void ClearConstraints();
+
+	virtual void UpdatePositionConstraint( IMesh::VertexID vID, const Wml::Vector3f & vPosition, float fWeight );
+
+	virtual void UpdateOrientationConstraint( IMesh::VertexID vID, const rms::Frame3f & vFrame, float fWeight )
+		{ }		// no orientation constraint support...
+
+	//! rest frame (tangent towards first neighbour, normal) rotated by the current vertex rotation
+	virtual rms::Frame3f GetCurrentFrame( IMesh::VertexID vID );
+
+	virtual void Solve();
+
+	//! local/global iterations per Solve() (default 4)
+	void SetIterations( int nIterations ) { m_nIterations = nIterations; }
+	int GetIterations() const { return m_nIterations; }
+
+	void ResetWarmStart();
+
+	bool HasFactorization() const { return m_bSystemValid; }
+
+protected:
+	rms::VFTriangleMesh * m_pMesh;
+	int m_nIterations;
+
+	// rest pose, with neighbours and cotangent weights in CSR form
+	std::vector<Wml::Vector3f> m_vRestPositions;
+	std::vector<Wml::Vector3f> m_vRestNormals;
+	std::vector<unsigned int> m_vNbrStart;
+	std::vector<IMesh::VertexID> m_vNbrs;
+	std::vector<float> m_vNbrWeights;
+	void ComputeWeights();
+
+	// current solution
+	std::vector<Wml::Vector3f> m_vPositions;
+	std::vector<Wml::Matrix3f> m_vRotations;
+
+	std::vector<int> m_vConstraintIndex;
+	std::vector<IMesh::VertexID> m_vConstrained;
+	std::vector<Wml::Vector3f> m_vTargets;
+
+	// factored system over the unconstrained vertices
+	bool m_bSystemValid;
+	std::vector<int> m_vRow;
+	std::vector<IMesh::VertexID> m_vFree;
+
+	gsi::SparseLinearSystem * m_pSystem;
+	gsi::SparseLinearSystem * GetSystem();
+
+	gsi::Solver_TAUCS * m_pSolver;
+	gsi::Solver_TAUCS * GetSolver();
+
+	void UpdateSystem();
+	void UpdateRotations();
+	bool UpdatePositions();
+
+	//! rotation R minimizing sum w |R e - e'|^2, from S = sum w e e'^T
+	static void FitRotation( const double S[3][3], Wml::Matrix3f & R );
+};
+
+
+
+}   // end namespace rms
@@ -0,0 +1,639 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "Delaunay2.h"
+#include "ExactPredicates.h"
+#include "SpatialSort.h"
+#include "BitSet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace rms;
+
+
+Delaunay2::Delaunay2()
+{
+	m_nParallelThreshold = 1 << 18;
+	m_nDimension = -1;
+	m_nMark = 0;
+	m_nLast = NoTriangle;
+	m_nRandom = 0;
+}
+
+
+bool Delaunay2::Compute( const std::vector<Wml::Vector2d> & vPoints )
+{
+	m_vPoints.resize( 2*vPoints.size() );
+	for ( unsigned int i = 0; i < vPoints.size(); ++i ) {
+		m_vPoints[2*i] = vPoints[i].X();
+		m_vPoints[2*i+1] = vPoints[i].Y();
+	}
+	return Run();
+}
+
+bool Delaunay2::Compute( const std::vector<Wml::Vector2f> & vPoints )
+{
+	m_vPoints.resize( 2*vPoints.size() );
+	for ( unsigned int i = 0; i < vPoints.size(); ++i ) {
+		m_vPoints[2*i] = vPoints[i].X();
+		m_vPoints[2*i+1] = vPoints[i].Y();
+	}
+	return Run();
+}
+
+bool Delaunay2::Compute( const double * pPoints, unsigned int nCount )
+{
+	m_vPoints.assign( pPoints, pPoints + 2*nCount );
+	return Run();
+}
+
+
+void Delaunay2::Clear()
+{
+	m_vTriangles.resize(0);
+	m_vNeighbours.resize(0);
+	m_vTris.resize(0);
+	m_vFreeTris.resize(0);
+	m_nMark = 0;
+	m_nLast = NoTriangle;
+	m_nRandom = 0;
+	m_nDimension = -1;
+}
+
+
+unsigned int Delaunay2::NewTriangle( unsigned int a, unsigned int b, unsigned int c )
+{
+	unsigned int nTri;
+	if ( ! m_vFreeTris.empty() ) {
+		nTri = m_vFreeTris.back();
+		m_vFreeTris.pop_back();
+	} else {
+		nTri = (unsigned int)m_vTris.size();
+		m_vTris.resize( nTri+1 );
+	}
+	Triangle & t = m_vTris[nTri];
+	t.v[0] = a;  t.v[1] = b;  t.v[2] = c;
+	t.n[0] = t.n[1] = t.n[2] = NoTriangle;
+	t.nMark = 0;
+	return nTri;
+}
+
+
+bool Delaunay2::Run()
+{
+	Clear();
+	unsigned int nCount = (unsigned int)m_vPoints.size() / 2;
+	m_vVertexMap.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		m_vVertexMap[i] = i;
+	if ( nCount == 0 )
+		return false;
+	if ( nCount >= m_nParallelThreshold && RunPartitioned() )
+		return true;
+
+	std::vector<unsigned int> vOrder;
+	BRIOOrder( &m_vPoints[0], nCount, 2, vOrder );
+
+	// initial triangle from first non-collinear points in insertion order
+	unsigned int nA = vOrder[0], iB = 1;
+	while ( iB < nCount && P(vOrder[iB])[0] == P(nA)[0] && P(vOrder[iB])[1] == P(nA)[1] )
+		++iB;
+	if ( iB == nCount ) {
+		m_nDimension = 0;
+		return false;
+	}
+	unsigned int nB = vOrder[iB], iC = iB+1;
+	while ( iC < nCount && Orient2D( P(nA), P(nB), P(vOrder[iC]) ) == 0 )
+		++iC;
+	if ( iC == nCount ) {
+		m_nDimension = 1;
+		return false;
+	}
+	unsigned int nC = vOrder[iC];
+	if ( Orient2D( P(nA), P(nB), P(nC) ) < 0 )
+		std::swap(nB, nC);
+	vOrder.erase( vOrder.begin() + iC );
+	vOrder.erase( vOrder.begin() + iB );
+	vOrder.erase( vOrder.begin() );
+
+	// real triangle, plus a ghost across each edge. Ghost i is (b,a,Infinite) for edge (a,b) = (v[i+1],v[i+2])
+	unsigned int nReal = NewTriangle( nA, nB, nC );
+	unsigned int nGhost[3];
+	for ( int i = 0; i < 3; ++i ) {
+		const Triangle & t = m_vTris[nReal];
+		nGhost[i] = NewTriangle( t.v[(i+2)%3], t.v[(i+1)%3], Infinite );
+		m_vTris[nReal].n[i] = nGhost[i];
+		m_vTris[nGhost[i]].n[2] = nReal;
+	}
+	// ghost i = (v[i+2], v[i+1], Inf). Its edge (v[i+1],Inf) (opposite slot 0) is shared with ghost i+2,
+	// which is (v[i+1], v[i], Inf), across its edge (Inf,v[i+1]) (opposite slot 1)
+	for ( int i = 0; i < 3; ++i ) {
+		m_vTris[nGhost[i]].n[0] = nGhost[(i+2)%3];
+		m_vTris[nGhost[(i+2)%3]].n[1] = nGhost[i];
+	}
+	m_nLast = nReal;
+
+	for ( unsigned int i = 0; i < vOrder.size(); ++i )
+		Insert( vOrder[i] );
+
+	m_nDimension = 2;
+	Extract();
+	return true;
+}
+
+
+// true if the circumcircle of a,b,c is strictly inside the open box. Conservative: the circumcenter is
+// computed in floating point, and its error bound (which grows as the triangle flattens) counts as outside
+static bool CircleInsideBox( const double * a, const double * b, const double * c, const double * fMin, const double * fMax )
+{
+	double bx = b[0]-a[0], by = b[1]-a[1], cx = c[0]-a[0], cy = c[1]-a[1];
+	double fDet = 2 * ( bx*cy - by*cx );
+	if ( fDet == 0 )
+		return false;
+	double fB = bx*bx + by*by, fC = cx*cx + cy*cy;
+	double ux = (cy*fB - by*fC) / fDet, uy = (bx*fC - cx*fB) / fDet;
+	double fRadius = sqrt( ux*ux + uy*uy );
+	double fLengths = sqrt(fB) * sqrt(fC);
+	double fError = 64 * DBL_EPSILON * ( (sqrt(fB) + sqrt(fC) + fRadius) * fLengths / fabs(fDet)
+										+ fRadius + fabs(a[0]) + fabs(a[1]) );
+	double vCenter[2] = { a[0] + ux, a[1] + uy };
+	for ( int k = 0; k < 2; ++k )
+		if ( vCenter[k] - fRadius - fError <= fMin[k] || vCenter[k] + fRadius + fError >= fMax[k] )
+			return false;
+	return true;
+}
+
+
+// edge of a final region triangle whose neighbour is not final. The merge triangulation must have
+// it too, with the triangle on the other side (or the hull) as the neighbour
+struct Delaunay2Border {
+	unsigned long long nKey;	// sorted vertices
+	bool bReversed;				// edge runs from the larger to the smaller vertex in the final triangle
+	unsigned int nTri;			// output index of final triangle
+	int nOther;					// merge triangle on the other side, -1 on the hull
+	int nMatches;
+	bool operator<( const Delaunay2Border & b ) const { return nKey < b.nKey; }
+};
+
+static unsigned long long EdgeKey( unsigned int a, unsigned int b )
+{
+	return ( a < b ) ? ( ((unsigned long long)a << 32) | b ) : ( ((unsigned long long)b << 32) | a );
+}
+
+static Delaunay2Border * FindBorder( std::vector<Delaunay2Border> & vBorders, unsigned long long nKey )
+{
+	Delaunay2Border key;
+	key.nKey = nKey;
+	std::vector<Delaunay2Border>::iterator found = std::lower_bound( vBorders.begin(), vBorders.end(), key );
+	return ( found != vBorders.end() && found->nKey == nKey ) ? &(*found) : NULL;
+}
+
+
+bool Delaunay2::RunPartitioned()
+{
+	unsigned int nCount = (unsigned int)m_vPoints.size() / 2;
+	std::vector<SpatialRegion> vRegions;
+	PartitionPoints( &m_vPoints[0], nCount, 2, m_nParallelThreshold / 2, vRegions );
+	int nRegions = (int)vRegions.size();
+	if ( nRegions < 2 )
+		return false;
+
+	// triangulate regions, and find final triangles. Points of the others go into the merge
+	std::vector<Delaunay2> vRegionTris( nRegions );
+	std::vector< std::vector<unsigned char> > vFinal( nRegions );
+	std::vector<unsigned char> vInMerge( nCount, 0 );
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int r = 0; r < nRegions; ++r ) {
+		const SpatialRegion & region = vRegions[r];
+		unsigned int nPoints = (unsigned int)region.vPoints.size();
+		std::vector<double> vPoints( 2*nPoints );
+		for ( unsigned int i = 0; i < nPoints; ++i ) {
+			vPoints[2*i] = P(region.vPoints[i])[0];
+			vPoints[2*i+1] = P(region.vPoints[i])[1];
+		}
+		Delaunay2 & d = vRegionTris[r];
+		d.SetParallelThreshold( 0xFFFFFFFF );
+		if ( ! d.Compute( &vPoints[0], nPoints ) )
+			continue;
+
+		const std::vector<unsigned int> & vTris = d.GetTriangles();
+		const std::vector<int> & vNbrs = d.GetNeighbours();
+		unsigned int nTris = d.GetTriangleCount();
+		std::vector<unsigned char> & vIsFinal = vFinal[r];
+		vIsFinal.resize( nTris );
+		std::vector<unsigned int> vStack;
+		for ( unsigned int t = 0; t < nTris; ++t ) {
+			vIsFinal[t] = CircleInsideBox( d.P(vTris[3*t]), d.P(vTris[3*t+1]), d.P(vTris[3*t+2]), region.fMin, region.fMax );
+			if ( ! vIsFinal[t] )
+				vStack.push_back(t);
+		}
+		// a cocircular neighbour of a rejected triangle is rejected too, so whole Delaunay cells go into the merge
+		while ( ! vStack.empty() ) {
+			unsigned int t = vStack.back();
+			vStack.pop_back();
+			for ( int j = 0; j < 3; ++j ) {
+				int n = vNbrs[3*t+j];
+				if ( n < 0 || ! vIsFinal[n] )
+					continue;
+				unsigned int nOpposite = vTris[3*n] + vTris[3*n+1] + vTris[3*n+2] - vTris[3*t+(j+1)%3] - vTris[3*t+(j+2)%3];
+				if ( InCircle( d.P(vTris[3*t]), d.P(vTris[3*t+1]), d.P(vTris[3*t+2]), d.P(nOpposite) ) == 0 ) {
+					vIsFinal[n] = 0;
+					vStack.push_back(n);
+				}
+			}
+		}
+		for ( unsigned int t = 0; t < nTris; ++t ) {
+			for ( int j = 0; j < 3; ++j ) {
+				if ( ! vIsFinal[t] )
+					vInMerge[ region.vPoints[ vTris[3*t+j] ] ] = 1;
+				else if ( vNbrs[3*t+j] < 0 ) {
+					vInMerge[ region.vPoints[ vTris[3*t+(j+1)%3] ] ] = 1;
+					vInMerge[ region.vPoints[ vTris[3*t+(j+2)%3] ] ] = 1;
+				}
+			}
+		}
+	}
+	for ( int r = 0; r < nRegions; ++r )
+		if ( vRegionTris[r].GetDimension() != 2 )
+			return false;
+
+	// output indices of final triangles, and their border edges
+	std::vector< std::vector<int> > vFinalIndex( nRegions );
+	unsigned int nFinal = 0;
+	for ( int r = 0; r < nRegions; ++r ) {
+		vFinalIndex[r].resize( vFinal[r].size(), -1 );
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t )
+			if ( vFinal[r][t] )
+				vFinalIndex[r][t] = (int)nFinal++;
+	}
+	std::vector<Delaunay2Border> vBorders;
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vTris = vRegionTris[r].GetTriangles();
+		const std::vector<int> & vNbrs = vRegionTris[r].GetNeighbours();
+		const std::vector<unsigned int> & vRegionPoints = vRegions[r].vPoints;
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t ) {
+			for ( int j = 0; j < 3 && vFinal[r][t]; ++j ) {
+				int n = vNbrs[3*t+j];
+				if ( n >= 0 && vFinal[r][n] )
+					continue;
+				unsigned int a = vRegionPoints[ vTris[3*t+(j+1)%3] ], b = vRegionPoints[ vTris[3*t+(j+2)%3] ];
+				Delaunay2Border border;
+				border.nKey = EdgeKey(a, b);
+				border.bReversed = ( a > b );
+				border.nTri = vFinalIndex[r][t];
+				border.nOther = -1;
+				border.nMatches = 0;
+				vBorders.push_back(border);
+			}
+		}
+	}
+	std::sort( vBorders.begin(), vBorders.end() );
+
+	// merge triangulation
+	std::vector<unsigned int> vMerge;
+	for ( unsigned int i = 0; i < nCount; ++i )
+		if ( vInMerge[i] )
+			vMerge.push_back(i);
+	unsigned int nMerge = (unsigned int)vMerge.size();
+	std::vector<double> vMergePoints( 2*nMerge );
+	for ( unsigned int i = 0; i < nMerge; ++i ) {
+		vMergePoints[2*i] = P(vMerge[i])[0];
+		vMergePoints[2*i+1] = P(vMerge[i])[1];
+	}
+	Delaunay2 merge;
+	merge.SetParallelThreshold( 0xFFFFFFFF );
+	if ( nMerge == 0 || ! merge.Compute( &vMergePoints[0], nMerge ) )
+		return false;
+	const std::vector<unsigned int> & vMergeTris = merge.GetTriangles();
+	const std::vector<int> & vMergeNbrs = merge.GetNeighbours();
+	unsigned int nMergeTris = merge.GetTriangleCount();
+
+	// merge triangles on the inner side of a border edge are kept (1), on the outer side they overlap final triangles (2)
+	std::vector<unsigned char> vSide( nMergeTris, vBorders.empty() ? 1 : 0 );
+	std::vector<Delaunay2Border *> vEdgeBorder( 3*nMergeTris, (Delaunay2Border *)NULL );
+	for ( unsigned int t = 0; t < nMergeTris; ++t ) {
+		for ( int j = 0; j < 3; ++j ) {
+			unsigned int a = vMerge[ vMergeTris[3*t+(j+1)%3] ], b = vMerge[ vMergeTris[3*t+(j+2)%3] ];
+			Delaunay2Border * pBorder = FindBorder( vBorders, EdgeKey(a, b) );
+			if ( pBorder == NULL )
+				continue;
+			vEdgeBorder[3*t+j] = pBorder;
+			if ( (a > b) == pBorder->bReversed ) {
+				vSide[t] |= 2;
+				if ( vMergeNbrs[3*t+j] < 0 )
+					pBorder->nMatches++;
+			} else {
+				vSide[t] |= 1;
+				pBorder->nOther = (int)t;
+				pBorder->nMatches++;
+			}
+		}
+	}
+	for ( unsigned int i = 0; i < vBorders.size(); ++i )
+		if ( vBorders[i].nMatches != 1 )
+			return false;
+
+	// flood the kept side from the border edges
+	std::vector<unsigned int> vStack;
+	for ( unsigned int t = 0; t < nMergeTris; ++t ) {
+		if ( vSide[t] == 3 )
+			return false;
+		if ( vSide[t] == 1 )
+			vStack.push_back(t);
+	}
+	while ( ! vStack.empty() ) {
+		unsigned int t = vStack.back();
+		vStack.pop_back();
+		for ( int j = 0; j < 3; ++j ) {
+			int n = vMergeNbrs[3*t+j];
+			if ( n < 0 || vEdgeBorder[3*t+j] != NULL || vSide[n] == 1 )
+				continue;
+			if ( vSide[n] != 0 )
+				return false;
+			vSide[n] = 1;
+			vStack.push_back(n);
+		}
+	}
+
+	// output: final region triangles, then kept merge triangles
+	std::vector<int> vMergeIndex( nMergeTris, -1 );
+	unsigned int nOut = nFinal;
+	for ( unsigned int t = 0; t < nMergeTris; ++t )
+		if ( vSide[t] == 1 )
+			vMergeIndex[t] = (int)nOut++;
+
+	m_vTriangles.resize( 3*nOut );
+	m_vNeighbours.resize( 3*nOut );
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vTris = vRegionTris[r].GetTriangles();
+		const std::vector<int> & vNbrs = vRegionTris[r].GetNeighbours();
+		const std::vector<unsigned int> & vRegionPoints = vRegions[r].vPoints;
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t ) {
+			int k = vFinalIndex[r][t];
+			if ( k < 0 )
+				continue;
+			for ( int j = 0; j < 3; ++j ) {
+				m_vTriangles[3*k+j] = vRegionPoints[ vTris[3*t+j] ];
+				int n = vNbrs[3*t+j];
+				if ( n >= 0 && vFinal[r][n] ) {
+					m_vNeighbours[3*k+j] = vFinalIndex[r][n];
+				} else {
+					unsigned int a = vRegionPoints[ vTris[3*t+(j+1)%3] ], b = vRegionPoints[ vTris[3*t+(j+2)%3] ];
+					int nOther = FindBorder( vBorders, EdgeKey(a, b) )->nOther;
+					m_vNeighbours[3*k+j] = ( nOther >= 0 ) ? vMergeIndex[nOther] : -1;
+				}
+			}
+		}
+	}
+	for ( unsigned int t = 0; t < nMergeTris; ++t ) {
+		int k = vMergeIndex[t];
+		if ( k < 0 )
+			continue;
+		for ( int j = 0; j < 3; ++j ) {
+			m_vTriangles[3*k+j] = vMerge[ vMergeTris[3*t+j] ];
+			int n = vMergeNbrs[3*t+j];
+			if ( vEdgeBorder[3*t+j] != NULL )
+				m_vNeighbours[3*k+j] = (int)vEdgeBorder[3*t+j]->nTri;
+			else
+				m_vNeighbours[3*k+j] = ( n >= 0 ) ? vMergeIndex[n] : -1;
+		}
+	}
+
+	// duplicates merged by the regions, then by the merge triangulation
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vMap = vRegionTris[r].GetVertexMap();
+		for ( unsigned int i = 0; i < vMap.size(); ++i )
+			m_vVertexMap[ vRegions[r].vPoints[i] ] = vRegions[r].vPoints[ vMap[i] ];
+	}
+	const std::vector<unsigned int> & vMergeMap = merge.GetVertexMap();
+	for ( unsigned int i = 0; i < nMerge; ++i )
+		m_vVertexMap[ vMerge[i] ] = vMerge[ vMergeMap[i] ];
+	for ( unsigned int i = 0; i < nCount; ++i )
+		m_vVertexMap[i] = m_vVertexMap[ m_vVertexMap[i] ];
+
+	m_nDimension = 2;
+	return true;
+}
+
+
+unsigned int Delaunay2::Locate( unsigned int nPoint )
+{
+	const double * p = P(nPoint);
+	unsigned int nTri = m_nLast;
+	if ( IsGhost(m_vTris[nTri]) )
+		nTri = m_vTris[nTri].n[2];
+
+	while ( true ) {
+		const Triangle & t = m_vTris[nTri];
+		if ( IsGhost(t) )
+			return nTri;
+
+		// stochastic walk: test edges starting at a random one, so the walk cannot cycle
+		m_nRandom = m_nRandom * 1664525u + 1013904223u;
+		int k0 = (int)( m_nRandom >> 30 ) % 3;
+		unsigned int nNext = NoTriangle;
+		for ( int j = 0; j < 3 && nNext == NoTriangle; ++j ) {
+			int i = (k0 + j) % 3;
+			if ( Orient2D( P(t.v[(i+1)%3]), P(t.v[(i+2)%3]), p ) < 0 )
+				nNext = t.n[i];
+		}
+		if ( nNext == NoTriangle )
+			return nTri;
+		nTri = nNext;
+	}
+}
+
+
+bool Delaunay2::InConflict( const Triangle & t, unsigned int nPoint ) const
+{
+	const double * p = P(nPoint);
+	if ( ! IsGhost(t) )
+		return InCircle( P(t.v[0]), P(t.v[1]), P(t.v[2]), p ) > 0;
+
+	// ghost (a,b,Inf) conflicts if p is strictly outside the hull edge (a,b),
+	// or on its line and strictly inside the segment
+	const double * a = P(t.v[0]);
+	const double * b = P(t.v[1]);
+	double fOrient = Orient2D( a, b, p );
+	if ( fOrient != 0 )
+		return fOrient > 0;
+
+	// collinear: p is inside the segment iff it is inside any circle through a and b.
+	// Use an off-line point c for the third point.
+	for ( int k = 0; k < 2; ++k ) {
+		double c[2] = { a[0], a[1] };
+		c[k] += fabs(a[k]) + fabs(b[k]) + 1.0;
+		double fSide = Orient2D( a, b, c );
+		if ( fSide != 0 ) {
+			double fIn = InCircle( a, b, c, p );
+			return (fSide > 0) ? (fIn > 0) : (fIn < 0);
+		}
+	}
+	return false;
+}
+
+
+bool Delaunay2::Insert( unsigned int nPoint )
+{
+	const double * p = P(nPoint);
+	unsigned int nStart = Locate( nPoint );
+
+	// duplicate points are merged with the existing vertex
+	const Triangle & tStart = m_vTris[nStart];
+	for ( int j = 0; j < 3; ++j ) {
+		if ( tStart.v[j] != Infinite && P(tStart.v[j])[0] == p[0] && P(tStart.v[j])[1] == p[1] ) {
+			m_vVertexMap[nPoint] = tStart.v[j];
+			return false;
+		}
+	}
+
+	// find cavity of triangles whose circumcircle contains p
+	// nMark == m_nMark for cavity members, m_nMark+1 for neighbours already tested and rejected
+	m_nMark += 2;
+	m_vCavity.resize(0);
+	m_vBoundary.resize(0);
+	m_vCavity.push_back( nStart );
+	m_vTris[nStart].nMark = m_nMark;
+	for ( unsigned int k = 0; k < m_vCavity.size(); ++k ) {
+		unsigned int nTri = m_vCavity[k];
+		for ( int i = 0; i < 3; ++i ) {
+			unsigned int nNbr = m_vTris[nTri].n[i];
+			Triangle & nbr = m_vTris[nNbr];
+			if ( nbr.nMark == m_nMark )
+				continue;
+			if ( nbr.nMark != m_nMark+1 && InConflict( nbr, nPoint ) ) {
+				nbr.nMark = m_nMark;
+				m_vCavity.push_back(nNbr);
+			} else {
+				nbr.nMark = m_nMark+1;
+				BoundaryEdge e;
+				e.a = m_vTris[nTri].v[(i+1)%3];
+				e.b = m_vTris[nTri].v[(i+2)%3];
+				e.nOutside = nNbr;
+				e.nNewTri = NoTriangle;
+				m_vBoundary.push_back(e);
+			}
+		}
+	}
+
+	for ( unsigned int k = 0; k < m_vCavity.size(); ++k )
+		m_vFreeTris.push_back( m_vCavity[k] );
+
+	// fan of new triangles (a,b,p). Ghosts keep Infinite in slot 2
+	unsigned int nBoundary = (unsigned int)m_vBoundary.size();
+	for ( unsigned int k = 0; k < nBoundary; ++k ) {
+		BoundaryEdge & e = m_vBoundary[k];
+		unsigned int nTri;
+		if ( e.a == Infinite )
+			nTri = NewTriangle( e.b, nPoint, Infinite );
+		else if ( e.b == Infinite )
+			nTri = NewTriangle( nPoint, e.a, Infinite );
+		else
+			nTri = NewTriangle( e.a, e.b, nPoint );
+		e.nNewTri = nTri;
+
+		Triangle & t = m_vTris[nTri];
+		int nSlot = (e.a == Infinite) ? 1 : ( (e.b == Infinite) ? 0 : 2 );
+		t.n[nSlot] = e.nOutside;
+		Triangle & out = m_vTris[e.nOutside];
+		for ( int j = 0; j < 3; ++j ) {
+			if ( out.v[j] != e.a && out.v[j] != e.b ) {
+				out.n[j] = nTri;
+				break;
+			}
+		}
+	}
+
+	// link fan. New triangle on edge (a,b) shares edge (b,p) with the triangle on edge (b,c).
+	// Boundary is a cycle, so each vertex starts exactly one edge
+	m_vBoundaryStart.resize(nBoundary);
+	for ( unsigned int k = 0; k < nBoundary; ++k )
+		m_vBoundaryStart[k] = std::pair<unsigned int,unsigned int>( m_vBoundary[k].a, k );
+	std::sort( m_vBoundaryStart.begin(), m_vBoundaryStart.end() );
+	for ( unsigned int k = 0; k < nBoundary; ++k ) {
+		const BoundaryEdge & e = m_vBoundary[k];
+		std::vector< std::pair<unsigned int,unsigned int> >::const_iterator found =
+			std::lower_bound( m_vBoundaryStart.begin(), m_vBoundaryStart.end(), std::pair<unsigned int,unsigned int>(e.b, 0) );
+		lgASSERT( found != m_vBoundaryStart.end() && found->first == e.b );
+		const BoundaryEdge & f = m_vBoundary[ found->second ];
+		Triangle & t0 = m_vTris[e.nNewTri];
+		Triangle & t1 = m_vTris[f.nNewTri];
+		for ( int j = 0; j < 3; ++j ) {
+			if ( t0.v[j] == e.a )
+				t0.n[j] = f.nNewTri;
+			if ( t1.v[j] == f.b )
+				t1.n[j] = e.nNewTri;
+		}
+	}
+
+	m_nLast = m_vBoundary[0].nNewTri;
+	return true;
+}
+
+
+void Delaunay2::Extract()
+{
+	unsigned int nTris = (unsigned int)m_vTris.size();
+	std::vector<bool> vFree( nTris, false );
+	for ( unsigned int i = 0; i < m_vFreeTris.size(); ++i )
+		vFree[ m_vFreeTris[i] ] = true;
+
+	std::vector<int> vIndex( nTris, -1 );
+	int nOut = 0;
+	for ( unsigned int i = 0; i < nTris; ++i )
+		if ( ! vFree[i] && ! IsGhost(m_vTris[i]) )
+			vIndex[i] = nOut++;
+
+	m_vTriangles.resize( 3*nOut );
+	m_vNeighbours.resize( 3*nOut );
+	for ( unsigned int i = 0; i < nTris; ++i ) {
+		if ( vIndex[i] < 0 )
+			continue;
+		const Triangle & t = m_vTris[i];
+		int k = vIndex[i];
+		for ( int j = 0; j < 3; ++j ) {
+			m_vTriangles[3*k+j] = t.v[j];
+			m_vNeighbours[3*k+j] = vIndex[ t.n[j] ];
+		}
+	}
+
+	m_vTris.resize(0);
+	m_vFreeTris.resize(0);
+}
+
+
+void Delaunay2::GetOutput( std::vector<double> & vPoints, std::vector<int> & vTriangles ) const
+{
+	vPoints = m_vPoints;
+	vTriangles.resize( m_vTriangles.size() );
+	for ( unsigned int i = 0; i < m_vTriangles.size(); ++i )
+		vTriangles[i] = (int)m_vTriangles[i];
+}
+
+
+void Delaunay2::MakeTriMesh( IMesh & mesh, const Wml::Vector3f * pSetNormal, int nCoordU, int nCoordV, bool bCompact ) const
+{
+	mesh.Clear(false);
+
+	unsigned int nVerts = (unsigned int)m_vPoints.size() / 2;
+	unsigned int nTris = GetTriangleCount();
+
+	BitSet vtxBits(nVerts);
+	for ( unsigned int i = 0; i < 3*nTris; ++i )
+		vtxBits.set( m_vTriangles[i], true );
+
+	std::vector<IMesh::VertexID> vMap( nVerts, IMesh::InvalidID );
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		if ( bCompact && ! vtxBits[i] )
+			continue;
+		Wml::Vector3f vVert( Wml::Vector3f::ZERO );
+		vVert[nCoordU] = (float)m_vPoints[2*i];
+		vVert[nCoordV] = (float)m_vPoints[2*i+1];
+		vMap[i] = mesh.AppendVertex( vVert, (pSetNormal) ? pSetNormal : & Wml::Vector3f::UNIT_Z );
+	}
+
+	for ( unsigned int i = 0; i < nTris; ++i )
+		mesh.AppendTriangle( vMap[ m_vTriangles[3*i] ], vMap[ m_vTriangles[3*i+1] ], vMap[ m_vTriangles[3*i+2] ] );
+}
@@ -0,0 +1,121 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef __RMS_DELAUNAY2_H__
+#define __RMS_DELAUNAY2_H__
+
+#include "config.h"
+#include "IMesh.h"
+#include <Wm4Vector2.h>
+#include <Wm4Vector3.h>
+
+#include <vector>
+
+namespace rms {
+
+/*
+ * 2D Delaunay triangulation of a point set, as a faster alternative to Wml::Delaunay2 /
+ * Wml::IncrementalDelaunay2 on large inputs.
+ *
+ * Bowyer-Watson insertion in BRIO order (SpatialSort.h), with point location by a stochastic
+ * walk from the previously-inserted triangle. The hull is closed with "ghost" triangles on an
+ * implicit vertex at infinity, so no bounding super-triangle is needed and the output always
+ * covers the convex hull. All tests use the exact predicates in ExactPredicates.h.
+ *
+ * Large inputs (SetParallelThreshold()) are split into kd-tree regions (PartitionPoints()) that are
+ * triangulated in parallel. A region triangle whose circumcircle is strictly inside the region box
+ * is final; cocircular triangles are kept or rejected together. The points of all other triangles
+ * (and of region hulls) are triangulated again in one piece, and the triangles of that merge that
+ * are outside the final ones fill the gaps along the region borders. The merge is checked to close
+ * up with the final triangles; if it does not, the whole input is triangulated sequentially.
+ * The output only depends on the input and the threshold, not on the thread count.
+ *
+ * Duplicate points are merged (GetVertexMap()). Fully collinear input has no triangulation;
+ * GetDimension() reports 0 or 1 in that case.
+ */
+class Delaunay2
+{
+public:
+	Delaunay2();
+
+	bool Compute( const std::vector<Wml::Vector2d> & vPoints );
+	bool Compute( const std::vector<Wml::Vector2f> & vPoints );
+	//! pPoints is packed x,y
+	bool Compute( const double * pPoints, unsigned int nCount );
+
+	//! 2 if triangulation is valid, otherwise dimension of (degenerate) input
+	int GetDimension() const { return m_nDimension; }
+
+	unsigned int GetTriangleCount() const { return (unsigned int)m_vTriangles.size() / 3; }
+
+	//! triangles as indices into input points, 3 per triangle, counter-clockwise
+	const std::vector<unsigned int> & GetTriangles() const { return m_vTriangles; }
+
+	//! 3 per triangle. Neighbour j is across the edge opposite vertex j, -1 on the hull
+	const std::vector<int> & GetNeighbours() const { return m_vNeighbours; }
+
+	//! for each input point, the index of the point it was merged with (itself, if not a duplicate)
+	const std::vector<unsigned int> & GetVertexMap() const { return m_vVertexMap; }
+
+	//! output in the same form as Triangulator2D::OutputData_CDT (points are the input points, unused/duplicate ones included)
+	void GetOutput( std::vector<double> & vPoints, std::vector<int> & vTriangles ) const;
+
+	//! same mapping as Triangulator2D::MakeTriMesh. If bCompact, only vertices used by triangles are added
+	void MakeTriMesh( IMesh & mesh, const Wml::Vector3f * pSetNormal = NULL, int nCoordU = 0, int nCoordV = 1, bool bCompact = true ) const;
+
+	//! point sets smaller than this are triangulated in one piece, larger ones in regions of at most half this size
+	void SetParallelThreshold( unsigned int nCount ) { m_nParallelThreshold = nCount; }
+
+protected:
+	std::vector<double> m_vPoints;
+	unsigned int m_nParallelThreshold;
+	int m_nDimension;
+
+	std::vector<unsigned int> m_vTriangles;
+	std::vector<int> m_vNeighbours;
+	std::vector<unsigned int> m_vVertexMap;
+
+	enum {
+		Infinite = 0xFFFFFFFE,		// implicit vertex at infinity
+		NoTriangle = 0xFFFFFFFF
+	};
+
+	struct Triangle {
+		unsigned int v[3];			// counter-clockwise. Ghost triangles have v[2] == Infinite
+		unsigned int n[3];			// n[i] is across edge (v[i+1], v[i+2])
+		unsigned int nMark;
+	};
+	std::vector<Triangle> m_vTris;
+	std::vector<unsigned int> m_vFreeTris;
+	unsigned int m_nMark;
+	unsigned int m_nLast;
+	unsigned int m_nRandom;
+
+	struct BoundaryEdge {
+		unsigned int a, b;			// oriented as in the cavity triangle
+		unsigned int nOutside;
+		unsigned int nNewTri;
+	};
+	std::vector<unsigned int> m_vCavity;
+	std::vector<BoundaryEdge> m_vBoundary;
+	std::vector< std::pair<unsigned int, unsigned int> > m_vBoundaryStart;
+
+	bool Run();
+	bool RunPartitioned();
+	void Clear();
+
+	inline const double * P( unsigned int i ) const { return &m_vPoints[2*i]; }
+	inline bool IsGhost( const Triangle & t ) const { return t.v[2] == Infinite; }
+
+	unsigned int NewTriangle( unsigned int a, unsigned int b, unsigned int c );
+	unsigned int Locate( unsigned int nPoint );
+	bool InConflict( const Triangle & t, unsigned int nPoint ) const;
+	bool Insert( unsigned int nPoint );
+	void Extract();
+};
+
+
+} // end namespace rms
+
+#endif  // __RMS_DELAUNAY2_H__
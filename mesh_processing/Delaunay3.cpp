@@ -0,0 +1,681 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "Delaunay3.h"
+#include "ExactPredicates.h"
+#include "SpatialSort.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace rms;
+
+
+// face i is opposite vertex i, and Orient3D(face,v[i]) > 0 (an even permutation of the tet)
+const int Delaunay3::FaceTable[4][3] = { {1,3,2}, {0,2,3}, {0,3,1}, {0,1,2} };
+
+
+Delaunay3::Delaunay3()
+{
+	m_nParallelThreshold = 1 << 18;
+	m_nDimension = -1;
+	m_nMark = 0;
+	m_nLast = NoTet;
+	m_nRandom = 0;
+}
+
+
+bool Delaunay3::Compute( const std::vector<Wml::Vector3d> & vPoints )
+{
+	m_vPoints.resize( 3*vPoints.size() );
+	for ( unsigned int i = 0; i < vPoints.size(); ++i )
+		for ( int k = 0; k < 3; ++k )
+			m_vPoints[3*i+k] = vPoints[i][k];
+	return Run();
+}
+
+bool Delaunay3::Compute( const std::vector<Wml::Vector3f> & vPoints )
+{
+	m_vPoints.resize( 3*vPoints.size() );
+	for ( unsigned int i = 0; i < vPoints.size(); ++i )
+		for ( int k = 0; k < 3; ++k )
+			m_vPoints[3*i+k] = vPoints[i][k];
+	return Run();
+}
+
+bool Delaunay3::Compute( const double * pPoints, unsigned int nCount )
+{
+	m_vPoints.assign( pPoints, pPoints + 3*nCount );
+	return Run();
+}
+
+
+void Delaunay3::Clear()
+{
+	m_vTetrahedra.resize(0);
+	m_vNeighbours.resize(0);
+	m_vTets.resize(0);
+	m_vFreeTets.resize(0);
+	m_nMark = 0;
+	m_nLast = NoTet;
+	m_nRandom = 0;
+	m_nDimension = -1;
+}
+
+
+unsigned int Delaunay3::NewTet( unsigned int a, unsigned int b, unsigned int c, unsigned int d )
+{
+	unsigned int nTet;
+	if ( ! m_vFreeTets.empty() ) {
+		nTet = m_vFreeTets.back();
+		m_vFreeTets.pop_back();
+	} else {
+		nTet = (unsigned int)m_vTets.size();
+		m_vTets.resize( nTet+1 );
+	}
+	Tet & t = m_vTets[nTet];
+	t.v[0] = a;  t.v[1] = b;  t.v[2] = c;  t.v[3] = d;
+	t.n[0] = t.n[1] = t.n[2] = t.n[3] = NoTet;
+	t.nMark = 0;
+	return nTet;
+}
+
+
+// faces of nTet that contain nApex are identified by their other edge
+void Delaunay3::AddFaceKeys( unsigned int nTet, unsigned int nApex )
+{
+	const Tet & t = m_vTets[nTet];
+	for ( int s = 0; s < 4; ++s ) {
+		if ( t.v[s] == nApex )
+			continue;
+		unsigned int e[2];  int ne = 0;
+		for ( int j = 0; j < 4; ++j )
+			if ( j != s && t.v[j] != nApex )
+				e[ne++] = t.v[j];
+		if ( e[0] > e[1] )
+			std::swap(e[0], e[1]);
+		FaceKey k;
+		k.nEdge = ((unsigned long long)e[0] << 32) | e[1];
+		k.nTet = nTet;
+		k.nSlot = s;
+		m_vFaceKeys.push_back(k);
+	}
+}
+
+void Delaunay3::LinkFaceKeys()
+{
+	std::sort( m_vFaceKeys.begin(), m_vFaceKeys.end() );
+	for ( unsigned int i = 0; i+1 < m_vFaceKeys.size(); i += 2 ) {
+		const FaceKey & k0 = m_vFaceKeys[i];
+		const FaceKey & k1 = m_vFaceKeys[i+1];
+		lgASSERT( k0.nEdge == k1.nEdge );
+		m_vTets[k0.nTet].n[k0.nSlot] = k1.nTet;
+		m_vTets[k1.nTet].n[k1.nSlot] = k0.nTet;
+	}
+	m_vFaceKeys.resize(0);
+}
+
+
+static bool Collinear( const double * a, const double * b, const double * c )
+{
+	// collinear in 3D iff collinear in all three axis projections
+	for ( int k = 0; k < 3; ++k ) {
+		int i = k, j = (k+1)%3;
+		double pa[2] = { a[i], a[j] }, pb[2] = { b[i], b[j] }, pc[2] = { c[i], c[j] };
+		if ( Orient2D(pa, pb, pc) != 0 )
+			return false;
+	}
+	return true;
+}
+
+
+bool Delaunay3::Run()
+{
+	Clear();
+	unsigned int nCount = (unsigned int)m_vPoints.size() / 3;
+	m_vVertexMap.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		m_vVertexMap[i] = i;
+	if ( nCount == 0 )
+		return false;
+	if ( nCount >= m_nParallelThreshold && RunPartitioned() )
+		return true;
+
+	std::vector<unsigned int> vOrder;
+	BRIOOrder( &m_vPoints[0], nCount, 3, vOrder );
+
+	// initial tet from first affinely-independent points in insertion order
+	unsigned int nA = vOrder[0], iB = 1;
+	while ( iB < nCount && P(vOrder[iB])[0] == P(nA)[0] && P(vOrder[iB])[1] == P(nA)[1] && P(vOrder[iB])[2] == P(nA)[2] )
+		++iB;
+	if ( iB == nCount ) {
+		m_nDimension = 0;
+		return false;
+	}
+	unsigned int nB = vOrder[iB], iC = iB+1;
+	while ( iC < nCount && Collinear( P(nA), P(nB), P(vOrder[iC]) ) )
+		++iC;
+	if ( iC == nCount ) {
+		m_nDimension = 1;
+		return false;
+	}
+	unsigned int nC = vOrder[iC], iD = iC+1;
+	while ( iD < nCount && Orient3D( P(nA), P(nB), P(nC), P(vOrder[iD]) ) == 0 )
+		++iD;
+	if ( iD == nCount ) {
+		m_nDimension = 2;
+		return false;
+	}
+	unsigned int nD = vOrder[iD];
+	if ( Orient3D( P(nA), P(nB), P(nC), P(nD) ) < 0 )
+		std::swap(nA, nB);
+	vOrder.erase( vOrder.begin() + iD );
+	vOrder.erase( vOrder.begin() + iC );
+	vOrder.erase( vOrder.begin() + iB );
+	vOrder.erase( vOrder.begin() );
+
+	// real tet, plus a ghost on each face. Ghost has the face reversed, with Infinite as the 4th vertex
+	unsigned int nReal = NewTet( nA, nB, nC, nD );
+	for ( int i = 0; i < 4; ++i ) {
+		const int * f = FaceTable[i];
+		unsigned int v[3] = { m_vTets[nReal].v[f[0]], m_vTets[nReal].v[f[1]], m_vTets[nReal].v[f[2]] };
+		unsigned int nGhost = NewTet( v[0], v[2], v[1], Infinite );
+		m_vTets[nReal].n[i] = nGhost;
+		m_vTets[nGhost].n[3] = nReal;
+		AddFaceKeys( nGhost, Infinite );
+	}
+	LinkFaceKeys();
+	m_nLast = nReal;
+
+	for ( unsigned int i = 0; i < vOrder.size(); ++i )
+		Insert( vOrder[i] );
+
+	m_nDimension = 3;
+	Extract();
+	return true;
+}
+
+
+// true if the circumsphere of a,b,c,d is strictly inside the open box. Conservative: the circumcenter is
+// computed in floating point, and its error bound (which grows as the tet flattens) counts as outside
+static bool SphereInsideBox( const double * a, const double * b, const double * c, const double * d, const double * fMin, const double * fMax )
+{
+	Wml::Vector3d vB( b[0]-a[0], b[1]-a[1], b[2]-a[2] ), vC( c[0]-a[0], c[1]-a[1], c[2]-a[2] ), vD( d[0]-a[0], d[1]-a[1], d[2]-a[2] );
+	Wml::Vector3d vCD = vC.Cross(vD), vDB = vD.Cross(vB), vBC = vB.Cross(vC);
+	double fDet = 2 * vB.Dot(vCD);
+	if ( fDet == 0 )
+		return false;
+	Wml::Vector3d vU = ( vB.SquaredLength() * vCD + vC.SquaredLength() * vDB + vD.SquaredLength() * vBC ) / fDet;
+	double fRadius = vU.Length();
+	double fLengths = vB.Length() * vC.Length() * vD.Length();
+	double fError = 64 * DBL_EPSILON * ( (vB.Length() + vC.Length() + vD.Length() + fRadius) * fLengths / fabs(fDet)
+										+ fRadius + fabs(a[0]) + fabs(a[1]) + fabs(a[2]) );
+	for ( int k = 0; k < 3; ++k ) {
+		double fCenter = a[k] + vU[k];
+		if ( fCenter - fRadius - fError <= fMin[k] || fCenter + fRadius + fError >= fMax[k] )
+			return false;
+	}
+	return true;
+}
+
+
+// face of a final region tet whose neighbour is not final. The merge tetrahedralization must have
+// it too, with the tet on the other side (or the hull) as the neighbour
+struct Delaunay3Border {
+	unsigned int nKey[3];		// sorted vertices
+	bool bOdd;					// face is an odd permutation of nKey in the final tet
+	unsigned int nTet;			// output index of final tet
+	int nOther;					// merge tet on the other side, -1 on the hull
+	int nMatches;
+	bool operator<( const Delaunay3Border & b ) const {
+		return nKey[0] < b.nKey[0] || ( nKey[0] == b.nKey[0] && ( nKey[1] < b.nKey[1] || ( nKey[1] == b.nKey[1] && nKey[2] < b.nKey[2] ) ) );
+	}
+};
+
+// sorts the face into nKey, returns true if that takes an odd permutation
+static bool SortFace( unsigned int a, unsigned int b, unsigned int c, unsigned int nKey[3] )
+{
+	nKey[0] = a;  nKey[1] = b;  nKey[2] = c;
+	bool bOdd = false;
+	if ( nKey[0] > nKey[1] ) { std::swap(nKey[0], nKey[1]);  bOdd = !bOdd; }
+	if ( nKey[1] > nKey[2] ) { std::swap(nKey[1], nKey[2]);  bOdd = !bOdd; }
+	if ( nKey[0] > nKey[1] ) { std::swap(nKey[0], nKey[1]);  bOdd = !bOdd; }
+	return bOdd;
+}
+
+static Delaunay3Border * FindBorder( std::vector<Delaunay3Border> & vBorders, const unsigned int nKey[3] )
+{
+	Delaunay3Border key;
+	key.nKey[0] = nKey[0];  key.nKey[1] = nKey[1];  key.nKey[2] = nKey[2];
+	std::vector<Delaunay3Border>::iterator found = std::lower_bound( vBorders.begin(), vBorders.end(), key );
+	if ( found == vBorders.end() || found->nKey[0] != nKey[0] || found->nKey[1] != nKey[1] || found->nKey[2] != nKey[2] )
+		return NULL;
+	return &(*found);
+}
+
+
+bool Delaunay3::RunPartitioned()
+{
+	unsigned int nCount = (unsigned int)m_vPoints.size() / 3;
+	std::vector<SpatialRegion> vRegions;
+	PartitionPoints( &m_vPoints[0], nCount, 3, m_nParallelThreshold / 2, vRegions );
+	int nRegions = (int)vRegions.size();
+	if ( nRegions < 2 )
+		return false;
+
+	// tetrahedralize regions, and find final tets. Points of the others go into the merge
+	std::vector<Delaunay3> vRegionTets( nRegions );
+	std::vector< std::vector<unsigned char> > vFinal( nRegions );
+	std::vector<unsigned char> vInMerge( nCount, 0 );
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int r = 0; r < nRegions; ++r ) {
+		const SpatialRegion & region = vRegions[r];
+		unsigned int nPoints = (unsigned int)region.vPoints.size();
+		std::vector<double> vPoints( 3*nPoints );
+		for ( unsigned int i = 0; i < nPoints; ++i )
+			for ( int k = 0; k < 3; ++k )
+				vPoints[3*i+k] = P(region.vPoints[i])[k];
+		Delaunay3 & d = vRegionTets[r];
+		d.SetParallelThreshold( 0xFFFFFFFF );
+		if ( ! d.Compute( &vPoints[0], nPoints ) )
+			continue;
+
+		const std::vector<unsigned int> & vTets = d.GetTetrahedra();
+		const std::vector<int> & vNbrs = d.GetNeighbours();
+		unsigned int nTets = d.GetTetrahedronCount();
+		std::vector<unsigned char> & vIsFinal = vFinal[r];
+		vIsFinal.resize( nTets );
+		std::vector<unsigned int> vStack;
+		for ( unsigned int t = 0; t < nTets; ++t ) {
+			const unsigned int * v = &vTets[4*t];
+			vIsFinal[t] = SphereInsideBox( d.P(v[0]), d.P(v[1]), d.P(v[2]), d.P(v[3]), region.fMin, region.fMax );
+			if ( ! vIsFinal[t] )
+				vStack.push_back(t);
+		}
+		// a cospherical neighbour of a rejected tet is rejected too, so whole Delaunay cells go into the merge
+		while ( ! vStack.empty() ) {
+			unsigned int t = vStack.back();
+			vStack.pop_back();
+			const unsigned int * v = &vTets[4*t];
+			for ( int j = 0; j < 4; ++j ) {
+				int n = vNbrs[4*t+j];
+				if ( n < 0 || ! vIsFinal[n] )
+					continue;
+				unsigned int nOpposite = 0;
+				for ( int k = 0; k < 4; ++k )
+					if ( vNbrs[4*n+k] == (int)t )
+						nOpposite = vTets[4*n+k];
+				if ( InSphere( d.P(v[0]), d.P(v[1]), d.P(v[2]), d.P(v[3]), d.P(nOpposite) ) == 0 ) {
+					vIsFinal[n] = 0;
+					vStack.push_back(n);
+				}
+			}
+		}
+		for ( unsigned int t = 0; t < nTets; ++t ) {
+			for ( int j = 0; j < 4; ++j ) {
+				if ( ! vIsFinal[t] ) {
+					vInMerge[ region.vPoints[ vTets[4*t+j] ] ] = 1;
+				} else if ( vNbrs[4*t+j] < 0 ) {
+					for ( int k = 0; k < 3; ++k )
+						vInMerge[ region.vPoints[ vTets[4*t + FaceTable[j][k]] ] ] = 1;
+				}
+			}
+		}
+	}
+	for ( int r = 0; r < nRegions; ++r )
+		if ( vRegionTets[r].GetDimension() != 3 )
+			return false;
+
+	// output indices of final tets, and their border faces
+	std::vector< std::vector<int> > vFinalIndex( nRegions );
+	unsigned int nFinal = 0;
+	for ( int r = 0; r < nRegions; ++r ) {
+		vFinalIndex[r].resize( vFinal[r].size(), -1 );
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t )
+			if ( vFinal[r][t] )
+				vFinalIndex[r][t] = (int)nFinal++;
+	}
+	std::vector<Delaunay3Border> vBorders;
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vTets = vRegionTets[r].GetTetrahedra();
+		const std::vector<int> & vNbrs = vRegionTets[r].GetNeighbours();
+		const std::vector<unsigned int> & vRegionPoints = vRegions[r].vPoints;
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t ) {
+			for ( int j = 0; j < 4 && vFinal[r][t]; ++j ) {
+				int n = vNbrs[4*t+j];
+				if ( n >= 0 && vFinal[r][n] )
+					continue;
+				const int * f = FaceTable[j];
+				Delaunay3Border border;
+				border.bOdd = SortFace( vRegionPoints[ vTets[4*t+f[0]] ], vRegionPoints[ vTets[4*t+f[1]] ], vRegionPoints[ vTets[4*t+f[2]] ], border.nKey );
+				border.nTet = vFinalIndex[r][t];
+				border.nOther = -1;
+				border.nMatches = 0;
+				vBorders.push_back(border);
+			}
+		}
+	}
+	std::sort( vBorders.begin(), vBorders.end() );
+
+	// merge tetrahedralization
+	std::vector<unsigned int> vMerge;
+	for ( unsigned int i = 0; i < nCount; ++i )
+		if ( vInMerge[i] )
+			vMerge.push_back(i);
+	unsigned int nMerge = (unsigned int)vMerge.size();
+	std::vector<double> vMergePoints( 3*nMerge );
+	for ( unsigned int i = 0; i < nMerge; ++i )
+		for ( int k = 0; k < 3; ++k )
+			vMergePoints[3*i+k] = P(vMerge[i])[k];
+	Delaunay3 merge;
+	merge.SetParallelThreshold( 0xFFFFFFFF );
+	if ( nMerge == 0 || ! merge.Compute( &vMergePoints[0], nMerge ) )
+		return false;
+	const std::vector<unsigned int> & vMergeTets = merge.GetTetrahedra();
+	const std::vector<int> & vMergeNbrs = merge.GetNeighbours();
+	unsigned int nMergeTets = merge.GetTetrahedronCount();
+
+	// merge tets on the inner side of a border face are kept (1), on the outer side they overlap final tets (2)
+	std::vector<unsigned char> vSide( nMergeTets, vBorders.empty() ? 1 : 0 );
+	std::vector<Delaunay3Border *> vFaceBorder( 4*nMergeTets, (Delaunay3Border *)NULL );
+	for ( unsigned int t = 0; t < nMergeTets; ++t ) {
+		for ( int j = 0; j < 4; ++j ) {
+			const int * f = FaceTable[j];
+			unsigned int nKey[3];
+			bool bOdd = SortFace( vMerge[ vMergeTets[4*t+f[0]] ], vMerge[ vMergeTets[4*t+f[1]] ], vMerge[ vMergeTets[4*t+f[2]] ], nKey );
+			Delaunay3Border * pBorder = FindBorder( vBorders, nKey );
+			if ( pBorder == NULL )
+				continue;
+			vFaceBorder[4*t+j] = pBorder;
+			if ( bOdd == pBorder->bOdd ) {
+				vSide[t] |= 2;
+				if ( vMergeNbrs[4*t+j] < 0 )
+					pBorder->nMatches++;
+			} else {
+				vSide[t] |= 1;
+				pBorder->nOther = (int)t;
+				pBorder->nMatches++;
+			}
+		}
+	}
+	for ( unsigned int i = 0; i < vBorders.size(); ++i )
+		if ( vBorders[i].nMatches != 1 )
+			return false;
+
+	// flood the kept side from the border faces
+	std::vector<unsigned int> vStack;
+	for ( unsigned int t = 0; t < nMergeTets; ++t ) {
+		if ( vSide[t] == 3 )
+			return false;
+		if ( vSide[t] == 1 )
+			vStack.push_back(t);
+	}
+	while ( ! vStack.empty() ) {
+		unsigned int t = vStack.back();
+		vStack.pop_back();
+		for ( int j = 0; j < 4; ++j ) {
+			int n = vMergeNbrs[4*t+j];
+			if ( n < 0 || vFaceBorder[4*t+j] != NULL || vSide[n] == 1 )
+				continue;
+			if ( vSide[n] != 0 )
+				return false;
+			vSide[n] = 1;
+			vStack.push_back(n);
+		}
+	}
+
+	// output: final region tets, then kept merge tets
+	std::vector<int> vMergeIndex( nMergeTets, -1 );
+	unsigned int nOut = nFinal;
+	for ( unsigned int t = 0; t < nMergeTets; ++t )
+		if ( vSide[t] == 1 )
+			vMergeIndex[t] = (int)nOut++;
+
+	m_vTetrahedra.resize( 4*nOut );
+	m_vNeighbours.resize( 4*nOut );
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vTets = vRegionTets[r].GetTetrahedra();
+		const std::vector<int> & vNbrs = vRegionTets[r].GetNeighbours();
+		const std::vector<unsigned int> & vRegionPoints = vRegions[r].vPoints;
+		for ( unsigned int t = 0; t < vFinal[r].size(); ++t ) {
+			int k = vFinalIndex[r][t];
+			if ( k < 0 )
+				continue;
+			for ( int j = 0; j < 4; ++j ) {
+				m_vTetrahedra[4*k+j] = vRegionPoints[ vTets[4*t+j] ];
+				int n = vNbrs[4*t+j];
+				if ( n >= 0 && vFinal[r][n] ) {
+					m_vNeighbours[4*k+j] = vFinalIndex[r][n];
+				} else {
+					const int * f = FaceTable[j];
+					unsigned int nKey[3];
+					SortFace( vRegionPoints[ vTets[4*t+f[0]] ], vRegionPoints[ vTets[4*t+f[1]] ], vRegionPoints[ vTets[4*t+f[2]] ], nKey );
+					int nOther = FindBorder( vBorders, nKey )->nOther;
+					m_vNeighbours[4*k+j] = ( nOther >= 0 ) ? vMergeIndex[nOther] : -1;
+				}
+			}
+		}
+	}
+	for ( unsigned int t = 0; t < nMergeTets; ++t ) {
+		int k = vMergeIndex[t];
+		if ( k < 0 )
+			continue;
+		for ( int j = 0; j < 4; ++j ) {
+			m_vTetrahedra[4*k+j] = vMerge[ vMergeTets[4*t+j] ];
+			int n = vMergeNbrs[4*t+j];
+			if ( vFaceBorder[4*t+j] != NULL )
+				m_vNeighbours[4*k+j] = (int)vFaceBorder[4*t+j]->nTet;
+			else
+				m_vNeighbours[4*k+j] = ( n >= 0 ) ? vMergeIndex[n] : -1;
+		}
+	}
+
+	// duplicates merged by the regions, then by the merge tetrahedralization
+	for ( int r = 0; r < nRegions; ++r ) {
+		const std::vector<unsigned int> & vMap = vRegionTets[r].GetVertexMap();
+		for ( unsigned int i = 0; i < vMap.size(); ++i )
+			m_vVertexMap[ vRegions[r].vPoints[i] ] = vRegions[r].vPoints[ vMap[i] ];
+	}
+	const std::vector<unsigned int> & vMergeMap = merge.GetVertexMap();
+	for ( unsigned int i = 0; i < nMerge; ++i )
+		m_vVertexMap[ vMerge[i] ] = vMerge[ vMergeMap[i] ];
+	for ( unsigned int i = 0; i < nCount; ++i )
+		m_vVertexMap[i] = m_vVertexMap[ m_vVertexMap[i] ];
+
+	m_nDimension = 3;
+	return true;
+}
+
+
+unsigned int Delaunay3::Locate( unsigned int nPoint )
+{
+	const double * p = P(nPoint);
+	unsigned int nTet = m_nLast;
+	if ( IsGhost(m_vTets[nTet]) )
+		nTet = m_vTets[nTet].n[3];
+
+	while ( true ) {
+		const Tet & t = m_vTets[nTet];
+		if ( IsGhost(t) )
+			return nTet;
+
+		// stochastic walk: test faces starting at a random one, so the walk cannot cycle
+		m_nRandom = m_nRandom * 1664525u + 1013904223u;
+		int k0 = (int)( m_nRandom >> 30 );
+		unsigned int nNext = NoTet;
+		for ( int j = 0; j < 4 && nNext == NoTet; ++j ) {
+			int i = (k0 + j) & 3;
+			const int * f = FaceTable[i];
+			if ( Orient3D( P(t.v[f[0]]), P(t.v[f[1]]), P(t.v[f[2]]), p ) < 0 )
+				nNext = t.n[i];
+		}
+		if ( nNext == NoTet )
+			return nTet;
+		nTet = nNext;
+	}
+}
+
+
+bool Delaunay3::InConflict( const Tet & t, unsigned int nPoint ) const
+{
+	const double * p = P(nPoint);
+	if ( ! IsGhost(t) )
+		return InSphere( P(t.v[0]), P(t.v[1]), P(t.v[2]), P(t.v[3]), p ) > 0;
+
+	// ghost (a,b,c,Inf) conflicts if p is strictly outside the hull face (a,b,c),
+	// or on its plane and strictly inside its circumcircle
+	const double * a = P(t.v[0]);
+	const double * b = P(t.v[1]);
+	const double * c = P(t.v[2]);
+	double fOrient = Orient3D( a, b, c, p );
+	if ( fOrient != 0 )
+		return fOrient > 0;
+
+	// coplanar: p is inside the circumcircle iff it is inside any sphere through a,b,c.
+	// Use an off-plane point d for the fourth point
+	for ( int k = 0; k < 3; ++k ) {
+		double d[3] = { a[0], a[1], a[2] };
+		d[k] += fabs(a[k]) + fabs(b[k]) + fabs(c[k]) + 1.0;
+		double fSide = Orient3D( a, b, c, d );
+		if ( fSide != 0 ) {
+			double fIn = InSphere( a, b, c, d, p );
+			return (fSide > 0) ? (fIn > 0) : (fIn < 0);
+		}
+	}
+	return false;
+}
+
+
+bool Delaunay3::Insert( unsigned int nPoint )
+{
+	const double * p = P(nPoint);
+	unsigned int nStart = Locate( nPoint );
+
+	// duplicate points are merged with the existing vertex
+	const Tet & tStart = m_vTets[nStart];
+	for ( int j = 0; j < 4; ++j ) {
+		if ( tStart.v[j] == Infinite )
+			continue;
+		const double * q = P(tStart.v[j]);
+		if ( q[0] == p[0] && q[1] == p[1] && q[2] == p[2] ) {
+			m_vVertexMap[nPoint] = tStart.v[j];
+			return false;
+		}
+	}
+
+	// find cavity of tets whose circumsphere contains p
+	// nMark == m_nMark for cavity members, m_nMark+1 for neighbours already tested and rejected
+	m_nMark += 2;
+	m_vCavity.resize(0);
+	m_vBoundary.resize(0);
+	m_vCavity.push_back( nStart );
+	m_vTets[nStart].nMark = m_nMark;
+	for ( unsigned int k = 0; k < m_vCavity.size(); ++k ) {
+		unsigned int nTet = m_vCavity[k];
+		for ( int i = 0; i < 4; ++i ) {
+			unsigned int nNbr = m_vTets[nTet].n[i];
+			Tet & nbr = m_vTets[nNbr];
+			if ( nbr.nMark == m_nMark )
+				continue;
+			if ( nbr.nMark != m_nMark+1 && InConflict( nbr, nPoint ) ) {
+				nbr.nMark = m_nMark;
+				m_vCavity.push_back(nNbr);
+			} else {
+				nbr.nMark = m_nMark+1;
+				const int * f = FaceTable[i];
+				BoundaryFace bf;
+				for ( int j = 0; j < 3; ++j )
+					bf.v[j] = m_vTets[nTet].v[f[j]];
+				bf.nOutside = nNbr;
+				m_vBoundary.push_back(bf);
+			}
+		}
+	}
+
+	for ( unsigned int k = 0; k < m_vCavity.size(); ++k )
+		m_vFreeTets.push_back( m_vCavity[k] );
+
+	// cone of new tets (f0,f1,f2,p). If the face contains Infinite, an even permutation moves it to slot 3
+	unsigned int nBoundary = (unsigned int)m_vBoundary.size();
+	unsigned int nNewTet = NoTet;
+	for ( unsigned int k = 0; k < nBoundary; ++k ) {
+		const BoundaryFace & bf = m_vBoundary[k];
+		const unsigned int * f = bf.v;
+		unsigned int nTet;
+		int nSlot;
+		if ( f[0] == Infinite ) {
+			nTet = NewTet( nPoint, f[2], f[1], f[0] );  nSlot = 0;
+		} else if ( f[1] == Infinite ) {
+			nTet = NewTet( f[2], nPoint, f[0], f[1] );  nSlot = 1;
+		} else if ( f[2] == Infinite ) {
+			nTet = NewTet( f[1], f[0], nPoint, f[2] );  nSlot = 2;
+		} else {
+			nTet = NewTet( f[0], f[1], f[2], nPoint );  nSlot = 3;
+		}
+		m_vTets[nTet].n[nSlot] = bf.nOutside;
+
+		Tet & out = m_vTets[bf.nOutside];
+		for ( int j = 0; j < 4; ++j ) {
+			if ( out.v[j] != f[0] && out.v[j] != f[1] && out.v[j] != f[2] ) {
+				out.n[j] = nTet;
+				break;
+			}
+		}
+
+		AddFaceKeys( nTet, nPoint );
+		if ( nNewTet == NoTet || IsGhost(m_vTets[nNewTet]) )
+			nNewTet = nTet;
+	}
+	LinkFaceKeys();
+
+	m_nLast = nNewTet;
+	return true;
+}
+
+
+void Delaunay3::Extract()
+{
+	unsigned int nTets = (unsigned int)m_vTets.size();
+	std::vector<bool> vFree( nTets, false );
+	for ( unsigned int i = 0; i < m_vFreeTets.size(); ++i )
+		vFree[ m_vFreeTets[i] ] = true;
+
+	std::vector<int> vIndex( nTets, -1 );
+	int nOut = 0;
+	for ( unsigned int i = 0; i < nTets; ++i )
+		if ( ! vFree[i] && ! IsGhost(m_vTets[i]) )
+			vIndex[i] = nOut++;
+
+	m_vTetrahedra.resize( 4*nOut );
+	m_vNeighbours.resize( 4*nOut );
+	for ( unsigned int i = 0; i < nTets; ++i ) {
+		if ( vIndex[i] < 0 )
+			continue;
+		const Tet & t = m_vTets[i];
+		int k = vIndex[i];
+		for ( int j = 0; j < 4; ++j ) {
+			m_vTetrahedra[4*k+j] = t.v[j];
+			m_vNeighbours[4*k+j] = vIndex[ t.n[j] ];
+		}
+	}
+
+	m_vTets.resize(0);
+	m_vFreeTets.resize(0);
+}
+
+
+void Delaunay3::GetHullTriangles( std::vector<unsigned int> & vTriangles ) const
+{
+	vTriangles.resize(0);
+	unsigned int nTets = GetTetrahedronCount();
+	for ( unsigned int i = 0; i < nTets; ++i ) {
+		for ( int j = 0; j < 4; ++j ) {
+			if ( m_vNeighbours[4*i+j] >= 0 )
+				continue;
+			const int * f = FaceTable[j];
+			for ( int k = 0; k < 3; ++k )
+				vTriangles.push_back( m_vTetrahedra[4*i + f[k]] );
+		}
+	}
+}
@@ -0,0 +1,125 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef __RMS_DELAUNAY3_H__
+#define __RMS_DELAUNAY3_H__
+
+#include "config.h"
+#include <Wm4Vector3.h>
+
+#include <vector>
+
+namespace rms {
+
+/*
+ * 3D Delaunay tetrahedralization of a point set. Same approach as Delaunay2: Bowyer-Watson
+ * insertion in BRIO order, stochastic walk location from the last inserted tetrahedron,
+ * ghost tetrahedra on a vertex at infinity to close the hull, and exact predicates throughout.
+ *
+ * Output tetrahedra (a,b,c,d) are positively oriented, ie Orient3D(a,b,c,d) > 0. The face
+ * opposite vertex i is given by GetFace(i); faces are counter-clockwise seen from outside the tet.
+ *
+ * Large inputs (SetParallelThreshold()) are tetrahedralized per kd-tree region in parallel and
+ * merged as in Delaunay2: tets whose circumsphere is strictly inside their region box are final,
+ * the points of the others are tetrahedralized again in one piece to fill the gaps. If the merge
+ * does not close up with the final tets (cospherical input, eg lattices, can triangulate a shared
+ * polygonal face differently on the two sides), the whole input is tetrahedralized sequentially.
+ *
+ * Duplicate points are merged (GetVertexMap()). Degenerate (coplanar/collinear) input has no
+ * tetrahedralization; GetDimension() reports 0, 1 or 2 in that case.
+ */
+class Delaunay3
+{
+public:
+	Delaunay3();
+
+	bool Compute( const std::vector<Wml::Vector3d> & vPoints );
+	bool Compute( const std::vector<Wml::Vector3f> & vPoints );
+	//! pPoints is packed x,y,z
+	bool Compute( const double * pPoints, unsigned int nCount );
+
+	//! 3 if tetrahedralization is valid, otherwise dimension of (degenerate) input
+	int GetDimension() const { return m_nDimension; }
+
+	unsigned int GetTetrahedronCount() const { return (unsigned int)m_vTetrahedra.size() / 4; }
+
+	//! tetrahedra as indices into input points, 4 per tet, positively oriented
+	const std::vector<unsigned int> & GetTetrahedra() const { return m_vTetrahedra; }
+
+	//! 4 per tet. Neighbour j is across the face opposite vertex j, -1 on the hull
+	const std::vector<int> & GetNeighbours() const { return m_vNeighbours; }
+
+	//! for each input point, the index of the point it was merged with (itself, if not a duplicate)
+	const std::vector<unsigned int> & GetVertexMap() const { return m_vVertexMap; }
+
+	//! convex hull boundary triangles, 3 per triangle, counter-clockwise seen from outside
+	void GetHullTriangles( std::vector<unsigned int> & vTriangles ) const;
+
+	//! local vertex indices of face opposite vertex nVertex of a tet
+	static const int * GetFace( int nVertex ) { return FaceTable[nVertex]; }
+
+	//! point sets smaller than this are tetrahedralized in one piece, larger ones in regions of at most half this size
+	void SetParallelThreshold( unsigned int nCount ) { m_nParallelThreshold = nCount; }
+
+protected:
+	std::vector<double> m_vPoints;
+	unsigned int m_nParallelThreshold;
+	int m_nDimension;
+
+	std::vector<unsigned int> m_vTetrahedra;
+	std::vector<int> m_vNeighbours;
+	std::vector<unsigned int> m_vVertexMap;
+
+	static const int FaceTable[4][3];
+
+	enum {
+		Infinite = 0xFFFFFFFE,		// implicit vertex at infinity
+		NoTet = 0xFFFFFFFF
+	};
+
+	struct Tet {
+		unsigned int v[4];			// Orient3D(v0,v1,v2,v3) > 0. Ghost tets have v[3] == Infinite
+		unsigned int n[4];			// n[i] is across face opposite v[i]
+		unsigned int nMark;
+	};
+	std::vector<Tet> m_vTets;
+	std::vector<unsigned int> m_vFreeTets;
+	unsigned int m_nMark;
+	unsigned int m_nLast;
+	unsigned int m_nRandom;
+
+	struct BoundaryFace {
+		unsigned int v[3];			// oriented as in the cavity tet
+		unsigned int nOutside;
+	};
+	struct FaceKey {
+		unsigned long long nEdge;	// sorted edge of face, excluding the apex vertex shared by all faces being linked
+		unsigned int nTet;
+		int nSlot;
+		bool operator<( const FaceKey & k ) const { return nEdge < k.nEdge; }
+	};
+	std::vector<unsigned int> m_vCavity;
+	std::vector<BoundaryFace> m_vBoundary;
+	std::vector<FaceKey> m_vFaceKeys;
+
+	bool Run();
+	bool RunPartitioned();
+	void Clear();
+
+	inline const double * P( unsigned int i ) const { return &m_vPoints[3*i]; }
+	inline bool IsGhost( const Tet & t ) const { return t.v[3] == Infinite; }
+
+	unsigned int NewTet( unsigned int a, unsigned int b, unsigned int c, unsigned int d );
+	void AddFaceKeys( unsigned int nTet, unsigned int nApex );
+	void LinkFaceKeys();
+	unsigned int Locate( unsigned int nPoint );
+	bool InConflict( const Tet & t, unsigned int nPoint ) const;
+	bool Insert( unsigned int nPoint );
+	void Extract();
+};
+
+
+} // end namespace rms
+
+#endif  // __RMS_DELAUNAY3_H__
@@ -0,0 +1,640 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MeshBoolean.h"
+#include "MeshUtils.h"
+#include "Triangulator2D.h"
+#include "ExactPredicates.h"
+
+#include <algorithm>
+#include <map>
+#include <cmath>
+
+#include "rmsdebug.h"
+
+using namespace rms;
+
+
+namespace {
+
+inline void MeshBoolean_ToDouble( const Wml::Vector3f & v, double p[3] )
+{
+	p[0] = v.X();  p[1] = v.Y();  p[2] = v.Z();
+}
+
+inline double MeshBoolean_Orient( const VFTriangleMesh & mesh, IMesh::TriangleID tID, const double p[3] )
+{
+	IMesh::VertexID nTri[3];
+	mesh.GetTriangle( tID, nTri );
+	double q[3][3];
+	for ( int j = 0; j < 3; ++j )
+		MeshBoolean_ToDouble( mesh.GetVertex(nTri[j]), q[j] );
+	return Orient3D( q[0], q[1], q[2], p );
+}
+
+// union-find with path halving. The smaller index becomes the root, so patch roots don't depend on merge order
+inline unsigned int MeshBoolean_Find( std::vector<unsigned int> & vParent, unsigned int i )
+{
+	while ( vParent[i] != i ) {
+		vParent[i] = vParent[ vParent[i] ];
+		i = vParent[i];
+	}
+	return i;
+}
+inline void MeshBoolean_Union( std::vector<unsigned int> & vParent, unsigned int i, unsigned int j )
+{
+	i = MeshBoolean_Find( vParent, i );
+	j = MeshBoolean_Find( vParent, j );
+	if ( i < j )
+		vParent[j] = i;
+	else if ( j < i )
+		vParent[i] = j;
+}
+
+}  // end anonymous namespace
+
+
+
+MeshBoolean::MeshBoolean()
+{
+	m_pMeshA = NULL;
+	m_pMeshB = NULL;
+	m_nPerturbations = 0;
+	m_Sides[0].pMesh = NULL;
+	m_Sides[1].pMesh = NULL;
+}
+
+MeshBoolean::~MeshBoolean()
+{
+}
+
+
+void MeshBoolean::SetMeshes( rms::VFTriangleMesh * pMeshA, rms::VFTriangleMesh * pMeshB )
+{
+	m_pMeshA = pMeshA;
+	m_pMeshB = pMeshB;
+	m_Sides[0].pMesh = pMeshA;
+	m_Sides[0].tree.SetMesh( pMeshA );
+	m_Sides[1].pMesh = pMeshB;
+	m_Sides[1].tree.SetMesh( pMeshB );
+	m_PerturbedB.Clear(true);
+}
+
+
+bool MeshBoolean::Compute( Operation eOp )
+{
+	m_ResultMesh.Clear(false);
+	m_vIntersectionVerts.resize(0);
+	m_vResultFromBBitmap.clear();
+	if ( m_pMeshA == NULL || m_pMeshB == NULL )
+		return false;
+
+	// previous Compute() may have left the trees on a translated B
+	m_nPerturbations = 0;
+	if ( m_Sides[1].pMesh != m_pMeshB ) {
+		m_Sides[1].pMesh = m_pMeshB;
+		m_Sides[1].tree.SetMesh( m_pMeshB );
+	}
+
+	while ( ! ( FindCuts() && CutTriangles(0) && CutTriangles(1) ) ) {
+		if ( m_nPerturbations == MaxPerturbations ) {
+			_RMSInfo("[MeshBoolean] Compute() : could not resolve degenerate intersections\n");
+			return false;
+		}
+		++m_nPerturbations;
+		PerturbB();
+	}
+
+	ClassifyPatches( 0, eOp == Intersection );
+	ClassifyPatches( 1, eOp != Union );
+	BuildResult( eOp );
+	return true;
+}
+
+
+
+void MeshBoolean::PerturbB()
+{
+	// off-axis directions, so that axis-aligned coplanar faces separate. The components differ by more than
+	// float precision at the shift scale, otherwise (eg) diagonals of a translated grid still pass through the same points
+	static const float vDirections[MaxPerturbations][3] = {
+		{ 0.3015f, 0.5222f, 0.7977f }, { -0.6245f, 0.2319f, 0.7458f }, { 0.7860f, -0.5736f, 0.2307f } };
+	int k = (m_nPerturbations - 1) % MaxPerturbations;
+
+	Wml::AxisAlignedBox3f bounds;
+	m_Sides[0].tree.GetMeshBounds( bounds );
+	Wml::Vector3f vDiag( bounds.Max[0]-bounds.Min[0], bounds.Max[1]-bounds.Min[1], bounds.Max[2]-bounds.Min[2] );
+	float fScale = vDiag.Length() * 1.0e-5f * (float)(1 << (2*(m_nPerturbations-1)));
+	Wml::Vector3f vShift( vDirections[k][0], vDirections[k][1], vDirections[k][2] );
+	vShift *= fScale / vShift.Length();
+
+	m_PerturbedB.Copy( *m_pMeshB, m_vPerturbedVMap, &m_vPerturbedTMap, false );
+	Wml::Vector3f vVertex, vNormal;
+	VFTriangleMesh::vertex_iterator curv(m_PerturbedB.BeginVertices()), endv(m_PerturbedB.EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		m_PerturbedB.GetVertex( vID, vVertex, &vNormal );
+		vVertex += vShift;
+		m_PerturbedB.SetVertex( vID, vVertex, &vNormal );
+	}
+
+	m_Sides[1].pMesh = &m_PerturbedB;
+	m_Sides[1].tree.SetMesh( &m_PerturbedB );
+}
+
+
+
+
+bool MeshBoolean::FindCuts()
+{
+	std::vector<IMeshBVTree::IntersectionPair> vPairs;
+	m_Sides[0].tree.FindIntersections( m_Sides[1].tree, vPairs );
+
+	// pairs are sorted, so everything below is deterministic
+	int nPairs = (int)vPairs.size();
+	m_vCuts.resize( nPairs );
+	int nDegenerate = 0;
+	#pragma omp parallel for schedule(dynamic,256) reduction(+:nDegenerate)
+	for ( int i = 0; i < nPairs; ++i ) {
+		if ( vPairs[i].bCoplanar || ! ClassifyPair( vPairs[i].tID1, vPairs[i].tID2, m_vCuts[i] ) )
+			++nDegenerate;
+	}
+	if ( nDegenerate > 0 )
+		return false;
+
+	// unique crossings are the vertices of the intersection curves
+	m_vCrossings.resize(0);
+	m_vCrossings.reserve( 2*nPairs );
+	for ( int i = 0; i < nPairs; ++i ) {
+		m_vCrossings.push_back( m_vCuts[i].vEnds[0] );
+		m_vCrossings.push_back( m_vCuts[i].vEnds[1] );
+	}
+	std::sort( m_vCrossings.begin(), m_vCrossings.end() );
+	m_vCrossings.erase( std::unique( m_vCrossings.begin(), m_vCrossings.end() ), m_vCrossings.end() );
+
+	m_vCurveEdges.resize( nPairs );
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < nPairs; ++i ) {
+		PairCut & cut = m_vCuts[i];
+		for ( int j = 0; j < 2; ++j )
+			cut.nCrossing[j] = (unsigned int)( std::lower_bound( m_vCrossings.begin(), m_vCrossings.end(), cut.vEnds[j] ) - m_vCrossings.begin() );
+		m_vCurveEdges[i] = std::make_pair( std::min(cut.nCrossing[0], cut.nCrossing[1]), std::max(cut.nCrossing[0], cut.nCrossing[1]) );
+	}
+	std::sort( m_vCurveEdges.begin(), m_vCurveEdges.end() );
+
+	ComputeCrossingPositions();
+
+	// cut triangles of each side, with their pairs
+	for ( int s = 0; s < 2; ++s ) {
+		Side & side = m_Sides[s];
+		side.vCutTris.resize( nPairs );
+		for ( int i = 0; i < nPairs; ++i )
+			side.vCutTris[i] = m_vCuts[i].tID[s];
+		std::sort( side.vCutTris.begin(), side.vCutTris.end() );
+		side.vCutTris.erase( std::unique( side.vCutTris.begin(), side.vCutTris.end() ), side.vCutTris.end() );
+
+		unsigned int nCutTris = (unsigned int)side.vCutTris.size();
+		side.vCutIndex.resize(0);
+		side.vCutIndex.resize( side.pMesh->GetMaxTriangleID(), IMesh::InvalidID );
+		for ( unsigned int k = 0; k < nCutTris; ++k )
+			side.vCutIndex[ side.vCutTris[k] ] = k;
+
+		side.vCutStart.resize(0);
+		side.vCutStart.resize( nCutTris + 1, 0 );
+		for ( int i = 0; i < nPairs; ++i )
+			++side.vCutStart[ side.vCutIndex[ m_vCuts[i].tID[s] ] + 1 ];
+		for ( unsigned int k = 0; k < nCutTris; ++k )
+			side.vCutStart[k+1] += side.vCutStart[k];
+		std::vector<unsigned int> vNext( side.vCutStart.begin(), side.vCutStart.end() - 1 );
+		side.vCutPairs.resize( nPairs );
+		for ( int i = 0; i < nPairs; ++i )
+			side.vCutPairs[ vNext[ side.vCutIndex[ m_vCuts[i].tID[s] ] ]++ ] = i;
+	}
+
+	return true;
+}
+
+
+bool MeshBoolean::ClassifyPair( IMesh::TriangleID tA, IMesh::TriangleID tB, PairCut & cut )
+{
+	cut.tID[0] = tA;
+	cut.tID[1] = tB;
+
+	IMesh::VertexID nTri[2][3];
+	double p[2][3][3];
+	for ( int s = 0; s < 2; ++s ) {
+		m_Sides[s].pMesh->GetTriangle( cut.tID[s], nTri[s] );
+		for ( int j = 0; j < 3; ++j )
+			MeshBoolean_ToDouble( m_Sides[s].pMesh->GetVertex( nTri[s][j] ), p[s][j] );
+	}
+
+	// side of each vertex relative to the plane of the other triangle
+	double fSide[2][3];
+	for ( int s = 0; s < 2; ++s ) {
+		const double (*q)[3] = p[1-s];
+		for ( int j = 0; j < 3; ++j ) {
+			fSide[s][j] = Orient3D( q[0], q[1], q[2], p[s][j] );
+			if ( fSide[s][j] == 0 )
+				return false;
+		}
+	}
+
+	// in general position, two triangles cross along a segment whose ends are two edge/triangle crossings
+	int nEnds = 0;
+	for ( int s = 0; s < 2; ++s ) {
+		const double (*q)[3] = p[1-s];
+		for ( int i = 0; i < 3; ++i ) {
+			int j = (i+1) % 3;
+			if ( (fSide[s][i] > 0) == (fSide[s][j] > 0) )
+				continue;
+
+			// edge crosses the plane. It crosses the triangle if it passes all three triangle edges on the same side
+			double o[3];
+			int nPos = 0, nNeg = 0;
+			for ( int k = 0; k < 3; ++k ) {
+				o[k] = Orient3D( p[s][i], p[s][j], q[k], q[(k+1)%3] );
+				if ( o[k] > 0 )  ++nPos;
+				else if ( o[k] < 0 )  ++nNeg;
+			}
+			if ( nPos > 0 && nNeg > 0 )
+				continue;
+			if ( nPos + nNeg < 3 )
+				return false;		// through a vertex or edge of the other triangle
+			if ( nEnds == 2 )
+				return false;
+
+			Crossing & c = cut.vEnds[nEnds++];
+			c.nMesh = s;
+			c.eID = m_Sides[s].pMesh->FindEdge( nTri[s][i], nTri[s][j] );
+			c.tID = cut.tID[1-s];
+		}
+	}
+	return ( nEnds == 2 );
+}
+
+
+void MeshBoolean::ComputeCrossingPositions()
+{
+	int nCrossings = (int)m_vCrossings.size();
+	m_vCrossingPos.resize( nCrossings );
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < nCrossings; ++i ) {
+		const Crossing & c = m_vCrossings[i];
+		const VFTriangleMesh & mesh = *m_Sides[c.nMesh].pMesh;
+		const VFTriangleMesh & other = *m_Sides[1-c.nMesh].pMesh;
+
+		IMesh::VertexID nEdge[2];  IMesh::TriangleID nEdgeTris[2];
+		mesh.GetEdge( c.eID, nEdge, nEdgeTris );
+		double a[3], b[3];
+		MeshBoolean_ToDouble( mesh.GetVertex(nEdge[0]), a );
+		MeshBoolean_ToDouble( mesh.GetVertex(nEdge[1]), b );
+
+		// orientations are proportional to distance from the plane
+		double fA = MeshBoolean_Orient( other, c.tID, a );
+		double fB = MeshBoolean_Orient( other, c.tID, b );
+		double fT = fA / (fA - fB);
+		m_vCrossingPos[i] = Wml::Vector3d( a[0] + fT*(b[0]-a[0]), a[1] + fT*(b[1]-a[1]), a[2] + fT*(b[2]-a[2]) );
+	}
+}
+
+
+
+
+bool MeshBoolean::CutTriangles( int nSide )
+{
+	Side & side = m_Sides[nSide];
+	int nCutTris = (int)side.vCutTris.size();
+	std::vector< std::vector<Piece> > vPieces( nCutTris );
+
+	int nFailed = 0;
+	#pragma omp parallel for schedule(dynamic,16) reduction(+:nFailed)
+	for ( int ci = 0; ci < nCutTris; ++ci ) {
+		if ( ! CutTriangle( nSide, ci, vPieces[ci] ) )
+			++nFailed;
+	}
+	if ( nFailed > 0 )
+		return false;
+
+	side.vPieces.resize(0);
+	for ( int ci = 0; ci < nCutTris; ++ci )
+		side.vPieces.insert( side.vPieces.end(), vPieces[ci].begin(), vPieces[ci].end() );
+	return true;
+}
+
+
+bool MeshBoolean::CutTriangle( int nSide, unsigned int nCut, std::vector<Piece> & vPieces )
+{
+	const Side & side = m_Sides[nSide];
+	const VFTriangleMesh & mesh = *side.pMesh;
+	const VFTriangleMesh & other = *m_Sides[1-nSide].pMesh;
+	unsigned int nMaxVID = mesh.GetMaxVertexID();
+
+	IMesh::TriangleID tID = side.vCutTris[nCut];
+	IMesh::VertexID nTri[3];
+	mesh.GetTriangle( tID, nTri );
+
+	// local points are the corners, then the crossings (sorted)
+	std::vector<unsigned int> vRefs( nTri, nTri+3 );
+	for ( unsigned int k = side.vCutStart[nCut]; k < side.vCutStart[nCut+1]; ++k ) {
+		const PairCut & cut = m_vCuts[ side.vCutPairs[k] ];
+		vRefs.push_back( nMaxVID + cut.nCrossing[0] );
+		vRefs.push_back( nMaxVID + cut.nCrossing[1] );
+	}
+	std::sort( vRefs.begin()+3, vRefs.end() );
+	vRefs.erase( std::unique( vRefs.begin()+3, vRefs.end() ), vRefs.end() );
+	unsigned int nPoints = (unsigned int)vRefs.size();
+
+	std::vector<Wml::Vector3d> vPos( nPoints );
+	for ( int j = 0; j < 3; ++j ) {
+		const Wml::Vector3f & v = mesh.GetVertex( nTri[j] );
+		vPos[j] = Wml::Vector3d( v.X(), v.Y(), v.Z() );
+	}
+	for ( unsigned int i = 3; i < nPoints; ++i )
+		vPos[i] = m_vCrossingPos[ vRefs[i] - nMaxVID ];
+
+	// project along the dominant normal axis. Output triangles are counter-clockwise in (u,v), which
+	// matches the source orientation if the normal points along +axis
+	Wml::Vector3d vNormal( (vPos[1]-vPos[0]).Cross( vPos[2]-vPos[0] ) );
+	int nAxis = 0;
+	for ( int j = 1; j < 3; ++j )
+		if ( fabs(vNormal[j]) > fabs(vNormal[nAxis]) )
+			nAxis = j;
+	int nU = (nAxis+1) % 3, nV = (nAxis+2) % 3;
+	bool bFlip = ( vNormal[nAxis] < 0 );
+
+	Triangulator2D trigen;
+	trigen.SetVerbose(false);
+	trigen.SetEnclosingSegmentsProvided(true);
+	trigen.SetSubdivideAnySegments(false);
+	for ( unsigned int i = 0; i < nPoints; ++i )
+		trigen.AddPoint( vPos[i][nU], vPos[i][nV], i );
+
+	// triangle edges, split at the crossings on them
+	std::vector< std::pair<double, unsigned int> > vSplits;
+	for ( int j = 0; j < 3; ++j ) {
+		int j2 = (j+1) % 3;
+		IMesh::EdgeID eID = mesh.FindEdge( nTri[j], nTri[j2] );
+		Wml::Vector3d vEdge( vPos[j2] - vPos[j] );
+		vSplits.resize(0);
+		for ( unsigned int i = 3; i < nPoints; ++i ) {
+			const Crossing & c = m_vCrossings[ vRefs[i] - nMaxVID ];
+			if ( c.nMesh == nSide && c.eID == eID )
+				vSplits.push_back( std::make_pair( (vPos[i] - vPos[j]).Dot(vEdge), i ) );
+		}
+		std::sort( vSplits.begin(), vSplits.end() );
+		unsigned int nPrev = j;
+		for ( unsigned int k = 0; k < vSplits.size(); ++k ) {
+			trigen.AddSegment( nPrev, vSplits[k].second );
+			nPrev = vSplits[k].second;
+		}
+		trigen.AddSegment( nPrev, j2 );
+	}
+
+	// intersection curve segments
+	std::vector<unsigned int> vSegments;
+	for ( unsigned int k = side.vCutStart[nCut]; k < side.vCutStart[nCut+1]; ++k ) {
+		const PairCut & cut = m_vCuts[ side.vCutPairs[k] ];
+		for ( int j = 0; j < 2; ++j )
+			vSegments.push_back( (unsigned int)( std::lower_bound( vRefs.begin()+3, vRefs.end(), nMaxVID + cut.nCrossing[j] ) - vRefs.begin() ) );
+		trigen.AddSegment( vSegments[vSegments.size()-2], vSegments.back() );
+	}
+
+	if ( ! trigen.Compute() )
+		return false;
+
+	// crossing curve segments would need new points, duplicate points are dropped
+	const Triangulator2D::OutputData_CDT & output = trigen.GetOutputData();
+	if ( output.vPoints.size() != 2*nPoints )
+		return false;
+	std::vector<unsigned char> vUsed( nPoints, 0 );
+
+	unsigned int nTris = (unsigned int)output.vTriangles.size() / 3;
+	for ( unsigned int t = 0; t < nTris; ++t ) {
+		unsigned int vLocal[3] = { (unsigned int)output.vTriangles[3*t], (unsigned int)output.vTriangles[3*t+1], (unsigned int)output.vTriangles[3*t+2] };
+		if ( bFlip )
+			std::swap( vLocal[1], vLocal[2] );
+
+		Piece piece;
+		piece.tSource = tID;
+		piece.nVote = 0;
+		for ( int j = 0; j < 3; ++j ) {
+			piece.nRef[j] = vRefs[ vLocal[j] ];
+			vUsed[ vLocal[j] ] = 1;
+		}
+
+		// pieces along a curve segment vote on which side of the other triangle they are
+		Wml::Vector3d vCentroid( (vPos[vLocal[0]] + vPos[vLocal[1]] + vPos[vLocal[2]]) / 3.0 );
+		double c[3] = { vCentroid.X(), vCentroid.Y(), vCentroid.Z() };
+		for ( int j = 0; j < 3; ++j ) {
+			unsigned int a = vLocal[j], b = vLocal[(j+1)%3];
+			for ( unsigned int k = 0; k < vSegments.size(); k += 2 ) {
+				if ( ! ( (vSegments[k] == a && vSegments[k+1] == b) || (vSegments[k] == b && vSegments[k+1] == a) ) )
+					continue;
+				const PairCut & cut = m_vCuts[ side.vCutPairs[ side.vCutStart[nCut] + k/2 ] ];
+				double fOrient = MeshBoolean_Orient( other, cut.tID[1-nSide], c );
+				if ( fOrient > 0 )
+					++piece.nVote;
+				else if ( fOrient < 0 )
+					--piece.nVote;
+			}
+		}
+		vPieces.push_back( piece );
+	}
+
+	for ( unsigned int i = 0; i < nPoints; ++i )
+		if ( ! vUsed[i] )
+			return false;
+	return true;
+}
+
+
+
+
+void MeshBoolean::ClassifyPatches( int nSide, bool bKeepInside )
+{
+	Side & side = m_Sides[nSide];
+	const VFTriangleMesh & mesh = *side.pMesh;
+	unsigned int nMaxVID = mesh.GetMaxVertexID();
+	unsigned int nMaxTID = mesh.GetMaxTriangleID();
+	unsigned int nPieces = (unsigned int)side.vPieces.size();
+
+	// elements are the mesh triangles (uncut ones only), then the pieces
+	std::vector<unsigned int> vParent( nMaxTID + nPieces );
+	for ( unsigned int i = 0; i < vParent.size(); ++i )
+		vParent[i] = i;
+
+	// join uncut triangles across mesh edges. Edges between uncut and cut triangles have no crossings,
+	// so they appear unsplit in the pieces, and are matched to them below
+	typedef std::map< std::pair<unsigned int, unsigned int>, unsigned int > EdgeMap;
+	EdgeMap vOpenEdges;
+	unsigned int nMaxEID = mesh.GetMaxEdgeID();
+	for ( unsigned int eID = 0; eID < nMaxEID; ++eID ) {
+		if ( ! mesh.IsEdge(eID) )
+			continue;
+		IMesh::VertexID nEdge[2];  IMesh::TriangleID nEdgeTris[2];
+		mesh.GetEdge( eID, nEdge, nEdgeTris );
+		if ( nEdgeTris[1] == IMesh::InvalidID )
+			continue;
+		bool bCut0 = ( side.vCutIndex[ nEdgeTris[0] ] != IMesh::InvalidID );
+		bool bCut1 = ( side.vCutIndex[ nEdgeTris[1] ] != IMesh::InvalidID );
+		if ( ! bCut0 && ! bCut1 )
+			MeshBoolean_Union( vParent, nEdgeTris[0], nEdgeTris[1] );
+		else if ( bCut0 != bCut1 )
+			vOpenEdges[ std::make_pair( std::min(nEdge[0],nEdge[1]), std::max(nEdge[0],nEdge[1]) ) ] = bCut0 ? nEdgeTris[1] : nEdgeTris[0];
+	}
+
+	// join pieces to each other and to uncut triangles, except across the intersection curves
+	for ( unsigned int p = 0; p < nPieces; ++p ) {
+		const Piece & piece = side.vPieces[p];
+		for ( int j = 0; j < 3; ++j ) {
+			unsigned int a = std::min( piece.nRef[j], piece.nRef[(j+1)%3] );
+			unsigned int b = std::max( piece.nRef[j], piece.nRef[(j+1)%3] );
+			if ( a >= nMaxVID && std::binary_search( m_vCurveEdges.begin(), m_vCurveEdges.end(), std::make_pair(a-nMaxVID, b-nMaxVID) ) )
+				continue;
+			std::pair<EdgeMap::iterator, bool> ins = vOpenEdges.insert( std::make_pair( std::make_pair(a,b), nMaxTID + p ) );
+			if ( ! ins.second ) {
+				MeshBoolean_Union( vParent, ins.first->second, nMaxTID + p );
+				vOpenEdges.erase( ins.first );
+			}
+		}
+	}
+
+	// sum up votes per patch
+	std::vector<int> vVotes( vParent.size(), 0 );
+	for ( unsigned int p = 0; p < nPieces; ++p )
+		vVotes[ MeshBoolean_Find( vParent, nMaxTID + p ) ] += side.vPieces[p].nVote;
+
+	// patches without a (decisive) vote are tested against the other mesh, at the centroid of any element
+	IMeshBVTree & otherTree = m_Sides[1-nSide].tree;
+	for ( unsigned int i = 0; i < vParent.size(); ++i ) {
+		Wml::Vector3f vTri[3];
+		if ( i < nMaxTID ) {
+			if ( ! mesh.IsTriangle(i) || side.vCutIndex[i] != IMesh::InvalidID )
+				continue;
+			mesh.GetTriangle( i, vTri );
+		} else {
+			const Piece & piece = side.vPieces[i - nMaxTID];
+			for ( int j = 0; j < 3; ++j )
+				vTri[j] = ( piece.nRef[j] < nMaxVID ) ? mesh.GetVertex( piece.nRef[j] ) :
+					Wml::Vector3f( (float)m_vCrossingPos[ piece.nRef[j]-nMaxVID ].X(), (float)m_vCrossingPos[ piece.nRef[j]-nMaxVID ].Y(), (float)m_vCrossingPos[ piece.nRef[j]-nMaxVID ].Z() );
+		}
+		unsigned int nRoot = MeshBoolean_Find( vParent, i );
+		if ( vVotes[nRoot] == 0 )
+			vVotes[nRoot] = otherTree.IsInside( (vTri[0] + vTri[1] + vTri[2]) / 3.0f ) ? 1 : -1;
+	}
+
+	side.vKeepTri.resize(0);
+	side.vKeepTri.resize( nMaxTID, 0 );
+	for ( unsigned int i = 0; i < nMaxTID; ++i ) {
+		if ( mesh.IsTriangle(i) && side.vCutIndex[i] == IMesh::InvalidID )
+			side.vKeepTri[i] = ( (vVotes[ MeshBoolean_Find(vParent, i) ] > 0) == bKeepInside ) ? 1 : 0;
+	}
+	side.vKeepPiece.resize( nPieces );
+	for ( unsigned int p = 0; p < nPieces; ++p )
+		side.vKeepPiece[p] = ( (vVotes[ MeshBoolean_Find(vParent, nMaxTID + p) ] > 0) == bKeepInside ) ? 1 : 0;
+}
+
+
+
+
+void MeshBoolean::BuildResult( Operation eOp )
+{
+	m_ResultMesh.Clear(false);
+	std::vector<IMesh::VertexID> vCrossingMap( m_vCrossings.size(), IMesh::InvalidID );
+	std::vector<IMesh::VertexID> vVertexMap[2];
+	std::vector<IMesh::TriangleID> vResultSource;
+
+	for ( int s = 0; s < 2; ++s ) {
+		Side & side = m_Sides[s];
+		const VFTriangleMesh & mesh = *side.pMesh;
+		unsigned int nMaxVID = mesh.GetMaxVertexID();
+		unsigned int nMaxTID = mesh.GetMaxTriangleID();
+		vVertexMap[s].resize( nMaxVID, IMesh::InvalidID );
+		bool bFlip = ( eOp == Difference && s == 1 );
+
+		unsigned int nPieces = (unsigned int)side.vPieces.size();
+		for ( unsigned int i = 0; i < nMaxTID + nPieces; ++i ) {
+			unsigned int nRef[3];
+			IMesh::TriangleID tSource;
+			if ( i < nMaxTID ) {
+				if ( ! side.vKeepTri[i] )
+					continue;
+				mesh.GetTriangle( i, nRef );
+				tSource = i;
+			} else {
+				const Piece & piece = side.vPieces[i - nMaxTID];
+				if ( ! side.vKeepPiece[i - nMaxTID] )
+					continue;
+				for ( int j = 0; j < 3; ++j )
+					nRef[j] = piece.nRef[j];
+				tSource = piece.tSource;
+			}
+
+			IMesh::VertexID nNew[3];
+			for ( int j = 0; j < 3; ++j ) {
+				if ( nRef[j] < nMaxVID ) {
+					IMesh::VertexID & vNew = vVertexMap[s][ nRef[j] ];
+					if ( vNew == IMesh::InvalidID ) {
+						Wml::Vector3f vVertex, vNormal;
+						mesh.GetVertex( nRef[j], vVertex, &vNormal );
+						if ( bFlip )
+							vNormal = -vNormal;
+						vNew = m_ResultMesh.AppendVertex( vVertex, &vNormal );
+					}
+					nNew[j] = vNew;
+				} else {
+					IMesh::VertexID & vNew = vCrossingMap[ nRef[j] - nMaxVID ];
+					if ( vNew == IMesh::InvalidID ) {
+						const Wml::Vector3d & vPos = m_vCrossingPos[ nRef[j] - nMaxVID ];
+						vNew = m_ResultMesh.AppendVertex( Wml::Vector3f( (float)vPos.X(), (float)vPos.Y(), (float)vPos.Z() ) );
+						m_vIntersectionVerts.push_back( vNew );
+					}
+					nNew[j] = vNew;
+				}
+			}
+			if ( bFlip )
+				std::swap( nNew[1], nNew[2] );
+			m_ResultMesh.AppendTriangle( nNew[0], nNew[1], nNew[2] );
+			vResultSource.push_back( tSource );
+		}
+		if ( s == 0 )
+			vResultSource.push_back( IMesh::InvalidID );		// separates A and B triangles
+	}
+
+	for ( unsigned int k = 0; k < m_vIntersectionVerts.size(); ++k )
+		m_ResultMesh.SetNormal( m_vIntersectionVerts[k], MeshUtils::EstimateNormal( m_ResultMesh, m_vIntersectionVerts[k] ) );
+
+	// provenance maps. B IDs go through the translated copy if there is one
+	unsigned int nResultV = m_ResultMesh.GetMaxVertexID();
+	unsigned int nResultT = m_ResultMesh.GetMaxTriangleID();
+	bool bPerturbed = ( m_Sides[1].pMesh != m_pMeshB );
+
+	m_vAToResultVMap.Resize( m_pMeshA->GetMaxVertexID(), nResultV );
+	for ( unsigned int vID = 0; vID < vVertexMap[0].size(); ++vID )
+		if ( vVertexMap[0][vID] != IMesh::InvalidID )
+			m_vAToResultVMap.SetMap( vID, vVertexMap[0][vID] );
+	m_vBToResultVMap.Resize( m_pMeshB->GetMaxVertexID(), nResultV );
+	for ( unsigned int vID = 0; vID < vVertexMap[1].size(); ++vID )
+		if ( vVertexMap[1][vID] != IMesh::InvalidID )
+			m_vBToResultVMap.SetMap( bPerturbed ? m_vPerturbedVMap.GetOld(vID) : vID, vVertexMap[1][vID] );
+
+	m_vAToResultTMap.Resize( m_pMeshA->GetMaxTriangleID(), nResultT );
+	m_vBToResultTMap.Resize( m_pMeshB->GetMaxTriangleID(), nResultT );
+	m_vResultFromBBitmap.resize( nResultT );
+	IMesh::TriangleID tResult = 0;
+	int s = 0;
+	for ( unsigned int k = 0; k < vResultSource.size(); ++k ) {
+		if ( vResultSource[k] == IMesh::InvalidID ) {
+			s = 1;
+			continue;
+		}
+		if ( s == 0 ) {
+			m_vAToResultTMap.SetMap( vResultSource[k], tResult );
+		} else {
+			m_vBToResultTMap.SetMap( bPerturbed ? m_vPerturbedTMap.GetOld(vResultSource[k]) : vResultSource[k], tResult );
+			m_vResultFromBBitmap.set( tResult, true );
+		}
+		++tResult;
+	}
+}
@@ -0,0 +1,147 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include <VFTriangleMesh.h>
+#include <IMeshBVTree.h>
+#include <BitSet.h>
+
+
+namespace rms {
+
+
+/*
+ * Union / intersection / difference of two closed meshes (consistently oriented, outward normals).
+ *
+ * Intersecting triangle pairs are found with a dual BVTree traversal (IMeshBVTree::FindIntersections),
+ * and each pair is classified with the exact Orient3D predicate. The points where an edge of one mesh
+ * crosses a triangle of the other are the vertices of the intersection curves. Each is computed once
+ * and shared by every triangle that contains it, so the cut meshes stitch together exactly. Cut
+ * triangles are re-triangulated (in parallel) with Triangulator2D, constrained to the curve segments.
+ *
+ * The pieces are then grouped into patches bounded by the curves. Patches that border a curve are
+ * classified from the orientation of the other mesh along it, only patches that don't touch any curve
+ * (eg a component completely inside the other mesh) need an IMeshBVTree::IsInside() query.
+ *
+ * Inputs that are not in general position (coplanar overlapping faces, a vertex exactly on the other
+ * surface, ...) are resolved by translating B by a tiny amount (relative to the bounding box) and
+ * trying again. The translated B positions are used in the result.
+ */
+class MeshBoolean
+{
+public:
+	enum Operation {
+		Union,
+		Intersection,
+		Difference			//! A minus B
+	};
+
+	MeshBoolean();
+	~MeshBoolean();
+
+	//! meshes are not modified. BVTrees are built on the first Compute() and re-used for further operations
+	void SetMeshes( rms::VFTriangleMesh * pMeshA, rms::VFTriangleMesh * pMeshB );
+
+	bool Compute( Operation eOp );
+
+	rms::VFTriangleMesh & ResultMesh() { return m_ResultMesh; }
+
+	//! GetOld() of a result vertex/triangle is its source in A (or B). A cut source triangle has several
+	//! result triangles, GetNew() returns one of them. Vertices on the intersection curves have no source.
+	const VertexMap & AToResultMap() const { return m_vAToResultVMap; }
+	const TriangleMap & AToResultTMap() const { return m_vAToResultTMap; }
+	const VertexMap & BToResultMap() const { return m_vBToResultVMap; }
+	const TriangleMap & BToResultTMap() const { return m_vBToResultTMap; }
+
+	//! per-face bits, set to 1 if result face is from B
+	const BitSet & ResultFromBTBits() const { return m_vResultFromBBitmap; }
+
+	//! result vertices on the intersection curves
+	const std::vector<IMesh::VertexID> & IntersectionVertices() const { return m_vIntersectionVerts; }
+
+	//! number of times B was translated to get out of a degenerate configuration in the last Compute()
+	int GetPerturbationCount() const { return m_nPerturbations; }
+
+protected:
+	rms::VFTriangleMesh * m_pMeshA;
+	rms::VFTriangleMesh * m_pMeshB;
+
+	rms::VFTriangleMesh m_ResultMesh;
+	VertexMap m_vAToResultVMap;
+	TriangleMap m_vAToResultTMap;
+	VertexMap m_vBToResultVMap;
+	TriangleMap m_vBToResultTMap;
+	BitSet m_vResultFromBBitmap;
+	std::vector<IMesh::VertexID> m_vIntersectionVerts;
+
+	// translated copy of B, and maps from B to the copy
+	enum { MaxPerturbations = 3 };
+	int m_nPerturbations;
+	rms::VFTriangleMesh m_PerturbedB;
+	VertexMap m_vPerturbedVMap;
+	TriangleMap m_vPerturbedTMap;
+	void PerturbB();
+
+	// point where edge eID of mesh nMesh crosses triangle tID of the other mesh
+	struct Crossing {
+		int nMesh;
+		IMesh::EdgeID eID;
+		IMesh::TriangleID tID;
+
+		bool operator<( const Crossing & c ) const
+			{ return nMesh < c.nMesh || (nMesh == c.nMesh && (eID < c.eID || (eID == c.eID && tID < c.tID))); }
+		bool operator==( const Crossing & c ) const
+			{ return nMesh == c.nMesh && eID == c.eID && tID == c.tID; }
+	};
+	std::vector<Crossing> m_vCrossings;
+	std::vector<Wml::Vector3d> m_vCrossingPos;
+
+	// intersecting triangle pair, and the segment of the intersection curves it contributes
+	struct PairCut {
+		IMesh::TriangleID tID[2];		// triangle of A, triangle of B
+		Crossing vEnds[2];
+		unsigned int nCrossing[2];		// indices into m_vCrossings
+	};
+	std::vector<PairCut> m_vCuts;
+	std::vector< std::pair<unsigned int, unsigned int> > m_vCurveEdges;		// sorted (min,max) crossing pairs
+
+	// triangle of a cut triangle's re-triangulation. nRef is a vertex of the mesh, or MaxVertexID + crossing index
+	struct Piece {
+		IMesh::TriangleID tSource;
+		unsigned int nRef[3];
+		int nVote;			// > 0 if locally inside the other mesh (along a curve segment), < 0 if outside
+	};
+
+	struct Side {
+		rms::VFTriangleMesh * pMesh;
+		IMeshBVTree tree;
+
+		std::vector<unsigned int> vCutIndex;		// per triangle, index into vCutTris or InvalidID
+		std::vector<IMesh::TriangleID> vCutTris;
+		std::vector<unsigned int> vCutStart;		// PairCuts of each cut triangle (CSR)
+		std::vector<unsigned int> vCutPairs;
+		std::vector<Piece> vPieces;
+
+		std::vector<unsigned char> vKeepTri;		// uncut triangles in result
+		std::vector<unsigned char> vKeepPiece;
+	};
+	Side m_Sides[2];
+
+	bool FindCuts();
+	bool ClassifyPair( IMesh::TriangleID tA, IMesh::TriangleID tB, PairCut & cut );
+	void ComputeCrossingPositions();
+
+	bool CutTriangles( int nSide );
+	bool CutTriangle( int nSide, unsigned int nCut, std::vector<Piece> & vPieces );
+
+	void ClassifyPatches( int nSide, bool bKeepInside );
+	void BuildResult( Operation eOp );
+};
+
+
+
+}   // end namespace rms
@@ -5,48 +5,298 @@
 #include "MeshFunction.h"
 #include "VectorUtil.h"
 #include "MeshUtils.h"
-#include "VertexWeights.h"
-#include <SparseSymmetricMatrixSolver.h>
+#include <SparseLinearSystem.h>
+#include <Solver_TAUCS.h>
 
 #include "rmsdebug.h"
 
+#include <algorithm>
+
 using namespace rms;
 
+
+namespace {
+struct Entry {
+	unsigned int i, j;
+	double w;
+	bool operator<( const Entry & e2 ) const
+		{ return (i < e2.i) || (i == e2.i && j < e2.j); }
+};
+}
+
 MeshVFunctionf::MeshVFunctionf(VFTriangleMesh * pMesh, IVertexFunctionf * pFunction)
-{ 
+{
 	m_pMesh = pMesh;
-	V = pFunction; 
+	V = pFunction;
 
+	m_eMode = Harmonic;
+	m_nValueStride = 0;
+	m_bConstraintSetChanged = false;
+	m_bSystemValid = false;
+	m_pSystem = NULL;
 	m_pSolver = NULL;
 }
 
+MeshVFunctionf::~MeshVFunctionf()
+{
+	delete m_pSolver;
+	delete m_pSystem;
+}
+
+
+gsi::SparseLinearSystem * MeshVFunctionf::GetSystem()
+{
+	if ( m_pSystem == NULL )
+		m_pSystem = new gsi::SparseLinearSystem();
+	return m_pSystem;
+}
 
-gsi::SparseSymmetricMatrixSolver * MeshVFunctionf::Solver()
+gsi::Solver_TAUCS * MeshVFunctionf::GetSolver()
 {
 	if ( m_pSolver == NULL )
-		m_pSolver = new gsi::SparseSymmetricMatrixSolver();
+		m_pSolver = new gsi::Solver_TAUCS(GetSystem());
 	return m_pSolver;
 }
 
 
+void MeshVFunctionf::SetInterpolationMode( InterpolationMode eMode )
+{
+	if ( m_eMode != eMode ) {
+		m_eMode = eMode;
+		InvalidateSystem();
+	}
+}
+
+void MeshVFunctionf::InvalidateSystem()
+{
+	m_bSystemValid = false;
+}
+
+
+
 void MeshVFunctionf::ClearConstraints()
 {
-	m_vConstraints.clear();
+	for ( unsigned int k = 0; k < m_vConstrained.size(); ++k )
+		m_vConstraintIndex[ m_vConstrained[k] ] = -1;
+	m_vConstrained.resize(0);
+	m_vConstraintValues.resize(0);
+	m_bConstraintSetChanged = true;
+}
+
+void MeshVFunctionf::ResizeConstraintValues( unsigned int nStride )
+{
+	if ( nStride == m_nValueStride )
+		return;
+	std::vector<float> vValues( m_vConstrained.size() * nStride, 0.0f );
+	unsigned int nCopy = std::min(nStride, m_nValueStride);
+	for ( unsigned int i = 0; i < m_vConstrained.size(); ++i )
+		for ( unsigned int k = 0; k < nCopy; ++k )
+			vValues[i*nStride + k] = m_vConstraintValues[i*m_nValueStride + k];
+	m_vConstraintValues.swap(vValues);
+	m_nValueStride = nStride;
 }
 
 void MeshVFunctionf::ConstrainValue( IMesh::VertexID vID, float * pValue, unsigned int nValueSize )
 {
-	Constraint c(vID);
-	std::set<Constraint>::iterator found = m_vConstraints.find(c);
-	if ( found == m_vConstraints.end() ) {
-		for ( unsigned int k = 0; k < nValueSize; ++k )
-			c.vValue.push_back( pValue[k] );
-		m_vConstraints.insert(c);
+	unsigned int nStride = std::max( m_nValueStride, nValueSize );
+	if ( V != NULL )
+		nStride = std::max( nStride, V->Components() );
+	ResizeConstraintValues(nStride);
+
+	if ( vID >= m_vConstraintIndex.size() )
+		m_vConstraintIndex.resize( std::max( (size_t)vID+1, (size_t)m_pMesh->GetMaxVertexID() ), -1 );
+	int nIndex = m_vConstraintIndex[vID];
+	if ( nIndex < 0 ) {
+		nIndex = (int)m_vConstrained.size();
+		m_vConstraintIndex[vID] = nIndex;
+		m_vConstrained.push_back(vID);
+		m_vConstraintValues.resize( m_vConstraintValues.size() + m_nValueStride, 0.0f );
+		m_bConstraintSetChanged = true;
+	}
+	for ( unsigned int k = 0; k < nValueSize; ++k )
+		m_vConstraintValues[nIndex*m_nValueStride + k] = pValue[k];
+}
+
+void MeshVFunctionf::RemoveConstraint( IMesh::VertexID vID )
+{
+	if ( ! IsConstrained(vID) )
+		return;
+	unsigned int nIndex = m_vConstraintIndex[vID];
+	unsigned int nLast = (unsigned int)m_vConstrained.size() - 1;
+	if ( nIndex != nLast ) {
+		m_vConstrained[nIndex] = m_vConstrained[nLast];
+		m_vConstraintIndex[ m_vConstrained[nIndex] ] = nIndex;
+		for ( unsigned int k = 0; k < m_nValueStride; ++k )
+			m_vConstraintValues[nIndex*m_nValueStride + k] = m_vConstraintValues[nLast*m_nValueStride + k];
+	}
+	m_vConstrained.pop_back();
+	m_vConstraintValues.resize( m_vConstrained.size() * m_nValueStride );
+	m_vConstraintIndex[vID] = -1;
+	m_bConstraintSetChanged = true;
+}
+
+
+
+bool MeshVFunctionf::UpdateSystem()
+{
+	unsigned int nMaxVID = m_pMesh->GetMaxVertexID();
+	if ( m_vConstraintIndex.size() < nMaxVID )
+		m_vConstraintIndex.resize( nMaxVID, -1 );
+
+	// compact vertex indices
+	std::vector<int> vIndex(nMaxVID, -1);
+	std::vector<IMesh::VertexID> vVertices;
+	VFTriangleMesh::vertex_iterator curv(m_pMesh->BeginVertices()), endv(m_pMesh->EndVertices());
+	while ( curv != endv ) {
+		vIndex[*curv] = (int)vVertices.size();
+		vVertices.push_back(*curv);
+		++curv;
+	}
+	unsigned int nVerts = (unsigned int)vVertices.size();
+
+	// symmetric cotangent weights (0.5 * cot of opposite angle, per triangle) and lumped areas
+	std::vector<Entry> vEntries;
+	vEntries.reserve( 6 * m_pMesh->GetTriangleCount() );
+	std::vector<double> vArea(nVerts, 0.0);
+	VFTriangleMesh::triangle_iterator curt(m_pMesh->BeginTriangles()), endt(m_pMesh->EndTriangles());
+	while ( curt != endt ) {
+		IMesh::VertexID vTri[3];
+		Wml::Vector3f vPos[3];
+		m_pMesh->GetTriangle(*curt, vTri);
+		m_pMesh->GetTriangle(*curt, vPos);
+		++curt;
+		double fArea = 0.5 * (vPos[1]-vPos[0]).Cross(vPos[2]-vPos[0]).Length();
+		for ( int k = 0; k < 3; ++k ) {
+			vArea[ vIndex[vTri[k]] ] += fArea / 3.0;
+			Wml::Vector3f e1( vPos[(k+1)%3] - vPos[k] ), e2( vPos[(k+2)%3] - vPos[k] );
+			float fSin = e1.Cross(e2).Length();
+			if ( fSin < 1e-12f )
+				continue;
+			Entry e;
+			e.i = vIndex[vTri[(k+1)%3]];  e.j = vIndex[vTri[(k+2)%3]];
+			e.w = 0.5 * (double)e1.Dot(e2) / (double)fSin;
+			vEntries.push_back(e);
+			std::swap(e.i, e.j);
+			vEntries.push_back(e);
+		}
+	}
+	std::sort( vEntries.begin(), vEntries.end() );
+
+	// L = D - W, as CSR with the diagonal first in each row
+	std::vector<unsigned int> vLStart(nVerts+1, 0), vLCol;
+	std::vector<double> vLValue;
+	vLCol.reserve( vEntries.size()/2 + nVerts );
+	vLValue.reserve( vEntries.size()/2 + nVerts );
+	unsigned int nEntry = 0;
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		vLStart[i] = (unsigned int)vLCol.size();
+		vLCol.push_back(i);
+		vLValue.push_back(0.0);
+		double fSum = 0;
+		while ( nEntry < vEntries.size() && vEntries[nEntry].i == i ) {
+			unsigned int j = vEntries[nEntry].j;
+			double w = 0;
+			while ( nEntry < vEntries.size() && vEntries[nEntry].i == i && vEntries[nEntry].j == j )
+				w += vEntries[nEntry++].w;
+			vLCol.push_back(j);
+			vLValue.push_back(-w);
+			fSum += w;
+		}
+		vLValue[ vLStart[i] ] = fSum;
+	}
+	vLStart[nVerts] = (unsigned int)vLCol.size();
+	std::vector<Entry>().swap(vEntries);
+
+	// system matrix
+	std::vector<unsigned int> vAStart, vACol;
+	std::vector<double> vAValue;
+	if ( m_eMode == Harmonic ) {
+		vAStart.swap(vLStart);  vACol.swap(vLCol);  vAValue.swap(vLValue);
 	} else {
-		Constraint & f = const_cast<Constraint&>(*found);
-		for ( unsigned int k = 0; k < nValueSize; ++k )
-			f.vValue[k] = pValue[k];	
+		double fAvgArea = 0;
+		for ( unsigned int i = 0; i < nVerts; ++i )
+			fAvgArea += vArea[i];
+		fAvgArea = (nVerts > 0) ? fAvgArea / nVerts : 1.0;
+		for ( unsigned int i = 0; i < nVerts; ++i )
+			if ( vArea[i] <= 1e-12 * fAvgArea )
+				vArea[i] = fAvgArea;
+
+		// A = L M^-1 L
+		std::vector<int> vMarker(nVerts, -1);
+		vAStart.resize(nVerts+1);
+		for ( unsigned int i = 0; i < nVerts; ++i ) {
+			unsigned int nRowStart = (unsigned int)vACol.size();
+			vAStart[i] = nRowStart;
+			for ( unsigned int a = vLStart[i]; a < vLStart[i+1]; ++a ) {
+				unsigned int k = vLCol[a];
+				double fScale = vLValue[a] / vArea[k];
+				for ( unsigned int b = vLStart[k]; b < vLStart[k+1]; ++b ) {
+					unsigned int j = vLCol[b];
+					if ( vMarker[j] < (int)nRowStart ) {
+						vMarker[j] = (int)vACol.size();
+						vACol.push_back(j);
+						vAValue.push_back(0.0);
+					}
+					vAValue[ vMarker[j] ] += fScale * vLValue[b];
+				}
+			}
+		}
+		vAStart[nVerts] = (unsigned int)vACol.size();
 	}
+
+	// eliminate constrained vertices
+	std::vector<int> vRow(nVerts, -1);
+	m_vFreeVertices.resize(0);
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		if ( m_vConstraintIndex[vVertices[i]] < 0 ) {
+			vRow[i] = (int)m_vFreeVertices.size();
+			m_vFreeVertices.push_back(vVertices[i]);
+		}
+	}
+	unsigned int nFree = (unsigned int)m_vFreeVertices.size();
+
+	gsi::SparseLinearSystem * pSystem = GetSystem();
+	pSystem->Resize(nFree, nFree);
+	m_vCouplingStart.resize(nFree+1);
+	m_vCouplingVertex.resize(0);
+	m_vCouplingWeight.resize(0);
+	for ( unsigned int i = 0; i < nVerts; ++i ) {
+		int ri = vRow[i];
+		if ( ri < 0 )
+			continue;
+		m_vCouplingStart[ri] = (unsigned int)m_vCouplingVertex.size();
+		bool bHasDiagonal = false;
+		for ( unsigned int a = vAStart[i]; a < vAStart[i+1]; ++a ) {
+			unsigned int j = vACol[a];
+			int rj = vRow[j];
+			if ( rj < 0 ) {
+				m_vCouplingVertex.push_back( vVertices[j] );
+				m_vCouplingWeight.push_back( vAValue[a] );
+			} else if ( j == i ) {
+				if ( vAValue[a] != 0 ) {
+					pSystem->Set(ri, ri, vAValue[a]);
+					bHasDiagonal = true;
+				}
+			} else if ( j > i ) {
+				// only upper triangle is used, so the matrix is exactly symmetric
+				pSystem->Set(ri, rj, vAValue[a]);
+				pSystem->Set(rj, ri, vAValue[a]);
+			}
+		}
+		if ( ! bHasDiagonal )
+			pSystem->Set(ri, ri, 1.0);		// isolated vertex
+	}
+	m_vCouplingStart[nFree] = (unsigned int)m_vCouplingVertex.size();
+
+	GetSolver()->OnMatrixChanged();
+	GetSolver()->SetStoreFactorization(true);
+	GetSolver()->SetSolverMode( gsi::Solver_TAUCS::TAUCS_LLT );
+	GetSolver()->SetOrderingMode( gsi::Solver_TAUCS::TAUCS_METIS );
+
+	m_vFactoredConstraints = m_vConstrained;
+	std::sort( m_vFactoredConstraints.begin(), m_vFactoredConstraints.end() );
+	m_bSystemValid = true;
+	return true;
 }
 
 
@@ -56,59 +306,70 @@ bool MeshVFunctionf::SolveDirichlet(  )
 	if ( V == NULL )
 		return false;
 
-	gsi::SparseSymmetricMatrixSolver * pSolver = Solver();
-
-	// make linear list of vertices (some could be missing)
-	std::vector<IMesh::VertexID> vID;
-	std::vector<unsigned int> reverseMap(m_pMesh->GetMaxVertexID());
 	VFTriangleMesh::vertex_iterator curv(m_pMesh->BeginVertices()), endv(m_pMesh->EndVertices());
 	while ( curv != endv ) {
-		vID.push_back( *curv ); 
-		reverseMap[*curv] = (unsigned int)vID.size()-1;
-
-		if ( m_pMesh->IsBoundaryVertex(*curv) && m_vConstraints.find(Constraint(*curv)) == m_vConstraints.end() )
+		if ( m_pMesh->IsBoundaryVertex(*curv) && ! IsConstrained(*curv) )
 			return false;	// all boundary verts need to be constrained
-
 		++curv;
 	}
-	unsigned int nVerts = (unsigned int)vID.size();
+
+	return Solve();
+}
+
+
+bool MeshVFunctionf::Solve()
+{
+	if ( V == NULL || m_vConstrained.empty() )
+		return false;
 	unsigned int nRHS = V->Components();
+	ResizeConstraintValues( std::max(m_nValueStride, nRHS) );
 
-	// build sparse matrix
-	pSolver->Resize(nVerts, nVerts);
-	pSolver->ResizeRHS( nRHS );
+	// re-use the factorization if the constrained vertex set is the same
+	if ( m_bConstraintSetChanged && m_bSystemValid ) {
+		std::vector<IMesh::VertexID> vSorted(m_vConstrained);
+		std::sort( vSorted.begin(), vSorted.end() );
+		if ( vSorted != m_vFactoredConstraints )
+			m_bSystemValid = false;
+	}
+	m_bConstraintSetChanged = false;
+	if ( ! m_bSystemValid && ! UpdateSystem() )
+		return false;
 
-	// set interior rows
-	std::vector<IMesh::VertexID> vOneRing;
-	std::vector<float> vWeights;
-	for ( unsigned int i = 0; i < nVerts; ++i ) {
-		std::set<Constraint>::iterator found = m_vConstraints.find(Constraint(vID[i]));
-		if ( found == m_vConstraints.end() ) {
-			m_pMesh->VertexOneRing( vID[i], vOneRing, true );
-			VertexWeights::Cotangent(*m_pMesh, vID[i], vOneRing, vWeights);
-			size_t nOneRing = vOneRing.size();
-			for ( unsigned int j = 0; j < nOneRing; ++j ) {
-				pSolver->Set( i, reverseMap[vOneRing[j]], -vWeights[j] );
-				pSolver->Set( i, i, 1.0f );		// weights sum to 1
+	unsigned int nFree = (unsigned int)m_vFreeVertices.size();
+	if ( nFree > 0 ) {
+		// RHS is -A_fc * x_c, for all components at once
+		std::vector<double> vRHS( nFree * nRHS, 0.0 );
+		#pragma omp parallel for
+		for ( int ri = 0; ri < (int)nFree; ++ri ) {
+			double * pRHS = &vRHS[ri * nRHS];
+			for ( unsigned int a = m_vCouplingStart[ri]; a < m_vCouplingStart[ri+1]; ++a ) {
+				const float * pValue = &m_vConstraintValues[ m_vConstraintIndex[m_vCouplingVertex[a]] * m_nValueStride ];
+				for ( unsigned int k = 0; k < nRHS; ++k )
+					pRHS[k] -= m_vCouplingWeight[a] * (double)pValue[k];
 			}
+		}
+
+		gsi::SparseLinearSystem * pSystem = GetSystem();
+		pSystem->ResizeRHS( nRHS );
+		for ( unsigned int ri = 0; ri < nFree; ++ri )
 			for ( unsigned int k = 0; k < nRHS; ++k )
-				pSolver->SetRHS(i, 0, k);
-		} else {
-			// Constraint & c = *found;
-			pSolver->Set(i, i, 1.0f);
+				pSystem->SetRHS( ri, vRHS[ri*nRHS + k], k );
+
+		if ( ! GetSolver()->Solve() )
+			return false;
+
+		for ( unsigned int ri = 0; ri < nFree; ++ri ) {
 			for ( unsigned int k = 0; k < nRHS; ++k )
-				pSolver->SetRHS(i, found->vValue[k], k );
+				(*V)(m_vFreeVertices[ri],k) = (float)pSystem->GetSolution(ri, k);
 		}
 	}
 
-	if ( ! pSolver->Solve() )
-		return false;
-
-	for ( unsigned int i = 0; i < nVerts; ++i ) {
+	for ( unsigned int i = 0; i < m_vConstrained.size(); ++i ) {
+		if ( ! m_pMesh->IsVertex(m_vConstrained[i]) )
+			continue;
 		for ( unsigned int k = 0; k < nRHS; ++k )
-			(*V)(vID[i],k) = (float)pSolver->GetSolution(i, k);
+			(*V)(m_vConstrained[i],k) = m_vConstraintValues[i*m_nValueStride + k];
 	}
 
 	return true;
 }
-
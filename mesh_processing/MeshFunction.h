@@ -11,14 +11,24 @@
 
 // predecl to avoid include
 namespace gsi {
-	class SparseSymmetricMatrixSolver;
+	class SparseLinearSystem;
+	class Solver_TAUCS;
 };
 
 
 namespace rms {
 
 
-
+/*
+ * Harmonic / biharmonic interpolation of constrained vertex values.
+ *
+ * Constrained vertices are eliminated from the (symmetric, cotangent-weighted) system, which
+ * is factored once per constraint set. Changing only constraint values re-uses the factorization,
+ * so a re-solve is just a back-substitution. All components of V are solved as one multi-RHS solve.
+ *
+ * The factorization is also re-used if the constraints are cleared and the same set of vertices is
+ * constrained again. Call InvalidateSystem() if the mesh changes.
+ */
 class MeshVFunctionf
 {
 public:
@@ -26,31 +36,59 @@ public:
 	IVertexFunctionf * V;
 
 	MeshVFunctionf(VFTriangleMesh * pMesh, IVertexFunctionf * pFunction);
+	~MeshVFunctionf();
+
+	enum InterpolationMode {
+		Harmonic,			//! minimizes Dirichlet energy (L x = 0)
+		Biharmonic			//! minimizes Laplacian energy (L M^-1 L x = 0), smooth across constraints
+	};
+	void SetInterpolationMode( InterpolationMode eMode );
+	InterpolationMode GetInterpolationMode() const { return m_eMode; }
 
 	void ClearConstraints();
 	void ConstrainValue( IMesh::VertexID vID, float * pValue, unsigned int nValueSize = 1 );
+	void RemoveConstraint( IMesh::VertexID vID );
+	bool IsConstrained( IMesh::VertexID vID ) const
+		{ return vID < m_vConstraintIndex.size() && m_vConstraintIndex[vID] >= 0; }
 
 	//! interpolates boundary values to interior. Can also constrain interior vertices.
 	bool SolveDirichlet();
 
-protected:
+	//! interpolates constraint values. Unconstrained boundary vertices have natural boundary conditions
+	bool Solve();
 
-	struct Constraint {
-		IMesh::VertexID vID;
-		std::vector<float> vValue;
-		bool operator<(const Constraint & c2 ) const 
-			{ return vID < c2.vID; }
-		Constraint() 
-			{ vID = IMesh::InvalidID; }
-		Constraint(IMesh::VertexID id) 
-			{ vID = id; }
-	};
-	std::set<Constraint> m_vConstraints;
+	//! discard the factorization (call after the mesh changes)
+	void InvalidateSystem();
+	bool HasFactorization() const { return m_bSystemValid; }
 
-	gsi::SparseSymmetricMatrixSolver * m_pSolver;
-	gsi::SparseSymmetricMatrixSolver * Solver();
+protected:
+	InterpolationMode m_eMode;
+
+	// constraint values, V->Components() values per constraint
+	std::vector<int> m_vConstraintIndex;				//! per vertex, index into m_vConstrained or -1
+	std::vector<IMesh::VertexID> m_vConstrained;
+	std::vector<float> m_vConstraintValues;
+	unsigned int m_nValueStride;
+	bool m_bConstraintSetChanged;
+
+	// factored system: free vertices are rows, constrained vertices are moved to the RHS
+	bool m_bSystemValid;
+	std::vector<IMesh::VertexID> m_vFactoredConstraints;	//! sorted
+	std::vector<IMesh::VertexID> m_vFreeVertices;
+	std::vector<unsigned int> m_vCouplingStart;			//! per free vertex, into m_vCouplingVertex / m_vCouplingWeight
+	std::vector<IMesh::VertexID> m_vCouplingVertex;
+	std::vector<double> m_vCouplingWeight;
+
+	gsi::SparseLinearSystem * m_pSystem;
+	gsi::SparseLinearSystem * GetSystem();
+
+	gsi::Solver_TAUCS * m_pSolver;
+	gsi::Solver_TAUCS * GetSolver();
+
+	void ResizeConstraintValues( unsigned int nStride );
+	bool UpdateSystem();
 };
 
 
 
-}   // end namespace rms
\ No newline at end of file
+}   // end namespace rms
@@ -6,6 +6,9 @@
 #include "MeshGeodesic.h"
 #include <limits>
 #include <Wm4DistVector3Segment3.h>
+#include <TriangleKernels.h>
+#include <algorithm>
+#include <map>
 
 #include "rmsdebug.h"
 
@@ -253,6 +256,298 @@ void MeshGeodesic::Transport( const Wml::Vector2f & vDirectionIn, const rms::Fra
 
 }
 
+
+
+void MeshGeodesic::MakeStations( float fLength, float fSpacing, std::vector<float> & vStations )
+{
+	vStations.resize(0);
+	if ( fLength < 0 )
+		fLength = 0;
+	if ( fSpacing > 0 ) {
+		for ( unsigned int k = 0; (float)k * fSpacing < fLength; ++k )
+			vStations.push_back( (float)k * fSpacing );
+	}
+	vStations.push_back(fLength);
+}
+
+
+bool MeshGeodesic::TransportFrame( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection, float fLength,
+								   rms::Frame3f & vResult, TransportCache * pCache )
+{
+	float fStation = (fLength > 0) ? fLength : 0;
+	return WalkTransport( vStart, vDirection, &fStation, 1, &vResult, pCache );
+}
+
+bool MeshGeodesic::TransportFrame( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection, const std::vector<float> & vStations,
+								   std::vector<rms::Frame3f> & vResult, TransportCache * pCache )
+{
+	vResult.resize( vStations.size(), vStart );
+	if ( vStations.empty() )
+		return true;
+	return WalkTransport( vStart, vDirection, &vStations[0], (unsigned int)vStations.size(), &vResult[0], pCache );
+}
+
+
+void MeshGeodesic::TransportBatch( const std::vector<TransportJob> & vJobs, std::vector<rms::Frame3f> & vFrames,
+								   std::vector<unsigned int> & vFrameStart, std::vector<bool> * pReachedEnd )
+{
+	unsigned int nJobs = (unsigned int)vJobs.size();
+
+	// stations for all jobs, stored in the same layout as the frames
+	std::vector<float> vStations, vJobStations;
+	vFrameStart.resize(nJobs+1);
+	vFrameStart[0] = 0;
+	for ( unsigned int i = 0; i < nJobs; ++i ) {
+		MakeStations( vJobs[i].fLength, vJobs[i].fStationSpacing, vJobStations );
+		vStations.insert( vStations.end(), vJobStations.begin(), vJobStations.end() );
+		vFrameStart[i+1] = (unsigned int)vStations.size();
+	}
+	vFrames.resize( vStations.size() );
+
+	// group jobs into tasks: one per stroke (jobs in input order), one per independent job
+	std::map<int, unsigned int> vStrokeTask;
+	std::vector<unsigned int> vTaskOf(nJobs), vTaskCount;
+	for ( unsigned int i = 0; i < nJobs; ++i ) {
+		int nStroke = vJobs[i].nStroke;
+		if ( nStroke >= 0 ) {
+			std::map<int, unsigned int>::iterator found = vStrokeTask.find(nStroke);
+			if ( found == vStrokeTask.end() ) {
+				vStrokeTask[nStroke] = (unsigned int)vTaskCount.size();
+				vTaskCount.push_back(0);
+			}
+			vTaskOf[i] = vStrokeTask[nStroke];
+		} else {
+			vTaskOf[i] = (unsigned int)vTaskCount.size();
+			vTaskCount.push_back(0);
+		}
+		vTaskCount[vTaskOf[i]]++;
+	}
+	int nTasks = (int)vTaskCount.size();
+	std::vector<unsigned int> vTaskStart(nTasks+1, 0), vTaskJobs(nJobs);
+	for ( int t = 0; t < nTasks; ++t )
+		vTaskStart[t+1] = vTaskStart[t] + vTaskCount[t];
+	std::vector<unsigned int> vFill( vTaskStart.begin(), vTaskStart.end()-1 );
+	for ( unsigned int i = 0; i < nJobs; ++i )
+		vTaskJobs[ vFill[vTaskOf[i]]++ ] = i;
+
+	// strokes are independent, jobs within a stroke share the walk cache
+	std::vector<unsigned char> vReachedEnd(nJobs, 0);
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int t = 0; t < nTasks; ++t ) {
+		TransportCache cache;
+		for ( unsigned int k = vTaskStart[t]; k < vTaskStart[t+1]; ++k ) {
+			unsigned int i = vTaskJobs[k];
+			const TransportJob & job = vJobs[i];
+			unsigned int nStart = vFrameStart[i];
+			vReachedEnd[i] = WalkTransport( job.vStart, job.vDirection, &vStations[nStart], vFrameStart[i+1] - nStart, &vFrames[nStart], &cache ) ? 1 : 0;
+		}
+	}
+
+	if ( pReachedEnd ) {
+		pReachedEnd->resize(nJobs);
+		for ( unsigned int i = 0; i < nJobs; ++i )
+			(*pReachedEnd)[i] = (vReachedEnd[i] != 0);
+	}
+}
+
+
+rms::IMesh::TriangleID MeshGeodesic::LocateStart( const Wml::Vector3f & vPoint, TransportCache * pCache )
+{
+	// consecutive samples of a stroke are usually close, so walk from the cached triangle towards the point
+	rms::IMesh::TriangleID tID = (pCache) ? pCache->tStart : rms::IMesh::InvalidID;
+	const int nMaxLocateSteps = 32;
+	for ( int k = 0; k < nMaxLocateSteps && m_pMesh->IsTriangle(tID); ++k ) {
+		Wml::Vector3f vTri[3];
+		m_pMesh->GetTriangle(tID, vTri);
+		float fBary[3];
+		rms::BarycentricCoords( vTri[0], vTri[1], vTri[2], vPoint, fBary[0], fBary[1], fBary[2] );
+		int nMin = 0;
+		for ( int j = 1; j < 3; ++j )
+			if ( fBary[j] < fBary[nMin] )
+				nMin = j;
+		if ( fBary[nMin] >= -0.0001f ) {
+			Wml::Vector3f vNormal = (vTri[1]-vTri[0]).UnitCross(vTri[2]-vTri[0]);
+			float fMaxEdgeSqr = std::max( (vTri[1]-vTri[0]).SquaredLength(), std::max( (vTri[2]-vTri[1]).SquaredLength(), (vTri[0]-vTri[2]).SquaredLength() ) );
+			float fPlaneDist = vNormal.Dot(vPoint - vTri[0]);
+			if ( fPlaneDist*fPlaneDist <= 0.0001f * fMaxEdgeSqr ) {
+				if ( pCache )
+					pCache->tStart = tID;
+				return tID;
+			}
+			break;
+		}
+
+		// cross the edge opposite the most-negative barycentric coordinate
+		rms::IMesh::TriangleID vNbrs[3];
+		m_pMesh->FindNeighbours(tID, vNbrs);
+		tID = vNbrs[ (nMin+1) % 3 ];
+	}
+
+	// BVTree expands lazily, so queries are serialized
+	rms::IMesh::TriangleID tNearest = rms::IMesh::InvalidID;
+	#pragma omp critical(MeshGeodesic_BVTree)
+	{
+		Wml::Vector3f vNearest;
+		if ( ! m_pBVTree->FindNearest(vPoint, vNearest, tNearest) )
+			tNearest = rms::IMesh::InvalidID;
+	}
+	if ( pCache )
+		pCache->tStart = tNearest;
+	return tNearest;
+}
+
+
+namespace {
+//! rotate v about unit axis k by the angle with the given cos/sin
+inline Wml::Vector3f RotateAboutAxis( const Wml::Vector3f & v, const Wml::Vector3f & k, float fCos, float fSin )
+{
+	return v*fCos + k.Cross(v)*fSin + k*( k.Dot(v) * (1.0f - fCos) );
+}
+
+//! frame at vPoint in the current triangle, with Z aligned to the interpolated vertex normal
+void MakeTransportFrame( const rms::Frame3f & vStart, const Wml::Vector3f & vPoint, const Wml::Vector3f vTri[3], const Wml::Vector3f vNormals[3],
+						 const Wml::Vector3f & vX, const Wml::Vector3f & vY, const Wml::Vector3f & vFaceNormal, rms::Frame3f & vFrame )
+{
+	vFrame = vStart;
+	vFrame.Origin() = vPoint;
+	vFrame.SetFrame( vX, vY, vFaceNormal );
+
+	float fBary[3];
+	rms::BarycentricCoords( vTri[0], vTri[1], vTri[2], vPoint, fBary[0], fBary[1], fBary[2] );
+	Wml::Vector3f vNormal = fBary[0]*vNormals[0] + fBary[1]*vNormals[1] + fBary[2]*vNormals[2];
+	if ( vNormal.Normalize() > Wml::Mathf::ZERO_TOLERANCE )
+		vFrame.AlignZAxis(vNormal);
+}
+}
+
+
+bool MeshGeodesic::WalkTransport( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection,
+								  const float * pStations, unsigned int nStations, rms::Frame3f * pFrames, TransportCache * pCache )
+{
+	rms::IMesh::TriangleID tID = LocateStart( vStart.Origin(), pCache );
+	if ( tID == rms::IMesh::InvalidID ) {
+		for ( unsigned int k = 0; k < nStations; ++k )
+			pFrames[k] = vStart;
+		return false;
+	}
+
+	rms::IMesh::VertexID nTri[3];
+	Wml::Vector3f vTri[3], vNormals[3];
+	m_pMesh->GetTriangle(tID, nTri);
+	m_pMesh->GetTriangle(tID, vTri, vNormals);
+
+	// start on the triangle, with the frame rotated into its plane
+	float fBary[3];
+	rms::PointTriangleSqrDistance( vStart.Origin(), vTri[0], vTri[1], vTri[2], fBary );
+	Wml::Vector3f vPoint = fBary[0]*vTri[0] + fBary[1]*vTri[1] + fBary[2]*vTri[2];
+	Wml::Vector3f vFaceNormal = (vTri[1]-vTri[0]).UnitCross(vTri[2]-vTri[0]);
+
+	rms::Frame3f vAligned(vStart);
+	vAligned.AlignZAxis(vFaceNormal);
+	Wml::Vector3f vX = vAligned.X(), vY = vAligned.Y();
+	Wml::Vector3f vDir = vDirection.X()*vX + vDirection.Y()*vY;
+	vDir -= vDir.Dot(vFaceNormal) * vFaceNormal;
+	if ( vDir.Normalize() < Wml::Mathf::ZERO_TOLERANCE )
+		vDir = Wml::Vector3f::ZERO;
+
+	const int nMaxSteps = 4 * (int)m_pMesh->GetTriangleCount() + 16;
+	float fOrientation = 1.0f;		// -1 while walking over triangles with flipped orientation
+	int nEnterEdge = -1;
+	float fTravelled = 0;
+	unsigned int k = 0;
+	bool bReachedEnd = true;
+	for ( int nStep = 0; k < nStations; ++nStep ) {
+
+		// distance to the exit edge. Edge j is [j,j+1], its in-plane normal m points towards the opposite vertex
+		float fExit = std::numeric_limits<float>::max();
+		int nExit = -1;
+		for ( int j = 0; j < 3; ++j ) {
+			if ( j == nEnterEdge )
+				continue;
+			const Wml::Vector3f & a = vTri[j];
+			Wml::Vector3f m = vFaceNormal.Cross( vTri[(j+1)%3] - a );
+			if ( m.Normalize() < Wml::Mathf::ZERO_TOLERANCE )
+				continue;
+			if ( m.Dot( vTri[(j+2)%3] - a ) < 0 )
+				m = -m;
+			float fRate = vDir.Dot(m);
+			if ( fRate >= 0 )
+				continue;
+			float fHeight = std::max( 0.0f, m.Dot(vPoint - a) );
+			float fDist = fHeight / -fRate;
+			if ( fDist < fExit ) {
+				fExit = fDist;
+				nExit = j;
+			}
+		}
+
+		// emit the stations inside this triangle
+		while ( k < nStations && pStations[k] - fTravelled <= fExit ) {
+			Wml::Vector3f vStation = vPoint + (pStations[k] - fTravelled) * vDir;
+			MakeTransportFrame( vStart, vStation, vTri, vNormals, vX, vY, vFaceNormal, pFrames[k] );
+			++k;
+		}
+		if ( k == nStations )
+			break;
+
+		rms::IMesh::TriangleID vNbrs[3];
+		m_pMesh->FindNeighbours(tID, vNbrs);
+		if ( nExit < 0 || vNbrs[nExit] == rms::IMesh::InvalidID || nStep >= nMaxSteps ) {
+			if ( nExit >= 0 ) {
+				vPoint += fExit * vDir;
+				fTravelled += fExit;
+			}
+			bReachedEnd = false;
+			break;
+		}
+
+		// move to the exit edge and cross into the neighbour
+		vPoint += fExit * vDir;
+		fTravelled += fExit;
+		rms::IMesh::VertexID vEdgeA = nTri[nExit], vEdgeB = nTri[(nExit+1)%3];
+		Wml::Vector3f vAxis = vTri[(nExit+1)%3] - vTri[nExit];
+		vAxis.Normalize();
+
+		tID = vNbrs[nExit];
+		m_pMesh->GetTriangle(tID, nTri);
+		m_pMesh->GetTriangle(tID, vTri, vNormals);
+		nEnterEdge = 0;
+		for ( int j = 0; j < 3; ++j ) {
+			if ( (nTri[j] == vEdgeA && nTri[(j+1)%3] == vEdgeB) || (nTri[j] == vEdgeB && nTri[(j+1)%3] == vEdgeA) )
+				nEnterEdge = j;
+		}
+
+		// rotate frame and direction about the edge, from the old face normal to the new one. If the
+		// neighbour's orientation differs (edge has the same direction in both) its normal is flipped,
+		// so the dihedral angle is taken from the side that unfolds the two triangles into a plane
+		if ( nTri[nEnterEdge] == vEdgeA )
+			fOrientation = -fOrientation;
+		Wml::Vector3f vNewNormal = fOrientation * (vTri[1]-vTri[0]).UnitCross(vTri[2]-vTri[0]);
+		float fCos = vFaceNormal.Dot(vNewNormal);
+		float fSin = vFaceNormal.Cross(vNewNormal).Dot(vAxis);
+		vX = RotateAboutAxis(vX, vAxis, fCos, fSin);
+		vY = RotateAboutAxis(vY, vAxis, fCos, fSin);
+		vDir = RotateAboutAxis(vDir, vAxis, fCos, fSin);
+		vFaceNormal = vNewNormal;
+
+		// remove drift
+		vDir -= vDir.Dot(vFaceNormal) * vFaceNormal;
+		vDir.Normalize();
+		vX -= vX.Dot(vFaceNormal) * vFaceNormal;
+		vX.Normalize();
+		vY -= vY.Dot(vFaceNormal) * vFaceNormal;
+		vY -= vY.Dot(vX) * vX;
+		vY.Normalize();
+	}
+
+	// stopped at the boundary - remaining stations stay at the last point
+	for ( ; k < nStations; ++k )
+		MakeTransportFrame( vStart, vPoint, vTri, vNormals, vX, vY, vFaceNormal, pFrames[k] );
+
+	return bReachedEnd;
+}
+
+
 void MeshGeodesic::GetEndpoints( rms::Frame3f & vEndPoint1, rms::Frame3f & vEndPoint2 )
 {
 	vEndPoint1 = m_vOptPath.front();
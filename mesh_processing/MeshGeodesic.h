@@ -29,6 +29,46 @@ public:
 	void DoOptimizeStep() { OptimizePath(); }
 
 	void Transport( const Wml::Vector2f & vDirection, const rms::Frame3f * pPrevFrame = NULL );	
+
+
+	/*
+	 * Triangle-walk transport: moves a frame along the straightest geodesic that leaves vStart in
+	 * vDirection (in the X/Y plane of vStart), rotating it about each crossed edge (discrete parallel
+	 * transport). Result frames have Z aligned to the interpolated vertex normal. This only reads the
+	 * mesh (the ExpMapGenerator is not used), so many jobs can run at once.
+	 */
+
+	//! walk state kept between consecutive samples of a stroke
+	struct TransportCache {
+		rms::IMesh::TriangleID tStart;		//! triangle containing the last start point
+		TransportCache() { tStart = rms::IMesh::InvalidID; }
+	};
+
+	//! returns false if the walk stopped at the mesh boundary (vResult is then the frame at the boundary)
+	bool TransportFrame( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection, float fLength,
+		rms::Frame3f & vResult, TransportCache * pCache = NULL );
+
+	//! polyline mode: one frame per arc-length station (ascending), all from a single walk
+	bool TransportFrame( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection, const std::vector<float> & vStations,
+		std::vector<rms::Frame3f> & vResult, TransportCache * pCache = NULL );
+
+	struct TransportJob {
+		rms::Frame3f vStart;
+		Wml::Vector2f vDirection;
+		float fLength;
+		float fStationSpacing;		//! if > 0, frames at 0, s, 2s, ... and fLength are returned. Otherwise just the end frame
+		int nStroke;				//! jobs with the same stroke ID (>= 0) run in order and share a TransportCache. -1 if independent
+		TransportJob() : vDirection(Wml::Vector2f::UNIT_X) { fLength = 0;  fStationSpacing = 0;  nStroke = -1; }
+	};
+
+	//! runs strokes (and independent jobs) in parallel. The frames of job i are vFrames[ vFrameStart[i] .. vFrameStart[i+1] ).
+	//! Results are identical to calling TransportFrame() on the jobs of each stroke in order, with one TransportCache per stroke.
+	void TransportBatch( const std::vector<TransportJob> & vJobs, std::vector<rms::Frame3f> & vFrames,
+		std::vector<unsigned int> & vFrameStart, std::vector<bool> * pReachedEnd = NULL );
+
+	//! arc-length stations used for fStationSpacing > 0
+	static void MakeStations( float fLength, float fSpacing, std::vector<float> & vStations );
+
 	void GetEndpoints( rms::Frame3f & vEndPoint1, rms::Frame3f & vEndPoint2 );
 
 	void Render(const Wml::ColorRGBA & cEdgeColor, bool bDrawDijkstraPath = true, bool bDrawEndpoints = true);
@@ -52,6 +92,10 @@ protected:
 	std::vector< rms::Frame3f > m_vDijkstraPath;
 
 	void OptimizePath();
+
+	rms::IMesh::TriangleID LocateStart( const Wml::Vector3f & vPoint, TransportCache * pCache );
+	bool WalkTransport( const rms::Frame3f & vStart, const Wml::Vector2f & vDirection,
+		const float * pStations, unsigned int nStations, rms::Frame3f * pFrames, TransportCache * pCache );
 	std::vector< rms::Frame3f > m_vOptPath;
 	std::vector< Wml::Vector2f > m_vLocalUVs;
 };
@@ -5,6 +5,11 @@
 #include "MeshInsertion.h"
 #include "VectorUtil.h"
 #include "MeshUtils.h"
+#include "ExactPredicates.h"
+#include <Wm4AxisAlignedBox2.h>
+
+#include <algorithm>
+#include <cmath>
 
 #include "rmsdebug.h"
 
@@ -15,12 +20,18 @@ MeshInsertion::MeshInsertion()
 	m_pInsertMesh = NULL;
 	m_pDestMesh = NULL;
 	m_pProjector = NULL;
+	m_bThreadSafeProjector = false;
 
 	m_bUseHoleHack = false;
 	m_nUseSingleInsertionLoop = -1;
 	m_fInsertionScale = 1.0f;
 }
 
+MeshInsertion::~MeshInsertion()
+{
+	ClearBatch();
+}
+
 
 bool MeshInsertion::SetDestMesh( rms::VFTriangleMesh * pDestMesh )
 {
@@ -112,15 +123,11 @@ bool MeshInsertion::Compute()
 			trigen.AddHole( m_vHoleHack[0], m_vHoleHack[1] );
 
 		} else {
-			IMesh::EdgeID eID = m_pInsertMesh->FindEdge(m_vInsertLoops[li][0], m_vInsertLoops[li][1]);
-			IMesh::VertexID edgeV[2];  IMesh::VertexID edgeT[2];
-			m_pInsertMesh->GetEdge( eID, edgeV, edgeT);
-			Wml::Vector2f vTriUV[3];
-			if ( ! m_pInsertMesh->GetTriangleUV( (edgeT[0] == IMesh::InvalidID) ? edgeT[1] : edgeT[0], 0, vTriUV ) )
+			Wml::Vector2f vCentroid;
+			if ( ! FindInsertHole( m_pInsertMesh, m_vInsertLoops[li], vCentroid ) )
 				return false;
-			Wml::Vector2f vCentroid = (vTriUV[0] + vTriUV[1] + vTriUV[2]) / 3.0f;
 			//vCentroid *= m_fInsertionScale;
-			vCentroid = (vCentroid-m_vInsertionOrigin) * m_fInsertionScale + m_vInsertionOrigin;
+			vCentroid = ToInsertUV( vCentroid, m_fInsertionScale, m_vInsertionOrigin );
 			trigen.AddHole( vCentroid[0], vCentroid[1] );
 		}
 	}
@@ -199,42 +206,601 @@ bool MeshInsertion::Compute()
 }
 
 
+bool MeshInsertion::FindInsertHole( rms::VFTriangleMesh * pInsertMesh, const std::vector<IMesh::VertexID> & vLoop, Wml::Vector2f & vHole )
+{
+	// centroid of the insert triangle on the first loop edge (in un-scaled insert UV)
+	IMesh::EdgeID eID = pInsertMesh->FindEdge(vLoop[0], vLoop[1]);
+	IMesh::VertexID edgeV[2];  IMesh::VertexID edgeT[2];
+	pInsertMesh->GetEdge( eID, edgeV, edgeT);
+	Wml::Vector2f vTriUV[3];
+	if ( ! pInsertMesh->GetTriangleUV( (edgeT[0] == IMesh::InvalidID) ? edgeT[1] : edgeT[0], 0, vTriUV ) )
+		return false;
+	vHole = (vTriUV[0] + vTriUV[1] + vTriUV[2]) / 3.0f;
+	return true;
+}
+
+
 bool MeshInsertion::ProjectInsertInterior()
+{
+	return ProjectInterior( m_pInsertMesh, m_fInsertionScale, m_vInsertionOrigin, m_vInsertToMergeVMap, m_vInsertBdryToMergeMap );
+}
+
+void MeshInsertion::CopyInsertInterior(bool bIncludeBoundary)
+{
+	CopyInterior( m_pInsertMesh, m_vInsertToMergeVMap, m_vInsertBdryToMergeMap, bIncludeBoundary );
+}
+
+
+bool MeshInsertion::ProjectInterior( rms::VFTriangleMesh * pInsertMesh, float fScale, const Wml::Vector2f & vOrigin,
+									 const VertexMap & vInsertToMerge, const VertexMap & vBdryToMerge )
 {
 	// project interior of inserted mesh to 3D using UV coordinates
-	VFTriangleMesh::vertex_iterator curs(m_pInsertMesh->BeginVertices()), ends(m_pInsertMesh->EndVertices());
+	VFTriangleMesh::vertex_iterator curs(pInsertMesh->BeginVertices()), ends(pInsertMesh->EndVertices());
 	while ( curs != ends ) {
 		IMesh::VertexID vInsertID = *curs++;
-		if ( m_vInsertBdryToMergeMap.GetNew(vInsertID) != IMesh::InvalidID )
+		if ( vBdryToMerge.GetNew(vInsertID) != IMesh::InvalidID )
 			continue;
 
 		Wml::Vector2f vUV;
-		if (! m_pInsertMesh->GetUV( vInsertID, 0, vUV ) ) {
+		if (! pInsertMesh->GetUV( vInsertID, 0, vUV ) ) {
 			lgBreakToDebugger();
 			return false;
 		}
 		//vUV *= m_fInsertionScale;
-		vUV = (vUV-m_vInsertionOrigin) * m_fInsertionScale + m_vInsertionOrigin;
+		vUV = ToInsertUV( vUV, fScale, vOrigin );
 		Wml::Vector3f vNormal;
 		Wml::Vector3f vXYZ = m_pProjector->ProjectTo3D(vUV, &vNormal);
-		m_MergedMesh.SetVertex( m_vInsertToMergeVMap.GetNew(vInsertID), vXYZ, &vNormal);
+		m_MergedMesh.SetVertex( vInsertToMerge.GetNew(vInsertID), vXYZ, &vNormal);
 	}
 
 	return true;
 }
 
 
-void MeshInsertion::CopyInsertInterior(bool bIncludeBoundary)
+void MeshInsertion::CopyInterior( rms::VFTriangleMesh * pInsertMesh, const VertexMap & vInsertToMerge, 
+								  const VertexMap & vBdryToMerge, bool bIncludeBoundary )
 {
-	VFTriangleMesh::vertex_iterator curv(m_pInsertMesh->BeginVertices()), endv(m_pInsertMesh->EndVertices());
+	VFTriangleMesh::vertex_iterator curv(pInsertMesh->BeginVertices()), endv(pInsertMesh->EndVertices());
 	while ( curv != endv ) {
 		IMesh::VertexID vInsertID = *curv++;
-		if ( !bIncludeBoundary && m_vInsertBdryToMergeMap.GetNew(vInsertID) != IMesh::InvalidID )
+		if ( !bIncludeBoundary && vBdryToMerge.GetNew(vInsertID) != IMesh::InvalidID )
 			continue;
 
 		Wml::Vector3f vVtx, vNormal;
-		m_pInsertMesh->GetVertex(vInsertID, vVtx, &vNormal);
-		m_MergedMesh.SetVertex( m_vInsertToMergeVMap.GetNew(vInsertID), vVtx, &vNormal );
+		pInsertMesh->GetVertex(vInsertID, vVtx, &vNormal);
+		m_MergedMesh.SetVertex( vInsertToMerge.GetNew(vInsertID), vVtx, &vNormal );
+	}
+
+}
+
+
+
+
+/*
+ * batch insertion
+ */
+
+void MeshInsertion::ClearBatch()
+{
+	for ( unsigned int i = 0; i < m_vBatch.size(); ++i )
+		delete m_vBatch[i];
+	m_vBatch.resize(0);
+}
+
+
+unsigned int MeshInsertion::AddBatchInsert( rms::VFTriangleMesh * pInsertMesh, float fScale, const Wml::Vector2f & vInsertionOrigin )
+{
+	BatchInsert * pInsert = new BatchInsert();
+	pInsert->pMesh = pInsertMesh;
+	pInsert->fScale = fScale;
+	pInsert->vOrigin = vInsertionOrigin;
+	MeshUtils::FindBoundaryLoops( *pInsertMesh, pInsert->vLoops );
+	m_vBatch.push_back(pInsert);
+	return (unsigned int)m_vBatch.size() - 1;
+}
+
+
+// coarse grid of insert footprints, so that each dest triangle only tests nearby inserts
+class MeshInsertion_FootprintGrid
+{
+public:
+	MeshInsertion_FootprintGrid( const std::vector<Wml::AxisAlignedBox2f> & vBoxes ) 
+		: m_vBoxes(vBoxes)
+	{
+		m_bounds = vBoxes[0];
+		for ( unsigned int i = 1; i < vBoxes.size(); ++i ) {
+			for ( int j = 0; j < 2; ++j ) {
+				m_bounds.Min[j] = std::min(m_bounds.Min[j], vBoxes[i].Min[j]);
+				m_bounds.Max[j] = std::max(m_bounds.Max[j], vBoxes[i].Max[j]);
+			}
+		}
+		m_nCells = (int)ceil( sqrt( (double)vBoxes.size() ) );
+		for ( int j = 0; j < 2; ++j ) {
+			m_fCellSize[j] = (m_bounds.Max[j] - m_bounds.Min[j]) / (float)m_nCells;
+			if ( m_fCellSize[j] <= 0.0f )
+				m_fCellSize[j] = 1.0f;
+		}
+		m_vCells.resize( m_nCells*m_nCells );
+		for ( unsigned int i = 0; i < vBoxes.size(); ++i ) {
+			int nMin[2], nMax[2];
+			CellRange( vBoxes[i], nMin, nMax );
+			for ( int yi = nMin[1]; yi <= nMax[1]; ++yi )
+				for ( int xi = nMin[0]; xi <= nMax[0]; ++xi )
+					m_vCells[ yi*m_nCells + xi ].push_back(i);
+		}
+	}
+
+	//! indices of footprints overlapping box, in increasing order
+	void Find( const Wml::AxisAlignedBox2f & box, std::vector<unsigned int> & vHits ) const
+	{
+		vHits.resize(0);
+		if ( ! box.TestIntersection(m_bounds) )
+			return;
+		int nMin[2], nMax[2];
+		CellRange( box, nMin, nMax );
+		for ( int yi = nMin[1]; yi <= nMax[1]; ++yi ) {
+			for ( int xi = nMin[0]; xi <= nMax[0]; ++xi ) {
+				const std::vector<unsigned int> & vCell = m_vCells[ yi*m_nCells + xi ];
+				for ( unsigned int k = 0; k < vCell.size(); ++k )
+					if ( box.TestIntersection( m_vBoxes[vCell[k]] ) )
+						vHits.push_back( vCell[k] );
+			}
+		}
+		if ( vHits.size() > 1 ) {
+			std::sort( vHits.begin(), vHits.end() );
+			vHits.erase( std::unique( vHits.begin(), vHits.end() ), vHits.end() );
+		}
+	}
+
+protected:
+	const std::vector<Wml::AxisAlignedBox2f> & m_vBoxes;
+	Wml::AxisAlignedBox2f m_bounds;
+	int m_nCells;
+	float m_fCellSize[2];
+	std::vector< std::vector<unsigned int> > m_vCells;
+
+	void CellRange( const Wml::AxisAlignedBox2f & box, int nMin[2], int nMax[2] ) const
+	{
+		for ( int j = 0; j < 2; ++j ) {
+			nMin[j] = (int)( (box.Min[j] - m_bounds.Min[j]) / m_fCellSize[j] );
+			nMax[j] = (int)( (box.Max[j] - m_bounds.Min[j]) / m_fCellSize[j] );
+			nMin[j] = std::max( 0, std::min( nMin[j], m_nCells-1 ) );
+			nMax[j] = std::max( 0, std::min( nMax[j], m_nCells-1 ) );
+		}
+	}
+};
+
+
+static int MeshInsertion_FindRoot( std::vector<int> & vParent, int i )
+{
+	while ( vParent[i] != i ) {
+		vParent[i] = vParent[ vParent[i] ];
+		i = vParent[i];
+	}
+	return i;
+}
+
+static void MeshInsertion_Union( std::vector<int> & vParent, int a, int b )
+{
+	a = MeshInsertion_FindRoot(vParent, a);
+	b = MeshInsertion_FindRoot(vParent, b);
+	if ( a < b )
+		vParent[b] = a;
+	else if ( b < a )
+		vParent[a] = b;
+}
+
+
+// counter-clockwise convex hull of a subset of UV points (monotone chain), packed x,y
+static bool MeshInsertion_HullLess( const Wml::Vector2f & a, const Wml::Vector2f & b )
+{
+	return a.X() < b.X() || ( a.X() == b.X() && a.Y() < b.Y() );
+}
+static void MeshInsertion_ConvexHull( const std::vector<Wml::Vector2f> & vUV, const std::vector<IMesh::VertexID> & vVerts, std::vector<double> & vHull )
+{
+	std::vector<Wml::Vector2f> vPoints( vVerts.size() );
+	for ( unsigned int k = 0; k < vVerts.size(); ++k )
+		vPoints[k] = vUV[vVerts[k]];
+	std::sort( vPoints.begin(), vPoints.end(), MeshInsertion_HullLess );
+
+	int nPoints = (int)vPoints.size();
+	std::vector<double> vPacked( 2*nPoints );
+	for ( int k = 0; k < nPoints; ++k ) {
+		vPacked[2*k] = vPoints[k].X();
+		vPacked[2*k+1] = vPoints[k].Y();
 	}
 
-}
\ No newline at end of file
+	// lower hull left-to-right, then upper hull right-to-left
+	std::vector<int> vChain( 2*nPoints + 1 );
+	int nChain = 0;
+	for ( int k = 0; k < nPoints; ++k ) {
+		while ( nChain >= 2 && Orient2D( &vPacked[2*vChain[nChain-2]], &vPacked[2*vChain[nChain-1]], &vPacked[2*k] ) <= 0 )
+			--nChain;
+		vChain[nChain++] = k;
+	}
+	int nLower = nChain + 1;
+	for ( int k = nPoints-2; k >= 0; --k ) {
+		while ( nChain >= nLower && Orient2D( &vPacked[2*vChain[nChain-2]], &vPacked[2*vChain[nChain-1]], &vPacked[2*k] ) <= 0 )
+			--nChain;
+		vChain[nChain++] = k;
+	}
+	if ( nChain > 0 )
+		--nChain;		// last point repeats the first
+
+	vHull.resize( 2*nChain );
+	for ( int k = 0; k < nChain; ++k ) {
+		vHull[2*k] = vPacked[ 2*vChain[k] ];
+		vHull[2*k+1] = vPacked[ 2*vChain[k]+1 ];
+	}
+}
+
+
+static const int MeshInsertion_DestOffset = 10;		// Triangle uses markers 0/1 internally
+
+
+bool MeshInsertion::ComputeBatch()
+{
+	m_MergedMesh.Clear(false);
+	m_vDestToMergeMap.Clear();
+	m_vMergeInsertBitmap.clear();
+	int nInserts = (int)m_vBatch.size();
+	if ( m_pDestMesh == NULL || m_pProjector == NULL || nInserts == 0 )
+		return false;
+
+	unsigned int nMaxVID = m_pDestMesh->GetMaxVertexID();
+	unsigned int nMaxTID = m_pDestMesh->GetMaxTriangleID();
+
+	// dense dest UVs, so triangle tests below don't go through GetUV
+	std::vector<Wml::Vector2f> vDestUV( nMaxVID, Wml::Vector2f::ZERO );
+	VFTriangleMesh::vertex_iterator curd(m_pDestMesh->BeginVertices()), endd(m_pDestMesh->EndVertices());	
+	while ( curd != endd ) {
+		IMesh::VertexID vID = *curd++;
+		if (! m_pDestMesh->GetUV(vID, 0, vDestUV[vID]) )
+			return false;
+	}
+
+	// footprint of each insert is the UV-bounds of its (scaled) boundary loops
+	std::vector<Wml::AxisAlignedBox2f> vFootprints(nInserts);
+	for ( int i = 0; i < nInserts; ++i ) {
+		BatchInsert & insert = *m_vBatch[i];
+		if ( insert.vLoops.empty() )
+			return false;
+		bool bFirst = true;
+		for ( unsigned int li = 0; li < insert.vLoops.size(); ++li ) {
+			for ( unsigned int k = 0; k < insert.vLoops[li].size(); ++k ) {
+				Wml::Vector2f vUV;
+				if ( ! insert.pMesh->GetUV( insert.vLoops[li][k], 0, vUV ) )
+					return false;
+				vUV = ToInsertUV( vUV, insert.fScale, insert.vOrigin );
+				if ( bFirst ) {
+					vFootprints[i] = Wml::AxisAlignedBox2f( vUV.X(), vUV.X(), vUV.Y(), vUV.Y() );
+					bFirst = false;
+				} else {
+					for ( int j = 0; j < 2; ++j ) {
+						vFootprints[i].Min[j] = std::min( vFootprints[i].Min[j], vUV[j] );
+						vFootprints[i].Max[j] = std::max( vFootprints[i].Max[j], vUV[j] );
+					}
+				}
+			}
+		}
+	}
+	MeshInsertion_FootprintGrid grid( vFootprints );
+
+	// assign dest triangles to the first footprint they overlap. Triangles overlapping
+	// several footprints are flagged, and join those inserts into one region below
+	std::vector<int> vTriRegion( nMaxTID, -1 );
+	std::vector<unsigned char> vTriShared( nMaxTID, 0 );
+	#pragma omp parallel
+	{
+		std::vector<unsigned int> vHits;
+		#pragma omp for schedule(static)
+		for ( int ti = 0; ti < (int)nMaxTID; ++ti ) {
+			if ( ! m_pDestMesh->IsTriangle(ti) )
+				continue;
+			IMesh::VertexID nTri[3];
+			m_pDestMesh->GetTriangle( ti, nTri );
+			Wml::AxisAlignedBox2f box( vDestUV[nTri[0]].X(), vDestUV[nTri[0]].X(), vDestUV[nTri[0]].Y(), vDestUV[nTri[0]].Y() );
+			for ( int j = 1; j < 3; ++j ) {
+				for ( int k = 0; k < 2; ++k ) {
+					box.Min[k] = std::min( box.Min[k], vDestUV[nTri[j]][k] );
+					box.Max[k] = std::max( box.Max[k], vDestUV[nTri[j]][k] );
+				}
+			}
+			grid.Find( box, vHits );
+			if ( ! vHits.empty() ) {
+				vTriRegion[ti] = vHits[0];
+				vTriShared[ti] = ( vHits.size() > 1 ) ? 1 : 0;
+			}
+		}
+	}
+
+	std::vector<int> vParent( nInserts );
+	for ( int i = 0; i < nInserts; ++i )
+		vParent[i] = i;
+	std::vector<unsigned int> vHits;
+	for ( unsigned int ti = 0; ti < nMaxTID; ++ti ) {
+		if ( ! vTriShared[ti] )
+			continue;
+		IMesh::VertexID nTri[3];
+		m_pDestMesh->GetTriangle( ti, nTri );
+		Wml::AxisAlignedBox2f box( vDestUV[nTri[0]].X(), vDestUV[nTri[0]].X(), vDestUV[nTri[0]].Y(), vDestUV[nTri[0]].Y() );
+		for ( int j = 1; j < 3; ++j ) {
+			for ( int k = 0; k < 2; ++k ) {
+				box.Min[k] = std::min( box.Min[k], vDestUV[nTri[j]][k] );
+				box.Max[k] = std::max( box.Max[k], vDestUV[nTri[j]][k] );
+			}
+		}
+		grid.Find( box, vHits );
+		for ( unsigned int k = 1; k < vHits.size(); ++k )
+			MeshInsertion_Union( vParent, vHits[0], vHits[k] );
+	}
+
+	// grow each region by the one-ring of its vertices, so insert loops stay clear of the
+	// region boundary. Regions that meet are merged.
+	std::vector<int> vVtxRegion( nMaxVID, -1 );
+	for ( unsigned int ti = 0; ti < nMaxTID; ++ti ) {
+		if ( vTriRegion[ti] < 0 )
+			continue;
+		IMesh::VertexID nTri[3];
+		m_pDestMesh->GetTriangle( ti, nTri );
+		for ( int j = 0; j < 3; ++j ) {
+			if ( vVtxRegion[nTri[j]] < 0 )
+				vVtxRegion[nTri[j]] = vTriRegion[ti];
+			else
+				MeshInsertion_Union( vParent, vVtxRegion[nTri[j]], vTriRegion[ti] );
+		}
+	}
+	for ( unsigned int ti = 0; ti < nMaxTID; ++ti ) {
+		if ( ! m_pDestMesh->IsTriangle(ti) )
+			continue;
+		IMesh::VertexID nTri[3];
+		m_pDestMesh->GetTriangle( ti, nTri );
+		for ( int j = 0; j < 3; ++j ) {
+			int nVtxRegion = vVtxRegion[nTri[j]];
+			if ( nVtxRegion < 0 )
+				continue;
+			if ( vTriRegion[ti] < 0 )
+				vTriRegion[ti] = nVtxRegion;
+			else
+				MeshInsertion_Union( vParent, vTriRegion[ti], nVtxRegion );
+		}
+	}
+
+	// collect regions
+	std::vector<BatchRegion> vRegions;
+	std::vector<int> vRootRegion( nInserts, -1 );
+	for ( int i = 0; i < nInserts; ++i ) {
+		int nRoot = MeshInsertion_FindRoot( vParent, i );
+		if ( vRootRegion[nRoot] < 0 ) {
+			vRootRegion[nRoot] = (int)vRegions.size();
+			vRegions.push_back( BatchRegion() );
+		}
+		vRegions[ vRootRegion[nRoot] ].vInserts.push_back(i);
+	}
+	for ( unsigned int ti = 0; ti < nMaxTID; ++ti ) {
+		if ( vTriRegion[ti] < 0 )
+			continue;
+		vTriRegion[ti] = vRootRegion[ MeshInsertion_FindRoot( vParent, vTriRegion[ti] ) ];
+		vRegions[ vTriRegion[ti] ].vTris.push_back(ti);
+	}
+
+	// re-triangulate regions independently, in parallel (triangle.c state is per-thread)
+	int nRegions = (int)vRegions.size();
+	int nSourceOffset = MeshInsertion_DestOffset + (int)nMaxVID;
+	#pragma omp parallel for schedule(dynamic,1) if(nRegions > 1)
+	for ( int ri = 0; ri < nRegions; ++ri )
+		TriangulateRegion( vRegions[ri], vDestUV, vTriRegion, ri, nSourceOffset );
+
+	bool bOK = true;
+	unsigned int nNewMaxVID = nMaxVID;
+	for ( int ri = 0; ri < nRegions; ++ri ) {
+		if ( ! vRegions[ri].bOK )
+			bOK = false;
+		nNewMaxVID += (unsigned int)vRegions[ri].output.vPointMarkers.size();
+	}
+	for ( int i = 0; i < nInserts; ++i )
+		nNewMaxVID += m_vBatch[i]->pMesh->GetMaxVertexID();
+	if ( ! bOK ) {
+		lgBreakToDebugger();
+		return false;
+	}
+
+	// copy dest vertices and the triangles outside all regions
+	m_vDestToMergeMap.Resize( nMaxVID, nNewMaxVID );
+	curd = m_pDestMesh->BeginVertices();
+	while ( curd != endd ) {
+		IMesh::VertexID vID = *curd++;
+		Wml::Vector3f vVtx, vNormal;
+		m_pDestMesh->GetVertex(vID, vVtx, &vNormal);
+		m_vDestToMergeMap.SetMap( vID, m_MergedMesh.AppendVertex(vVtx, &vNormal) );
+	}
+	for ( unsigned int ti = 0; ti < nMaxTID; ++ti ) {
+		if ( vTriRegion[ti] >= 0 || ! m_pDestMesh->IsTriangle(ti) )
+			continue;
+		IMesh::VertexID nTri[3];
+		m_pDestMesh->GetTriangle( ti, nTri );
+		m_MergedMesh.AppendTriangle( m_vDestToMergeMap.GetNew(nTri[0]), m_vDestToMergeMap.GetNew(nTri[1]), m_vDestToMergeMap.GetNew(nTri[2]) );
+	}
+
+	// append region triangulations. New vertices are projected to 3D, as in Compute()
+	for ( int i = 0; i < nInserts; ++i ) 
+		m_vBatch[i]->vInsertBdryToMergeMap.Resize( m_vBatch[i]->pMesh->GetMaxVertexID(), nNewMaxVID );
+	std::vector<IMesh::VertexID> vPointMap;
+	for ( int ri = 0; ri < nRegions; ++ri ) {
+		BatchRegion & region = vRegions[ri];
+		const std::vector<int> & vMarkers = region.output.vPointMarkers;
+		unsigned int nPoints = (unsigned int)vMarkers.size();
+		vPointMap.resize( nPoints );
+		for ( unsigned int k = 0; k < nPoints; ++k ) {
+			int nMarker = vMarkers[k];
+			if ( nMarker >= MeshInsertion_DestOffset && nMarker < nSourceOffset ) {
+				vPointMap[k] = m_vDestToMergeMap.GetNew( nMarker - MeshInsertion_DestOffset );
+				continue;
+			}
+			Wml::Vector2f vUV( (float)region.output.vPoints[2*k], (float)region.output.vPoints[2*k+1] );
+			Wml::Vector3f vNormal;
+			Wml::Vector3f vXYZ = m_pProjector->ProjectTo3D(vUV, &vNormal);
+			vPointMap[k] = m_MergedMesh.AppendVertex( vXYZ, &vNormal );
+			if ( nMarker >= nSourceOffset ) {
+				const std::pair<unsigned int, IMesh::VertexID> & insertV = region.vInsertVerts[ nMarker - nSourceOffset ];
+				m_vBatch[insertV.first]->vInsertBdryToMergeMap.SetMap( insertV.second, vPointMap[k] );
+			}
+		}
+
+		// triangle.c output is counter-clockwise in UV. Match dest winding if the dest UVs are flipped.
+		double fArea = 0;
+		for ( unsigned int k = 0; k < region.vTris.size(); ++k ) {
+			IMesh::VertexID nTri[3];
+			m_pDestMesh->GetTriangle( region.vTris[k], nTri );
+			Wml::Vector2f e1 = vDestUV[nTri[1]] - vDestUV[nTri[0]], e2 = vDestUV[nTri[2]] - vDestUV[nTri[0]];
+			fArea += e1.X()*e2.Y() - e1.Y()*e2.X();
+		}
+		bool bFlip = ( fArea < 0 );
+
+		const std::vector<int> & vTriangles = region.output.vTriangles;
+		for ( unsigned int k = 0; k < vTriangles.size(); k += 3 ) {
+			if ( bFlip )
+				m_MergedMesh.AppendTriangle( vPointMap[vTriangles[k]], vPointMap[vTriangles[k+2]], vPointMap[vTriangles[k+1]] );
+			else
+				m_MergedMesh.AppendTriangle( vPointMap[vTriangles[k]], vPointMap[vTriangles[k+1]], vPointMap[vTriangles[k+2]] );
+		}
+	}
+
+	// append inserted meshes, merging boundary vertices
+	std::vector< std::pair<unsigned int, unsigned int> > vInsertTris( nInserts );
+	for ( int i = 0; i < nInserts; ++i ) {
+		BatchInsert & insert = *m_vBatch[i];
+		vInsertTris[i].first = m_MergedMesh.GetMaxTriangleID();
+		m_MergedMesh.Append( *insert.pMesh, insert.vInsertToMergeVMap, &insert.vInsertToMergeTMap, &insert.vInsertBdryToMergeMap );
+		vInsertTris[i].second = m_MergedMesh.GetMaxTriangleID();
+	}
+
+	m_vMergeInsertBitmap.resize( m_MergedMesh.GetMaxTriangleID() );
+	for ( int i = 0; i < nInserts; ++i ) {
+		for ( unsigned int k = vInsertTris[i].first; k < vInsertTris[i].second; ++k ) {
+			if ( m_vBatch[i]->vInsertToMergeTMap.GetOld(k) != IMesh::InvalidID )
+				m_vMergeInsertBitmap.set(k, true);
+		}
+	}
+
+	return true;
+}
+
+
+
+void MeshInsertion::TriangulateRegion( BatchRegion & region, const std::vector<Wml::Vector2f> & vDestUV, 
+									   const std::vector<int> & vTriRegion, int nRegion, int nSourceOffset )
+{
+	region.bOK = false;
+	if ( region.vTris.empty() )
+		return;
+
+	rms::Triangulator2D trigen;
+
+	// all dest vertices of region triangles
+	std::vector<IMesh::VertexID> vVerts;
+	vVerts.reserve( 3*region.vTris.size() );
+	for ( unsigned int k = 0; k < region.vTris.size(); ++k ) {
+		IMesh::VertexID nTri[3];
+		m_pDestMesh->GetTriangle( region.vTris[k], nTri );
+		vVerts.push_back(nTri[0]);  vVerts.push_back(nTri[1]);  vVerts.push_back(nTri[2]);
+	}
+	std::sort( vVerts.begin(), vVerts.end() );
+	vVerts.erase( std::unique( vVerts.begin(), vVerts.end() ), vVerts.end() );
+	for ( unsigned int k = 0; k < vVerts.size(); ++k )
+		trigen.AddPoint( vDestUV[vVerts[k]].X(), vDestUV[vVerts[k]].Y(), vVerts[k] + MeshInsertion_DestOffset );
+
+	// region boundary edges are segments. Any dest triangles enclosed by the region are kept out
+	// with a hole in each outside neighbour that lies inside the hull of the region (triangle.c
+	// carves everything else from the hull inwards, and can fail to locate holes just outside it)
+	std::vector<double> vHull;
+	MeshInsertion_ConvexHull( vDestUV, vVerts, vHull );
+	unsigned int nHull = (unsigned int)vHull.size() / 2;
+	for ( unsigned int k = 0; k < region.vTris.size(); ++k ) {
+		IMesh::TriangleID tID = region.vTris[k];
+		IMesh::VertexID nTri[3];  IMesh::TriangleID nNbrs[3];
+		m_pDestMesh->GetTriangle( tID, nTri );
+		m_pDestMesh->FindNeighbours( tID, nNbrs );
+		for ( int j = 0; j < 3; ++j ) {
+			if ( nNbrs[j] != IMesh::InvalidID && vTriRegion[nNbrs[j]] == nRegion )
+				continue;
+			int a = (int)( std::lower_bound( vVerts.begin(), vVerts.end(), nTri[j] ) - vVerts.begin() );
+			int b = (int)( std::lower_bound( vVerts.begin(), vVerts.end(), nTri[(j+1)%3] ) - vVerts.begin() );
+			trigen.AddSegment( a, b );
+			if ( nNbrs[j] != IMesh::InvalidID ) {
+				IMesh::VertexID nOut[3];
+				m_pDestMesh->GetTriangle( nNbrs[j], nOut );
+				Wml::Vector2f vCentroid = ( vDestUV[nOut[0]] + vDestUV[nOut[1]] + vDestUV[nOut[2]] ) / 3.0f;
+				double vHole[2] = { vCentroid[0], vCentroid[1] };
+				bool bInside = ( nHull > 2 );
+				for ( unsigned int hi = 0; hi < nHull && bInside; ++hi )
+					bInside = Orient2D( &vHull[2*hi], &vHull[2*((hi+1)%nHull)], vHole ) > 0;
+				if ( bInside )
+					trigen.AddHole( vHole[0], vHole[1] );
+			}
+		}
+	}
+
+	// insert loops, with a hole inside each
+	for ( unsigned int ii = 0; ii < region.vInserts.size(); ++ii ) {
+		BatchInsert & insert = *m_vBatch[ region.vInserts[ii] ];
+		for ( unsigned int li = 0; li < insert.vLoops.size(); ++li ) {
+			const std::vector<IMesh::VertexID> & vLoop = insert.vLoops[li];
+			int nLoop = (int)vLoop.size();
+			unsigned int nPrev = -1;  unsigned int nFirst = -1;
+			for ( int k = 0; k < nLoop; ++k ) {
+				Wml::Vector2f vUV;
+				if (! insert.pMesh->GetUV(vLoop[k], 0, vUV) )
+					return;
+				vUV = ToInsertUV( vUV, insert.fScale, insert.vOrigin );
+				int nMarker = nSourceOffset + (int)region.vInsertVerts.size();
+				region.vInsertVerts.push_back( std::pair<unsigned int, IMesh::VertexID>( region.vInserts[ii], vLoop[k] ) );
+				unsigned int nCur = trigen.AddPoint( vUV[0], vUV[1], nMarker );
+				if ( nPrev != -1 )
+					trigen.AddSegment( nPrev, nCur );
+				nPrev = nCur;
+				if ( nFirst == -1 )  
+					nFirst = nCur;
+			}
+			trigen.AddSegment( nPrev, nFirst );
+
+			Wml::Vector2f vCentroid;
+			if ( ! FindInsertHole( insert.pMesh, vLoop, vCentroid ) )
+				return;
+			vCentroid = ToInsertUV( vCentroid, insert.fScale, insert.vOrigin );
+			trigen.AddHole( vCentroid[0], vCentroid[1] );
+		}
+	}
+
+	trigen.SetEnclosingSegmentsProvided(true);
+	trigen.SetSubdivideAnySegments(false);
+	if ( ! trigen.Compute() )
+		return;
+
+	region.output = trigen.GetOutputData();
+	region.bOK = true;
+}
+
+
+bool MeshInsertion::ProjectBatchInteriors()
+{
+	// inserts write disjoint sets of merge vertices
+	int nInserts = (int)m_vBatch.size();
+	int nFailed = 0;
+	#pragma omp parallel for schedule(dynamic,1) reduction(+:nFailed) if(m_bThreadSafeProjector && nInserts > 1)
+	for ( int i = 0; i < nInserts; ++i ) {
+		BatchInsert & insert = *m_vBatch[i];
+		if ( ! ProjectInterior( insert.pMesh, insert.fScale, insert.vOrigin, insert.vInsertToMergeVMap, insert.vInsertBdryToMergeMap ) )
+			++nFailed;
+	}
+	return nFailed == 0;
+}
+
+
+void MeshInsertion::CopyBatchInteriors(bool bIncludeBoundary)
+{
+	for ( unsigned int i = 0; i < m_vBatch.size(); ++i ) {
+		BatchInsert & insert = *m_vBatch[i];
+		CopyInterior( insert.pMesh, insert.vInsertToMergeVMap, insert.vInsertBdryToMergeMap, bIncludeBoundary );
+	}
+}
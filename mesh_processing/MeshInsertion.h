@@ -23,6 +23,7 @@ class MeshInsertion
 {
 public:
 	MeshInsertion();
+	~MeshInsertion();
 
 	bool SetDestMesh( rms::VFTriangleMesh * pDestMesh );
 
@@ -30,6 +31,9 @@ public:
 	void SetInsertionScale( float fScale, const Wml::Vector2f & vInsertionOrigin = Wml::Vector2f::ZERO );
 
 	void Set3DProjector( ISurfaceProjector * pProjector );
+	//! if the projector can be called from several threads at once, ProjectBatchInteriors() projects the inserts in parallel.
+	//! Default false (eg ExpMapGenerator::Find3D is not thread-safe)
+	void SetThreadSafeProjector( bool bThreadSafe ) { m_bThreadSafeProjector = bThreadSafe; }
 
 	rms::VFTriangleMesh & MergeMesh() { return m_MergedMesh; }
 	const VertexMap & InsertToMergeMap() const { return m_vInsertToMergeVMap; }
@@ -47,6 +51,29 @@ public:
 
 	void CopyInsertInterior(bool bIncludeBoundary = false);
 
+
+	/*
+	 * Batch insertion: insert many meshes into the dest mesh in one pass. Dest triangles near each
+	 * insert footprint (UV-bounds, grown by a one-ring) form a region, and overlapping regions are
+	 * merged. Only the regions are re-triangulated, in parallel, and the untouched dest triangles
+	 * are copied once. Each insert's interior only touches its own merge vertices, so ProjectBatchInteriors()
+	 * handles the inserts in parallel (if SetThreadSafeProjector()). MergeMesh() / DestToMergeMap() / InsertToMergeTBits() hold the combined result,
+	 * per-insert maps are available via the Batch*() accessors. SetHoleHack/SetUseInsertLoopHack are not used.
+	 */
+	void ClearBatch();
+	unsigned int AddBatchInsert( rms::VFTriangleMesh * pInsertMesh, float fScale = 1.0f, const Wml::Vector2f & vInsertionOrigin = Wml::Vector2f::ZERO );
+	unsigned int GetBatchCount() const { return (unsigned int)m_vBatch.size(); }
+
+	bool ComputeBatch();
+
+	bool ProjectBatchInteriors();
+
+	void CopyBatchInteriors(bool bIncludeBoundary = false);
+
+	const VertexMap & BatchInsertToMergeMap( unsigned int i ) const { return m_vBatch[i]->vInsertToMergeVMap; }
+	const TriangleMap & BatchInsertToMergeTMap( unsigned int i ) const { return m_vBatch[i]->vInsertToMergeTMap; }
+	const VertexMap & BatchInsertBdryToMergeMap( unsigned int i ) const { return m_vBatch[i]->vInsertBdryToMergeMap; }
+
 protected:
 	rms::VFTriangleMesh * m_pDestMesh;			// initial mesh, with UV coordinates for all vertices
 
@@ -68,11 +95,51 @@ protected:
 
 	// projection to 3D mesh
 	ISurfaceProjector * m_pProjector;
+	bool m_bThreadSafeProjector;
 
 	bool m_bUseHoleHack;
 	Wml::Vector2f m_vHoleHack;
 
 	int m_nUseSingleInsertionLoop;
+
+	Wml::Vector2f ToInsertUV( const Wml::Vector2f & vUV, float fScale, const Wml::Vector2f & vOrigin ) const
+		{ return (vUV-vOrigin) * fScale + vOrigin; }
+	bool FindInsertHole( rms::VFTriangleMesh * pInsertMesh, const std::vector<IMesh::VertexID> & vLoop, Wml::Vector2f & vHole );
+	bool ProjectInterior( rms::VFTriangleMesh * pInsertMesh, float fScale, const Wml::Vector2f & vOrigin,
+						  const VertexMap & vInsertToMerge, const VertexMap & vBdryToMerge );
+	void CopyInterior( rms::VFTriangleMesh * pInsertMesh, const VertexMap & vInsertToMerge, 
+					   const VertexMap & vBdryToMerge, bool bIncludeBoundary );
+
+	// batch insertion
+	struct BatchInsert {
+		BatchInsert() : vInsertToMergeVMap(true), vInsertToMergeTMap(true), vInsertBdryToMergeMap(true) {}
+
+		rms::VFTriangleMesh * pMesh;
+		float fScale;
+		Wml::Vector2f vOrigin;
+		std::vector< std::vector<IMesh::VertexID> > vLoops;
+
+		// sparse, so per-insert maps don't scale with the merged mesh size
+		VertexMap vInsertToMergeVMap;
+		TriangleMap vInsertToMergeTMap;
+		VertexMap vInsertBdryToMergeMap;
+	};
+	std::vector<BatchInsert *> m_vBatch;
+
+	struct BatchRegion {
+		std::vector<IMesh::TriangleID> vTris;			// dest triangles replaced by this region
+		std::vector<unsigned int> vInserts;				// indices into m_vBatch
+		std::vector< std::pair<unsigned int, IMesh::VertexID> > vInsertVerts;	// (insert, vertex) for insert-boundary point markers
+		Triangulator2D::OutputData_CDT output;
+		bool bOK;
+	};
+	void TriangulateRegion( BatchRegion & region, const std::vector<Wml::Vector2f> & vDestUV, 
+							const std::vector<int> & vTriRegion, int nRegion, int nSourceOffset );
+
+private:
+	// m_vBatch entries are owned, so no copies
+	MeshInsertion( const MeshInsertion & );
+	MeshInsertion & operator=( const MeshInsertion & );
 };
 
 
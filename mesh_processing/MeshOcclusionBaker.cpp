@@ -0,0 +1,242 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MeshOcclusionBaker.h"
+#include "MeshUtils.h"
+#include "SpatialSort.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace rms;
+
+
+namespace {
+
+// integer hash (avalanching, so neighbouring inputs give unrelated outputs)
+inline unsigned int MeshOcclusionBaker_Hash( unsigned int n )
+{
+	n ^= n >> 16;  n *= 0x7feb352dU;
+	n ^= n >> 15;  n *= 0x846ca68bU;
+	n ^= n >> 16;
+	return n;
+}
+
+inline float MeshOcclusionBaker_Unit( unsigned int n )
+{
+	return (float)(n >> 8) * (1.0f / 16777216.0f);
+}
+
+}  // end anonymous namespace
+
+
+
+MeshOcclusionBaker::MeshOcclusionBaker()
+{
+	m_pMesh = NULL;
+	m_bTreeExpanded = false;
+	m_nStrata = 8;
+	m_fMaxDistance = 0;
+	m_fRayOffset = 1e-4f;
+	m_nSeed = 0;
+}
+
+MeshOcclusionBaker::~MeshOcclusionBaker()
+{
+}
+
+
+void MeshOcclusionBaker::SetMesh( VFTriangleMesh * pMesh )
+{
+	m_pMesh = pMesh;
+	m_Tree.SetMesh( pMesh );
+	m_bTreeExpanded = false;
+	m_vOcclusion.resize(0);
+	m_vThickness.resize(0);
+	m_vBentNormals.resize(0);
+}
+
+
+void MeshOcclusionBaker::SetRayCount( unsigned int nRays )
+{
+	m_nStrata = 1;
+	while ( m_nStrata * m_nStrata < nRays )
+		++m_nStrata;
+}
+
+
+Wml::Vector3f MeshOcclusionBaker::SampleDirection( IMesh::VertexID vID, unsigned int i, unsigned int j, unsigned int nSalt,
+												   const Wml::Vector3f & vU, const Wml::Vector3f & vV, const Wml::Vector3f & vNormal )
+{
+	unsigned int nHash = MeshOcclusionBaker_Hash( m_nSeed ^ MeshOcclusionBaker_Hash( vID ^ MeshOcclusionBaker_Hash( (i * m_nStrata + j) ^ nSalt ) ) );
+	float fU1 = ( (float)i + MeshOcclusionBaker_Unit(nHash) ) / (float)m_nStrata;
+	float fU2 = ( (float)j + MeshOcclusionBaker_Unit( MeshOcclusionBaker_Hash(nHash) ) ) / (float)m_nStrata;
+
+	// cosine-weighted: uniform on the unit disk, projected up to the hemisphere
+	float fR = sqrt(fU1);
+	float fPhi = Wml::Mathf::TWO_PI * fU2;
+	float fZ = sqrt( std::max(0.0f, 1.0f - fU1) );
+	return (fR * (float)cos(fPhi)) * vU + (fR * (float)sin(fPhi)) * vV + fZ * vNormal;
+}
+
+
+
+bool MeshOcclusionBaker::Compute( int nBakeFlags )
+{
+	m_vOcclusion.resize(0);
+	m_vThickness.resize(0);
+	m_vBentNormals.resize(0);
+	if ( m_pMesh == NULL || m_pMesh->GetTriangleCount() == 0 )
+		return false;
+	VFTriangleMesh & mesh = *m_pMesh;
+
+	// queries are read-only (and so thread-safe) on an expanded tree
+	if ( ! m_bTreeExpanded ) {
+		m_Tree.ExpandAll();
+		m_bTreeExpanded = true;
+	}
+
+	bool bOcclusion = (nBakeFlags & (AmbientOcclusion | BentNormals)) != 0;
+	bool bThickness = (nBakeFlags & Thickness) != 0;
+	bool bBentNormals = (nBakeFlags & BentNormals) != 0;
+
+	Wml::AxisAlignedBox3f bounds;
+	mesh.GetBoundingBox(bounds);
+	float fDiag = Wml::Vector3f( bounds.Max[0]-bounds.Min[0], bounds.Max[1]-bounds.Min[1], bounds.Max[2]-bounds.Min[2] ).Length();
+	float fMaxDistance = (m_fMaxDistance > 0) ? m_fMaxDistance : fDiag;
+	float fOffset = m_fRayOffset * fDiag;
+
+	unsigned int nMaxID = mesh.GetMaxVertexID();
+	if ( bOcclusion )
+		m_vOcclusion.resize( nMaxID, 1.0f );
+	if ( bThickness )
+		m_vThickness.resize( nMaxID, 0.0f );
+	if ( bBentNormals )
+		m_vBentNormals.resize( nMaxID, Wml::Vector3f::ZERO );
+
+	std::vector<IMesh::VertexID> vVerts;
+	std::vector<double> vPoints;
+	vVerts.reserve( mesh.GetVertexCount() );
+	vPoints.reserve( 3*mesh.GetVertexCount() );
+	VFTriangleMesh::vertex_iterator curv(mesh.BeginVertices()), endv(mesh.EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		const Wml::Vector3f & v = mesh.GetVertex(vID);
+		vVerts.push_back( vID );
+		vPoints.push_back( v.X() );  vPoints.push_back( v.Y() );  vPoints.push_back( v.Z() );
+	}
+	int nVerts = (int)vVerts.size();
+	if ( nVerts == 0 )
+		return true;
+	std::vector<unsigned int> vOrder;
+	HilbertOrder( &vPoints[0], nVerts, 3, vOrder );
+
+	unsigned int nRays = m_nStrata * m_nStrata;
+	int nBlocks = (nVerts + VertexBlockSize - 1) / VertexBlockSize;
+
+	#pragma omp parallel
+	{
+		std::vector<Wml::Vector3f> vOrigins( nRays ), vDirections( nRays );
+		std::vector<unsigned char> vOccluded( nRays );
+
+		#pragma omp for schedule(dynamic,1)
+		for ( int bi = 0; bi < nBlocks; ++bi ) {
+			int nEnd = std::min( nVerts, (bi+1)*VertexBlockSize );
+			for ( int k = bi*VertexBlockSize; k < nEnd; ++k ) {
+				IMesh::VertexID vID = vVerts[ vOrder[k] ];
+				const Wml::Vector3f & v = mesh.GetVertex(vID);
+				Wml::Vector3f vNormal = MeshUtils::EstimateNormal( mesh, vID );
+				if ( vNormal.SquaredLength() < 0.5f )
+					continue;		// isolated or degenerate, leave defaults
+				Wml::Vector3f vU, vV;
+				Wml::Vector3f::GenerateComplementBasis( vU, vV, vNormal );
+
+				if ( bOcclusion ) {
+					Wml::Vector3f vOrigin( v + fOffset * vNormal );
+					for ( unsigned int i = 0; i < m_nStrata; ++i ) {
+						for ( unsigned int j = 0; j < m_nStrata; ++j ) {
+							vOrigins[i*m_nStrata + j] = vOrigin;
+							vDirections[i*m_nStrata + j] = SampleDirection( vID, i, j, 0, vU, vV, vNormal );
+						}
+					}
+					m_Tree.TestOcclusion( &vOrigins[0], &vDirections[0], nRays, fMaxDistance, &vOccluded[0] );
+
+					unsigned int nOpen = 0;
+					Wml::Vector3f vBent( Wml::Vector3f::ZERO );
+					for ( unsigned int r = 0; r < nRays; ++r ) {
+						if ( vOccluded[r] )
+							continue;
+						++nOpen;
+						vBent += vDirections[r];
+					}
+					m_vOcclusion[vID] = (float)nOpen / (float)nRays;
+					if ( bBentNormals )
+						m_vBentNormals[vID] = ( nOpen > 0 && vBent.Normalize() > 0 ) ? vBent : vNormal;
+				}
+
+				if ( bThickness ) {
+					// rays into the inward hemisphere, basis (vV,vU,-vNormal) keeps it right-handed
+					Wml::Vector3f vOrigin( v - fOffset * vNormal );
+					float fSum = 0;
+					unsigned int nHits = 0;
+					for ( unsigned int i = 0; i < m_nStrata; ++i ) {
+						for ( unsigned int j = 0; j < m_nStrata; ++j ) {
+							Wml::Vector3f vDir = SampleDirection( vID, i, j, 0x9e3779b9U, vV, vU, -vNormal );
+							Wml::Vector3f vHit;  IMesh::TriangleID tHit;
+							if ( m_Tree.FindRayIntersection( vOrigin, vDir, vHit, tHit ) ) {
+								fSum += std::min( (vHit - vOrigin).Length(), fMaxDistance );
+								++nHits;
+							}
+						}
+					}
+					m_vThickness[vID] = (nHits > 0) ? fSum / (float)nHits : fMaxDistance;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+
+
+IMesh::ScalarSetID MeshOcclusionBaker::AppendScalarSet( const std::vector<float> & vValues )
+{
+	if ( m_pMesh == NULL || vValues.size() != m_pMesh->GetMaxVertexID() )
+		return IMesh::InvalidID;
+
+	IMesh::ScalarSetID nSetID = m_pMesh->AppendScalarSet();
+	m_pMesh->InitializeScalarSet( nSetID );
+	VFTriangleMesh::vertex_iterator curv(m_pMesh->BeginVertices()), endv(m_pMesh->EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		m_pMesh->SetScalar( vID, nSetID, vValues[vID] );
+	}
+	return nSetID;
+}
+
+IMesh::ScalarSetID MeshOcclusionBaker::AppendOcclusionScalarSet()
+{
+	return AppendScalarSet( m_vOcclusion );
+}
+
+IMesh::ScalarSetID MeshOcclusionBaker::AppendThicknessScalarSet()
+{
+	return AppendScalarSet( m_vThickness );
+}
+
+
+bool MeshOcclusionBaker::SetOcclusionColors()
+{
+	if ( m_pMesh == NULL || m_vOcclusion.size() != m_pMesh->GetMaxVertexID() )
+		return false;
+
+	VFTriangleMesh::vertex_iterator curv(m_pMesh->BeginVertices()), endv(m_pMesh->EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		float f = m_vOcclusion[vID];
+		m_pMesh->SetColor( vID, Wml::ColorRGBA(f, f, f, 1.0f) );
+	}
+	return true;
+}
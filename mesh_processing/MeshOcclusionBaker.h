@@ -0,0 +1,96 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include <VFTriangleMesh.h>
+#include <IMeshBVTree.h>
+
+
+namespace rms {
+
+
+/*
+ * Per-vertex ambient occlusion, thickness and bent normals.
+ *
+ * Each vertex casts cosine-weighted rays into the hemisphere around its normal (outwards for
+ * occlusion, inwards for thickness). The hemisphere is stratified into an m x m grid with one
+ * jittered ray per cell, so the ray count is rounded up to a square. Jitter comes from a hash of
+ * (seed, vertex, cell), so results are repeatable and don't depend on the thread count.
+ *
+ * Occlusion rays of a vertex go through the tree as one batch with an any-hit test
+ * (IMeshBVTree::TestOcclusion). Vertices are baked in Hilbert order, in blocks that are
+ * distributed over threads (OpenMP), so consecutive batches touch the same nodes.
+ * Thickness needs the hit distance, so it uses closest-hit queries.
+ */
+class MeshOcclusionBaker
+{
+public:
+	enum BakeFlags {
+		AmbientOcclusion = 1,
+		Thickness = 2,
+		BentNormals = 4				//! also casts the occlusion rays
+	};
+
+	MeshOcclusionBaker();
+	~MeshOcclusionBaker();
+
+	//! mesh is not modified (except by the Append/Set functions below). The tree is built on the first Compute()
+	void SetMesh( rms::VFTriangleMesh * pMesh );
+
+	//! rays per vertex, rounded up to a square (default 64)
+	void SetRayCount( unsigned int nRays );
+	unsigned int GetRayCount() const { return m_nStrata * m_nStrata; }
+
+	//! rays are cut off at this length. 0 (the default) means the bounding box diagonal
+	void SetMaxDistance( float fDistance ) { m_fMaxDistance = fDistance; }
+
+	//! ray origins are moved this far along the normal, relative to the bounding box diagonal (default 1e-4)
+	void SetRayOffset( float fOffset ) { m_fRayOffset = fOffset; }
+
+	void SetSeed( unsigned int nSeed ) { m_nSeed = nSeed; }
+
+	//! nBakeFlags is a combination of BakeFlags
+	bool Compute( int nBakeFlags = AmbientOcclusion );
+
+	//! per-vertex results of the last Compute(), indexed by VertexID. Empty if not baked
+	const std::vector<float> & GetOcclusion() const { return m_vOcclusion; }			//! unoccluded fraction, 1 = fully open
+	const std::vector<float> & GetThickness() const { return m_vThickness; }			//! mean inward hit distance
+	const std::vector<Wml::Vector3f> & GetBentNormals() const { return m_vBentNormals; }	//! mean unoccluded direction
+
+	//! copy results into a new ScalarSet of the mesh. Returns InvalidID if not baked
+	IMesh::ScalarSetID AppendOcclusionScalarSet();
+	IMesh::ScalarSetID AppendThicknessScalarSet();
+
+	//! set vertex colors to grey levels of the occlusion
+	bool SetOcclusionColors();
+
+protected:
+	rms::VFTriangleMesh * m_pMesh;
+	IMeshBVTree m_Tree;
+	bool m_bTreeExpanded;
+
+	unsigned int m_nStrata;
+	float m_fMaxDistance;
+	float m_fRayOffset;
+	unsigned int m_nSeed;
+
+	std::vector<float> m_vOcclusion;
+	std::vector<float> m_vThickness;
+	std::vector<Wml::Vector3f> m_vBentNormals;
+
+	enum { VertexBlockSize = 64 };
+
+	//! unit direction in the cosine-weighted hemisphere around vNormal (with basis vU,vV), for cell (i,j) of vertex vID
+	Wml::Vector3f SampleDirection( IMesh::VertexID vID, unsigned int i, unsigned int j, unsigned int nSalt,
+								   const Wml::Vector3f & vU, const Wml::Vector3f & vV, const Wml::Vector3f & vNormal );
+
+	IMesh::ScalarSetID AppendScalarSet( const std::vector<float> & vValues );
+};
+
+
+
+}   // end namespace rms
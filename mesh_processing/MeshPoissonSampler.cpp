@@ -0,0 +1,590 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MeshPoissonSampler.h"
+#include "MeshUtils.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace rms;
+
+
+namespace {
+
+// integer hash (avalanching, so neighbouring inputs give unrelated outputs)
+inline unsigned int MeshPoissonSampler_Hash( unsigned int n )
+{
+	n ^= n >> 16;  n *= 0x7feb352dU;
+	n ^= n >> 15;  n *= 0x846ca68bU;
+	n ^= n >> 16;
+	return n;
+}
+
+inline float MeshPoissonSampler_Unit( unsigned int n )
+{
+	return (float)(n >> 8) * (1.0f / 16777216.0f);
+}
+
+// grid cell coordinates, 21 bits each
+inline unsigned long long MeshPoissonSampler_CellKey( int x, int y, int z )
+{
+	return (unsigned long long)x | ((unsigned long long)y << 21) | ((unsigned long long)z << 42);
+}
+
+inline void MeshPoissonSampler_CellCoords( unsigned long long nKey, int & x, int & y, int & z )
+{
+	x = (int)(nKey & 0x1FFFFF);
+	y = (int)((nKey >> 21) & 0x1FFFFF);
+	z = (int)(nKey >> 42);
+}
+
+// sample elimination weight (Yuksel 2015, alpha = 8) of two samples fDist apart, that see each other up to fRange
+inline double MeshPoissonSampler_Weight( float fDist, float fRange, float fMinRatio )
+{
+	if ( fDist >= fRange )
+		return 0;
+	double t = 1.0 - (double)std::max( fDist, fRange * fMinRatio ) / (double)fRange;
+	t *= t;  t *= t;
+	return t*t;
+}
+
+// candidates in grid order: by cell, then by priority, then in generation order
+struct MeshPoissonSampler_SortEntry {
+	unsigned long long nKey;
+	unsigned int nPriority;
+	unsigned int nIndex;
+	bool operator<( const MeshPoissonSampler_SortEntry & e ) const {
+		if ( nKey != e.nKey )
+			return nKey < e.nKey;
+		return ( nPriority != e.nPriority ) ? nPriority < e.nPriority : nIndex < e.nIndex;
+	}
+};
+
+// binary max-heap of candidates by weight (ties: lower index first). Weights only decrease, so changes are
+// applied lazily: the stored weight is an upper bound, and a stale top entry is re-sifted with its current weight
+class MeshPoissonSampler_Heap
+{
+public:
+	MeshPoissonSampler_Heap( const std::vector<double> & vWeights ) : m_vWeights(vWeights)
+	{
+		unsigned int nCount = (unsigned int)vWeights.size();
+		m_vHeap.resize( nCount );
+		for ( unsigned int i = 0; i < nCount; ++i ) {
+			m_vHeap[i].dWeight = vWeights[i];
+			m_vHeap[i].nIndex = i;
+		}
+		for ( unsigned int i = nCount/2; i > 0; --i )
+			SiftDown( i-1 );
+	}
+
+	unsigned int Size() const { return (unsigned int)m_vHeap.size(); }
+
+	//! remove and return the candidate with the largest current weight
+	unsigned int Pop()
+	{
+		while ( m_vHeap[0].dWeight != m_vWeights[ m_vHeap[0].nIndex ] ) {
+			m_vHeap[0].dWeight = m_vWeights[ m_vHeap[0].nIndex ];
+			SiftDown( 0 );
+		}
+		unsigned int nTop = m_vHeap[0].nIndex;
+		m_vHeap[0] = m_vHeap.back();
+		m_vHeap.pop_back();
+		if ( ! m_vHeap.empty() )
+			SiftDown( 0 );
+		return nTop;
+	}
+
+protected:
+	struct Entry {
+		double dWeight;
+		unsigned int nIndex;
+	};
+	const std::vector<double> & m_vWeights;
+	std::vector<Entry> m_vHeap;
+
+	static bool Before( const Entry & a, const Entry & b )
+		{ return a.dWeight > b.dWeight || ( a.dWeight == b.dWeight && a.nIndex < b.nIndex ); }
+
+	void SiftDown( unsigned int n )
+	{
+		unsigned int nSize = (unsigned int)m_vHeap.size();
+		Entry item = m_vHeap[n];
+		while ( 2*n+1 < nSize ) {
+			unsigned int nChild = 2*n+1;
+			if ( nChild+1 < nSize && Before( m_vHeap[nChild+1], m_vHeap[nChild] ) )
+				++nChild;
+			if ( ! Before( m_vHeap[nChild], item ) )
+				break;
+			m_vHeap[n] = m_vHeap[nChild];
+			n = nChild;
+		}
+		m_vHeap[n] = item;
+	}
+};
+
+}  // end anonymous namespace
+
+
+
+MeshPoissonSampler::MeshPoissonSampler()
+{
+	m_pMesh = NULL;
+	m_eDistanceMode = Euclidean;
+	m_nRadiusSet = IMesh::InvalidID;
+	m_nSeed = 0;
+	m_fCandidateDensity = 5.0f;
+	m_bParallel = true;
+	m_fCellSize = 0;
+}
+
+MeshPoissonSampler::~MeshPoissonSampler()
+{
+}
+
+
+void MeshPoissonSampler::SetMesh( VFTriangleMesh * pMesh )
+{
+	m_pMesh = pMesh;
+	m_vSamples.resize(0);
+}
+
+
+void MeshPoissonSampler::ClearWorkspace()
+{
+	// swap to actually release the memory, the pool can be large
+	std::vector<Wml::Vector3f>().swap( m_vNormals );
+	std::vector<Sample>().swap( m_vCandidates );
+	std::vector<unsigned int>().swap( m_vPriority );
+	std::vector<unsigned long long>().swap( m_vCellKeys );
+	std::vector<unsigned int>().swap( m_vCellStart );
+	std::vector<unsigned int>().swap( m_vNbrStart );
+	std::vector<unsigned int>().swap( m_vNbrCells );
+}
+
+
+float MeshPoissonSampler::RadiusScale( IMesh::TriangleID tID, const float fBary[3] ) const
+{
+	if ( m_nRadiusSet == IMesh::InvalidID || ! m_pMesh->HasScalarSet(m_nRadiusSet) )
+		return 1.0f;
+	float fValues[3];
+	if ( ! m_pMesh->GetTriangleScalar( tID, m_nRadiusSet, fValues ) )
+		return 1.0f;
+	return std::max( 0.01f, fBary[0]*fValues[0] + fBary[1]*fValues[1] + fBary[2]*fValues[2] );
+}
+
+
+bool MeshPoissonSampler::Initialize( std::vector<IMesh::TriangleID> & vTris, std::vector<float> & vWeights )
+{
+	m_vSamples.resize(0);
+	ClearWorkspace();
+	if ( m_pMesh == NULL || m_pMesh->GetTriangleCount() == 0 )
+		return false;
+	VFTriangleMesh & mesh = *m_pMesh;
+
+	std::vector<IMesh::VertexID> vVerts;
+	vVerts.reserve( mesh.GetVertexCount() );
+	VFTriangleMesh::vertex_iterator curv(mesh.BeginVertices()), endv(mesh.EndVertices());
+	while ( curv != endv ) {
+		vVerts.push_back( *curv );  ++curv;
+	}
+	m_vNormals.resize( mesh.GetMaxVertexID(), Wml::Vector3f::ZERO );
+	int nVerts = (int)vVerts.size();
+	#pragma omp parallel for schedule(dynamic,256)
+	for ( int i = 0; i < nVerts; ++i )
+		m_vNormals[ vVerts[i] ] = MeshUtils::EstimateNormal( mesh, vVerts[i] );
+
+	// area in units of the local radius, so that candidates are uniform relative to the sample spacing
+	const float fCentroid[3] = { 1.0f/3.0f, 1.0f/3.0f, 1.0f/3.0f };
+	vTris.resize(0);
+	vWeights.resize(0);
+	vTris.reserve( mesh.GetTriangleCount() );
+	vWeights.reserve( mesh.GetTriangleCount() );
+	VFTriangleMesh::triangle_iterator curt(mesh.BeginTriangles()), endt(mesh.EndTriangles());
+	while ( curt != endt ) {
+		IMesh::TriangleID tID = *curt;  ++curt;
+		Wml::Vector3f vTri[3];
+		mesh.GetTriangle( tID, vTri );
+		float fArea = 0.5f * (vTri[1] - vTri[0]).Cross( vTri[2] - vTri[0] ).Length();
+		float fScale = RadiusScale( tID, fCentroid );
+		vTris.push_back( tID );
+		vWeights.push_back( fArea / (fScale*fScale) );
+	}
+	return true;
+}
+
+
+bool MeshPoissonSampler::GenerateCandidates( float fRadius, const std::vector<IMesh::TriangleID> & vTris, const std::vector<float> & vExpected )
+{
+	VFTriangleMesh & mesh = *m_pMesh;
+
+	// expected counts are rounded up with probability of their fractional part
+	int nTris = (int)vTris.size();
+	std::vector<unsigned int> vOffsets( nTris+1, 0 );
+	double dTotal = 0;
+	for ( int i = 0; i < nTris; ++i ) {
+		unsigned int nHash = MeshPoissonSampler_Hash( m_nSeed ^ MeshPoissonSampler_Hash( vTris[i] ^ 0x85ebca6bU ) );
+		double dCount = floor( (double)vExpected[i] + (double)MeshPoissonSampler_Unit(nHash) );
+		dTotal += dCount;
+		if ( dTotal > (double)0x7FFFFFFF )
+			return false;
+		vOffsets[i+1] = vOffsets[i] + (unsigned int)dCount;
+	}
+	unsigned int nCandidates = vOffsets[nTris];
+	m_vCandidates.resize( nCandidates );
+	m_vPriority.resize( nCandidates );
+
+	#pragma omp parallel for schedule(dynamic,256)
+	for ( int i = 0; i < nTris; ++i ) {
+		IMesh::TriangleID tID = vTris[i];
+		IMesh::VertexID nTri[3];
+		Wml::Vector3f vTri[3];
+		mesh.GetTriangle( tID, nTri );
+		mesh.GetTriangle( tID, vTri );
+		Wml::Vector3f vFaceNormal( (vTri[1] - vTri[0]).UnitCross( vTri[2] - vTri[0] ) );
+
+		for ( unsigned int k = vOffsets[i]; k < vOffsets[i+1]; ++k ) {
+			unsigned int nHash = MeshPoissonSampler_Hash( m_nSeed ^ MeshPoissonSampler_Hash( tID ^ MeshPoissonSampler_Hash( k - vOffsets[i] ) ) );
+			unsigned int nHash2 = MeshPoissonSampler_Hash( nHash );
+
+			// uniform on the triangle
+			float fS = sqrt( MeshPoissonSampler_Unit(nHash) );
+			float fT = MeshPoissonSampler_Unit(nHash2);
+			float fBary[3] = { 1.0f - fS, fS * (1.0f - fT), fS * fT };
+
+			Sample & s = m_vCandidates[k];
+			s.vPosition = fBary[0]*vTri[0] + fBary[1]*vTri[1] + fBary[2]*vTri[2];
+			s.vNormal = fBary[0]*m_vNormals[nTri[0]] + fBary[1]*m_vNormals[nTri[1]] + fBary[2]*m_vNormals[nTri[2]];
+			if ( s.vNormal.Normalize() < Wml::Mathf::ZERO_TOLERANCE )
+				s.vNormal = vFaceNormal;
+			s.tID = tID;
+			s.fRadius = fRadius * RadiusScale( tID, fBary );
+			m_vPriority[k] = MeshPoissonSampler_Hash( nHash2 ^ 0x9e3779b9U );
+		}
+	}
+	return true;
+}
+
+
+void MeshPoissonSampler::BuildGrid( float fCellSize )
+{
+	unsigned int nCandidates = (unsigned int)m_vCandidates.size();
+	Wml::Vector3f vMin( m_vCandidates[0].vPosition ), vMax( vMin );
+	for ( unsigned int k = 1; k < nCandidates; ++k ) {
+		const Wml::Vector3f & v = m_vCandidates[k].vPosition;
+		for ( int j = 0; j < 3; ++j ) {
+			vMin[j] = std::min( vMin[j], v[j] );
+			vMax[j] = std::max( vMax[j], v[j] );
+		}
+	}
+
+	// coordinates have to fit into the 21 bits of the cell key
+	float fExtent = std::max( vMax[0]-vMin[0], std::max( vMax[1]-vMin[1], vMax[2]-vMin[2] ) );
+	m_fCellSize = std::max( fCellSize, fExtent / (float)(1 << 20) );
+	if ( m_fCellSize <= 0 )
+		m_fCellSize = 1.0f;
+	m_vGridOrigin = vMin;
+
+	std::vector<MeshPoissonSampler_SortEntry> vEntries( nCandidates );
+	#pragma omp parallel for schedule(static)
+	for ( int k = 0; k < (int)nCandidates; ++k ) {
+		Wml::Vector3f v( (m_vCandidates[k].vPosition - m_vGridOrigin) / m_fCellSize );
+		vEntries[k].nKey = MeshPoissonSampler_CellKey( (int)v[0], (int)v[1], (int)v[2] );
+		vEntries[k].nPriority = m_vPriority[k];
+		vEntries[k].nIndex = (unsigned int)k;
+	}
+	std::sort( vEntries.begin(), vEntries.end() );
+
+	std::vector<Sample> vSorted( nCandidates );
+	std::vector<unsigned int> vPriority( nCandidates );
+	m_vCellKeys.resize(0);
+	m_vCellStart.resize(0);
+	for ( unsigned int k = 0; k < nCandidates; ++k ) {
+		vSorted[k] = m_vCandidates[ vEntries[k].nIndex ];
+		vPriority[k] = vEntries[k].nPriority;
+		if ( k == 0 || vEntries[k].nKey != vEntries[k-1].nKey ) {
+			m_vCellKeys.push_back( vEntries[k].nKey );
+			m_vCellStart.push_back( k );
+		}
+	}
+	m_vCellStart.push_back( nCandidates );
+	m_vCandidates.swap( vSorted );
+	m_vPriority.swap( vPriority );
+
+	FindNeighbours();
+}
+
+
+void MeshPoissonSampler::FindNeighbours()
+{
+	// Key offsets of the 27 neighbours. Adding an offset keeps the cell keys sorted, so the neighbours for
+	// one offset are found by walking a second pointer along the cells. Coordinates are at most 2^20, so
+	// x-1 or y-1 at 0 borrows into a field value that no cell has, and z-1 at 0 gives a negative key
+	long long vOffsets[27];
+	int nOffsets = 0;
+	for ( int dz = -1; dz <= 1; ++dz ) {
+		for ( int dy = -1; dy <= 1; ++dy ) {
+			for ( int dx = -1; dx <= 1; ++dx )
+				vOffsets[nOffsets++] = (long long)dx + (long long)dy * (1LL << 21) + (long long)dz * (1LL << 42);
+		}
+	}
+
+	unsigned int nCells = (unsigned int)m_vCellKeys.size();
+	int nBlocks = (int)( (nCells + CellBlockSize - 1) / CellBlockSize );
+	m_vNbrStart.assign( nCells+1, 0 );
+	std::vector<unsigned int> vFill;
+
+	// count, then fill
+	for ( int nPass = 0; nPass < 2; ++nPass ) {
+		if ( nPass == 1 ) {
+			for ( unsigned int c = 0; c < nCells; ++c )
+				m_vNbrStart[c+1] += m_vNbrStart[c];
+			m_vNbrCells.resize( m_vNbrStart[nCells] );
+			vFill.assign( m_vNbrStart.begin(), m_vNbrStart.end() - 1 );
+		}
+
+		#pragma omp parallel for schedule(dynamic,1)
+		for ( int b = 0; b < nBlocks; ++b ) {
+			unsigned int nBegin = (unsigned int)b * CellBlockSize;
+			unsigned int nEnd = std::min( nCells, nBegin + CellBlockSize );
+			for ( int o = 0; o < nOffsets; ++o ) {
+				long long nFirst = std::max( 0LL, (long long)m_vCellKeys[nBegin] + vOffsets[o] );
+				unsigned int p = (unsigned int)( std::lower_bound( m_vCellKeys.begin(), m_vCellKeys.end(), (unsigned long long)nFirst ) - m_vCellKeys.begin() );
+				for ( unsigned int c = nBegin; c < nEnd; ++c ) {
+					long long nKey = (long long)m_vCellKeys[c] + vOffsets[o];
+					if ( nKey < 0 )
+						continue;
+					while ( p < nCells && m_vCellKeys[p] < (unsigned long long)nKey )
+						++p;
+					if ( p == nCells || m_vCellKeys[p] != (unsigned long long)nKey )
+						continue;
+					if ( nPass == 0 )
+						m_vNbrStart[c+1]++;
+					else
+						m_vNbrCells[ vFill[c]++ ] = p;
+				}
+			}
+		}
+	}
+}
+
+
+inline float MeshPoissonSampler::Distance( const Sample & a, const Sample & b, float fMaxDistance ) const
+{
+	Wml::Vector3f v( b.vPosition - a.vPosition );
+	float fSqrLen = v.SquaredLength();
+	if ( fSqrLen >= fMaxDistance*fMaxDistance )
+		return fMaxDistance;		// the arc is never shorter than the chord
+	float fLen = sqrt(fSqrLen);
+	if ( m_eDistanceMode == Euclidean || fLen == 0 )
+		return fLen;
+
+	// normals turning by more than 90 degrees within a disk: a and b are on different sheets (e.g. two sides of a thin part)
+	if ( a.vNormal.Dot( b.vNormal ) < 0 )
+		return fMaxDistance;
+
+	// length of the circular arc from a to b with normals a.vNormal and b.vNormal (Bowers et al. 2010)
+	v *= 1.0f / fLen;
+	float fA = std::max( -1.0f, std::min( 1.0f, a.vNormal.Dot(v) ) );
+	float fB = std::max( -1.0f, std::min( 1.0f, b.vNormal.Dot(v) ) );
+	if ( fabs(fA - fB) > 1e-4f )
+		return fLen * ( (float)asin(fA) - (float)asin(fB) ) / (fA - fB);
+	return fLen / sqrt( std::max( 1.0f - fA*fA, 1e-4f ) );
+}
+
+
+bool MeshPoissonSampler::TryAccept( unsigned int nCell, unsigned int k, std::vector<unsigned int> & vAccepted )
+{
+	const Sample & s = m_vCandidates[k];
+	for ( unsigned int n = m_vNbrStart[nCell]; n < m_vNbrStart[nCell+1]; ++n ) {
+		unsigned int nNbr = m_vNbrCells[n];
+		for ( unsigned int j = m_vCellStart[nNbr]; j < m_vCellStart[nNbr] + vAccepted[nNbr]; ++j ) {
+			const Sample & a = m_vCandidates[j];
+			float fMinDistance = 0.5f * (s.fRadius + a.fRadius);
+			if ( Distance( s, a, fMinDistance ) < fMinDistance )
+				return false;
+		}
+	}
+
+	// accepted samples are kept at the front of their cell. Candidates between them and k were already rejected
+	unsigned int nSlot = m_vCellStart[nCell] + vAccepted[nCell];
+	if ( nSlot != k ) {
+		std::swap( m_vCandidates[nSlot], m_vCandidates[k] );
+		std::swap( m_vPriority[nSlot], m_vPriority[k] );
+	}
+	vAccepted[nCell]++;
+	return true;
+}
+
+
+
+bool MeshPoissonSampler::ComputeRadius( float fRadius )
+{
+	std::vector<IMesh::TriangleID> vTris;
+	std::vector<float> vWeights;
+	if ( fRadius <= 0 || ! Initialize( vTris, vWeights ) )
+		return false;
+
+	std::vector<float> vExpected( vTris.size() );
+	float fDensity = m_fCandidateDensity / (fRadius*fRadius);
+	for ( unsigned int i = 0; i < vTris.size(); ++i )
+		vExpected[i] = vWeights[i] * fDensity;
+	if ( ! GenerateCandidates( fRadius, vTris, vExpected ) ) {
+		ClearWorkspace();
+		return false;
+	}
+	unsigned int nCandidates = (unsigned int)m_vCandidates.size();
+	if ( nCandidates == 0 ) {
+		ClearWorkspace();
+		return true;
+	}
+
+	// any two samples that can conflict are in neighbouring cells
+	float fMaxRadius = 0;
+	for ( unsigned int k = 0; k < nCandidates; ++k )
+		fMaxRadius = std::max( fMaxRadius, m_vCandidates[k].fRadius );
+	BuildGrid( fMaxRadius );
+
+	unsigned int nCells = (unsigned int)m_vCellKeys.size();
+	std::vector<unsigned int> vAccepted( nCells, 0 );
+	if ( m_bParallel ) {
+		// cells with the same (x,y,z) mod 3 are at least two cells apart, so they don't see each other's
+		// samples and can be filled concurrently. Each cell is filled in priority order by one thread.
+		std::vector< std::vector<unsigned int> > vPhases( 27 );
+		for ( unsigned int c = 0; c < nCells; ++c ) {
+			int x, y, z;
+			MeshPoissonSampler_CellCoords( m_vCellKeys[c], x, y, z );
+			vPhases[ (x % 3) + 3*(y % 3) + 9*(z % 3) ].push_back( c );
+		}
+		for ( unsigned int p = 0; p < 27; ++p ) {
+			const std::vector<unsigned int> & vPhase = vPhases[p];
+			int nPhaseCells = (int)vPhase.size();
+			#pragma omp parallel for schedule(dynamic,64)
+			for ( int i = 0; i < nPhaseCells; ++i ) {
+				unsigned int nCell = vPhase[i];
+				for ( unsigned int k = m_vCellStart[nCell]; k < m_vCellStart[nCell+1]; ++k )
+					TryAccept( nCell, k, vAccepted );
+			}
+		}
+
+	} else {
+		// one global priority order. Within each cell it is the sorted order, so candidate k
+		// is still at index k when it is visited
+		std::vector<unsigned long long> vOrder( nCandidates );
+		std::vector<unsigned int> vCellOf( nCandidates );
+		for ( unsigned int c = 0; c < nCells; ++c ) {
+			for ( unsigned int k = m_vCellStart[c]; k < m_vCellStart[c+1]; ++k ) {
+				vOrder[k] = ((unsigned long long)m_vPriority[k] << 32) | k;
+				vCellOf[k] = c;
+			}
+		}
+		std::sort( vOrder.begin(), vOrder.end() );
+		for ( unsigned int i = 0; i < nCandidates; ++i ) {
+			unsigned int k = (unsigned int)(vOrder[i] & 0xFFFFFFFF);
+			TryAccept( vCellOf[k], k, vAccepted );
+		}
+	}
+
+	for ( unsigned int c = 0; c < nCells; ++c ) {
+		for ( unsigned int k = m_vCellStart[c]; k < m_vCellStart[c] + vAccepted[c]; ++k )
+			m_vSamples.push_back( m_vCandidates[k] );
+	}
+	ClearWorkspace();
+	return true;
+}
+
+
+
+bool MeshPoissonSampler::ComputeCount( unsigned int nSamples )
+{
+	std::vector<IMesh::TriangleID> vTris;
+	std::vector<float> vWeights;
+	if ( nSamples == 0 || ! Initialize( vTris, vWeights ) )
+		return false;
+	double dArea = 0;
+	for ( unsigned int i = 0; i < vWeights.size(); ++i )
+		dArea += vWeights[i];
+	if ( dArea <= 0 )
+		return false;
+
+	// radius of nSamples disks in hexagonal packing (at radius scale 1). Samples see each other up to twice that
+	float fMaxRadius = (float)sqrt( dArea / (2.0 * sqrt(3.0) * (double)nSamples) );
+
+	// pool of 5x the target count. Rounding can (rarely, for small counts) leave fewer candidates than samples
+	std::vector<float> vExpected( vTris.size() );
+	for ( double dRatio = 5.0; m_vCandidates.size() < nSamples; dRatio *= 2 ) {
+		double dScale = dRatio * (double)nSamples / dArea;
+		for ( unsigned int i = 0; i < vTris.size(); ++i )
+			vExpected[i] = (float)( (double)vWeights[i] * dScale );
+		if ( ! GenerateCandidates( 2*fMaxRadius, vTris, vExpected ) ) {
+			ClearWorkspace();
+			return false;
+		}
+	}
+
+	float fMaxDistance = 0;
+	for ( unsigned int k = 0; k < m_vCandidates.size(); ++k )
+		fMaxDistance = std::max( fMaxDistance, m_vCandidates[k].fRadius );
+	BuildGrid( fMaxDistance );
+	Eliminate( nSamples );
+	ClearWorkspace();
+	return true;
+}
+
+
+void MeshPoissonSampler::Eliminate( unsigned int nSamples )
+{
+	unsigned int nCandidates = (unsigned int)m_vCandidates.size();
+	unsigned int nCells = (unsigned int)m_vCellKeys.size();
+
+	// samples closer than this fraction of their range all weigh the same (Yuksel's r_min)
+	float fMinRatio = (float)( 0.65 * ( 1.0 - pow( (double)nSamples / (double)nCandidates, 1.5 ) ) );
+
+	std::vector<unsigned int> vCellOf( nCandidates );
+	std::vector<double> vWeights( nCandidates, 0.0 );
+	#pragma omp parallel for schedule(dynamic,64)
+	for ( int c = 0; c < (int)nCells; ++c ) {
+		for ( unsigned int k = m_vCellStart[c]; k < m_vCellStart[c+1]; ++k ) {
+			vCellOf[k] = (unsigned int)c;
+			const Sample & s = m_vCandidates[k];
+			double dWeight = 0;
+			for ( unsigned int n = m_vNbrStart[c]; n < m_vNbrStart[c+1]; ++n ) {
+				unsigned int nNbr = m_vNbrCells[n];
+				for ( unsigned int j = m_vCellStart[nNbr]; j < m_vCellStart[nNbr+1]; ++j ) {
+					if ( j == k )
+						continue;
+					float fRange = 0.5f * (s.fRadius + m_vCandidates[j].fRadius);
+					dWeight += MeshPoissonSampler_Weight( Distance( s, m_vCandidates[j], fRange ), fRange, fMinRatio );
+				}
+			}
+			vWeights[k] = dWeight;
+		}
+	}
+
+	// remove the most crowded candidate until nSamples are left
+	MeshPoissonSampler_Heap heap( vWeights );
+	std::vector<unsigned char> vRemoved( nCandidates, 0 );
+	while ( heap.Size() > nSamples ) {
+		unsigned int i = heap.Pop();
+		vRemoved[i] = 1;
+		const Sample & s = m_vCandidates[i];
+		unsigned int nCell = vCellOf[i];
+		for ( unsigned int n = m_vNbrStart[nCell]; n < m_vNbrStart[nCell+1]; ++n ) {
+			unsigned int nNbr = m_vNbrCells[n];
+			for ( unsigned int j = m_vCellStart[nNbr]; j < m_vCellStart[nNbr+1]; ++j ) {
+				if ( vRemoved[j] )
+					continue;
+				float fRange = 0.5f * (s.fRadius + m_vCandidates[j].fRadius);
+				double dWeight = MeshPoissonSampler_Weight( Distance( s, m_vCandidates[j], fRange ), fRange, fMinRatio );
+				vWeights[j] -= dWeight;
+			}
+		}
+	}
+
+	m_vSamples.reserve( nSamples );
+	for ( unsigned int k = 0; k < nCandidates; ++k ) {
+		if ( ! vRemoved[k] )
+			m_vSamples.push_back( m_vCandidates[k] );
+	}
+}
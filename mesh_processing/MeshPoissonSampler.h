@@ -0,0 +1,127 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include <VFTriangleMesh.h>
+
+
+namespace rms {
+
+
+/*
+ * Blue-noise (Poisson-disk) point sets on mesh surfaces.
+ *
+ * A pool of candidate points is generated first, uniformly by area (or by area / radius^2 with an adaptive
+ * radius). Each triangle gets a number of candidates and their positions from a hash of (seed, triangle,
+ * index), so the pool does not depend on the thread count. Candidates are bucketed in a uniform grid
+ * with cells at least as large as the largest conflict distance (as in ParticleGrid, but only occupied
+ * cells are stored, sorted by cell key, with precomputed neighbour lists, which scales to millions of points).
+ *
+ * ComputeRadius() throws darts: candidates are visited in random (hashed) priority order and accepted
+ * if they don't conflict with any accepted sample in the 27 neighbouring cells. The result is maximal
+ * with respect to the pool. In the parallel variant cells are split into 27 phase groups by (x,y,z) mod 3.
+ * Cells of one group are at least two cells apart, so they are processed concurrently without locks, and
+ * the output is the same for any number of threads.
+ *
+ * ComputeCount() returns exactly the requested number of samples, by weighted sample elimination
+ * (Yuksel 2015) from a pool of 5x as many candidates.
+ *
+ * Two samples p,q with radii rp,rq conflict if their distance is less than (rp+rq)/2. Distance is the
+ * Euclidean distance, or an estimate of the geodesic distance from the normals at p and q (length of
+ * the circular arc from p to q with those normals). In the geodesic mode, points whose normals are
+ * more than 90 degrees apart are taken to be on different sheets and never conflict, so samples on
+ * opposite sides of thin parts don't reject each other. The radius is uniform, or scaled per point
+ * by a per-vertex ScalarSet (interpolated over triangles).
+ */
+class MeshPoissonSampler
+{
+public:
+	enum DistanceMode {
+		Euclidean,
+		Geodesic
+	};
+
+	struct Sample {
+		Wml::Vector3f vPosition;
+		Wml::Vector3f vNormal;			//! interpolated vertex normal
+		IMesh::TriangleID tID;
+		float fRadius;
+	};
+
+	MeshPoissonSampler();
+	~MeshPoissonSampler();
+
+	//! mesh is not modified
+	void SetMesh( rms::VFTriangleMesh * pMesh );
+
+	void SetDistanceMode( DistanceMode eMode ) { m_eDistanceMode = eMode; }
+
+	//! radius at a point is multiplied by the value of this ScalarSet (InvalidID for a uniform radius, the default).
+	//! Values are clamped to at least 0.01
+	void SetRadiusScalarSet( IMesh::ScalarSetID nSetID ) { m_nRadiusSet = nSetID; }
+
+	void SetSeed( unsigned int nSeed ) { m_nSeed = nSeed; }
+
+	//! ComputeRadius() candidates per radius^2 of area (default 5, about 8x the number of samples)
+	void SetCandidateDensity( float fDensity ) { m_fCandidateDensity = fDensity; }
+
+	//! phase-group parallel dart throwing (default), or sequential in one global priority order
+	void SetParallel( bool bParallel ) { m_bParallel = bParallel; }
+
+	//! maximal sample set where no two samples are closer than fRadius (times the radius scale)
+	bool ComputeRadius( float fRadius );
+
+	//! exactly nSamples samples, by sample elimination
+	bool ComputeCount( unsigned int nSamples );
+
+	//! samples of the last Compute, in grid cell order
+	const std::vector<Sample> & GetSamples() const { return m_vSamples; }
+
+protected:
+	rms::VFTriangleMesh * m_pMesh;
+	DistanceMode m_eDistanceMode;
+	IMesh::ScalarSetID m_nRadiusSet;
+	unsigned int m_nSeed;
+	float m_fCandidateDensity;
+	bool m_bParallel;
+
+	std::vector<Sample> m_vSamples;
+
+	// per-vertex normals of the current Compute
+	std::vector<Wml::Vector3f> m_vNormals;
+
+	// candidate pool, sorted by grid cell and then by priority
+	std::vector<Sample> m_vCandidates;
+	std::vector<unsigned int> m_vPriority;
+
+	// uniform grid over the candidates, only occupied cells. Cell i holds candidates [m_vCellStart[i], m_vCellStart[i+1]),
+	// its occupied neighbours (including itself) are m_vNbrCells[ m_vNbrStart[i] ... m_vNbrStart[i+1]-1 ]
+	float m_fCellSize;
+	Wml::Vector3f m_vGridOrigin;
+	std::vector<unsigned long long> m_vCellKeys;
+	std::vector<unsigned int> m_vCellStart;
+	std::vector<unsigned int> m_vNbrStart;
+	std::vector<unsigned int> m_vNbrCells;
+
+	enum { CellBlockSize = 4096 };
+
+	bool Initialize( std::vector<IMesh::TriangleID> & vTris, std::vector<float> & vWeights );
+	float RadiusScale( IMesh::TriangleID tID, const float fBary[3] ) const;
+	bool GenerateCandidates( float fRadius, const std::vector<IMesh::TriangleID> & vTris, const std::vector<float> & vExpected );
+	void BuildGrid( float fCellSize );
+	void FindNeighbours();
+	bool TryAccept( unsigned int nCell, unsigned int k, std::vector<unsigned int> & vAccepted );
+	void Eliminate( unsigned int nSamples );
+	void ClearWorkspace();
+
+	//! distance from a to b, or fMaxDistance if they are at least that far apart (or on different sheets)
+	inline float Distance( const Sample & a, const Sample & b, float fMaxDistance ) const;
+};
+
+
+
+}   // end namespace rms
@@ -7,6 +7,7 @@
 #include <rmsdebug.h>
 
 #include <VectorUtil.h>
+#include <TriangleKernels.h>
 
 
 using namespace rms;
@@ -33,11 +34,11 @@ bool MeshProjection::GetUVFromNearest( Wml::Vector3f vPoint, Wml::Vector2f & vUV
 	if (! bvTree.FindNearest( vPoint, vNearest, tNearestID ) ) 
 		return false;
 
+	// closest-point kernel gives us the barycentrics directly (and clamped to the triangle)
 	float fBary[3];
 	Wml::Vector3f vTri[3];
 	mesh.GetTriangle(tNearestID, vTri);
-	BarycentricCoords( vTri[0], vTri[1], vTri[2], vNearest,
-		fBary[0], fBary[1], fBary[2] );
+	PointTriangleSqrDistance( vPoint, vTri[0], vTri[1], vTri[2], fBary );
 
 	MeshPolygons::PolygonID polyID = polygons.FindPolygon(tNearestID);
 	const std::vector<IMesh::VertexID> & vPolyLoop = polygons.GetBoundary(polyID);
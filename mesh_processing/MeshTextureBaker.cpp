@@ -0,0 +1,393 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MeshTextureBaker.h"
+#include "MeshUtils.h"
+#include "VectorUtil.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace rms;
+
+
+namespace {
+
+// integer hash (avalanching, so neighbouring inputs give unrelated outputs)
+inline unsigned int MeshTextureBaker_Hash( unsigned int n )
+{
+	n ^= n >> 16;  n *= 0x7feb352dU;
+	n ^= n >> 15;  n *= 0x846ca68bU;
+	n ^= n >> 16;
+	return n;
+}
+
+inline float MeshTextureBaker_Unit( unsigned int n )
+{
+	return (float)(n >> 8) * (1.0f / 16777216.0f);
+}
+
+inline float MeshTextureBaker_Diagonal( VFTriangleMesh & mesh )
+{
+	Wml::AxisAlignedBox3f bounds;
+	mesh.GetBoundingBox(bounds);
+	return Wml::Vector3f( bounds.Max[0]-bounds.Min[0], bounds.Max[1]-bounds.Min[1], bounds.Max[2]-bounds.Min[2] ).Length();
+}
+
+}  // end anonymous namespace
+
+
+
+MeshTextureBaker::MeshTextureBaker()
+{
+	m_pLowMesh = m_pHighMesh = m_pCage = NULL;
+	m_nUVSet = 0;
+	m_bTreesExpanded = false;
+	m_nWidth = m_nHeight = 512;
+	m_nPadding = 4;
+	m_fFront = m_fBack = 0;
+	m_nAOStrata = 8;
+	m_fAODistance = 0;
+	m_nSeed = 0;
+	m_bUseMeshNormals = false;
+}
+
+MeshTextureBaker::~MeshTextureBaker()
+{
+}
+
+
+void MeshTextureBaker::SetLowMesh( VFTriangleMesh * pLowMesh, IMesh::UVSetID nUVSet )
+{
+	m_pLowMesh = pLowMesh;
+	m_nUVSet = nUVSet;
+	m_UVTree.SetMesh( pLowMesh );
+	m_UVTree.SetUVSet( nUVSet );
+	m_bTreesExpanded = false;
+}
+
+void MeshTextureBaker::SetHighMesh( VFTriangleMesh * pHighMesh )
+{
+	m_pHighMesh = pHighMesh;
+	m_HighTree.SetMesh( pHighMesh );
+	m_bTreesExpanded = false;
+}
+
+void MeshTextureBaker::SetAORayCount( unsigned int nRays )
+{
+	m_nAOStrata = 1;
+	while ( m_nAOStrata * m_nAOStrata < nRays )
+		++m_nAOStrata;
+}
+
+
+const MeshTextureBaker::Image & MeshTextureBaker::GetImage( BakeChannel eChannel ) const
+{
+	switch ( eChannel ) {
+		case Normals:			return m_Normals;
+		case Displacement:		return m_Displacement;
+		case AmbientOcclusion:	return m_Occlusion;
+		default:				return m_Colors;
+	}
+}
+
+
+
+bool MeshTextureBaker::Compute( int nChannels )
+{
+	m_Normals = m_Displacement = m_Occlusion = m_Colors = m_Coverage = Image();
+	if ( m_pLowMesh == NULL || m_pHighMesh == NULL || ! m_pLowMesh->HasUVSet(m_nUVSet)
+		 || m_pHighMesh->GetTriangleCount() == 0 || m_nWidth == 0 || m_nHeight == 0 )
+		return false;
+	if ( m_pCage && m_pCage->GetMaxVertexID() < m_pLowMesh->GetMaxVertexID() )
+		return false;
+
+	// queries are read-only (and so thread-safe) on expanded trees
+	if ( ! m_bTreesExpanded ) {
+		m_UVTree.ExpandAll();
+		m_HighTree.ExpandAll();
+		m_bTreesExpanded = true;
+	}
+
+	// vertex normals of both meshes
+	VFTriangleMesh * pMeshes[2] = { m_pLowMesh, m_pHighMesh };
+	std::vector<Wml::Vector3f> * pNormals[2] = { &m_vLowNormals, &m_vHighNormals };
+	for ( int k = 0; k < 2; ++k ) {
+		VFTriangleMesh & mesh = *pMeshes[k];
+		std::vector<Wml::Vector3f> & vNormals = *pNormals[k];
+		vNormals.resize(0);
+		vNormals.resize( mesh.GetMaxVertexID(), Wml::Vector3f::UNIT_Z );
+		int nMaxID = (int)mesh.GetMaxVertexID();
+		if ( m_bUseMeshNormals && mesh.HasVertexAttribute( VFTriangleMesh::VertexNormals ) ) {
+			Wml::Vector3f vVertex;
+			for ( int vID = 0; vID < nMaxID; ++vID ) {
+				if ( mesh.IsVertex(vID) )
+					mesh.GetVertex( vID, vVertex, &vNormals[vID] );
+			}
+		} else {
+			#pragma omp parallel for schedule(dynamic,1024)
+			for ( int vID = 0; vID < nMaxID; ++vID ) {
+				if ( mesh.IsVertex(vID) )
+					vNormals[vID] = MeshUtils::EstimateNormal( mesh, vID );
+			}
+		}
+	}
+
+	float fDiag = MeshTextureBaker_Diagonal( *m_pHighMesh );
+	BakeParams params;
+	params.nChannels = nChannels;
+	params.fFront = (m_fFront > 0) ? m_fFront : 0.02f * fDiag;
+	params.fBack = (m_fBack > 0) ? m_fBack : 0.02f * fDiag;
+	params.fAODistance = (m_fAODistance > 0) ? m_fAODistance : fDiag;
+	params.fAOOffset = 1e-4f * fDiag;
+
+	m_Coverage.Resize( m_nWidth, m_nHeight, 1 );
+	std::vector<Image *> vImages;
+	if ( nChannels & Normals ) {
+		m_Normals.Resize( m_nWidth, m_nHeight, 3 );
+		vImages.push_back( &m_Normals );
+	}
+	if ( nChannels & Displacement ) {
+		m_Displacement.Resize( m_nWidth, m_nHeight, 1 );
+		vImages.push_back( &m_Displacement );
+	}
+	if ( nChannels & AmbientOcclusion ) {
+		m_Occlusion.Resize( m_nWidth, m_nHeight, 1 );
+		vImages.push_back( &m_Occlusion );
+	}
+	if ( nChannels & Colors ) {
+		m_Colors.Resize( m_nWidth, m_nHeight, 4 );
+		vImages.push_back( &m_Colors );
+	}
+
+	// tiles write disjoint texels
+	int nTilesX = (m_nWidth + TileSize - 1) / TileSize;
+	int nTilesY = (m_nHeight + TileSize - 1) / TileSize;
+	int nTiles = nTilesX * nTilesY;
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int ti = 0; ti < nTiles; ++ti )
+		BakeTile( ti % nTilesX, ti / nTilesX, params );
+
+	Dilate( vImages );
+	return true;
+}
+
+
+
+void MeshTextureBaker::BakeTile( unsigned int nTileX, unsigned int nTileY, const BakeParams & params )
+{
+	unsigned int x0 = nTileX * TileSize, x1 = std::min( m_nWidth, x0 + TileSize );
+	unsigned int y0 = nTileY * TileSize, y1 = std::min( m_nHeight, y0 + TileSize );
+	float fW = (float)m_nWidth, fH = (float)m_nHeight;
+
+	std::vector<IMesh::TriangleID> vTris;
+	Wml::AxisAlignedBox2f box( (float)x0 / fW, (float)x1 / fW, (float)y0 / fH, (float)y1 / fH );
+	m_UVTree.FindTriangles( box, vTris );
+	if ( vTris.empty() )
+		return;
+	std::sort( vTris.begin(), vTris.end() );
+
+	// rasterize at texel centers. Triangles are in ID order and a texel keeps the first one that covers it
+	std::vector<IMesh::TriangleID> vTexelTri( TileSize*TileSize, IMesh::InvalidID );
+	std::vector<float> vTexelBary( 3*TileSize*TileSize );
+	for ( unsigned int i = 0; i < vTris.size(); ++i ) {
+		Wml::Vector2f vUV[3];
+		if ( ! m_pLowMesh->GetTriangleUV( vTris[i], m_nUVSet, vUV ) )
+			continue;
+		Wml::Vector2f e1( vUV[1] - vUV[0] ), e2( vUV[2] - vUV[0] );
+		float fArea = e1.X()*e2.Y() - e1.Y()*e2.X();
+		if ( fabs(fArea) < 1e-20f )
+			continue;
+		float fInvArea = 1.0f / fArea;
+
+		float fMinU = std::min( vUV[0].X(), std::min(vUV[1].X(), vUV[2].X()) ) * fW - 0.5f;
+		float fMaxU = std::max( vUV[0].X(), std::max(vUV[1].X(), vUV[2].X()) ) * fW - 0.5f;
+		float fMinV = std::min( vUV[0].Y(), std::min(vUV[1].Y(), vUV[2].Y()) ) * fH - 0.5f;
+		float fMaxV = std::max( vUV[0].Y(), std::max(vUV[1].Y(), vUV[2].Y()) ) * fH - 0.5f;
+		int nx0 = std::max( (int)x0, (int)ceil(fMinU) ), nx1 = std::min( (int)x1 - 1, (int)floor(fMaxU) );
+		int ny0 = std::max( (int)y0, (int)ceil(fMinV) ), ny1 = std::min( (int)y1 - 1, (int)floor(fMaxV) );
+
+		for ( int y = ny0; y <= ny1; ++y ) {
+			for ( int x = nx0; x <= nx1; ++x ) {
+				unsigned int nLocal = (y - y0) * TileSize + (x - x0);
+				if ( vTexelTri[nLocal] != IMesh::InvalidID )
+					continue;
+				Wml::Vector2f d( ((float)x + 0.5f) / fW - vUV[0].X(), ((float)y + 0.5f) / fH - vUV[0].Y() );
+				float b1 = (d.X()*e2.Y() - d.Y()*e2.X()) * fInvArea;
+				float b2 = (e1.X()*d.Y() - e1.Y()*d.X()) * fInvArea;
+				float b0 = 1.0f - b1 - b2;
+				const float fEps = -1e-6f;		// texels on shared edges are claimed by the lower triangle ID
+				if ( b0 < fEps || b1 < fEps || b2 < fEps )
+					continue;
+				vTexelTri[nLocal] = vTris[i];
+				vTexelBary[3*nLocal] = b0;  vTexelBary[3*nLocal+1] = b1;  vTexelBary[3*nLocal+2] = b2;
+			}
+		}
+	}
+
+	unsigned int nRays = m_nAOStrata * m_nAOStrata;
+	std::vector<Wml::Vector3f> vOrigins( nRays ), vDirections( nRays );
+	std::vector<unsigned char> vOccluded( nRays );
+	for ( unsigned int y = y0; y < y1; ++y ) {
+		for ( unsigned int x = x0; x < x1; ++x ) {
+			unsigned int nLocal = (y - y0) * TileSize + (x - x0);
+			if ( vTexelTri[nLocal] == IMesh::InvalidID )
+				continue;
+			*m_Coverage.Texel(x,y) = 1.0f;
+			BakeTexel( x, y, vTexelTri[nLocal], &vTexelBary[3*nLocal], params, vOrigins, vDirections, vOccluded );
+		}
+	}
+}
+
+
+
+void MeshTextureBaker::BakeTexel( unsigned int x, unsigned int y, IMesh::TriangleID tID, const float fBary[3], const BakeParams & params,
+								  std::vector<Wml::Vector3f> & vOrigins, std::vector<Wml::Vector3f> & vDirections, std::vector<unsigned char> & vOccluded )
+{
+	// point and normal on the low surface
+	IMesh::VertexID nTri[3];
+	m_pLowMesh->GetTriangle( tID, nTri );
+	Wml::Vector3f vPoint( Wml::Vector3f::ZERO ), vNormal( Wml::Vector3f::ZERO );
+	for ( int j = 0; j < 3; ++j ) {
+		vPoint += fBary[j] * m_pLowMesh->GetVertex( nTri[j] );
+		vNormal += fBary[j] * m_vLowNormals[ nTri[j] ];
+	}
+	if ( vNormal.Normalize() == 0 )
+		vNormal = Wml::Vector3f::UNIT_Z;
+
+	Wml::Vector3f vOrigin( vPoint + params.fFront * vNormal ), vDirection( -vNormal );
+	float fMaxT = params.fFront + params.fBack;
+	if ( m_pCage ) {
+		Wml::Vector3f vCage( Wml::Vector3f::ZERO );
+		for ( int j = 0; j < 3; ++j )
+			vCage += fBary[j] * m_pCage->GetVertex( nTri[j] );
+		Wml::Vector3f vToLow( vPoint - vCage );
+		float fLength = vToLow.Normalize();
+		if ( fLength > 0 ) {
+			vOrigin = vCage;
+			vDirection = vToLow;
+			fMaxT = fLength + params.fBack;
+		}
+	}
+
+	// hit on the high mesh, or the nearest point if the ray misses
+	Wml::Vector3f vHit;
+	IMesh::TriangleID tHit;
+	bool bFound = m_HighTree.FindRayIntersection( vOrigin, vDirection, vHit, tHit ) && (vHit - vOrigin).Length() <= fMaxT;
+	if ( ! bFound ) {
+		float fDistance;
+		bFound = m_HighTree.FindNearest( vPoint, params.fFront + params.fBack, vHit, tHit, fDistance );
+	}
+
+	Wml::Vector3f vHitNormal( vNormal );
+	float fHitBary[3] = { 1, 0, 0 };
+	IMesh::VertexID nHitTri[3] = { 0, 0, 0 };
+	if ( bFound ) {
+		Wml::Vector3f vTri[3];
+		m_pHighMesh->GetTriangle( tHit, nHitTri );
+		m_pHighMesh->GetTriangle( tHit, vTri );
+		BarycentricCoords( vTri[0], vTri[1], vTri[2], vHit, fHitBary[0], fHitBary[1], fHitBary[2] );
+		vHitNormal = fHitBary[0] * m_vHighNormals[nHitTri[0]] + fHitBary[1] * m_vHighNormals[nHitTri[1]] + fHitBary[2] * m_vHighNormals[nHitTri[2]];
+		if ( vHitNormal.Normalize() == 0 )
+			vHitNormal = vNormal;
+	}
+
+	if ( params.nChannels & Normals ) {
+		float * pTexel = m_Normals.Texel(x,y);
+		pTexel[0] = vHitNormal.X();  pTexel[1] = vHitNormal.Y();  pTexel[2] = vHitNormal.Z();
+	}
+
+	if ( params.nChannels & Displacement )
+		*m_Displacement.Texel(x,y) = (bFound) ? (vHit - vPoint).Dot(vNormal) : 0.0f;
+
+	if ( params.nChannels & Colors ) {
+		float * pTexel = m_Colors.Texel(x,y);
+		for ( int j = 0; bFound && j < 3; ++j ) {
+			Wml::ColorRGBA cColor;
+			m_pHighMesh->GetColor( nHitTri[j], cColor );
+			for ( int k = 0; k < 4; ++k )
+				pTexel[k] += fHitBary[j] * cColor[k];
+		}
+	}
+
+	if ( params.nChannels & AmbientOcclusion ) {
+		float fOpen = 1.0f;
+		if ( bFound ) {
+			// stratified cosine-weighted rays around the high normal, jitter hashed from (seed, texel, cell)
+			Wml::Vector3f vU, vV;
+			Wml::Vector3f::GenerateComplementBasis( vU, vV, vHitNormal );
+			Wml::Vector3f vAOOrigin( vHit + params.fAOOffset * vHitNormal );
+			unsigned int nTexelHash = MeshTextureBaker_Hash( m_nSeed ^ MeshTextureBaker_Hash( y * m_nWidth + x ) );
+			unsigned int nRays = m_nAOStrata * m_nAOStrata;
+			for ( unsigned int r = 0; r < nRays; ++r ) {
+				unsigned int nHash = MeshTextureBaker_Hash( nTexelHash ^ r );
+				float fU1 = ( (float)(r / m_nAOStrata) + MeshTextureBaker_Unit(nHash) ) / (float)m_nAOStrata;
+				float fU2 = ( (float)(r % m_nAOStrata) + MeshTextureBaker_Unit( MeshTextureBaker_Hash(nHash) ) ) / (float)m_nAOStrata;
+				float fR = sqrt(fU1), fPhi = Wml::Mathf::TWO_PI * fU2;
+				vOrigins[r] = vAOOrigin;
+				vDirections[r] = (fR * (float)cos(fPhi)) * vU + (fR * (float)sin(fPhi)) * vV + (float)sqrt( std::max(0.0f, 1.0f - fU1) ) * vHitNormal;
+			}
+			m_HighTree.TestOcclusion( &vOrigins[0], &vDirections[0], nRays, params.fAODistance, &vOccluded[0] );
+			unsigned int nOpen = 0;
+			for ( unsigned int r = 0; r < nRays; ++r )
+				nOpen += (vOccluded[r] == 0) ? 1 : 0;
+			fOpen = (float)nOpen / (float)nRays;
+		}
+		*m_Occlusion.Texel(x,y) = fOpen;
+	}
+}
+
+
+
+void MeshTextureBaker::Dilate( std::vector<Image *> & vImages )
+{
+	int nWidth = (int)m_nWidth, nHeight = (int)m_nHeight;
+	std::vector<unsigned char> vFilled( m_Coverage.vPixels.size() ), vNextFilled;
+	for ( unsigned int i = 0; i < vFilled.size(); ++i )
+		vFilled[i] = (m_Coverage.vPixels[i] > 0) ? 1 : 0;
+
+	// each pass fills the texels next to filled ones with the average of their filled 8-neighbours.
+	// It reads the previous pass only, so rows are independent
+	for ( unsigned int nPass = 0; nPass < m_nPadding; ++nPass ) {
+		vNextFilled = vFilled;
+		std::vector< std::vector<float> > vPrev( vImages.size() );
+		for ( unsigned int k = 0; k < vImages.size(); ++k )
+			vPrev[k] = vImages[k]->vPixels;
+
+		#pragma omp parallel for schedule(dynamic,16)
+		for ( int y = 0; y < nHeight; ++y ) {
+			for ( int x = 0; x < nWidth; ++x ) {
+				if ( vFilled[y*nWidth + x] )
+					continue;
+				int nNbrs[8], nCount = 0;
+				for ( int dy = -1; dy <= 1; ++dy ) {
+					for ( int dx = -1; dx <= 1; ++dx ) {
+						int nx = x + dx, ny = y + dy;
+						if ( (dx != 0 || dy != 0) && nx >= 0 && ny >= 0 && nx < nWidth && ny < nHeight && vFilled[ny*nWidth + nx] )
+							nNbrs[nCount++] = ny*nWidth + nx;
+					}
+				}
+				if ( nCount == 0 )
+					continue;
+				vNextFilled[y*nWidth + x] = 1;
+				for ( unsigned int k = 0; k < vImages.size(); ++k ) {
+					unsigned int nC = vImages[k]->nChannels;
+					float * pTexel = &vImages[k]->vPixels[ (y*nWidth + x) * nC ];
+					for ( unsigned int c = 0; c < nC; ++c ) {
+						float fSum = 0;
+						for ( int n = 0; n < nCount; ++n )
+							fSum += vPrev[k][ nNbrs[n]*nC + c ];
+						pTexel[c] = fSum / (float)nCount;
+					}
+					if ( vImages[k] == &m_Normals ) {
+						Wml::Vector3f vNormal( pTexel[0], pTexel[1], pTexel[2] );
+						vNormal.Normalize();
+						pTexel[0] = vNormal.X();  pTexel[1] = vNormal.Y();  pTexel[2] = vNormal.Z();
+					}
+				}
+			}
+		}
+		vFilled.swap( vNextFilled );
+	}
+}
@@ -0,0 +1,146 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include <VFTriangleMesh.h>
+#include <IMeshBVTree.h>
+#include <IMeshUVBVTree.h>
+
+
+namespace rms {
+
+
+/*
+ * Transfer of surface detail from a high-resolution mesh into textures of a low-resolution mesh.
+ *
+ * The texture is split into tiles that are baked in parallel (OpenMP). The low triangles that overlap
+ * a tile are found with an IMeshUVBVTree box query and rasterized into the tile (texel centers, lowest
+ * triangle ID wins on shared edges). For each covered texel a ray is cast from the low surface into the
+ * high mesh's IMeshBVTree: from a cage mesh (if set) towards the low surface, or from the low surface
+ * offset along its normal back through it. Texels whose ray misses use the nearest point on the high
+ * mesh within the same distance. Vertex normals are estimated from the meshes, or taken from their normal
+ * layers with SetUseMeshNormals(). Values are then taken from the high mesh at the hit:
+ *
+ *   Normals			- interpolated high vertex normal, object space (xyz in [-1,1])
+ *   Displacement		- signed distance from the low surface to the hit along the low normal
+ *   AmbientOcclusion	- unoccluded fraction of stratified cosine-weighted rays (batched any-hit queries)
+ *   Colors				- interpolated high vertex color (RGBA)
+ *
+ * Texel (x,y) is sampled at uv = ((x+0.5)/width, (y+0.5)/height), rows are stored bottom (v=0) to top.
+ * Uncovered texels are filled by dilating the covered ones for SetPadding() texels, so that filtering
+ * across UV seams does not pick up the background.
+ */
+class MeshTextureBaker
+{
+public:
+	enum BakeChannel {
+		Normals = 1,
+		Displacement = 2,
+		AmbientOcclusion = 4,
+		Colors = 8
+	};
+
+	//! row-major float image, nChannels floats per texel
+	struct Image {
+		unsigned int nWidth;
+		unsigned int nHeight;
+		unsigned int nChannels;
+		std::vector<float> vPixels;
+
+		Image() { nWidth = nHeight = nChannels = 0; }
+		void Resize( unsigned int nW, unsigned int nH, unsigned int nC )
+			{ nWidth = nW; nHeight = nH; nChannels = nC; vPixels.resize(0); vPixels.resize(nW*nH*nC, 0.0f); }
+		float * Texel( unsigned int x, unsigned int y ) { return &vPixels[ (y*nWidth + x) * nChannels ]; }
+		const float * Texel( unsigned int x, unsigned int y ) const { return &vPixels[ (y*nWidth + x) * nChannels ]; }
+	};
+
+	MeshTextureBaker();
+	~MeshTextureBaker();
+
+	//! low mesh and the UV set the texture is laid out in. Meshes are not modified
+	void SetLowMesh( rms::VFTriangleMesh * pLowMesh, IMesh::UVSetID nUVSet = 0 );
+	void SetHighMesh( rms::VFTriangleMesh * pHighMesh );
+
+	//! optional cage, with the same vertex IDs as the low mesh. Rays start on the cage and go through the low surface
+	void SetCage( rms::VFTriangleMesh * pCage ) { m_pCage = pCage; }
+
+	//! without a cage, rays start fFront above the low surface and end fBack below it.
+	//! With a cage they end fBack below the low surface. 0 (the default) means 2% of the high mesh bounding box diagonal
+	void SetRayDistances( float fFront, float fBack ) { m_fFront = fFront; m_fBack = fBack; }
+
+	void SetImageSize( unsigned int nWidth, unsigned int nHeight ) { m_nWidth = nWidth; m_nHeight = nHeight; }
+
+	//! covered texels are dilated into the background by this many texels (default 4)
+	void SetPadding( unsigned int nTexels ) { m_nPadding = nTexels; }
+
+	//! AO rays per texel, rounded up to a square (default 64), and their length (0 = high mesh bounding box diagonal)
+	void SetAORayCount( unsigned int nRays );
+	void SetAODistance( float fDistance ) { m_fAODistance = fDistance; }
+	void SetSeed( unsigned int nSeed ) { m_nSeed = nSeed; }
+
+	//! use the normals stored in the low/high meshes instead of estimating them (default false).
+	//! Only set this if the normals were actually assigned, the normal layer is enabled (and UNIT_Z) by default
+	void SetUseMeshNormals( bool bUse ) { m_bUseMeshNormals = bUse; }
+
+	//! nChannels is a combination of BakeChannel
+	bool Compute( int nChannels );
+
+	//! images of the last Compute(). Empty if the channel was not baked
+	const Image & GetImage( BakeChannel eChannel ) const;
+
+	//! 1 for texels covered by a low triangle, 0 otherwise (including padding)
+	const Image & GetCoverage() const { return m_Coverage; }
+
+protected:
+	rms::VFTriangleMesh * m_pLowMesh;
+	rms::VFTriangleMesh * m_pHighMesh;
+	rms::VFTriangleMesh * m_pCage;
+	IMesh::UVSetID m_nUVSet;
+
+	IMeshUVBVTree m_UVTree;
+	IMeshBVTree m_HighTree;
+	bool m_bTreesExpanded;
+
+	unsigned int m_nWidth;
+	unsigned int m_nHeight;
+	unsigned int m_nPadding;
+	float m_fFront;
+	float m_fBack;
+	unsigned int m_nAOStrata;
+	float m_fAODistance;
+	unsigned int m_nSeed;
+	bool m_bUseMeshNormals;
+
+	Image m_Normals;
+	Image m_Displacement;
+	Image m_Occlusion;
+	Image m_Colors;
+	Image m_Coverage;
+
+	enum { TileSize = 32 };
+
+	std::vector<Wml::Vector3f> m_vLowNormals;
+	std::vector<Wml::Vector3f> m_vHighNormals;
+
+	// ray distances and AO settings of the current Compute()
+	struct BakeParams {
+		int nChannels;
+		float fFront;
+		float fBack;
+		float fAODistance;
+		float fAOOffset;
+	};
+
+	void BakeTile( unsigned int nTileX, unsigned int nTileY, const BakeParams & params );
+	void BakeTexel( unsigned int x, unsigned int y, IMesh::TriangleID tID, const float fBary[3], const BakeParams & params,
+					std::vector<Wml::Vector3f> & vOrigins, std::vector<Wml::Vector3f> & vDirections, std::vector<unsigned char> & vOccluded );
+	void Dilate( std::vector<Image *> & vImages );
+};
+
+
+
+}   // end namespace rms
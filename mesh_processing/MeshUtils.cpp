@@ -11,6 +11,8 @@
 #include "rmsdebug.h"
 #include "rmsprofile.h"
 
+#include <algorithm>
+
 using namespace rms;
 
 MeshUtils::MeshUtils(void)
@@ -384,96 +386,195 @@ bool MeshUtils::CheckForFins( VFTriangleMesh & mesh )
 	return (nFins > 0);
 }
 
-bool MeshUtils::CheckMeshValidity( VFTriangleMesh & mesh, bool bTopologyChecks )
+void MeshUtils::ValidityReport::Clear()
 {
-	bool bOK = true;
+	vBadVertexRefs.resize(0);
+	vLowValenceVertices.resize(0);
+	vBadTriangles.resize(0);
+	vDegenerateTriangles.resize(0);
+	vBadEdges.resize(0);
+	bTopologyChecked = false;
+}
 
-	// check verts
-	VFTriangleMesh::vertex_iterator curv(mesh.BeginVertices()), endv(mesh.EndVertices());
-	while ( curv != endv ) {
-		IMesh::VertexID vID = *curv++;
-		if ( ! mesh.IsVertex(vID) ) {
-			bOK = false; lgBreakToDebugger();
-		}
+size_t MeshUtils::ValidityReport::ErrorCount() const
+{
+	return vBadVertexRefs.size() + vLowValenceVertices.size() + vBadTriangles.size()
+		+ vDegenerateTriangles.size() + vBadEdges.size();
+}
 
-		// do nbr iters
-		VFTriangleMesh::VtxNbrItr triItr(vID);
-		mesh.BeginVtxTriangles(triItr);
-		IMesh::TriangleID tID = mesh.GetNextVtxTriangle(triItr);
-		while ( tID != IMesh::InvalidID ) {
-			if ( ! mesh.IsTriangle(tID) ) {
-				bOK = false; lgBreakToDebugger();
-			}
-			tID = mesh.GetNextVtxTriangle(triItr);
-		}
+void MeshUtils::ValidityReport::Print() const
+{
+	if ( IsValid() ) {
+		_RMSInfo("Mesh is valid%s\n", bTopologyChecked ? "" : " (no topology checks)");
+		return;
+	}
+	if ( ! vBadVertexRefs.empty() )
+		_RMSInfo("  %d vertices reference removed triangles/edges (first %d)\n", (int)vBadVertexRefs.size(), vBadVertexRefs[0]);
+	if ( ! vLowValenceVertices.empty() )
+		_RMSInfo("  %d interior vertices with valence < 3 (first %d)\n", (int)vLowValenceVertices.size(), vLowValenceVertices[0]);
+	if ( ! vBadTriangles.empty() )
+		_RMSInfo("  %d triangles reference invalid vertices (first %d)\n", (int)vBadTriangles.size(), vBadTriangles[0]);
+	if ( ! vDegenerateTriangles.empty() )
+		_RMSInfo("  %d degenerate triangles (first %d)\n", (int)vDegenerateTriangles.size(), vDegenerateTriangles[0]);
+	if ( ! vBadEdges.empty() )
+		_RMSInfo("  %d inconsistent edges (first %d)\n", (int)vBadEdges.size(), vBadEdges[0]);
+}
 
-		VFTriangleMesh::VtxNbrItr edgeItr(vID);
-		mesh.BeginVtxEdges(edgeItr);
-		IMesh::EdgeID eID = mesh.GetNextVtxEdges(edgeItr);
-		while ( eID != IMesh::InvalidID ) {
-			if ( ! mesh.IsEdge(eID) ) {
-				bOK = false; lgBreakToDebugger();
-			}
-			eID = mesh.GetNextVtxEdges(edgeItr);
-		}
 
-		if ( bTopologyChecks ) {
-			bool bIsBoundary = mesh.IsBoundaryVertex(vID);
+bool MeshUtils::CheckMeshValidity( const VFTriangleMesh & mesh, ValidityReport & report, bool bTopologyChecks, float fDegenerateArea )
+{
+	report.Clear();
+	report.bTopologyChecked = bTopologyChecks;
+
+	// The checks only read the mesh, so each ID range is split across threads. Each thread
+	// collects failures locally and appends them once; the lists are sorted at the end so the
+	// report does not depend on the schedule.
+
+	// check vertex neighbour lists
+	int nMaxVID = (int)mesh.GetMaxVertexID();
+	#pragma omp parallel
+	{
+		std::vector<IMesh::VertexID> vBadRefs, vLowValence;
+
+		#pragma omp for schedule(dynamic,4096)
+		for ( int i = 0; i < nMaxVID; ++i ) {
+			IMesh::VertexID vID = (IMesh::VertexID)i;
+			if ( ! mesh.IsVertex(vID) )
+				continue;
 
-			if ( ! bIsBoundary && mesh.GetTriangleCount(vID) < 3 ) {
-				bOK = false; lgBreakToDebugger();
+			bool bBadRef = false;
+			unsigned int nTris = 0, nEdges = 0;
+			bool bIsBoundary = false;
+
+			VFTriangleMesh::VtxNbrItr triItr(vID);
+			mesh.BeginVtxTriangles(triItr);
+			IMesh::TriangleID tID = mesh.GetNextVtxTriangle(triItr);
+			while ( tID != IMesh::InvalidID ) {
+				if ( ! mesh.IsTriangle(tID) )
+					bBadRef = true;
+				++nTris;
+				tID = mesh.GetNextVtxTriangle(triItr);
 			}
 
-			if ( ! bIsBoundary && mesh.GetEdgeCount(vID) < 3 ) {
-				bOK = false; lgBreakToDebugger();
+			VFTriangleMesh::VtxNbrItr edgeItr(vID);
+			mesh.BeginVtxEdges(edgeItr);
+			IMesh::EdgeID eID = mesh.GetNextVtxEdges(edgeItr);
+			while ( eID != IMesh::InvalidID ) {
+				if ( ! mesh.IsEdge(eID) )
+					bBadRef = true;
+				else if ( ! bIsBoundary ) {
+					IMesh::VertexID nVtx[2];  IMesh::TriangleID nTri[2];
+					mesh.GetEdge(eID, nVtx, nTri);
+					bIsBoundary = ( nTri[0] == IMesh::InvalidID || nTri[1] == IMesh::InvalidID );
+				}
+				++nEdges;
+				eID = mesh.GetNextVtxEdges(edgeItr);
 			}
+
+			if ( bBadRef )
+				vBadRefs.push_back(vID);
+			else if ( bTopologyChecks && ! bIsBoundary && (nTris < 3 || nEdges < 3) )
+				vLowValence.push_back(vID);
+		}
+
+		#pragma omp critical(MeshUtils_CheckMeshValidity)
+		{
+			report.vBadVertexRefs.insert( report.vBadVertexRefs.end(), vBadRefs.begin(), vBadRefs.end() );
+			report.vLowValenceVertices.insert( report.vLowValenceVertices.end(), vLowValence.begin(), vLowValence.end() );
 		}
 	}
 
+	// check that each tri vert is a real vert, and that the triangle is not degenerate
+	int nMaxTID = (int)mesh.GetMaxTriangleID();
+	#pragma omp parallel
+	{
+		std::vector<IMesh::TriangleID> vBad, vDegenerate;
 
-	// check that each tri vert is a real vert
-	VFTriangleMesh::triangle_iterator curt(mesh.BeginTriangles()), endt(mesh.EndTriangles());
-	while ( curt != endt ) {
-		IMesh::TriangleID tID = *curt++;
-		if (! mesh.IsTriangle(tID) ) {
-			bOK = false; lgBreakToDebugger();
-		}
-		IMesh::VertexID nTri[3];
-		mesh.GetTriangle(tID, nTri);
-		for ( int j = 0; j < 3; ++j ) {
-			if ( ! mesh.IsVertex( nTri[j]) ) {
-				bOK = false; lgBreakToDebugger();
+		#pragma omp for schedule(dynamic,4096)
+		for ( int i = 0; i < nMaxTID; ++i ) {
+			IMesh::TriangleID tID = (IMesh::TriangleID)i;
+			if ( ! mesh.IsTriangle(tID) )
+				continue;
+
+			IMesh::VertexID nTri[3];
+			mesh.GetTriangle(tID, nTri);
+			if ( ! mesh.IsVertex(nTri[0]) || ! mesh.IsVertex(nTri[1]) || ! mesh.IsVertex(nTri[2]) ) {
+				vBad.push_back(tID);
+				continue;
 			}
+
+			Wml::Vector3f vVerts[3];
+			mesh.GetTriangle(tID, vVerts);
+			if ( Area(vVerts[0], vVerts[1], vVerts[2]) < fDegenerateArea )
+				vDegenerate.push_back(tID);
 		}
 
-		Wml::Vector3f vVerts[3];
-		mesh.GetTriangle(tID, vVerts);
-		float fArea = Area(vVerts[0], vVerts[1], vVerts[2]);
-		if ( fArea < 0.00001f ) {
-			bOK = false; lgBreakToDebugger();
+		#pragma omp critical(MeshUtils_CheckMeshValidity)
+		{
+			report.vBadTriangles.insert( report.vBadTriangles.end(), vBad.begin(), vBad.end() );
+			report.vDegenerateTriangles.insert( report.vDegenerateTriangles.end(), vDegenerate.begin(), vDegenerate.end() );
 		}
 	}
 
-	// check that each edge vert is a real vert
-	VFTriangleMesh::edge_iterator cure(mesh.BeginEdges()), ende(mesh.EndEdges());
-	while ( cure != ende ) {
-		IMesh::EdgeID eID = *cure++;
-		if (! mesh.IsEdge(eID) ) {
-			bOK = false; lgBreakToDebugger();
-		}
-		IMesh::VertexID nVtx[2];
-		IMesh::TriangleID nTri[2];
-		mesh.GetEdge(eID, nVtx, nTri);
-		for ( int j = 0; j < 2; ++j ) {
-			if ( ! mesh.IsVertex( nVtx[j]) ) {
-				bOK = false; lgBreakToDebugger();
-			}
-			if ( nTri[j] != IMesh::InvalidID && ! mesh.IsTriangle( nTri[j]) ) {
-				bOK = false; lgBreakToDebugger();
+	// check that each edge references real verts, and real tris that contain it
+	int nMaxEID = (int)mesh.GetMaxEdgeID();
+	#pragma omp parallel
+	{
+		std::vector<IMesh::EdgeID> vBad;
+
+		#pragma omp for schedule(dynamic,4096)
+		for ( int i = 0; i < nMaxEID; ++i ) {
+			IMesh::EdgeID eID = (IMesh::EdgeID)i;
+			if ( ! mesh.IsEdge(eID) )
+				continue;
+
+			IMesh::VertexID nVtx[2];
+			IMesh::TriangleID nTri[2];
+			mesh.GetEdge(eID, nVtx, nTri);
+			bool bOK = mesh.IsVertex(nVtx[0]) && mesh.IsVertex(nVtx[1]);
+			for ( int j = 0; j < 2 && bOK; ++j ) {
+				if ( nTri[j] == IMesh::InvalidID )
+					continue;
+				if ( ! mesh.IsTriangle(nTri[j]) ) {
+					bOK = false;
+					break;
+				}
+				IMesh::VertexID nTriVerts[3];
+				mesh.GetTriangle(nTri[j], nTriVerts);
+				int nFound = 0;
+				for ( int k = 0; k < 3; ++k ) {
+					if ( nTriVerts[k] == nVtx[0] || nTriVerts[k] == nVtx[1] )
+						++nFound;
+				}
+				bOK = (nFound == 2);
 			}
+			if ( ! bOK )
+				vBad.push_back(eID);
+		}
+
+		#pragma omp critical(MeshUtils_CheckMeshValidity)
+		{
+			report.vBadEdges.insert( report.vBadEdges.end(), vBad.begin(), vBad.end() );
 		}
 	}
 
+	std::sort( report.vBadVertexRefs.begin(), report.vBadVertexRefs.end() );
+	std::sort( report.vLowValenceVertices.begin(), report.vLowValenceVertices.end() );
+	std::sort( report.vBadTriangles.begin(), report.vBadTriangles.end() );
+	std::sort( report.vDegenerateTriangles.begin(), report.vDegenerateTriangles.end() );
+	std::sort( report.vBadEdges.begin(), report.vBadEdges.end() );
+
+	return report.IsValid();
+}
+
+bool MeshUtils::CheckMeshValidity( VFTriangleMesh & mesh, bool bTopologyChecks )
+{
+	ValidityReport report;
+	bool bOK = CheckMeshValidity( mesh, report, bTopologyChecks );
+	if ( ! bOK ) {
+		report.Print();
+		lgBreakToDebugger();
+	}
 	return bOK;
 }
 
@@ -909,66 +1010,155 @@ void MeshUtils::FindBoundaryLoopMaps(
 	}
 }
 
-void MeshUtils::FindBoundaryLoops( const rms::VFTriangleMesh & mesh, std::vector< std::vector< rms::IMesh::TriangleID > > & vLoops )
+namespace {
+//! successor table for FindBoundaryLoops. Edges are oriented as in their triangle, and listed
+//! per vertex (at both endpoints) in EdgeID order
+struct BoundaryEdgeTable {
+	std::vector<IMesh::EdgeID> vEdge;
+	std::vector<IMesh::VertexID> vFrom;
+	std::vector<IMesh::VertexID> vTo;
+	std::vector<IMesh::TriangleID> vTri;
+	std::vector<unsigned int> vStart;		// per vertex, into vIncident
+	std::vector<unsigned int> vIncident;
+	std::vector<bool> vUsed;
+
+	void Build( const VFTriangleMesh & mesh );
+	int NextEdge( const VFTriangleMesh & mesh, IMesh::VertexID vCur, unsigned int nPrevEdge ) const;
+	IMesh::EdgeID FanBoundaryEdge( const VFTriangleMesh & mesh, IMesh::VertexID vCur, IMesh::TriangleID tID ) const;
+};
+}
+
+void BoundaryEdgeTable::Build( const VFTriangleMesh & mesh )
 {
-	std::set< IMesh::EdgeID > vBEdges;
+	unsigned int nMaxVID = mesh.GetMaxVertexID();
+	vStart.resize(0);   vStart.resize(nMaxVID+1, 0);
 
+	IMesh::VertexID nVerts[2], vTriVerts[3];   IMesh::TriangleID nTris[2];
 	VFTriangleMesh::edge_iterator cure(mesh.BeginEdges()), ende(mesh.EndEdges());
 	while ( cure != ende ) {
 		IMesh::EdgeID eID = *cure++;
-		if ( mesh.IsBoundaryEdge(eID) )
-			vBEdges.insert(eID); 
-	}
-
-	// ok start loop at first edge
-	while ( ! vBEdges.empty() ) {
-		IMesh::EdgeID eID = *vBEdges.begin();
-		vBEdges.erase(eID);
-
-		IMesh::VertexID nVerts[2];   IMesh::TriangleID nTris[2];
 		mesh.GetEdge(eID, nVerts, nTris);
+		if ( nTris[0] != IMesh::InvalidID && nTris[1] != IMesh::InvalidID )
+			continue;
+		IMesh::TriangleID tID = (nTris[0] != IMesh::InvalidID) ? nTris[0] : nTris[1];
+		if ( tID == IMesh::InvalidID )
+			continue;
 
 		// make sure boundary loops wind in a consistent direction
-		int nTri = (nTris[0] != IMesh::InvalidID) ? 0 : 1;
-		IMesh::VertexID vTri[3];
-		mesh.GetTriangle(nTris[nTri], vTri);
+		mesh.GetTriangle(tID, vTriVerts);
 		bool bFlip = true;
 		for ( int k = 0; k < 3; ++k ) {
-			if ( vTri[k] == nVerts[0] && vTri[(k+1)%3] == nVerts[1] )
+			if ( vTriVerts[k] == nVerts[0] && vTriVerts[(k+1)%3] == nVerts[1] )
 				bFlip = false;
 		}
+		vEdge.push_back(eID);
+		vFrom.push_back( bFlip ? nVerts[1] : nVerts[0] );
+		vTo.push_back( bFlip ? nVerts[0] : nVerts[1] );
+		vTri.push_back(tID);
+		vStart[nVerts[0]+1]++;
+		vStart[nVerts[1]+1]++;
+	}
+
+	for ( unsigned int i = 0; i < nMaxVID; ++i )
+		vStart[i+1] += vStart[i];
+	size_t nEdges = vEdge.size();
+	vIncident.resize( 2*nEdges );
+	std::vector<unsigned int> vFill( vStart.begin(), vStart.end()-1 );
+	for ( unsigned int i = 0; i < nEdges; ++i ) {
+		vIncident[ vFill[vFrom[i]]++ ] = i;
+		vIncident[ vFill[vTo[i]]++ ] = i;
+	}
+	vUsed.resize(0);  vUsed.resize(nEdges, false);
+}
 
-		std::vector<IMesh::VertexID> vLoop;
-		if ( bFlip ) {
-			vLoop.push_back( nVerts[1] );  
-			vLoop.push_back( nVerts[0] );
-		} else {
-			vLoop.push_back( nVerts[0] );  
-			vLoop.push_back( nVerts[1] );
+//! rotate around vCur from tID, across interior edges, to the boundary edge leaving vCur in the same fan
+IMesh::EdgeID BoundaryEdgeTable::FanBoundaryEdge( const VFTriangleMesh & mesh, IMesh::VertexID vCur, IMesh::TriangleID tID ) const
+{
+	IMesh::VertexID vTriVerts[3], nVerts[2];   IMesh::TriangleID nTris[2];
+	unsigned int nMaxSteps = mesh.GetTriangleCount(vCur);
+	for ( unsigned int k = 0; k < nMaxSteps; ++k ) {
+		mesh.GetTriangle(tID, vTriVerts);
+		int j = 0;
+		while ( j < 3 && vTriVerts[j] != vCur )
+			++j;
+		if ( j == 3 )
+			return IMesh::InvalidID;
+		IMesh::EdgeID eID = mesh.FindEdge( vCur, vTriVerts[(j+1)%3] );
+		if ( eID == IMesh::InvalidID )
+			return IMesh::InvalidID;
+		mesh.GetEdge(eID, nVerts, nTris);
+		if ( nTris[0] == IMesh::InvalidID || nTris[1] == IMesh::InvalidID )
+			return eID;
+		tID = (nTris[0] == tID) ? nTris[1] : nTris[0];
+	}
+	return IMesh::InvalidID;
+}
+
+//! next unused boundary edge at vCur (local index), or -1
+int BoundaryEdgeTable::NextEdge( const VFTriangleMesh & mesh, IMesh::VertexID vCur, unsigned int nPrevEdge ) const
+{
+	int nFirstOut = -1, nFirstIn = -1, nOutCount = 0;
+	for ( unsigned int k = vStart[vCur]; k < vStart[vCur+1]; ++k ) {
+		unsigned int i = vIncident[k];
+		if ( vUsed[i] )
+			continue;
+		if ( vFrom[i] == vCur ) {
+			if ( nFirstOut < 0 )
+				nFirstOut = i;
+			++nOutCount;
+		} else if ( nFirstIn < 0 )
+			nFirstIn = i;
+	}
+
+	// bowtie vertex - continue along the boundary of the fan we arrived in
+	if ( nOutCount > 1 && vTo[nPrevEdge] == vCur ) {
+		IMesh::EdgeID eID = FanBoundaryEdge( mesh, vCur, vTri[nPrevEdge] );
+		for ( unsigned int k = vStart[vCur]; k < vStart[vCur+1] && eID != IMesh::InvalidID; ++k ) {
+			unsigned int i = vIncident[k];
+			if ( vEdge[i] == eID && ! vUsed[i] && vFrom[i] == vCur )
+				return i;
 		}
-		IMesh::VertexID nLastVID = vLoop.back();
+	}
 
-		int nIters = 0;
-		const int nWhyIsThisFailing = 100000;
-		while ( nLastVID != vLoop.front() && nIters++ < nWhyIsThisFailing ) {
+	// no outgoing edge means orientation is flipped somewhere, follow the edge backwards
+	return (nFirstOut >= 0) ? nFirstOut : nFirstIn;
+}
 
-			VFTriangleMesh::VtxNbrItr itr(nLastVID);
-			mesh.BeginVtxEdges(itr);
-			eID = mesh.GetNextVtxEdges(itr);
-			while (eID != IMesh::InvalidID) {
-				if ( vBEdges.find(eID) != vBEdges.end() ) {
-					mesh.GetEdge(eID, nVerts, nTris);
-					nLastVID = (nVerts[0] == nLastVID) ? nVerts[1] : nVerts[0];
-					if ( nLastVID != vLoop.front() )
-						vLoop.push_back( nLastVID );
-					vBEdges.erase(eID);
-					eID = IMesh::InvalidID;		
-				} else
-					eID = mesh.GetNextVtxEdges(itr);
-			}
+
+void MeshUtils::FindBoundaryLoops( const rms::VFTriangleMesh & mesh, std::vector< std::vector< rms::IMesh::TriangleID > > & vLoops )
+{
+	BoundaryEdgeTable table;
+	table.Build(mesh);
+
+	// start loops at the lowest unused edge
+	unsigned int nEdges = (unsigned int)table.vEdge.size();
+	for ( unsigned int nStartEdge = 0; nStartEdge < nEdges; ++nStartEdge ) {
+		if ( table.vUsed[nStartEdge] )
+			continue;
+		table.vUsed[nStartEdge] = true;
+
+		std::vector<IMesh::VertexID> vLoop;
+		IMesh::VertexID vStartV = table.vFrom[nStartEdge];
+		IMesh::VertexID vCur = table.vTo[nStartEdge];
+		vLoop.push_back(vStartV);
+		vLoop.push_back(vCur);
+
+		unsigned int nCurEdge = nStartEdge;
+		bool bClosed = false;
+		while ( ! bClosed ) {
+			int nNext = table.NextEdge(mesh, vCur, nCurEdge);
+			if ( nNext < 0 )
+				break;
+			table.vUsed[nNext] = true;
+			nCurEdge = (unsigned int)nNext;
+			vCur = (table.vFrom[nCurEdge] == vCur) ? table.vTo[nCurEdge] : table.vFrom[nCurEdge];
+			if ( vCur == vStartV )
+				bClosed = true;
+			else
+				vLoop.push_back(vCur);
 		}
 
-		if ( nIters != nWhyIsThisFailing ) 
+		if ( bClosed ) 
 			vLoops.push_back(vLoop);
 	}
 }
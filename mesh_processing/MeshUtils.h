@@ -57,6 +57,26 @@ public:
 
 
 	static bool CheckForFins( VFTriangleMesh & mesh );
+
+	//! result of CheckMeshValidity. Each list holds the (sorted) IDs that failed that check
+	struct ValidityReport {
+		std::vector<IMesh::VertexID> vBadVertexRefs;		//! vertex triangle/edge lists reference removed elements
+		std::vector<IMesh::VertexID> vLowValenceVertices;	//! interior vertex with < 3 triangles or edges (topology checks only)
+		std::vector<IMesh::TriangleID> vBadTriangles;		//! triangle references an invalid vertex
+		std::vector<IMesh::TriangleID> vDegenerateTriangles;	//! triangle area below threshold
+		std::vector<IMesh::EdgeID> vBadEdges;				//! edge references an invalid vertex/triangle, or a triangle that does not contain it
+		bool bTopologyChecked;
+
+		void Clear();
+		size_t ErrorCount() const;
+		bool IsValid() const { return ErrorCount() == 0; }
+		//! one line per failed check, via _RMSInfo
+		void Print() const;
+	};
+
+	//! vertices, triangles and edges are checked in parallel over ID ranges (OpenMP). Returns report.IsValid()
+	static bool CheckMeshValidity( const VFTriangleMesh & mesh, ValidityReport & report, bool bTopologyChecks = true, float fDegenerateArea = 0.00001f );
+	//! breaks to debugger if the mesh is invalid
 	static bool CheckMeshValidity( VFTriangleMesh & mesh, bool bTopologyChecks );
 
 	//! bClosed flag is only set if bOrdered is true
@@ -76,6 +96,10 @@ public:
 	static Wml::Vector3f MeshLaplacian( VFTriangleMesh & mesh, IMesh::VertexID vID, std::vector<IMesh::VertexID> & vOneRing, std::vector<float> & vWeights );
 
 
+	//! Loops follow the triangle orientation. Runs in O(boundary edges) from a boundary-edge successor table.
+	//! At a bowtie vertex the loop continues along the boundary of the same triangle fan, and a loop is closed
+	//! the first time it returns to its start vertex. Loops start at their lowest boundary EdgeID, in EdgeID order.
+	//! Edges with flipped orientation are followed in reverse. Chains that do not close (broken topology) are not returned.
 	static void FindBoundaryLoops( const VFTriangleMesh & mesh, std::vector< std::vector< IMesh::VertexID > > & vLoops );
 	static void FindBoundaryEdges( VFTriangleMesh & mesh, std::vector< std::pair<IMesh::VertexID,IMesh::VertexID> > & vEdges);
 
@@ -0,0 +1,963 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "OutOfCoreMesh.h"
+#include "MeshStream.h"
+#include "MeshSmoother.h"
+#include "MeshUtils.h"
+#include "rmsdebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <queue>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+using namespace rms;
+
+
+// per-vertex record in the temporary vertex and result files: position, normal
+static const unsigned int VertexRecordSize = 6 * sizeof(float);
+// per-triangle record in the chunk files: v0, v1, v2, owned flag
+static const unsigned int TriangleRecordSize = 4 * sizeof(unsigned int);
+// chunk result files (operators that change connectivity): new vertex count, triangle count,
+//  new vertex records, then v0, v1, v2 per triangle (global IDs, new vertices numbered from m_nVertices)
+static const unsigned int ResultTriangleSize = 3 * sizeof(unsigned int);
+
+static const unsigned int CellBits = 26;
+static const unsigned int CellMask = (1 << CellBits) - 1;
+
+static double GetSeconds()
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+// resident memory of the process (working set), 0 if not available
+static size_t GetResidentBytes()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+		return counters.WorkingSetSize;
+	return 0;
+#else
+	size_t nBytes = 0;
+	FILE * pFile = fopen( "/proc/self/statm", "r" );
+	if ( pFile != NULL ) {
+		unsigned long nSize = 0, nResident = 0;
+		if ( fscanf( pFile, "%lu %lu", &nSize, &nResident ) == 2 )
+			nBytes = (size_t)nResident * (size_t)sysconf(_SC_PAGESIZE);
+		fclose(pFile);
+	}
+	return nBytes;
+#endif
+}
+
+
+OutOfCoreMesh::OutOfCoreMesh()
+{
+	m_tempDir = ".";
+	m_nTargetTriangles = 1000000;
+	m_fMarginFraction = 0.05f;
+	m_nMemoryBudget = (size_t)2 << 30;
+	m_bWriteNormals = false;
+	m_nVertices = m_nTriangles = 0;
+	m_fCellSize = 0;
+	m_nCells[0] = m_nCells[1] = m_nCells[2] = 1;
+	m_nPeakBytes = m_nMeasuredPeakBytes = 0;
+	m_nResultVertices = m_nResultTriangles = 0;
+}
+
+OutOfCoreMesh::~OutOfCoreMesh()
+{
+	RemoveTempFiles();
+}
+
+
+size_t OutOfCoreMesh::EstimateChunkBytes( unsigned int nVertices, unsigned int nTriangles )
+{
+	// VFTriangleMesh with normals: vertex entry + adjacency + normal + loading tables,
+	//  triangle entry + ~1.5 edges + 6 adjacency list entries + chunk file record
+	return (size_t)nVertices * 96 + (size_t)nTriangles * 176;
+}
+
+
+
+/*
+ * grid setup
+ */
+
+void OutOfCoreMesh::ChooseGrid()
+{
+	m_vOrigin = Wml::Vector3f( m_bounds.Min[0], m_bounds.Min[1], m_bounds.Min[2] );
+	float fExtents[3];
+	float fMaxExtent = 0;
+	for ( int j = 0; j < 3; ++j ) {
+		fExtents[j] = m_bounds.Max[j] - m_bounds.Min[j];
+		fMaxExtent = std::max(fMaxExtent, fExtents[j]);
+	}
+
+	unsigned int nTarget = std::max( 1u, (m_nTriangles + m_nTargetTriangles - 1) / std::max(1u, m_nTargetTriangles) );
+	m_fCellSize = ( fMaxExtent > 0 ) ? fMaxExtent * 1.0001f : 1.0f;
+	while ( true ) {
+		unsigned long long nCells = 1;
+		unsigned int nNewCells[3];
+		float fNewSize = m_fCellSize * 0.95f;
+		for ( int j = 0; j < 3; ++j ) {
+			nNewCells[j] = std::max( 1u, (unsigned int)ceil( fExtents[j] * 1.0001f / fNewSize ) );
+			nCells *= nNewCells[j];
+		}
+		unsigned long long nCurCells = (unsigned long long)m_nCells[0] * m_nCells[1] * m_nCells[2];
+		if ( nCurCells >= nTarget || nCells > CellMask || fMaxExtent == 0 )
+			break;
+		m_fCellSize = fNewSize;
+		m_nCells[0] = nNewCells[0];  m_nCells[1] = nNewCells[1];  m_nCells[2] = nNewCells[2];
+	}
+}
+
+
+unsigned int OutOfCoreMesh::EncodeVertex( const Wml::Vector3f & vVertex ) const
+{
+	unsigned int nCell[3], nSides = 0;
+	for ( int j = 0; j < 3; ++j ) {
+		float f = (vVertex[j] - m_vOrigin[j]) / m_fCellSize;
+		int i = (int)floor(f);
+		i = std::max( 0, std::min( (int)m_nCells[j]-1, i ) );
+		float fFrac = f - (float)i;
+		unsigned int nSide = 0;
+		if ( fFrac < m_fMarginFraction && i > 0 )
+			nSide = 1;
+		else if ( fFrac > 1.0f - m_fMarginFraction && i < (int)m_nCells[j]-1 )
+			nSide = 2;
+		nCell[j] = (unsigned int)i;
+		nSides |= nSide << (2*j);
+	}
+	unsigned int nIndex = nCell[0] + m_nCells[0] * ( nCell[1] + m_nCells[1] * nCell[2] );
+	return nIndex | (nSides << CellBits);
+}
+
+
+void OutOfCoreMesh::GetVertexChunks( unsigned int nCode, unsigned int vChunks[8], int & nCount ) const
+{
+	unsigned int nIndex = nCode & CellMask;
+	unsigned int nCell[3] = { nIndex % m_nCells[0], (nIndex / m_nCells[0]) % m_nCells[1], nIndex / (m_nCells[0]*m_nCells[1]) };
+	int nOffset[3];
+	for ( int j = 0; j < 3; ++j ) {
+		unsigned int nSide = (nCode >> (CellBits + 2*j)) & 3;
+		nOffset[j] = (nSide == 1) ? -1 : ( (nSide == 2) ? 1 : 0 );
+	}
+
+	// owner cell, plus each neighbour cell whose margin contains the vertex
+	nCount = 0;
+	for ( int dz = 0; dz <= (nOffset[2] != 0 ? 1 : 0); ++dz ) {
+		for ( int dy = 0; dy <= (nOffset[1] != 0 ? 1 : 0); ++dy ) {
+			for ( int dx = 0; dx <= (nOffset[0] != 0 ? 1 : 0); ++dx ) {
+				unsigned int x = nCell[0] + dx*nOffset[0], y = nCell[1] + dy*nOffset[1], z = nCell[2] + dz*nOffset[2];
+				vChunks[nCount++] = x + m_nCells[0] * ( y + m_nCells[1] * z );
+			}
+		}
+	}
+}
+
+
+
+/*
+ * pass 1: vertices to temp file, bounding box
+ */
+namespace rms {
+class OOCVertexPass : public MeshStreamReader::Handler
+{
+public:
+	OOCVertexPass( OutOfCoreMesh * pMesh, FILE * pFile ) : m_pMesh(pMesh), m_pFile(pFile), m_nTriangles(0) {}
+	virtual void Vertex( unsigned int nIndex, const Wml::Vector3f & vVertex ) {
+		float vRecord[6] = { vVertex.X(), vVertex.Y(), vVertex.Z(), 0, 0, 1 };
+		fwrite( vRecord, sizeof(float), 6, m_pFile );
+		Wml::AxisAlignedBox3f & box = m_pMesh->m_bounds;
+		if ( nIndex == 0 )
+			box = Wml::AxisAlignedBox3f( vVertex.X(), vVertex.X(), vVertex.Y(), vVertex.Y(), vVertex.Z(), vVertex.Z() );
+		for ( int j = 0; j < 3; ++j ) {
+			if ( vVertex[j] < box.Min[j] )  box.Min[j] = vVertex[j];
+			if ( vVertex[j] > box.Max[j] )  box.Max[j] = vVertex[j];
+		}
+		m_pMesh->m_nVertices = nIndex+1;
+	}
+	virtual void Triangle( unsigned int nIndex, const unsigned int /*vTri*/[3] ) {
+		m_nTriangles = nIndex+1;
+	}
+	OutOfCoreMesh * m_pMesh;
+	FILE * m_pFile;
+	unsigned int m_nTriangles;
+};
+}
+
+bool OutOfCoreMesh::StreamVertices( const char * pInputFile )
+{
+	FILE * pFile = fopen( m_vertexFile.c_str(), "wb" );
+	if ( pFile == NULL ) {
+		m_errString = "cannot create temporary file " + m_vertexFile;
+		return false;
+	}
+	setvbuf( pFile, NULL, _IOFBF, 1<<20 );
+	OOCVertexPass pass(this, pFile);
+	bool bOK = MeshStreamReader::Read( pInputFile, pass, m_errString, true );
+	bOK = ( fclose(pFile) == 0 ) && bOK;
+	m_nTriangles = pass.m_nTriangles;
+	return bOK;
+}
+
+
+
+/*
+ * pass 2: assign triangles to chunk files
+ */
+namespace rms {
+class OOCTrianglePass : public MeshStreamReader::Handler
+{
+public:
+	OOCTrianglePass( OutOfCoreMesh * pMesh, unsigned int nCells )
+		: m_pMesh(pMesh), m_vBuffers(nCells), m_vCounts(nCells, 0), m_vOwnedCounts(nCells, 0), m_nBuffered(0), m_bOK(true) {}
+
+	virtual void Triangle( unsigned int /*nIndex*/, const unsigned int vTri[3] ) {
+		if ( vTri[0] >= m_pMesh->m_nVertices || vTri[1] >= m_pMesh->m_nVertices || vTri[2] >= m_pMesh->m_nVertices )
+			return;
+		unsigned int nMinVtx = std::min( vTri[0], std::min(vTri[1], vTri[2]) );
+		unsigned int nOwner = m_pMesh->m_vVertexCodes[nMinVtx] & CellMask;
+
+		unsigned int vChunks[24];
+		int nChunks = 0;
+		for ( int j = 0; j < 3; ++j ) {
+			int nCount = 0;
+			m_pMesh->GetVertexChunks( m_pMesh->m_vVertexCodes[vTri[j]], &vChunks[nChunks], nCount );
+			nChunks += nCount;
+		}
+		std::sort( vChunks, vChunks + nChunks );
+		nChunks = (int)( std::unique(vChunks, vChunks + nChunks) - vChunks );
+
+		for ( int k = 0; k < nChunks; ++k ) {
+			unsigned int nChunk = vChunks[k];
+			std::vector<unsigned int> & buffer = m_vBuffers[nChunk];
+			buffer.push_back(vTri[0]);  buffer.push_back(vTri[1]);  buffer.push_back(vTri[2]);
+			buffer.push_back( (nChunk == nOwner) ? 1 : 0 );
+			m_vCounts[nChunk]++;
+			if ( nChunk == nOwner )
+				m_vOwnedCounts[nChunk]++;
+		}
+		m_nBuffered += nChunks;
+		if ( m_nBuffered * TriangleRecordSize > BufferBytes )
+			Flush();
+	}
+
+	void Flush() {
+		for ( unsigned int k = 0; k < m_vBuffers.size(); ++k ) {
+			std::vector<unsigned int> & buffer = m_vBuffers[k];
+			if ( buffer.empty() )
+				continue;
+			FILE * pFile = fopen( m_pMesh->m_vChunkFiles[k].c_str(), "ab" );
+			if ( pFile == NULL || fwrite( &buffer[0], sizeof(unsigned int), buffer.size(), pFile ) != buffer.size() )
+				m_bOK = false;
+			if ( pFile != NULL && fclose(pFile) != 0 )
+				m_bOK = false;
+			buffer.clear();
+		}
+		m_nBuffered = 0;
+	}
+
+	enum { BufferBytes = 64 << 20 };
+	OutOfCoreMesh * m_pMesh;
+	std::vector< std::vector<unsigned int> > m_vBuffers;
+	std::vector<unsigned int> m_vCounts;
+	std::vector<unsigned int> m_vOwnedCounts;
+	size_t m_nBuffered;
+	bool m_bOK;
+};
+}
+
+bool OutOfCoreMesh::SplitTriangles( const char * pInputFile )
+{
+	// vertex codes, from the temporary vertex file
+	m_vVertexCodes.resize( m_nVertices );
+	FILE * pFile = fopen( m_vertexFile.c_str(), "rb" );
+	if ( pFile == NULL ) {
+		m_errString = "cannot open temporary file " + m_vertexFile;
+		return false;
+	}
+	std::vector<float> vBlock( 6 * 65536 );
+	for ( unsigned int nStart = 0; nStart < m_nVertices; nStart += 65536 ) {
+		unsigned int nCount = std::min( 65536u, m_nVertices - nStart );
+		if ( fread( &vBlock[0], VertexRecordSize, nCount, pFile ) != nCount ) {
+			fclose(pFile);
+			m_errString = "error reading temporary file " + m_vertexFile;
+			return false;
+		}
+		for ( unsigned int k = 0; k < nCount; ++k )
+			m_vVertexCodes[nStart+k] = EncodeVertex( Wml::Vector3f( &vBlock[6*k] ) );
+	}
+	fclose(pFile);
+
+	unsigned int nCells = m_nCells[0] * m_nCells[1] * m_nCells[2];
+	m_vChunkFiles.resize(nCells);
+	for ( unsigned int k = 0; k < nCells; ++k ) {
+		std::ostringstream name;
+		name << m_vertexFile << ".chunk" << k;
+		m_vChunkFiles[k] = name.str();
+	}
+
+	OOCTrianglePass pass(this, nCells);
+	if ( ! MeshStreamReader::Read( pInputFile, pass, m_errString, true ) )
+		return false;
+	pass.Flush();
+	if ( ! pass.m_bOK ) {
+		m_errString = "error writing chunk files";
+		return false;
+	}
+
+	// non-empty chunks
+	m_vChunkStats.resize(0);
+	for ( unsigned int k = 0; k < nCells; ++k ) {
+		if ( pass.m_vCounts[k] == 0 )
+			continue;
+		ChunkStats stats;
+		stats.nChunk = k;
+		stats.nTriangles = pass.m_vCounts[k];
+		stats.nOwnedTriangles = pass.m_vOwnedCounts[k];
+		stats.nVertices = stats.nOwnedVertices = stats.nLockedVertices = 0;
+		stats.nResultTriangles = stats.nOwnedTriangles;
+		stats.nEstimatedBytes = EstimateChunkBytes( stats.nTriangles/2 + 16, stats.nTriangles );
+		stats.fSeconds = 0;
+		m_vChunkStats.push_back(stats);
+	}
+	return true;
+}
+
+
+
+/*
+ * pass 3: process chunks
+ */
+
+bool OutOfCoreMesh::ProcessChunk( unsigned int nIndex, ChunkOperator & op, FILE * pVertexFile, FILE * pResultFile )
+{
+	double fStart = GetSeconds();
+	ChunkStats & stats = m_vChunkStats[nIndex];
+	unsigned int nChunk = stats.nChunk;
+
+	std::vector<unsigned int> vRecords( 4 * stats.nTriangles );
+	FILE * pFile = fopen( m_vChunkFiles[nChunk].c_str(), "rb" );
+	if ( pFile == NULL )
+		return false;
+	bool bOK = ( fread( &vRecords[0], TriangleRecordSize, stats.nTriangles, pFile ) == stats.nTriangles );
+	fclose(pFile);
+	if ( ! bOK )
+		return false;
+
+	// vertices used by chunk, in global order
+	std::vector<unsigned int> vVertices;
+	vVertices.reserve( 3 * stats.nTriangles );
+	for ( unsigned int k = 0; k < stats.nTriangles; ++k )
+		for ( int j = 0; j < 3; ++j )
+			vVertices.push_back( vRecords[4*k+j] );
+	std::sort( vVertices.begin(), vVertices.end() );
+	vVertices.erase( std::unique(vVertices.begin(), vVertices.end()), vVertices.end() );
+	unsigned int nVertices = (unsigned int)vVertices.size();
+
+	bool bTopology = op.ChangesConnectivity();
+	VFTriangleMesh mesh( bTopology ? (VFTriangleMesh::VertexNormals | VFTriangleMesh::VertexBits) : VFTriangleMesh::VertexNormals );
+	float vRecord[6];
+	unsigned long long nFilePos = (unsigned long long)-1;
+	for ( unsigned int k = 0; k < nVertices; ++k ) {
+		unsigned long long nOffset = (unsigned long long)vVertices[k] * VertexRecordSize;
+		if ( nOffset != nFilePos && ! SeekFile64(pVertexFile, nOffset) )
+			return false;
+		if ( fread( vRecord, sizeof(float), 6, pVertexFile ) != 6 )
+			return false;
+		nFilePos = nOffset + VertexRecordSize;
+		Wml::Vector3f vNormal( &vRecord[3] );
+		mesh.AppendVertex( Wml::Vector3f(vRecord), &vNormal );
+	}
+	std::vector<IMesh::TriangleID> vContextTris;		// triangles owned by other chunks, in increasing order
+	for ( unsigned int k = 0; k < stats.nTriangles; ++k ) {
+		IMesh::VertexID vTri[3];
+		for ( int j = 0; j < 3; ++j )
+			vTri[j] = (IMesh::VertexID)( std::lower_bound(vVertices.begin(), vVertices.end(), vRecords[4*k+j]) - vVertices.begin() );
+		IMesh::TriangleID tID = mesh.AppendTriangle( vTri[0], vTri[1], vTri[2] );
+		if ( vRecords[4*k+3] == 0 )
+			vContextTris.push_back(tID);
+	}
+	std::vector<unsigned int>().swap(vRecords);
+
+	stats.nVertices = nVertices;
+	stats.nEstimatedBytes = EstimateChunkBytes( stats.nVertices, stats.nTriangles );
+
+	// lock vertices of other chunks and vertices of context triangles. Unlocked vertices
+	// then only have triangles owned by this chunk, and no other chunk outputs them
+	std::vector<IMesh::VertexID> vLocked;
+	std::vector<Wml::Vector3f> vLockedPos;
+	std::vector<IMesh::VertexID> vContextVerts;
+	if ( bTopology ) {
+		for ( unsigned int k = 0; k < nVertices; ++k )
+			if ( (m_vVertexCodes[vVertices[k]] & CellMask) != nChunk )
+				mesh.SetBit( k, LockedVertexBit );
+		vContextVerts.resize( 3 * vContextTris.size() );
+		for ( unsigned int k = 0; k < vContextTris.size(); ++k ) {
+			mesh.GetTriangle( vContextTris[k], &vContextVerts[3*k] );
+			for ( int j = 0; j < 3; ++j )
+				mesh.SetBit( vContextVerts[3*k+j], LockedVertexBit );
+		}
+		for ( unsigned int k = 0; k < nVertices; ++k ) {
+			if ( mesh.GetBit( k, LockedVertexBit ) ) {
+				vLocked.push_back(k);
+				vLockedPos.push_back( mesh.GetVertex(k) );
+			}
+		}
+		stats.nLockedVertices = (unsigned int)vLocked.size();
+	}
+
+	op.Process( mesh, stats );
+
+	size_t nResidentBytes = GetResidentBytes();
+	#pragma omp critical(OutOfCoreMesh_Progress)
+	m_nMeasuredPeakBytes = std::max( m_nMeasuredPeakBytes, nResidentBytes );
+
+	if ( bTopology ) {
+		bool bValid = true;
+		for ( unsigned int k = 0; k < vLocked.size() && bValid; ++k )
+			bValid = mesh.IsVertex( vLocked[k] ) && mesh.GetVertex( vLocked[k] ) == vLockedPos[k];
+		for ( unsigned int k = 0; k < vContextTris.size() && bValid; ++k ) {
+			IMesh::VertexID vTri[3];
+			bValid = mesh.IsTriangle( vContextTris[k] );
+			if ( bValid )
+				mesh.GetTriangle( vContextTris[k], vTri );
+			for ( int j = 0; j < 3 && bValid; ++j )
+				bValid = ( vTri[j] == vContextVerts[3*k+j] );
+		}
+		if ( ! bValid ) {
+			std::ostringstream error;
+			error << "operator changed locked vertices or context triangles of chunk " << nChunk;
+			#pragma omp critical(OutOfCoreMesh_Progress)
+			m_errString = error.str();
+			return false;
+		}
+	}
+
+	// write back the vertices this chunk owns
+	unsigned int nOwned = 0;
+	#pragma omp critical(OutOfCoreMesh_Result)
+	{
+		Wml::Vector3f vVertex, vNormal;
+		for ( unsigned int k = 0; k < nVertices && bOK; ++k ) {
+			if ( (m_vVertexCodes[vVertices[k]] & CellMask) != nChunk || ! mesh.IsVertex(k) )
+				continue;
+			mesh.GetVertex( k, vVertex, &vNormal );
+			for ( int j = 0; j < 3; ++j ) {
+				vRecord[j] = vVertex[j];
+				vRecord[3+j] = vNormal[j];
+			}
+			bOK = SeekFile64( pResultFile, (unsigned long long)vVertices[k] * VertexRecordSize )
+				&& fwrite( vRecord, sizeof(float), 6, pResultFile ) == 6;
+			++nOwned;
+		}
+	}
+	stats.nOwnedVertices = nOwned;
+	if ( bOK && bTopology )
+		bOK = WriteChunkResult( stats, mesh, vVertices, vContextTris );
+	stats.fSeconds = GetSeconds() - fStart;
+	return bOK;
+}
+
+
+bool OutOfCoreMesh::WriteChunkResult( ChunkStats & stats, VFTriangleMesh & mesh, const std::vector<unsigned int> & vVertices,
+									  const std::vector<IMesh::TriangleID> & vContextTris )
+{
+	// vertices added by the operator. Removed IDs of loaded vertices that the mesh
+	// hands out again are unlocked, so their global slot belongs to this chunk
+	unsigned int nLoaded = (unsigned int)vVertices.size();
+	unsigned int nMaxID = mesh.GetMaxVertexID();
+	std::vector<unsigned int> vNewIDs( (nMaxID > nLoaded) ? nMaxID - nLoaded : 0, IMesh::InvalidID );
+	std::vector<float> vNewVertices;
+	Wml::Vector3f vVertex, vNormal;
+	for ( unsigned int vID = nLoaded; vID < nMaxID; ++vID ) {
+		if ( ! mesh.IsVertex(vID) )
+			continue;
+		vNewIDs[vID - nLoaded] = m_nVertices + (unsigned int)(vNewVertices.size() / 6);
+		mesh.GetVertex( vID, vVertex, &vNormal );
+		for ( int j = 0; j < 3; ++j )
+			vNewVertices.push_back( vVertex[j] );
+		for ( int j = 0; j < 3; ++j )
+			vNewVertices.push_back( vNormal[j] );
+	}
+
+	// owned triangles, in ID order
+	std::vector<unsigned int> vTriangles;
+	unsigned int nMaxTri = mesh.GetMaxTriangleID();
+	for ( IMesh::TriangleID tID = 0; tID < nMaxTri; ++tID ) {
+		if ( ! mesh.IsTriangle(tID) || std::binary_search( vContextTris.begin(), vContextTris.end(), tID ) )
+			continue;
+		IMesh::VertexID vTri[3];
+		mesh.GetTriangle( tID, vTri );
+		for ( int j = 0; j < 3; ++j )
+			vTriangles.push_back( (vTri[j] < nLoaded) ? vVertices[vTri[j]] : vNewIDs[vTri[j] - nLoaded] );
+	}
+
+	unsigned int nHeader[2] = { (unsigned int)(vNewVertices.size() / 6), (unsigned int)(vTriangles.size() / 3) };
+	stats.nResultTriangles = nHeader[1];
+	FILE * pFile = fopen( (m_vChunkFiles[stats.nChunk] + ".out").c_str(), "wb" );
+	if ( pFile == NULL )
+		return false;
+	bool bOK = ( fwrite( nHeader, sizeof(unsigned int), 2, pFile ) == 2 );
+	if ( bOK && ! vNewVertices.empty() )
+		bOK = ( fwrite( &vNewVertices[0], sizeof(float), vNewVertices.size(), pFile ) == vNewVertices.size() );
+	if ( bOK && ! vTriangles.empty() )
+		bOK = ( fwrite( &vTriangles[0], sizeof(unsigned int), vTriangles.size(), pFile ) == vTriangles.size() );
+	if ( fclose(pFile) != 0 )
+		bOK = false;
+	return bOK;
+}
+
+
+
+/*
+ * pass 4: output
+ */
+namespace rms {
+class OOCOutputPass : public MeshStreamReader::Handler
+{
+public:
+	OOCOutputPass( MeshStreamWriter * pWriter ) : m_pWriter(pWriter) {}
+	virtual void Triangle( unsigned int /*nIndex*/, const unsigned int vTri[3] ) {
+		m_pWriter->WriteTriangle(vTri);
+	}
+	MeshStreamWriter * m_pWriter;
+};
+}
+
+bool OutOfCoreMesh::WriteOutput( const char * pInputFile, const char * pOutputFile )
+{
+	MeshStreamWriter writer;
+	if ( ! writer.Open( pOutputFile, m_nVertices, m_nTriangles, m_bWriteNormals, m_errString ) )
+		return false;
+
+	FILE * pFile = fopen( m_resultFile.c_str(), "rb" );
+	if ( pFile == NULL ) {
+		m_errString = "cannot open temporary file " + m_resultFile;
+		return false;
+	}
+	std::vector<float> vBlock( 6 * 65536 );
+	for ( unsigned int nStart = 0; nStart < m_nVertices; nStart += 65536 ) {
+		unsigned int nCount = std::min( 65536u, m_nVertices - nStart );
+		if ( fread( &vBlock[0], VertexRecordSize, nCount, pFile ) != nCount ) {
+			fclose(pFile);
+			m_errString = "error reading temporary file " + m_resultFile;
+			return false;
+		}
+		for ( unsigned int k = 0; k < nCount; ++k ) {
+			Wml::Vector3f vNormal( &vBlock[6*k+3] );
+			writer.WriteVertex( Wml::Vector3f(&vBlock[6*k]), &vNormal );
+		}
+	}
+	fclose(pFile);
+
+	// connectivity is unchanged, so triangles come straight from the input
+	OOCOutputPass pass(&writer);
+	if ( ! MeshStreamReader::Read( pInputFile, pass, m_errString, true ) )
+		return false;
+	if ( ! writer.Close() ) {
+		m_errString = std::string("error writing ") + pOutputFile;
+		return false;
+	}
+	m_nResultVertices = m_nVertices;
+	m_nResultTriangles = m_nTriangles;
+	return true;
+}
+
+
+// opens a chunk result file and reads the header (new vertex count, triangle count)
+static FILE * OpenChunkResult( const std::string & filename, unsigned int nHeader[2] )
+{
+	FILE * pFile = fopen( filename.c_str(), "rb" );
+	if ( pFile != NULL && fread( nHeader, sizeof(unsigned int), 2, pFile ) != 2 ) {
+		fclose(pFile);
+		pFile = NULL;
+	}
+	return pFile;
+}
+
+bool OutOfCoreMesh::WriteRemeshedOutput( const char * pOutputFile )
+{
+	unsigned int nChunks = (unsigned int)m_vChunkStats.size();
+	std::vector<unsigned int> vBlock( 3 * 65536 );
+	unsigned int nHeader[2];
+
+	// used input vertices. The vertex codes aren't needed any more, so they are reused for the output IDs
+	std::vector<unsigned int> & vOutputIDs = m_vVertexCodes;
+	std::fill( vOutputIDs.begin(), vOutputIDs.end(), (unsigned int)IMesh::InvalidID );
+	std::vector<unsigned int> vNewStart( nChunks );
+	unsigned int nNewVertices = 0, nTriangles = 0;
+	for ( unsigned int k = 0; k < nChunks; ++k ) {
+		std::string filename = m_vChunkFiles[ m_vChunkStats[k].nChunk ] + ".out";
+		FILE * pFile = OpenChunkResult( filename, nHeader );
+		bool bOK = ( pFile != NULL ) && SeekFile64( pFile, 2 * sizeof(unsigned int) + (unsigned long long)nHeader[0] * VertexRecordSize );
+		for ( unsigned int nStart = 0; nStart < nHeader[1] && bOK; nStart += 65536 ) {
+			unsigned int nCount = std::min( 65536u, nHeader[1] - nStart );
+			bOK = ( fread( &vBlock[0], ResultTriangleSize, nCount, pFile ) == nCount );
+			for ( unsigned int i = 0; i < 3*nCount && bOK; ++i )
+				if ( vBlock[i] < m_nVertices )
+					vOutputIDs[ vBlock[i] ] = 0;
+		}
+		if ( pFile != NULL )
+			fclose(pFile);
+		if ( ! bOK ) {
+			m_errString = "error reading temporary file " + filename;
+			return false;
+		}
+		vNewStart[k] = nNewVertices;
+		nNewVertices += nHeader[0];
+		nTriangles += nHeader[1];
+	}
+	unsigned int nUsed = 0;
+	for ( unsigned int i = 0; i < m_nVertices; ++i )
+		if ( vOutputIDs[i] != (unsigned int)IMesh::InvalidID )
+			vOutputIDs[i] = nUsed++;
+
+	m_nResultVertices = nUsed + nNewVertices;
+	m_nResultTriangles = nTriangles;
+	MeshStreamWriter writer;
+	if ( ! writer.Open( pOutputFile, m_nResultVertices, m_nResultTriangles, m_bWriteNormals, m_errString ) )
+		return false;
+
+	// used input vertices, in input order
+	FILE * pFile = fopen( m_resultFile.c_str(), "rb" );
+	if ( pFile == NULL ) {
+		m_errString = "cannot open temporary file " + m_resultFile;
+		return false;
+	}
+	std::vector<float> vVertexBlock( 6 * 65536 );
+	for ( unsigned int nStart = 0; nStart < m_nVertices; nStart += 65536 ) {
+		unsigned int nCount = std::min( 65536u, m_nVertices - nStart );
+		if ( fread( &vVertexBlock[0], VertexRecordSize, nCount, pFile ) != nCount ) {
+			fclose(pFile);
+			m_errString = "error reading temporary file " + m_resultFile;
+			return false;
+		}
+		for ( unsigned int k = 0; k < nCount; ++k ) {
+			if ( vOutputIDs[nStart+k] == (unsigned int)IMesh::InvalidID )
+				continue;
+			Wml::Vector3f vNormal( &vVertexBlock[6*k+3] );
+			writer.WriteVertex( Wml::Vector3f(&vVertexBlock[6*k]), &vNormal );
+		}
+	}
+	fclose(pFile);
+
+	// vertices added by the chunks, then the triangles, both in chunk order
+	for ( int nPass = 0; nPass < 2; ++nPass ) {
+		for ( unsigned int k = 0; k < nChunks; ++k ) {
+			std::string filename = m_vChunkFiles[ m_vChunkStats[k].nChunk ] + ".out";
+			pFile = OpenChunkResult( filename, nHeader );
+			bool bOK = ( pFile != NULL );
+			if ( nPass == 0 ) {
+				for ( unsigned int nStart = 0; nStart < nHeader[0] && bOK; nStart += 65536 ) {
+					unsigned int nCount = std::min( 65536u, nHeader[0] - nStart );
+					bOK = ( fread( &vVertexBlock[0], VertexRecordSize, nCount, pFile ) == nCount );
+					for ( unsigned int i = 0; i < nCount && bOK; ++i ) {
+						Wml::Vector3f vNormal( &vVertexBlock[6*i+3] );
+						writer.WriteVertex( Wml::Vector3f(&vVertexBlock[6*i]), &vNormal );
+					}
+				}
+			} else {
+				bOK = bOK && SeekFile64( pFile, 2 * sizeof(unsigned int) + (unsigned long long)nHeader[0] * VertexRecordSize );
+				unsigned int nNewOffset = nUsed + vNewStart[k] - m_nVertices;
+				for ( unsigned int nStart = 0; nStart < nHeader[1] && bOK; nStart += 65536 ) {
+					unsigned int nCount = std::min( 65536u, nHeader[1] - nStart );
+					bOK = ( fread( &vBlock[0], ResultTriangleSize, nCount, pFile ) == nCount );
+					for ( unsigned int i = 0; i < nCount && bOK; ++i ) {
+						unsigned int vTri[3];
+						for ( int j = 0; j < 3; ++j ) {
+							unsigned int vID = vBlock[3*i+j];
+							vTri[j] = ( vID < m_nVertices ) ? vOutputIDs[vID] : vID + nNewOffset;
+						}
+						writer.WriteTriangle(vTri);
+					}
+				}
+			}
+			if ( pFile != NULL )
+				fclose(pFile);
+			if ( ! bOK ) {
+				m_errString = "error reading temporary file " + filename;
+				return false;
+			}
+		}
+	}
+
+	if ( ! writer.Close() ) {
+		m_errString = std::string("error writing ") + pOutputFile;
+		return false;
+	}
+	return true;
+}
+
+
+
+bool OutOfCoreMesh::Process( const char * pInputFile, const char * pOutputFile, ChunkOperator & op, ProgressCallback * pProgress )
+{
+	RemoveTempFiles();
+	m_errString.clear();
+	m_nVertices = m_nTriangles = 0;
+	m_nCells[0] = m_nCells[1] = m_nCells[2] = 1;
+	m_vChunkStats.clear();
+	m_nPeakBytes = m_nMeasuredPeakBytes = 0;
+	m_nResultVertices = m_nResultTriangles = 0;
+
+	std::ostringstream prefix;
+	prefix << m_tempDir << "/ooc_" << (void *)this;
+	m_vertexFile = prefix.str() + ".vtx";
+	m_resultFile = prefix.str() + ".out";
+
+	if ( ! StreamVertices(pInputFile) )
+		return false;
+	ChooseGrid();
+	if ( ! SplitTriangles(pInputFile) )
+		return false;
+	size_t nResidentBytes = m_vVertexCodes.size() * sizeof(unsigned int);
+
+	// result file starts as a copy of the input vertices, so unused vertices pass through
+	{
+		FILE * pIn = fopen( m_vertexFile.c_str(), "rb" ), * pOut = fopen( m_resultFile.c_str(), "wb" );
+		bool bOK = ( pIn != NULL && pOut != NULL );
+		std::vector<char> vBlock( 1 << 20 );
+		size_t nRead = 0;
+		while ( bOK && (nRead = fread( &vBlock[0], 1, vBlock.size(), pIn )) > 0 )
+			bOK = ( fwrite( &vBlock[0], 1, nRead, pOut ) == nRead );
+		if ( pIn ) fclose(pIn);
+		if ( pOut && fclose(pOut) != 0 ) bOK = false;
+		if ( ! bOK ) {
+			m_errString = "error writing temporary file " + m_resultFile;
+			return false;
+		}
+	}
+
+	FILE * pResultFile = fopen( m_resultFile.c_str(), "r+b" );
+	if ( pResultFile == NULL ) {
+		m_errString = "cannot open temporary file " + m_resultFile;
+		return false;
+	}
+
+	// process batches of chunks that fit in the memory budget
+	unsigned int nChunks = (unsigned int)m_vChunkStats.size();
+	unsigned int nDone = 0;
+	bool bOK = true;
+	unsigned int nBatchStart = 0;
+	while ( nBatchStart < nChunks && bOK ) {
+		unsigned int nBatchEnd = nBatchStart;
+		size_t nBatchBytes = 0;
+		while ( nBatchEnd < nChunks &&
+				( nBatchEnd == nBatchStart || nBatchBytes + m_vChunkStats[nBatchEnd].nEstimatedBytes <= m_nMemoryBudget ) ) {
+			nBatchBytes += m_vChunkStats[nBatchEnd].nEstimatedBytes;
+			++nBatchEnd;
+		}
+		size_t nCurrentBytes = 0;
+
+		int nBatchSize = (int)(nBatchEnd - nBatchStart);
+		#pragma omp parallel for schedule(dynamic,1)
+		for ( int k = 0; k < nBatchSize; ++k ) {
+			unsigned int nIndex = nBatchStart + k;
+			size_t nEstimate = m_vChunkStats[nIndex].nEstimatedBytes;
+			#pragma omp critical(OutOfCoreMesh_Progress)
+			{
+				nCurrentBytes += nEstimate;
+				m_nPeakBytes = std::max( m_nPeakBytes, nResidentBytes + nCurrentBytes );
+			}
+
+			FILE * pVertexFile = fopen( m_vertexFile.c_str(), "rb" );
+			bool bChunkOK = ( pVertexFile != NULL ) && ProcessChunk( nIndex, op, pVertexFile, pResultFile );
+			if ( pVertexFile != NULL )
+				fclose(pVertexFile);
+
+			#pragma omp critical(OutOfCoreMesh_Progress)
+			{
+				nCurrentBytes -= nEstimate;
+				// estimate is replaced with the size of the loaded chunk
+				m_nPeakBytes = std::max( m_nPeakBytes, nResidentBytes + nCurrentBytes + m_vChunkStats[nIndex].nEstimatedBytes );
+				if ( ! bChunkOK )
+					bOK = false;
+				++nDone;
+				if ( pProgress )
+					pProgress->ChunkDone( m_vChunkStats[nIndex], nDone, nChunks, GetResidentBytes() );
+			}
+		}
+		nBatchStart = nBatchEnd;
+	}
+
+	if ( fclose(pResultFile) != 0 )
+		bOK = false;
+	if ( ! bOK ) {
+		if ( m_errString.empty() )
+			m_errString = "error processing chunks";
+		return false;
+	}
+
+	bOK = op.ChangesConnectivity() ? WriteRemeshedOutput( pOutputFile ) : WriteOutput( pInputFile, pOutputFile );
+	std::vector<unsigned int>().swap(m_vVertexCodes);
+	RemoveTempFiles();
+	return bOK;
+}
+
+
+void OutOfCoreMesh::RemoveTempFiles()
+{
+	for ( unsigned int k = 0; k < m_vChunkFiles.size(); ++k ) {
+		remove( m_vChunkFiles[k].c_str() );
+		remove( (m_vChunkFiles[k] + ".out").c_str() );
+	}
+	m_vChunkFiles.clear();
+	if ( ! m_vertexFile.empty() )
+		remove( m_vertexFile.c_str() );
+	if ( ! m_resultFile.empty() )
+		remove( m_resultFile.c_str() );
+}
+
+
+
+
+void OutOfCoreMesh::SmoothOperator::Process( VFTriangleMesh & mesh, const ChunkStats & /*chunk*/ )
+{
+	MeshSmoother smoother;
+	smoother.SetSurface(&mesh);
+	if ( m_fKpb == 0 )
+		smoother.DoLaplacianSmooth( m_nPasses, m_fLambda );
+	else
+		smoother.DoTaubinSmooth( m_nPasses, m_fKpb, m_fLambda );
+}
+
+void OutOfCoreMesh::NormalsOperator::Process( VFTriangleMesh & mesh, const ChunkStats & /*chunk*/ )
+{
+	MeshUtils::EstimateNormals( mesh );
+}
+
+
+
+// edge in the decimation queue. The endpoints and length detect entries that are out of date
+struct OOCDecimateEdge {
+	float fLength;
+	IMesh::EdgeID eID;
+	IMesh::VertexID nVertices[2];
+	// shortest first, ties by ID so the order doesn't depend on the queue implementation
+	bool operator<( const OOCDecimateEdge & e2 ) const
+		{ return fLength > e2.fLength || ( fLength == e2.fLength && eID > e2.eID ); }
+};
+
+static void PushDecimateEdge( VFTriangleMesh & mesh, IMesh::EdgeID eID, std::priority_queue<OOCDecimateEdge> & queue )
+{
+	OOCDecimateEdge e;
+	IMesh::TriangleID nTris[2];
+	mesh.GetEdge( eID, e.nVertices, nTris );
+	if ( mesh.GetBit( e.nVertices[0], OutOfCoreMesh::LockedVertexBit ) || mesh.GetBit( e.nVertices[1], OutOfCoreMesh::LockedVertexBit ) )
+		return;
+	if ( nTris[0] == IMesh::InvalidID || nTris[1] == IMesh::InvalidID )
+		return;
+	e.eID = eID;
+	e.fLength = ( mesh.GetVertex(e.nVertices[0]) - mesh.GetVertex(e.nVertices[1]) ).Length();
+	queue.push(e);
+}
+
+// true if moving the endpoints of the edge to vNewPos flips one of the remaining triangles
+static bool CollapseFlipsTriangle( VFTriangleMesh & mesh, const IMesh::VertexID nVertices[2], const Wml::Vector3f & vNewPos )
+{
+	for ( int i = 0; i < 2; ++i ) {
+		IMesh::VtxNbrItr itr(nVertices[i]);
+		mesh.BeginVtxTriangles(itr);
+		IMesh::TriangleID tID = mesh.GetNextVtxTriangle(itr);
+		while ( tID != IMesh::InvalidID ) {
+			IMesh::VertexID vTri[3];
+			mesh.GetTriangle( tID, vTri );
+			int nOnEdge = 0;
+			Wml::Vector3f vBefore[3], vAfter[3];
+			for ( int j = 0; j < 3; ++j ) {
+				vBefore[j] = vAfter[j] = mesh.GetVertex( vTri[j] );
+				if ( vTri[j] == nVertices[0] || vTri[j] == nVertices[1] ) {
+					vAfter[j] = vNewPos;
+					++nOnEdge;
+				}
+			}
+			if ( nOnEdge == 1 ) {
+				Wml::Vector3f vNormalBefore = (vBefore[1] - vBefore[0]).Cross( vBefore[2] - vBefore[0] );
+				Wml::Vector3f vNormalAfter = (vAfter[1] - vAfter[0]).Cross( vAfter[2] - vAfter[0] );
+				if ( vNormalBefore.Dot(vNormalAfter) <= 0 )
+					return true;
+			}
+			tID = mesh.GetNextVtxTriangle(itr);
+		}
+	}
+	return false;
+}
+
+void OutOfCoreMesh::DecimateOperator::Process( VFTriangleMesh & mesh, const ChunkStats & chunk )
+{
+	unsigned int nRemove = (unsigned int)( (1.0f - m_fTriangleFraction) * (float)chunk.nOwnedTriangles );
+	unsigned int nStartCount = mesh.GetTriangleCount();
+
+	std::priority_queue<OOCDecimateEdge> queue;
+	VFTriangleMesh::edge_iterator cure(mesh.BeginEdges()), ende(mesh.EndEdges());
+	while ( cure != ende )
+		PushDecimateEdge( mesh, *cure++, queue );
+
+	while ( ! queue.empty() && nStartCount - mesh.GetTriangleCount() < nRemove ) {
+		OOCDecimateEdge e = queue.top();
+		queue.pop();
+		if ( ! mesh.IsEdge(e.eID) )
+			continue;
+		IMesh::VertexID nVertices[2];  IMesh::TriangleID nTris[2];
+		mesh.GetEdge( e.eID, nVertices, nTris );
+		if ( nVertices[0] != e.nVertices[0] || nVertices[1] != e.nVertices[1] )
+			continue;
+		const Wml::Vector3f & v0 = mesh.GetVertex(nVertices[0]), & v1 = mesh.GetVertex(nVertices[1]);
+		if ( (v0 - v1).Length() != e.fLength )
+			continue;
+
+		// new position as in VFTriangleMesh::CollapseEdge()
+		bool bBoundary0 = mesh.IsBoundaryVertex(nVertices[0]), bBoundary1 = mesh.IsBoundaryVertex(nVertices[1]);
+		if ( bBoundary0 && bBoundary1 )
+			continue;
+		Wml::Vector3f vNewPos = bBoundary0 ? v0 : ( bBoundary1 ? v1 : 0.5f * (v0 + v1) );
+		if ( CollapseFlipsTriangle( mesh, nVertices, vNewPos ) )
+			continue;
+		if ( ! mesh.CollapseEdge( e.eID ) )
+			continue;
+
+		IMesh::VertexID vKeep = mesh.IsVertex(nVertices[0]) ? nVertices[0] : nVertices[1];
+		IMesh::VtxNbrItr itr(vKeep);
+		mesh.BeginVtxEdges(itr);
+		IMesh::EdgeID eID = mesh.GetNextVtxEdges(itr);
+		while ( eID != IMesh::InvalidID ) {
+			PushDecimateEdge( mesh, eID, queue );
+			eID = mesh.GetNextVtxEdges(itr);
+		}
+	}
+}
+
+void OutOfCoreMesh::CleanupOperator::Process( VFTriangleMesh & mesh, const ChunkStats & /*chunk*/ )
+{
+	MeshSelection selection(&mesh);
+	VFTriangleMesh::vertex_iterator curv(mesh.BeginVertices()), endv(mesh.EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv++;
+		if ( ! mesh.GetBit( vID, LockedVertexBit ) )
+			selection.SelectVertex(vID);
+	}
+	while ( MeshUtils::MergeVertices( mesh, m_fMinEdgeLength, NULL, &selection ) )
+		;
+}
@@ -0,0 +1,207 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_OUT_OF_CORE_MESH_H__
+#define __RMS_OUT_OF_CORE_MESH_H__
+
+#include "config.h"
+#include <VFTriangleMesh.h>
+#include <Wm4AxisAlignedBox3.h>
+#include <vector>
+#include <string>
+#include <cstdio>
+
+namespace rms {
+
+/*
+ * Out-of-core processing of meshes that are too large for a VFTriangleMesh.
+ *
+ * The input (OBJ or PLY, see MeshStreamReader) is streamed twice to split it into a grid of
+ * spatial chunks. Each vertex is owned by the grid cell it lies in, and each triangle by the cell
+ * of its lowest-index vertex. A chunk is loaded as a VFTriangleMesh containing its owned triangles
+ * plus the triangles touching vertices within the overlap margin of the cell, so that operators see
+ * some context past the cell boundary. Chunks are processed in parallel (OpenMP), in batches whose
+ * estimated size fits in the memory budget.
+ *
+ * Operators that keep connectivity (smoothing, normals) may change any vertex. On output, every
+ * vertex is taken from the chunk that owns it, and the triangles are re-streamed from the input.
+ *
+ * Operators that change connectivity (decimation, cleanup) run under locks instead. A vertex is
+ * locked (vertex bit LockedVertexBit) unless it is owned by the chunk and all its triangles are
+ * owned by the chunk, so the locked vertices are the seams with other chunks plus the context in
+ * the overlap margin. Operators must not move or remove locked vertices, and must not change
+ * triangles that only have locked vertices (in practice: only collapse edges between unlocked
+ * vertices). Locked vertices and context triangles are checked after each chunk. Each chunk then writes its owned triangles,
+ * and the seams are welded by global vertex ID: the output has the used input vertices in input order,
+ * then the vertices added by the chunks, and the triangles in chunk order. So the result does not depend
+ * on thread scheduling either. Seams stay at input resolution; a second pass with a different
+ * SetTargetTrianglesPerChunk() (and so a different grid) simplifies them.
+ *
+ * Resident memory outside of the chunks is 4 bytes per input vertex. Vertex data is kept in
+ * temporary files (24 bytes per vertex) and per-chunk triangle lists (16 bytes per triangle per chunk).
+ * Batching uses an estimate of the chunk size (EstimateChunkBytes()), the reported memory is measured.
+ */
+class OutOfCoreMesh
+{
+public:
+	OutOfCoreMesh();
+	~OutOfCoreMesh();
+
+	struct ChunkStats {
+		unsigned int nChunk;
+		unsigned int nVertices;				//! in the loaded chunk, including margin
+		unsigned int nTriangles;
+		unsigned int nOwnedVertices;
+		unsigned int nOwnedTriangles;
+		unsigned int nLockedVertices;		//! only for operators that change connectivity
+		unsigned int nResultTriangles;		//! owned triangles after processing
+		size_t nEstimatedBytes;
+		double fSeconds;
+	};
+
+	//! vertex bit of locked vertices, see class comment (first bit available to callers of VFTriangleMesh::SetBit())
+	enum { LockedVertexBit = 16 };
+
+	//! operator applied to each chunk. Called in parallel on different chunks
+	class ChunkOperator {
+	public:
+		virtual ~ChunkOperator() {}
+		virtual void Process( VFTriangleMesh & mesh, const ChunkStats & chunk ) = 0;
+		//! true if Process() removes or adds vertices or triangles. Then locked vertices are marked
+		virtual bool ChangesConnectivity() const { return false; }
+	};
+
+	//! called (serialized) after each chunk is done. nCurrentBytes is the measured resident memory of the process
+	class ProgressCallback {
+	public:
+		virtual ~ProgressCallback() {}
+		virtual void ChunkDone( const ChunkStats & stats, unsigned int nDone, unsigned int nTotal, size_t nCurrentBytes ) = 0;
+	};
+
+	//! directory for temporary files (default is the current directory)
+	void SetTempDirectory( const char * pPath ) { m_tempDir = pPath; }
+
+	//! grid cell size is chosen so that chunks have about this many triangles (on average)
+	void SetTargetTrianglesPerChunk( unsigned int nCount ) { m_nTargetTriangles = nCount; }
+	//! overlap margin as a fraction of the cell size (must be < 0.5)
+	void SetOverlapMargin( float fFraction ) { m_fMarginFraction = fFraction; }
+	//! estimated memory of chunks that are loaded at the same time
+	void SetMemoryBudget( size_t nBytes ) { m_nMemoryBudget = nBytes; }
+	//! write vertex normals from the processed chunks
+	void SetWriteNormals( bool bEnable ) { m_bWriteNormals = bEnable; }
+
+	bool Process( const char * pInputFile, const char * pOutputFile, ChunkOperator & op, ProgressCallback * pProgress = NULL );
+
+	const std::string & GetLastError() const { return m_errString; }
+
+	unsigned int GetVertexCount() const { return m_nVertices; }
+	unsigned int GetTriangleCount() const { return m_nTriangles; }
+	const Wml::AxisAlignedBox3f & GetBounds() const { return m_bounds; }
+	unsigned int GetChunkCount() const { return (unsigned int)m_vChunkStats.size(); }
+	const std::vector<ChunkStats> & GetChunkStats() const { return m_vChunkStats; }
+	//! peak of resident tables plus the estimated size of concurrently loaded chunks
+	size_t GetPeakMemoryEstimate() const { return m_nPeakBytes; }
+	//! highest measured resident memory of the process during the last Process(), sampled after each
+	//! operator call while the chunk is loaded (0 if the platform doesn't report it)
+	size_t GetPeakMemory() const { return m_nMeasuredPeakBytes; }
+	unsigned int GetResultVertexCount() const { return m_nResultVertices; }
+	unsigned int GetResultTriangleCount() const { return m_nResultTriangles; }
+
+	//! estimated VFTriangleMesh memory for a chunk (with normals)
+	static size_t EstimateChunkBytes( unsigned int nVertices, unsigned int nTriangles );
+
+
+	/*
+	 * operators built on the in-core tools
+	 */
+	//! MeshSmoother::DoTaubinSmooth() (or DoLaplacianSmooth() if fKpb == 0)
+	class SmoothOperator : public ChunkOperator {
+	public:
+		SmoothOperator( int nPasses, float fLambda = 0.6307f, float fKpb = 0.1f )
+			: m_nPasses(nPasses), m_fLambda(fLambda), m_fKpb(fKpb) {}
+		virtual void Process( VFTriangleMesh & mesh, const ChunkStats & chunk );
+	protected:
+		int m_nPasses;
+		float m_fLambda, m_fKpb;
+	};
+
+	//! MeshUtils::EstimateNormals()
+	class NormalsOperator : public ChunkOperator {
+	public:
+		virtual void Process( VFTriangleMesh & mesh, const ChunkStats & chunk );
+	};
+
+	//! shortest-edge-first VFTriangleMesh::CollapseEdge() until fTriangleFraction of the owned triangles are left,
+	//! or no edge between unlocked vertices can be collapsed. Collapses that flip a triangle are skipped
+	class DecimateOperator : public ChunkOperator {
+	public:
+		DecimateOperator( float fTriangleFraction ) : m_fTriangleFraction(fTriangleFraction) {}
+		virtual void Process( VFTriangleMesh & mesh, const ChunkStats & chunk );
+		virtual bool ChangesConnectivity() const { return true; }
+	protected:
+		float m_fTriangleFraction;
+	};
+
+	//! MeshUtils::MergeVertices() on the unlocked vertices (collapses edges shorter than fMinEdgeLength), repeated until nothing changes
+	class CleanupOperator : public ChunkOperator {
+	public:
+		CleanupOperator( float fMinEdgeLength ) : m_fMinEdgeLength(fMinEdgeLength) {}
+		virtual void Process( VFTriangleMesh & mesh, const ChunkStats & chunk );
+		virtual bool ChangesConnectivity() const { return true; }
+	protected:
+		float m_fMinEdgeLength;
+	};
+
+
+protected:
+	std::string m_tempDir;
+	unsigned int m_nTargetTriangles;
+	float m_fMarginFraction;
+	size_t m_nMemoryBudget;
+	bool m_bWriteNormals;
+
+	std::string m_errString;
+	unsigned int m_nVertices;
+	unsigned int m_nTriangles;
+	Wml::AxisAlignedBox3f m_bounds;
+
+	// grid
+	Wml::Vector3f m_vOrigin;
+	float m_fCellSize;
+	unsigned int m_nCells[3];
+
+	// per vertex: cell index in low 26 bits, then 2 bits per axis for the margin side (0 none, 1 low, 2 high)
+	std::vector<unsigned int> m_vVertexCodes;
+
+	std::vector<ChunkStats> m_vChunkStats;
+	size_t m_nPeakBytes;
+	size_t m_nMeasuredPeakBytes;
+	unsigned int m_nResultVertices;
+	unsigned int m_nResultTriangles;
+
+	std::string m_vertexFile;
+	std::string m_resultFile;
+	std::vector<std::string> m_vChunkFiles;
+
+	void ChooseGrid();
+	unsigned int EncodeVertex( const Wml::Vector3f & vVertex ) const;
+	void GetVertexChunks( unsigned int nCode, unsigned int vChunks[8], int & nCount ) const;
+
+	bool StreamVertices( const char * pInputFile );
+	bool SplitTriangles( const char * pInputFile );
+	bool ProcessChunk( unsigned int nChunk, ChunkOperator & op, FILE * pVertexFile, FILE * pResultFile );
+	bool WriteChunkResult( ChunkStats & stats, VFTriangleMesh & mesh, const std::vector<unsigned int> & vVertices,
+						   const std::vector<IMesh::TriangleID> & vContextTris );
+	bool WriteOutput( const char * pInputFile, const char * pOutputFile );
+	bool WriteRemeshedOutput( const char * pOutputFile );
+	void RemoveTempFiles();
+
+	friend class OOCVertexPass;
+	friend class OOCTrianglePass;
+	friend class OOCOutputPass;
+};
+
+
+} // end namespace rms
+
+#endif  // __RMS_OUT_OF_CORE_MESH_H__
@@ -0,0 +1,510 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "QuickHull3.h"
+#include "ExactPredicates.h"
+#include <algorithm>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace rms;
+
+
+QuickHull3::QuickHull3()
+{
+	m_nParallelThreshold = 16384;
+	m_nDimension = 0;
+	m_nMark = 0;
+}
+
+
+bool QuickHull3::Compute( const std::vector<Wml::Vector3f> & vPoints )
+{
+	return Compute( (vPoints.empty()) ? NULL : &vPoints[0], (unsigned int)vPoints.size() );
+}
+
+bool QuickHull3::Compute( const Wml::Vector3f * pPoints, unsigned int nCount )
+{
+	m_vPoints.resize(nCount);
+	for ( unsigned int i = 0; i < nCount; ++i )
+		m_vPoints[i] = Wml::Vector3d( pPoints[i].X(), pPoints[i].Y(), pPoints[i].Z() );
+
+	bool bOK = Run();
+
+	m_vHullVertices = m_vTriangles;
+	std::sort( m_vHullVertices.begin(), m_vHullVertices.end() );
+	m_vHullVertices.erase( std::unique( m_vHullVertices.begin(), m_vHullVertices.end() ), m_vHullVertices.end() );
+	m_vHullPositions.resize( m_vHullVertices.size() );
+	for ( size_t k = 0; k < m_vHullVertices.size(); ++k )
+		m_vHullPositions[k] = pPoints[ m_vHullVertices[k] ];
+
+	// release working memory
+	m_vFaces.clear();
+	m_vFreeFaces.clear();
+	m_vPoints.clear();
+	return bOK;
+}
+
+
+
+bool QuickHull3::Run()
+{
+	m_vTriangles.resize(0);
+	m_vFaces.resize(0);
+	m_vFreeFaces.resize(0);
+	m_nDimension = 0;
+	if ( m_vPoints.empty() )
+		return false;
+
+	std::vector<unsigned int> vCandidates;
+	CullInterior( vCandidates );
+
+	unsigned int nSimplex[4];
+	if ( ! InitialSimplex( vCandidates, nSimplex ) )
+		return false;
+	m_nDimension = 3;
+	m_vFaces.reserve( std::min( 2 * vCandidates.size() + 4, (size_t)65536 ) );
+
+	// orient the tetrahedron so that each face has the opposite vertex on its inside (Orient3D > 0)
+	const unsigned int nTetFaces[4][4] = { {0,1,2,3}, {0,3,1,2}, {1,3,2,0}, {2,3,0,1} };
+	std::vector<unsigned int> vInitFaces(4);
+	for ( int k = 0; k < 4; ++k ) {
+		unsigned int a = nSimplex[nTetFaces[k][0]], b = nSimplex[nTetFaces[k][1]], c = nSimplex[nTetFaces[k][2]];
+		unsigned int d = nSimplex[nTetFaces[k][3]];
+		if ( Orient3D( m_vPoints[a], m_vPoints[b], m_vPoints[c], m_vPoints[d] ) < 0 )
+			std::swap(b,c);
+		vInitFaces[k] = NewFace(a,b,c);
+	}
+	// adjacency by matching opposite half-edges
+	for ( int k = 0; k < 4; ++k ) {
+		Face & f = m_vFaces[vInitFaces[k]];
+		for ( int i = 0; i < 3; ++i ) {
+			unsigned int a = f.nV[i], b = f.nV[(i+1)%3];
+			for ( int j = 0; j < 4; ++j ) {
+				const Face & g = m_vFaces[vInitFaces[j]];
+				for ( int e = 0; e < 3; ++e )
+					if ( g.nV[e] == b && g.nV[(e+1)%3] == a )
+						f.nNbr[i] = vInitFaces[j];
+			}
+		}
+	}
+
+	// initial conflict lists
+	std::vector<unsigned int> vPoints;
+	vPoints.reserve( vCandidates.size() );
+	for ( size_t i = 0; i < vCandidates.size(); ++i ) {
+		unsigned int p = vCandidates[i];
+		if ( p != nSimplex[0] && p != nSimplex[1] && p != nSimplex[2] && p != nSimplex[3] )
+			vPoints.push_back(p);
+	}
+	AssignConflicts( vPoints, vInitFaces );
+
+	std::vector<unsigned int> vStack( vInitFaces ), vNewFaces;
+	while ( ! vStack.empty() ) {
+		unsigned int nFace = vStack.back();
+		vStack.pop_back();
+		if ( m_vFaces[nFace].bDeleted || m_vFaces[nFace].vConflict.empty() )
+			continue;
+		if ( ! AddPoint(nFace, vNewFaces) ) {
+			lgBreakToDebugger();
+			m_nDimension = 0;
+			return false;
+		}
+		for ( size_t k = 0; k < vNewFaces.size(); ++k )
+			if ( ! m_vFaces[vNewFaces[k]].vConflict.empty() )
+				vStack.push_back( vNewFaces[k] );
+	}
+
+	for ( size_t k = 0; k < m_vFaces.size(); ++k ) {
+		const Face & f = m_vFaces[k];
+		if ( f.bDeleted )
+			continue;
+		m_vTriangles.push_back(f.nV[0]);  m_vTriangles.push_back(f.nV[1]);  m_vTriangles.push_back(f.nV[2]);
+	}
+	return true;
+}
+
+
+
+void QuickHull3::CullInterior( std::vector<unsigned int> & vCandidates )
+{
+	int nCount = (int)m_vPoints.size();
+
+	// axis-extreme points. [2k] = min along axis k, [2k+1] = max
+	unsigned int nExtreme[6] = {0,0,0,0,0,0};
+	#pragma omp parallel if(nCount > (int)m_nParallelThreshold)
+	{
+		unsigned int nLocal[6] = {0,0,0,0,0,0};
+		#pragma omp for schedule(static)
+		for ( int i = 0; i < nCount; ++i ) {
+			for ( int k = 0; k < 3; ++k ) {
+				if ( m_vPoints[i][k] < m_vPoints[nLocal[2*k]][k] )		nLocal[2*k] = i;
+				if ( m_vPoints[i][k] > m_vPoints[nLocal[2*k+1]][k] )	nLocal[2*k+1] = i;
+			}
+		}
+		#pragma omp critical
+		{
+			for ( int k = 0; k < 3; ++k ) {
+				if ( m_vPoints[nLocal[2*k]][k] < m_vPoints[nExtreme[2*k]][k] )		nExtreme[2*k] = nLocal[2*k];
+				if ( m_vPoints[nLocal[2*k+1]][k] > m_vPoints[nExtreme[2*k+1]][k] )	nExtreme[2*k+1] = nLocal[2*k+1];
+			}
+		}
+	}
+
+	// octahedron faces, one per octant. The cull is skipped if the octahedron is degenerate
+	// (in that case it may not be star-shaped around its centroid, and culling could be wrong)
+	Wml::Vector3d vCentroid( Wml::Vector3d::ZERO );
+	double fExtent = 0;
+	for ( int k = 0; k < 6; ++k )
+		vCentroid += m_vPoints[nExtreme[k]] / 6.0;
+	for ( int k = 0; k < 3; ++k )
+		fExtent = std::max( fExtent, m_vPoints[nExtreme[2*k+1]][k] - m_vPoints[nExtreme[2*k]][k] );
+	double fTolerance = fExtent * 1e-10;
+
+	Wml::Vector3d vNormals[8];
+	double fOffsets[8];
+	bool bCull = (fExtent > 0);
+	for ( int nOct = 0; nOct < 8 && bCull; ++nOct ) {
+		const Wml::Vector3d & a = m_vPoints[ nExtreme[ 0 + ((nOct&1) ? 1 : 0) ] ];
+		const Wml::Vector3d & b = m_vPoints[ nExtreme[ 2 + ((nOct&2) ? 1 : 0) ] ];
+		const Wml::Vector3d & c = m_vPoints[ nExtreme[ 4 + ((nOct&4) ? 1 : 0) ] ];
+		Wml::Vector3d vN( (b-a).Cross(c-a) );
+		if ( vN.Normalize() < Wml::Mathd::ZERO_TOLERANCE * fExtent ) {
+			bCull = false;
+			break;
+		}
+		if ( vN.Dot(vCentroid - a) > 0 )
+			vN = -vN;
+		vNormals[nOct] = vN;
+		fOffsets[nOct] = vN.Dot(a);
+		if ( vN.Dot(vCentroid) - fOffsets[nOct] > -fTolerance )
+			bCull = false;
+	}
+
+	vCandidates.resize(0);
+	if ( ! bCull ) {
+		vCandidates.resize(nCount);
+		for ( int i = 0; i < nCount; ++i )
+			vCandidates[i] = i;
+		return;
+	}
+
+	std::vector<unsigned char> vKeep(nCount);
+	#pragma omp parallel for schedule(static) if(nCount > (int)m_nParallelThreshold)
+	for ( int i = 0; i < nCount; ++i ) {
+		bool bInside = true;
+		for ( int nOct = 0; nOct < 8 && bInside; ++nOct )
+			bInside = ( vNormals[nOct].Dot(m_vPoints[i]) - fOffsets[nOct] < -fTolerance );
+		vKeep[i] = (bInside) ? 0 : 1;
+	}
+	for ( int i = 0; i < nCount; ++i )
+		if ( vKeep[i] )
+			vCandidates.push_back(i);
+	// extreme points are always kept (they are on the octahedron)
+}
+
+
+
+bool QuickHull3::InitialSimplex( const std::vector<unsigned int> & vCandidates, unsigned int nSimplex[4] )
+{
+	size_t nCount = vCandidates.size();
+	if ( nCount == 0 )
+		return false;
+
+	// two most distant candidates along an axis
+	unsigned int i0 = vCandidates[0], i1 = vCandidates[0];
+	double fMaxSpan = -1;
+	for ( int k = 0; k < 3; ++k ) {
+		unsigned int nMin = vCandidates[0], nMax = vCandidates[0];
+		for ( size_t i = 1; i < nCount; ++i ) {
+			unsigned int p = vCandidates[i];
+			if ( m_vPoints[p][k] < m_vPoints[nMin][k] )	nMin = p;
+			if ( m_vPoints[p][k] > m_vPoints[nMax][k] )	nMax = p;
+		}
+		double fSpan = m_vPoints[nMax][k] - m_vPoints[nMin][k];
+		if ( fSpan > fMaxSpan ) {
+			fMaxSpan = fSpan;  i0 = nMin;  i1 = nMax;
+		}
+	}
+	if ( fMaxSpan <= 0 ) {
+		m_nDimension = 0;
+		return false;
+	}
+	const Wml::Vector3d & p0 = m_vPoints[i0];
+	const Wml::Vector3d & p1 = m_vPoints[i1];
+
+	// furthest from line, then check exactly that it is not collinear (projections onto the 3 axis planes)
+	Wml::Vector3d vDir( p1 - p0 );
+	unsigned int i2 = i0;
+	double fMax = 0;
+	for ( size_t i = 0; i < nCount; ++i ) {
+		unsigned int p = vCandidates[i];
+		double fDist = vDir.Cross( m_vPoints[p] - p0 ).SquaredLength();
+		if ( fDist > fMax ) {
+			fMax = fDist;  i2 = p;
+		}
+	}
+	bool bFound = false;
+	for ( size_t i = 0; i <= nCount && ! bFound; ++i ) {
+		unsigned int p = (i == 0) ? i2 : vCandidates[i-1];
+		for ( int k = 0; k < 3 && ! bFound; ++k ) {
+			double a[2] = { p0[k], p0[(k+1)%3] }, b[2] = { p1[k], p1[(k+1)%3] };
+			double c[2] = { m_vPoints[p][k], m_vPoints[p][(k+1)%3] };
+			if ( Orient2D(a, b, c) != 0 ) {
+				bFound = true;  i2 = p;
+			}
+		}
+	}
+	if ( ! bFound ) {
+		m_nDimension = 1;
+		return false;
+	}
+	const Wml::Vector3d & p2 = m_vPoints[i2];
+
+	// furthest from plane, with exact non-coplanarity check
+	Wml::Vector3d vN( (p1-p0).Cross(p2-p0) );
+	unsigned int i3 = i0;
+	fMax = 0;
+	for ( size_t i = 0; i < nCount; ++i ) {
+		unsigned int p = vCandidates[i];
+		double fDist = fabs( vN.Dot( m_vPoints[p] - p0 ) );
+		if ( fDist > fMax ) {
+			fMax = fDist;  i3 = p;
+		}
+	}
+	if ( Orient3D( p0, p1, p2, m_vPoints[i3] ) == 0 ) {
+		bFound = false;
+		for ( size_t i = 0; i < nCount && ! bFound; ++i ) {
+			if ( Orient3D( p0, p1, p2, m_vPoints[vCandidates[i]] ) != 0 ) {
+				bFound = true;  i3 = vCandidates[i];
+			}
+		}
+		if ( ! bFound ) {
+			m_nDimension = 2;
+			return false;
+		}
+	}
+
+	nSimplex[0] = i0;  nSimplex[1] = i1;  nSimplex[2] = i2;  nSimplex[3] = i3;
+	return true;
+}
+
+
+
+
+unsigned int QuickHull3::NewFace( unsigned int a, unsigned int b, unsigned int c )
+{
+	unsigned int nFace;
+	if ( ! m_vFreeFaces.empty() ) {
+		nFace = m_vFreeFaces.back();
+		m_vFreeFaces.pop_back();
+	} else {
+		nFace = (unsigned int)m_vFaces.size();
+		m_vFaces.resize( m_vFaces.size() + 1 );
+	}
+	Face & f = m_vFaces[nFace];
+	f.nV[0] = a;  f.nV[1] = b;  f.nV[2] = c;
+	f.nNbr[0] = f.nNbr[1] = f.nNbr[2] = IMesh::InvalidID;
+	f.vConflict.resize(0);
+	f.nFurthest = IMesh::InvalidID;
+	f.fFurthestDist = 0;
+	f.nMark = 0;
+	f.bDeleted = false;
+	SetPlane(f);
+	return nFace;
+}
+
+void QuickHull3::SetPlane( Face & f )
+{
+	const Wml::Vector3d & a = m_vPoints[f.nV[0]];
+	f.vNormal = ( m_vPoints[f.nV[1]] - a ).Cross( m_vPoints[f.nV[2]] - a );
+	f.vNormal.Normalize();
+	f.fOffset = f.vNormal.Dot(a);
+}
+
+bool QuickHull3::IsOutside( const Face & f, unsigned int nPoint ) const
+{
+	return Orient3D( m_vPoints[f.nV[0]], m_vPoints[f.nV[1]], m_vPoints[f.nV[2]], m_vPoints[nPoint] ) < 0;
+}
+
+
+
+void QuickHull3::AssignConflicts( const std::vector<unsigned int> & vPoints, const std::vector<unsigned int> & vFaces )
+{
+	int nPoints = (int)vPoints.size();
+	int nFaces = (int)vFaces.size();
+	std::vector<unsigned int> vAssign(nPoints);
+	std::vector<double> vDist(nPoints);
+
+	#pragma omp parallel for schedule(static) if(nPoints > (int)m_nParallelThreshold)
+	for ( int i = 0; i < nPoints; ++i ) {
+		unsigned int nBest = IMesh::InvalidID;
+		double fBest = -std::numeric_limits<double>::max();
+		for ( int j = 0; j < nFaces; ++j ) {
+			const Face & f = m_vFaces[vFaces[j]];
+			if ( ! IsOutside(f, vPoints[i]) )
+				continue;
+			double fDist = Distance(f, vPoints[i]);
+			if ( fDist > fBest ) {
+				fBest = fDist;  nBest = (unsigned int)j;
+			}
+		}
+		vAssign[i] = nBest;
+		vDist[i] = fBest;
+	}
+
+	for ( int i = 0; i < nPoints; ++i ) {
+		if ( vAssign[i] == IMesh::InvalidID )
+			continue;
+		Face & f = m_vFaces[ vFaces[vAssign[i]] ];
+		if ( f.vConflict.empty() || vDist[i] > f.fFurthestDist ) {
+			f.nFurthest = vPoints[i];
+			f.fFurthestDist = vDist[i];
+		}
+		f.vConflict.push_back( vPoints[i] );
+	}
+}
+
+
+
+bool QuickHull3::AddPoint( unsigned int nFace, std::vector<unsigned int> & vNewFaces )
+{
+	unsigned int nEye = m_vFaces[nFace].nFurthest;
+	const Wml::Vector3d & vEye = m_vPoints[nEye];
+	if ( ++m_nMark == 0 )
+		m_nMark = 1;
+
+	// flood-fill visible faces from nFace, collecting horizon half-edges
+	std::vector<unsigned int> vVisible;
+	std::vector<HorizonEdge> vHorizon;
+	vVisible.push_back(nFace);
+	m_vFaces[nFace].nMark = m_nMark;
+	for ( size_t k = 0; k < vVisible.size(); ++k ) {
+		unsigned int nCur = vVisible[k];
+		for ( int i = 0; i < 3; ++i ) {
+			unsigned int nNbr = m_vFaces[nCur].nNbr[i];
+			Face & g = m_vFaces[nNbr];
+			if ( g.nMark == m_nMark )
+				continue;
+			if ( Orient3D( m_vPoints[g.nV[0]], m_vPoints[g.nV[1]], m_vPoints[g.nV[2]], vEye ) < 0 ) {
+				g.nMark = m_nMark;
+				vVisible.push_back(nNbr);
+			}
+		}
+	}
+	for ( size_t k = 0; k < vVisible.size(); ++k ) {
+		const Face & f = m_vFaces[vVisible[k]];
+		for ( int i = 0; i < 3; ++i ) {
+			if ( m_vFaces[f.nNbr[i]].nMark != m_nMark ) {
+				HorizonEdge e = { f.nV[i], f.nV[(i+1)%3], f.nNbr[i] };
+				vHorizon.push_back(e);
+			}
+		}
+	}
+
+	// order horizon into a loop (start vertex -> edge)
+	size_t nHorizon = vHorizon.size();
+	std::vector< std::pair<unsigned int, unsigned int> > vStarts(nHorizon);
+	for ( size_t k = 0; k < nHorizon; ++k )
+		vStarts[k] = std::pair<unsigned int,unsigned int>( vHorizon[k].a, (unsigned int)k );
+	std::sort( vStarts.begin(), vStarts.end() );
+	std::vector<unsigned int> vLoop;
+	vLoop.reserve(nHorizon);
+	unsigned int nCur = 0;
+	for ( size_t k = 0; k < nHorizon; ++k ) {
+		vLoop.push_back(nCur);
+		std::vector< std::pair<unsigned int, unsigned int> >::iterator found =
+			std::lower_bound( vStarts.begin(), vStarts.end(), std::pair<unsigned int,unsigned int>(vHorizon[nCur].b, 0) );
+		if ( found == vStarts.end() || found->first != vHorizon[nCur].b )
+			return false;
+		nCur = found->second;
+	}
+	if ( nCur != 0 || nHorizon < 3 )
+		return false;		// visible region is not a disk
+
+	// gather orphaned points and release visible faces
+	std::vector<unsigned int> vOrphans;
+	for ( size_t k = 0; k < vVisible.size(); ++k ) {
+		Face & f = m_vFaces[vVisible[k]];
+		for ( size_t i = 0; i < f.vConflict.size(); ++i )
+			if ( f.vConflict[i] != nEye )
+				vOrphans.push_back( f.vConflict[i] );
+		std::vector<unsigned int>().swap( f.vConflict );
+		f.bDeleted = true;
+	}
+	for ( size_t k = 0; k < vVisible.size(); ++k )
+		m_vFreeFaces.push_back( vVisible[k] );
+
+	// cone of new faces from horizon to eye
+	vNewFaces.resize(nHorizon);
+	for ( size_t k = 0; k < nHorizon; ++k ) {
+		const HorizonEdge & e = vHorizon[ vLoop[k] ];
+		vNewFaces[k] = NewFace( e.a, e.b, nEye );
+	}
+	for ( size_t k = 0; k < nHorizon; ++k ) {
+		const HorizonEdge & e = vHorizon[ vLoop[k] ];
+		Face & f = m_vFaces[ vNewFaces[k] ];
+		f.nNbr[0] = e.nOpposite;
+		f.nNbr[1] = vNewFaces[ (k+1) % nHorizon ];
+		f.nNbr[2] = vNewFaces[ (k+nHorizon-1) % nHorizon ];
+		Face & g = m_vFaces[e.nOpposite];
+		for ( int i = 0; i < 3; ++i )
+			if ( g.nV[i] == e.b && g.nV[(i+1)%3] == e.a )
+				g.nNbr[i] = vNewFaces[k];
+	}
+
+	AssignConflicts( vOrphans, vNewFaces );
+	return true;
+}
+
+
+
+void QuickHull3::MakeTriMesh( VFTriangleMesh & mesh, bool bClear ) const
+{
+	if ( bClear )
+		mesh.Clear(false);
+	if ( m_vTriangles.empty() )
+		return;
+
+	size_t nVerts = m_vHullVertices.size();
+	std::vector<IMesh::VertexID> vMap( nVerts );
+	for ( size_t k = 0; k < nVerts; ++k )
+		vMap[k] = mesh.AppendVertex( m_vHullPositions[k] );
+
+	std::vector<Wml::Vector3f> vNormals( nVerts, Wml::Vector3f::ZERO );
+	size_t nTris = m_vTriangles.size() / 3;
+	for ( size_t t = 0; t < nTris; ++t ) {
+		unsigned int nTri[3];
+		for ( int j = 0; j < 3; ++j )
+			nTri[j] = (unsigned int)( std::lower_bound( m_vHullVertices.begin(), m_vHullVertices.end(), m_vTriangles[3*t+j] ) - m_vHullVertices.begin() );
+		const Wml::Vector3f & a = m_vHullPositions[nTri[0]];
+		Wml::Vector3f vFaceNormal( (m_vHullPositions[nTri[1]] - a).Cross( m_vHullPositions[nTri[2]] - a ) );
+		for ( int j = 0; j < 3; ++j )
+			vNormals[nTri[j]] += vFaceNormal;
+		mesh.AppendTriangle( vMap[nTri[0]], vMap[nTri[1]], vMap[nTri[2]] );
+	}
+	for ( size_t k = 0; k < nVerts; ++k ) {
+		vNormals[k].Normalize();
+		mesh.SetNormal( vMap[k], vNormals[k] );
+	}
+}
+
+
+
+void QuickHull3::ComputeHulls( const std::vector< std::vector<Wml::Vector3f> > & vPointSets, std::vector<VFTriangleMesh *> & vMeshes )
+{
+	int nSets = (int)vPointSets.size();
+	#pragma omp parallel for schedule(dynamic,1)
+	for ( int i = 0; i < nSets; ++i ) {
+		QuickHull3 hull;
+		hull.SetParallelThreshold( std::numeric_limits<unsigned int>::max() );
+		if ( hull.Compute( vPointSets[i] ) )
+			hull.MakeTriMesh( *vMeshes[i] );
+		else
+			vMeshes[i]->Clear(false);
+	}
+}
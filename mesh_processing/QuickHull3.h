@@ -0,0 +1,103 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef __RMS_QUICKHULL3_H__
+#define __RMS_QUICKHULL3_H__
+
+#include "config.h"
+#include "VFTriangleMesh.h"
+#include <Wm4Vector3.h>
+
+#include <vector>
+
+namespace rms {
+
+/*
+ * 3D convex hull by quickhull. Intended as a faster replacement for Wml::ConvexHull3 on large
+ * point sets (which is incremental and uses rational arithmetic for every query).
+ *
+ *   - points strictly inside the octahedron spanned by the 6 axis-extreme points are culled up front
+ *   - point-vs-face tests use filtered predicates with an exact fallback (ExactPredicates.h),
+ *     so the output is a valid convex polyhedron even for degenerate / coplanar input
+ *   - culling and conflict-list (re)assignment run in parallel (OpenMP) for large point sets
+ *
+ * Coplanar hull faces are not merged, so a point lying exactly on a hull face may or may not
+ * end up as a hull vertex. Input with fewer than 4 non-coplanar points has no 3D hull;
+ * GetDimension() reports 0, 1 or 2 in that case.
+ */
+class QuickHull3
+{
+public:
+	QuickHull3();
+
+	bool Compute( const std::vector<Wml::Vector3f> & vPoints );
+	bool Compute( const Wml::Vector3f * pPoints, unsigned int nCount );
+
+	//! 3 if hull is valid, otherwise dimension of (degenerate) input
+	int GetDimension() const { return m_nDimension; }
+
+	//! hull triangles as indices into input points, 3 per triangle, counter-clockwise seen from outside
+	const std::vector<unsigned int> & GetTriangles() const { return m_vTriangles; }
+	unsigned int GetTriangleCount() const { return (unsigned int)m_vTriangles.size() / 3; }
+
+	//! append hull to mesh (hull vertices only). Vertex normals are averaged face normals
+	void MakeTriMesh( VFTriangleMesh & mesh, bool bClear = true ) const;
+
+	//! hull of each point set, in parallel over sets (each hull runs single-threaded). Meshes that fail are left empty
+	static void ComputeHulls( const std::vector< std::vector<Wml::Vector3f> > & vPointSets, std::vector<VFTriangleMesh *> & vMeshes );
+
+
+	//! point sets smaller than this are processed single-threaded
+	void SetParallelThreshold( unsigned int nCount ) { m_nParallelThreshold = nCount; }
+
+protected:
+	std::vector<Wml::Vector3d> m_vPoints;
+	unsigned int m_nParallelThreshold;
+	int m_nDimension;
+	std::vector<unsigned int> m_vTriangles;
+	std::vector<unsigned int> m_vHullVertices;		// sorted input indices of hull vertices
+	std::vector<Wml::Vector3f> m_vHullPositions;
+
+	struct Face {
+		unsigned int nV[3];
+		unsigned int nNbr[3];			// face across edge (nV[i], nV[(i+1)%3])
+		Wml::Vector3d vNormal;
+		double fOffset;
+		std::vector<unsigned int> vConflict;
+		unsigned int nFurthest;
+		double fFurthestDist;
+		unsigned int nMark;
+		bool bDeleted;
+	};
+	std::vector<Face> m_vFaces;
+
+	struct HorizonEdge {
+		unsigned int a, b;			// oriented as in the visible face
+		unsigned int nOpposite;		// non-visible face across the edge
+	};
+	std::vector<unsigned int> m_vFreeFaces;
+	unsigned int m_nMark;
+
+	bool Run();
+
+	void CullInterior( std::vector<unsigned int> & vCandidates );
+	bool InitialSimplex( const std::vector<unsigned int> & vCandidates, unsigned int nSimplex[4] );
+
+	unsigned int NewFace( unsigned int a, unsigned int b, unsigned int c );
+	void SetPlane( Face & f );
+	bool IsOutside( const Face & f, unsigned int nPoint ) const;
+	inline double Distance( const Face & f, unsigned int nPoint ) const
+		{ return f.vNormal.Dot( m_vPoints[nPoint] ) - f.fOffset; }
+
+	//! distribute vPoints among conflict lists of vFaces (points outside all faces are dropped)
+	void AssignConflicts( const std::vector<unsigned int> & vPoints, const std::vector<unsigned int> & vFaces );
+
+	//! add furthest conflict point of nFace to hull. Returns new faces in vNewFaces
+	bool AddPoint( unsigned int nFace, std::vector<unsigned int> & vNewFaces );
+};
+
+
+} // end namespace rms
+
+#endif  // __RMS_QUICKHULL3_H__
@@ -31,6 +31,8 @@ RotInvCoordDeformer::RotInvCoordDeformer()
 	m_pLs = new gsi::SparseMatrix();
 	m_pM = new gsi::SparseMatrix();
 	m_pRHSPos = new gsi::Vector[3];
+	m_pRHSRot = new gsi::Vector[3];
+	InvalidateMatrices();
 }
 
 RotInvCoordDeformer::~RotInvCoordDeformer()
@@ -49,6 +51,8 @@ RotInvCoordDeformer::~RotInvCoordDeformer()
 		delete m_pM;
 	if ( m_pRHSPos )
 		delete [] m_pRHSPos;
+	if ( m_pRHSRot )
+		delete [] m_pRHSRot;
 }
 
 
@@ -86,7 +90,16 @@ void RotInvCoordDeformer::SetMesh(rms::VFTriangleMesh * pMesh)
 	m_vPosConstraints.resize(0);
 	m_vRotConstraints.resize(0);
 	ComputeWeights();
-	m_bMatricesValid = false;
+	InvalidateMatrices();
+}
+
+
+void RotInvCoordDeformer::ClearConstraints()
+{
+	// soft constraints live on the system diagonals, so both factorizations are stale
+	m_vPosConstraints.resize(0); 
+	m_vRotConstraints.resize(0);
+	InvalidateMatrices();
 }
 
 
@@ -113,7 +126,7 @@ void RotInvCoordDeformer::UpdatePositionConstraint( IMesh::VertexID vID, const W
 		if ( m_vPosConstraints[k].vID == vID ) {
 			m_vPosConstraints[k].vPosition = vPosition;
 			if ( m_vPosConstraints[k].fWeight != fWeight )
-				m_bMatricesValid = false;
+				m_bPosMatrixValid = false;
 			m_vPosConstraints[k].fWeight = fWeight;
 			bFound = true;
 		}
@@ -124,7 +137,7 @@ void RotInvCoordDeformer::UpdatePositionConstraint( IMesh::VertexID vID, const W
 		c.vPosition = vPosition;
 		c.fWeight = fWeight;
 		m_vPosConstraints.push_back(c);
-		m_bMatricesValid = false;
+		m_bPosMatrixValid = false;
 	}
 }
 
@@ -136,7 +149,7 @@ void RotInvCoordDeformer::UpdateOrientationConstraint( IMesh::VertexID vID, cons
 		if ( m_vRotConstraints[k].vID == vID ) {
 			m_vRotConstraints[k].vFrame = vFrame;
 			if ( m_vRotConstraints[k].fWeight != fWeight )
-				m_bMatricesValid = false;
+				m_bRotMatrixValid = false;
 			m_vRotConstraints[k].fWeight = fWeight;
 			bFound = true;
 		}
@@ -147,7 +160,7 @@ void RotInvCoordDeformer::UpdateOrientationConstraint( IMesh::VertexID vID, cons
 		c.vFrame = vFrame;
 		c.fWeight = fWeight;
 		m_vRotConstraints.push_back(c);
-		m_bMatricesValid = false;
+		m_bRotMatrixValid = false;
 	}
 }
 
@@ -180,7 +193,7 @@ void RotInvCoordDeformer::SetVertexWeight( IMesh::VertexID vID, float fWeight )
 {
 	VtxInfo & vi = m_vVertices[vID];
 	vi.fVertexWeight = fWeight;
-	m_bMatricesValid = false;
+	InvalidateMatrices();
 }
 void RotInvCoordDeformer::SetVertexScale( IMesh::VertexID vID, float fScale )
 {
@@ -200,17 +213,36 @@ void RotInvCoordDeformer::ComputeWeights()
 	m_vVertices.resize( nVerts );
 	m_nEdges = 0;
 
+	m_vLsRowStart.resize(nVerts+1);
+	m_vLsNbrs.resize(0);
+	m_vLsWeights.resize(0);
+	m_vLsWeightSum.resize(nVerts);
+
+	std::vector<IMesh::VertexID> vNbrs;
+	std::vector<float> vNbrWeights;
+
 	m_fAvgVtxArea = 0.0f;
 	for ( unsigned int i = 0; i < nVerts; ++i ) {
 		VtxInfo & vi = m_vVertices[i];
 		vi.vID = i;
 		
-		MeshUtils::VertexOneRing(*m_pMesh, vi.vID, vi.vNbrs, false);
-		size_t nNbrs = vi.vNbrs.size();
+		vNbrs.resize(0);
+		MeshUtils::VertexOneRing(*m_pMesh, vi.vID, vNbrs, false);
+		size_t nNbrs = vNbrs.size();
 		m_nEdges += (unsigned int)nNbrs;
 
-		MeshUtils::CotangentWeights(*m_pMesh, vi.vID, vi.vNbrs, vi.vNbrWeights);
-//		MeshUtils::UniformWeights(*m_pMesh, vi.vID, vi.vNbrs, vi.vNbrWeights);
+		MeshUtils::CotangentWeights(*m_pMesh, vi.vID, vNbrs, vNbrWeights);
+//		MeshUtils::UniformWeights(*m_pMesh, vi.vID, vNbrs, vNbrWeights);
+
+		// append row to flat laplacian
+		m_vLsRowStart[i] = (unsigned int)m_vLsNbrs.size();
+		float fWeightSum = 0.0f;
+		for ( unsigned int k = 0; k < nNbrs; ++k ) {
+			m_vLsNbrs.push_back( vNbrs[k] );
+			m_vLsWeights.push_back( vNbrWeights[k] );
+			fWeightSum += vNbrWeights[k];
+		}
+		m_vLsWeightSum[i] = fWeightSum;
 
 		Wml::Vector3f vVtx, vNormal, vNbr;
 		m_pMesh->GetVertex(vi.vID, vVtx);
@@ -220,7 +252,7 @@ void RotInvCoordDeformer::ComputeWeights()
 		// find most-orthogonal outgoing edge (for tangent-frame calculation)
 		float fMinNbrDot = 1.0f;   unsigned int nBestNbr = -1;
 		for ( unsigned int k = 0; k < nNbrs; ++k ) {
-			m_pMesh->GetVertex( vi.vNbrs[k], vNbr );
+			m_pMesh->GetVertex( vNbrs[k], vNbr );
 			vNbr -= vVtx;   vNbr.Normalize();
 			float fDot = (float)fabs(vNbr.Dot(vNormal));
 			if ( fDot < fMinNbrDot ) {
@@ -230,7 +262,7 @@ void RotInvCoordDeformer::ComputeWeights()
 		}
 		if ( nBestNbr == -1 )
 			nBestNbr = 0;
-		vi.nTangentNbr = vi.vNbrs[nBestNbr];
+		vi.nTangentNbr = vNbrs[nBestNbr];
 
 		// compute frame
 		m_pMesh->GetVertex(vi.nTangentNbr, vNbr);
@@ -241,7 +273,7 @@ void RotInvCoordDeformer::ComputeWeights()
 		vi.vFrame.SetFrame( xikbar, xik, vNormal);
 
 		// compute laplacian vector
-		vi.vLaplacian = MeshUtils::MeshLaplacian(*m_pMesh, vi.vID, vi.vNbrs, vi.vNbrWeights);
+		vi.vLaplacian = MeshUtils::MeshLaplacian(*m_pMesh, vi.vID, vNbrs, vNbrWeights);
 		vi.vFrameLaplacian = vi.vLaplacian;
 		vi.vFrame.ToFrameLocal( vi.vFrameLaplacian );
 
@@ -256,12 +288,15 @@ void RotInvCoordDeformer::ComputeWeights()
 		// per-vertex scaling factor
 		vi.fVertexScale = 1.0f;
 	}
+	m_vLsRowStart[nVerts] = (unsigned int)m_vLsNbrs.size();
 
 	// rescale vertex areas, so that constraint weight scales are not affected
 	for ( unsigned int i = 0; i < nVerts; ++i ) {
 		VtxInfo & vi = m_vVertices[i];
 		vi.fVertexArea /= m_fAvgVtxArea;
 	}
+
+	m_vScaledLaplacians.resize(nVerts);
 }
 
 
@@ -272,66 +307,35 @@ void RotInvCoordDeformer::ComputeWeights()
 
 void RotInvCoordDeformer::UpdateMatrices()
 {
-	if ( m_bMatricesValid )
-		return;
-
-	unsigned int nVerts = (unsigned int)m_vVertices.size();
-
-
-	/*
-	 * build system matrix for orientations
-	 */
-#if 0
-	gsi::SparseMatrix MRot;
-	MRot.Resize(3*m_nEdges, 3*nVerts);
-	gsi::SparseMatrix RotMInv;
-	RotMInv.Resize( 3*m_nEdges, 3*m_nEdges );
-
-	// [TODO] this loop uses vertex ID indexing...need to rewrite w/ vertex<->row map
-	unsigned int rij = 0;
-	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
-		VtxInfo & vi = m_vVertices[ri];
-		IMesh::VertexID i = vi.vID;
-		unsigned int ci = 3*i;
-		float fVtxWeight = 1.0f / ( vi.fVertexArea ) / vi.fVertexWeight;
-
-		size_t nNbrs = vi.vNbrs.size();
-		for ( unsigned int ni = 0; ni < nNbrs; ++ni ) {
-			IMesh::VertexID j = vi.vNbrs[ni];
-			unsigned int cj = 3*j;
-			float fWeight = vi.vNbrWeights[ni];
-
-			Wml::Matrix3f Fi = m_vVertices[i].vFrame.FrameMatrix();
-			Wml::Matrix3f Fj = m_vVertices[j].vFrame.FrameMatrix();
-			Wml::Matrix3f Rij = Fj.TransposeTimes(Fi);
-
-			for ( int k = 0; k < 3; ++k ) {
-				// Mrot(rij+k,ci:ci+2) = Rij(k,:);
-				// Mrot(rij+k,cj+k) = -1;
-				MRot.Set( rij+k, ci+0, Rij(k, 0) * fWeight );
-				MRot.Set( rij+k, ci+1, Rij(k, 1) * fWeight );
-				MRot.Set( rij+k, ci+2, Rij(k, 2) * fWeight );
-				MRot.Set( rij+k, cj+k, -1 * fWeight);
-
-				RotMInv.Set( rij+k, rij+k, fVtxWeight );
-			}
-			rij += 3;
+	// The two systems are independent, so if both are stale we assemble them concurrently.
+	// Factorizations are computed (once) by the TAUCS solvers on the next Solve() and 
+	// then re-used until the corresponding matrix is invalidated.
+	bool bRot = ! m_bRotMatrixValid;
+	bool bPos = ! m_bPosMatrixValid;
+	if ( bRot && bPos ) {
+		#pragma omp parallel sections
+		{
+			#pragma omp section
+			UpdateMatrixRot();
+			#pragma omp section
+			UpdateMatrixPos();
 		}
+	} else if ( bRot ) {
+		UpdateMatrixRot();
+	} else if ( bPos ) {
+		UpdateMatrixPos();
 	}
+}
 
-	// construct weighted normal equations	
-	gsi::SparseMatrix MRotTrans;
-	MRot.Transpose(MRotTrans);
 
-	//gsi::SparseMatrix MTransTimesMInv;
-	//MRotTrans.Multiply(RotMInv, MTransTimesMInv);
-	//gsi::SparseMatrix MSysRot( MTransTimesMInv * MRot );
-	gsi::SparseMatrix MSysRot;
-	MRotTrans.Multiply( MRot, MSysRot );
-#endif
 
+void RotInvCoordDeformer::UpdateMatrixRot()
+{
+	unsigned int nVerts = (unsigned int)m_vVertices.size();
 
-#if 1
+	/*
+	 * build system matrix for orientations
+	 */
 	SparseMatrixType Rs(3*m_nEdges, 3*nVerts);
 	Rs.reserve( (3*m_nEdges)*4 );
 
@@ -340,15 +344,14 @@ void RotInvCoordDeformer::UpdateMatrices()
 		VtxInfo & vi = m_vVertices[ri];
 		IMesh::VertexID i = vi.vID;
 		unsigned int ci = 3*i;
-		float fVtxWeight = 1.0f / ( vi.fVertexArea ) / vi.fVertexWeight;
+		Wml::Matrix3f Fi = vi.vFrame.FrameMatrix();
 
-		size_t nNbrs = vi.vNbrs.size();
-		for ( unsigned int ni = 0; ni < nNbrs; ++ni ) {
-			IMesh::VertexID j = vi.vNbrs[ni];
+		unsigned int nEnd = m_vLsRowStart[ri+1];
+		for ( unsigned int ni = m_vLsRowStart[ri]; ni < nEnd; ++ni ) {
+			IMesh::VertexID j = m_vLsNbrs[ni];
 			unsigned int cj = 3*j;
-			float fWeight = vi.vNbrWeights[ni];
+			float fWeight = m_vLsWeights[ni];
 
-			Wml::Matrix3f Fi = m_vVertices[i].vFrame.FrameMatrix();
 			Wml::Matrix3f Fj = m_vVertices[j].vFrame.FrameMatrix();
 			Wml::Matrix3f Rij = Fj.TransposeTimes(Fi);
 
@@ -367,16 +370,13 @@ void RotInvCoordDeformer::UpdateMatrices()
 	Rs.finalize();
 	SparseMatrixType RsT_Rs = SparseMatrixType(Rs.transpose()) * Rs;
 
-
 	gsi::SparseMatrix MSysRot;
 	MSysRot.Resize(3*nVerts,3*nVerts);
 	for (unsigned int k=0; k < 3*nVerts; ++k) {
 		for ( SparseMatrixType::InnerIterator it(RsT_Rs,k); it; ++it)
 			MSysRot.Set( it.row(), it.col(), it.value() );
 	}
-#endif
 
-	
 	// add soft constraints
 	// [TODO] this loop uses vertex ID indexing...need to rewrite w/ vertex<->row map
 	size_t nRotCons = m_vRotConstraints.size();
@@ -389,6 +389,8 @@ void RotInvCoordDeformer::UpdateMatrices()
 
 	GetSystemRot()->SetMatrix( MSysRot );
 	GetSystemRot()->ResizeRHS(3);
+	for ( int k = 0; k < 3; ++k )
+		m_pRHSRot[k].Resize( 3*nVerts );
 
 	if ( ! GetSystemRot()->Matrix().IsSymmetric() )
 		lgBreakToDebugger();
@@ -398,8 +400,14 @@ void RotInvCoordDeformer::UpdateMatrices()
 	GetSolverRot()->SetSolverMode( gsi::Solver_TAUCS::TAUCS_LLT );
 	GetSolverRot()->SetOrderingMode( gsi::Solver_TAUCS::TAUCS_METIS );
 
+	m_bRotMatrixValid = true;
+}
+
 
 
+void RotInvCoordDeformer::UpdateMatrixPos()
+{
+	unsigned int nVerts = (unsigned int)m_vVertices.size();
 
 	/*
 	 * build Laplacian system to find positions
@@ -409,52 +417,13 @@ void RotInvCoordDeformer::UpdateMatrices()
 	for ( int k = 0; k < 3; ++k )
 		m_pRHSPos[k].Resize( nVerts );
 
-#if 0
-	_RMSTUNE_start(2);
-
-	gsi::SparseMatrix & Ls = (*m_pLs);
-	Ls.Resize(nVerts, nVerts);
-	//gsi::SparseMatrix & Minv = (*m_pM);
-	//Minv.Resize(nVerts, nVerts);
-	
-	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
-		VtxInfo & vi = m_vVertices[ri];
-		size_t nNbrs = vi.vNbrs.size();
-
-		double dSum = 0.0f;
-		for ( unsigned int k = 0; k < nNbrs; ++k ) {
-			Ls(ri, vi.vNbrs[k]) = vi.vNbrWeights[k];
-			dSum += vi.vNbrWeights[k];
-		}
-		Ls(ri, ri) = -dSum;
-		//Minv(ri,ri) = ( 1.0f / ( vi.fVertexArea ) ) / vi.fVertexWeight;
-	}
-
-	// construct system
-	//gsi::SparseMatrix Msys( Ls * Minv * Ls );
-	gsi::SparseMatrix Msys( Ls * Ls );
-
-	_RMSTUNE_end(2);
-	_RMSInfo("gsi Ls*Ls time was %f\n", _RMSTUNE_time(2));
-#endif
-
-
-#if 1
-	_RMSTUNE_start(2);
-
-
 	SparseMatrixType Ls(nVerts,nVerts);
 	Ls.reserve(m_nEdges+nVerts);
 	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
-		VtxInfo & vi = m_vVertices[ri];
-		size_t nNbrs = vi.vNbrs.size();
-
-		double dSum = 0.0f;
-		for ( unsigned int k = 0; k < nNbrs; ++k ) {
-			Ls.insert(ri, vi.vNbrs[k]) = vi.vNbrWeights[k];
-			dSum += vi.vNbrWeights[k];
-		}
-		Ls.insert(ri, ri) = -dSum;
+		unsigned int nEnd = m_vLsRowStart[ri+1];
+		for ( unsigned int k = m_vLsRowStart[ri]; k < nEnd; ++k )
+			Ls.insert(ri, m_vLsNbrs[k]) = m_vLsWeights[k];
+		Ls.insert(ri, ri) = -m_vLsWeightSum[ri];
 		//Minv(ri,ri) = ( 1.0f / ( vi.fVertexArea ) ) / vi.fVertexWeight;
 	}
 	Ls.finalize();
@@ -467,10 +436,6 @@ void RotInvCoordDeformer::UpdateMatrices()
 			Msys.Set( it.row(), it.col(), it.value() );
 	}
 
-	_RMSTUNE_end(2);
-	_RMSInfo("Eigen Ls*Ls time was %f\n", _RMSTUNE_time(2));
-#endif
-
 	// add soft constraints
 	unsigned int nCons = (unsigned int)m_vPosConstraints.size();
 	for ( unsigned int ci = 0; ci < nCons; ++ci ) {
@@ -489,69 +454,74 @@ void RotInvCoordDeformer::UpdateMatrices()
 	GetSolverPos()->SetSolverMode( gsi::Solver_TAUCS::TAUCS_LLT );
 	GetSolverPos()->SetOrderingMode( gsi::Solver_TAUCS::TAUCS_METIS );
 
-	m_bMatricesValid = true;
+	m_bPosMatrixValid = true;
 }
 
 
 
 void RotInvCoordDeformer::UpdateRHSRot()
 {
-	gsi::SparseLinearSystem * pSystem = GetSystemRot();
+	// The rotation system has 3 rows per vertex (frame axes) and 3 RHS columns (xyz), 
+	// ie 9 RHS values per vertex. We assemble all columns in one pass and hand them to
+	// the system as a block, so that one Solve() back-substitutes them against the same factorization.
+	for ( int k = 0; k < 3; ++k )
+		m_pRHSRot[k].Clear();
+	double * pRHS[3] = { m_pRHSRot[0].GetValues(), m_pRHSRot[1].GetValues(), m_pRHSRot[2].GetValues() };
 
 	// update soft constraints
 	// [TODO] this loop uses vertex ID indexing...need to rewrite w/ vertex<->row map
-	size_t nRotCons = m_vRotConstraints.size();
-	for ( unsigned int ci = 0; ci < nRotCons; ++ci ) {
-		RotConstraint & c = m_vRotConstraints[ci];
+	int nRotCons = (int)m_vRotConstraints.size();
+	#pragma omp parallel for
+	for ( int ci = 0; ci < nRotCons; ++ci ) {
+		const RotConstraint & c = m_vRotConstraints[ci];
 		int ri = c.vID * 3;
-
-		Wml::Vector3f vConsValA = c.fWeight*c.fWeight*c.vFrame.X();
-		for ( int k = 0; k < 3; ++k ) 
-			pSystem->SetRHS( ri, vConsValA[k], k );
-
-		Wml::Vector3f vConsValB = c.fWeight*c.fWeight*c.vFrame.Y();
-		for ( int k = 0; k < 3; ++k ) 
-			pSystem->SetRHS( ri+1, vConsValB[k], k );
-
-		Wml::Vector3f vConsValN = c.fWeight*c.fWeight*c.vFrame.Z();
-		for ( int k = 0; k < 3; ++k ) 
-			pSystem->SetRHS( ri+2, vConsValN[k], k );
+		float fWeight2 = c.fWeight*c.fWeight;
+		for ( int j = 0; j < 3; ++j ) {
+			Wml::Vector3f vConsVal = fWeight2 * c.vFrame.Axis( (rms::Frame3f::FrameAxis)j );
+			for ( int k = 0; k < 3; ++k ) 
+				pRHS[k][ri+j] = vConsVal[k];
+		}
 	}	
+
+	gsi::SparseLinearSystem * pSystem = GetSystemRot();
+	for ( int k = 0; k < 3; ++k )
+		pSystem->SetRHS(k, m_pRHSRot[k]);
 }
 
 
 
 void RotInvCoordDeformer::UpdateRHSPos()
 {
-	unsigned int nVerts = (unsigned int)m_vVertices.size();
+	int nVerts = (int)m_vVertices.size();
+	float fGlobalScale = GlobalScale();
 
 	// transform laplacians to new frames
-	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
+	#pragma omp parallel for
+	for ( int ri = 0; ri < nVerts; ++ri ) {
 		VtxInfo & vi = m_vVertices[ri];
 
 		// transform frame-encoded laplacian vector into new 3D frame
 		vi.vLaplacian = vi.vFrameLaplacian;
 		vi.vTransFrame.ToWorld( vi.vLaplacian );
+		m_vScaledLaplacians[ri] = vi.vLaplacian * (fGlobalScale*vi.fVertexScale);
 	}
 
-	float fGlobalScale = GlobalScale();
-	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
-		VtxInfo & vi = m_vVertices[ri];
+	// RHS = Ls * (scaled laplacians), all three columns in one pass over the operator
+	double * pRHS[3] = { m_pRHSPos[0].GetValues(), m_pRHSPos[1].GetValues(), m_pRHSPos[2].GetValues() };
+	#pragma omp parallel for
+	for ( int ri = 0; ri < nVerts; ++ri ) {
 		double x[3] = {0,0,0};
-		float fWeightSum = 0.0f;
-		size_t nNbrs = vi.vNbrs.size();
-		for ( unsigned int k = 0; k < nNbrs; ++k ) {
-			VtxInfo & ni = m_vVertices[ vi.vNbrs[k] ];
-			float fWeight = vi.vNbrWeights[k];
-			fWeightSum += fWeight;
-			const Wml::Vector3f & vNbrLaplacian = ni.vLaplacian;
-			for ( int i = 0; i < 3; ++i ) {
-				x[i] += fWeight*vNbrLaplacian[i]*fGlobalScale*ni.fVertexScale;
-			}
+		unsigned int nEnd = m_vLsRowStart[ri+1];
+		for ( unsigned int k = m_vLsRowStart[ri]; k < nEnd; ++k ) {
+			float fWeight = m_vLsWeights[k];
+			const Wml::Vector3f & vNbrLaplacian = m_vScaledLaplacians[ m_vLsNbrs[k] ];
+			for ( int i = 0; i < 3; ++i )
+				x[i] += fWeight*vNbrLaplacian[i];
 		}
-		const Wml::Vector3f & vLaplacian = vi.vLaplacian;
+		const Wml::Vector3f & vLaplacian = m_vScaledLaplacians[ri];
+		float fWeightSum = m_vLsWeightSum[ri];
 		for ( int i = 0; i < 3; ++i )
-			m_pRHSPos[i][ri] = x[i] - fWeightSum*vLaplacian[i]*fGlobalScale*vi.fVertexScale ;
+			pRHS[i][ri] = x[i] - fWeightSum*vLaplacian[i];
 	}
 
 	// add soft constraints
@@ -561,48 +531,13 @@ void RotInvCoordDeformer::UpdateRHSPos()
 		int ri = c.vID;
 		float fConsWeight = c.fWeight;
 		for ( int k = 0; k < 3; ++k ) 
-			m_pRHSPos[k][ri] += c.vPosition[k]*fConsWeight*fConsWeight;
+			pRHS[k][ri] += c.vPosition[k]*fConsWeight*fConsWeight;
 	};
 
-
 	gsi::SparseLinearSystem * pSystem = GetSystemPos();
 	pSystem->SetRHS(0, m_pRHSPos[0]);
 	pSystem->SetRHS(1, m_pRHSPos[1]);
 	pSystem->SetRHS(2, m_pRHSPos[2]);
-
-
-#if 0
-	gsi::SparseLinearSystem * pSystem = GetSystemPos();
-
-	for ( unsigned int ri = 0; ri < nVerts; ++ri ) {
-		VtxInfo & vi = m_vVertices[ri];
-
-		// transform frame-encoded laplacian vector into new 3D frame
-		vi.vLaplacian = vi.vFrameLaplacian;
-		vi.vTransFrame.ToWorld( vi.vLaplacian );
-		Wml::Vector3f vLaplacian = vi.vLaplacian;
-		vLaplacian *= GlobalScale() * vi.fVertexScale;
-		for ( int k = 0; k < 3; ++k )
-			pSystem->SetRHS(ri, vLaplacian[k], k);
-	}
-
-	for ( int k = 0; k < 3; ++k ) {
-		const gsi::Vector & vRHS = pSystem->GetRHS(k);
-		gsi::Vector vLsRHS( (*m_pLs) * vRHS );
-		pSystem->SetRHS( k, vLsRHS );
-	}
-
-	unsigned int nCons = (unsigned int)m_vPosConstraints.size();
-	for ( unsigned int ci = 0; ci < nCons; ++ci ) {
-		PosConstraint & c = m_vPosConstraints[ci];
-		int ri = c.vID;
-		Wml::Vector3f vConsVal = c.fWeight*c.fWeight*c.vPosition;
-		for ( int k = 0; k < 3; ++k ) 
-			pSystem->SetRHS( ri, pSystem->GetRHS(ri,k) + vConsVal[k], k );
-	};
-#endif
-
-
 }
 
 
@@ -612,6 +547,7 @@ void RotInvCoordDeformer::Solve()
 {
 	UpdateMatrices();
 
+	// stage 1: solve for frames
 	UpdateRHSRot();
 	bool bOKRot = GetSolverRot()->Solve();
 	if ( ! bOKRot )
@@ -619,13 +555,16 @@ void RotInvCoordDeformer::Solve()
 
 	// extract solved frames 
 	gsi::SparseLinearSystem * pSystemRot = GetSystemRot();
+	const double * pSolRot[3] = { pSystemRot->GetSolution(0).GetValues(), 
+		pSystemRot->GetSolution(1).GetValues(), pSystemRot->GetSolution(2).GetValues() };
 	int nSize = (int)m_vVertices.size();
+	#pragma omp parallel for
 	for ( int i = 0; i < nSize; ++i ) {
 		VtxInfo & vi = m_vVertices[i];
 		int ri = 3*i;
 		Wml::Vector3f vFrameV[3];
 		for ( int k = 0; k < 3; ++k ) {
-			vFrameV[k] = Wml::Vector3f((float)pSystemRot->GetSolution(ri+k,0), (float)pSystemRot->GetSolution(ri+k,1), (float)pSystemRot->GetSolution(ri+k,2) );
+			vFrameV[k] = Wml::Vector3f( (float)pSolRot[0][ri+k], (float)pSolRot[1][ri+k], (float)pSolRot[2][ri+k] );
 			vFrameV[k].Normalize();
 		}
 		Wml::Vector3f vA = vFrameV[1].Cross(vFrameV[2]);
@@ -635,16 +574,20 @@ void RotInvCoordDeformer::Solve()
 		vi.vTransFrame.SetFrame( vA, vB, vFrameV[2] );
 	}
 
-
+	// stage 2: solve for positions
 	UpdateRHSPos();
 	bool bOK = GetSolverPos()->Solve();
 	if ( ! bOK )
 		lgBreakToDebugger();
 
 	gsi::SparseLinearSystem * pSystem = GetSystemPos();
+	const double * pSolPos[3] = { pSystem->GetSolution(0).GetValues(), 
+		pSystem->GetSolution(1).GetValues(), pSystem->GetSolution(2).GetValues() };
 	int nMatrixCols = (int)m_vVertices.size();
+	m_pMesh->DetachSnapshots();		// parallel SetVertex() needs unshared storage
+	#pragma omp parallel for
 	for ( int i = 0; i < nMatrixCols; ++i ) {
-		Wml::Vector3f v((float)pSystem->GetSolution(i,0), (float)pSystem->GetSolution(i,1), (float)pSystem->GetSolution(i,2) );
+		Wml::Vector3f v( (float)pSolPos[0][i], (float)pSolPos[1][i], (float)pSolPos[2][i] );
 		m_pMesh->SetVertex(i, v);
 	}
 
@@ -655,11 +598,20 @@ void RotInvCoordDeformer::Solve()
 float RotInvCoordDeformer::GetLaplacianError()
 {
 	float fErr = 0.0f;
-	unsigned int nVerts = m_pMesh->GetMaxVertexID();
-	for ( unsigned int i = 0; i < nVerts; ++i ) {
-		VtxInfo & vi = m_vVertices[i];
-		Wml::Vector3f vCurLaplacian = MeshUtils::MeshLaplacian(*m_pMesh, vi.vID, vi.vNbrs, vi.vNbrWeights);
-		Wml::Vector3f vWantLaplacian = vi.vLaplacian * GlobalScale() * vi.fVertexScale;
+	int nVerts = (int)m_vVertices.size();
+	float fGlobalScale = GlobalScale();
+	#pragma omp parallel for reduction(+:fErr)
+	for ( int i = 0; i < nVerts; ++i ) {
+		const VtxInfo & vi = m_vVertices[i];
+
+		// apply cached laplacian operator to current positions
+		const Wml::Vector3f & vCenter = m_pMesh->GetVertex(vi.vID);
+		Wml::Vector3f vCurLaplacian(Wml::Vector3f::ZERO);
+		unsigned int nEnd = m_vLsRowStart[i+1];
+		for ( unsigned int k = m_vLsRowStart[i]; k < nEnd; ++k )
+			vCurLaplacian += m_vLsWeights[k] * ( m_pMesh->GetVertex(m_vLsNbrs[k]) - vCenter );
+
+		Wml::Vector3f vWantLaplacian = vi.vLaplacian * fGlobalScale * vi.fVertexScale;
 		//fErr += (vCurLaplacian-vWantLaplacian).SquaredLength();
 		vCurLaplacian.Normalize();
 		vWantLaplacian.Normalize();
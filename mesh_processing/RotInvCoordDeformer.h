@@ -32,7 +32,7 @@ public:
 	
 	virtual void AddBoundaryConstraints(float fWeight = 1.0f);
 
-	virtual void ClearConstraints() { m_vPosConstraints.resize(0); m_vRotConstraints.resize(0); }
+	virtual void ClearConstraints();
 
 	virtual void UpdatePositionConstraint( IMesh::VertexID vID, const Wml::Vector3f & vPosition, float fWeight );
 	virtual void UpdateOrientationConstraint( IMesh::VertexID vID, const rms::Frame3f & vFrame, float fWeight );
@@ -45,6 +45,7 @@ public:
 
 	virtual void Solve();
 
+	//! evaluated with the same cached laplacian operator that Solve() uses
 	float GetLaplacianError();
 
 	virtual void DebugRender();
@@ -54,8 +55,6 @@ protected:
 
 	struct VtxInfo {
 		IMesh::VertexID vID;
-		std::vector<IMesh::VertexID> vNbrs;
-		std::vector<float> vNbrWeights;
 		float fVertexArea;
 		float fVertexWeight;
 		float fVertexScale;
@@ -75,6 +74,16 @@ protected:
 	float m_fAvgVtxArea;
 	void ComputeWeights();
 
+	// cotangent laplacian operator, flattened into CSR arrays (row i spans [m_vLsRowStart[i], m_vLsRowStart[i+1]) ).
+	// Built once in ComputeWeights() and shared by matrix assembly, RHS assembly and GetLaplacianError()
+	std::vector<unsigned int> m_vLsRowStart;
+	std::vector<IMesh::VertexID> m_vLsNbrs;
+	std::vector<float> m_vLsWeights;
+	std::vector<float> m_vLsWeightSum;
+
+	//! scaled, frame-transformed laplacians (input to position RHS)
+	std::vector<Wml::Vector3f> m_vScaledLaplacians;
+
 
 	struct RotConstraint {
 		IMesh::VertexID vID;
@@ -109,9 +118,16 @@ protected:
 	gsi::SparseMatrix * m_pLs;
 	gsi::SparseMatrix * m_pM;
 	gsi::Vector       * m_pRHSPos;
+	gsi::Vector       * m_pRHSRot;
 
-	bool m_bMatricesValid;
+	// The two systems are invalidated separately, so that (eg) changing a position-constraint
+	// weight does not throw away the cached factorization of the orientation system.
+	bool m_bRotMatrixValid;
+	bool m_bPosMatrixValid;
+	void InvalidateMatrices() { m_bRotMatrixValid = m_bPosMatrixValid = false; }
 	void UpdateMatrices();
+	void UpdateMatrixRot();
+	void UpdateMatrixPos();
 
 	void UpdateRHSRot();
 	void UpdateRHSPos();
@@ -957,16 +957,24 @@ struct memorypool {
 
 /* Global constants.                                                         */
 
-REAL splitter;       /* Used to split REAL factors for exact multiplication. */
-REAL epsilon;                             /* Floating-point machine epsilon. */
-REAL resulterrbound;
-REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
-REAL iccerrboundA, iccerrboundB, iccerrboundC;
-REAL o3derrboundA, o3derrboundB, o3derrboundC;
+/* [RMS] these are the only globals, and every triangulate() re-initializes them. Thread-local, so    */
+/*   that Triangulator2D::Compute() can run on several threads at once (with deterministic output).  */
+#ifdef _MSC_VER
+#define TRI_THREAD_LOCAL __declspec(thread)
+#else
+#define TRI_THREAD_LOCAL __thread
+#endif
+
+TRI_THREAD_LOCAL REAL splitter;       /* Used to split REAL factors for exact multiplication. */
+TRI_THREAD_LOCAL REAL epsilon;                             /* Floating-point machine epsilon. */
+TRI_THREAD_LOCAL REAL resulterrbound;
+TRI_THREAD_LOCAL REAL ccwerrboundA, ccwerrboundB, ccwerrboundC;
+TRI_THREAD_LOCAL REAL iccerrboundA, iccerrboundB, iccerrboundC;
+TRI_THREAD_LOCAL REAL o3derrboundA, o3derrboundB, o3derrboundC;
 
 /* Random number seed is not constant, but I've made it global anyway.       */
 
-unsigned long randomseed;                     /* Current random number seed. */
+TRI_THREAD_LOCAL unsigned long randomseed;                     /* Current random number seed. */
 
 
 /* Mesh data structure.  Triangle operates on only one mesh, but the mesh    */
@@ -16351,6 +16359,7 @@ Triangulator2D::Triangulator2D(void)
 	m_bNoSubdivdeOuterSegments = true;
 	m_bNoSubdivideAnySegments = false;
 	m_bEnclosingSegmentsProvided = false;
+	m_bVerbose = true;
 }
 
 Triangulator2D::~Triangulator2D(void)
@@ -16438,7 +16447,8 @@ bool Triangulator2D::Compute()
 {
 	struct triangulateio in;
 
-	_RMSInfo("[Triangulator2D] Compute()  :  passing %d points and %d segments\n", m_input.vPoints.size()/2, m_input.vSegments.size()/2);
+	if ( m_bVerbose )
+		_RMSInfo("[Triangulator2D] Compute()  :  passing %d points and %d segments\n", m_input.vPoints.size()/2, m_input.vSegments.size()/2);
 
 	in.numberofpoints = (int)m_input.vPoints.size() / 2;
 	in.pointlist = & m_input.vPoints[0];
@@ -16518,6 +16528,7 @@ bool Triangulator2D::Compute()
 
 	//sFlags += "VV";
 
+	// triangle.c globals are thread-local (see TRI_THREAD_LOCAL), so concurrent runs don't interfere
 	bool bFailed = false;
 	try {
 		char * pFlags = const_cast<char *>( sFlags.c_str() );
@@ -16526,7 +16537,8 @@ bool Triangulator2D::Compute()
 		// code 10101 == max iteration counter in mergehulls() is too small
 		//delete e;
 		bFailed = true;
-		_RMSInfo("Caught exception!\n");
+		if ( m_bVerbose )
+			_RMSInfo("Caught exception!\n");
 	}
 	if ( bFailed )
 		return false;
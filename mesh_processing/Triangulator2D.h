@@ -44,18 +44,23 @@ public:
 
 	void InitializeFromMesh( VFTriangleMesh & mesh, const std::vector<bool> & vBoundaryVerts );
 
+	//! can be called on different Triangulator2D objects from several threads at once
 	bool Compute();
 
 	//! if bCompact is true, will rewrite mesh to skip vertices which are not used in triangles
 	void MakeTriMesh( IMesh & mesh, const Wml::Vector3f * pSetNormal = NULL, int nCoordU = 0, int nCoordV = 1, bool bCompact = false );
 
 	int GetOutputMarker_MeshVtx( IMesh::VertexID vID );
+	const OutputData_CDT & GetOutputData() const { return m_output; }
 	const std::vector<int> & GetOutputMarkers_MeshVtx() { return m_VtxMarkers; }
 
 	void SetSubdivideOuterSegments( bool bAllowSubdiv ) { m_bNoSubdivdeOuterSegments = ! bAllowSubdiv; }
 	void SetSubdivideAnySegments( bool bAllowSubdiv ) { m_bNoSubdivideAnySegments = ! bAllowSubdiv; }
 	void SetEnclosingSegmentsProvided( bool bProvided ) { m_bEnclosingSegmentsProvided = bProvided; }
 
+	//! if false, Compute() does not log (eg when triangulating many small regions)
+	void SetVerbose( bool bVerbose ) { m_bVerbose = bVerbose; }
+
 protected:
 	InputData m_input;
 	OutputData_CDT m_output;
@@ -66,6 +71,7 @@ protected:
 	bool m_bEnclosingSegmentsProvided;
 	bool m_bNoSubdivdeOuterSegments;
 	bool m_bNoSubdivideAnySegments;
+	bool m_bVerbose;
 
 
 
@@ -0,0 +1,313 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "PointSetFitting.h"
+#include "SymmetricEigen3.h"
+#include "VectorUtil.h"
+#include <algorithm>
+
+using namespace rms;
+
+
+void PointSetFitting::InitializeGrid( ParticleGrid<unsigned int> & grid, const std::vector<Wml::Vector3f> & vPoints, float fRadius )
+{
+	Wml::AxisAlignedBox3f bounds;
+	size_t nCount = vPoints.size();
+	for ( unsigned int i = 0; i < nCount; ++i ) {
+		if ( i == 0 )
+			bounds = Wml::AxisAlignedBox3f( vPoints[i].X(), vPoints[i].X(), vPoints[i].Y(), vPoints[i].Y(), vPoints[i].Z(), vPoints[i].Z() );
+		else
+			rms::Union( bounds, vPoints[i] );
+	}
+	grid.Initialize( (nCount > 0) ? rms::Center(bounds) : Wml::Vector3f::ZERO, fRadius );
+	for ( unsigned int i = 0; i < nCount; ++i )
+		grid.AddParticle( i, vPoints[i] );
+}
+
+
+void PointSetFitting::FindNeighbours( const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+									  Neighbourhoods & nbrs, WeightMode eWeights )
+{
+	ParticleGrid<unsigned int> grid;
+	InitializeGrid( grid, vPoints, fRadius );
+	FindNeighbours( grid, vPoints, fRadius, nMaxK, nbrs, eWeights );
+}
+
+
+// (squared distance, index) for all points within fRadius of vPoints[i], truncated to the nMaxK nearest
+static void GatherNeighbours( ParticleGrid<unsigned int> & grid, const std::vector<Wml::Vector3f> & vPoints, unsigned int i,
+							  float fRadius, unsigned int nMaxK, std::vector< std::pair<float,unsigned int> > & vFound )
+{
+	float fRadiusSqr = fRadius*fRadius;
+	vFound.resize(0);
+	ParticleGrid<unsigned int>::BoxIterator itr( &grid, vPoints[i], fRadius );
+	while ( ! itr.Done() ) {
+		unsigned int j = *itr;
+		++itr;
+		float fDistSqr = (vPoints[j] - vPoints[i]).SquaredLength();
+		if ( fDistSqr <= fRadiusSqr )
+			vFound.push_back( std::pair<float,unsigned int>(fDistSqr, j) );
+	}
+	if ( nMaxK > 0 && vFound.size() > nMaxK ) {
+		std::nth_element( vFound.begin(), vFound.begin() + nMaxK, vFound.end() );
+		vFound.resize(nMaxK);
+	}
+}
+
+
+void PointSetFitting::FindNeighbours( ParticleGrid<unsigned int> & grid, const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+									  Neighbourhoods & nbrs, WeightMode eWeights )
+{
+	int nCount = (int)vPoints.size();
+	nbrs.vStart.resize(0);
+	nbrs.vStart.resize(nCount+1, 0);
+
+	// two passes (count, then fill) so that memory is bounded by the output size.
+	// Grid queries only read the grid, so they are safe to run in parallel.
+	#pragma omp parallel
+	{
+		std::vector< std::pair<float,unsigned int> > vFound;
+		#pragma omp for schedule(dynamic,256)
+		for ( int i = 0; i < nCount; ++i ) {
+			GatherNeighbours( grid, vPoints, (unsigned int)i, fRadius, nMaxK, vFound );
+			nbrs.vStart[i+1] = (unsigned int)vFound.size();
+		}
+	}
+	for ( int i = 0; i < nCount; ++i )
+		nbrs.vStart[i+1] += nbrs.vStart[i];
+
+	nbrs.vNbrs.resize( nbrs.vStart[nCount] );
+	nbrs.vWeights.resize(0);
+	if ( eWeights == GaussianWeights )
+		nbrs.vWeights.resize( nbrs.vStart[nCount] );
+	float fInvSigmaSqr = 4.0f / (fRadius*fRadius);
+
+	#pragma omp parallel
+	{
+		std::vector< std::pair<float,unsigned int> > vFound;
+		#pragma omp for schedule(dynamic,256)
+		for ( int i = 0; i < nCount; ++i ) {
+			GatherNeighbours( grid, vPoints, (unsigned int)i, fRadius, nMaxK, vFound );
+			unsigned int nStart = nbrs.vStart[i];
+			size_t nFound = vFound.size();
+			for ( unsigned int k = 0; k < nFound; ++k ) {
+				nbrs.vNbrs[nStart+k] = vFound[k].second;
+				if ( eWeights == GaussianWeights )
+					nbrs.vWeights[nStart+k] = exp( -vFound[k].first * fInvSigmaSqr );
+			}
+		}
+	}
+}
+
+
+
+void PointSetFitting::FitPlanes( const std::vector<Wml::Vector3f> & vPoints, const Neighbourhoods & nbrs, std::vector<PlaneFit> & vFits )
+{
+	int nCount = (int)vPoints.size();
+	vFits.resize(nCount);
+	bool bWeighted = ! nbrs.vWeights.empty();
+
+	// accumulate covariance matrices into SoA batch
+	SymmetricEigen3Batch eigen;
+	eigen.Resize(nCount);
+	float * pA[6];
+	for ( int k = 0; k < 6; ++k )
+		pA[k] = eigen.Matrix(k);
+
+	#pragma omp parallel for schedule(dynamic,256)
+	for ( int i = 0; i < nCount; ++i ) {
+		unsigned int nStart = nbrs.vStart[i], nEnd = nbrs.vStart[i+1];
+
+		double fWSum = 0, vMean[3] = {0,0,0};
+		for ( unsigned int k = nStart; k < nEnd; ++k ) {
+			double w = (bWeighted) ? nbrs.vWeights[k] : 1.0;
+			const Wml::Vector3f & v = vPoints[ nbrs.vNbrs[k] ];
+			fWSum += w;
+			for ( int j = 0; j < 3; ++j )
+				vMean[j] += w * v[j];
+		}
+		if ( fWSum > 0 )
+			for ( int j = 0; j < 3; ++j )
+				vMean[j] /= fWSum;
+
+		double C[6] = {0,0,0,0,0,0};
+		for ( unsigned int k = nStart; k < nEnd; ++k ) {
+			double w = (bWeighted) ? nbrs.vWeights[k] : 1.0;
+			const Wml::Vector3f & v = vPoints[ nbrs.vNbrs[k] ];
+			double dx = v[0]-vMean[0], dy = v[1]-vMean[1], dz = v[2]-vMean[2];
+			C[0] += w*dx*dx;  C[1] += w*dx*dy;  C[2] += w*dx*dz;
+			C[3] += w*dy*dy;  C[4] += w*dy*dz;  C[5] += w*dz*dz;
+		}
+		double fScale = (fWSum > 0) ? 1.0 / fWSum : 0.0;
+		for ( int j = 0; j < 6; ++j )
+			pA[j][i] = (float)(C[j] * fScale);
+
+		vFits[i].vCenter = Wml::Vector3f( (float)vMean[0], (float)vMean[1], (float)vMean[2] );
+	}
+
+	eigen.Compute();
+
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < nCount; ++i ) {
+		float fEval[3];
+		eigen.GetEigenvalues(i, fEval);
+		vFits[i].vNormal = eigen.GetEigenvector(i, 0);
+		vFits[i].vTangent1 = eigen.GetEigenvector(i, 2);
+		float fSum = fEval[0] + fEval[1] + fEval[2];
+		vFits[i].fVariation = (fSum > 0) ? std::max(fEval[0], 0.0f) / fSum : 0.0f;
+	}
+}
+
+
+void PointSetFitting::EstimateNormals( const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+									   std::vector<Wml::Vector3f> & vNormals, const std::vector<Wml::Vector3f> * pOrient )
+{
+	Neighbourhoods nbrs;
+	FindNeighbours( vPoints, fRadius, nMaxK, nbrs, GaussianWeights );
+	std::vector<PlaneFit> vFits;
+	FitPlanes( vPoints, nbrs, vFits );
+
+	int nCount = (int)vPoints.size();
+	vNormals.resize(nCount);
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < nCount; ++i ) {
+		vNormals[i] = vFits[i].vNormal;
+		if ( pOrient && vNormals[i].Dot( (*pOrient)[i] ) < 0 )
+			vNormals[i] = -vNormals[i];
+	}
+}
+
+
+
+
+// in-place Cholesky solve of 6x6 SPD system. returns false if not positive-definite
+static bool CholeskySolve6( double M[6][6], double b[6] )
+{
+	double fMaxDiag = 0;
+	for ( int i = 0; i < 6; ++i )
+		fMaxDiag = std::max(fMaxDiag, M[i][i]);
+	double fEps = fMaxDiag * 1e-12;
+
+	for ( int j = 0; j < 6; ++j ) {
+		double d = M[j][j];
+		for ( int k = 0; k < j; ++k )
+			d -= M[j][k]*M[j][k];
+		if ( d <= fEps )
+			return false;
+		M[j][j] = sqrt(d);
+		for ( int i = j+1; i < 6; ++i ) {
+			double s = M[i][j];
+			for ( int k = 0; k < j; ++k )
+				s -= M[i][k]*M[j][k];
+			M[i][j] = s / M[j][j];
+		}
+	}
+	for ( int i = 0; i < 6; ++i ) {
+		for ( int k = 0; k < i; ++k )
+			b[i] -= M[i][k]*b[k];
+		b[i] /= M[i][i];
+	}
+	for ( int i = 5; i >= 0; --i ) {
+		for ( int k = i+1; k < 6; ++k )
+			b[i] -= M[k][i]*b[k];
+		b[i] /= M[i][i];
+	}
+	return true;
+}
+
+
+void PointSetFitting::FitQuadrics( const std::vector<Wml::Vector3f> & vPoints, const Neighbourhoods & nbrs,
+								   const std::vector<PlaneFit> & vPlanes, std::vector<QuadricFit> & vFits )
+{
+	int nCount = (int)vPoints.size();
+	vFits.resize(nCount);
+	bool bWeighted = ! nbrs.vWeights.empty();
+
+	#pragma omp parallel for schedule(dynamic,256)
+	for ( int i = 0; i < nCount; ++i ) {
+		QuadricFit & fit = vFits[i];
+		fit.bValid = false;
+		for ( int k = 0; k < 6; ++k )
+			fit.fCoeffs[k] = 0;
+		fit.fK1 = fit.fK2 = 0;
+
+		const Wml::Vector3f & vN = vPlanes[i].vNormal;
+		Wml::Vector3f vT1( vPlanes[i].vTangent1 );
+		Wml::Vector3f vT2( vN.Cross(vT1) );
+		fit.vDir1 = vT1;  fit.vDir2 = vT2;
+
+		unsigned int nStart = nbrs.vStart[i], nEnd = nbrs.vStart[i+1];
+		if ( nEnd - nStart < 6 )
+			continue;
+
+		// scale local coords to unit size, for conditioning
+		double fScaleSqr = 0, fWSum = 0;
+		for ( unsigned int k = nStart; k < nEnd; ++k ) {
+			double w = (bWeighted) ? nbrs.vWeights[k] : 1.0;
+			fScaleSqr += w * (vPoints[nbrs.vNbrs[k]] - vPoints[i]).SquaredLength();
+			fWSum += w;
+		}
+		if ( fScaleSqr <= 0 || fWSum <= 0 )
+			continue;
+		double fScale = sqrt(fScaleSqr / fWSum), fInvScale = 1.0 / fScale;
+
+		double M[6][6], b[6];
+		for ( int r = 0; r < 6; ++r ) {
+			b[r] = 0;
+			for ( int c = 0; c < 6; ++c )
+				M[r][c] = 0;
+		}
+		for ( unsigned int k = nStart; k < nEnd; ++k ) {
+			double w = (bWeighted) ? nbrs.vWeights[k] : 1.0;
+			Wml::Vector3f d( vPoints[nbrs.vNbrs[k]] - vPoints[i] );
+			double x = d.Dot(vT1) * fInvScale, y = d.Dot(vT2) * fInvScale, z = d.Dot(vN) * fInvScale;
+			double basis[6] = { 1, x, y, x*x, x*y, y*y };
+			for ( int r = 0; r < 6; ++r ) {
+				b[r] += w * basis[r] * z;
+				for ( int c = 0; c <= r; ++c )
+					M[r][c] += w * basis[r] * basis[c];
+			}
+		}
+		for ( int r = 0; r < 6; ++r )
+			for ( int c = r+1; c < 6; ++c )
+				M[r][c] = M[c][r];
+		if ( ! CholeskySolve6( M, b ) )
+			continue;
+
+		// undo scaling: z/s = f(x/s, y/s)
+		double c[6] = { b[0]*fScale, b[1], b[2], b[3]*fInvScale, b[4]*fInvScale, b[5]*fInvScale };
+		for ( int k = 0; k < 6; ++k )
+			fit.fCoeffs[k] = (float)c[k];
+
+		// shape operator I^-1 II of the height field at (0,0)
+		double fx = c[1], fy = c[2], fxx = 2*c[3], fxy = c[4], fyy = 2*c[5];
+		double E = 1 + fx*fx, F = fx*fy, G = 1 + fy*fy;
+		double fInvDenom = 1.0 / sqrt(1 + fx*fx + fy*fy);
+		double L = fxx*fInvDenom, Mc = fxy*fInvDenom, N = fyy*fInvDenom;
+		double fInvDet = 1.0 / (E*G - F*F);
+		double S00 = (G*L - F*Mc) * fInvDet, S01 = (G*Mc - F*N) * fInvDet;
+		double S10 = (E*Mc - F*L) * fInvDet, S11 = (E*N - F*Mc) * fInvDet;
+
+		double fHalfTrace = 0.5 * (S00 + S11);
+		double fDisc = fHalfTrace*fHalfTrace - (S00*S11 - S01*S10);
+		double fRoot = sqrt( std::max(fDisc, 0.0) );
+		double k1 = fHalfTrace + fRoot, k2 = fHalfTrace - fRoot;
+		fit.fK1 = (float)k1;  fit.fK2 = (float)k2;
+		fit.bValid = true;
+
+		// principal direction for k1 in (x,y) parameter space, mapped to surface tangent. Umbilics keep (T1,T2)
+		double u1 = S01, v1 = k1 - S00;
+		double u2 = k1 - S11, v2 = S10;
+		if ( u2*u2 + v2*v2 > u1*u1 + v1*v1 ) {
+			u1 = u2;  v1 = v2;
+		}
+		if ( u1*u1 + v1*v1 > 1e-20 ) {
+			Wml::Vector3f vXu( vT1 + (float)fx * vN ), vXv( vT2 + (float)fy * vN );
+			Wml::Vector3f vDir( (float)u1 * vXu + (float)v1 * vXv );
+			vDir.Normalize();
+			fit.vDir1 = vDir;
+			fit.vDir2 = vN.Cross(vDir);
+		}
+	}
+}
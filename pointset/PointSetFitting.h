@@ -0,0 +1,82 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include "config.h"
+#include <vector>
+#include <Wm4Vector3.h>
+#include "ParticleGrid.h"
+
+namespace rms {
+
+/*
+ * Batched local fits over point neighbourhoods (normal estimation for raw point sets,
+ * curvature estimation). Neighbourhoods are found with a ParticleGrid radius query,
+ * optionally truncated to the k nearest. Plane fits accumulate all covariance matrices
+ * first and then solve them together with SymmetricEigen3Batch.
+ */
+class PointSetFitting
+{
+public:
+
+	enum WeightMode {
+		UniformWeights,
+		GaussianWeights			//! exp( -d^2 / (r/2)^2 )
+	};
+
+	//! neighbourhoods in CSR form: neighbours of point i are vNbrs[ vStart[i] .. vStart[i+1] ), including i itself
+	struct Neighbourhoods {
+		std::vector<unsigned int> vStart;
+		std::vector<unsigned int> vNbrs;
+		std::vector<float> vWeights;		//! parallel to vNbrs, empty for uniform weights
+
+		unsigned int Count( unsigned int i ) const { return vStart[i+1] - vStart[i]; }
+	};
+
+	//! radius query, keeping at most nMaxK nearest points (nMaxK == 0 keeps all)
+	static void FindNeighbours( const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+								Neighbourhoods & nbrs, WeightMode eWeights = GaussianWeights );
+
+	//! same, using an existing grid of point indices (cell size should be >= fRadius/2 for efficiency)
+	static void FindNeighbours( ParticleGrid<unsigned int> & grid, const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+								Neighbourhoods & nbrs, WeightMode eWeights = GaussianWeights );
+
+	//! initialize grid over points, with cell size fRadius
+	static void InitializeGrid( ParticleGrid<unsigned int> & grid, const std::vector<Wml::Vector3f> & vPoints, float fRadius );
+
+
+
+	struct PlaneFit {
+		Wml::Vector3f vCenter;		//! weighted centroid of neighbourhood
+		Wml::Vector3f vNormal;		//! eigenvector of smallest eigenvalue (sign is arbitrary)
+		Wml::Vector3f vTangent1;	//! largest-variance direction
+		float fVariation;			//! surface variation l0 / (l0+l1+l2), 0 for perfectly planar neighbourhood
+	};
+
+	//! weighted least-squares plane at each point
+	static void FitPlanes( const std::vector<Wml::Vector3f> & vPoints, const Neighbourhoods & nbrs, std::vector<PlaneFit> & vFits );
+
+	//! normals for a raw point set. If pOrient is non-null, each normal is flipped to agree with (*pOrient)[i]
+	static void EstimateNormals( const std::vector<Wml::Vector3f> & vPoints, float fRadius, unsigned int nMaxK,
+								 std::vector<Wml::Vector3f> & vNormals, const std::vector<Wml::Vector3f> * pOrient = NULL );
+
+
+
+	//! height-field quadric z = c0 + c1*x + c2*y + c3*x^2 + c4*x*y + c5*y^2, in the frame (vTangent1, vNormal x vTangent1, vNormal) of the plane fit
+	struct QuadricFit {
+		bool bValid;				//! false if neighbourhood has < 6 points or is degenerate
+		float fCoeffs[6];
+		float fK1, fK2;				//! principal curvatures at the point, fK1 >= fK2
+		Wml::Vector3f vDir1, vDir2;	//! principal directions
+	};
+
+	//! weighted quadric at each point, in the frame of vPlanes[i] (from FitPlanes) and centered at vPoints[i]
+	static void FitQuadrics( const std::vector<Wml::Vector3f> & vPoints, const Neighbourhoods & nbrs,
+							 const std::vector<PlaneFit> & vPlanes, std::vector<QuadricFit> & vFits );
+};
+
+
+
+}   // end namespace rms
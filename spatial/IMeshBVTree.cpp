@@ -5,11 +5,15 @@
 #include "IMeshBVTree.h"
 
 #include <limits>
-#include <Wm4IntrRay3Triangle3.h>
-#include <Wm4DistVector3Triangle3.h>
+#include <algorithm>
 #include <Wm4DistVector3Line3.h>
 
 #include "VectorUtil.h"
+#include "TriangleIntersection.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace rms;
 
@@ -71,11 +75,11 @@ bool IMeshBVTree::FindRayIntersection( IMeshBVTree::IMeshBVNode * pNode, Ray & r
 		if ( bInside || (bHit && fNear < fNearest) ) {
 
 			// ok, hit box, now try the triangle
-			Wml::Triangle3f tri;
-			m_pMesh->GetTriangle(pNode->GetTriangleID(), tri.V);
-			Wml::IntrRay3Triangle3f intr(ray.wmlRay, tri);
-			if ( intr.Find() == true ) {
-				Wml::Vector3f vTmp = ray.origin + intr.GetRayT() * ray.direction;
+			Wml::Vector3f vTri[3];
+			m_pMesh->GetTriangle(pNode->GetTriangleID(), vTri);
+			float fT, fU, fV;
+			if ( RayTriangleIntersect( ray.origin, ray.direction, vTri[0], vTri[1], vTri[2], fT, fU, fV ) ) {
+				Wml::Vector3f vTmp = ray.origin + fT * ray.direction;
 				float fDist = (vTmp - ray.origin).Length();
 				if ( fDist < fNearest ) {
 					fNearest = fDist;
@@ -86,6 +90,29 @@ bool IMeshBVTree::FindRayIntersection( IMeshBVTree::IMeshBVNode * pNode, Ray & r
 			}
 		}
 
+	} else if ( pNode->IsPacket() ) {
+		if ( bInside || (bHit && fNear < fNearest) ) {
+
+			// test all triangles of small node at once
+			const TrianglePacket4 & packet = GetPacket(pNode);
+			float vT[PacketSize], vU[PacketSize], vV[PacketSize];
+			int nMask = RayTrianglePacketIntersect( ray.origin, ray.direction, packet, vT, vU, vV );
+			bool bFound = false;
+			for ( int i = 0; i < packet.nCount; ++i ) {
+				if ( (nMask & (1<<i)) == 0 )
+					continue;
+				Wml::Vector3f vTmp = ray.origin + vT[i] * ray.direction;
+				float fDist = (vTmp - ray.origin).Length();
+				if ( fDist < fNearest ) {
+					fNearest = fDist;
+					vHit = vTmp;
+					nHitTri = m_vPacketTris[ pNode->nPacket*PacketSize + i ];
+					bFound = true;
+				}
+			}
+			return bFound;
+		}
+
 	} else { 
 		if ( bInside || (bHit && fNear < fNearest) ) {
 
@@ -123,6 +150,18 @@ bool IMeshBVTree::FindNearest( const Wml::Vector3f & vPoint, Wml::Vector3f & vNe
 }
 
 
+bool IMeshBVTree::FindNearest( const Wml::Vector3f & vPoint, float fMaxDistance, Wml::Vector3f & vNearest, IMesh::TriangleID & nNearestTri, float & fDistance )
+{
+	if ( m_pRoot == NULL )
+		Initialize();
+	if ( ! m_pRoot )
+		return false;
+
+	fDistance = fMaxDistance;
+	return FindNearest( m_pRoot, vPoint, vNearest, fDistance, nNearestTri );
+}
+
+
 bool IMeshBVTree::FindNearestVtx( const Wml::Vector3f & vPoint, IMesh::VertexID & nNearestVtx )
 {
 	m_fLastQueryDistance = std::numeric_limits<float>::max();
@@ -150,6 +189,136 @@ bool IMeshBVTree::FindNearestVtx( const Wml::Vector3f & vPoint, IMesh::VertexID
 }
 
 
+bool IMeshBVTree::IsInside( const Wml::Vector3f & vPoint )
+{
+	// directions are off-axis, so rays don't run along the axis-aligned edges and faces of CAD models
+	static const float vDirections[3][3] = {
+		{ 0.5469f, 0.7164f, 0.4330f }, { -0.6713f, 0.2896f, 0.6822f }, { 0.1818f, -0.8457f, -0.5017f } };
+
+	int nInside = 0;
+	for ( int k = 0; k < 3; ++k ) {
+		Wml::Vector3f vDirection( vDirections[k][0], vDirections[k][1], vDirections[k][2] );
+		vDirection.Normalize();
+		Wml::Vector3f vHit;  IMesh::TriangleID tID;
+		if ( ! FindRayIntersection( vPoint, vDirection, vHit, tID ) )
+			continue;
+		Wml::Vector3f vTri[3];
+		m_pMesh->GetTriangle( tID, vTri );
+		Wml::Vector3f vNormal( (vTri[1] - vTri[0]).Cross( vTri[2] - vTri[0] ) );
+		if ( vNormal.Dot(vDirection) > 0 )
+			++nInside;
+	}
+	return nInside >= 2;
+}
+
+
+bool IMeshBVTree::TestOcclusion( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection, float fMaxT )
+{
+	unsigned char bOccluded = 0;
+	TestOcclusion( &vOrigin, &vDirection, 1, fMaxT, &bOccluded );
+	return bOccluded != 0;
+}
+
+
+void IMeshBVTree::TestOcclusion( const Wml::Vector3f * pOrigins, const Wml::Vector3f * pDirections, unsigned int nRays,
+								 float fMaxT, unsigned char * pOccluded )
+{
+	if ( m_pRoot == NULL )
+		Initialize();
+	for ( unsigned int i = 0; i < nRays; ++i )
+		pOccluded[i] = 0;
+	if ( ! m_pRoot || nRays == 0 )
+		return;
+
+	std::vector<Ray> vRays;
+	vRays.reserve(nRays);
+	std::vector<unsigned int> vActive(nRays);
+	for ( unsigned int i = 0; i < nRays; ++i ) {
+		vRays.push_back( Ray( pOrigins[i], pDirections[i] ) );
+		vActive[i] = i;
+	}
+	TestOcclusion( m_pRoot, vRays, &vActive[0], nRays, fMaxT, pOccluded );
+}
+
+
+bool IMeshBVTree::TestOverlap( IMeshBVTree::IMeshBVNode * pNode, const Ray & r, float fMaxT )
+{
+	float t0 = 0, t1 = fMaxT;
+	for ( int k = 0; k < 3; ++k ) {
+		float tNear = ( (r.sign[k] ? pNode->Box.Max[k] : pNode->Box.Min[k]) - r.origin[k] ) * r.inv_direction[k];
+		float tFar = ( (r.sign[k] ? pNode->Box.Min[k] : pNode->Box.Max[k]) - r.origin[k] ) * r.inv_direction[k];
+		if ( tNear > t0 )
+			t0 = tNear;
+		if ( tFar < t1 )
+			t1 = tFar;
+		if ( t0 > t1 )
+			return false;
+	}
+	return true;
+}
+
+
+void IMeshBVTree::TestOcclusion( IMeshBVTree::IMeshBVNode * pNode, std::vector<Ray> & vRays, unsigned int * pActive, unsigned int nActive,
+								 float fMaxT, unsigned char * pOccluded )
+{
+	// move the rays that are still open and hit the box to the front
+	unsigned int nHit = 0;
+	for ( unsigned int i = 0; i < nActive; ++i ) {
+		unsigned int k = pActive[i];
+		if ( pOccluded[k] )
+			continue;
+		if ( TestOverlap(pNode, vRays[k], fMaxT) )
+			std::swap( pActive[nHit++], pActive[i] );
+	}
+	if ( nHit == 0 )
+		return;
+
+	if ( pNode->IsLeaf() ) {
+		Wml::Vector3f vTri[3];
+		m_pMesh->GetTriangle(pNode->GetTriangleID(), vTri);
+		for ( unsigned int i = 0; i < nHit; ++i ) {
+			Ray & ray = vRays[ pActive[i] ];
+			float fT, fU, fV;
+			if ( RayTriangleIntersect( ray.origin, ray.direction, vTri[0], vTri[1], vTri[2], fT, fU, fV ) && fT < fMaxT )
+				pOccluded[ pActive[i] ] = 1;
+		}
+
+	} else if ( pNode->IsPacket() ) {
+		const TrianglePacket4 & packet = GetPacket(pNode);
+		float vT[PacketSize], vU[PacketSize], vV[PacketSize];
+		for ( unsigned int i = 0; i < nHit; ++i ) {
+			Ray & ray = vRays[ pActive[i] ];
+			int nMask = RayTrianglePacketIntersect( ray.origin, ray.direction, packet, vT, vU, vV );
+			for ( int j = 0; j < packet.nCount; ++j ) {
+				if ( (nMask & (1<<j)) && vT[j] < fMaxT ) {
+					pOccluded[ pActive[i] ] = 1;
+					break;
+				}
+			}
+		}
+
+	} else {
+		if ( pNode->HasChildren() == false ) 
+			ExpandNode( pNode );
+		lgASSERT( pNode->pLeft && pNode->pRight );
+
+		// nearby geometry is the most likely occluder, so descend into the child whose box center is closer to the (first) origin first
+		const Wml::Vector3f & vOrigin = vRays[ pActive[0] ].origin;
+		IMeshBVNode * pFirst = pNode->pLeft, * pSecond = pNode->pRight;
+		float fFirst = 0, fSecond = 0;
+		for ( int k = 0; k < 3; ++k ) {
+			float d1 = pFirst->Box.Min[k] + pFirst->Box.Max[k] - 2*vOrigin[k];
+			float d2 = pSecond->Box.Min[k] + pSecond->Box.Max[k] - 2*vOrigin[k];
+			fFirst += d1*d1;  fSecond += d2*d2;
+		}
+		if ( fSecond < fFirst )
+			std::swap( pFirst, pSecond );
+		TestOcclusion( pFirst, vRays, pActive, nHit, fMaxT, pOccluded );
+		TestOcclusion( pSecond, vRays, pActive, nHit, fMaxT, pOccluded );
+	}
+}
+
+
 bool IMeshBVTree::FindNearest( IMeshBVTree::IMeshBVNode * pNode, const Wml::Vector3f & vPoint, 
 							   Wml::Vector3f & vNearest, float & fNearest, IMesh::TriangleID & nNearestTri )
 {
@@ -160,20 +329,35 @@ bool IMeshBVTree::FindNearest( IMeshBVTree::IMeshBVNode * pNode, const Wml::Vect
 		if ( (fDistance = MinDistance(pNode,vPoint)) < fNearest ) {
 
 			// ok, hit box, now try the triangle
-			Wml::Triangle3f tri;
-			m_pMesh->GetTriangle(pNode->GetTriangleID(), tri.V);
-			Wml::DistVector3Triangle3f dist(vPoint, tri);
-			float fTriDist = dist.Get();
+			Wml::Vector3f vTri[3];
+			m_pMesh->GetTriangle(pNode->GetTriangleID(), vTri);
+			float fBary[3];
+			float fTriDist = (float)sqrt( PointTriangleSqrDistance( vPoint, vTri[0], vTri[1], vTri[2], fBary ) );
 			if ( fTriDist < fNearest ) {
 				fNearest = fTriDist;
-				vNearest = Wml::Vector3f::ZERO;
-				for ( int j = 0 ; j < 3; ++j ) 
-					vNearest += tri.V[j] * dist.GetTriangleBary(j);
+				vNearest = fBary[0]*vTri[0] + fBary[1]*vTri[1] + fBary[2]*vTri[2];
 				nNearestTri = pNode->GetTriangleID();
 				return true;
 			}
 		}
 
+	} else if ( pNode->IsPacket() ) {
+		if ( (fDistance = MinDistance(pNode,vPoint)) < fNearest ) {
+
+			// test all triangles of small node at once
+			const TrianglePacket4 & packet = GetPacket(pNode);
+			float fSqrDist, fBary[3];
+			int i = PointTrianglePacketNearest( vPoint, packet, fSqrDist, fBary );
+			float fTriDist = (float)sqrt(fSqrDist);
+			if ( fTriDist < fNearest ) {
+				fNearest = fTriDist;
+				for ( int k = 0; k < 3; ++k )
+					vNearest[k] = packet.v0[k][i] + fBary[1]*packet.e1[k][i] + fBary[2]*packet.e2[k][i];
+				nNearestTri = m_vPacketTris[ pNode->nPacket*PacketSize + i ];
+				return true;
+			}
+		}
+
 	} else { 
 
 		if ( (fDistance = MinDistance(pNode,vPoint)) < fNearest ) {
@@ -205,8 +389,11 @@ void IMeshBVTree::ExpandAll()
 
 void IMeshBVTree::ExpandAll( IMeshBVTree::IMeshBVNode * pNode )
 {
-	if ( ! pNode->IsLeaf() ) {
-		ExpandNode(pNode);
+	if ( pNode->IsPacket() ) {
+		GetPacket(pNode);
+	} else if ( ! pNode->IsLeaf() ) {
+		if ( pNode->HasChildren() == false )
+			ExpandNode(pNode);
 		ExpandAll(pNode->pLeft);
 		ExpandAll(pNode->pRight);
 	}
@@ -216,6 +403,8 @@ void IMeshBVTree::ExpandAll( IMeshBVTree::IMeshBVNode * pNode )
 void IMeshBVTree::Clear()
 {
 	m_vTriangles.resize(0);
+	m_vPackets.resize(0);
+	m_vPacketTris.resize(0);
 	m_vNodePool.ClearAll();
 	m_pRoot = NULL;
 	m_nNodeIDGen = 1;
@@ -228,10 +417,36 @@ IMeshBVTree::IMeshBVNode * IMeshBVTree::GetNewNode()
 	pNode->ID = m_nNodeIDGen++;
 	pNode->pLeft = NULL;
 	pNode->pRight = NULL;
+	pNode->nCount = 0;
+	pNode->nPacket = IMesh::InvalidID;
 	pNode->SetTriangleID(0);
 	return pNode;
 }
 
+
+const TrianglePacket4 & IMeshBVTree::GetPacket( IMeshBVNode * pNode )
+{
+	if ( pNode->nPacket == IMesh::InvalidID ) {
+		pNode->nPacket = (unsigned int)m_vPackets.size();
+		m_vPackets.push_back( TrianglePacket4() );
+		TrianglePacket4 & packet = m_vPackets.back();
+
+		Wml::Vector3f vTri[3];
+		unsigned int nIndex = pNode->GetIndex();
+		while ( nIndex < m_nMaxTriangle ) {
+			IMesh::TriangleID tID = m_vTriangles[nIndex].triID;
+			m_pMesh->GetTriangle( tID, vTri );
+			packet.Append( vTri[0], vTri[1], vTri[2] );
+			m_vPacketTris.push_back( tID );
+			nIndex = GetNextEntryIdx(pNode, nIndex);
+		}
+		lgASSERT( packet.nCount == (int)pNode->nCount );
+		packet.Pad();
+		m_vPacketTris.resize( m_vPackets.size() * PacketSize, m_vPacketTris[pNode->nPacket*PacketSize] );
+	}
+	return m_vPackets[pNode->nPacket];
+}
+
 void IMeshBVTree::Initialize()
 {
 	Clear();
@@ -277,9 +492,11 @@ void IMeshBVTree::ComputeBox( IMeshBVNode * pNode )
 			vTri[0].X(), vTri[0].X(), vTri[0].Y(), vTri[0].Y(), vTri[0].Z(), vTri[0].Z() );
 		for ( int j = 1; j < 3; ++j )
 			pNode->Union( vTri[j] );
+		pNode->nCount = 1;
 
 	} else { 
 		unsigned int nIndex = pNode->GetIndex();
+		pNode->nCount = 1;
 
 		// initialize first box
 		m_pMesh->GetTriangle( m_vTriangles[nIndex].triID, vTri );
@@ -294,6 +511,7 @@ void IMeshBVTree::ComputeBox( IMeshBVNode * pNode )
 			m_pMesh->GetTriangle( m_vTriangles[nIndex].triID, vTri );
 			for ( int j = 0; j < 3; ++j )
 				pNode->Union( vTri[j] );
+			++pNode->nCount;
 			unsigned int nNextIdx = GetNextEntryIdx(pNode, nIndex);
 			nIndex = nNextIdx;
 		}
@@ -369,8 +587,8 @@ void IMeshBVTree::ExpandNode( IMeshBVTree::IMeshBVNode * pNode )
 	// handle bad case where some child ended up with no nodes
 	if ( nLeftCount == 0 || nRightCount == 0 ) {
 		IMeshBVNode * pUseNode = (nLeftCount == 0) ? pRight : pLeft;
-		int nLastLeft = -1;
-		int nLastRight = -1;
+		nLastLeft = -1;
+		nLastRight = -1;
 		nLeftCount = nRightCount = 0;
 
 		bool bLeft = true;
@@ -406,6 +624,10 @@ void IMeshBVTree::ExpandNode( IMeshBVTree::IMeshBVNode * pNode )
 	if( nLeftCount == 0 || nRightCount == 0 )
 		lgBreakToDebugger();
 
+	// terminate both entry lists, so that iterating over a node never has to scan past its last entry
+	m_vTriangles[ nLastLeft ].nJump = m_nMaxTriangle - nLastLeft;
+	m_vTriangles[ nLastRight ].nJump = m_nMaxTriangle - nLastRight;
+
 	// set leaf flags
 	if ( nLeftCount == 1 ) {
 		pLeft->SetTriangleID( m_vTriangles[pLeft->GetIndex()].triID );
@@ -431,9 +653,6 @@ IMeshBVTree::Ray::Ray( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDir
 	sign[0] = (inv_direction.X() < 0);
 	sign[1] = (inv_direction.Y() < 0);
 	sign[2] = (inv_direction.Z() < 0);	
-
-	wmlRay.Origin = vOrigin;
-	wmlRay.Direction = vDirection;
 }
 
 
@@ -494,3 +713,229 @@ float IMeshBVTree::MinDistance( IMeshBVNode * pNode, const Wml::Vector3f & vPoin
 	else
 		return (float)sqrt( fDist[0]*fDist[0] + fDist[1]*fDist[1] + fDist[2]*fDist[2] );
 }
+
+
+
+
+/*
+ * dual-tree overlap traversal
+ */
+
+namespace {
+inline bool BoxesOverlap( const Wml::AxisAlignedBox3f & a, const Wml::AxisAlignedBox3f & b )
+{
+	for ( int k = 0; k < 3; ++k ) {
+		if ( a.Max[k] < b.Min[k] || b.Max[k] < a.Min[k] )
+			return false;
+	}
+	return true;
+}
+
+inline bool PairLess( const IMeshBVTree::IntersectionPair & a, const IMeshBVTree::IntersectionPair & b )
+{
+	return ( a.tID1 < b.tID1 ) || ( a.tID1 == b.tID1 && a.tID2 < b.tID2 );
+}
+
+inline Wml::Vector3d ToDouble( const Wml::Vector3f & v )
+{
+	return Wml::Vector3d( v.X(), v.Y(), v.Z() );
+}
+inline Wml::Vector3f ToFloat( const Wml::Vector3d & v )
+{
+	return Wml::Vector3f( (float)v.X(), (float)v.Y(), (float)v.Z() );
+}
+}
+
+
+void IMeshBVTree::FindSelfIntersections( std::vector<IntersectionPair> & vPairs )
+{
+	FindIntersections( *this, vPairs );
+}
+
+void IMeshBVTree::FindIntersections( IMeshBVTree & other, std::vector<IntersectionPair> & vPairs )
+{
+	vPairs.resize(0);
+	bool bSelf = ( &other == this );
+
+	// nodes and packets are built lazily, so build them all now. After that the traversal only reads
+	ExpandAll();
+	if ( ! bSelf )
+		other.ExpandAll();
+	if ( m_pRoot == NULL || other.m_pRoot == NULL )
+		return;
+
+	std::vector<OverlapTask> vTasks;
+	FindOverlapTasks( other, bSelf, vTasks );
+
+	int nTasks = (int)vTasks.size();
+	#pragma omp parallel
+	{
+		std::vector<IntersectionPair> vLocalPairs;
+
+		#pragma omp for schedule(dynamic,1)
+		for ( int i = 0; i < nTasks; ++i )
+			FindOverlaps( other, bSelf, vTasks[i].pA, vTasks[i].pB, vLocalPairs );
+
+		#pragma omp critical(IMeshBVTree_FindIntersections)
+		{
+			vPairs.insert( vPairs.end(), vLocalPairs.begin(), vLocalPairs.end() );
+		}
+	}
+
+	std::sort( vPairs.begin(), vPairs.end(), PairLess );
+}
+
+
+unsigned int IMeshBVTree::GetNodeTriangles( IMeshBVNode * pNode, IMesh::TriangleID * pTris )
+{
+	if ( pNode->IsLeaf() ) {
+		pTris[0] = pNode->GetTriangleID();
+		return 1;
+	}
+	lgASSERT( pNode->IsPacket() && pNode->nPacket != IMesh::InvalidID );
+	for ( unsigned int i = 0; i < pNode->nCount; ++i )
+		pTris[i] = m_vPacketTris[ pNode->nPacket*PacketSize + i ];
+	return pNode->nCount;
+}
+
+
+void IMeshBVTree::FindOverlapTasks( IMeshBVTree & other, bool bSelf, std::vector<OverlapTask> & vTasks )
+{
+	int nThreads = 1;
+#ifdef _OPENMP
+	nThreads = omp_get_max_threads();
+#endif
+	size_t nTargetTasks = (nThreads > 1) ? 32 * nThreads : 1;
+
+	// breadth-first split of the upper levels: self(N) -> self(L), self(R), (L,R);  (A,B) -> split the larger node
+	OverlapTask root = { m_pRoot, other.m_pRoot };
+	vTasks.push_back(root);
+	bool bSplit = true;
+	while ( vTasks.size() < nTargetTasks && bSplit ) {
+		bSplit = false;
+		std::vector<OverlapTask> vNext;
+		for ( unsigned int i = 0; i < vTasks.size(); ++i ) {
+			IMeshBVNode * pA = vTasks[i].pA, * pB = vTasks[i].pB;
+			bool bTerminalA = pA->IsLeaf() || pA->IsPacket();
+			bool bTerminalB = pB->IsLeaf() || pB->IsPacket();
+			if ( bSelf && pA == pB ) {
+				if ( bTerminalA ) {
+					vNext.push_back(vTasks[i]);
+				} else {
+					OverlapTask left = { pA->pLeft, pA->pLeft }, right = { pA->pRight, pA->pRight }, cross = { pA->pLeft, pA->pRight };
+					vNext.push_back(left);  vNext.push_back(right);
+					if ( BoxesOverlap(pA->pLeft->Box, pA->pRight->Box) )
+						vNext.push_back(cross);
+					bSplit = true;
+				}
+			} else if ( bTerminalA && bTerminalB ) {
+				vNext.push_back(vTasks[i]);
+			} else {
+				bool bSplitA = bTerminalB || ( ! bTerminalA && pA->nCount >= pB->nCount );
+				OverlapTask t1 = { bSplitA ? pA->pLeft : pA, bSplitA ? pB : pB->pLeft };
+				OverlapTask t2 = { bSplitA ? pA->pRight : pA, bSplitA ? pB : pB->pRight };
+				if ( BoxesOverlap(t1.pA->Box, t1.pB->Box) )
+					vNext.push_back(t1);
+				if ( BoxesOverlap(t2.pA->Box, t2.pB->Box) )
+					vNext.push_back(t2);
+				bSplit = true;
+			}
+		}
+		vTasks.swap(vNext);
+	}
+}
+
+
+void IMeshBVTree::FindOverlaps( IMeshBVTree & other, bool bSelf, IMeshBVNode * pA, IMeshBVNode * pB, std::vector<IntersectionPair> & vPairs )
+{
+	bool bTerminalA = pA->IsLeaf() || pA->IsPacket();
+	bool bTerminalB = pB->IsLeaf() || pB->IsPacket();
+
+	if ( bSelf && pA == pB ) {
+		if ( bTerminalA ) {
+			IMesh::TriangleID vTris[PacketSize];
+			unsigned int nTris = GetNodeTriangles(pA, vTris);
+			for ( unsigned int i = 0; i < nTris; ++i )
+				for ( unsigned int j = i+1; j < nTris; ++j )
+					TestTrianglePair( other, bSelf, vTris[i], vTris[j], vPairs );
+		} else {
+			FindOverlaps( other, bSelf, pA->pLeft, pA->pLeft, vPairs );
+			FindOverlaps( other, bSelf, pA->pRight, pA->pRight, vPairs );
+			FindOverlaps( other, bSelf, pA->pLeft, pA->pRight, vPairs );
+		}
+		return;
+	}
+
+	if ( ! BoxesOverlap(pA->Box, pB->Box) )
+		return;
+
+	if ( bTerminalA && bTerminalB ) {
+		IMesh::TriangleID vTrisA[PacketSize], vTrisB[PacketSize];
+		unsigned int nTrisA = GetNodeTriangles(pA, vTrisA);
+		unsigned int nTrisB = other.GetNodeTriangles(pB, vTrisB);
+		for ( unsigned int i = 0; i < nTrisA; ++i )
+			for ( unsigned int j = 0; j < nTrisB; ++j )
+				TestTrianglePair( other, bSelf, vTrisA[i], vTrisB[j], vPairs );
+
+	} else if ( bTerminalB || ( ! bTerminalA && pA->nCount >= pB->nCount ) ) {
+		FindOverlaps( other, bSelf, pA->pLeft, pB, vPairs );
+		FindOverlaps( other, bSelf, pA->pRight, pB, vPairs );
+	} else {
+		FindOverlaps( other, bSelf, pA, pB->pLeft, vPairs );
+		FindOverlaps( other, bSelf, pA, pB->pRight, vPairs );
+	}
+}
+
+
+void IMeshBVTree::TestTrianglePair( IMeshBVTree & other, bool bSelf, IMesh::TriangleID tID1, IMesh::TriangleID tID2, std::vector<IntersectionPair> & vPairs )
+{
+	Wml::Vector3f vTri1f[3], vTri2f[3];
+	m_pMesh->GetTriangle(tID1, vTri1f);
+	other.m_pMesh->GetTriangle(tID2, vTri2f);
+	Wml::Vector3d vTri1[3], vTri2[3];
+	for ( int j = 0; j < 3; ++j ) {
+		vTri1[j] = ToDouble(vTri1f[j]);
+		vTri2[j] = ToDouble(vTri2f[j]);
+	}
+
+	// count shared vertices, and where they are in each triangle
+	int nShared = 0, nShared1[3], nShared2[3];
+	if ( bSelf ) {
+		IMesh::VertexID nTri1[3], nTri2[3];
+		m_pMesh->GetTriangle(tID1, nTri1);
+		m_pMesh->GetTriangle(tID2, nTri2);
+		for ( int i = 0; i < 3; ++i ) {
+			for ( int j = 0; j < 3; ++j ) {
+				if ( nTri1[i] == nTri2[j] ) {
+					nShared1[nShared] = i;
+					nShared2[nShared] = j;
+					++nShared;
+				}
+			}
+		}
+	}
+
+	Wml::Vector3d vSegment[2];
+	bool bCoplanar = false;
+	bool bHit = false;
+	if ( nShared == 2 ) {
+		int c = 3 - nShared1[0] - nShared1[1], d = 3 - nShared2[0] - nShared2[1];
+		bHit = IntersectTrianglesSharedEdge( vTri1[nShared1[0]], vTri1[nShared1[1]], vTri1[c], vTri2[d], vSegment );
+		bCoplanar = bHit;
+	} else if ( nShared == 1 ) {
+		int i = nShared1[0], j = nShared2[0];
+		bHit = IntersectTrianglesSharedVertex( vTri1[i], vTri1[(i+1)%3], vTri1[(i+2)%3], vTri2[(j+1)%3], vTri2[(j+2)%3], vSegment, &bCoplanar );
+	} else {
+		bHit = IntersectTriangles( vTri1, vTri2, vSegment, &bCoplanar );
+	}
+	if ( ! bHit )
+		return;
+
+	IntersectionPair pair;
+	pair.tID1 = ( bSelf && tID2 < tID1 ) ? tID2 : tID1;
+	pair.tID2 = ( bSelf && tID2 < tID1 ) ? tID1 : tID2;
+	pair.vSegment[0] = ToFloat(vSegment[0]);
+	pair.vSegment[1] = ToFloat(vSegment[1]);
+	pair.bCoplanar = bCoplanar;
+	vPairs.push_back(pair);
+}
@@ -8,9 +8,11 @@
 #include "config.h"
 #include <Wm4AxisAlignedBox3.h>
 #include <Wm4Ray3.h>
+#include <vector>
 
 #include "IMesh.h"
 #include "MemoryPool.h"
+#include "TriangleKernels.h"
 #include "rmsprofile.h"
 
 
@@ -34,25 +36,64 @@ public:
 
 	bool FindNearest( const Wml::Vector3f & vPoint, Wml::Vector3f & vNearest, IMesh::TriangleID & nNearestTri );
 
+	//! nearest point closer than fMaxDistance, subtrees further away are pruned. Returns false if there is none.
+	//! Does not set LastDistance(), so it is thread-safe after ExpandAll()
+	bool FindNearest( const Wml::Vector3f & vPoint, float fMaxDistance, Wml::Vector3f & vNearest, IMesh::TriangleID & nNearestTri, float & fDistance );
+
 	bool FindNearestVtx( const Wml::Vector3f & vPoint, IMesh::VertexID & nNearestVtx );
 
+	//! inside/outside test for closed, outward-oriented meshes. Casts rays in three fixed directions and checks
+	//! whether the nearest hit is a back face, majority vote. Thread-safe after ExpandAll()
+	bool IsInside( const Wml::Vector3f & vPoint );
+
+	//! any-hit query: true if the ray hits a triangle at a parameter t < fMaxT (a distance, for unit directions).
+	//! Stops at the first hit found, so is much cheaper than FindRayIntersection(). Thread-safe after ExpandAll()
+	bool TestOcclusion( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection, float fMaxT );
+
+	//! any-hit query for a batch of rays, traversed together: each node is visited once, with the rays
+	//! that reach it and are not occluded yet. Sets pOccluded[i] to 1 or 0. Thread-safe after ExpandAll()
+	void TestOcclusion( const Wml::Vector3f * pOrigins, const Wml::Vector3f * pDirections, unsigned int nRays,
+						float fMaxT, unsigned char * pOccluded );
+
 	//! get nearest distance for last query
 	float LastDistance() { return m_fLastQueryDistance; }
 
 	//! expand entire BV Tree (makes queries faster, but expensive)
 	void ExpandAll();
 
+
+	struct IntersectionPair {
+		IMesh::TriangleID tID1;			//! triangle of this mesh
+		IMesh::TriangleID tID2;			//! triangle of the other mesh (for self-intersections, of this mesh and > tID1)
+		Wml::Vector3f vSegment[2];		//! intersection segment (see TriangleIntersection.h)
+		bool bCoplanar;
+	};
+
+	//! Find all intersecting triangle pairs between this mesh and the mesh of other (which may be this tree).
+	//! Both trees are fully expanded first, then the dual-tree traversal is split into independent node-pair
+	//! tasks at the upper levels, which run in parallel (OpenMP). Pairs are sorted by (tID1, tID2).
+	void FindIntersections( IMeshBVTree & other, std::vector<IntersectionPair> & vPairs );
+
+	//! Find intersecting triangle pairs within this mesh. Triangles that share an edge or vertex are only
+	//! reported if they intersect away from the shared element (folds, crossings through a vertex).
+	void FindSelfIntersections( std::vector<IntersectionPair> & vPairs );
+
 protected:
 	IMesh * m_pMesh;
 
 	float m_fLastQueryDistance;
 
+	//! nodes with at most this many triangles are not expanded further, their triangles are tested as one TrianglePacket
+	enum { PacketSize = 4 };
+
 	class IMeshBVNode {
 	public:
 		unsigned int ID;
 		Wml::AxisAlignedBox3f Box;
 		IMeshBVTree::IMeshBVNode * pLeft;
 		IMeshBVTree::IMeshBVNode * pRight;
+		unsigned int nCount;		//! number of triangles below this node (set by ComputeBox)
+		unsigned int nPacket;		//! index into m_vPackets, or InvalidID if not built yet
 
 		union {
 			struct {
@@ -68,6 +109,9 @@ protected:
 		inline bool IsLeaf() {
 				return Triangle.TriangleList.NotLeaf == 0; }
 
+		inline bool IsPacket() {
+				return ! IsLeaf() && nCount <= PacketSize; }
+
 		inline void SetIndex( unsigned int nIndex ) {
 				Triangle.TriangleList.NotLeaf = 1;
 				Triangle.TriangleList.Index = nIndex; }
@@ -94,8 +138,8 @@ protected:
 
 
 	struct TriangleEntry {
-		unsigned int nJump : 12;		// 0xFFF
-		unsigned int nNodeID  : 20;		
+		unsigned int nJump;				// offset to next entry of the same node (last entry jumps to m_nMaxTriangle)
+		unsigned int nNodeID;			// full width, a fully expanded tree over a few M triangles has > 2^20 nodes
 		IMesh::TriangleID triID;
 	};
 	std::vector<TriangleEntry> m_vTriangles;
@@ -104,10 +148,14 @@ protected:
 	inline unsigned int GetNextEntryIdx( IMeshBVNode * pNode, unsigned int nIndex );
 	inline void SetJump( unsigned int nIndex, unsigned int nNext );
 
+	// packed triangles for small nodes (built lazily, like node expansion)
+	std::vector<TrianglePacket4> m_vPackets;
+	std::vector<IMesh::TriangleID> m_vPacketTris;		// PacketSize entries per packet
+	const TrianglePacket4 & GetPacket( IMeshBVNode * pNode );
+
 
 	struct Ray {
 		Ray( const Wml::Vector3f & vOrigin, const Wml::Vector3f & vDirection );
-		Wml::Ray3f wmlRay;
 		Wml::Vector3f origin;
 		Wml::Vector3f direction;
 		Wml::Vector3f inv_direction;
@@ -117,6 +165,8 @@ protected:
 	void ComputeBox( IMeshBVNode * pNode );
 	void ExpandNode( IMeshBVNode * pNode );
 	bool TestIntersection( IMeshBVNode * pNode, Ray & ray, float & fNear, float & fFar );
+	//! slab test clipped to [0,fMaxT], so it also accepts rays that start inside the box
+	inline bool TestOverlap( IMeshBVNode * pNode, const Ray & ray, float fMaxT );
 	float MinDistance( IMeshBVNode * pNode, const Wml::Vector3f & vPoint );
 
 	//! recursive intersection test
@@ -126,7 +176,21 @@ protected:
 	bool FindNearest( IMeshBVTree::IMeshBVNode * pNode, const Wml::Vector3f & vPoint, 
 					  Wml::Vector3f & vNearest, float & fNearest, IMesh::TriangleID & nNearestTri );
 
+	//! recursive batched any-hit test. pActive lists the rays to test, it is reordered in place
+	void TestOcclusion( IMeshBVTree::IMeshBVNode * pNode, std::vector<Ray> & vRays, unsigned int * pActive, unsigned int nActive,
+						float fMaxT, unsigned char * pOccluded );
+
 	void ExpandAll( IMeshBVTree::IMeshBVNode * pNode );
+
+	// dual-tree overlap traversal. A task with pA == pB (in self mode) is the self-test of that node
+	struct OverlapTask {
+		IMeshBVNode * pA;
+		IMeshBVNode * pB;
+	};
+	unsigned int GetNodeTriangles( IMeshBVNode * pNode, IMesh::TriangleID * pTris );
+	void FindOverlapTasks( IMeshBVTree & other, bool bSelf, std::vector<OverlapTask> & vTasks );
+	void FindOverlaps( IMeshBVTree & other, bool bSelf, IMeshBVNode * pA, IMeshBVNode * pB, std::vector<IntersectionPair> & vPairs );
+	void TestTrianglePair( IMeshBVTree & other, bool bSelf, IMesh::TriangleID tID1, IMesh::TriangleID tID2, std::vector<IntersectionPair> & vPairs );
 };
 
 
@@ -156,11 +220,7 @@ unsigned int IMeshBVTree::GetNextEntryIdx( IMeshBVTree::IMeshBVNode * pNode, uns
 
 void IMeshBVTree::SetJump( unsigned int nIndex, unsigned int nNext )
 {
-	if ( nNext - nIndex < 0xFFF ) {
-		m_vTriangles[nIndex].nJump = (nNext - nIndex) & 0xFFF;
-	} else {
-		m_vTriangles[nIndex].nJump = 0xFFF;
-	}
+	m_vTriangles[nIndex].nJump = nNext - nIndex;
 	if(m_vTriangles[nIndex].nJump == 0)
 		lgBreakToDebugger();
 }
@@ -4,8 +4,9 @@
 #include "IMeshUVBVTree.h"
 
 #include <limits>
+#include <vector>
 #include <VectorUtil.h>
-#include <Wm4DistVector3Triangle3.h>
+#include <TriangleKernels.h>
 #include <Wm4ContPointInPolygon2.h>
 
 //#include <WmlIntrLin3Tri3.h>
@@ -19,12 +20,14 @@ using namespace rms;
 IMeshUVBVTree::IMeshUVBVTree( )
 {
 	m_pMesh = NULL;
+	m_nUVSet = 0;
 	m_pRoot = NULL;
 }
 
 IMeshUVBVTree::IMeshUVBVTree( IMesh * pMesh )
 {
 	m_pMesh = pMesh;
+	m_nUVSet = 0;
 	m_pRoot = NULL;
 }
 
@@ -34,6 +37,12 @@ void IMeshUVBVTree::SetMesh( IMesh * pMesh )
 	m_pMesh = pMesh;
 }
 
+void IMeshUVBVTree::SetUVSet( IMesh::UVSetID nSetID )
+{
+	Clear();
+	m_nUVSet = nSetID;
+}
+
 
 bool IMeshUVBVTree::FindTriangle( const Wml::Vector2f & vUV, IMesh::TriangleID & nTri )
 {
@@ -57,7 +66,7 @@ bool IMeshUVBVTree::FindTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, const Wm
 			// ok, hit box, now try the triangle
 			IMesh::TriangleID tID = pNode->GetTriangleID();
 			Wml::Vector2f vTriUV[3];
-			if ( ! m_pMesh->GetTriangleUV(tID, 0, vTriUV) )
+			if ( ! m_pMesh->GetTriangleUV(tID, m_nUVSet, vTriUV) )
 				return false;
 
 			Wml::PointInPolygon2f piquery(3, vTriUV);
@@ -113,7 +122,7 @@ bool IMeshUVBVTree::FindNearestTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, c
 		// ok, hit box, now try the triangle
 		IMesh::TriangleID tID = pNode->GetTriangleID();
 		Wml::Vector2f vTriUV[3];
-		if ( ! m_pMesh->GetTriangleUV(tID, 0, vTriUV) )
+		if ( ! m_pMesh->GetTriangleUV(tID, m_nUVSet, vTriUV) )
 			return false;
 
 		// check if point is inside triangle...if so, distance is 0
@@ -127,16 +136,16 @@ bool IMeshUVBVTree::FindNearestTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, c
 		} else if ( (fDistance = MinDistance(pNode,vUV)) < fNearest ) {
 
 			// ok, hit box, now try the triangle (use 3D triangle dist...)
-			Wml::Triangle3f vTri( 
+			Wml::Vector3f vTri[3] = {
 				Wml::Vector3f(vTriUV[0].X(), vTriUV[0].Y(), 0.0f),
 				Wml::Vector3f(vTriUV[1].X(), vTriUV[1].Y(), 0.0f),
-				Wml::Vector3f(vTriUV[2].X(), vTriUV[2].Y(), 0.0f) );
+				Wml::Vector3f(vTriUV[2].X(), vTriUV[2].Y(), 0.0f) };
 			Wml::Vector3f vPoint( vUV.X(), vUV.Y(), 0.0f );
-			Wml::DistVector3Triangle3f dquery(vPoint, vTri);
-			float fTriDist = dquery.Get();
+			float fBary[3];
+			float fTriDist = (float)sqrt( PointTriangleSqrDistance( vPoint, vTri[0], vTri[1], vTri[2], fBary ) );
 			if ( fTriDist < fNearest ) {
-				Wml::Vector3f vNearest3 = dquery.GetClosestPoint1();
-				vNearest = Wml::Vector2f( vNearest3.X(), vNearest3.Y() );
+				fNearest = fTriDist;
+				vNearest = fBary[0]*vTriUV[0] + fBary[1]*vTriUV[1] + fBary[2]*vTriUV[2];
 				nTriID = pNode->GetTriangleID();
 				return true;
 			}
@@ -164,6 +173,32 @@ bool IMeshUVBVTree::FindNearestTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, c
 
 
 
+void IMeshUVBVTree::FindTriangles( const Wml::AxisAlignedBox2f & box, std::vector<IMesh::TriangleID> & vTris )
+{
+	if ( m_pRoot == NULL )
+		Initialize();
+	if ( m_pRoot && m_nMaxTriangle > 0 )
+		FindTriangles( m_pRoot, box, vTris );
+}
+
+void IMeshUVBVTree::FindTriangles( IMeshUVBVTree::IMeshUVBVNode * pNode, const Wml::AxisAlignedBox2f & box, std::vector<IMesh::TriangleID> & vTris )
+{
+	if ( ! pNode->Box.TestIntersection(box) )
+		return;
+
+	if ( pNode->IsLeaf() ) {
+		vTris.push_back( pNode->GetTriangleID() );
+	} else {
+		if ( pNode->HasChildren() == false ) 
+			ExpandNode( pNode );
+		FindTriangles( pNode->pLeft, box, vTris );
+		FindTriangles( pNode->pRight, box, vTris );
+	}
+}
+
+
+
+
 void IMeshUVBVTree::Clear()
 {
 	m_vTriangles.resize(0);
@@ -187,9 +222,9 @@ void IMeshUVBVTree::Initialize()
 {
 	Clear();
 
-	if ( ! m_pMesh->HasUVSet(0) )
+	if ( ! m_pMesh->HasUVSet(m_nUVSet) )
 		DebugBreak();
-	IMesh::UVSet & uvset = m_pMesh->GetUVSet(0);
+	IMesh::UVSet & uvset = m_pMesh->GetUVSet(m_nUVSet);
 
 	m_pRoot = GetNewNode();
 
@@ -231,7 +266,7 @@ void IMeshUVBVTree::ComputeBox( IMeshUVBVNode * pNode )
 	Wml::Vector2f vTriUV[3];
 
 	if ( pNode->IsLeaf() ) {
-		m_pMesh->GetTriangleUV( pNode->GetTriangleID(), 0, vTriUV );
+		m_pMesh->GetTriangleUV( pNode->GetTriangleID(), m_nUVSet, vTriUV );
 		pNode->Box = Wml::AxisAlignedBox2f(
 			vTriUV[0].X(), vTriUV[0].X(), vTriUV[0].Y(), vTriUV[0].Y() );
 		for ( int j = 1; j < 3; ++j )
@@ -241,7 +276,7 @@ void IMeshUVBVTree::ComputeBox( IMeshUVBVNode * pNode )
 		unsigned int nIndex = pNode->GetIndex();
 
 		// initialize first box
-		m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, 0, vTriUV );
+		m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, m_nUVSet, vTriUV );
 		pNode->Box = Wml::AxisAlignedBox2f(
 			vTriUV[0].X(), vTriUV[0].X(), vTriUV[0].Y(), vTriUV[0].Y() );
 		for ( int j = 1; j < 3; ++j )
@@ -250,7 +285,7 @@ void IMeshUVBVTree::ComputeBox( IMeshUVBVNode * pNode )
 
 		// iterate over rest of boxes
 		while ( nIndex < m_nMaxTriangle ) {
-			m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, 0, vTriUV );
+			m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, m_nUVSet, vTriUV );
 			for ( int j = 0; j < 3; ++j )
 				pNode->Union( vTriUV[j].X(), vTriUV[j].Y() );
 			nIndex = GetNextEntryIdx(pNode, nIndex);
@@ -273,7 +308,7 @@ void IMeshUVBVTree::ExpandNode( IMeshUVBVTree::IMeshUVBVNode * pNode )
 	unsigned int nCount = 0;
 	unsigned int nIndex = pNode->GetIndex();
 	while ( nIndex < m_nMaxTriangle ) {
-		if (! m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, 0, vTriUV ) )
+		if (! m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, m_nUVSet, vTriUV ) )
 			DebugBreak();
 		vMeans += (1.0f/3.0f) * Wml::Vector2f( vTriUV[0] + vTriUV[1] + vTriUV[2] );
 		++nCount;
@@ -303,7 +338,7 @@ void IMeshUVBVTree::ExpandNode( IMeshUVBVTree::IMeshUVBVNode * pNode )
 	while ( nIndex < m_nMaxTriangle ) {
 		unsigned int nNextIndex = GetNextEntryIdx(pNode, nIndex);
 
-		m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, 0, vTriUV );
+		m_pMesh->GetTriangleUV( m_vTriangles[nIndex].triID, m_nUVSet, vTriUV );
 		Wml::Vector2f vCentroid( vTriUV[0] + vTriUV[1] + vTriUV[2] );
 		vCentroid *= (1.0f / 3.0f);
 
@@ -333,8 +368,8 @@ void IMeshUVBVTree::ExpandNode( IMeshUVBVTree::IMeshUVBVNode * pNode )
 	// handle bad case where some child ended up with no nodes
 	if ( nLeftCount == 0 || nRightCount == 0 ) {
 		IMeshUVBVNode * pUseNode = (nLeftCount == 0) ? pRight : pLeft;
-		int nLastLeft = -1;
-		int nLastRight = -1;
+		nLastLeft = -1;
+		nLastRight = -1;
 		nLeftCount = nRightCount = 0;
 
 		bool bLeft = true;
@@ -370,7 +405,10 @@ void IMeshUVBVTree::ExpandNode( IMeshUVBVTree::IMeshUVBVNode * pNode )
 	lgASSERT( nLeftCount != 0 && nRightCount != 0 );
 	if ( nLeftCount == 0 || nRightCount == 0 )
 		DebugBreak();
-	
+
+	// terminate both entry lists, so that iterating over a node never has to scan past its last entry
+	m_vTriangles[ nLastLeft ].nJump = m_nMaxTriangle - nLastLeft;
+	m_vTriangles[ nLastRight ].nJump = m_nMaxTriangle - nLastRight;
 	
 	// set leaf flags
 	if ( nLeftCount == 1 ) {
@@ -398,7 +436,8 @@ void IMeshUVBVTree::ExpandAll()
 void IMeshUVBVTree::ExpandAll( IMeshUVBVTree::IMeshUVBVNode * pNode )
 {
 	if ( ! pNode->IsLeaf() ) {
-		ExpandNode(pNode);
+		if ( pNode->HasChildren() == false )
+			ExpandNode(pNode);
 		ExpandAll(pNode->pLeft);
 		ExpandAll(pNode->pRight);
 	}
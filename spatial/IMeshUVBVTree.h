@@ -21,15 +21,22 @@ public:
 
 	void SetMesh( IMesh * pMesh );
 
+	//! UV set the tree is built over (default 0). Clears the tree
+	void SetUVSet( IMesh::UVSetID nSetID );
+
 	void Clear();
 
 	bool FindTriangle( const Wml::Vector2f & vUV, IMesh::TriangleID & nTri );
 	bool FindNearestTriangle( const Wml::Vector2f & vUV, Wml::Vector2f & vNearest, IMesh::TriangleID & nTri );
 
+	//! append the triangles whose UV bounding box overlaps box. Thread-safe after ExpandAll()
+	void FindTriangles( const Wml::AxisAlignedBox2f & box, std::vector<IMesh::TriangleID> & vTris );
+
 	void ExpandAll();
 
 protected:
 	IMesh * m_pMesh;
+	IMesh::UVSetID m_nUVSet;
 
 	class IMeshUVBVNode {
 	public:
@@ -76,8 +83,8 @@ protected:
 	void Initialize();
 
 	struct TriangleEntry {
-		unsigned int nJump : 12;		// 0xFFF
-		unsigned int nNodeID  : 20;		
+		unsigned int nJump;				// offset to next entry of the same node (last entry jumps to m_nMaxTriangle)
+		unsigned int nNodeID;
 		IMesh::TriangleID triID;
 	};
 	std::vector<TriangleEntry> m_vTriangles;
@@ -97,6 +104,7 @@ protected:
 	bool FindTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, const Wml::Vector2f & vUV, IMesh::TriangleID & nTri );
 	bool FindNearestTriangle( IMeshUVBVTree::IMeshUVBVNode * pNode, const Wml::Vector2f & vUV, 
 		Wml::Vector2f & vNearest, float & fNearest, IMesh::TriangleID & nTri );
+	void FindTriangles( IMeshUVBVTree::IMeshUVBVNode * pNode, const Wml::AxisAlignedBox2f & box, std::vector<IMesh::TriangleID> & vTris );
 };
 
 
@@ -128,11 +136,7 @@ unsigned int IMeshUVBVTree::GetNextEntryIdx( IMeshUVBVTree::IMeshUVBVNode * pNod
 
 void IMeshUVBVTree::SetJump( unsigned int nIndex, unsigned int nNext )
 {
-	if ( nNext - nIndex < 0xFFF ) {
-		m_vTriangles[nIndex].nJump = (nNext - nIndex) & 0xFFF;
-	} else {
-		m_vTriangles[nIndex].nJump = 0xFFF;
-	}
+	m_vTriangles[nIndex].nJump = nNext - nIndex;
 	if ( m_vTriangles[nIndex].nJump == 0 )
 		lgBreakToDebugger();
 }
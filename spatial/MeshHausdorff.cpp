@@ -0,0 +1,332 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "MeshHausdorff.h"
+#include "SpatialSort.h"
+#include "TriangleKernels.h"
+
+#include <limits>
+#include <algorithm>
+#include <cmath>
+
+using namespace rms;
+
+
+namespace {
+
+struct MeshHausdorff_SubTriangle {
+	Wml::Vector3f v[3];
+	float d[3];				// distance of v[i] to the other mesh
+	IMesh::TriangleID t[3];	// nearest triangle of v[i] in the other mesh
+	int nDepth;
+};
+
+}  // end anonymous namespace
+
+
+
+MeshHausdorff::MeshHausdorff()
+{
+	m_pMesh[0] = m_pMesh[1] = NULL;
+	m_bTreesExpanded = false;
+	m_fTolerance = 0.001f;
+}
+
+MeshHausdorff::~MeshHausdorff()
+{
+}
+
+
+void MeshHausdorff::SetMeshes( VFTriangleMesh * pMeshA, VFTriangleMesh * pMeshB )
+{
+	m_pMesh[0] = pMeshA;
+	m_pMesh[1] = pMeshB;
+	m_Tree[0].SetMesh( pMeshA );
+	m_Tree[1].SetMesh( pMeshB );
+	m_bTreesExpanded = false;
+	m_vVertexError[0].resize(0);
+	m_vVertexError[1].resize(0);
+	m_vVertexNearest[0].resize(0);
+	m_vVertexNearest[1].resize(0);
+}
+
+
+bool MeshHausdorff::ComputeOneSided( Result & result, bool bAToB )
+{
+	if ( m_pMesh[0] == NULL || m_pMesh[1] == NULL || m_pMesh[0]->GetTriangleCount() == 0 || m_pMesh[1]->GetTriangleCount() == 0 )
+		return false;
+
+	// queries are read-only (and so thread-safe) on expanded trees
+	if ( ! m_bTreesExpanded ) {
+		m_Tree[0].ExpandAll();
+		m_Tree[1].ExpandAll();
+		m_bTreesExpanded = true;
+	}
+
+	int nFrom = (bAToB) ? 0 : 1;
+	m_vVertexError[1-nFrom].resize(0);
+
+	result.fLower = 0;
+	result.fUpper = 0;
+	result.vWorstPoint = Wml::Vector3f::ZERO;
+	result.nWorstMesh = nFrom;
+	result.nSamples = 0;
+	result.bCertified = true;
+
+	ComputeVertexErrors( nFrom, result );
+	RefineTriangles( nFrom, result );
+	return true;
+}
+
+
+bool MeshHausdorff::ComputeSymmetric( Result & result )
+{
+	Result resultB;
+	if ( ! ComputeOneSided( resultB, false ) )
+		return false;
+	std::vector<float> vErrorB;
+	vErrorB.swap( m_vVertexError[1] );
+	ComputeOneSided( result, true );
+	m_vVertexError[1].swap( vErrorB );
+
+	if ( resultB.fLower > result.fLower ) {
+		result.fLower = resultB.fLower;
+		result.vWorstPoint = resultB.vWorstPoint;
+		result.nWorstMesh = 1;
+	}
+	result.fUpper = std::max( result.fUpper, resultB.fUpper );
+	result.nSamples += resultB.nSamples;
+	result.bCertified = result.bCertified && resultB.bCertified;
+	return true;
+}
+
+
+IMesh::ScalarSetID MeshHausdorff::AppendErrorScalarSet( int nMesh )
+{
+	VFTriangleMesh * pMesh = m_pMesh[nMesh];
+	const std::vector<float> & vError = m_vVertexError[nMesh];
+	if ( pMesh == NULL || vError.size() != pMesh->GetMaxVertexID() )
+		return IMesh::InvalidID;
+
+	IMesh::ScalarSetID nSetID = pMesh->AppendScalarSet();
+	pMesh->InitializeScalarSet( nSetID );
+	VFTriangleMesh::vertex_iterator curv(pMesh->BeginVertices()), endv(pMesh->EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		pMesh->SetScalar( vID, nSetID, vError[vID] );
+	}
+	return nSetID;
+}
+
+
+
+float MeshHausdorff::Distance( int nTo, const Wml::Vector3f & vPoint, float fBound, IMesh::TriangleID & tID )
+{
+	Wml::Vector3f vNearest;
+	float fDistance;
+
+	// bound is slightly inflated, it was computed in float from other float distances
+	if ( fBound < std::numeric_limits<float>::max() ) {
+		if ( m_Tree[nTo].FindNearest( vPoint, fBound * 1.001f + std::numeric_limits<float>::min(), vNearest, tID, fDistance ) )
+			return fDistance;
+	}
+	m_Tree[nTo].FindNearest( vPoint, std::numeric_limits<float>::max(), vNearest, tID, fDistance );
+	return fDistance;
+}
+
+
+
+void MeshHausdorff::ComputeVertexErrors( int nFrom, Result & result )
+{
+	const VFTriangleMesh & mesh = *m_pMesh[nFrom];
+	std::vector<float> & vError = m_vVertexError[nFrom];
+	vError.resize(0);
+	vError.resize( mesh.GetMaxVertexID(), 0.0f );
+	std::vector<IMesh::TriangleID> & vNearest = m_vVertexNearest[nFrom];
+	vNearest.resize(0);
+	vNearest.resize( mesh.GetMaxVertexID(), IMesh::InvalidID );
+
+	std::vector<IMesh::VertexID> vVerts;
+	std::vector<double> vPoints;
+	vVerts.reserve( mesh.GetVertexCount() );
+	vPoints.reserve( 3*mesh.GetVertexCount() );
+	VFTriangleMesh::vertex_iterator curv(mesh.BeginVertices()), endv(mesh.EndVertices());
+	while ( curv != endv ) {
+		IMesh::VertexID vID = *curv;  ++curv;
+		const Wml::Vector3f & v = mesh.GetVertex(vID);
+		vVerts.push_back( vID );
+		vPoints.push_back( v.X() );  vPoints.push_back( v.Y() );  vPoints.push_back( v.Z() );
+	}
+	int nVerts = (int)vVerts.size();
+	if ( nVerts == 0 )
+		return;
+
+	// consecutive vertices along the curve are close, so each one bounds the search for the next
+	std::vector<unsigned int> vOrder;
+	HilbertOrder( &vPoints[0], nVerts, 3, vOrder );
+
+	int nBlocks = (nVerts + VertexBlockSize - 1) / VertexBlockSize;
+	#pragma omp parallel for schedule(dynamic,4)
+	for ( int bi = 0; bi < nBlocks; ++bi ) {
+		int nEnd = std::min( nVerts, (bi+1)*VertexBlockSize );
+		Wml::Vector3f vPrev;
+		float fPrev = -1.0f;
+		for ( int k = bi*VertexBlockSize; k < nEnd; ++k ) {
+			IMesh::VertexID vID = vVerts[ vOrder[k] ];
+			const Wml::Vector3f & v = mesh.GetVertex(vID);
+			float fBound = (fPrev < 0) ? std::numeric_limits<float>::max() : fPrev + (v - vPrev).Length();
+			fPrev = vError[vID] = Distance( 1-nFrom, v, fBound, vNearest[vID] );
+			vPrev = v;
+		}
+	}
+
+	// largest vertex distance (lowest ID on ties)
+	for ( int k = 0; k < nVerts; ++k ) {
+		if ( vError[ vVerts[k] ] > result.fLower ) {
+			result.fLower = vError[ vVerts[k] ];
+			result.vWorstPoint = mesh.GetVertex( vVerts[k] );
+		}
+	}
+	result.fUpper = std::max( result.fUpper, result.fLower );
+	result.nSamples += nVerts;
+}
+
+
+
+void MeshHausdorff::RefineTriangles( int nFrom, Result & result )
+{
+	const VFTriangleMesh & mesh = *m_pMesh[nFrom];
+	const std::vector<float> & vError = m_vVertexError[nFrom];
+	const std::vector<IMesh::TriangleID> & vNearest = m_vVertexNearest[nFrom];
+	const VFTriangleMesh & other = *m_pMesh[1-nFrom];
+	int nMaxTID = (int)mesh.GetMaxTriangleID();
+	const float fInvSqrt3 = 1.0f / sqrt(3.0f);
+
+	// each triangle is only compared to the vertex maximum and its own samples, so the
+	// samples that are taken don't depend on the order triangles are processed in
+	float fLower0 = result.fLower;
+
+	float fUpper = result.fUpper;
+	float fBest = fLower0;
+	Wml::Vector3f vBest( result.vWorstPoint );
+	int nBestTri = -1;
+	unsigned int nSamples = 0;
+	int nUncertified = 0;
+
+	#pragma omp parallel
+	{
+		float fThreadUpper = fUpper;
+		float fThreadBest = fLower0;
+		Wml::Vector3f vThreadBest( vBest );
+		int nThreadBestTri = -1;
+		unsigned int nThreadSamples = 0;
+		int nThreadUncertified = 0;
+		std::vector<MeshHausdorff_SubTriangle> vStack;
+
+		#pragma omp for schedule(dynamic,1024)
+		for ( int ti = 0; ti < nMaxTID; ++ti ) {
+			if ( ! mesh.IsTriangle(ti) )
+				continue;
+			IMesh::VertexID nTri[3];
+			mesh.GetTriangle( ti, nTri );
+			MeshHausdorff_SubTriangle tri;
+			for ( int j = 0; j < 3; ++j ) {
+				tri.v[j] = mesh.GetVertex( nTri[j] );
+				tri.d[j] = vError[ nTri[j] ];
+				tri.t[j] = vNearest[ nTri[j] ];
+			}
+			tri.nDepth = 0;
+			vStack.push_back( tri );
+
+			float fLocal = fLower0;
+			while ( ! vStack.empty() ) {
+				tri = vStack.back();
+				vStack.pop_back();
+
+				// distance is 1-Lipschitz, and every point is within longest-edge / sqrt(3) of a vertex
+				float fLongest = 0;
+				for ( int j = 0; j < 3; ++j )
+					fLongest = std::max( fLongest, (tri.v[(j+1)%3] - tri.v[j]).SquaredLength() );
+				float fBound = std::max( tri.d[0], std::max(tri.d[1], tri.d[2]) ) + sqrt(fLongest) * fInvSqrt3;
+
+				// distance to a fixed triangle is convex, so on the piece it is largest at a corner.
+				// This bound is tight where the whole piece is nearest to one triangle of the other mesh
+				for ( int k = 0; k < 3 && fBound > fLocal + m_fTolerance; ++k ) {
+					if ( (k > 0 && tri.t[k] == tri.t[0]) || (k > 1 && tri.t[k] == tri.t[1]) )
+						continue;
+					Wml::Vector3f vTri[3];
+					other.GetTriangle( tri.t[k], vTri );
+					float fMaxSqr = 0, fBary[3];
+					for ( int j = 0; j < 3; ++j ) {
+						if ( j != k )
+							fMaxSqr = std::max( fMaxSqr, PointTriangleSqrDistance( tri.v[j], vTri[0], vTri[1], vTri[2], fBary ) );
+					}
+					fBound = std::min( fBound, std::max( tri.d[k], (float)sqrt(fMaxSqr) ) );
+				}
+				if ( fBound <= fLocal + m_fTolerance || tri.nDepth == MaxDepth ) {
+					fThreadUpper = std::max( fThreadUpper, fBound );
+					if ( fBound > fLocal + m_fTolerance )
+						++nThreadUncertified;
+					continue;
+				}
+
+				// split 1-to-4 at the edge midpoints
+				Wml::Vector3f vMid[3];
+				float fMid[3];
+				IMesh::TriangleID tMid[3];
+				for ( int j = 0; j < 3; ++j ) {
+					int j2 = (j+1) % 3;
+					vMid[j] = 0.5f * ( tri.v[j] + tri.v[j2] );
+					float fHalf = 0.5f * (tri.v[j2] - tri.v[j]).Length();
+					fMid[j] = Distance( 1-nFrom, vMid[j], std::min(tri.d[j], tri.d[j2]) + fHalf, tMid[j] );
+					++nThreadSamples;
+					if ( fMid[j] > fLocal ) {
+						fLocal = fMid[j];
+						if ( fMid[j] > fThreadBest || (fMid[j] == fThreadBest && ti < nThreadBestTri) ) {
+							fThreadBest = fMid[j];
+							vThreadBest = vMid[j];
+							nThreadBestTri = ti;
+						}
+					}
+				}
+
+				MeshHausdorff_SubTriangle sub;
+				sub.nDepth = tri.nDepth + 1;
+				for ( int j = 0; j < 3; ++j ) {
+					int jp = (j+2) % 3;		// midpoint of edge before corner j
+					sub.v[0] = tri.v[j];   sub.d[0] = tri.d[j];   sub.t[0] = tri.t[j];
+					sub.v[1] = vMid[j];    sub.d[1] = fMid[j];    sub.t[1] = tMid[j];
+					sub.v[2] = vMid[jp];   sub.d[2] = fMid[jp];   sub.t[2] = tMid[jp];
+					vStack.push_back( sub );
+				}
+				for ( int j = 0; j < 3; ++j ) {
+					sub.v[j] = vMid[j];
+					sub.d[j] = fMid[j];
+					sub.t[j] = tMid[j];
+				}
+				vStack.push_back( sub );
+			}
+		}
+
+		#pragma omp critical(MeshHausdorff_RefineTriangles)
+		{
+			fUpper = std::max( fUpper, fThreadUpper );
+			nSamples += nThreadSamples;
+			nUncertified += nThreadUncertified;
+			if ( nThreadBestTri >= 0 && ( fThreadBest > fBest || (fThreadBest == fBest && (nBestTri < 0 || nThreadBestTri < nBestTri)) ) ) {
+				fBest = fThreadBest;
+				vBest = vThreadBest;
+				nBestTri = nThreadBestTri;
+			}
+		}
+	}
+
+	if ( nBestTri >= 0 ) {
+		result.fLower = fBest;
+		result.vWorstPoint = vBest;
+	}
+	result.fUpper = std::max( fUpper, result.fLower );
+	result.nSamples += nSamples;
+	result.bCertified = result.bCertified && (nUncertified == 0);
+}
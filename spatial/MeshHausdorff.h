@@ -0,0 +1,90 @@
+// Copyright Ryan Schmidt 2011.
+// Distributed under the Boost Software License, Version 1.0.
+// (See copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef __RMS_MESH_HAUSDORFF_H__
+#define __RMS_MESH_HAUSDORFF_H__
+#include "config.h"
+#include <vector>
+
+#include "VFTriangleMesh.h"
+#include "IMeshBVTree.h"
+
+namespace rms
+{
+
+/*
+ * Hausdorff distance between two meshes, with a certified error bound.
+ *
+ * The distance to the other mesh is 1-Lipschitz, so for a triangle with vertex distances d_i,
+ * no point is further than max(d_i) + R, where R is the largest distance from a point of the triangle
+ * to its nearest vertex. Triangles whose bound is not within the tolerance of the largest distance
+ * sampled on them (or at any vertex) are subdivided (adaptively, 1-to-4) and sampled at the new points, until every piece
+ * is certified. The result is an interval [fLower, fUpper] that contains the exact distance, with
+ * fUpper - fLower <= tolerance.
+ *
+ * Nearest-point queries go to the BVTree of the other mesh, with the Lipschitz bound from an
+ * already-evaluated nearby point as the initial search radius, so most of the tree is pruned.
+ * Vertices are evaluated in Hilbert order for this reason. Vertices and triangles are processed in
+ * parallel (OpenMP). Each triangle is refined against the largest vertex distance (not the running
+ * maximum of other threads), so the result does not depend on the thread count.
+ *
+ * The per-vertex distances (of the last Compute) can be stored in a ScalarSet of each mesh.
+ */
+class MeshHausdorff
+{
+public:
+	MeshHausdorff();
+	~MeshHausdorff();
+
+	//! meshes are not modified. Trees are built (fully expanded) on the first Compute()
+	void SetMeshes( VFTriangleMesh * pMeshA, VFTriangleMesh * pMeshB );
+
+	//! absolute tolerance of the result interval (default 0.001)
+	void SetTolerance( float fTolerance ) { m_fTolerance = fTolerance; }
+	float GetTolerance() const { return m_fTolerance; }
+
+	struct Result {
+		float fLower;					//! largest distance found at a sample point
+		float fUpper;					//! certified upper bound on the distance
+		Wml::Vector3f vWorstPoint;		//! sample point at fLower
+		int nWorstMesh;					//! mesh of vWorstPoint (0 = A, 1 = B)
+		unsigned int nSamples;			//! number of nearest-point queries
+		bool bCertified;				//! false if subdivision hit its depth limit before fUpper - fLower <= tolerance
+	};
+
+	//! one-sided distance max_{p in A} d(p,B) (or B to A if bAToB is false)
+	bool ComputeOneSided( Result & result, bool bAToB = true );
+
+	//! max of the two one-sided distances
+	bool ComputeSymmetric( Result & result );
+
+	//! append a ScalarSet to mesh A (nMesh = 0) or B with the distance of each vertex to the other mesh.
+	//! That direction must have been evaluated by the last Compute. Returns InvalidID otherwise
+	IMesh::ScalarSetID AppendErrorScalarSet( int nMesh );
+
+	//! per-vertex distances of the last Compute (indexed by VertexID, empty if not evaluated)
+	const std::vector<float> & GetVertexErrors( int nMesh ) const { return m_vVertexError[nMesh]; }
+
+protected:
+	VFTriangleMesh * m_pMesh[2];
+	IMeshBVTree m_Tree[2];
+	bool m_bTreesExpanded;
+	float m_fTolerance;
+
+	std::vector<float> m_vVertexError[2];
+	std::vector<IMesh::TriangleID> m_vVertexNearest[2];
+
+	enum { VertexBlockSize = 256, MaxDepth = 20 };
+
+	void ComputeVertexErrors( int nFrom, Result & result );
+	void RefineTriangles( int nFrom, Result & result );
+
+	//! distance from vPoint to mesh nTo, with fBound a known upper bound (or FLT_MAX). tID is the nearest triangle
+	float Distance( int nTo, const Wml::Vector3f & vPoint, float fBound, IMesh::TriangleID & tID );
+};
+
+
+
+}  // end namespace rms
+
+#endif // __RMS_MESH_HAUSDORFF_H__